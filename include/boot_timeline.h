@@ -0,0 +1,39 @@
+#ifndef __BOOT_TIMELINE_H__
+#define __BOOT_TIMELINE_H__
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+// Start and end of every init stage in microseconds since boot (esp_timer_get_time()), logged
+// as each stage ends and published on /boot. Stages run on different tasks, each one is
+// recorded by one task only and only the first time, so there is no lock.
+//
+// Independent stages run side by side: the sensor and LCD jobs start before the filesystem is
+// mounted, and the web server no longer waits for the WiFi association before its loop sends the
+// first sensor values. first_publish is the first sensor broadcast that carries a valid DHT
+// reading, the time until a dashboard can show something useful after power-on.
+
+enum BootStage : uint8_t {
+    BOOT_SETUP,             // setup(), until all tasks are created
+    BOOT_CONFIG,            // LittleFS mount and config load
+    BOOT_LCD,               // I2C and LCD init
+    BOOT_DHT_WARMUP,        // Until the DHT11 answers after power-on
+    BOOT_FIRST_DHT,         // First valid DHT reading
+    BOOT_FIRST_LIGHT,
+    BOOT_WEB_SERVER,        // Web server and WebSocket set up and listening
+    BOOT_WIFI,              // Station association with the saved login
+    BOOT_FIRST_PUBLISH,
+    BOOT_STAGE_COUNT
+};
+
+void boot_stage_begin(BootStage stage);
+void boot_stage_end(BootStage stage);
+// A stage without duration
+void boot_mark(BootStage stage);
+// True once the stage ended
+bool boot_stage_done(BootStage stage);
+
+// Producer for ResponseStream, writes the timeline as one JSON object
+bool boot_timeline_write(Print& out, size_t item);
+
+#endif
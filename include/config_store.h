@@ -0,0 +1,74 @@
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Device configuration (WiFi login, CoreIOT connection) in one binary file on LittleFS. It
+// replaces /info.dat, JSON read into a 4 KB document, and the WiFi login in the "wifi-config"
+// Preferences, which were written by different code and could disagree. Both are moved into the
+// file on the first boot that does not find it.
+//
+// The file is a header with the schema version, the config and a CRC. A new config is written to
+// CONFIG_TMP_PATH and renamed over the old file, a reset while writing leaves the old config.
+//
+// Changes used to restart the device. Now the listeners of the parts that changed are called once
+// the new config is written, on the task that changed it, and reconfigure their part while the
+// rest keeps running.
+//
+// The channel and BSSID of the access point the station last joined are kept with the login, the
+// next connect goes to them directly instead of scanning every channel first. They are dropped
+// with the login they belong to.
+
+#define CONFIG_PATH "/config.bin"
+#define CONFIG_TMP_PATH "/config.tmp"
+#define CONFIG_LEGACY_PATH "/info.dat"
+#define CONFIG_MAGIC 0x31474643     // "CFG1"
+#define CONFIG_VERSION 2         // Versions only append fields
+#define CONFIG_MAX_LISTENERS 4
+#define CONFIG_MAX_SSID 32          // 802.11 limits
+#define CONFIG_MAX_PASSWORD 64
+#define CONFIG_MAX_TOKEN 64
+#define CONFIG_MAX_SERVER 64
+
+enum ConfigPart : uint8_t {
+    CONFIG_WIFI = 1 << 0,
+    CONFIG_CORE_IOT = 1 << 1,
+    CONFIG_WIFI_CACHE = 1 << 2      // Channel and BSSID of the last connect
+};
+
+// Written as it is, so there is no padding
+struct DeviceConfig {
+    char wifiSsid[CONFIG_MAX_SSID + 1];
+    char wifiPassword[CONFIG_MAX_PASSWORD + 1];
+    char coreIotToken[CONFIG_MAX_TOKEN + 1];
+    char coreIotServer[CONFIG_MAX_SERVER + 1];
+    uint16_t coreIotPort;       // 0 if not set
+    // Version 2
+    uint8_t wifiBssid[6];
+    uint8_t wifiChannel;        // 0 if not known
+    uint8_t reserved;           // Zero
+};
+
+// changed holds the ConfigPart bits of the parts that differ from the previous config
+typedef void (*ConfigListener)(uint8_t changed, const DeviceConfig& config, void* arg);
+
+// Mounts LittleFS and loads the config, moving the old files into it if there is none yet.
+// Call it once before any other function.
+bool config_begin();
+void config_get(DeviceConfig& config);
+// Writes the config and calls the listeners of the parts that changed. Nothing is written if
+// nothing changed, false if the file could not be written (the config stays the old one then).
+// The channel and BSSID of config are ignored, they are only set with config_set_wifi_cache.
+bool config_set(const DeviceConfig& config);
+bool config_set_wifi(const char* ssid, const char* password);
+// Remembers where the station is connected to now, for the next connect with the same login
+bool config_set_wifi_cache(uint8_t channel, const uint8_t* bssid);
+// Forgets the WiFi login and the CoreIOT connection
+bool config_clear();
+// Calls listener after changes to any of parts (ConfigPart bits). Listeners must not change the
+// config themselves.
+void config_listen(uint8_t parts, ConfigListener listener, void* arg);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef __DEFERRED_LOG_H__
+#define __DEFERRED_LOG_H__
+
+#include <Arduino.h>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Deferred logger: call sites only store the message id and the raw arguments in a
+// lock-free ring of the calling task, the "Log Drain" task formats them (or ships
+// them raw, see scripts/decode_log.py) and is the only one writing to Serial.
+//
+//   LOG(DHT_READ_FAILED);
+//   LOG(LIGHT_LEVEL, lightLevel, glob_led_state ? "ON" : "OFF");
+//
+// Messages are declared in log_messages.def.
+
+#define LOG_RING_SIZE 1024      // Bytes per task, power of two
+#define LOG_MAX_RINGS 8         // Tasks that can log
+#define LOG_MAX_RECORD 128      // Bytes per message including the header
+#define LOG_MAX_STRING 32       // Bytes copied per %s argument
+#define LOG_DRAIN_INTERVAL_MS 50
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_NONE
+};
+
+enum LogId : uint16_t {
+#define LOG_MESSAGE(id, level, format) LOG_##id,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+    LOG_MESSAGE_COUNT
+};
+
+extern const uint8_t LOG_MESSAGE_LEVELS[LOG_MESSAGE_COUNT];
+extern volatile uint8_t log_level;
+
+// Starts the drain task, raw ships binary frames instead of text
+void log_begin(bool raw = false);
+void log_set_level(LogLevel level);
+void log_set_raw(bool raw);
+
+// Message being encoded on the stack of the calling task:
+// u8 length, u16 id, u32 millis, then the arguments (4 bytes each, strings as u8 length + bytes)
+class LogRecord {
+public:
+    explicit LogRecord(uint16_t id);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(T value) {
+        int32_t raw = (int32_t)value;
+        append(&raw, sizeof(raw));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(T value) {
+        float raw = (float)value;
+        append(&raw, sizeof(raw));
+    }
+
+    void put(const char* value);
+    void put(const String& value) { put(value.c_str()); }
+
+    // Copies the record into the ring of the calling task, drops it if the ring is full
+    void commit();
+
+private:
+    uint8_t data[LOG_MAX_RECORD];
+    size_t len;
+    bool truncated;
+
+    void append(const void* value, size_t size);
+};
+
+inline void log_put_all(LogRecord& record) {
+    (void)record;
+}
+
+template <typename T, typename... Args>
+inline void log_put_all(LogRecord& record, T value, Args... args) {
+    record.put(value);
+    log_put_all(record, args...);
+}
+
+template <typename... Args>
+inline void log_message(LogId id, Args... args) {
+    // Disabled levels cost a table lookup and nothing else
+    if (LOG_MESSAGE_LEVELS[id] < log_level) {
+        return;
+    }
+    LogRecord record(id);
+    log_put_all(record, args...);
+    record.commit();
+}
+
+#define LOG(id, ...) log_message(LOG_##id, ##__VA_ARGS__)
+
+#endif
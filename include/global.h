@@ -5,20 +5,27 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "config_store.h"
 
+// Used by the jobs on the acquisition core only, the web server gets the readings through
+// sensor_channel.h
 extern float glob_temperature;
 extern float glob_humidity;
 extern int glob_light_level;
+// millis() when the values above were read
+extern uint32_t glob_dht_read_ms;
+extern uint32_t glob_light_read_ms;
 extern bool glob_led_state;
 extern bool glob_temp_alert;
 extern float HIGH_TEMP_THRESHOLD;
 
-extern String WIFI_SSID;
-extern String WIFI_PASS;
-extern String CORE_IOT_TOKEN;
-extern String CORE_IOT_SERVER;
-extern String CORE_IOT_PORT;
+// Copies of the device config, updated by config_store.cpp. Fixed arrays, so they are part of
+// the static image and not of the heap (memory_budget.h).
+extern char WIFI_SSID[CONFIG_MAX_SSID + 1];
+extern char WIFI_PASS[CONFIG_MAX_PASSWORD + 1];
+extern char CORE_IOT_TOKEN[CONFIG_MAX_TOKEN + 1];
+extern char CORE_IOT_SERVER[CONFIG_MAX_SERVER + 1];
+extern uint16_t CORE_IOT_PORT;      // 0 if not set
 
 extern boolean isWifiConnected;
-extern SemaphoreHandle_t xBinarySemaphoreInternet;
 #endif
\ No newline at end of file
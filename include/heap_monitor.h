@@ -0,0 +1,51 @@
+#ifndef __HEAP_MONITOR_H__
+#define __HEAP_MONITOR_H__
+
+#include <Arduino.h>
+
+// Heap health over days. The free heap alone does not show fragmentation: a unit can have plenty
+// free and still fail a 4 KB allocation. heap_monitor_poll() reads the free heap and the largest
+// free block every HEAP_MONITOR_POLL_MS and keeps the worst values of each HEAP_MONITOR_INTERVAL_MS,
+// the last HEAP_MONITOR_SAMPLES intervals (a week) are kept. The fragmentation ratio is the
+// share of the free heap that is not in the largest block, 0 for one contiguous block.
+//
+// The firmware's recurring allocations are counted per site (heap_sites.def), every sample holds
+// how many there were in its interval. Messages, JSON documents and the display text are
+// written into fixed buffers, the sites show what is left. /heap reports all of it.
+
+#ifndef HEAP_MONITOR_POLL_MS
+#define HEAP_MONITOR_POLL_MS 1000
+#endif
+#ifndef HEAP_MONITOR_INTERVAL_MS
+#define HEAP_MONITOR_INTERVAL_MS 3600000UL     // One sample per hour
+#endif
+#define HEAP_MONITOR_SAMPLES 168                // A week of samples
+
+enum HeapSite : uint8_t {
+#define HEAP_SITE(id, description) HEAP_SITE_##id,
+#include "heap_sites.def"
+#undef HEAP_SITE
+    HEAP_SITE_COUNT
+};
+
+struct HeapSample {
+    uint32_t time;              // Uptime in seconds at the start of the interval
+    uint32_t minFree;
+    uint32_t minLargest;        // Smallest largest free block
+    uint16_t fragmentation;     // Highest fragmentation ratio in per mille
+    uint32_t allocs;            // Allocations of all sites
+};
+
+// Any task, also before the scheduler runs
+void heap_site_alloc(HeapSite site, size_t bytes);
+
+// Share of the free heap outside of the largest free block, 0 to 1
+float heap_fragmentation(size_t freeBytes, size_t largestBlock);
+
+// Call it regularly (the web server loop does), it samples every HEAP_MONITOR_POLL_MS
+void heap_monitor_poll();
+
+// Producer for ResponseStream: the current values, the samples (oldest first) and the sites
+bool heap_monitor_write(Print& out, size_t item);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef __JOB_EXECUTOR_H__
+#define __JOB_EXECUTOR_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "memory_budget.h"
+
+// Jobs that share one worker task instead of each having a FreeRTOS task. The sensor and LCD
+// loops had a task with a 2048 byte stack each, every new feature cost another stack and task
+// control block although only one of them runs at a time. A job is a step function: it does
+// one piece of work and returns what it waits for before the next step, a delay or an item in
+// a JobQueue. The worker runs the steps that are due one after another and sleeps until the
+// next one is, so all jobs use one stack, as deep as the deepest step.
+//
+// A step must not block, every other job on the worker waits for it. Longer work is split into
+// steps that yield in between. The device is built as C++11, so jobs are plain state machines
+// (a small state enum in the job's file), not C++20 coroutines.
+
+#define JOB_MAX_JOBS 8
+#define JOB_FOREVER UINT32_MAX
+
+class JobQueue;
+
+// What a job waits for before its next step
+struct JobWait {
+    enum Kind : uint8_t {
+        JOB_WAIT_DELAY,
+        JOB_WAIT_QUEUE,     // An item in queue, or timeoutMs
+        JOB_WAIT_DONE       // The job ended
+    };
+
+    Kind kind;
+    uint32_t timeoutMs;
+    JobQueue* queue;
+
+    static JobWait delay(uint32_t ms) { return { JOB_WAIT_DELAY, ms, nullptr }; }
+    // Runs the step again after the other due jobs
+    static JobWait yield() { return delay(0); }
+    static JobWait receive(JobQueue& queue, uint32_t timeoutMs = JOB_FOREVER) { return { JOB_WAIT_QUEUE, timeoutMs, &queue }; }
+    static JobWait done() { return { JOB_WAIT_DONE, JOB_FOREVER, nullptr }; }
+};
+
+typedef JobWait (*JobStep)(void* arg);
+
+class JobExecutor {
+public:
+    JobExecutor();
+
+    // Jobs are added before start(), their first step runs as soon as the worker does. loop
+    // observes the run time of every step.
+    bool add(const char* name, JobStep step, void* arg = nullptr, MetricHistogram* loop = nullptr);
+    // The worker's stack comes from the stack region of the memory budget
+    void start(const char* name, MemoryRegionId stack, UBaseType_t priority, BaseType_t core = tskNO_AFFINITY);
+    TaskHandle_t task() const { return handle; }
+    // From any task, the worker checks the waits again
+    void wake();
+
+private:
+    struct Job {
+        const char* name;
+        JobStep step;
+        void* arg;
+        MetricHistogram* loop;
+        JobWait wait;
+        int64_t due;        // esp_timer_get_time() of the end of the wait, INT64_MAX for none
+    };
+
+    Job jobs[JOB_MAX_JOBS];
+    size_t count;
+    TaskHandle_t handle;
+
+    static void worker(void* parameter);
+    void run();
+};
+
+// FreeRTOS queue that wakes the job waiting for its items. Sending never blocks.
+class JobQueue {
+public:
+    JobQueue(JobExecutor& executor, UBaseType_t length, UBaseType_t itemSize);
+
+    // From any task, false if the queue is full
+    bool send(const void* item);
+    // Replaces the item of a queue of length 1, for jobs that only need the newest value
+    void overwrite(const void* item);
+    // For the job, false if the queue is empty
+    bool receive(void* item);
+    bool pending() const;
+
+private:
+    JobExecutor& executor;
+    QueueHandle_t queue;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __JSON_ARENA_H__
+#define __JSON_ARENA_H__
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Fixed blocks for the JSON documents of the web server, from the JSON_ARENA region of the
+// memory budget. A DynamicJsonDocument took its pool from the heap for every message; JsonArenaDocument
+// takes a free block of the arena instead and gives it back when it goes out of scope. Documents of
+// up to JSON_ARENA_SMALL bytes take a small block, or a large one if no small block is free.
+// Without a free block the pool comes from the heap as before, counted in json_arena_fallbacks.
+
+#define JSON_ARENA_SMALL 512
+#define JSON_ARENA_SMALL_BLOCKS 6
+#define JSON_ARENA_LARGE 2048
+#define JSON_ARENA_LARGE_BLOCKS 2
+
+struct JsonArenaAllocator {
+    void* allocate(size_t size);
+    void deallocate(void* pointer);
+    void* reallocate(void* pointer, size_t size);
+};
+
+typedef BasicJsonDocument<JsonArenaAllocator> JsonArenaDocument;
+
+#endif
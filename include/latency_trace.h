@@ -0,0 +1,108 @@
+#ifndef __LATENCY_TRACE_H__
+#define __LATENCY_TRACE_H__
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "metrics.h"
+
+// Latency tracing of sensor values on their way to the dashboards. Every reading gets a trace id
+// and each stage it passes records a span:
+//
+//   sensor_read -> snapshot_publish -> json_encode -> ws_enqueue -> net_send
+//
+// The first two run on the sensor task, the others on the web server task for the first message
+// that carries the reading. Readings that are replaced before a message goes out end at
+// snapshot_publish. net_send lasts until the send queues of all clients are empty, which is
+// checked on every pass of the web server loop, so it is only as exact as that loop period.
+//
+// Spans go into one fixed ring shared by all tasks: a slot is claimed with a single atomic add
+// and published with a sequence number, so recording never blocks and /trace skips slots that
+// are being overwritten. /trace exports the ring as Chrome trace-event JSON (chrome://tracing,
+// ui.perfetto.dev), one process per sensor with one row per stage.
+
+#define TRACE_BUFFER_SPANS 256      // Power of two
+
+enum TraceStage : uint8_t {
+    TRACE_SENSOR_READ,
+    TRACE_SNAPSHOT_PUBLISH,
+    TRACE_JSON_ENCODE,
+    TRACE_WS_ENQUEUE,
+    TRACE_NET_SEND,
+    TRACE_STAGE_COUNT
+};
+
+enum TraceSource : uint8_t {
+    TRACE_SOURCE_DHT,
+    TRACE_SOURCE_LIGHT,
+    TRACE_SOURCE_COUNT
+};
+
+struct TraceSpan {
+    uint32_t sequence;      // Claim number + 1 once the slot is complete, 0 while it is written
+    uint32_t id;
+    uint64_t start;         // esp_timer_get_time(), microseconds since boot
+    uint32_t duration;
+    TraceStage stage;
+    TraceSource source;
+};
+
+extern TraceSpan trace_spans[TRACE_BUFFER_SPANS];
+extern uint32_t trace_claimed;
+
+inline uint64_t trace_now() {
+    return (uint64_t)esp_timer_get_time();
+}
+
+// Id of a new trace, never 0
+uint32_t trace_begin();
+
+inline void trace_span(uint32_t id, TraceSource source, TraceStage stage, uint64_t start, uint64_t end) {
+    uint32_t claim = __atomic_fetch_add(&trace_claimed, 1, __ATOMIC_RELAXED);
+    TraceSpan& span = trace_spans[claim & (TRACE_BUFFER_SPANS - 1)];
+    __atomic_store_n(&span.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    span.id = id;
+    span.start = start;
+    span.duration = (uint32_t)(end - start);
+    span.stage = stage;
+    span.source = source;
+    __atomic_store_n(&span.sequence, claim + 1, __ATOMIC_RELEASE);
+}
+
+// Records snapshot_publish from start until now and hands the trace to the next message
+void trace_publish(TraceSource source, uint32_t id, uint64_t readStart, uint64_t start);
+
+// Traces carried by one WebSocket message: the readings published since the previous message
+class TraceMessage {
+public:
+    // Without take the message carries no trace
+    explicit TraceMessage(bool take = true);
+
+    bool empty() const;
+    // Records the stage for every carried trace
+    void span(TraceStage stage, uint64_t start, uint64_t end) const;
+    // Starts net_send, ended by trace_poll_sent
+    void enqueued(uint64_t end) const;
+
+private:
+    uint32_t ids[TRACE_SOURCE_COUNT];
+    uint64_t readStarts[TRACE_SOURCE_COUNT];
+};
+
+// Ends net_send of the waiting traces if all send queues are empty
+void trace_poll_sent(bool drained);
+
+// Writes a copy of the complete spans in the ring as Chrome trace-event JSON, one piece
+// (head, span, tail) per call, so it can be used as a ResponseStream producer
+class TraceJsonWriter {
+public:
+    TraceJsonWriter();
+    // Returns false once the closing bracket was written
+    bool write(Print& out, size_t item);
+
+private:
+    TraceSpan spans[TRACE_BUFFER_SPANS];
+    size_t count;
+};
+
+#endif
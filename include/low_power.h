@@ -0,0 +1,151 @@
+#ifndef __LOW_POWER_H__
+#define __LOW_POWER_H__
+
+#include <Arduino.h>
+#include "report_policy.h"
+
+// Battery operation. The normal firmware keeps WiFi, the web server and the LCD running all the
+// time, a battery powered unit only needs a sample every few minutes. Built with LOW_POWER_MODE=1
+// (env:yolo_uno_low_power) setup() hands over to low_power_run(): one sample of the DHT11 and the
+// light sensor, then deep sleep until the next one. The samples wait in a ring in RTC memory,
+// which keeps its contents through deep sleep. The radio is only turned on to push them to
+// ThingsBoard, once LOW_POWER_BATCH_SIZE samples are waiting or when the temperature goes above
+// the alert threshold. A failed uplink is retried after LOW_POWER_RETRY_S, doubling up to
+// LOW_POWER_RETRY_MAX_S, with the oldest samples overwritten if the ring fills in the meantime.
+//
+// The values of a wake go through the report filter (report_policy.h) with the rules stored in NVS.
+// Only a wake with a reported value, or one where an alert starts or ends, stores a sample, with
+// just the reported values in its message. The others are counted as suppressed, a batch then
+// stands for hours instead of an hour and the radio stays off for longer.
+//
+// The state machine below does not touch the hardware, the caller reads the sensors, does the
+// uplink and sleeps. Its clock is advanced by the time awake and the time asleep, so the native
+// build runs it with a simulated clock (lib/NativeShims/src/low_power_sim.h).
+//
+// The energy model estimates the radio-on time and the battery life from the time spent asleep,
+// awake with the radio off, and with the radio on, at the currents below. The device measures
+// these times, low_power_model() predicts them from the settings.
+
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE 0
+#endif
+
+#ifndef LOW_POWER_SAMPLE_INTERVAL_S
+#define LOW_POWER_SAMPLE_INTERVAL_S 300
+#endif
+#ifndef LOW_POWER_BATCH_SIZE
+#define LOW_POWER_BATCH_SIZE 12             // An hour of samples per uplink
+#endif
+#define LOW_POWER_RING_SIZE 128             // Ten hours or more without an uplink, 3 KB of RTC memory
+#define LOW_POWER_RETRY_S 600
+#define LOW_POWER_RETRY_MAX_S 7200
+#define LOW_POWER_MIN_SLEEP_MS 1000
+#define LOW_POWER_MAGIC 0x32525750          // "PWR2"
+
+// Currents of the energy model
+#ifndef LOW_POWER_SLEEP_MA
+#define LOW_POWER_SLEEP_MA 0.15f            // ESP32-S3 in deep sleep, DHT11 on standby
+#endif
+#ifndef LOW_POWER_ACTIVE_MA
+#define LOW_POWER_ACTIVE_MA 40.0f           // CPU running, radio off
+#endif
+#ifndef LOW_POWER_RADIO_MA
+#define LOW_POWER_RADIO_MA 120.0f           // WiFi associating and sending, on average
+#endif
+#ifndef LOW_POWER_BATTERY_MAH
+#define LOW_POWER_BATTERY_MAH 2000.0f
+#endif
+
+// Largest batch message, a batch with windows of every metric takes fewer samples
+#define LOW_POWER_BATCH_JSON 1536
+
+enum LowPowerSampleFlags : uint8_t {
+    LOW_POWER_SAMPLE_ALERT = 1 << 0,        // Temperature above the threshold
+};
+
+// Fixed point in steps of 0.1 °C, 0.1 % and 1 for the light level
+struct LowPowerValue {
+    int16_t mean;
+    int16_t min;                // Of the window, the mean for a single reading
+    int16_t max;
+};
+
+struct LowPowerSample {
+    uint32_t time;              // Seconds on the low-power clock
+    LowPowerValue values[HISTORY_METRIC_COUNT];
+    uint8_t reported;           // Bit per HistoryMetric, the other values are not sent
+    uint8_t flags;
+};
+
+// Kept in RTC memory, zero (or garbage after a power loss) until low_power_begin()
+struct LowPowerState {
+    uint32_t magic;
+    uint64_t clockMs;           // Low-power clock at the start of this wake
+    uint64_t awakeMs;           // Time awake since the cold boot, with the radio on included
+    uint64_t radioMs;           // Time with the radio on since the cold boot
+    int64_t epochOffsetMs;      // Unix time in ms at clock 0, 0 until the first time sync
+    float threshold;            // Alert threshold in °C
+    uint32_t wakes;
+    uint32_t uplinks;           // Uplinks that sent every waiting sample
+    uint32_t alertUplinks;      // Of these, uplinks started by an alert
+    uint32_t uplinkFailures;
+    uint32_t failureStreak;     // Failed uplinks since the last one that worked
+    uint32_t retryAt;           // Clock seconds, no uplink before this after a failure
+    uint32_t delivered;         // Samples sent
+    uint32_t dropped;           // Samples overwritten before they were sent
+    uint32_t suppressed;        // Wakes without a reported value, no sample stored
+    bool alertActive;           // Last sample was above the threshold
+    bool alertPending;          // An alert started and was not sent yet
+    uint16_t head;              // Ring index of the next sample
+    uint16_t count;             // Samples waiting, the newest count before head
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    ReportTrack tracks[HISTORY_METRIC_COUNT];
+    LowPowerSample samples[LOW_POWER_RING_SIZE];
+};
+
+struct LowPowerEstimate {
+    float awakeShare;           // Share of the time awake, radio included
+    float radioShare;           // Share of the time with the radio on
+    float radioSecondsPerDay;
+    float averageMa;
+    float batteryDays;          // On LOW_POWER_BATTERY_MAH
+};
+
+// Starts a wake. After a cold boot (no valid state) the state is reset, threshold taken and the
+// report rules set to their defaults, true then. Otherwise the threshold and the rules stay as they were.
+bool low_power_begin(LowPowerState& state, float threshold);
+void low_power_set_threshold(LowPowerState& state, float threshold);
+// HISTORY_METRIC_COUNT entries, the filter of a metric whose rule changed starts over
+void low_power_set_rules(LowPowerState& state, const ReportRule* rules);
+// Runs the values of this wake through the report filter, NaN for a failed DHT11 read, and stores
+// a sample if one is reported or an alert starts or ends. True if the radio should be turned on
+// for an uplink: enough samples are waiting or an alert started, and no retry is pending.
+bool low_power_record(LowPowerState& state, float temperature, float humidity, uint16_t light);
+// Time sync during an uplink, epochMs is the Unix time awakeMs into this wake
+void low_power_set_time(LowPowerState& state, int64_t epochMs, uint32_t awakeMs);
+// Writes the oldest waiting samples (at most LOW_POWER_BATCH_SIZE, fewer if the JSON would not fit
+// into size) as a ThingsBoard telemetry array with timestamps, a window as its mean with _min and
+// _max next to it. Returns how many, 0 if none are waiting, the time is not synced yet or not even
+// one sample fits.
+size_t low_power_batch_json(const LowPowerState& state, char* json, size_t size);
+// The oldest count samples were sent
+void low_power_sent(LowPowerState& state, size_t count);
+// Ends an uplink, ok if every waiting sample was sent. radioMs is how long the radio was on.
+void low_power_uplink_done(LowPowerState& state, bool ok, uint32_t radioMs);
+// Ends the wake after awakeMs, returns how long to sleep until the next sample
+uint32_t low_power_sleep(LowPowerState& state, uint32_t awakeMs);
+
+// From the times measured since the cold boot
+void low_power_estimate(const LowPowerState& state, LowPowerEstimate& estimate);
+// From the settings: awakeMs per wake without the radio, radioMs per uplink, the share of the wakes
+// that store a sample (1 if every reading is reported) and how many uplinks per day alerts add to
+// the batches
+void low_power_model(LowPowerEstimate& estimate, uint32_t awakeMs, uint32_t radioMs, float sampleShare,
+                     float alertsPerDay);
+
+#if LOW_POWER_MODE
+// Samples, does the uplink if one is due and goes to deep sleep, does not return
+void low_power_run();
+#endif
+
+#endif
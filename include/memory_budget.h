@@ -0,0 +1,81 @@
+#ifndef __MEMORY_BUDGET_H__
+#define __MEMORY_BUDGET_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+// Declared memory budget of the firmware's own long-lived memory. Task stacks, kernel objects,
+// the objects created at boot and the log, profiler and JSON buffers are claimed from the regions
+// in memory_budget.def instead of being allocated wherever they are needed.
+//
+// Built with MEMORY_STATIC=1 (env:yolo_uno_static, env:native_static) every region is a static
+// array, tasks, semaphores and queues are created with the xTaskCreateStatic family, and the
+// budget shows up in the linker map instead of the heap. memory_budget_print() writes the map at
+// boot and /memory reports what was claimed: heap_bytes stays 0 after boot. The normal build
+// claims the same regions from the heap, so both builds are held to the same budget.
+//
+// A region that is used up hands out heap instead, so nothing fails at runtime, and the bytes
+// are counted in heap_bytes. A declared region larger than MEMORY_BUDGET_BYTES in total, or an
+// object larger than its region, fails the build (also the native one).
+//
+// Libraries keep allocating on their own: the WiFi driver, lwIP, AsyncTCP and the web server's
+// requests and messages, the NeoPixel buffer, and the Strings of the WebSocket messages and of the
+// colors and scan results in WiFiConfigServer.
+
+#ifndef MEMORY_STATIC
+#define MEMORY_STATIC 0
+#endif
+
+#define MEMORY_BUDGET_BYTES (56 * 1024)
+
+enum MemoryKind : uint8_t {
+    MEMORY_STACK,
+    MEMORY_KERNEL,
+    MEMORY_OBJECT,
+    MEMORY_BUFFER
+};
+
+enum MemoryRegionId : uint8_t {
+#define MEMORY_REGION(id, kind, bytes, description) MEMORY_##id,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+    MEMORY_REGION_COUNT
+};
+
+// Declared size of each region as a constant expression, MEMORY_BYTES(STACK_JOBS)
+struct MemoryBytes {
+    enum : size_t {
+#define MEMORY_REGION(id, kind, bytes, description) id = bytes,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+    };
+};
+#define MEMORY_BYTES(id) ((size_t)MemoryBytes::id)
+
+// Fails the build if an object does not fit into its region
+#define MEMORY_FITS(id, bytes) static_assert((bytes) <= MEMORY_BYTES(id), "Region " #id " of memory_budget.def is too small")
+
+size_t memory_region_bytes(MemoryRegionId region);
+
+// Storage for bytes (rounded up to 8) from region, never released
+void* memory_claim(MemoryRegionId region, size_t bytes);
+
+// Kernel objects from the TASKS, SEMAPHORES and QUEUES regions
+SemaphoreHandle_t memory_create_mutex();
+SemaphoreHandle_t memory_create_counting_semaphore(UBaseType_t max, UBaseType_t initial);
+QueueHandle_t memory_create_queue(UBaseType_t length, UBaseType_t itemSize);
+// The stack size is that of the stack region
+TaskHandle_t memory_create_task(TaskFunction_t function, const char* name, MemoryRegionId stack, void* arg,
+                                UBaseType_t priority, BaseType_t core);
+
+// Bytes handed out from the heap instead of static storage
+size_t memory_heap_bytes();
+// Writes the budget table to Serial
+void memory_budget_print();
+// Producer for ResponseStream, writes the regions and what was claimed from them as one JSON object
+bool memory_budget_write(Print& out, size_t item);
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+
+// Counters, gauges and latency histograms exposed as OpenMetrics text on /metrics.
+// Updates are single relaxed atomic operations on the slot of the calling core,
+// so they are safe from any task without a lock and never block the hot path.
+// Metrics are global objects that register themselves, the exposition order is the definition order.
+
+#define METRICS_CORES portNUM_PROCESSORS
+#define METRICS_HISTOGRAM_BUCKETS 10
+
+class Metric {
+public:
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+    // labels is an optional OpenMetrics label set without braces, e.g. "task=\"lcd\""
+    Metric(Type type, const char* name, const char* help, const char* labels);
+
+    // Writes the metric, including the TYPE/HELP header if it is the first one with its name
+    void write(Print& out) const;
+
+    static Metric* first() { return head; }
+    Metric* next() const { return nextMetric; }
+
+protected:
+    Type type;
+    const char* name;
+    const char* help;
+    const char* labels;
+
+    virtual void writeSamples(Print& out) const = 0;
+
+private:
+    Metric* nextMetric;
+    static Metric* head;
+    static Metric* tail;
+};
+
+class MetricCounter : public Metric {
+public:
+    MetricCounter(const char* name, const char* help, const char* labels = nullptr);
+    inline void inc(uint32_t n = 1) {
+        __atomic_fetch_add(&values[xPortGetCoreID()], n, __ATOMIC_RELAXED);
+    }
+    uint64_t value() const;
+
+protected:
+    void writeSamples(Print& out) const override;
+
+private:
+    uint32_t values[METRICS_CORES];
+};
+
+class MetricGauge : public Metric {
+public:
+    MetricGauge(const char* name, const char* help, const char* labels = nullptr);
+    inline void set(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        __atomic_store_n(&this->bits, bits, __ATOMIC_RELAXED);
+    }
+    float value() const;
+
+protected:
+    void writeSamples(Print& out) const override;
+
+private:
+    uint32_t bits;
+};
+
+// Latency histogram with fixed buckets from 100 us to 5 s, observed in microseconds
+class MetricHistogram : public Metric {
+public:
+    MetricHistogram(const char* name, const char* help, const char* labels = nullptr);
+    void observe(uint32_t micros);
+    // Copies the per bucket (not cumulative) counts, returns the number of observations
+    uint64_t snapshot(uint32_t counts[METRICS_HISTOGRAM_BUCKETS + 1]) const;
+    // Upper bound of a bucket in seconds as exposed in the le label, "+Inf" for the last one
+    static const char* bound(int bucket);
+
+protected:
+    void writeSamples(Print& out) const override;
+
+private:
+    static const uint32_t BOUNDS_US[METRICS_HISTOGRAM_BUCKETS];
+    static const char* const BOUNDS_LE[METRICS_HISTOGRAM_BUCKETS];
+
+    // Per bucket (not cumulative), the last slot counts observations above the last bound
+    uint32_t buckets[METRICS_CORES][METRICS_HISTOGRAM_BUCKETS + 1];
+    // 64 bit sum split in two words, the high word is only touched when the low word wraps
+    uint32_t sumLow[METRICS_CORES];
+    uint32_t sumHigh[METRICS_CORES];
+};
+
+// Sensor and display jobs, tasks
+extern MetricCounter metric_dht_reads;
+extern MetricCounter metric_dht_read_failures;
+extern MetricGauge metric_temperature;
+extern MetricGauge metric_humidity;
+extern MetricGauge metric_light_level;
+extern MetricHistogram metric_loop_temp_humi;
+extern MetricHistogram metric_loop_light_sensor;
+extern MetricHistogram metric_loop_lcd;
+extern MetricHistogram metric_loop_webserver;
+extern MetricHistogram metric_loop_ws_commands;
+extern MetricHistogram metric_loop_neo_effect;
+extern MetricHistogram metric_job_lateness;
+extern MetricCounter metric_sensor_channel_dropped;
+
+// Web server
+extern MetricCounter metric_http_responses;
+extern MetricCounter metric_ws_messages_received;
+extern MetricHistogram metric_ws_broadcast;
+extern MetricCounter metric_ws_frames_dropped;
+extern MetricCounter metric_ws_evictions;
+extern MetricCounter metric_ws_commands_coalesced;
+extern MetricCounter metric_ws_commands_dropped;
+extern MetricHistogram metric_sensor_latency_dht;
+extern MetricHistogram metric_sensor_latency_light;
+
+// Dashboard settings
+extern MetricCounter metric_settings_changes;
+extern MetricCounter metric_settings_writes;
+extern MetricCounter metric_settings_write_failures;
+
+// Device config
+extern MetricCounter metric_config_writes;
+extern MetricCounter metric_config_write_failures;
+
+// Report-by-exception (report_policy.h)
+extern MetricCounter metric_report_readings_temperature;
+extern MetricCounter metric_report_readings_humidity;
+extern MetricCounter metric_report_readings_light;
+extern MetricCounter metric_report_reports_temperature;
+extern MetricCounter metric_report_reports_humidity;
+extern MetricCounter metric_report_reports_light;
+
+// Boot timeline (boot_timeline.h)
+extern MetricGauge metric_boot_first_publish;
+
+// Deferred logger
+extern MetricCounter metric_log_dropped;
+
+// Memory budget (memory_budget.h)
+extern MetricCounter metric_json_arena_fallbacks;
+
+// Sampled when /metrics is scraped
+extern MetricGauge metric_heap_free;
+extern MetricGauge metric_heap_min_free;
+extern MetricGauge metric_heap_largest_block;
+extern MetricGauge metric_heap_fragmentation;
+extern MetricGauge metric_uptime;
+extern MetricGauge metric_memory_budget_heap;
+
+// Refreshes the gauges that are sampled at scrape time
+void metrics_collect();
+// Producer for ResponseStream, writes one metric per item and the closing "# EOF"
+bool metrics_write(Print& out, size_t item);
+
+#endif
@@ -2,13 +2,33 @@
 #define __NEO_BLINKY__
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
+#include "job_executor.h"
+#include "metrics.h"
 
 
 
 #define NEO_PIN 45
 #define LED_COUNT 1 
+#define NEO_BLINK_MS 500
 
-void neo_blinky(void *pvParameters);
+// The NeoPixel belongs to a job on the job worker. The web server and the command task used to
+// write it both, the alert blinking ran in the web server loop. Now they post the effect to show
+// and the job applies it right away and runs the blinking.
+enum NeoEffectMode : uint8_t {
+    NEO_EFFECT_SOLID,
+    NEO_EFFECT_BLINK        // The color and off, NEO_BLINK_MS each
+};
 
+struct NeoEffect {
+    NeoEffectMode mode;
+    uint8_t r, g, b;
+};
 
-#endif
\ No newline at end of file
+// Adds the job, call it before the executor starts
+void neo_effect_begin(JobExecutor& executor);
+// From any task, only the newest effect is shown. Posting the current effect again changes nothing.
+void neo_effect_show(uint8_t r, uint8_t g, uint8_t b);
+void neo_effect_blink(uint8_t r, uint8_t g, uint8_t b);
+
+
+#endif
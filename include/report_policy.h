@@ -0,0 +1,81 @@
+#ifndef __REPORT_POLICY_H__
+#define __REPORT_POLICY_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "metrics.h"
+#include "sensor_history.h"
+
+// Report-by-exception for telemetry uplinks. Cloud ingestion is paid per message, and most readings
+// say nothing new: five seconds apart the DHT11 reads the same whole degree almost every time.
+// Each metric has a rule that decides which readings are worth a message:
+//   dead band    a reading is reported once it is at least this far from the last reported value,
+//                0 reports every reading
+//   max silence  seconds after which a reading is reported anyway, a heartbeat that tells a quiet
+//                sensor from a dead unit, 0 for none
+//   window       seconds of readings reported as their min, max and mean instead of one by one, 0
+//                for single readings. The dead band then applies to the min and max of the window,
+//                so a short spike still gets through.
+//
+// report_track() is the filter, its state is a plain struct so the low-power mode (low_power.h)
+// keeps it in RTC memory. The rules are kept in NVS and changed at runtime with the
+// get_report_policy and set_report_policy actions (ws_commands.h). The normal firmware has no
+// uplink, it runs the filter on its readings all the same and counts what would be sent
+// (report_readings and report_reports on /metrics), so a rule can be tried on a unit with a
+// dashboard before the low-power build, which reads the rules from NVS, sends with it.
+// The native replay benchmark (lib/NativeShims/src/report_replay.h) measures rules on traces.
+
+#define REPORT_POLICY_NAMESPACE "report"
+#define REPORT_POLICY_KEY "rules"
+#define REPORT_POLICY_VERSION 1
+#define REPORT_MAX_SILENCE_S 604800     // A week
+#define REPORT_MAX_WINDOW_S 86400
+#define REPORT_MAX_DEAD_BAND 4096.0f    // Full range of the light sensor
+
+struct ReportRule {
+    float deadBand;             // In the unit of the metric
+    uint32_t maxSilenceS;
+    uint32_t windowS;
+};
+
+// Filter state of one metric, zero is a fresh start
+struct ReportTrack {
+    uint32_t windowStart;       // ms of the first reading in the window
+    uint32_t lastReport;        // ms of the last report
+    float lastValue;            // Mean of the last report
+    float min;                  // Of the readings in the window
+    float max;
+    float sum;
+    uint16_t count;             // Readings in the window
+    bool reported;              // Anything reported since the start
+};
+
+struct Report {
+    float mean;
+    float min;
+    float max;
+    uint16_t count;             // Readings behind it
+};
+
+bool report_rule_valid(const ReportRule& rule);
+// Rules of a unit that never stored any, HISTORY_METRIC_COUNT entries
+void report_policy_defaults(ReportRule* rules);
+// Adds a reading taken at nowMs, true if report was set. A window is closed by the first reading
+// after its end, that reading starts the next one.
+bool report_track(ReportTrack& track, const ReportRule& rule, float value, uint32_t nowMs, Report& report);
+
+// Loads the rules from NVS, defaults for what is missing. Call before the sensor jobs start.
+void report_policy_begin();
+// HISTORY_METRIC_COUNT entries
+void report_policy_get(ReportRule* rules);
+// Replaces the rule of a metric and writes the rules to NVS if they changed, false if the rule is
+// invalid or writing failed. The filter of the metric starts over with the next reading.
+bool report_policy_set(HistoryMetric metric, const ReportRule& rule);
+// Called by the sensor jobs for every valid reading
+void report_policy_reading(HistoryMetric metric, float value, uint32_t readMs);
+// Counted since boot
+uint64_t report_policy_readings(HistoryMetric metric);
+uint64_t report_policy_reports(HistoryMetric metric);
+
+#endif
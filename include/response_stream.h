@@ -0,0 +1,42 @@
+#ifndef __RESPONSE_STREAM_H__
+#define __RESPONSE_STREAM_H__
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Produces a response body piece by piece straight into the send buffer of a chunked response.
+// The producer is called with increasing item numbers and prints one piece (an object, an array
+// element, ...) per call, it returns false once the body is complete. Whatever does not fit into
+// the current send buffer is kept until the next call, so only one piece is ever held in RAM.
+class ResponseStream : public Print {
+public:
+    typedef std::function<bool(Print& out, size_t item)> Producer;
+
+    explicit ResponseStream(Producer producer);
+
+    // Fills buffer with up to maxLen bytes, returns 0 once the body is complete
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t len) override;
+
+private:
+    Producer producer;
+    size_t item;
+    bool finished;
+
+    uint8_t* out;
+    size_t outLen;
+    size_t outMax;
+
+    std::vector<uint8_t> pending;
+    size_t pendingPos;
+};
+
+// Sends a chunked response whose body is generated by the given producer
+void sendStreamResponse(AsyncWebServerRequest* request, const char* contentType, ResponseStream::Producer producer);
+
+#endif
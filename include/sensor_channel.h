@@ -0,0 +1,42 @@
+#ifndef __SENSOR_CHANNEL_H__
+#define __SENSOR_CHANNEL_H__
+
+#include <Arduino.h>
+#include "spsc_ring.h"
+
+// Sensor readings from the acquisition core to the network core. The DHT11 and light sensor
+// jobs run on the one Jobs task, the only producer; the web server task is the only consumer
+// and applies the readings to its SensorSnapshot once per loop. The glob_* values stay with
+// the jobs (the LCD job reads them), nothing on the network core reads them any more.
+
+#define SENSOR_CHANNEL_DEPTH 16     // Readings, the web server loop runs every 100 ms
+
+enum SensorSampleKind : uint8_t {
+    SENSOR_SAMPLE_DHT,
+    SENSOR_SAMPLE_LIGHT
+};
+
+struct SensorSample {
+    SensorSampleKind kind;
+    bool ledState;          // Light: state of the LED the light level switches
+    float first;            // DHT: temperature, light: light level
+    float second;           // DHT: humidity
+    uint32_t readMs;        // millis() of the read
+};
+
+// The newest readings as the network core knows them
+struct SensorSnapshot {
+    float temperature;
+    float humidity;
+    int lightLevel;
+    bool ledState;
+    uint32_t dhtReadMs;
+    uint32_t lightReadMs;
+};
+
+// Jobs task only. A reading that does not fit is dropped and counted in sensor_channel_dropped.
+void sensor_channel_publish(const SensorSample& sample);
+// Web server task only, applies all queued readings to snapshot and returns how many there were
+size_t sensor_channel_drain(SensorSnapshot& snapshot);
+
+#endif
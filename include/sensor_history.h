@@ -0,0 +1,70 @@
+#ifndef __SENSOR_HISTORY_H__
+#define __SENSOR_HISTORY_H__
+
+#include <Arduino.h>
+#include "global.h"
+
+// Retention: one averaged sample per metric every HISTORY_INTERVAL_S seconds,
+// HISTORY_CAPACITY samples are kept (1440 x 60 s = one day, 11.5 KB per metric)
+#ifndef HISTORY_INTERVAL_S
+#define HISTORY_INTERVAL_S 60
+#endif
+#ifndef HISTORY_CAPACITY
+#define HISTORY_CAPACITY 1440
+#endif
+
+#define HISTORY_DEFAULT_POINTS 200
+// WebSocket replies are built as one message, so they get a smaller limit than the chunked REST endpoint
+#define HISTORY_WS_MAX_POINTS 300
+
+enum HistoryMetric {
+    HISTORY_TEMPERATURE = 0,
+    HISTORY_HUMIDITY,
+    HISTORY_LIGHT,
+    HISTORY_METRIC_COUNT
+};
+
+struct HistorySample {
+    uint32_t time;   // Seconds since boot
+    float value;
+};
+
+// Called by the sensor tasks for every reading
+void history_record(HistoryMetric metric, float value);
+uint32_t history_now();
+bool history_parse_metric(const String& name, HistoryMetric& metric);
+const char* history_metric_name(HistoryMetric metric);
+
+// Downsamples the samples of one metric in [from, to] to at most maxPoints points
+// with Largest-Triangle-Three-Buckets. Points are produced one at a time and only the
+// current bucket is read (under the history lock), so no copy of the series is needed.
+class HistoryQuery {
+public:
+    HistoryQuery(HistoryMetric metric, uint32_t from, uint32_t to, size_t maxPoints);
+    bool next(HistorySample& sample);
+    size_t size() const { return points; }
+
+private:
+    HistoryMetric metric;
+    uint32_t first;       // Sequence number of the first sample in range
+    size_t count;         // Samples in range
+    size_t points;        // Points that will be produced
+    size_t produced;
+    HistorySample selected;
+};
+
+// Writes a HistoryQuery as JSON, one piece (head, point, tail) per call,
+// so it can be used as a ResponseStream producer
+class HistoryJsonWriter {
+public:
+    HistoryJsonWriter(HistoryMetric metric, uint32_t from, uint32_t to, size_t maxPoints);
+    // Returns false once the closing bracket was written
+    bool write(Print& out, size_t item);
+
+private:
+    HistoryMetric metric;
+    uint32_t from, to;
+    HistoryQuery query;
+};
+
+#endif
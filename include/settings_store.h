@@ -0,0 +1,72 @@
+#ifndef __SETTINGS_STORE_H__
+#define __SETTINGS_STORE_H__
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "metrics.h"
+
+// Dashboard settings (NeoPixel colors, alert threshold) kept in RAM and written to NVS as one
+// versioned blob. Every save from a dashboard used to write 4 or 5 keys right away, a user trying
+// colors or typing a threshold wrote flash on every message. Saves now only change the RAM copy,
+// the blob is written once nothing changed for SETTINGS_FLUSH_QUIET_MS, at the latest
+// SETTINGS_FLUSH_MAX_MS after the first unsaved change, and before a restart. Changes that end
+// where the stored blob already is are not written at all.
+//
+// The first boot with the blob reads the old per value keys and replaces them with it.
+
+#define SETTINGS_KEY "settings"
+#define SETTINGS_VERSION 1
+#define SETTINGS_FLUSH_QUIET_MS 2000
+#define SETTINGS_FLUSH_MAX_MS 30000
+#define SETTINGS_MAX_HEX 7      // "#rrggbb"
+
+// Compared with memcmp, so there is no padding
+struct Settings {
+    float tempThreshold;
+    uint8_t neoR, neoG, neoB;
+    char neoHex[SETTINGS_MAX_HEX + 1];
+    uint8_t alertR, alertG, alertB;
+    char alertHex[SETTINGS_MAX_HEX + 1];
+    uint8_t reserved[2];    // Zero
+};
+
+class SettingsStore {
+public:
+    SettingsStore();
+
+    // Loads the blob (or the old keys) from an opened namespace, defaults for what is missing
+    void begin(Preferences* preferences);
+    Settings get();
+
+    void setNeoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex);
+    void setAlertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex);
+    void setTempThreshold(float threshold);
+
+    // Writes the blob if changes are due, call it regularly
+    void loop();
+    // Writes pending changes now, false if writing failed
+    bool flush();
+
+private:
+    struct Blob {
+        uint16_t version;
+        uint16_t size;      // sizeof(Settings) when written, a changed layout needs a new version
+        Settings settings;
+    };
+
+    Preferences* preferences;
+    SemaphoreHandle_t mutex;
+    Settings current;
+    Settings stored;        // What the blob in NVS holds
+    bool dirty;
+    uint32_t firstChange;   // millis() of the oldest unsaved change
+    uint32_t lastChange;
+
+    void changed();
+    bool migrate();
+    bool write();
+};
+
+#endif
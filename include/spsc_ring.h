@@ -0,0 +1,64 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free queue between exactly one producer task and one consumer task, typically on
+// different cores (see task_topology.h). Each side writes only its own index and publishes it
+// with a release store after the item is copied, so neither side ever blocks or takes a lock
+// and no semaphore hands the data over. The consumer polls, it is meant for a task that wakes
+// up on its own anyway.
+//
+// The indices run freely and wrap around, N must be a power of two. Rings are static objects,
+// new does not honor their alignment before C++17.
+
+// Head and tail on their own cache line, the native build runs on cached cores. The internal
+// SRAM of the ESP32 is not cached, there the alignment only costs a few bytes per ring.
+#ifndef SPSC_RING_ALIGN
+#define SPSC_RING_ALIGN 64
+#endif
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer only, false if the ring is full (the consumer is N items behind)
+    bool push(const T& item) {
+        uint32_t h = head;
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= N) {
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Consumer only, false if the ring is empty
+    bool pop(T& item) {
+        uint32_t t = tail;
+        if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) {
+            return false;
+        }
+        item = items[t & (N - 1)];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // From either side, only a snapshot while the other side runs
+    size_t size() const {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+    static size_t capacity() { return N; }
+
+private:
+    alignas(SPSC_RING_ALIGN) uint32_t head;     // Written by the producer
+    alignas(SPSC_RING_ALIGN) uint32_t tail;     // Written by the consumer
+    alignas(SPSC_RING_ALIGN) T items[N];
+};
+
+#endif
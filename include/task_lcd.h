@@ -6,6 +6,9 @@
 #include <WiFi.h>
 #include "LiquidCrystal_I2C.h"
 #include "global.h"
+#include "metrics.h"
+#include "boot_timeline.h"
+#include "job_executor.h"
 
 #define LCD_ADDR 33
 #define LCD_COLS 16
@@ -13,8 +16,10 @@
 #define SDA_PIN 11
 #define SCL_PIN 12
 
-void task_lcd(void *pvParameters);
+// One display line per step, the other jobs can run between the I2C transfers of a refresh
+JobWait lcd_job(void *arg);
 void initLCD();
-void displaySensorData();
+// Line row of display mode (0: temperature and humidity, 1: light and LED, 2: IP address)
+void displaySensorLine(uint8_t mode, uint8_t row);
 
 #endif
\ No newline at end of file
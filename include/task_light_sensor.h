@@ -5,12 +5,24 @@
 #include <Wire.h>
 #include "LiquidCrystal_I2C.h"
 #include "global.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "sensor_history.h"
+#include "report_policy.h"
+#include "latency_trace.h"
+#include "boot_timeline.h"
+#include "job_executor.h"
+#include "sensor_channel.h"
 
 #define LIGHT_SENSOR_PIN 1    // GPIO36 (ADC1_CH0) for light sensor
 #define LED_PIN 2              // GPIO pin for LED control
 #define LIGHT_THRESHOLD 500    // Threshold value for darkness detection
+#ifndef LIGHT_READ_INTERVAL_MS
+#define LIGHT_READ_INTERVAL_MS 2000
+#endif
 
-void task_light_sensor(void *pvParameters);
+// One read per step, on the job worker
+JobWait light_sensor_job(void *arg);
 void initLightSensor();
 int readLightLevel();
 void controlLED(bool state);
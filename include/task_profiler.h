@@ -0,0 +1,117 @@
+#ifndef __TASK_PROFILER_H__
+#define __TASK_PROFILER_H__
+
+#include <Arduino.h>
+#include "global.h"
+#include "metrics.h"
+
+// Per task CPU share, stack usage and loop latency, sampled every PROFILER_INTERVAL_MS
+// by the web server task and published on /tasks and as "tasks" WebSocket messages.
+//
+// The scheduler does not count context switches per task and the prebuilt Arduino core
+// has no trace hooks, so "yields" counts loop iterations of the tracked tasks instead:
+// every iteration ends in vTaskDelay, i.e. one voluntary switch. Preemptions are not counted.
+
+#define PROFILER_MAX_TASKS 24
+#define PROFILER_MAX_TRACKED 8
+#ifndef PROFILER_INTERVAL_MS
+#define PROFILER_INTERVAL_MS 5000
+#endif
+
+// One task as reported by the scheduler
+struct TaskStatsSample {
+    const void* handle;
+    char name[configMAX_TASK_NAME_LEN];
+    uint8_t priority;
+    int8_t core;            // Core the task is pinned to, -1 for either
+    uint32_t runtime;       // Run time counter (microseconds on ESP32), wraps around
+    uint32_t stackFree;     // Stack high water mark in bytes
+};
+
+// Where the profiler gets its samples from, FreeRTOSTaskStats on the device
+class TaskStatsSource {
+public:
+    virtual ~TaskStatsSource() {}
+    // Fills at most max samples and the run time counter of the whole system, returns the sample count
+    virtual size_t read(TaskStatsSample* samples, size_t max, uint32_t& totalRuntime) = 0;
+};
+
+// uxTaskGetSystemState fails if the array is too small, the scratch array leaves room for tasks
+// created meanwhile
+#define PROFILER_STATUS_SLACK 4
+
+class FreeRTOSTaskStats : public TaskStatsSource {
+public:
+    FreeRTOSTaskStats();
+    size_t read(TaskStatsSample* samples, size_t max, uint32_t& totalRuntime) override;
+
+private:
+    TaskStatus_t* status;           // Claimed from the PROFILER region on the first read
+};
+
+struct TaskProfile {
+    const void* handle;
+    char name[configMAX_TASK_NAME_LEN];
+    uint8_t priority;
+    int8_t core;
+    float cpu;                      // Share of all cores during the last interval in percent
+    uint64_t runtime;               // Accumulated run time, does not wrap
+    uint32_t stackSize;             // Stack size passed to xTaskCreate, 0 if the task is not tracked
+    uint32_t stackFree;
+    uint32_t stackMinFree;          // Lowest high water mark seen
+    const MetricHistogram* loop;    // Loop latency of tracked tasks, nullptr otherwise
+    uint32_t lastRuntime;           // Raw counter of the previous sample
+};
+
+// Turns consecutive samples into per interval profiles. Not thread safe, the
+// profiler_* functions below wrap the global instance in a lock.
+class TaskProfiler {
+public:
+    explicit TaskProfiler(uint8_t cores = portNUM_PROCESSORS);
+
+    // Stack size and loop histogram of a task, the scheduler knows neither
+    bool track(const void* handle, uint32_t stackSize, const MetricHistogram* loop);
+    void sample(TaskStatsSource& source);
+
+    size_t size() const { return count; }
+    const TaskProfile& task(size_t index) const { return profiles[index]; }
+    uint32_t interval() const { return lastInterval; }
+
+private:
+    struct Tracked {
+        const void* handle;
+        uint32_t stackSize;
+        const MetricHistogram* loop;
+    };
+
+    uint8_t cores;
+    TaskProfile profiles[PROFILER_MAX_TASKS];
+    TaskProfile previous[PROFILER_MAX_TASKS];   // Scratch copy while merging, kept off the stack
+    size_t count;
+    Tracked tracked[PROFILER_MAX_TRACKED];
+    size_t trackedCount;
+    bool sampled;
+    uint32_t lastTotal;
+    uint32_t lastInterval;      // Run time counter ticks between the last two samples
+};
+
+void profiler_track_task(TaskHandle_t handle, uint32_t stackSize, const MetricHistogram* loop = nullptr);
+void profiler_sample();
+
+// Writes a copy of the current profiles as JSON, one piece (head, task, tail) per call,
+// so it can be used as a ResponseStream producer
+class TaskProfileJsonWriter {
+public:
+    TaskProfileJsonWriter();
+    // Takes a new copy of the profiles, for a writer that is reused
+    void snapshot();
+    // Returns false once the closing bracket was written
+    bool write(Print& out, size_t item);
+
+private:
+    TaskProfile profiles[PROFILER_MAX_TASKS];
+    size_t count;
+    uint32_t interval;
+};
+
+#endif
@@ -5,8 +5,31 @@
 #include "LiquidCrystal_I2C.h"
 #include "DHT.h"
 #include "global.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "sensor_history.h"
+#include "report_policy.h"
+#include "latency_trace.h"
+#include "boot_timeline.h"
+#include "job_executor.h"
+#include "sensor_channel.h"
 
-void temp_humi_monitor(void *pvParameters);
+// The DHT11 needs at least one second between reads, shorter intervals are only
+// meant for the simulated sensor of the native environment
+#ifndef DHT_READ_INTERVAL_MS
+#define DHT_READ_INTERVAL_MS 5000
+#endif
+
+// The DHT11 does not answer for about a second after power-on. Until the first valid reading
+// failed reads are retried after DHT_BOOT_RETRY_MS instead of the full interval.
+#define DHT_WARMUP_MS 1000
+#define DHT_BOOT_RETRY_MS 2000
+
+// One read per step, on the job worker
+JobWait temp_humi_job(void *arg);
+
+// Also read by the low-power mode (low_power.h)
+extern DHT dht;
 
 
 #endif
\ No newline at end of file
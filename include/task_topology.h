@@ -0,0 +1,37 @@
+#ifndef __TASK_TOPOLOGY_H__
+#define __TASK_TOPOLOGY_H__
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "memory_budget.h"
+
+// Which core each task runs on. The WiFi driver and lwIP run on core 0, tasks created with
+// xTaskCreate could land on either core and the sensor reads and LCD transfers then waited
+// behind the radio. Every task now has a role and is pinned to the core of that role:
+//
+//   network       core 0   WebServer WiFi Config Task, WS Commands, Log Drain, async_tcp
+//                          (CONFIG_ASYNC_TCP_RUNNING_CORE in platformio.ini)
+//   acquisition   core 1   Jobs (DHT11, light sensor, LCD, NeoPixel), Arduino loopTask
+//
+// Data crosses the cores through SpscRing (spsc_ring.h), the sensor readings through
+// sensor_channel.h, not through globals written on one core and read on the other. On a single
+// core chip both roles share core 0.
+
+#define TOPOLOGY_NETWORK_CORE 0
+#define TOPOLOGY_ACQUISITION_CORE 1
+
+enum TaskRole : uint8_t {
+    TASK_ROLE_NETWORK,
+    TASK_ROLE_ACQUISITION
+};
+
+BaseType_t topology_core(TaskRole role);
+
+// Creates the task pinned to the core of its role, with its stack from the stack region, and
+// registers the stack size and loop histogram with the profiler. nullptr if it could not be created.
+TaskHandle_t topology_create_task(TaskFunction_t function, const char* name, MemoryRegionId stack, void* arg,
+                                  UBaseType_t priority, TaskRole role, const MetricHistogram* loop = nullptr);
+
+#endif
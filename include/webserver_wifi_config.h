@@ -6,18 +6,61 @@
 #include <ArduinoJson.h>
 #include <Preferences.h>
 #include <LittleFS.h>
-#include <Adafruit_NeoPixel.h>
 #include "global.h"
+#include "metrics.h"
+#include "deferred_log.h"
+#include "sensor_history.h"
+#include "report_policy.h"
+#include "task_profiler.h"
+#include "latency_trace.h"
+#include "ws_fanout.h"
+#include "ws_message.h"
+#include "ws_commands.h"
+#include "settings_store.h"
+#include "config_store.h"
+#include "boot_timeline.h"
+#include "neo_blynky.h"
+#include "sensor_channel.h"
+#include "task_topology.h"
 
 #define LED_GPIO 48
-#define NEO_PIN 45
-#define LED_COUNT 1
+
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+// A connect to the saved channel and BSSID takes well under a second, after this it scans instead
+#define WIFI_CACHED_CONNECT_TIMEOUT_MS 3000
+#define WIFI_CONNECT_POLL_MS 100
+
+// WebSocket messages (ws_message.h): the short ones are printed on the stack of the sending task,
+// the scan results, history and task profile into the one large buffer
+#define WS_MESSAGE_SMALL 512
+#define WS_MESSAGE_LARGE 6144
+
+// Period of the sensor broadcast to the dashboards
+#ifndef SENSOR_BROADCAST_INTERVAL_MS
+#define SENSOR_BROADCAST_INTERVAL_MS 3000
+#endif
+// Period of the WiFi status broadcast and of the web server loop
+#ifndef WIFI_STATUS_INTERVAL_MS
+#define WIFI_STATUS_INTERVAL_MS 5000
+#endif
+#ifndef WEB_SERVER_LOOP_MS
+#define WEB_SERVER_LOOP_MS 100
+#endif
 
 struct WiFiCredentials {
     String ssid;
     String password;
 };
 
+// Static web page on LittleFS, looked up once at startup instead of on every request
+struct StaticAsset {
+    const char* path;   // Path of the uncompressed page
+    String file;        // File that is actually served, the .gz variant if one exists
+    String etag;        // Strong ETag (MD5 of the served file)
+    bool gzip;
+    bool available;
+};
+
 struct WiFiNetwork {
     String ssid;
     int rssi;
@@ -28,7 +71,11 @@ class WiFiConfigServer {
 private:
     AsyncWebServer* server;
     AsyncWebSocket* ws;
+    WsFanout* fanout;
+    WsMessageAssembler assembler;
+    WsCommandQueue commands;
     Preferences preferences;
+    SettingsStore settings;
     bool isConfigMode;
     String configSSID;
     String configPassword;
@@ -36,26 +83,58 @@ private:
     // LED control
     bool ledState;
     bool neoState;
-    Adafruit_NeoPixel* neoPixel;
-    uint8_t savedNeoR, savedNeoG, savedNeoB;
-    String savedNeoHex;
     
-    // Temperature alert settings
-    uint8_t alertNeoR, alertNeoG, alertNeoB;
-    String alertNeoHex;
-    float tempThreshold;
+    // The NeoPixel colors and the alert threshold are not kept here: the command task saves them
+    // while the loop and the REST handlers read them. They live in settings (fixed char arrays,
+    // changed under its mutex), every reader takes a copy with settings.get().
+    
+    // Sensor readings from the jobs, taken over by the loop. The REST handlers and the command
+    // task read the fields without a lock, each is one word so a reader may only see fields of
+    // two consecutive readings.
+    SensorSnapshot sensors;
     
-    // Normal NeoPixel operation
+    // Buffer of the large messages, from the WS_MESSAGES region of the memory budget, and the
+    // task profile they are written from. Both tasks that send take largeMessageMutex for them.
+    SemaphoreHandle_t largeMessageMutex;
+    char* largeMessage;
+    TaskProfileJsonWriter profileWriter;
+    
+    // Alert blinking, run by the NeoPixel job (neo_blynky.h)
     bool isBlinking;
-    unsigned long lastBlinkTime;
-    bool blinkState;
     
-    void handleWebSocketMessage(void *arg, uint8_t *data, size_t len);
+    // Connect requested from a dashboard or at boot, run by the command task
+    bool connectPending;
+    unsigned long connectStart;
+    WsWiFiLogin connectLogin;
+    // Went to the saved channel and BSSID, retried with a scan if that fails
+    bool connectCached;
+    // Connect with the saved login at boot, config mode starts if it fails
+    bool connectAtBoot;
+    // Login of the last connect, empty after a disconnect
+    WsWiFiLogin stationLogin;
+    
+    // Static pages
+    StaticAsset dashboardAsset;
+    StaticAsset wifiConfigAsset;
+    
+    void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len);
+    void queueCommand(const WsCommand& command, const WsWiFiLogin* login = nullptr);
+    void runCommand(const WsCommand& command, const WsWiFiLogin& login);
+    // With the saved channel and BSSID if useCache and the login is the saved one
+    void beginConnect(const String& ssid, const String& password, bool useCache = true);
+    void startConnect(const WsWiFiLogin& login);
+    // Logs the result of a connect, true if connected
+    bool finishConnect();
+    void pollConnect();
     void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, 
                    AwsEventType type, void *arg, uint8_t *data, size_t len);
     void setupConfigRoutes();
-    String getWiFiScanJSON();
-    String getWiFiStatusJSON();
+    void loadStaticAsset(StaticAsset& asset, const char* path);
+    bool sendStaticAsset(AsyncWebServerRequest *request, const StaticAsset& asset);
+    void writeWiFiStatusJSON(Print& out);
+    void sendMessage(AsyncWebSocketClient *client, const WsMessage& message, WsFrameClass frameClass);
+    // Serializes doc into a fixed buffer and sends it, to all clients if client is nullptr
+    void sendJson(AsyncWebSocketClient *client, const JsonDocument& doc, WsFrameClass frameClass);
     String getConfigPageHTML();
     
 public:
@@ -63,47 +142,63 @@ public:
     
     void begin();
     void loop();
+    // Body of the "WS Commands" task, runs the queued dashboard actions one after another
+    void runCommands();
     void startConfigMode(const char* apSSID = "ESP32-Config", const char* apPassword = "12345678");
     void stopConfigMode();
     
     bool saveWiFiCredentials(const String& ssid, const String& password);
     WiFiCredentials loadWiFiCredentials();
+    // Listener of the device config, joins a changed WiFi login or starts config mode without one
+    void applyWiFiConfig(const DeviceConfig& config);
     
     std::vector<WiFiNetwork> scanWiFiNetworks();
-    bool connectToWiFi(const String& ssid, const String& password, unsigned long timeout = 10000);
+    bool connectToWiFi(const String& ssid, const String& password, unsigned long timeout = WIFI_CONNECT_TIMEOUT_MS);
     void disconnectWiFi();
     
     bool isConnected();
-    String getConnectedSSID();
-    String getLocalIP();
+    // Empty if not connected
+    const char* getConnectedSSID();
+    // Dotted quad, fits into 16 bytes
+    void getLocalIP(char* ip, size_t size);
     int getRSSI();
     
-    void sendWiFiStatus();
-    void sendWiFiList();
-    void sendSensorData();
-    void sendLEDStatus();
-    void sendLightSensorData();
-    void broadcastMessage(const String& message);
-    String getSensorDataJSON();
-    String getLEDStatusJSON();
-    String getLightSensorJSON();
+    // To one client or to all if client is nullptr
+    void sendWiFiStatus(AsyncWebSocketClient *client = nullptr);
+    void sendWiFiList(AsyncWebSocketClient *client = nullptr);
+    void sendSensorData(AsyncWebSocketClient *client = nullptr);
+    void sendLEDStatus(AsyncWebSocketClient *client = nullptr);
+    void sendLightSensorData(AsyncWebSocketClient *client = nullptr);
+    void sendAlertSettings(AsyncWebSocketClient *client = nullptr);
+    void broadcastMessage(const WsMessage& message, WsFrameClass frameClass = WS_FRAME_CONTROL);
+    void writeSensorDataJSON(Print& out);
+    void writeLEDStatusJSON(Print& out);
+    void writeLightSensorJSON(Print& out);
     
     // LED control methods
     void setLEDState(bool state);
     void setNeoColorForTemperature(float temperature); // Temperature-based NeoPixel control
     void setNeoColor(uint8_t r, uint8_t g, uint8_t b); // Normal color setting
     void setNeoState(bool state); // Manual control for normal operation
-    void handleNeoBlinking(); // Handle blinking during alerts
-    bool saveNeoColor(uint8_t r, uint8_t g, uint8_t b, const String& hex);
+    bool saveNeoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex);
     void loadSavedNeoColor();
     bool getLEDState();
     bool getNeoState();
     
     // Temperature alert configuration methods
-    bool saveAlertColor(uint8_t r, uint8_t g, uint8_t b, const String& hex);
+    bool saveAlertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex);
     void loadAlertSettings();
     bool saveTempThreshold(float threshold);
-    String getAlertSettingsJSON();
+    void writeAlertSettingsJSON(Print& out);
+    
+    // Sensor history (trend chart)
+    void sendHistory(AsyncWebSocketClient *client, HistoryMetric metric, uint32_t from, uint32_t to, size_t points);
+    
+    // Task profiler panel, to one client or to all if client is nullptr
+    void sendTaskProfile(AsyncWebSocketClient *client);
+    
+    // Rules of the report filter with what they let through since boot, to all clients if client is nullptr
+    void sendReportPolicy(AsyncWebSocketClient *client = nullptr);
 };
 
 extern WiFiConfigServer* wifiConfig;
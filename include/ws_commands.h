@@ -0,0 +1,150 @@
+#ifndef __WS_COMMANDS_H__
+#define __WS_COMMANDS_H__
+
+#include <Arduino.h>
+#include <AsyncWebSocket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "metrics.h"
+#include "sensor_history.h"
+#include "report_policy.h"
+
+// Actions from the dashboards, parsed in the WebSocket event handler and run by the "WS Commands"
+// task. The handler runs on the network task, anything slow in it (joining a WiFi network, writing
+// preferences, a WiFi scan) holds up every connection, so it only checks a message and queues a
+// fixed size command.
+//
+// Actions are declared in a table in ws_commands.cpp with the parameters they take. The table is
+// indexed by a perfect hash of the action name, checked at compile time, so finding an action is
+// one hash and one string compare. Messages are parsed in place, in the frame buffer of the
+// library, and messages split into several frames are joined by a WsMessageAssembler first.
+//
+// A new command replaces one of the same kind that is still waiting, the older one is never run
+// and the newer one goes to the end of the queue. Dragging the color picker sends a preview per
+// mouse move, only the last one of a burst has to reach the NeoPixel. Requests that are answered
+// to the asking client only (get_*, scan) are of the same kind only for the same client, report
+// rules only for the same metric. A new dashboard asks for up to 8 requests, the queue has room
+// for that from several at once.
+//
+// Commands are a few bytes, except for a WiFi login. Only one connect can be waiting, so its
+// credentials are kept next to the queue instead of in every command.
+
+#define WS_COMMAND_QUEUE_DEPTH 64
+#define WS_COMMAND_MAX_SSID 32          // 802.11 limits
+#define WS_COMMAND_MAX_PASSWORD 64
+#define WS_COMMAND_MAX_HEX 7            // "#rrggbb"
+#define WS_COMMAND_MAX_MESSAGE 256      // Longer fragmented messages are dropped
+#define WS_COMMAND_FRAGMENTED_SLOTS 4   // Clients that can be in the middle of a fragmented message
+
+enum WsCommandType : uint8_t {
+    // Answered to the asking client only
+    WS_CMD_SCAN,
+    WS_CMD_GET_STATUS,
+    WS_CMD_GET_SENSORS,
+    WS_CMD_GET_LEDS,
+    WS_CMD_GET_LIGHT,
+    WS_CMD_GET_ALERT_SETTINGS,
+    WS_CMD_GET_HISTORY,
+    WS_CMD_GET_TASKS,
+    WS_CMD_GET_REPORT_POLICY,
+    // State changes, the result goes to all clients
+    WS_CMD_CONNECT,
+    WS_CMD_DISCONNECT,
+    WS_CMD_CONTROL_LED,
+    WS_CMD_CONTROL_NEO,
+    WS_CMD_PREVIEW_NEO_COLOR,
+    WS_CMD_SAVE_NEO_COLOR,
+    WS_CMD_SAVE_ALERT_COLOR,
+    WS_CMD_SAVE_TEMP_THRESHOLD,
+    WS_CMD_SET_REPORT_POLICY
+};
+
+struct WsColor {
+    uint8_t r, g, b;
+    char hex[WS_COMMAND_MAX_HEX + 1];
+};
+
+struct WsWiFiLogin {
+    char ssid[WS_COMMAND_MAX_SSID + 1];
+    char password[WS_COMMAND_MAX_PASSWORD + 1];
+};
+
+struct WsHistoryRequest {
+    HistoryMetric metric;
+    uint32_t from;
+    uint32_t to;
+    uint32_t range;         // Only used while parsing, for the default of from
+    uint32_t points;
+};
+
+struct WsReportRule {
+    HistoryMetric metric;
+    ReportRule rule;
+};
+
+struct WsCommand {
+    WsCommandType type;
+    uint32_t client;        // Id of the client that sent it
+    union {
+        bool state;
+        float threshold;
+        WsColor color;
+        WsHistoryRequest history;
+        WsReportRule report;
+    };
+};
+
+inline bool ws_command_is_request(WsCommandType type) {
+    return type <= WS_CMD_GET_REPORT_POLICY;
+}
+
+// Parses and checks a message from a dashboard, false if it is no valid command. The message is
+// parsed in place and overwritten. login is only set for WS_CMD_CONNECT.
+bool ws_command_parse(char* message, size_t len, uint32_t client, WsCommand& command, WsWiFiLogin& login);
+
+// Joins the frames of fragmented messages per client, as they arrive in WS_EVT_DATA events. The
+// library hands over a frame in parts if it does not fit one TCP segment, those are joined too.
+// Only used from the event handler, so there is no lock.
+class WsMessageAssembler {
+public:
+    WsMessageAssembler();
+
+    // Returns the message once its last part arrived, nullptr while parts are missing or if it is
+    // longer than WS_COMMAND_MAX_MESSAGE. A message in one piece is returned as it is, in the buffer
+    // of the library. Either way it is only valid until the next call.
+    char* add(uint32_t client, const AwsFrameInfo* info, uint8_t* data, size_t len, size_t& messageLen);
+    // Drops a partial message of a client that disconnected
+    void drop(uint32_t client);
+
+private:
+    struct Slot {
+        uint32_t client;    // 0 if the slot is free
+        size_t len;
+        bool overflow;
+        char buffer[WS_COMMAND_MAX_MESSAGE + 1];
+    };
+
+    Slot slots[WS_COMMAND_FRAGMENTED_SLOTS];
+
+    Slot* find(uint32_t client);
+};
+
+class WsCommandQueue {
+public:
+    WsCommandQueue();
+
+    // Replaces a waiting command of the same kind, false if the queue is full. login is needed
+    // for WS_CMD_CONNECT only.
+    bool push(const WsCommand& command, const WsWiFiLogin* login = nullptr);
+    // Waits up to ticks for the oldest command, login is set if it is a WS_CMD_CONNECT
+    bool pop(WsCommand& command, WsWiFiLogin& login, TickType_t ticks);
+
+private:
+    SemaphoreHandle_t mutex;
+    SemaphoreHandle_t available;    // Counts the queued commands
+    WsCommand commands[WS_COMMAND_QUEUE_DEPTH];
+    size_t count;
+    WsWiFiLogin login;              // Of the waiting connect
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __WS_FANOUT_H__
+#define __WS_FANOUT_H__
+
+#include <Arduino.h>
+#include <AsyncWebSocket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "metrics.h"
+
+// Broadcast layer on top of AsyncWebSocket. textAll copies a message into the queue of every
+// client, so one client on a weak link lets its queue grow until the library drops messages or
+// the heap runs out. Here a message is written once into a shared AsyncWebSocketMessageBuffer,
+// every client queues references to it, and only WS_FANOUT_IN_FLIGHT frames per client are
+// handed to the library at a time.
+//
+// A client that falls behind loses its oldest queued sensor frame for every new one, the newer
+// reading makes it worthless anyway. Control frames are never dropped: a client whose queue is
+// full of them is closed instead, as is one whose queues (here and in the library) did not run
+// empty once for WS_FANOUT_EVICT_MS.
+
+#define WS_FANOUT_MAX_CLIENTS 16        // More are closed right after they connect
+#define WS_FANOUT_QUEUE_DEPTH 16        // Frames waiting per client
+#define WS_FANOUT_SENSOR_DEPTH 4        // Sensor frames among them
+#define WS_FANOUT_IN_FLIGHT 4           // Frames per client in the queue of the library
+#define WS_FANOUT_EVICT_MS 10000
+
+enum WsFrameClass : uint8_t {
+    WS_FRAME_SENSOR,    // Periodic state (sensors, status, task profile), superseded by the next one
+    WS_FRAME_CONTROL    // Replies to actions and requested data
+};
+
+class WsFanout {
+public:
+    explicit WsFanout(AsyncWebSocket* ws);
+
+    // From the connect and disconnect events
+    void addClient(uint32_t id);
+    void removeClient(uint32_t id);
+
+    void broadcast(const char* message, size_t len, WsFrameClass frameClass);
+    void send(uint32_t id, const char* message, size_t len, WsFrameClass frameClass);
+    // Hands queued frames to the library and closes clients that stay behind, call it regularly
+    void pump();
+    // True if no frame is waiting, neither here nor in the library
+    bool drained();
+
+private:
+    struct Frame {
+        AsyncWebSocketMessageBuffer* buffer;    // nullptr if the slot is free
+        uint8_t refs;
+        WsFrameClass frameClass;
+    };
+
+    struct Client {
+        uint32_t id;
+        Frame* queue[WS_FANOUT_QUEUE_DEPTH];
+        uint8_t count;
+        uint8_t sensors;
+        uint32_t lastDrained;   // millis() when nothing was queued for the client, here or in the library
+        bool evicted;
+    };
+
+    AsyncWebSocket* ws;
+    SemaphoreHandle_t mutex;
+    Client clients[WS_FANOUT_MAX_CLIENTS];
+    size_t clientCount;
+    // Every frame is referenced by at least one queue, so this many are always enough
+    Frame frames[WS_FANOUT_MAX_CLIENTS * WS_FANOUT_QUEUE_DEPTH];
+
+    Client* find(uint32_t id);
+    Frame* makeFrame(const char* message, size_t len, WsFrameClass frameClass);
+    void release(Frame* frame);
+    void remove(Client& client, size_t index);
+    void push(Client& client, Frame* frame);
+    void pumpClient(Client& client, uint32_t now);
+    void evict(Client& client);
+};
+
+#endif
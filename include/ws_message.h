@@ -0,0 +1,33 @@
+#ifndef __WS_MESSAGE_H__
+#define __WS_MESSAGE_H__
+
+#include <Arduino.h>
+
+// A WebSocket message printed into a fixed buffer. serializeJson(doc, String) grew a String
+// for every message, so every broadcast left allocations of a new size behind. WsMessage
+// writes into a buffer of the caller, on the stack for the short messages, and only a message
+// that outgrows it is moved to the heap (heap site WS_MESSAGE_OVERFLOW). WsFanout copies the
+// message into the frame of the library, the buffer can be reused right after sending.
+class WsMessage : public Print {
+public:
+    WsMessage(char* buffer, size_t capacity);
+    ~WsMessage();
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t size) override;
+
+    const char* c_str() const { return text; }
+    size_t length() const { return len; }
+
+private:
+    char* text;
+    size_t capacity;
+    size_t len;
+    bool onHeap;
+
+    WsMessage(const WsMessage&);
+    WsMessage& operator=(const WsMessage&);
+    bool reserve(size_t size);
+};
+
+#endif
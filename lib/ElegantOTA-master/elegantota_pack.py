@@ -0,0 +1,202 @@
+# Generates compressed and delta encoded images for ElegantOTA uploads
+#
+# Compressed image (only needs the new firmware):
+#   python elegantota_pack.py firmware.bin -o firmware.eotz
+#
+# Delta image (against the firmware that is currently running on the device):
+#   python elegantota_pack.py firmware.bin --base old_firmware.bin -o firmware.eotz
+#
+# The device detects encoded uploads by their magic and decodes them while the upload
+# streams, so they can be uploaded through /update like any other image. The MD5 hash
+# passed to /ota/start has to be the one of the decoded firmware, which is printed below.
+# See src/ElegantOTADecoder.h for a description of the format.
+
+import argparse
+import hashlib
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"EOTZ"
+VERSION = 1
+FLAG_DELTA = 0x01
+HEADER = struct.Struct("<4sBBBBIII")
+
+LITERAL_MAX = 128
+MATCH_MIN = 3
+MATCH_MAX = 0x3F + MATCH_MIN
+BASE_COPY_MAX = 0x3FFF + 1
+
+WINDOW_KEY = 4
+WINDOW_CHAIN = 16
+BASE_KEY = 8
+BASE_STEP = 4
+
+
+def _match_length(a, a_pos, b, b_pos, limit):
+    length = 0
+    # Compare in blocks first, firmware deltas are mostly long identical runs
+    while length + 32 <= limit and a[a_pos + length:a_pos + length + 32] == b[b_pos + length:b_pos + length + 32]:
+        length += 32
+    while length < limit and a[a_pos + length] == b[b_pos + length]:
+        length += 1
+    return length
+
+
+def _index_base(base):
+    index = {}
+    for pos in range(0, len(base) - BASE_KEY + 1, BASE_STEP):
+        index.setdefault(base[pos:pos + BASE_KEY], pos)
+    return index
+
+
+def encode(data, base=None, window_bits=12):
+    window = 1 << window_bits
+    base = base or b""
+    base_index = _index_base(base) if base else {}
+    heads = {}
+    prev = [0] * len(data)
+
+    out = bytearray(HEADER.pack(MAGIC, VERSION, FLAG_DELTA if base else 0, window_bits, 0,
+                                len(data), zlib.crc32(data) & 0xFFFFFFFF, len(base)))
+    literals = bytearray()
+
+    def flush_literals():
+        for start in range(0, len(literals), LITERAL_MAX):
+            run = literals[start:start + LITERAL_MAX]
+            out.append(len(run) - 1)
+            out.extend(run)
+        literals.clear()
+
+    def insert(pos):
+        if pos + WINDOW_KEY <= len(data):
+            key = data[pos:pos + WINDOW_KEY]
+            prev[pos] = heads.get(key, -1)
+            heads[key] = pos
+
+    pos = 0
+    while pos < len(data):
+        remaining = len(data) - pos
+
+        # Longest copy from the history window
+        window_len, window_dist = 0, 0
+        if remaining >= WINDOW_KEY:
+            candidate = heads.get(data[pos:pos + WINDOW_KEY], -1)
+            chain = WINDOW_CHAIN
+            while candidate >= 0 and pos - candidate <= window and chain:
+                length = _match_length(data, candidate, data, pos, min(remaining, MATCH_MAX))
+                if length > window_len:
+                    window_len, window_dist = length, pos - candidate
+                    if length == MATCH_MAX:
+                        break
+                candidate = prev[candidate]
+                chain -= 1
+
+        # Longest copy from the base firmware, the index only holds every BASE_STEP'th
+        # position, so a match is found at the latest BASE_STEP - 1 bytes after it starts
+        base_len, base_off = 0, 0
+        if base_index and remaining >= BASE_KEY:
+            candidate = base_index.get(data[pos:pos + BASE_KEY])
+            if candidate is not None:
+                base_len = _match_length(base, candidate, data, pos, min(remaining, BASE_COPY_MAX, len(base) - candidate))
+                base_off = candidate
+
+        window_gain = window_len - 3 if window_len >= MATCH_MIN else 0
+        base_gain = base_len - 6 if base_len >= BASE_KEY else 0
+
+        if base_gain > 0 and base_gain >= window_gain:
+            flush_literals()
+            out.append(0xC0 | ((base_len - 1) >> 8))
+            out.append((base_len - 1) & 0xFF)
+            out.extend(struct.pack("<I", base_off))
+            length = base_len
+        elif window_gain > 0:
+            flush_literals()
+            out.append(0x80 | (window_len - MATCH_MIN))
+            out.extend(struct.pack("<H", window_dist))
+            length = window_len
+        else:
+            literals.append(data[pos])
+            length = 1
+
+        for i in range(pos, pos + length):
+            insert(i)
+        pos += length
+
+    flush_literals()
+    return bytes(out)
+
+
+def decode(image, base=None):
+    magic, version, flags, window_bits, _, size, crc, base_size = HEADER.unpack_from(image)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not an encoded ElegantOTA image")
+    if flags & FLAG_DELTA and (base is None or len(base) < base_size):
+        raise ValueError("delta image needs the base firmware")
+    window = 1 << window_bits
+    out = bytearray()
+    pos = HEADER.size
+    while pos < len(image):
+        op = image[pos]
+        pos += 1
+        if op < 0x80:
+            out.extend(image[pos:pos + op + 1])
+            pos += op + 1
+        elif op < 0xC0:
+            length = (op & 0x3F) + MATCH_MIN
+            distance = struct.unpack_from("<H", image, pos)[0]
+            pos += 2
+            if distance == 0 or distance > window or distance > len(out):
+                raise ValueError("window reference out of range")
+            for _ in range(length):
+                out.append(out[-distance])
+        else:
+            length = (((op & 0x3F) << 8) | image[pos]) + 1
+            offset = struct.unpack_from("<I", image, pos + 1)[0]
+            pos += 5
+            if offset + length > base_size:
+                raise ValueError("base reference out of range")
+            out.extend(base[offset:offset + length])
+    if len(out) != size or (zlib.crc32(out) & 0xFFFFFFFF) != crc:
+        raise ValueError("decoded image does not match")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate compressed or delta images for ElegantOTA")
+    parser.add_argument("firmware", help="new firmware image (.bin)")
+    parser.add_argument("-o", "--output", required=True, help="encoded image to write")
+    parser.add_argument("--base", help="firmware running on the device, generates a delta image")
+    parser.add_argument("--window-bits", type=int, default=12, choices=range(8, 16),
+                        help="history window the device has to keep in RAM (default: 12 = 4 KiB)")
+    parser.add_argument("--verify", action="store_true", help="decode the result again and compare it byte by byte")
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        data = f.read()
+    base = None
+    if args.base:
+        with open(args.base, "rb") as f:
+            base = f.read()
+
+    started = time.time()
+    image = encode(data, base, args.window_bits)
+    elapsed = time.time() - started
+    with open(args.output, "wb") as f:
+        f.write(image)
+
+    print(f"{args.firmware}: {len(data)} -> {len(image)} bytes ({100.0 * len(image) / max(len(data), 1):.1f}%) in {elapsed:.1f}s")
+    print(f"MD5 of decoded firmware: {hashlib.md5(data).hexdigest()}")
+
+    if args.verify:
+        started = time.time()
+        if decode(image, base) != data:
+            print("Verification failed: decoded image differs")
+            return 1
+        print(f"Verified, decoded in {time.time() - started:.1f}s")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -11,7 +11,14 @@
 # An example of an upload URL:
 #                custom_upload_url = http://192.168.1.123/update 
 # also possible: custom_upload_url = http://domainname/update
+#
+# Optional, upload a compressed or delta image instead of the full firmware
+# (copy elegantota_pack.py next to this script as well):
+#
+# custom_upload_compress = yes
+# custom_upload_base = <path to the firmware .bin currently running on the device>
 
+import io
 import sys
 import requests
 import hashlib
@@ -29,6 +36,24 @@ except ImportError:
     from requests_toolbelt import MultipartEncoder, MultipartEncoderMonitor
     from tqdm import tqdm
 
+def encode_firmware(firmware, is_spiffs):
+    compress = env.GetProjectOption('custom_upload_compress', 'no').lower() in ('yes', 'true', '1')
+    base_path = env.GetProjectOption('custom_upload_base', '')
+    if not compress and not base_path:
+        return firmware
+    sys.path.insert(0, env.subst("$PROJECT_DIR"))
+    import elegantota_pack
+
+    data = firmware.read()
+    base = None
+    # Delta images are only supported for firmware updates
+    if base_path and not is_spiffs:
+        with open(base_path, 'rb') as f:
+            base = f.read()
+    image = elegantota_pack.encode(data, base)
+    print(f"Encoded image: {len(data)} -> {len(image)} bytes")
+    return io.BytesIO(image)
+
 def on_upload(source, target, env):
     firmware_path = str(source[0])
 
@@ -37,12 +62,15 @@ def on_upload(source, target, env):
     upload_url = upload_url_compatibility.replace("/update", "")
 
     with open(firmware_path, 'rb') as firmware:
+        # MD5 is always the one of the decoded firmware, the device checks it after decoding
         md5 = hashlib.md5(firmware.read()).hexdigest()
+        firmware.seek(0)
 
         parsed_url = urlparse(upload_url)
         host_ip = parsed_url.netloc
 
         is_spiffs = source[0].name == "spiffs.bin"
+        upload = encode_firmware(firmware, is_spiffs)
         file_type = "fs" if is_spiffs else "fr"
 
         # execute GET request
@@ -95,10 +123,10 @@ def on_upload(source, target, env):
             if doUpdate.status_code != 200:
                 return "Start request failed " + str(doUpdate.status_code)
 
-        firmware.seek(0)
+        upload.seek(0)
         encoder = MultipartEncoder(fields={
             'MD5': md5,
-            'firmware': ('firmware', firmware, 'application/octet-stream')}
+            'firmware': ('firmware', upload, 'application/octet-stream')}
         )
 
         bar = tqdm(desc='Upload Progress',
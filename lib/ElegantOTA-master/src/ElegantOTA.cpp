@@ -67,6 +67,8 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
         }
       }
 
+      _mode = mode;
+
       #if UPDATE_DEBUG == 1
         // Serial output must be active to see the callback serial prints
         Serial.setDebugOutput(true);
@@ -157,6 +159,8 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
         }
       }
 
+      _mode = mode;
+
       #if UPDATE_DEBUG == 1
         // Serial output must be active to see the callback serial prints
         Serial.setDebugOutput(true);
@@ -248,11 +252,12 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
         if (!index) {
           // Reset progress size on first frame
           _current_progress_size = 0;
+          beginUpload(data, len);
         }
 
         // Write chunked data to the free sketch space
         if(len){
-            if (Update.write(data, len) != len) {
+            if (writeUpload(data, len) != len) {
                 return request->send(400, "text/plain", "Failed to write chunked data to free space");
             }
             _current_progress_size += len;
@@ -261,6 +266,9 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
         }
             
         if (final) { // if the final flag is set then this is the last frame of data
+            if (!finishUpload()) {
+                return;
+            }
             if (!Update.end(true)) { //true to set the size to the current progress
                 // Save error to string
                 StreamString str;
@@ -301,7 +309,10 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
         Serial.printf("Update Received: %s\n", upload.filename.c_str());
         _current_progress_size = 0;
       } else if (upload.status == UPLOAD_FILE_WRITE) {
-          if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+          if (_current_progress_size == 0) {
+            beginUpload(upload.buf, upload.currentSize);
+          }
+          if (writeUpload(upload.buf, upload.currentSize) != upload.currentSize) {
             #if UPDATE_DEBUG == 1
               Update.printError(Serial);
             #endif
@@ -311,7 +322,9 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
           // Progress update callback
           if (progressUpdateCallback != NULL) progressUpdateCallback(_current_progress_size, upload.totalSize);
       } else if (upload.status == UPLOAD_FILE_END) {
-          if (Update.end(true)) {
+          if (!finishUpload()) {
+              ELEGANTOTA_DEBUG_MSG("[!] Update Failed\n");
+          } else if (Update.end(true)) {
               ELEGANTOTA_DEBUG_MSG(String("Update Success: "+String(upload.totalSize)+"\n").c_str());
           } else {
               ELEGANTOTA_DEBUG_MSG("[!] Update Failed\n");
@@ -333,6 +346,68 @@ void ElegantOTAClass::begin(ELEGANTOTA_WEBSERVER *server, const char * username,
   #endif
 }
 
+#if ELEGANTOTA_USE_DECODER == 1
+static bool readRunningFirmware(size_t offset, uint8_t *data, size_t len){
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  if (running == NULL || offset > running->size || len > running->size - offset) {
+    return false;
+  }
+  return esp_partition_read(running, offset, data, len) == ESP_OK;
+}
+#endif
+
+void ElegantOTAClass::beginUpload(const uint8_t *data, size_t len){
+  #if ELEGANTOTA_USE_DECODER == 1
+    // Encoded images are detected by their magic, raw images always start with 0xE9
+    _decoding = ElegantOTADecoder::isEncoded(data, len);
+    if (_decoding) {
+      ELEGANTOTA_DEBUG_MSG("Encoded image, decoding while uploading\n");
+      // Delta images are only allowed for firmware updates, the filesystem partition is the one being overwritten
+      _decoder.begin([](uint8_t *decoded, size_t decoded_len) {
+        return Update.write(decoded, decoded_len);
+      }, _mode == OTA_MODE_FIRMWARE ? readRunningFirmware : ElegantOTADecoder::BaseReadCallback(NULL));
+    }
+  #else
+    (void)data;
+    (void)len;
+  #endif
+}
+
+size_t ElegantOTAClass::writeUpload(uint8_t *data, size_t len){
+  #if ELEGANTOTA_USE_DECODER == 1
+    if (_decoding) {
+      if (_decoder.write(data, len)) {
+        return len;
+      }
+      if (!Update.hasError()) {
+        _update_error_str = String("Decoding failed: ") + _decoder.errorString() + "\n";
+        ELEGANTOTA_DEBUG_MSG(_update_error_str.c_str());
+        Update.abort();
+      }
+      return 0;
+    }
+  #endif
+  return Update.write(data, len);
+}
+
+bool ElegantOTAClass::finishUpload(){
+  #if ELEGANTOTA_USE_DECODER == 1
+    if (_decoding) {
+      _decoding = false;
+      bool decoded = _decoder.end();
+      if (!decoded && !Update.hasError()) {
+        _update_error_str = String("Decoding failed: ") + _decoder.errorString() + "\n";
+        ELEGANTOTA_DEBUG_MSG(_update_error_str.c_str());
+        // Never finish the update with a partially decoded image
+        Update.abort();
+      }
+      _decoder.abort();
+      return decoded;
+    }
+  #endif
+  return true;
+}
+
 void ElegantOTAClass::setAuth(const char * username, const char * password){
   _username = username;
   _password = password;
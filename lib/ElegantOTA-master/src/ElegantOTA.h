@@ -22,6 +22,7 @@ _____ _                        _    ___ _____  _
 #include "Arduino.h"
 #include "stdlib_noniso.h"
 #include "elop.h"
+#include "ElegantOTADecoder.h"
 
 #ifndef ELEGANTOTA_USE_ASYNC_WEBSERVER
   #define ELEGANTOTA_USE_ASYNC_WEBSERVER 0
@@ -35,6 +36,15 @@ _____ _                        _    ___ _____  _
   #define UPDATE_DEBUG 0
 #endif
 
+// Compressed and delta encoded uploads (see ElegantOTADecoder.h), needs Update.abort() and the ESP32 partition API
+#ifndef ELEGANTOTA_USE_DECODER
+  #if defined(ESP32)
+    #define ELEGANTOTA_USE_DECODER 1
+  #else
+    #define ELEGANTOTA_USE_DECODER 0
+  #endif
+#endif
+
 #if ELEGANTOTA_DEBUG
   #define ELEGANTOTA_DEBUG_MSG(x) Serial.printf("%s %s", "[ElegantOTA] ", x)
 #else
@@ -73,6 +83,10 @@ _____ _                        _    ___ _____  _
     #include "WebServer.h"
     #define ELEGANTOTA_WEBSERVER WebServer
   #endif
+  #if ELEGANTOTA_USE_DECODER == 1
+    #include "esp_ota_ops.h"
+    #include "esp_partition.h"
+  #endif
   #define HARDWARE "ESP32"
 #elif defined(TARGET_RP2040) || defined(TARGET_RP2350) || defined(PICO_RP2040) || defined(PICO_RP2350)
   #include <functional>
@@ -134,6 +148,16 @@ class ElegantOTAClass{
 
     String _update_error_str = "";
     unsigned long _current_progress_size;
+    OTA_Mode _mode = OTA_MODE_FIRMWARE;
+
+    #if ELEGANTOTA_USE_DECODER == 1
+      ElegantOTADecoder _decoder;
+      bool _decoding = false;
+    #endif
+
+    void beginUpload(const uint8_t *data, size_t len);
+    size_t writeUpload(uint8_t *data, size_t len);
+    bool finishUpload();
 
     std::function<void()> preUpdateCallback = NULL;
     std::function<void(size_t current, size_t final)> progressUpdateCallback = NULL;
@@ -0,0 +1,258 @@
+#include "ElegantOTADecoder.h"
+
+#include <new>
+#include <string.h>
+
+static const uint8_t ENCODED_MAGIC[4] = { 'E', 'O', 'T', 'Z' };
+static const uint8_t ENCODED_VERSION = 1;
+static const uint8_t FLAG_DELTA = 0x01;
+static const uint8_t MIN_WINDOW_BITS = 8;
+static const size_t BASE_READ_CHUNK = 64;
+
+// Nibble table for the reflected CRC32 (0xEDB88320), same result as zlib.crc32()
+static const uint32_t CRC32_NIBBLE[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t readLE16(const uint8_t *data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t *data) {
+  return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+ElegantOTADecoder::ElegantOTADecoder(){}
+
+ElegantOTADecoder::~ElegantOTADecoder(){
+  abort();
+}
+
+bool ElegantOTADecoder::isEncoded(const uint8_t *data, size_t len){
+  return len >= sizeof(ENCODED_MAGIC) && memcmp(data, ENCODED_MAGIC, sizeof(ENCODED_MAGIC)) == 0;
+}
+
+bool ElegantOTADecoder::begin(WriteCallback write, BaseReadCallback readBase){
+  abort();
+  _write = write;
+  _read_base = readBase;
+  _error = NULL;
+  _state = STATE_HEADER;
+  _header_pos = 0;
+  _out_len = 0;
+  _produced = 0;
+  _crc = 0xFFFFFFFF;
+  if (_write == NULL) {
+    fail("No output for decoded image");
+    return false;
+  }
+  return true;
+}
+
+bool ElegantOTADecoder::write(const uint8_t *data, size_t len){
+  while (len && _state != STATE_ERROR) {
+    switch (_state) {
+      case STATE_HEADER: {
+        size_t n = HEADER_SIZE - _header_pos;
+        if (n > len) n = len;
+        memcpy(_header + _header_pos, data, n);
+        _header_pos += n;
+        data += n;
+        len -= n;
+        if (_header_pos == HEADER_SIZE && parseHeader()) {
+          _state = STATE_OP;
+        }
+        break;
+      }
+      case STATE_OP:
+        _op = *data++;
+        len--;
+        if (_op < 0x80) {
+          _literal_remaining = (size_t)_op + 1;
+          if (reserveOutput(_literal_remaining)) {
+            _state = STATE_LITERAL;
+          }
+        } else {
+          _operand_len = _op < 0xC0 ? 2 : 5;
+          _operand_pos = 0;
+          _state = STATE_OPERAND;
+        }
+        break;
+      case STATE_LITERAL: {
+        size_t n = _literal_remaining < len ? _literal_remaining : len;
+        for (size_t i = 0; i < n; i++) {
+          if (!emit(data[i])) {
+            return false;
+          }
+        }
+        data += n;
+        len -= n;
+        _literal_remaining -= n;
+        if (!_literal_remaining) {
+          _state = STATE_OP;
+        }
+        break;
+      }
+      case STATE_OPERAND:
+        _operand[_operand_pos++] = *data++;
+        len--;
+        if (_operand_pos == _operand_len && executeOperand() && _state != STATE_ERROR) {
+          _state = STATE_OP;
+        }
+        break;
+      case STATE_ERROR:
+        break;
+    }
+  }
+  return _state != STATE_ERROR;
+}
+
+bool ElegantOTADecoder::end(){
+  if (_state == STATE_ERROR) {
+    return false;
+  }
+  if (_state != STATE_OP || _produced != _image_size) {
+    fail("Encoded image is truncated");
+    return false;
+  }
+  if (!flush()) {
+    return false;
+  }
+  if ((_crc ^ 0xFFFFFFFF) != _image_crc) {
+    fail("Decoded image CRC mismatch (wrong base firmware?)");
+    return false;
+  }
+  delete[] _window;
+  _window = NULL;
+  return true;
+}
+
+void ElegantOTADecoder::abort(){
+  delete[] _window;
+  _window = NULL;
+  _state = STATE_HEADER;
+}
+
+bool ElegantOTADecoder::parseHeader(){
+  if (!isEncoded(_header, HEADER_SIZE)) {
+    fail("Invalid encoded image magic");
+    return false;
+  }
+  if (_header[4] != ENCODED_VERSION) {
+    fail("Unsupported encoded image version");
+    return false;
+  }
+  uint8_t window_bits = _header[6];
+  if (window_bits < MIN_WINDOW_BITS || window_bits > ELEGANTOTA_DECODER_MAX_WINDOW_BITS) {
+    fail("Encoded image window size is not supported");
+    return false;
+  }
+  _image_size = readLE32(_header + 8);
+  _image_crc = readLE32(_header + 12);
+  _base_size = readLE32(_header + 16);
+  if ((_header[5] & FLAG_DELTA) && _read_base == NULL) {
+    fail("Delta images are not supported for this update");
+    return false;
+  }
+
+  size_t window_size = (size_t)1 << window_bits;
+  _window = new (std::nothrow) uint8_t[window_size];
+  if (_window == NULL) {
+    fail("Not enough memory for the decoder window");
+    return false;
+  }
+  memset(_window, 0, window_size);
+  _window_mask = window_size - 1;
+  _window_pos = 0;
+  return true;
+}
+
+bool ElegantOTADecoder::executeOperand(){
+  if (_op < 0xC0) {
+    // Copy from our own history, the source may overlap the bytes we are producing (runs)
+    size_t length = (size_t)(_op & 0x3F) + 3;
+    size_t distance = readLE16(_operand);
+    if (distance == 0 || distance > _window_mask + 1 || distance > _produced) {
+      fail("Encoded image references data outside of the window");
+      return false;
+    }
+    if (!reserveOutput(length)) {
+      return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+      if (!emit(_window[(_window_pos - distance) & _window_mask])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Copy from the currently running firmware
+  size_t length = ((((size_t)_op & 0x3F) << 8) | _operand[0]) + 1;
+  size_t offset = readLE32(_operand + 1);
+  if (offset > _base_size || length > _base_size - offset) {
+    fail("Encoded image references data outside of the base firmware");
+    return false;
+  }
+  if (!reserveOutput(length)) {
+    return false;
+  }
+  uint8_t chunk[BASE_READ_CHUNK];
+  while (length) {
+    size_t n = length < sizeof(chunk) ? length : sizeof(chunk);
+    if (!_read_base(offset, chunk, n)) {
+      fail("Failed to read base firmware");
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (!emit(chunk[i])) {
+        return false;
+      }
+    }
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool ElegantOTADecoder::reserveOutput(size_t len){
+  if (len > _image_size - _produced) {
+    fail("Encoded image decodes past the announced size");
+    return false;
+  }
+  return true;
+}
+
+bool ElegantOTADecoder::emit(uint8_t value){
+  _window[_window_pos & _window_mask] = value;
+  _window_pos++;
+  _produced++;
+
+  _crc ^= value;
+  _crc = (_crc >> 4) ^ CRC32_NIBBLE[_crc & 0x0F];
+  _crc = (_crc >> 4) ^ CRC32_NIBBLE[_crc & 0x0F];
+
+  _out[_out_len++] = value;
+  if (_out_len == sizeof(_out)) {
+    return flush();
+  }
+  return true;
+}
+
+bool ElegantOTADecoder::flush(){
+  // Emptied on every path, a failed write must not leave a full buffer behind for the next emit()
+  size_t len = _out_len;
+  _out_len = 0;
+  if (len && _state != STATE_ERROR && _write(_out, len) != len) {
+    fail("Failed to write decoded data to free space");
+  }
+  return _state != STATE_ERROR;
+}
+
+void ElegantOTADecoder::fail(const char *error){
+  if (_error == NULL) {
+    _error = error;
+  }
+  _state = STATE_ERROR;
+}
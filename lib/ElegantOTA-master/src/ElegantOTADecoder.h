@@ -0,0 +1,114 @@
+/**
+ *
+ * @name ElegantOTADecoder
+ * @brief Streaming decoder for compressed and delta encoded OTA images
+ *
+ * Encoded images start with a 20 byte header (all values little endian):
+ *
+ *   0  "EOTZ" magic
+ *   4  format version (1)
+ *   5  flags (bit 0: image references the running firmware)
+ *   6  window bits, the decoder keeps (1 << bits) bytes of history
+ *   7  reserved (0)
+ *   8  size of the decoded image
+ *   12 CRC32 of the decoded image
+ *   16 size of the base image the delta was generated against (0 if none)
+ *
+ * followed by a stream of ops:
+ *
+ *   0x00-0x7F  literal run, (op + 1) raw bytes follow
+ *   0x80-0xBF  copy (op & 0x3F) + 3 bytes from the history window, u16 distance follows
+ *   0xC0-0xFF  copy (((op & 0x3F) << 8) | u8) + 1 bytes from the base image, u32 offset follows
+ *
+ * Ops may be split at any byte across upload chunks, the decoder only ever
+ * needs the history window plus a small output buffer in RAM.
+ * Images are generated by elegantota_pack.py.
+ */
+
+#ifndef ElegantOTADecoder_h
+#define ElegantOTADecoder_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+#ifndef ELEGANTOTA_DECODER_MAX_WINDOW_BITS
+  #define ELEGANTOTA_DECODER_MAX_WINDOW_BITS 15
+#endif
+
+#ifndef ELEGANTOTA_DECODER_OUT_BUFFER
+  #define ELEGANTOTA_DECODER_OUT_BUFFER 512
+#endif
+
+class ElegantOTADecoder{
+  public:
+    typedef std::function<size_t(uint8_t *data, size_t len)> WriteCallback;
+    typedef std::function<bool(size_t offset, uint8_t *data, size_t len)> BaseReadCallback;
+
+    static constexpr size_t HEADER_SIZE = 20;
+
+    ElegantOTADecoder();
+    ~ElegantOTADecoder();
+
+    // Returns true if the given upload starts with the encoded image magic
+    static bool isEncoded(const uint8_t *data, size_t len);
+
+    // Write receives the decoded image, readBase may be NULL if delta images are not supported
+    bool begin(WriteCallback write, BaseReadCallback readBase = NULL);
+    // Feeds the next part of the upload, returns false once the stream is invalid
+    bool write(const uint8_t *data, size_t len);
+    // Flushes the remaining output and validates size and CRC of the decoded image
+    bool end();
+    void abort();
+
+    bool hasError() const { return _error != NULL; }
+    const char *errorString() const { return _error ? _error : ""; }
+    size_t decodedSize() const { return _produced; }
+    size_t imageSize() const { return _image_size; }
+
+  private:
+    enum State {
+      STATE_HEADER,
+      STATE_OP,
+      STATE_OPERAND,
+      STATE_LITERAL,
+      STATE_ERROR
+    };
+
+    WriteCallback _write = NULL;
+    BaseReadCallback _read_base = NULL;
+
+    State _state = STATE_HEADER;
+    const char *_error = NULL;
+
+    uint8_t _header[HEADER_SIZE];
+    size_t _header_pos = 0;
+
+    uint8_t _op = 0;
+    uint8_t _operand[5];
+    size_t _operand_len = 0;
+    size_t _operand_pos = 0;
+    size_t _literal_remaining = 0;
+
+    uint8_t *_window = NULL;
+    size_t _window_mask = 0;
+    size_t _window_pos = 0;
+
+    uint8_t _out[ELEGANTOTA_DECODER_OUT_BUFFER];
+    size_t _out_len = 0;
+
+    size_t _image_size = 0;
+    uint32_t _image_crc = 0;
+    size_t _base_size = 0;
+    size_t _produced = 0;
+    uint32_t _crc = 0;
+
+    bool parseHeader();
+    bool executeOperand();
+    bool reserveOutput(size_t len);
+    bool emit(uint8_t value);
+    bool flush();
+    void fail(const char *error);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __NATIVE_ADAFRUIT_NEOPIXEL_H__
+#define __NATIVE_ADAFRUIT_NEOPIXEL_H__
+
+#include "Arduino.h"
+#include <vector>
+
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+// Keeps the pixel colors in memory, show() only counts the frames that would be sent
+class Adafruit_NeoPixel {
+public:
+    Adafruit_NeoPixel(uint16_t n, int16_t pin = 6, uint16_t type = NEO_GRB + NEO_KHZ800) : pixels(n, 0), frames(0) {}
+
+    void begin() {}
+    void show() { frames++; }
+    void clear() { std::fill(pixels.begin(), pixels.end(), 0); }
+    void setBrightness(uint8_t brightness) {}
+    void setPixelColor(uint16_t n, uint32_t color) {
+        if (n < pixels.size()) {
+            pixels[n] = color;
+        }
+    }
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) { setPixelColor(n, Color(r, g, b)); }
+    uint32_t getPixelColor(uint16_t n) const { return n < pixels.size() ? pixels[n] : 0; }
+    uint16_t numPixels() const { return pixels.size(); }
+    uint32_t shownFrames() const { return frames; }
+
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+
+private:
+    std::vector<uint32_t> pixels;
+    uint32_t frames;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "Arduino.h"
+#include "native_board.h"
+
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+static uint8_t pinStates[64];
+static uint32_t minFreeHeap = NATIVE_HEAP_SIZE;
+static std::mutex randomMutex;
+static uint32_t randomState = 1;
+static std::atomic<bool> virtualClock(false);
+static std::atomic<uint64_t> virtualClockUs(0);
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+void native_clock_set_us(uint64_t us) {
+    virtualClockUs = us;
+    virtualClock = true;
+}
+
+void native_clock_advance_us(uint64_t us) {
+    virtualClockUs += us;
+    virtualClock = true;
+}
+
+uint64_t native_clock_us() {
+    if (virtualClock) {
+        return virtualClockUs;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() {
+    return (unsigned long)(uint32_t)(native_clock_us() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(uint32_t)native_clock_us();
+}
+
+void delay(uint32_t ms) {
+    if (virtualClock) {
+        virtualClockUs += (uint64_t)ms * 1000;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    if (virtualClock) {
+        virtualClockUs += us;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < sizeof(pinStates)) {
+        pinStates[pin] = value;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return native_sim_digital_read(pin, pin < sizeof(pinStates) ? pinStates[pin] : LOW);
+}
+
+uint16_t analogRead(uint8_t pin) {
+    return native_sim_analog_read(pin);
+}
+
+long random(long max) {
+    return max > 0 ? random(0, max) : 0;
+}
+
+long random(long min, long max) {
+    if (max <= min) {
+        return min;
+    }
+    std::lock_guard<std::mutex> lock(randomMutex);
+    // xorshift32, deterministic for a given seed like the sensor simulation
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return min + (long)(randomState % (uint32_t)(max - min));
+}
+
+void randomSeed(unsigned long seed) {
+    std::lock_guard<std::mutex> lock(randomMutex);
+    randomState = seed ? (uint32_t)seed : 1;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    // Only what was allocated since main() started counts, the host C++ runtime is not on the device
+    struct mallinfo2 info = mallinfo2();
+    size_t allocated = info.uordblks > native_heap_baseline() ? info.uordblks - native_heap_baseline() : 0;
+    uint32_t used = allocated > NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE : (uint32_t)allocated;
+    uint32_t free = NATIVE_HEAP_SIZE - used;
+    if (free < minFreeHeap) {
+        minFreeHeap = free;
+    }
+    return free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    getFreeHeap();
+    return minFreeHeap;
+}
+
+void EspClass::restart() {
+    native_run_shutdown_handlers();
+    Serial.println("ESP.restart(): restarting the native process");
+    fflush(stdout);
+    char path[512];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+        path[len] = '\0';
+        execv(path, native_argv());
+    }
+    _exit(1);
+}
@@ -0,0 +1,105 @@
+#ifndef __NATIVE_ARDUINO_H__
+#define __NATIVE_ARDUINO_H__
+
+// Host replacement for the Arduino-ESP32 core, used by the native environment.
+// Only what the firmware uses is provided, behaviour follows the ESP32 core where it matters
+// (String, Print, millis) and is simulated where there is no hardware (GPIO, ADC, heap).
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define NATIVE_BUILD 1
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::isnan;
+using std::isinf;
+using std::min;
+using std::max;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define PI 3.1415926535897932384626433832795
+#define F(string_literal) (string_literal)
+#define PSTR(string_literal) (string_literal)
+#define PROGMEM
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// Serial output goes to stdout, input is not supported
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    operator bool() const { return true; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    void flush() override;
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+// Heap figures are derived from the host allocator against the internal RAM of an ESP32-S3
+#define NATIVE_HEAP_SIZE (320 * 1024)
+
+class EspClass {
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getHeapSize() { return NATIVE_HEAP_SIZE; }
+    uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+    const char* getChipModel() { return "native"; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    // Restarts the process with the same arguments, like a reboot keeps flash and NVS
+    void restart() __attribute__((noreturn));
+};
+
+extern EspClass ESP;
+
+// setup() and loop() of the firmware, called by the native main()
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,521 @@
+#include "AsyncWebSocket.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WS_MAX_FRAME 65536
+// TCP_SND_BUF of the Arduino core's lwIP
+#define WS_SOCKET_SEND_BUFFER 5744
+
+static const char* WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// FIPS 180-1, only used for the handshake
+static void sha1(const uint8_t* data, size_t len, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string message((const char*)data, len);
+    message += (char)0x80;
+    while (message.size() % 64 != 56) {
+        message += (char)0;
+    }
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 7; i >= 0; i--) {
+        message += (char)(bits >> (i * 8));
+    }
+
+    for (size_t block = 0; block < message.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t* p = (const uint8_t*)message.data() + block + i * 4;
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) {
+        digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+    }
+}
+
+static String base64(const uint8_t* data, size_t len) {
+    static const char* ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    String out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t chunk = (uint32_t)data[i] << 16;
+        if (i + 1 < len) chunk |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) chunk |= data[i + 2];
+        out += ALPHABET[(chunk >> 18) & 0x3F];
+        out += ALPHABET[(chunk >> 12) & 0x3F];
+        out += i + 1 < len ? ALPHABET[(chunk >> 6) & 0x3F] : '=';
+        out += i + 2 < len ? ALPHABET[chunk & 0x3F] : '=';
+    }
+    return out;
+}
+
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebSocket* server, int fd, uint32_t id)
+    : socket(server), socketFd(fd), clientId(id), clientStatus(WS_CONNECTED), lastMessage(millis()),
+      frameCount(0), messageOpcode(WS_TEXT), queueOffset(0) {
+}
+
+AsyncWebSocketClient::~AsyncWebSocketClient() {
+    // Only destroyed by the server task under the socket mutex
+    for (const QueuedFrame& frame : queue) {
+        if (frame.buffer) {
+            frame.buffer->users--;
+        }
+    }
+    if (socketFd >= 0) {
+        ::close(socketFd);
+    }
+}
+
+bool AsyncWebSocketClient::enqueue(uint8_t opcode, const uint8_t* data, size_t len, bool control,
+                                   AsyncWebSocketMessageBuffer* buffer) {
+    std::lock_guard<std::recursive_mutex> lock(socket->mutex);
+    if (clientStatus != WS_CONNECTED) {
+        return false;
+    }
+    if (!control && queue.size() >= WS_MAX_QUEUED_MESSAGES) {
+        fprintf(stderr, "ERROR: Too many messages queued\n");
+        return false;
+    }
+
+    std::string frame;
+    frame += (char)(0x80 | opcode);
+    if (len < 126) {
+        frame += (char)len;
+    } else if (len < 65536) {
+        frame += (char)126;
+        frame += (char)(len >> 8);
+        frame += (char)len;
+    } else {
+        frame += (char)127;
+        for (int i = 7; i >= 0; i--) {
+            frame += (char)((uint64_t)len >> (i * 8));
+        }
+    }
+    if (buffer) {
+        buffer->users++;
+    } else {
+        frame.append((const char*)data, len);
+    }
+    queue.push_back({ std::move(frame), buffer });
+    socket->wake();
+    return true;
+}
+
+void AsyncWebSocketClient::text(const char* message, size_t len) {
+    enqueue(WS_TEXT, (const uint8_t*)message, len);
+}
+
+void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer* buffer) {
+    if (buffer) {
+        enqueue(WS_TEXT, nullptr, buffer->length(), false, buffer);
+    }
+}
+
+void AsyncWebSocketClient::binary(const uint8_t* message, size_t len) {
+    enqueue(WS_BINARY, message, len);
+}
+
+void AsyncWebSocketClient::ping(const uint8_t* data, size_t len) {
+    enqueue(WS_PING, data, len < 125 ? len : 125, true);
+}
+
+void AsyncWebSocketClient::close(uint16_t code, const char* message) {
+    uint8_t payload[125];
+    size_t len = 0;
+    if (code != 0) {
+        payload[0] = code >> 8;
+        payload[1] = code;
+        len = 2;
+        if (message) {
+            size_t n = min(strlen(message), sizeof(payload) - 2);
+            memcpy(payload + 2, message, n);
+            len += n;
+        }
+    }
+    std::lock_guard<std::recursive_mutex> lock(socket->mutex);
+    enqueue(WS_DISCONNECT, payload, len, true);
+    // The server task drops the connection once the close frame is out
+    if (clientStatus == WS_CONNECTED) {
+        clientStatus = WS_DISCONNECTING;
+    }
+}
+
+size_t AsyncWebSocketClient::queueLen() const {
+    std::lock_guard<std::recursive_mutex> lock(socket->mutex);
+    return queue.size();
+}
+
+bool AsyncWebSocketClient::receive() {
+    uint8_t buffer[4096];
+    while (true) {
+        ssize_t n = recv(socketFd, buffer, sizeof(buffer), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        input.append((const char*)buffer, n);
+    }
+    lastMessage = millis();
+    return processFrames();
+}
+
+bool AsyncWebSocketClient::processFrames() {
+    while (input.size() >= 2) {
+        const uint8_t* head = (const uint8_t*)input.data();
+        bool final = head[0] & 0x80;
+        uint8_t opcode = head[0] & 0x0F;
+        bool masked = head[1] & 0x80;
+        uint64_t len = head[1] & 0x7F;
+        size_t offset = 2;
+        if (len == 126) {
+            if (input.size() < 4) return true;
+            len = ((uint64_t)head[2] << 8) | head[3];
+            offset = 4;
+        } else if (len == 127) {
+            if (input.size() < 10) return true;
+            len = 0;
+            for (int i = 0; i < 8; i++) {
+                len = (len << 8) | head[2 + i];
+            }
+            offset = 10;
+        }
+        // Clients have to mask their frames
+        if (!masked || len > WS_MAX_FRAME) {
+            socket->event(this, WS_EVT_ERROR);
+            return false;
+        }
+        if (input.size() < offset + 4 + len) {
+            return true;
+        }
+
+        AwsFrameInfo info = {};
+        memcpy(info.mask, head + offset, 4);
+        offset += 4;
+        // One spare byte, text payloads are handed to the handler NUL terminated
+        std::vector<uint8_t> payload(len + 1, 0);
+        for (uint64_t i = 0; i < len; i++) {
+            payload[i] = head[offset + i] ^ info.mask[i % 4];
+        }
+        input.erase(0, offset + len);
+
+        if (opcode == WS_DISCONNECT) {
+            enqueue(WS_DISCONNECT, payload.data(), len < 2 ? len : 2, true);
+            std::lock_guard<std::recursive_mutex> lock(socket->mutex);
+            clientStatus = WS_DISCONNECTING;
+            return true;
+        } else if (opcode == WS_PING) {
+            enqueue(WS_PONG, payload.data(), len, true);
+        } else if (opcode == WS_PONG) {
+            socket->event(this, WS_EVT_PONG, nullptr, payload.data(), len);
+        } else if (opcode == WS_TEXT || opcode == WS_BINARY || opcode == WS_CONTINUATION) {
+            if (opcode != WS_CONTINUATION) {
+                messageOpcode = opcode;
+                frameCount = 0;
+            } else {
+                frameCount++;
+            }
+            info.message_opcode = messageOpcode;
+            info.num = frameCount;
+            info.final = final;
+            info.masked = 1;
+            info.opcode = opcode;
+            info.len = len;
+            info.index = 0;
+            socket->event(this, WS_EVT_DATA, &info, payload.data(), len);
+        }
+    }
+    return true;
+}
+
+bool AsyncWebSocketClient::flush() {
+    std::lock_guard<std::recursive_mutex> lock(socket->mutex);
+    while (!queue.empty()) {
+        QueuedFrame& frame = queue.front();
+        const char* data;
+        size_t len;
+        if (queueOffset < frame.data.size()) {
+            data = frame.data.data() + queueOffset;
+            len = frame.data.size() - queueOffset;
+        } else {
+            data = (const char*)frame.buffer->get() + (queueOffset - frame.data.size());
+            len = frame.size() - queueOffset;
+        }
+        ssize_t n = ::send(socketFd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        queueOffset += n;
+        if (queueOffset == frame.size()) {
+            if (frame.buffer) {
+                frame.buffer->users--;
+            }
+            queue.pop_front();
+            queueOffset = 0;
+        }
+    }
+    return clientStatus != WS_DISCONNECTING;
+}
+
+AsyncWebSocket::~AsyncWebSocket() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    clients.clear();
+}
+
+size_t AsyncWebSocket::count() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    size_t connected = 0;
+    for (const auto& client : clients) {
+        if (client->clientStatus == WS_CONNECTED) {
+            connected++;
+        }
+    }
+    return connected;
+}
+
+AsyncWebSocketClient* AsyncWebSocket::client(uint32_t id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        if (client->id() == id && client->clientStatus == WS_CONNECTED) {
+            return client.get();
+        }
+    }
+    return nullptr;
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    size_t connected = count();
+    for (const auto& client : clients) {
+        if (connected <= maxClients) {
+            break;
+        }
+        if (client->clientStatus == WS_CONNECTED) {
+            client->close();
+            connected--;
+        }
+    }
+}
+
+void AsyncWebSocket::closeAll(uint16_t code, const char* message) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        client->close(code, message);
+    }
+}
+
+void AsyncWebSocket::text(uint32_t id, const char* message, size_t len) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    AsyncWebSocketClient* found = client(id);
+    if (found) {
+        found->text(message, len);
+    }
+}
+
+void AsyncWebSocket::textAll(const char* message, size_t len) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        client->text(message, len);
+    }
+}
+
+void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer* buffer) {
+    if (buffer == nullptr) {
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    buffer->lock();
+    for (const auto& client : clients) {
+        client->text(buffer);
+    }
+    buffer->unlock();
+    cleanBuffers();
+}
+
+AsyncWebSocketMessageBuffer* AsyncWebSocket::makeBuffer(size_t size) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    cleanBuffers();
+    buffers.emplace_back(new AsyncWebSocketMessageBuffer(size));
+    return buffers.back().get();
+}
+
+AsyncWebSocketMessageBuffer* AsyncWebSocket::makeBuffer(const uint8_t* data, size_t size) {
+    AsyncWebSocketMessageBuffer* buffer = makeBuffer(size);
+    memcpy(buffer->get(), data, size);
+    return buffer;
+}
+
+void AsyncWebSocket::cleanBuffers() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    buffers.remove_if([](const std::unique_ptr<AsyncWebSocketMessageBuffer>& buffer) { return buffer->canDelete(); });
+}
+
+void AsyncWebSocket::binaryAll(const uint8_t* message, size_t len) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        client->binary(message, len);
+    }
+}
+
+bool AsyncWebSocket::availableForWriteAll() {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        if (!client->canSend()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncWebSocket::canHandle(AsyncWebServerRequest* request) {
+    return request->method() == HTTP_GET && request->url() == url &&
+           request->header("Upgrade").equalsIgnoreCase("websocket");
+}
+
+void AsyncWebSocket::handleRequest(AsyncWebServerRequest* request) {
+    if (!request->hasHeader("Sec-WebSocket-Key")) {
+        request->send(400, "text/plain", "Missing Sec-WebSocket-Key");
+        return;
+    }
+    String key = request->header("Sec-WebSocket-Key") + WS_GUID;
+    uint8_t digest[20];
+    sha1((const uint8_t*)key.c_str(), key.length(), digest);
+    String response = "HTTP/1.1 101 Switching Protocols\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: " + base64(digest, sizeof(digest)) + "\r\n\r\n";
+    int fd = request->fd();
+    if (::send(fd, response.c_str(), response.length(), MSG_NOSIGNAL) != (ssize_t)response.length()) {
+        return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    // As small as the lwIP send buffer of the device, so slow readers back up into the queue like there
+    int sendBuffer = WS_SOCKET_SEND_BUFFER / 2;     // Linux doubles it for its bookkeeping
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    request->detach();
+
+    AsyncWebSocketClient* client;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        clients.emplace_back(new AsyncWebSocketClient(this, fd, nextId++));
+        client = clients.back().get();
+    }
+    event(client, WS_EVT_CONNECT);
+}
+
+void AsyncWebSocket::collectFds(std::vector<pollfd>& fds) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    for (const auto& client : clients) {
+        fds.push_back({ client->socketFd, (short)(POLLIN | (client->queue.empty() ? 0 : POLLOUT)), 0 });
+    }
+}
+
+void AsyncWebSocket::service(const std::vector<pollfd>& fds) {
+    // Clients are only removed here, on the server task, so the snapshot stays valid
+    // while the event handler runs without the lock
+    std::vector<AsyncWebSocketClient*> snapshot;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        for (const auto& client : clients) {
+            snapshot.push_back(client.get());
+        }
+    }
+
+    for (AsyncWebSocketClient* client : snapshot) {
+        short revents = 0;
+        for (const pollfd& fd : fds) {
+            if (fd.fd == client->socketFd) {
+                revents = fd.revents;
+            }
+        }
+        bool alive = true;
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            alive = client->receive();
+        }
+        if (alive) {
+            alive = client->flush();
+        }
+        if (alive) {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex);
+            client->clientStatus = WS_DISCONNECTED;
+        }
+        event(client, WS_EVT_DISCONNECT);
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        clients.remove_if([client](const std::unique_ptr<AsyncWebSocketClient>& entry) { return entry.get() == client; });
+    }
+}
+
+static NativeWsHandlerObserver handlerObserver = nullptr;
+
+void native_ws_observe_handler(NativeWsHandlerObserver observer) {
+    handlerObserver = observer;
+}
+
+void AsyncWebSocket::event(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+    if (eventHandler) {
+        // The handler may parse the data in place, keep the start of it for the observer
+        std::string head;
+        if (handlerObserver && data) {
+            head.assign((const char*)data, len < 64 ? len : 64);
+        }
+        auto start = std::chrono::steady_clock::now();
+        eventHandler(this, client, type, arg, data, len);
+        if (handlerObserver) {
+            uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            handlerObserver(type, type == WS_EVT_DATA ? (const AwsFrameInfo*)arg : nullptr, head,
+                            nanos < UINT32_MAX ? (uint32_t)nanos : UINT32_MAX);
+        }
+    }
+}
+
+void AsyncWebSocket::wake() {
+    if (server) {
+        server->wake();
+    }
+}
@@ -0,0 +1,188 @@
+#ifndef __NATIVE_ASYNCWEBSOCKET_H__
+#define __NATIVE_ASYNCWEBSOCKET_H__
+
+#include "ESPAsyncWebServer.h"
+
+#include <deque>
+#include <string>
+
+#define WS_MAX_QUEUED_MESSAGES 32
+#define DEFAULT_MAX_WS_CLIENTS 8
+
+typedef enum {
+    WS_CONTINUATION = 0,
+    WS_TEXT = 1,
+    WS_BINARY = 2,
+    WS_DISCONNECT = 8,
+    WS_PING = 9,
+    WS_PONG = 10
+} AwsFrameType;
+
+typedef enum {
+    WS_DISCONNECTED,
+    WS_CONNECTED,
+    WS_DISCONNECTING
+} AwsClientStatus;
+
+typedef enum {
+    WS_EVT_CONNECT,
+    WS_EVT_DISCONNECT,
+    WS_EVT_PONG,
+    WS_EVT_ERROR,
+    WS_EVT_DATA
+} AwsEventType;
+
+// Frames are delivered whole (index is always 0), fragmented messages arrive as one
+// event per frame with opcode WS_CONTINUATION after the first, like on the device
+typedef struct {
+    uint8_t message_opcode;
+    uint32_t num;
+    uint8_t final;
+    uint8_t masked;
+    uint8_t opcode;
+    uint64_t len;
+    uint8_t mask[4];
+    uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+// Payload shared by the queues of several clients, as in the library: count is the number of
+// queued messages using it, lock keeps it alive while there are none. Buffers are owned by the
+// AsyncWebSocket and freed by makeBuffer and textAll once neither holds.
+class AsyncWebSocketMessageBuffer {
+public:
+    explicit AsyncWebSocketMessageBuffer(size_t size) : data(size + 1, 0), locked(false), users(0) {}
+    AsyncWebSocketMessageBuffer(const uint8_t* data, size_t size) : AsyncWebSocketMessageBuffer(size) {
+        memcpy(this->data.data(), data, size);
+    }
+
+    void lock() { locked = true; }
+    void unlock() { locked = false; }
+    uint8_t* get() { return data.data(); }
+    size_t length() const { return data.size() - 1; }
+    uint32_t count() const { return users; }
+    bool canDelete() const { return !users && !locked; }
+
+private:
+    friend class AsyncWebSocket;
+    friend class AsyncWebSocketClient;
+
+    std::vector<uint8_t> data;
+    volatile bool locked;
+    uint32_t users;
+};
+
+class AsyncWebSocketClient {
+public:
+    AsyncWebSocketClient(AsyncWebSocket* server, int fd, uint32_t id);
+    ~AsyncWebSocketClient();
+
+    uint32_t id() const { return clientId; }
+    AwsClientStatus status() const { return clientStatus; }
+    AsyncWebSocket* server() const { return socket; }
+    IPAddress remoteIP() const { return IPAddress(127, 0, 0, 1); }
+
+    void text(const char* message, size_t len);
+    void text(const char* message) { text(message, strlen(message)); }
+    void text(const String& message) { text(message.c_str(), message.length()); }
+    void text(AsyncWebSocketMessageBuffer* buffer);
+    void binary(const uint8_t* message, size_t len);
+    void ping(const uint8_t* data = nullptr, size_t len = 0);
+    void close(uint16_t code = 0, const char* message = nullptr);
+
+    size_t queueLen() const;
+    bool queueIsFull() const { return queueLen() >= WS_MAX_QUEUED_MESSAGES; }
+    bool canSend() const { return !queueIsFull(); }
+
+private:
+    friend class AsyncWebSocket;
+
+    AsyncWebSocket* socket;
+    int socketFd;
+    uint32_t clientId;
+    AwsClientStatus clientStatus;
+    uint32_t lastMessage;
+
+    // Owned by the server task
+    std::string input;
+    uint32_t frameCount;
+    uint8_t messageOpcode;
+
+    // Header, then the payload if it is not in a shared buffer
+    struct QueuedFrame {
+        std::string data;
+        AsyncWebSocketMessageBuffer* buffer;
+        size_t size() const { return data.size() + (buffer ? buffer->length() : 0); }
+    };
+
+    // Shared with the senders, guarded by the socket mutex
+    std::deque<QueuedFrame> queue;
+    size_t queueOffset;
+
+    bool enqueue(uint8_t opcode, const uint8_t* data, size_t len, bool control = false,
+                 AsyncWebSocketMessageBuffer* buffer = nullptr);
+    // Returns false once the connection is gone
+    bool receive();
+    bool flush();
+    bool processFrames();
+};
+
+typedef std::function<void(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                           void* arg, uint8_t* data, size_t len)> AwsEventHandler;
+
+class AsyncWebSocket : public AsyncWebHandler {
+public:
+    explicit AsyncWebSocket(const String& url) : url(url), server(nullptr), nextId(1) {}
+    ~AsyncWebSocket();
+
+    const char* getUrl() const { return url.c_str(); }
+    void onEvent(AwsEventHandler handler) { eventHandler = handler; }
+
+    size_t count() const;
+    AsyncWebSocketClient* client(uint32_t id);
+    bool hasClient(uint32_t id) { return client(id) != nullptr; }
+    void cleanupClients(uint16_t maxClients = DEFAULT_MAX_WS_CLIENTS);
+    void closeAll(uint16_t code = 0, const char* message = nullptr);
+
+    void text(uint32_t id, const char* message, size_t len);
+    void text(uint32_t id, const String& message) { text(id, message.c_str(), message.length()); }
+    void textAll(const char* message, size_t len);
+    void textAll(const char* message) { textAll(message, strlen(message)); }
+    void textAll(const String& message) { textAll(message.c_str(), message.length()); }
+    void textAll(AsyncWebSocketMessageBuffer* buffer);
+    AsyncWebSocketMessageBuffer* makeBuffer(size_t size = 0);
+    AsyncWebSocketMessageBuffer* makeBuffer(const uint8_t* data, size_t size);
+    void binaryAll(const uint8_t* message, size_t len);
+    bool availableForWriteAll();
+
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void attach(AsyncWebServer* server) override { this->server = server; }
+    void collectFds(std::vector<pollfd>& fds) override;
+    void service(const std::vector<pollfd>& fds) override;
+
+private:
+    friend class AsyncWebSocketClient;
+
+    String url;
+    AsyncWebServer* server;
+    AwsEventHandler eventHandler;
+    uint32_t nextId;
+    mutable std::recursive_mutex mutex;
+    std::list<std::unique_ptr<AsyncWebSocketClient>> clients;
+    std::list<std::unique_ptr<AsyncWebSocketMessageBuffer>> buffers;
+
+    void event(AsyncWebSocketClient* client, AwsEventType type, void* arg = nullptr, uint8_t* data = nullptr, size_t len = 0);
+    void wake();
+    void cleanBuffers();
+};
+
+// Native only: called with the run time of the event handler in nanoseconds (at most 4.29 s)
+// after every event, with the frame
+// info and the first 64 bytes of the data of data events. On the device the handler runs on the
+// network task, as long as it runs no other connection is served.
+typedef void (*NativeWsHandlerObserver)(AwsEventType type, const AwsFrameInfo* info, const std::string& head, uint32_t duration);
+void native_ws_observe_handler(NativeWsHandlerObserver observer);
+
+#endif
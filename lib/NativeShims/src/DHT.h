@@ -0,0 +1,42 @@
+#ifndef __NATIVE_DHT_H__
+#define __NATIVE_DHT_H__
+
+#include "Arduino.h"
+#include "sensor_sim.h"
+
+#define DHT11 11
+#define DHT12 12
+#define DHT21 21
+#define DHT22 22
+
+// Readings come from the sensor simulation (sensor_sim.h). Like the Adafruit library, both
+// values come from one measurement: readTemperature() starts it, readHumidity() returns the
+// humidity of that measurement if it is less than two seconds old.
+class DHT {
+public:
+    DHT(uint8_t pin, uint8_t type, uint8_t count = 6) : last({NAN, NAN}), lastRead(0), valid(false) {}
+    void begin(uint8_t usec = 55) {}
+    float readTemperature(bool fahrenheit = false, bool force = false) {
+        read();
+        return fahrenheit ? last.temperature * 1.8f + 32 : last.temperature;
+    }
+    float readHumidity(bool force = false) {
+        if (force || !valid || millis() - lastRead >= 2000) {
+            read();
+        }
+        return last.humidity;
+    }
+
+private:
+    DhtSample last;
+    unsigned long lastRead;
+    bool valid;
+
+    void read() {
+        last = sensor_sim_read_dht();
+        lastRead = millis();
+        valid = true;
+    }
+};
+
+#endif
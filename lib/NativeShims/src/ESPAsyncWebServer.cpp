@@ -0,0 +1,575 @@
+#include "ESPAsyncWebServer.h"
+#include "native_board.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MAX_REQUEST_HEAD 8192
+#define MAX_REQUEST_BODY 65536
+#define REQUEST_TIMEOUT_MS 10000
+// Roughly one TCP segment, like the send buffer the device fills per callback
+#define RESPONSE_BUFFER 1436
+
+// Core of the server task, like AsyncTCP
+#ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
+#define CONFIG_ASYNC_TCP_RUNNING_CORE tskNO_AFFINITY
+#endif
+
+static const String EMPTY_STRING;
+
+static bool send_all(int fd, const void* data, size_t len) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    while (len > 0) {
+        ssize_t n = ::send(fd, bytes, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        len -= n;
+    }
+    return true;
+}
+
+static const char* status_text(int code) {
+    switch (code) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+static String content_type_for(const String& path) {
+    String name = path.endsWith(".gz") ? path.substring(0, path.length() - 3) : path;
+    if (name.endsWith(".html") || name.endsWith(".htm")) return "text/html";
+    if (name.endsWith(".css")) return "text/css";
+    if (name.endsWith(".js")) return "application/javascript";
+    if (name.endsWith(".json")) return "application/json";
+    if (name.endsWith(".svg")) return "image/svg+xml";
+    if (name.endsWith(".png")) return "image/png";
+    if (name.endsWith(".ico")) return "image/x-icon";
+    if (name.endsWith(".txt")) return "text/plain";
+    return "application/octet-stream";
+}
+
+static String url_decode(const String& text, bool plusIsSpace) {
+    String out;
+    for (unsigned int i = 0; i < text.length(); i++) {
+        char c = text.charAt(i);
+        if (c == '%' && i + 2 < text.length() && isxdigit((uint8_t)text.charAt(i + 1)) && isxdigit((uint8_t)text.charAt(i + 2))) {
+            char hex[3] = { text.charAt(i + 1), text.charAt(i + 2), 0 };
+            out += (char)strtol(hex, nullptr, 16);
+            i += 2;
+        } else if (c == '+' && plusIsSpace) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+    AsyncBasicResponse(int code, const String& contentType, const String& content)
+        : AsyncWebServerResponse(code, contentType), content(content) {}
+
+protected:
+    long contentLength() override { return content.length(); }
+    size_t fill(uint8_t* buffer, size_t maxLen, size_t index) override {
+        size_t n = index < content.length() ? min(maxLen, (size_t)content.length() - index) : 0;
+        memcpy(buffer, content.c_str() + index, n);
+        return n;
+    }
+
+private:
+    String content;
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse {
+public:
+    AsyncFileResponse(File file, const String& contentType)
+        : AsyncWebServerResponse(200, contentType), file(file) {}
+    ~AsyncFileResponse() { file.close(); }
+
+protected:
+    long contentLength() override { return file.size(); }
+    size_t fill(uint8_t* buffer, size_t maxLen, size_t index) override { return file.read(buffer, maxLen); }
+
+private:
+    File file;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+public:
+    AsyncChunkedResponse(const String& contentType, AwsResponseFiller filler)
+        : AsyncWebServerResponse(200, contentType), filler(filler) {}
+
+protected:
+    long contentLength() override { return -1; }
+    size_t fill(uint8_t* buffer, size_t maxLen, size_t index) override {
+        size_t n;
+        // The filler may ask to be called again once it has data
+        while ((n = filler(buffer, maxLen, index)) == RESPONSE_TRY_AGAIN) {
+            delay(1);
+        }
+        return n;
+    }
+
+private:
+    AwsResponseFiller filler;
+};
+
+bool AsyncWebServerResponse::sendTo(int fd, bool head) {
+    long length = contentLength();
+    String out = "HTTP/1.1 " + String(code) + " " + status_text(code) + "\r\n";
+    if (contentType.length() > 0) {
+        out += "Content-Type: " + contentType + "\r\n";
+    }
+    for (const AsyncWebHeader& header : headers) {
+        out += header.name() + ": " + header.value() + "\r\n";
+    }
+    out += "Connection: close\r\n";
+    if (code == 304 || code == 204) {
+        length = 0;
+    } else if (length >= 0) {
+        out += "Content-Length: " + String(length) + "\r\n";
+    } else {
+        out += "Transfer-Encoding: chunked\r\n";
+    }
+    out += "\r\n";
+    if (!send_all(fd, out.c_str(), out.length())) {
+        return false;
+    }
+    if (head || length == 0) {
+        return true;
+    }
+
+    uint8_t buffer[RESPONSE_BUFFER + 16];
+    size_t index = 0;
+    while (true) {
+        size_t n = fill(buffer, RESPONSE_BUFFER, index);
+        if (length >= 0) {
+            if (n == 0 || !send_all(fd, buffer, n)) {
+                return index == (size_t)length;
+            }
+        } else {
+            char size[16];
+            int sizeLen = snprintf(size, sizeof(size), "%zx\r\n", n);
+            if (!send_all(fd, size, sizeLen) || (n > 0 && !send_all(fd, buffer, n)) || !send_all(fd, "\r\n", 2)) {
+                return false;
+            }
+            if (n == 0) {
+                return true;
+            }
+        }
+        index += n;
+    }
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest* request) {
+    if (!(method & request->method())) {
+        return false;
+    }
+    return uri.length() == 0 || uri == request->url() || request->url().startsWith(uri + "/");
+}
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* server, int fd)
+    : server(server), socketFd(fd), responded(false), requestMethod(HTTP_GET) {
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+}
+
+bool AsyncWebServerRequest::parse(const String& head, const String& body) {
+    int lineEnd = head.indexOf("\r\n");
+    String line = lineEnd < 0 ? head : head.substring(0, lineEnd);
+    int methodEnd = line.indexOf(' ');
+    int targetEnd = line.indexOf(' ', methodEnd + 1);
+    if (methodEnd <= 0 || targetEnd <= methodEnd + 1) {
+        return false;
+    }
+
+    String methodName = line.substring(0, methodEnd);
+    static const struct { const char* name; WebRequestMethod method; } METHODS[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "DELETE", HTTP_DELETE }, { "PUT", HTTP_PUT },
+        { "PATCH", HTTP_PATCH }, { "HEAD", HTTP_HEAD }, { "OPTIONS", HTTP_OPTIONS }
+    };
+    bool known = false;
+    for (const auto& entry : METHODS) {
+        if (methodName == entry.name) {
+            requestMethod = entry.method;
+            known = true;
+        }
+    }
+    if (!known) {
+        return false;
+    }
+
+    String target = line.substring(methodEnd + 1, targetEnd);
+    int query = target.indexOf('?');
+    requestUrl = url_decode(query < 0 ? target : target.substring(0, query), false);
+
+    auto addParams = [this](const String& text, bool form) {
+        unsigned int start = 0;
+        while (start < text.length()) {
+            int end = text.indexOf('&', start);
+            if (end < 0) {
+                end = text.length();
+            }
+            String pair = text.substring(start, end);
+            int equals = pair.indexOf('=');
+            if (pair.length() > 0) {
+                String name = url_decode(equals < 0 ? pair : pair.substring(0, equals), true);
+                String value = equals < 0 ? String() : url_decode(pair.substring(equals + 1), true);
+                requestParams.emplace_back(new AsyncWebParameter(name, value, form));
+            }
+            start = end + 1;
+        }
+    };
+    if (query >= 0) {
+        addParams(target.substring(query + 1), false);
+    }
+
+    int start = lineEnd < 0 ? head.length() : lineEnd + 2;
+    while (start < (int)head.length()) {
+        int end = head.indexOf("\r\n", start);
+        if (end < 0) {
+            end = head.length();
+        }
+        String headerLine = head.substring(start, end);
+        int colon = headerLine.indexOf(':');
+        if (colon > 0) {
+            String name = headerLine.substring(0, colon);
+            String value = headerLine.substring(colon + 1);
+            value.trim();
+            requestHeaders.emplace_back(new AsyncWebHeader(name, value));
+            if (name.equalsIgnoreCase("Host")) {
+                requestHost = value;
+            } else if (name.equalsIgnoreCase("Content-Type")) {
+                requestContentType = value;
+            }
+        }
+        start = end + 2;
+    }
+
+    if (body.length() > 0 && requestContentType.startsWith("application/x-www-form-urlencoded")) {
+        addParams(body, true);
+    }
+    return true;
+}
+
+const char* AsyncWebServerRequest::methodToString() const {
+    switch (requestMethod) {
+        case HTTP_GET: return "GET";
+        case HTTP_POST: return "POST";
+        case HTTP_DELETE: return "DELETE";
+        case HTTP_PUT: return "PUT";
+        case HTTP_PATCH: return "PATCH";
+        case HTTP_HEAD: return "HEAD";
+        case HTTP_OPTIONS: return "OPTIONS";
+        default: return "UNKNOWN";
+    }
+}
+
+bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+    return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
+    for (const auto& param : requestParams) {
+        if (param->name() == name && param->isPost() == post) {
+            return param.get();
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(size_t index) const {
+    return index < requestParams.size() ? requestParams[index].get() : nullptr;
+}
+
+const String& AsyncWebServerRequest::arg(const String& name) const {
+    AsyncWebParameter* param = getParam(name);
+    if (param == nullptr) {
+        param = getParam(name, true);
+    }
+    return param ? param->value() : EMPTY_STRING;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String& name) const {
+    return getHeader(name) != nullptr;
+}
+
+const String& AsyncWebServerRequest::header(const char* name) const {
+    AsyncWebHeader* found = getHeader(name);
+    return found ? found->value() : EMPTY_STRING;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
+    for (const auto& header : requestHeaders) {
+        if (header->name().equalsIgnoreCase(name)) {
+            return header.get();
+        }
+    }
+    return nullptr;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType, const String& content) {
+    return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(File content, const String& path, const String& contentType, bool download) {
+    if (!content) {
+        return new AsyncBasicResponse(404, String(), String());
+    }
+    AsyncWebServerResponse* response = new AsyncFileResponse(content, contentType.length() ? contentType : content_type_for(path));
+    if (download) {
+        const char* slash = strrchr(path.c_str(), '/');
+        response->addHeader("Content-Disposition", String("attachment; filename=\"") + (slash ? slash + 1 : path.c_str()) + "\"");
+    }
+    return response;
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(FS& fs, const String& path, const String& contentType, bool download) {
+    return beginResponse(fs.open(path, "r"), path, contentType, download);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const String& contentType, AwsResponseFiller callback) {
+    return new AsyncChunkedResponse(contentType, callback);
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+    if (!responded && socketFd >= 0) {
+        responded = true;
+        response->sendTo(socketFd, requestMethod == HTTP_HEAD);
+    }
+    delete response;
+}
+
+void AsyncWebServerRequest::redirect(const String& url) {
+    AsyncWebServerResponse* response = beginResponse(302);
+    response->addHeader("Location", url);
+    send(response);
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port)
+    : port(port), listenFd(-1), wakePipe{-1, -1}, running(false), task(nullptr) {
+}
+
+AsyncWebServer::~AsyncWebServer() {
+    end();
+}
+
+void AsyncWebServer::begin() {
+    if (running) {
+        return;
+    }
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(native_port(port));
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        fprintf(stderr, "[native] web server cannot listen on port %u: %s\n", native_port(port), strerror(errno));
+        ::close(listenFd);
+        listenFd = -1;
+        return;
+    }
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+    if (pipe(wakePipe) == 0) {
+        fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    }
+    fprintf(stderr, "[native] web server listening on http://127.0.0.1:%u\n", native_port(port));
+    running = true;
+    xTaskCreatePinnedToCore(serverTask, "async_tcp", 8192, this, 3, &task, CONFIG_ASYNC_TCP_RUNNING_CORE);
+}
+
+void AsyncWebServer::end() {
+    // The server task is not joined, it owns the sockets until the process exits
+    running = false;
+    wake();
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+    callbackHandlers.emplace_back(new AsyncCallbackWebHandler(uri, method, onRequest));
+    addHandler(callbackHandlers.back().get());
+    return *callbackHandlers.back();
+}
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+    handler->attach(this);
+    handlers.push_back(handler);
+    return *handler;
+}
+
+void AsyncWebServer::reset() {
+    handlers.clear();
+    callbackHandlers.clear();
+    notFound = nullptr;
+}
+
+void AsyncWebServer::wake() {
+    if (wakePipe[1] >= 0) {
+        char c = 0;
+        (void)!write(wakePipe[1], &c, 1);
+    }
+}
+
+void AsyncWebServer::serverTask(void* parameter) {
+    ((AsyncWebServer*)parameter)->run();
+    vTaskDelete(NULL);
+}
+
+void AsyncWebServer::run() {
+    std::vector<pollfd> fds;
+    while (running) {
+        fds.clear();
+        fds.push_back({ listenFd, POLLIN, 0 });
+        fds.push_back({ wakePipe[0], POLLIN, 0 });
+        for (const Connection& connection : connections) {
+            fds.push_back({ connection.fd, POLLIN, 0 });
+        }
+        for (AsyncWebHandler* handler : handlers) {
+            handler->collectFds(fds);
+        }
+
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        size_t index = 2;
+        for (auto it = connections.begin(); it != connections.end(); index++) {
+            bool done;
+            if (fds[index].revents) {
+                done = receive(*it);
+            } else if (millis() - it->since > REQUEST_TIMEOUT_MS) {
+                ::close(it->fd);
+                done = true;
+            } else {
+                done = false;
+            }
+            it = done ? connections.erase(it) : std::next(it);
+        }
+        for (AsyncWebHandler* handler : handlers) {
+            handler->service(fds);
+        }
+        if (fds[0].revents & POLLIN) {
+            accept();
+        }
+    }
+}
+
+void AsyncWebServer::accept() {
+    while (true) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        connections.push_back({ fd, String(), millis() });
+    }
+}
+
+bool AsyncWebServer::receive(Connection& connection) {
+    char buffer[2048];
+    ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return false;
+    }
+    if (n <= 0) {
+        ::close(connection.fd);
+        return true;
+    }
+    connection.data.concat(buffer, n);
+
+    int headEnd = connection.data.indexOf("\r\n\r\n");
+    if (headEnd < 0) {
+        if (connection.data.length() > MAX_REQUEST_HEAD) {
+            fcntl(connection.fd, F_SETFL, 0);
+            AsyncBasicResponse(431, "text/plain", "Request header too large").sendTo(connection.fd, false);
+            ::close(connection.fd);
+            return true;
+        }
+        return false;
+    }
+    String head = connection.data.substring(0, headEnd);
+
+    size_t bodyLength = 0;
+    String lower = head;
+    lower.toLowerCase();
+    int lengthHeader = lower.indexOf("\r\ncontent-length:");
+    if (lengthHeader >= 0) {
+        bodyLength = strtoul(head.c_str() + lengthHeader + 17, nullptr, 10);
+    }
+    if (bodyLength > MAX_REQUEST_BODY) {
+        fcntl(connection.fd, F_SETFL, 0);
+        AsyncBasicResponse(413, "text/plain", "Request body too large").sendTo(connection.fd, false);
+        ::close(connection.fd);
+        return true;
+    }
+    if (connection.data.length() < headEnd + 4 + bodyLength) {
+        return false;
+    }
+
+    // Responses are written blocking, the handlers expect send() to be done when it returns
+    fcntl(connection.fd, F_SETFL, 0);
+    AsyncWebServerRequest request(this, connection.fd);
+    if (!request.parse(head, connection.data.substring(headEnd + 4, headEnd + 4 + bodyLength))) {
+        request.send(400, "text/plain", "Bad request");
+    } else {
+        dispatch(&request);
+    }
+    if (request.fd() >= 0) {
+        if (!request.sent()) {
+            request.send(500, "text/plain", "No response");
+        }
+        shutdown(connection.fd, SHUT_WR);
+        ::close(connection.fd);
+    }
+    return true;
+}
+
+void AsyncWebServer::dispatch(AsyncWebServerRequest* request) {
+    for (AsyncWebHandler* handler : handlers) {
+        if (handler->canHandle(request)) {
+            handler->handleRequest(request);
+            return;
+        }
+    }
+    if (notFound) {
+        notFound(request);
+    } else {
+        request->send(404);
+    }
+}
@@ -0,0 +1,217 @@
+#ifndef __NATIVE_ESPASYNCWEBSERVER_H__
+#define __NATIVE_ESPASYNCWEBSERVER_H__
+
+#include "Arduino.h"
+#include "FS.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <poll.h>
+
+// Subset of ESPAsyncWebServer on top of POSIX sockets. One "async_tcp" task polls the listening
+// socket and all connections and runs the handlers, like the AsyncTCP task on the device.
+// Every response is sent with Connection: close, the port is offset by NATIVE_PORT_OFFSET.
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_PATCH = 0b00010000,
+    HTTP_HEAD = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+typedef uint8_t WebRequestMethodComposite;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String& name, const String& value, bool form = false)
+        : paramName(name), paramValue(value), form(form) {}
+    const String& name() const { return paramName; }
+    const String& value() const { return paramValue; }
+    bool isPost() const { return form; }
+    bool isFile() const { return false; }
+
+private:
+    String paramName;
+    String paramValue;
+    bool form;
+};
+
+class AsyncWebHeader {
+public:
+    AsyncWebHeader(const String& name, const String& value) : headerName(name), headerValue(value) {}
+    const String& name() const { return headerName; }
+    const String& value() const { return headerValue; }
+
+private:
+    String headerName;
+    String headerValue;
+};
+
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebServerResponse {
+public:
+    AsyncWebServerResponse(int code, const String& contentType) : code(code), contentType(contentType) {}
+    virtual ~AsyncWebServerResponse() {}
+
+    void setCode(int code) { this->code = code; }
+    void setContentType(const String& type) { contentType = type; }
+    void addHeader(const String& name, const String& value) { headers.emplace_back(name, value); }
+
+    // Writes status line, headers and body to a blocking socket
+    bool sendTo(int fd, bool head);
+
+protected:
+    // Content length, or -1 for a chunked body
+    virtual long contentLength() = 0;
+    // Next piece of the body, 0 once complete
+    virtual size_t fill(uint8_t* buffer, size_t maxLen, size_t index) = 0;
+
+private:
+    int code;
+    String contentType;
+    std::vector<AsyncWebHeader> headers;
+};
+
+class AsyncWebHandler {
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest* request) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest* request) {}
+
+    // Native only: connections a handler took over (WebSocket) are polled by the server task
+    virtual void attach(AsyncWebServer* server) {}
+    virtual void collectFds(std::vector<pollfd>& fds) {}
+    virtual void service(const std::vector<pollfd>& fds) {}
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+    AsyncCallbackWebHandler(const String& uri, WebRequestMethodComposite method, ArRequestHandlerFunction handler)
+        : uri(uri), method(method), handler(handler) {}
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override { handler(request); }
+
+private:
+    String uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction handler;
+};
+
+class AsyncWebServerRequest {
+public:
+    AsyncWebServerRequest(AsyncWebServer* server, int fd);
+    ~AsyncWebServerRequest();
+
+    // Parses a complete request head (and body), false if it is malformed
+    bool parse(const String& head, const String& body);
+
+    WebRequestMethodComposite method() const { return requestMethod; }
+    const char* methodToString() const;
+    const String& url() const { return requestUrl; }
+    const String& host() const { return requestHost; }
+    const String& contentType() const { return requestContentType; }
+
+    size_t params() const { return requestParams.size(); }
+    bool hasParam(const String& name, bool post = false, bool file = false) const;
+    AsyncWebParameter* getParam(const String& name, bool post = false, bool file = false) const;
+    AsyncWebParameter* getParam(size_t index) const;
+    bool hasArg(const char* name) const { return hasParam(name) || hasParam(name, true); }
+    const String& arg(const String& name) const;
+
+    size_t headers() const { return requestHeaders.size(); }
+    bool hasHeader(const String& name) const;
+    const String& header(const char* name) const;
+    AsyncWebHeader* getHeader(const String& name) const;
+
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(), const String& content = String());
+    AsyncWebServerResponse* beginResponse(File content, const String& path, const String& contentType = String(), bool download = false);
+    AsyncWebServerResponse* beginResponse(FS& fs, const String& path, const String& contentType = String(), bool download = false);
+    AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller callback);
+
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const String& contentType = String(), const String& content = String()) {
+        send(beginResponse(code, contentType, content));
+    }
+    void send(FS& fs, const String& path, const String& contentType = String(), bool download = false) {
+        send(beginResponse(fs, path, contentType, download));
+    }
+    void redirect(const String& url);
+
+    // Native only
+    int fd() const { return socketFd; }
+    void detach() { socketFd = -1; }
+    bool sent() const { return responded; }
+
+private:
+    AsyncWebServer* server;
+    int socketFd;
+    bool responded;
+    WebRequestMethodComposite requestMethod;
+    String requestUrl;
+    String requestHost;
+    String requestContentType;
+    std::vector<std::unique_ptr<AsyncWebParameter>> requestParams;
+    std::vector<std::unique_ptr<AsyncWebHeader>> requestHeaders;
+};
+
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port);
+    ~AsyncWebServer();
+
+    void begin();
+    void end();
+
+    AsyncCallbackWebHandler& on(const char* uri, ArRequestHandlerFunction onRequest) { return on(uri, HTTP_ANY, onRequest); }
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+    AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+    void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+    void reset();
+
+    // Native only: wakes the server task, e.g. after messages were queued from another task
+    void wake();
+
+private:
+    struct Connection {
+        int fd;
+        String data;
+        unsigned long since;
+    };
+
+    uint16_t port;
+    int listenFd;
+    int wakePipe[2];
+    volatile bool running;
+    TaskHandle_t task;
+    std::vector<AsyncWebHandler*> handlers;
+    std::vector<std::unique_ptr<AsyncCallbackWebHandler>> callbackHandlers;
+    ArRequestHandlerFunction notFound;
+    std::list<Connection> connections;
+
+    static void serverTask(void* parameter);
+    void run();
+    void accept();
+    // Returns true once the connection is done (answered, handed over or broken)
+    bool receive(Connection& connection);
+    void dispatch(AsyncWebServerRequest* request);
+};
+
+#include "AsyncWebSocket.h"
+
+#endif
@@ -0,0 +1,183 @@
+#include "FS.h"
+#include "LittleFS.h"
+#include "native_board.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#ifndef NATIVE_FS_ROOT
+#define NATIVE_FS_ROOT "data"
+#endif
+
+fs::FS LittleFS(NATIVE_FS_ROOT);
+
+namespace fs {
+
+struct FileImpl {
+    FILE* file;
+    std::string path;
+    std::string name;
+    bool directory;
+
+    ~FileImpl() {
+        if (file) {
+            fclose(file);
+        }
+    }
+};
+
+File::operator bool() const {
+    return impl && (impl->file || impl->directory);
+}
+
+size_t File::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+    return impl && impl->file ? fwrite(buffer, 1, size, impl->file) : 0;
+}
+
+int File::available() {
+    if (!impl || !impl->file) {
+        return 0;
+    }
+    long remaining = (long)size() - (long)position();
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+int File::read() {
+    return impl && impl->file ? fgetc(impl->file) : -1;
+}
+
+int File::peek() {
+    if (!impl || !impl->file) {
+        return -1;
+    }
+    int c = fgetc(impl->file);
+    if (c >= 0) {
+        ungetc(c, impl->file);
+    }
+    return c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+    return impl && impl->file ? fread(buffer, 1, size, impl->file) : 0;
+}
+
+void File::flush() {
+    if (impl && impl->file) {
+        fflush(impl->file);
+    }
+}
+
+bool File::seek(uint32_t pos) {
+    return impl && impl->file && fseek(impl->file, pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+    return impl && impl->file ? (size_t)ftell(impl->file) : 0;
+}
+
+size_t File::size() const {
+    if (!impl || !impl->file) {
+        return 0;
+    }
+    struct stat st;
+    fflush(impl->file);
+    return fstat(fileno(impl->file), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::close() {
+    impl.reset();
+}
+
+const char* File::path() const {
+    return impl ? impl->path.c_str() : "";
+}
+
+const char* File::name() const {
+    return impl ? impl->name.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return impl && impl->directory;
+}
+
+bool FS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    root = native_env("NATIVE_FS_ROOT", defaultRoot);
+    struct stat st;
+    if (stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        return true;
+    }
+    return formatOnFail && ::mkdir(root.c_str(), 0755) == 0;
+}
+
+std::string FS::hostPath(const char* path) const {
+    std::string base = root.empty() ? native_env("NATIVE_FS_ROOT", defaultRoot) : root;
+    if (!path || path[0] != '/') {
+        base += '/';
+    }
+    return base + (path ? path : "");
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+    (void)create;
+    std::string host = hostPath(path);
+    std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+    impl->path = path;
+    const char* slash = strrchr(path, '/');
+    impl->name = slash ? slash + 1 : path;
+    impl->file = nullptr;
+    impl->directory = false;
+
+    struct stat st;
+    if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->directory = true;
+        return File(impl);
+    }
+    // Binary modes, "r" must not translate anything and "w" truncates like on LittleFS
+    std::string hostMode = std::string(mode) + "b";
+    impl->file = fopen(host.c_str(), hostMode.c_str());
+    return impl->file ? File(impl) : File();
+}
+
+bool FS::exists(const char* path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+size_t FS::usedBytes() {
+    size_t used = 0;
+    DIR* dir = opendir(hostPath("/").c_str());
+    if (!dir) {
+        return 0;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        struct stat st;
+        if (stat(hostPath(entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            used += st.st_size;
+        }
+    }
+    closedir(dir);
+    return used;
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef __NATIVE_IPADDRESS_H__
+#define __NATIVE_IPADDRESS_H__
+
+#include <stdio.h>
+#include "Print.h"
+
+class IPAddress : public Printable {
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    explicit IPAddress(uint32_t address) {
+        memcpy(bytes, &address, sizeof(bytes));
+    }
+
+    uint8_t operator[](int index) const { return bytes[index]; }
+    operator uint32_t() const {
+        uint32_t address;
+        memcpy(&address, bytes, sizeof(address));
+        return address;
+    }
+    bool operator==(const IPAddress& other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
+
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return String(buffer);
+    }
+    size_t printTo(Print& p) const override {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return p.print(buffer);
+    }
+
+private:
+    uint8_t bytes[4];
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __NATIVE_LIQUIDCRYSTAL_I2C_H__
+#define __NATIVE_LIQUIDCRYSTAL_I2C_H__
+
+#include "Arduino.h"
+
+// Character LCD kept as a text buffer, lines() returns what the display would show
+class LiquidCrystal_I2C : public Print {
+public:
+    LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows) : cols(cols < 40 ? cols : 40), rows(rows < 4 ? rows : 4) {
+        clear();
+    }
+
+    void begin() { clear(); }
+    void backlight() {}
+    void noBacklight() {}
+    void clear() {
+        memset(text, ' ', sizeof(text));
+        col = row = 0;
+    }
+    void home() { col = row = 0; }
+    void setCursor(uint8_t c, uint8_t r) {
+        col = c;
+        row = r < rows ? r : rows - 1;
+    }
+    size_t write(uint8_t c) override {
+        if (col < cols) {
+            text[row][col] = c;
+        }
+        col++;
+        return 1;
+    }
+    using Print::write;
+
+    String line(uint8_t r) const { return r < rows ? String(text[r], cols) : String(); }
+
+private:
+    uint8_t cols, rows;
+    uint8_t col, row;
+    char text[4][40];
+};
+
+#endif
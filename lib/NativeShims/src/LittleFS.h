@@ -0,0 +1,10 @@
+#ifndef __NATIVE_LITTLEFS_H__
+#define __NATIVE_LITTLEFS_H__
+
+#include "FS.h"
+
+// LittleFS is backed by NATIVE_FS_ROOT (the environment variable or the compile time default,
+// which points to the data directory the filesystem image would be built from)
+extern fs::FS LittleFS;
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __NATIVE_MD5BUILDER_H__
+#define __NATIVE_MD5BUILDER_H__
+
+#include "Arduino.h"
+
+class MD5Builder {
+public:
+    void begin();
+    void add(const uint8_t* data, size_t len);
+    void add(const char* data) { add((const uint8_t*)data, strlen(data)); }
+    void add(const String& data) { add((const uint8_t*)data.c_str(), data.length()); }
+    bool addStream(Stream& stream, size_t maxLen);
+    void calculate();
+    void getBytes(uint8_t* output) const { memcpy(output, digest, sizeof(digest)); }
+    void getChars(char* output) const;
+    String toString() const;
+
+private:
+    uint32_t state[4];
+    uint64_t total;
+    uint8_t block[64];
+    uint8_t digest[16];
+
+    void transform(const uint8_t* data);
+};
+
+#endif
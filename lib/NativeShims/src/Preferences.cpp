@@ -0,0 +1,129 @@
+#include "Preferences.h"
+#include "native_board.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <mutex>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <vector>
+
+#define NVS_ENTRY_SIZE 32
+
+static NativeNvsWrites nvsWrites;
+static std::mutex nvsWritesMutex;
+
+NativeNvsWrites native_nvs_writes() {
+    std::lock_guard<std::mutex> lock(nvsWritesMutex);
+    return nvsWrites;
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+    (void)partitionLabel;
+    // Like NVS, namespace names are limited to 15 characters
+    if (name == nullptr || strlen(name) > 15) {
+        return false;
+    }
+    String root = native_env("NATIVE_NVS_DIR", ".native_nvs");
+    if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    directory = root + "/" + name;
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    this->readOnly = readOnly;
+    opened = true;
+    return true;
+}
+
+String Preferences::keyPath(const char* key) const {
+    return directory + "/" + key;
+}
+
+bool Preferences::clear() {
+    if (!opened || readOnly) {
+        return false;
+    }
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            ::remove(keyPath(entry->d_name).c_str());
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    return opened && !readOnly && ::remove(keyPath(key).c_str()) == 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    struct stat st;
+    return opened && stat(keyPath(key).c_str(), &st) == 0;
+}
+
+size_t Preferences::write(const char* key, const void* value, size_t len, bool variable) {
+    // NVS keys are limited to 15 characters as well
+    if (!opened || readOnly || key == nullptr || strlen(key) > 15) {
+        return 0;
+    }
+    if (isKey(key) && getBytesLength(key) == len) {
+        std::vector<char> stored(len);
+        if (getBytes(key, stored.data(), len) == len && (len == 0 || memcmp(stored.data(), value, len) == 0)) {
+            std::lock_guard<std::mutex> lock(nvsWritesMutex);
+            nvsWrites.unchanged++;
+            return len;
+        }
+    }
+    // Write and rename, so a killed process never leaves a half written value
+    String path = keyPath(key);
+    String temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return 0;
+    }
+    size_t written = len ? fwrite(value, 1, len, file) : 0;
+    fclose(file);
+    if (written != len || rename(temporary.c_str(), path.c_str()) != 0) {
+        ::remove(temporary.c_str());
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(nvsWritesMutex);
+    nvsWrites.writes++;
+    // Strings are stored with their terminating zero, blobs are counted the same
+    nvsWrites.entries += variable ? 1 + (len + 1 + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE : 1;
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    struct stat st;
+    return opened && stat(keyPath(key).c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLen) {
+    if (!opened) {
+        return 0;
+    }
+    FILE* file = fopen(keyPath(key).c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t n = fread(buffer, 1, maxLen, file);
+    fclose(file);
+    return n;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    if (!isKey(key)) {
+        return defaultValue;
+    }
+    std::vector<char> buffer(getBytesLength(key));
+    size_t n = getBytes(key, buffer.data(), buffer.size());
+    return String(buffer.data(), n);
+}
@@ -0,0 +1,76 @@
+#ifndef __NATIVE_PREFERENCES_H__
+#define __NATIVE_PREFERENCES_H__
+
+#include "Arduino.h"
+
+// NVS backed by NATIVE_NVS_DIR, one file per key holding the raw value, so settings
+// survive a restart of the process like they survive a reboot of the device.
+// Writes are counted the way NVS writes flash: a value equal to the stored one is not written,
+// others take 32 byte entries, one for a number, a header and the data for strings and blobs.
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+    void end() { opened = false; }
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putChar(const char* key, int8_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putUChar(const char* key, uint8_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putShort(const char* key, int16_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putUShort(const char* key, uint16_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putInt(const char* key, int32_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putUInt(const char* key, uint32_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putLong(const char* key, int32_t value) { return putInt(key, value); }
+    size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+    size_t putLong64(const char* key, int64_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putULong64(const char* key, uint64_t value) { return write(key, &value, sizeof(value), false); }
+    size_t putFloat(const char* key, float value) { return write(key, &value, sizeof(value), false); }
+    size_t putDouble(const char* key, double value) { return write(key, &value, sizeof(value), false); }
+    size_t putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+    size_t putString(const char* key, const char* value) { return write(key, value, strlen(value), true); }
+    size_t putString(const char* key, const String& value) { return write(key, value.c_str(), value.length(), true); }
+    size_t putBytes(const char* key, const void* value, size_t len) { return write(key, value, len, true); }
+
+    int8_t getChar(const char* key, int8_t defaultValue = 0) { return getValue(key, defaultValue); }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+    int16_t getShort(const char* key, int16_t defaultValue = 0) { return getValue(key, defaultValue); }
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+    int32_t getLong(const char* key, int32_t defaultValue = 0) { return getInt(key, defaultValue); }
+    uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+    int64_t getLong64(const char* key, int64_t defaultValue = 0) { return getValue(key, defaultValue); }
+    uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, defaultValue); }
+    float getFloat(const char* key, float defaultValue = NAN) { return getValue(key, defaultValue); }
+    double getDouble(const char* key, double defaultValue = NAN) { return getValue(key, defaultValue); }
+    bool getBool(const char* key, bool defaultValue = false) { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+    String getString(const char* key, const String& defaultValue = String());
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLen);
+
+private:
+    String directory;
+    bool opened = false;
+    bool readOnly = false;
+
+    String keyPath(const char* key) const;
+    size_t write(const char* key, const void* value, size_t len, bool variable);
+
+    template <typename T>
+    T getValue(const char* key, T defaultValue) {
+        T value;
+        return getBytesLength(key) == sizeof(T) && getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+    }
+};
+
+// Flash writes of all namespaces since the start, see the class comment
+struct NativeNvsWrites {
+    uint32_t writes;        // Values written
+    uint32_t unchanged;     // Puts of the stored value, not written
+    uint32_t entries;       // 32 byte entries written
+};
+
+NativeNvsWrites native_nvs_writes();
+
+#endif
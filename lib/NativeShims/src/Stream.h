@@ -0,0 +1,23 @@
+#ifndef __NATIVE_STREAM_H__
+#define __NATIVE_STREAM_H__
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    // Unlike the device, reads never wait for more data, the host sources are all complete
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+    virtual size_t readBytes(char* buffer, size_t length);
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+    String readString();
+    String readStringUntil(char terminator);
+
+protected:
+    unsigned long timeout = 1000;
+};
+
+#endif
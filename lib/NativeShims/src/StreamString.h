@@ -0,0 +1,27 @@
+#ifndef __NATIVE_STREAMSTRING_H__
+#define __NATIVE_STREAMSTRING_H__
+
+#include "Arduino.h"
+
+class StreamString : public Stream, public String {
+public:
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return concat((const char*)buffer, size) ? size : 0;
+    }
+    size_t write(uint8_t data) override { return concat((char)data) ? 1 : 0; }
+    using Print::write;
+
+    int available() override { return length(); }
+    int read() override {
+        if (length() == 0) {
+            return -1;
+        }
+        char c = charAt(0);
+        remove(0, 1);
+        return (uint8_t)c;
+    }
+    int peek() override { return length() ? (uint8_t)charAt(0) : -1; }
+    void flush() override {}
+};
+
+#endif
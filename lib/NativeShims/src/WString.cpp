@@ -0,0 +1,155 @@
+#include "WString.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <type_traits>
+
+template <typename T>
+static std::string format_unsigned(T number, unsigned char base) {
+    if (base < 2 || base > 36) {
+        base = 10;
+    }
+    char buffer[72];
+    char* p = &buffer[sizeof(buffer) - 1];
+    *p = '\0';
+    do {
+        int digit = number % base;
+        *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        number /= base;
+    } while (number);
+    return p;
+}
+
+template <typename T>
+static std::string format_signed(T number, unsigned char base) {
+    // Like Arduino, negative numbers only get a sign in base 10
+    if (number < 0 && base == 10) {
+        return "-" + format_unsigned((unsigned long long)(-(long long)number), base);
+    }
+    return format_unsigned((typename std::make_unsigned<T>::type)number, base);
+}
+
+static std::string format_float(double number, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    return buffer;
+}
+
+String::String(int number, unsigned char base) : value(format_signed(number, base)) {}
+String::String(unsigned int number, unsigned char base) : value(format_unsigned(number, base)) {}
+String::String(long number, unsigned char base) : value(format_signed(number, base)) {}
+String::String(unsigned long number, unsigned char base) : value(format_unsigned(number, base)) {}
+String::String(long long number, unsigned char base) : value(format_signed(number, base)) {}
+String::String(unsigned long long number, unsigned char base) : value(format_unsigned(number, base)) {}
+String::String(float number, unsigned int decimals) : value(format_float(number, decimals)) {}
+String::String(double number, unsigned int decimals) : value(format_float(number, decimals)) {}
+
+bool String::equalsIgnoreCase(const String& other) const {
+    return value.size() == other.value.size() && strcasecmp(value.c_str(), other.value.c_str()) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t pos = value.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& str, unsigned int from) const {
+    size_t pos = value.find(str.value, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+    size_t pos = value.rfind(c);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String& str) const {
+    size_t pos = value.rfind(str.value);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+    return from < value.size() ? String(value.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        unsigned int swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from >= value.size()) {
+        return String();
+    }
+    return String(value.substr(from, to - from));
+}
+
+void String::replace(const String& find, const String& replacement) {
+    if (find.value.empty()) {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = value.find(find.value, pos)) != std::string::npos) {
+        value.replace(pos, find.value.size(), replacement.value);
+        pos += replacement.value.size();
+    }
+}
+
+void String::toLowerCase() {
+    for (char& c : value) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+    for (char& c : value) c = toupper((unsigned char)c);
+}
+
+void String::trim() {
+    size_t start = 0;
+    while (start < value.size() && isspace((unsigned char)value[start])) start++;
+    size_t end = value.size();
+    while (end > start && isspace((unsigned char)value[end - 1])) end--;
+    value = value.substr(start, end - start);
+}
+
+long String::toInt() const {
+    return strtol(value.c_str(), nullptr, 10);
+}
+
+float String::toFloat() const {
+    return strtof(value.c_str(), nullptr);
+}
+
+double String::toDouble() const {
+    return strtod(value.c_str(), nullptr);
+}
+
+String operator+(const String& a, const String& b) {
+    String result(a);
+    result.concat(b);
+    return result;
+}
+
+String operator+(const char* a, const String& b) {
+    String result(a);
+    result.concat(b);
+    return result;
+}
+
+String operator+(const String& a, const char* b) {
+    String result(a);
+    result.concat(b);
+    return result;
+}
+
+String operator+(const String& a, char b) {
+    String result(a);
+    result.concat(b);
+    return result;
+}
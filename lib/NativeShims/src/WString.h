@@ -0,0 +1,88 @@
+#ifndef __NATIVE_WSTRING_H__
+#define __NATIVE_WSTRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Subset of the Arduino String API on top of std::string
+class String {
+public:
+    String() {}
+    String(const char* str) : value(str ? str : "") {}
+    String(const char* str, size_t len) : value(str ? str : "", str ? len : 0) {}
+    String(const std::string& str) : value(str) {}
+    String(char c) : value(1, c) {}
+    String(int number, unsigned char base = 10);
+    String(unsigned int number, unsigned char base = 10);
+    String(long number, unsigned char base = 10);
+    String(unsigned long number, unsigned char base = 10);
+    String(long long number, unsigned char base = 10);
+    String(unsigned long long number, unsigned char base = 10);
+    String(unsigned char number, unsigned char base = 10) : String((unsigned int)number, base) {}
+    String(float number, unsigned int decimals = 2);
+    String(double number, unsigned int decimals = 2);
+
+    const char* c_str() const { return value.c_str(); }
+    // size_t is what unsigned int is on the device, ArduinoJson only accepts strings whose length() returns it
+    size_t length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+    const std::string& str() const { return value; }
+
+    bool concat(const String& str) { value += str.value; return true; }
+    bool concat(const char* str) { if (str) value += str; return true; }
+    bool concat(const char* str, unsigned int len) { if (str) value.append(str, len); return true; }
+    bool concat(char c) { value += c; return true; }
+    template <typename T>
+    bool concat(T number) { return concat(String(number)); }
+
+    template <typename T>
+    String& operator+=(const T& other) { concat(other); return *this; }
+
+    bool equals(const String& other) const { return value == other.value; }
+    bool equalsIgnoreCase(const String& other) const;
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator==(const char* other) const { return value == (other ? other : ""); }
+    bool operator!=(const String& other) const { return value != other.value; }
+    bool operator!=(const char* other) const { return !(*this == other); }
+    bool operator<(const String& other) const { return value < other.value; }
+    int compareTo(const String& other) const { return value.compare(other.value); }
+
+    char charAt(unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index) { return value[index]; }
+    void setCharAt(unsigned int index, char c) { if (index < value.size()) value[index] = c; }
+
+    bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+    bool endsWith(const String& suffix) const;
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& str, unsigned int from = 0) const;
+    int lastIndexOf(char c) const;
+    int lastIndexOf(const String& str) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+
+    void replace(const String& find, const String& replacement);
+    void remove(unsigned int index) { if (index < value.size()) value.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < value.size()) value.erase(index, count); }
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    std::string value;
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const char* a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const String& a, char b);
+template <typename T>
+String operator+(const String& a, T number) { return a + String(number); }
+
+#endif
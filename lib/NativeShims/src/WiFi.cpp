@@ -0,0 +1,113 @@
+#include "WiFi.h"
+#include "native_board.h"
+
+WiFiClass WiFi;
+
+struct SimulatedNetwork {
+    const char* ssid;
+    int32_t rssi;
+    wifi_auth_mode_t auth;
+};
+
+static const SimulatedNetwork SIMULATED_NETWORKS[] = {
+    { "native-lab", -48, WIFI_AUTH_WPA2_PSK },
+    { "native-guest", -67, WIFI_AUTH_OPEN },
+    { "native-iot", -80, WIFI_AUTH_WPA_WPA2_PSK },
+};
+static const int SIMULATED_NETWORK_COUNT = sizeof(SIMULATED_NETWORKS) / sizeof(SIMULATED_NETWORKS[0]);
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+    currentMode = mode;
+    return true;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password) {
+    (void)ssid;
+    (void)password;
+    if (currentMode == WIFI_OFF || currentMode == WIFI_STA) {
+        currentMode = currentMode == WIFI_STA ? WIFI_AP_STA : WIFI_AP;
+    }
+    return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifiOff) {
+    if (wifiOff) {
+        currentMode = currentMode == WIFI_AP_STA ? WIFI_STA : WIFI_OFF;
+    }
+    return true;
+}
+
+// Locally administered address, the same for the same SSID
+static void simulated_bssid(const String& ssid, uint8_t* bssid) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < ssid.length(); i++) {
+        hash = (hash ^ (uint8_t)ssid[i]) * 16777619u;
+    }
+    uint8_t address[6] = { 0x02, 0xAC, (uint8_t)(hash >> 24), (uint8_t)(hash >> 16), (uint8_t)(hash >> 8), (uint8_t)hash };
+    memcpy(bssid, address, sizeof(address));
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel, const uint8_t* bssid) {
+    (void)password;
+    stationSSID = ssid ? ssid : "";
+    simulated_bssid(stationSSID, stationBSSID);
+    bool direct = channel != 0 && bssid != nullptr;
+    if (native_env("NATIVE_WIFI_FAIL", nullptr) || stationSSID.isEmpty() ||
+        (direct && (channel != SIMULATED_CHANNEL || memcmp(bssid, stationBSSID, sizeof(stationBSSID)) != 0))) {
+        currentStatus = WL_NO_SSID_AVAIL;
+    } else {
+        currentStatus = WL_CONNECTED;
+        static const unsigned long association = strtoul(native_env("NATIVE_WIFI_ASSOC_MS", "0"), nullptr, 10);
+        static const unsigned long scan = strtoul(native_env("NATIVE_WIFI_SCAN_MS", "0"), nullptr, 10);
+        connectedAt = millis() + association + (direct ? 0 : scan);
+    }
+    return status();
+}
+
+uint8_t* WiFiClass::BSSID() {
+    return status() == WL_CONNECTED ? stationBSSID : nullptr;
+}
+
+wl_status_t WiFiClass::status() {
+    static const unsigned long flaky = strtoul(native_env("NATIVE_WIFI_FLAKY", "0"), nullptr, 10) * 1000;
+    if (currentStatus == WL_CONNECTED && (long)(millis() - connectedAt) < 0) {
+        return WL_IDLE_STATUS;
+    }
+    if (currentStatus != WL_CONNECTED || flaky == 0) {
+        return currentStatus;
+    }
+    // One drop per period, at a pseudo random offset and of pseudo random length
+    unsigned long now = millis();
+    uint32_t period = now / flaky;
+    uint32_t hash = (period + 1) * 2654435761u;
+    hash ^= hash >> 15;
+    unsigned long start = period * flaky + hash % flaky;
+    unsigned long length = 2000 + (hash >> 8) % 8000;
+    return now >= start && now < start + length ? WL_CONNECTION_LOST : WL_CONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    (void)wifiOff;
+    currentStatus = WL_DISCONNECTED;
+    return true;
+}
+
+bool WiFiClass::reconnect() {
+    return begin(stationSSID.c_str()) == WL_CONNECTED;
+}
+
+int16_t WiFiClass::scanNetworks() {
+    return SIMULATED_NETWORK_COUNT;
+}
+
+String WiFiClass::SSID(uint8_t index) {
+    return index < SIMULATED_NETWORK_COUNT ? String(SIMULATED_NETWORKS[index].ssid) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t index) {
+    return index < SIMULATED_NETWORK_COUNT ? SIMULATED_NETWORKS[index].rssi : 0;
+}
+
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t index) {
+    return index < SIMULATED_NETWORK_COUNT ? SIMULATED_NETWORKS[index].auth : WIFI_AUTH_OPEN;
+}
@@ -0,0 +1,81 @@
+#ifndef __NATIVE_WIFI_H__
+#define __NATIVE_WIFI_H__
+
+#include "Arduino.h"
+
+// Simulated station and access point: connecting succeeds (unless NATIVE_WIFI_FAIL is set),
+// the station address is the loopback address and scans return a fixed list.
+// NATIVE_WIFI_FLAKY drops the connection for 2 to 10 s about every that many seconds.
+// A connect takes NATIVE_WIFI_ASSOC_MS plus NATIVE_WIFI_SCAN_MS for the scan of all channels,
+// which is skipped when begin() gets the channel and BSSID of the access point. Every SSID is on
+// channel 6 with a BSSID made from its name, a connect to another BSSID finds no network.
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK
+} wifi_auth_mode_t;
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t mode);
+    wifi_mode_t getMode() { return currentMode; }
+
+    bool softAP(const char* ssid, const char* password = nullptr);
+    bool softAP(const String& ssid, const String& password) { return softAP(ssid.c_str(), password.c_str()); }
+    bool softAPdisconnect(bool wifiOff = false);
+    IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+    uint8_t softAPgetStationNum() { return 0; }
+
+    wl_status_t begin(const char* ssid, const char* password = nullptr, int32_t channel = 0, const uint8_t* bssid = nullptr);
+    bool disconnect(bool wifiOff = false);
+    bool reconnect();
+    // Connected NATIVE_WIFI_ASSOC_MS after begin(). With NATIVE_WIFI_FLAKY the connection is lost
+    // now and then and comes back by itself
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+    String SSID() { return status() == WL_CONNECTED ? stationSSID : String(); }
+    int8_t RSSI() { return status() == WL_CONNECTED ? -55 : 0; }
+    IPAddress localIP() { return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress(); }
+    String macAddress() { return "02:00:00:00:00:01"; }
+    int32_t channel() { return status() == WL_CONNECTED ? SIMULATED_CHANNEL : 0; }
+    uint8_t* BSSID();
+
+    int16_t scanNetworks();
+    void scanDelete() {}
+    String SSID(uint8_t index);
+    int32_t RSSI(uint8_t index);
+    wifi_auth_mode_t encryptionType(uint8_t index);
+
+private:
+    static const int32_t SIMULATED_CHANNEL = 6;
+
+    wifi_mode_t currentMode = WIFI_OFF;
+    wl_status_t currentStatus = WL_DISCONNECTED;
+    unsigned long connectedAt = 0;  // millis() when the association of begin() is done
+    String stationSSID;
+    uint8_t stationBSSID[6];
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __NATIVE_WIRE_H__
+#define __NATIVE_WIRE_H__
+
+#include "Arduino.h"
+
+// No I2C bus on the host, the devices on it (LCD) are simulated by their own shims
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+    void setClock(uint32_t frequency) {}
+    void beginTransmission(uint8_t address) {}
+    uint8_t endTransmission(bool sendStop = true) { return 0; }
+    size_t write(uint8_t data) { return 1; }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) { return 0; }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif
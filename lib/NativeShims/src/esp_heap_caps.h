@@ -0,0 +1,21 @@
+#ifndef __NATIVE_ESP_HEAP_CAPS_H__
+#define __NATIVE_ESP_HEAP_CAPS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+// The largest free block of the host heap is the free heap less the free chunks that malloc
+// keeps between allocated ones (mallinfo2, one arena, see native_init), as on the device heap
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+static inline void* heap_caps_malloc(size_t size, uint32_t caps) { (void)caps; return malloc(size); }
+static inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif
@@ -0,0 +1,59 @@
+#include "Arduino.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "native_board.h"
+
+#include <malloc.h>
+#include <mutex>
+#include <vector>
+
+static std::vector<shutdown_handler_t> shutdownHandlers;
+static std::mutex shutdownMutex;
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    std::lock_guard<std::mutex> lock(shutdownMutex);
+    for (shutdown_handler_t registered : shutdownHandlers) {
+        if (registered == handler) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    shutdownHandlers.push_back(handler);
+    return ESP_OK;
+}
+
+void native_run_shutdown_handlers() {
+    std::vector<shutdown_handler_t> handlers;
+    {
+        std::lock_guard<std::mutex> lock(shutdownMutex);
+        handlers.swap(shutdownHandlers);
+    }
+    // Like esp_restart(), the last registered runs first
+    for (auto handler = handlers.rbegin(); handler != handlers.rend(); ++handler) {
+        (*handler)();
+    }
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)native_clock_us();
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return ESP.getFreeHeap();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    (void)caps;
+    return ESP.getMinFreeHeap();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    (void)caps;
+    // keepcost is the free top of the heap, the rest of the free chunks are holes
+    struct mallinfo2 info = mallinfo2();
+    size_t holes = info.fordblks > info.keepcost ? info.fordblks - info.keepcost : 0;
+    holes = holes > native_heap_holes_baseline() ? holes - native_heap_holes_baseline() : 0;
+    size_t freeBytes = ESP.getFreeHeap();
+    return holes < freeBytes ? freeBytes - holes : 0;
+}
@@ -0,0 +1,16 @@
+#ifndef __NATIVE_ESP_SYSTEM_H__
+#define __NATIVE_ESP_SYSTEM_H__
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef void (*shutdown_handler_t)(void);
+
+// Run by ESP.restart() and, as the host has no other shutdown, by native_exit()
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+#endif
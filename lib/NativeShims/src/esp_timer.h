@@ -0,0 +1,9 @@
+#ifndef __NATIVE_ESP_TIMER_H__
+#define __NATIVE_ESP_TIMER_H__
+
+#include <stdint.h>
+
+// Microseconds since start, 64 bit like on the device
+int64_t esp_timer_get_time();
+
+#endif
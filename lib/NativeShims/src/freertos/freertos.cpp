@@ -0,0 +1,555 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+// Host threads get NATIVE_STACK_SCALE times the requested stack, x86-64 frames are larger
+// than Xtensa ones and glibc needs more than newlib. High water marks are scaled back, so
+// they can be compared with the stack size passed to xTaskCreate.
+#define NATIVE_STACK_SCALE 32
+#define NATIVE_STACK_MIN (64 * 1024)
+#define NATIVE_STACK_FILL 0xA5
+
+struct NativeTask {
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t function;
+    void* parameters;
+    uint32_t stackDepth;
+    UBaseType_t priority;
+    BaseType_t core;
+    UBaseType_t number;
+    pthread_t thread;
+    uint8_t* stack;
+    size_t stackSize;
+
+    std::mutex notifyMutex;
+    std::condition_variable notifyCondition;
+    uint32_t notifications;
+};
+
+static std::mutex taskListMutex;
+static std::vector<NativeTask*> taskList;
+static UBaseType_t nextTaskNumber = 1;
+static thread_local NativeTask* currentTask;
+static std::recursive_mutex schedulerMutex;
+static const std::chrono::steady_clock::time_point schedulerStart = std::chrono::steady_clock::now();
+
+static void task_register(NativeTask* task) {
+    std::lock_guard<std::mutex> lock(taskListMutex);
+    task->number = nextTaskNumber++;
+    taskList.push_back(task);
+}
+
+static void task_unregister(NativeTask* task) {
+    std::lock_guard<std::mutex> lock(taskListMutex);
+    for (size_t i = 0; i < taskList.size(); i++) {
+        if (taskList[i] == task) {
+            taskList.erase(taskList.begin() + i);
+            break;
+        }
+    }
+}
+
+static void* task_entry(void* arg) {
+    NativeTask* task = (NativeTask*)arg;
+    currentTask = task;
+    task->function(task->parameters);
+    // Returning from a task function is an error on FreeRTOS, treat it like vTaskDelete(NULL)
+    fprintf(stderr, "Task %s returned from its function\n", task->name);
+    vTaskDelete(NULL);
+    return nullptr;
+}
+
+BaseType_t xPortGetCoreID() {
+    if (currentTask && currentTask->core >= 0 && currentTask->core < portNUM_PROCESSORS) {
+        return currentTask->core;
+    }
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % portNUM_PROCESSORS;
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    uintptr_t self = (uintptr_t)pthread_self();
+    if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) == self) {
+        mux->count++;
+        return;
+    }
+    uintptr_t expected = 0;
+    while (!__atomic_compare_exchange_n(&mux->owner, &expected, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        expected = 0;
+        sched_yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    if (--mux->count == 0) {
+        __atomic_store_n(&mux->owner, (uintptr_t)0, __ATOMIC_RELEASE);
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    NativeTask* task = new NativeTask();
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    task->function = function;
+    task->parameters = parameters;
+    task->stackDepth = stackDepth;
+    task->priority = priority;
+    task->core = core;
+    task->notifications = 0;
+
+    task->stackSize = (size_t)stackDepth * NATIVE_STACK_SCALE;
+    if (task->stackSize < NATIVE_STACK_MIN) {
+        task->stackSize = NATIVE_STACK_MIN;
+    }
+    void* stack = mmap(nullptr, task->stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        delete task;
+        return pdFAIL;
+    }
+    task->stack = (uint8_t*)stack;
+    memset(task->stack, NATIVE_STACK_FILL, task->stackSize);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, task->stack, task->stackSize);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    task_register(task);
+    int error = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (error) {
+        task_unregister(task);
+        munmap(task->stack, task->stackSize);
+        delete task;
+        return pdFAIL;
+    }
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void native_task_adopt_main(const char* name, uint32_t stackDepth, UBaseType_t priority) {
+    NativeTask* task = new NativeTask();
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->stackDepth = stackDepth;
+    task->priority = priority;
+    task->core = 1;     // The Arduino loop task runs on core 1
+    task->thread = pthread_self();
+    task->stack = nullptr;
+    task->stackSize = 0;
+    task->notifications = 0;
+    currentTask = task;
+    task_register(task);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != nullptr && task != currentTask) {
+        fprintf(stderr, "vTaskDelete: deleting another task is not supported on the host\n");
+        return;
+    }
+    NativeTask* self = currentTask;
+    if (self) {
+        task_unregister(self);
+        // The stack and the task are leaked on purpose, the thread is still running on them
+    }
+    pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        sched_yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t increment) {
+    TickType_t wake = *previousWake + increment;
+    TickType_t now = xTaskGetTickCount();
+    *previousWake = wake;
+    if ((int32_t)(wake - now) <= 0) {
+        return pdFALSE;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(wake - now));
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - schedulerStart).count();
+}
+
+void taskYIELD() {
+    sched_yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return currentTask;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    static char unknown[] = "host";
+    NativeTask* t = task ? task : currentTask;
+    return t ? t->name : unknown;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    NativeTask* t = task ? task : currentTask;
+    return t ? t->priority : tskIDLE_PRIORITY;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    NativeTask* t = task ? task : currentTask;
+    if (t) {
+        t->priority = priority;
+    }
+}
+
+BaseType_t xTaskGetAffinity(TaskHandle_t task) {
+    NativeTask* t = task ? task : currentTask;
+    return t ? t->core : tskNO_AFFINITY;
+}
+
+static uint32_t task_stack_high_water(const NativeTask* task) {
+    if (task->stack == nullptr) {
+        return task->stackDepth;
+    }
+    // The stack grows down, untouched fill bytes at the low end were never used
+    size_t untouched = 0;
+    while (untouched < task->stackSize && task->stack[untouched] == NATIVE_STACK_FILL) {
+        untouched++;
+    }
+    return untouched / NATIVE_STACK_SCALE;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    NativeTask* t = task ? task : currentTask;
+    return t ? task_stack_high_water(t) : 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks() {
+    std::lock_guard<std::mutex> lock(taskListMutex);
+    return taskList.size();
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* totalRunTime) {
+    std::lock_guard<std::mutex> lock(taskListMutex);
+    if (size < taskList.size()) {
+        return 0;
+    }
+    for (size_t i = 0; i < taskList.size(); i++) {
+        NativeTask* task = taskList[i];
+        TaskStatus_t& entry = status[i];
+        entry.xHandle = task;
+        entry.pcTaskName = task->name;
+        entry.xTaskNumber = task->number;
+        entry.eCurrentState = task == currentTask ? eRunning : eBlocked;
+        entry.uxCurrentPriority = task->priority;
+        entry.uxBasePriority = task->priority;
+        entry.ulRunTimeCounter = 0;
+        clockid_t clock;
+        struct timespec ts;
+        if (pthread_getcpuclockid(task->thread, &clock) == 0 && clock_gettime(clock, &ts) == 0) {
+            entry.ulRunTimeCounter = (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+        }
+        entry.pxStackBase = task->stack;
+        entry.usStackHighWaterMark = task_stack_high_water(task);
+        entry.xCoreID = task->core;
+    }
+    if (totalRunTime) {
+        *totalRunTime = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - schedulerStart).count();
+    }
+    return taskList.size();
+}
+
+void vTaskSuspendAll() {
+    schedulerMutex.lock();
+}
+
+BaseType_t xTaskResumeAll() {
+    schedulerMutex.unlock();
+    return pdFALSE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (task == nullptr) {
+        return pdFAIL;
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->notifyMutex);
+        task->notifications++;
+    }
+    task->notifyCondition.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    NativeTask* task = currentTask;
+    if (task == nullptr) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(task->notifyMutex);
+    auto ready = [task]() { return task->notifications > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->notifyCondition.wait(lock, ready);
+    } else {
+        task->notifyCondition.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+    uint32_t value = task->notifications;
+    if (value) {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+// Semaphores
+
+struct NativeSemaphore {
+    enum Type { MUTEX, RECURSIVE_MUTEX, BINARY, COUNTING };
+
+    Type type;
+    std::mutex mutex;
+    std::condition_variable condition;
+    UBaseType_t count;
+    UBaseType_t maxCount;
+    pthread_t owner;
+    UBaseType_t recursion;
+};
+
+static SemaphoreHandle_t semaphore_create(NativeSemaphore::Type type, UBaseType_t maxCount, UBaseType_t initialCount) {
+    NativeSemaphore* semaphore = new NativeSemaphore();
+    semaphore->type = type;
+    semaphore->count = initialCount;
+    semaphore->maxCount = maxCount;
+    semaphore->recursion = 0;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return semaphore_create(NativeSemaphore::MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+    return semaphore_create(NativeSemaphore::RECURSIVE_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return semaphore_create(NativeSemaphore::BINARY, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    return semaphore_create(NativeSemaphore::COUNTING, maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (semaphore == nullptr) {
+        return pdFALSE;
+    }
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    auto available = [semaphore]() { return semaphore->count > 0; };
+    if (ticks == portMAX_DELAY) {
+        semaphore->condition.wait(lock, available);
+    } else if (!semaphore->condition.wait_for(lock, std::chrono::milliseconds(ticks), available)) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    semaphore->owner = pthread_self();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (semaphore == nullptr) {
+        return pdFALSE;
+    }
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->count >= semaphore->maxCount) {
+            return pdFALSE;
+        }
+        semaphore->count++;
+    }
+    semaphore->condition.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (semaphore == nullptr) {
+        return pdFALSE;
+    }
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->recursion > 0 && pthread_equal(semaphore->owner, pthread_self())) {
+            semaphore->recursion++;
+            return pdTRUE;
+        }
+    }
+    if (!xSemaphoreTake(semaphore, ticks)) {
+        return pdFALSE;
+    }
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    semaphore->recursion = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+    if (semaphore == nullptr) {
+        return pdFALSE;
+    }
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->recursion == 0 || !pthread_equal(semaphore->owner, pthread_self())) {
+            return pdFALSE;
+        }
+        if (--semaphore->recursion > 0) {
+            return pdTRUE;
+        }
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    return semaphore->count;
+}
+
+// Queues
+
+struct NativeQueue {
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::vector<uint8_t> storage;
+    UBaseType_t head;
+    UBaseType_t count;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+
+    uint8_t* slot(UBaseType_t index) { return &storage[(index % length) * itemSize]; }
+};
+
+template <typename Predicate>
+static bool queue_wait(std::condition_variable& condition, std::unique_lock<std::mutex>& lock,
+                       TickType_t ticks, Predicate predicate) {
+    if (ticks == portMAX_DELAY) {
+        condition.wait(lock, predicate);
+        return true;
+    }
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks), predicate);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if (length == 0) {
+        return nullptr;
+    }
+    NativeQueue* queue = new NativeQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->storage.resize((size_t)length * itemSize);
+    queue->head = 0;
+    queue->count = 0;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void* item, TickType_t ticks, bool front) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!queue_wait(queue->notFull, lock, ticks, [queue]() { return queue->count < queue->length; })) {
+        return errQUEUE_FULL;
+    }
+    if (front) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        memcpy(queue->slot(queue->head), item, queue->itemSize);
+    } else {
+        memcpy(queue->slot(queue->head + queue->count), item, queue->itemSize);
+    }
+    queue->count++;
+    lock.unlock();
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        memcpy(queue->slot(queue->head), item, queue->itemSize);
+        queue->count = 1;
+    }
+    queue->notEmpty.notify_one();
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void* item, TickType_t ticks, bool remove) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!queue_wait(queue->notEmpty, lock, ticks, [queue]() { return queue->count > 0; })) {
+        return errQUEUE_EMPTY;
+    }
+    memcpy(item, queue->slot(queue->head), queue->itemSize);
+    if (!remove) {
+        return pdPASS;
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    lock.unlock();
+    queue->notFull.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    return queue_receive(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) {
+    return queue_receive(queue, item, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->head = 0;
+        queue->count = 0;
+    }
+    queue->notFull.notify_all();
+    return pdPASS;
+}
@@ -0,0 +1,82 @@
+#ifndef __NATIVE_FREERTOS_TASK_H__
+#define __NATIVE_FREERTOS_TASK_H__
+
+#include "FreeRTOS.h"
+
+struct NativeTask;
+typedef NativeTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char* pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    uint32_t ulRunTimeCounter;          // Thread CPU time in microseconds
+    StackType_t* pxStackBase;
+    uint32_t usStackHighWaterMark;      // Bytes, measured on the (larger) host stack
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+static inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                     void* parameters, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, handle, tskNO_AFFINITY);
+}
+// The stack buffer is only claimed, host tasks run on a larger mapped stack
+static inline TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                                         void* parameters, UBaseType_t priority, StackType_t* stack,
+                                                         StaticTask_t* buffer, BaseType_t core) {
+    (void)stack;
+    (void)buffer;
+    TaskHandle_t handle = nullptr;
+    xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, &handle, core);
+    return handle;
+}
+// Only the calling task (NULL or its own handle) can be deleted on the host
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t increment);
+static inline void vTaskDelayUntil(TickType_t* previousWake, TickType_t increment) {
+    xTaskDelayUntil(previousWake, increment);
+}
+TickType_t xTaskGetTickCount();
+static inline TickType_t xTaskGetTickCountFromISR() { return xTaskGetTickCount(); }
+void taskYIELD();
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+BaseType_t xTaskGetAffinity(TaskHandle_t task);
+
+UBaseType_t uxTaskGetNumberOfTasks();
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* totalRunTime);
+
+// Suspending the scheduler is not possible on the host, it takes a global lock instead,
+// which gives the same exclusion between sections that use it
+void vTaskSuspendAll();
+BaseType_t xTaskResumeAll();
+
+// Direct to task notifications
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+// Registers the calling thread (main) as a task, used for the Arduino loop task
+void native_task_adopt_main(const char* name, uint32_t stackDepth, UBaseType_t priority);
+
+#endif
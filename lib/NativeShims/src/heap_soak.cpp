@@ -0,0 +1,65 @@
+#include "heap_soak.h"
+#include "Arduino.h"
+#include "esp_heap_caps.h"
+#include "native_board.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+struct SoakSample {
+    size_t freeBytes;
+    size_t largest;
+    double fragmentation;
+};
+
+static SoakSample soak_sample() {
+    SoakSample sample;
+    sample.freeBytes = ESP.getFreeHeap();
+    sample.largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    sample.fragmentation = sample.freeBytes && sample.largest < sample.freeBytes
+                               ? 1.0 - (double)sample.largest / sample.freeBytes : 0;
+    return sample;
+}
+
+static void soak_run(int seconds, int warmup, double maxFragmentation, size_t maxGrowth, int report) {
+    SoakSample warm = soak_sample();
+    double worst = 0;
+    int worstAt = 0;
+    for (int second = 1; second <= seconds; second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        SoakSample sample = soak_sample();
+        if (second == warmup) {
+            warm = sample;
+        }
+        if (second > warmup && sample.fragmentation > worst) {
+            worst = sample.fragmentation;
+            worstAt = second;
+        }
+        if (report > 0 && second % report == 0) {
+            printf("[soak] %d s: free %.1f KB, largest block %.1f KB, fragmentation %.3f (worst %.3f)\n", second,
+                   sample.freeBytes / 1024.0, sample.largest / 1024.0, sample.fragmentation, worst);
+        }
+    }
+    SoakSample last = soak_sample();
+    size_t growth = warm.freeBytes > last.freeBytes ? warm.freeBytes - last.freeBytes : 0;
+    bool passed = worst <= maxFragmentation && growth <= maxGrowth;
+    printf("[soak] %s: worst fragmentation %.3f at %d s (limit %.3f), free heap %.1f KB after the warmup, "
+           "%.1f KB at the end (%.1f KB lost, limit %.1f KB)\n",
+           passed ? "passed" : "FAILED", worst, worstAt, maxFragmentation, warm.freeBytes / 1024.0,
+           last.freeBytes / 1024.0, growth / 1024.0, maxGrowth / 1024.0);
+    native_exit(passed ? 0 : 1);
+}
+
+void heap_soak_begin() {
+    int seconds = atoi(native_env("NATIVE_SOAK_SECONDS", "0"));
+    if (seconds <= 0) {
+        return;
+    }
+    int warmup = atoi(native_env("NATIVE_SOAK_WARMUP_S", "60"));
+    double maxFragmentation = atof(native_env("NATIVE_SOAK_MAX_FRAGMENTATION", "0.25"));
+    size_t maxGrowth = (size_t)atoi(native_env("NATIVE_SOAK_MAX_GROWTH_KB", "16")) * 1024;
+    int report = atoi(native_env("NATIVE_SOAK_REPORT_S", "60"));
+    std::thread(soak_run, seconds, warmup, maxFragmentation, maxGrowth, report).detach();
+}
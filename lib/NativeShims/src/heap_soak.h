@@ -0,0 +1,23 @@
+#ifndef __NATIVE_HEAP_SOAK_H__
+#define __NATIVE_HEAP_SOAK_H__
+
+// Soak check of the heap, for a week of operation compressed into a run of env:native_soak (see
+// platformio.ini). Samples the free heap and the largest free block (esp_heap_caps.h) every
+// second, prints them every NATIVE_SOAK_REPORT_S and when NATIVE_SOAK_SECONDS is over ends the
+// process with status 0 if, after the warmup,
+//   the fragmentation ratio (share of the free heap outside of the largest block) never went
+//   above NATIVE_SOAK_MAX_FRAGMENTATION, and
+//   the free heap at the end is at most NATIVE_SOAK_MAX_GROWTH_KB below the one at the end of
+//   the warmup (no leak),
+// and with status 1 otherwise. Run it with bots (load_generator.h) so the WebSocket paths work.
+//
+// Settings, read from the environment:
+//   NATIVE_SOAK_SECONDS            length of the run, default 0 (off)
+//   NATIVE_SOAK_WARMUP_S           seconds before the limits apply, default 60
+//   NATIVE_SOAK_MAX_FRAGMENTATION  default 0.25
+//   NATIVE_SOAK_MAX_GROWTH_KB      default 16
+//   NATIVE_SOAK_REPORT_S           seconds between progress lines, default 60
+
+void heap_soak_begin();
+
+#endif
@@ -0,0 +1,795 @@
+#include "Arduino.h"
+#include "AsyncWebSocket.h"
+#include "load_generator.h"
+#include "native_board.h"
+#include "Preferences.h"
+#include "sensor_sim.h"
+#include "task_check_info.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// Latency samples kept per channel, older ones are dropped
+#define LOAD_MAX_SAMPLES 200000
+#define LOAD_REFRESH_MS 5000
+#define LOAD_HISTORY_MS 60000
+#define LOAD_RECONNECT_MS 200
+#define LOAD_SLOW_RECEIVE_BUFFER 4096
+#define LOAD_HEAP_SAMPLE_MS 10
+// A settings session of NATIVE_BOT_SETTINGS_S: a save every LOAD_SETTINGS_SAVE_MS for LOAD_SETTINGS_SESSION_MS
+#define LOAD_SETTINGS_SESSION_MS 3000
+#define LOAD_SETTINGS_SAVE_MS 200
+#define LOAD_CONFIG_APPLY_TIMEOUT_MS 30000
+
+// The requests of refreshAll() in dashboard.html
+static const char* const DASHBOARD_REFRESH[] = {
+    "{\"action\":\"get_status\"}",
+    "{\"action\":\"get_sensors\"}",
+    "{\"action\":\"get_leds\"}",
+    "{\"action\":\"get_light\"}",
+    "{\"action\":\"get_alert_settings\"}",
+};
+static const char* DASHBOARD_HISTORY = "{\"action\":\"get_history\",\"metric\":\"temperature\",\"range\":86400,\"points\":300}";
+static const char* DASHBOARD_TASKS = "{\"action\":\"get_tasks\"}";
+// The WiFi setup of wifi_config.html, fails with NATIVE_WIFI_FAIL after the 10 s connect timeout
+static const char* DASHBOARD_CONNECT = "{\"action\":\"connect\",\"ssid\":\"LoadTest\",\"password\":\"loadtest1\"}";
+// One message per action the server knows, sent in turn with NATIVE_BOT_ACTION_HZ
+static const char* const ALL_ACTIONS[] = {
+    "{\"action\":\"scan\"}",
+    "{\"action\":\"get_status\"}",
+    "{\"action\":\"get_sensors\"}",
+    "{\"action\":\"get_leds\"}",
+    "{\"action\":\"get_light\"}",
+    "{\"action\":\"get_alert_settings\"}",
+    "{\"action\":\"get_history\",\"metric\":\"humidity\",\"range\":3600,\"points\":100}",
+    "{\"action\":\"get_tasks\"}",
+    "{\"action\":\"get_report_policy\"}",
+    "{\"action\":\"connect\",\"ssid\":\"LoadTest\",\"password\":\"loadtest1\"}",
+    "{\"action\":\"disconnect\"}",
+    "{\"action\":\"control_led\",\"state\":true}",
+    "{\"action\":\"control_neo\",\"state\":true}",
+    "{\"action\":\"preview_neo_color\",\"r\":12,\"g\":200,\"b\":7,\"hex\":\"#0cc807\"}",
+    "{\"action\":\"save_neo_color\",\"r\":0,\"g\":255,\"b\":0,\"hex\":\"#00ff00\"}",
+    "{\"action\":\"save_alert_color\",\"r\":255,\"g\":0,\"b\":0,\"hex\":\"#ff0000\"}",
+    "{\"action\":\"save_temp_threshold\",\"threshold\":30}",
+    "{\"action\":\"set_report_policy\",\"metric\":\"light\",\"dead_band\":100,\"max_silence\":900}",
+};
+
+struct LatencySeries {
+    std::vector<uint32_t> us;
+    uint32_t dropped = 0;
+
+    // Reserved at once, malloc maps a block this large on its own: the samples of the bots stay out
+    // of the heap the firmware sees (getFreeHeap) and do not fragment it as the vector grows
+    LatencySeries() {
+        us.reserve(LOAD_MAX_SAMPLES);
+    }
+
+    void add(uint32_t value) {
+        if (us.size() < LOAD_MAX_SAMPLES) {
+            us.push_back(value);
+        } else {
+            us[dropped++ % LOAD_MAX_SAMPLES] = value;
+        }
+    }
+};
+
+struct LoadStats {
+    std::mutex mutex;
+    uint32_t bots = 0;
+    unsigned long startMs = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint32_t connects = 0;
+    uint32_t connectFailures = 0;
+    uint32_t slowBots = 0;
+    uint32_t disconnects = 0;
+    uint32_t closedByServer = 0;
+    uint32_t stalls = 0;
+    uint32_t unmatched = 0;     // Sensor values that match no journaled reading (DHT failures report -1)
+    uint64_t commandsSent = 0;  // Previews and connects
+    uint64_t previewResults = 0;    // Preview confirmations received by the fast bots
+    // get_history requests and replies, every request is answered unless a newer one replaced it
+    // before it ran, so a gap shows requests that got lost (e.g. fragmented ones)
+    uint64_t historyRequests = 0;
+    uint64_t historyReplies = 0;
+    uint32_t settingsSessions = 0;
+    uint32_t settingsSaves = 0;
+    // millis() when a bot first got a DHT value that was actually read, 0 before
+    unsigned long firstDhtMs = 0;
+    // Fast bots at 0, slow ones at 1
+    LatencySeries dht[2];
+    LatencySeries light[2];
+    // Run time of the server's WebSocket event handler in nanoseconds, per data and connect event
+    LatencySeries dataHandler;
+    LatencySeries connectHandler;
+    // Data handler time per action, of the unfragmented messages
+    std::map<std::string, LatencySeries> actionHandler;
+};
+
+// Never freed, the bots still run while the exit hook prints the summary
+static LoadStats* stats = nullptr;
+
+struct Percentiles {
+    size_t count;
+    double p50, p90, p99, max;
+};
+
+// Samples in microseconds give milliseconds, the handler times in nanoseconds give microseconds
+static Percentiles percentiles(std::vector<uint32_t> values) {
+    Percentiles result = { values.size(), 0, 0, 0, 0 };
+    if (values.empty()) {
+        return result;
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double fraction) {
+        size_t index = (size_t)(fraction * (values.size() - 1) + 0.5);
+        return values[index] / 1000.0;
+    };
+    result.p50 = at(0.50);
+    result.p90 = at(0.90);
+    result.p99 = at(0.99);
+    result.max = values.back() / 1000.0;
+    return result;
+}
+
+class Bot {
+public:
+    Bot(uint32_t index, uint16_t port, float churn, float stall, uint32_t slowBps, uint32_t previewHz, uint32_t connectSeconds,
+        uint32_t actionHz, uint32_t settingsSeconds, uint32_t fragment)
+        : index(index), port(port), churn(churn), stall(stall), slowBps(slowBps), previewHz(previewHz),
+          connectSeconds(connectSeconds), actionHz(actionHz), settingsSeconds(settingsSeconds), fragment(fragment),
+          nextAction(index), nextSetting(0), fd(-1),
+          random(0x9E3779B9u * (index + 1) ^ strtoul(native_env("NATIVE_SIM_SEED", "1"), nullptr, 10)),
+          lastDht(UINT32_MAX), lastLight(UINT32_MAX) {}
+
+    void run() {
+        // Spread the connects a little, like browsers that are opened one after another
+        delay(nextRandom() % 500);
+        while (true) {
+            if (!connectSocket()) {
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->connectFailures++;
+                delay(LOAD_RECONNECT_MS);
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->connects++;
+            }
+            bool left = session();
+            ::close(fd);
+            fd = -1;
+            {
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->disconnects++;
+                if (!left) {
+                    stats->closedByServer++;
+                }
+            }
+            delay(LOAD_RECONNECT_MS);
+        }
+    }
+
+private:
+    uint32_t index;
+    uint16_t port;
+    float churn;
+    float stall;
+    uint32_t slowBps;       // 0 for a fast bot
+    uint32_t previewHz;
+    uint32_t connectSeconds;
+    uint32_t actionHz;
+    uint32_t settingsSeconds;
+    uint32_t fragment;      // Largest frame payload, 0 to send every message in one frame
+    uint32_t nextAction;
+    uint32_t nextSetting;
+    int fd;
+    uint32_t random;
+    std::string input;
+    uint32_t lastDht;
+    uint32_t lastLight;
+
+    uint32_t nextRandom() {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random;
+    }
+
+    bool chance(float probability) {
+        return (nextRandom() >> 8) / 16777216.0f < probability;
+    }
+
+    bool connectSocket() {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (slowBps) {
+            int receiveBuffer = LOAD_SLOW_RECEIVE_BUFFER;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+        }
+        if (::connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        char request[256];
+        int len = snprintf(request, sizeof(request),
+                           "GET /ws HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: bG9hZGdlbmVyYXRvcj%04u==\r\nSec-WebSocket-Version: 13\r\n\r\n", index % 10000);
+        if (::send(fd, request, len, MSG_NOSIGNAL) != len) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        input.clear();
+        while (input.find("\r\n\r\n") == std::string::npos) {
+            char buffer[512];
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            input.append(buffer, n);
+        }
+        size_t headEnd = input.find("\r\n\r\n");
+        if (input.compare(0, 12, "HTTP/1.1 101") != 0) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        // Frames that came with the handshake response
+        input.erase(0, headEnd + 4);
+        return true;
+    }
+
+    bool sendText(const char* text) {
+        size_t len = strlen(text);
+        if (strstr(text, "\"get_history\"")) {
+            std::lock_guard<std::mutex> lock(stats->mutex);
+            stats->historyRequests++;
+        }
+        // Fragmented: a text frame without FIN, then continuation frames, the last one with FIN
+        std::string frames;
+        size_t offset = 0;
+        do {
+            size_t part = fragment ? min(len - offset, (size_t)fragment) : len;
+            bool final = offset + part == len;
+            frames += (char)((final ? 0x80 : 0x00) | (offset == 0 ? 0x1 : 0x0));
+            if (part < 126) {
+                frames += (char)(0x80 | part);
+            } else {
+                frames += (char)(0x80 | 126);
+                frames += (char)(part >> 8);
+                frames += (char)part;
+            }
+            uint32_t mask = nextRandom();
+            frames.append((const char*)&mask, 4);
+            for (size_t i = 0; i < part; i++) {
+                frames += (char)(text[offset + i] ^ ((const uint8_t*)&mask)[i % 4]);
+            }
+            offset += part;
+        } while (offset < len);
+        return ::send(fd, frames.data(), frames.size(), MSG_NOSIGNAL) == (ssize_t)frames.size();
+    }
+
+    bool refresh() {
+        for (const char* request : DASHBOARD_REFRESH) {
+            if (!sendText(request)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A color picker being dragged
+    bool sendPreview() {
+        uint32_t color = nextRandom() & 0xFFFFFF;
+        char message[128];
+        snprintf(message, sizeof(message), "{\"action\":\"preview_neo_color\",\"r\":%u,\"g\":%u,\"b\":%u,\"hex\":\"#%06x\"}",
+                 color >> 16, (color >> 8) & 0xFF, color & 0xFF, color);
+        if (!sendText(message)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(stats->mutex);
+        stats->commandsSent++;
+        return true;
+    }
+
+    // Someone trying colors and thresholds: saves of all three settings in turn, each with a new value
+    bool sendSave() {
+        uint32_t color = nextRandom() & 0xFFFFFF;
+        char message[128];
+        switch (nextSetting++ % 3) {
+            case 0:
+                snprintf(message, sizeof(message), "{\"action\":\"save_neo_color\",\"r\":%u,\"g\":%u,\"b\":%u,\"hex\":\"#%06x\"}",
+                         color >> 16, (color >> 8) & 0xFF, color & 0xFF, color);
+                break;
+            case 1:
+                snprintf(message, sizeof(message), "{\"action\":\"save_alert_color\",\"r\":%u,\"g\":%u,\"b\":%u,\"hex\":\"#%06x\"}",
+                         color >> 16, (color >> 8) & 0xFF, color & 0xFF, color);
+                break;
+            default:
+                snprintf(message, sizeof(message), "{\"action\":\"save_temp_threshold\",\"threshold\":%.1f}",
+                         25 + (nextRandom() % 21) / 2.0);
+                break;
+        }
+        if (!sendText(message)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(stats->mutex);
+        stats->commandsSent++;
+        stats->settingsSaves++;
+        return true;
+    }
+
+    // Returns true if the bot left on its own, false if the connection was lost or closed by the server
+    bool session() {
+        if (!refresh() || !sendText(DASHBOARD_HISTORY) || !sendText(DASHBOARD_TASKS)) {
+            return false;
+        }
+        unsigned long lastRefresh = millis();
+        unsigned long lastHistory = millis();
+        unsigned long lastSecond = millis();
+        unsigned long lastBudget = millis();
+        unsigned long lastPreview = millis();
+        unsigned long lastAction = millis();
+        unsigned long lastConnect = millis();
+        unsigned long settingsStart = millis();
+        unsigned long lastSave = 0;
+        bool inSettings = false;
+        size_t budget = slowBps;
+
+        while (true) {
+            if (!processFrames()) {
+                return false;
+            }
+
+            unsigned long now = millis();
+            if (now - lastRefresh >= LOAD_REFRESH_MS) {
+                lastRefresh = now;
+                if (!refresh()) {
+                    return false;
+                }
+            }
+            if (now - lastHistory >= LOAD_HISTORY_MS) {
+                lastHistory = now;
+                if (!sendText(DASHBOARD_HISTORY)) {
+                    return false;
+                }
+            }
+            if (previewHz && now - lastPreview >= 1000 / previewHz) {
+                lastPreview = now;
+                if (!sendPreview()) {
+                    return false;
+                }
+            }
+            if (actionHz && now - lastAction >= 1000 / actionHz) {
+                lastAction = now;
+                const char* action = ALL_ACTIONS[nextAction++ % (sizeof(ALL_ACTIONS) / sizeof(ALL_ACTIONS[0]))];
+                if (!sendText(action)) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->commandsSent++;
+            }
+            if (connectSeconds && now - lastConnect >= connectSeconds * 1000) {
+                lastConnect = now;
+                if (!sendText(DASHBOARD_CONNECT)) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->commandsSent++;
+            }
+            if (settingsSeconds && !inSettings && now - settingsStart >= settingsSeconds * 1000) {
+                inSettings = true;
+                settingsStart = now;
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->settingsSessions++;
+            }
+            if (inSettings && now - lastSave >= LOAD_SETTINGS_SAVE_MS) {
+                lastSave = now;
+                if (!sendSave()) {
+                    return false;
+                }
+                inSettings = now - settingsStart < LOAD_SETTINGS_SESSION_MS;
+            }
+            if (now - lastSecond >= 1000) {
+                lastSecond = now;
+                if (chance(churn)) {
+                    return true;
+                }
+                if (chance(stall)) {
+                    {
+                        std::lock_guard<std::mutex> lock(stats->mutex);
+                        stats->stalls++;
+                    }
+                    // Connected but not reading, the server side queue fills up meanwhile
+                    delay(1000 + nextRandom() % 4000);
+                }
+            }
+
+            char buffer[8192];
+            size_t want = sizeof(buffer);
+            if (slowBps) {
+                // Refilled every 100 ms, reading stops while it is used up
+                if (now - lastBudget >= 100) {
+                    budget = min((size_t)slowBps, budget + slowBps * (now - lastBudget) / 1000);
+                    lastBudget = now;
+                }
+                want = min(want, budget);
+                if (want == 0) {
+                    delay(20);
+                    continue;
+                }
+            }
+            pollfd descriptor = { fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, 100) > 0) {
+                ssize_t n = recv(fd, buffer, want, 0);
+                if (n <= 0) {
+                    return false;
+                }
+                input.append(buffer, n);
+                if (slowBps) {
+                    budget -= n;
+                }
+            }
+        }
+    }
+
+    // Returns false once the server closed the connection
+    bool processFrames() {
+        while (input.size() >= 2) {
+            const uint8_t* head = (const uint8_t*)input.data();
+            uint8_t opcode = head[0] & 0x0F;
+            uint64_t len = head[1] & 0x7F;
+            size_t offset = 2;
+            if (len == 126) {
+                if (input.size() < 4) return true;
+                len = ((uint64_t)head[2] << 8) | head[3];
+                offset = 4;
+            } else if (len == 127) {
+                if (input.size() < 10) return true;
+                len = 0;
+                for (int i = 0; i < 8; i++) {
+                    len = (len << 8) | head[2 + i];
+                }
+                offset = 10;
+            }
+            if (input.size() < offset + len) {
+                return true;
+            }
+            std::string payload = input.substr(offset, len);
+            input.erase(0, offset + len);
+
+            if (opcode == 0x8) {
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->messages++;
+                stats->bytes += offset + len;
+            }
+            if (opcode == 0x1) {
+                measure(payload);
+            }
+        }
+        return true;
+    }
+
+    static bool numberAfter(const std::string& text, const char* key, double& value) {
+        size_t pos = text.find(key);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        value = strtod(text.c_str() + pos + strlen(key), nullptr);
+        return true;
+    }
+
+    void measure(const std::string& message) {
+        uint32_t now = micros();
+        double temperature, humidity, light;
+        uint32_t sampled, sequence;
+
+        if (message.find("\"type\":\"sensors\"") != std::string::npos &&
+            numberAfter(message, "\"temperature\":", temperature) && numberAfter(message, "\"humidity\":", humidity)) {
+            // Values that are in the journal more than once are attributed to the newest reading,
+            // which is the age of what the dashboard shows
+            if (sensor_sim_dht_journal().find(temperature, humidity, 0.01f, sampled, sequence)) {
+                if (lastDht == UINT32_MAX || sequence > lastDht) {
+                    lastDht = sequence;
+                    std::lock_guard<std::mutex> lock(stats->mutex);
+                    stats->dht[slowBps ? 1 : 0].add(now - sampled);
+                    if (stats->firstDhtMs == 0) {
+                        stats->firstDhtMs = max(millis(), 1ul);
+                    }
+                }
+            } else {
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->unmatched++;
+            }
+        }
+        if (message.compare(0, 17, "{\"type\":\"history\"") == 0) {
+            std::lock_guard<std::mutex> lock(stats->mutex);
+            stats->historyReplies++;
+        }
+        if (!slowBps && message.find("\"type\":\"neo_color_result\",\"action\":\"preview\"") != std::string::npos) {
+            std::lock_guard<std::mutex> lock(stats->mutex);
+            stats->previewResults++;
+        }
+        if (numberAfter(message, "\"light_level\":", light) &&
+            sensor_sim_light_journal().find(light, 0, 0.5f, sampled, sequence)) {
+            if (lastLight == UINT32_MAX || sequence > lastLight) {
+                lastLight = sequence;
+                std::lock_guard<std::mutex> lock(stats->mutex);
+                stats->light[slowBps ? 1 : 0].add(now - sampled);
+            }
+        }
+    }
+};
+
+static void print_latency(FILE* out, const char* name, const Percentiles& p) {
+    fprintf(out, " | %s n=%zu p50=%.1f p90=%.1f p99=%.1f max=%.1f ms", name, p.count, p.p50, p.p90, p.p99, p.max);
+}
+
+static void json_latency(FILE* out, const char* name, const Percentiles& p) {
+    fprintf(out, "\"%s\":{\"count\":%zu,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+            name, p.count, p.p50, p.p90, p.p99, p.max);
+}
+
+static const char* const LOAD_GROUPS[2] = { "", "slow_" };
+
+static void load_report(bool final) {
+    stats->mutex.lock();
+    double seconds = (millis() - stats->startMs) / 1000.0;
+    uint32_t bots = stats->bots;
+    uint32_t slowBots = stats->slowBots;
+    uint64_t messages = stats->messages;
+    uint64_t bytes = stats->bytes;
+    uint32_t connects = stats->connects;
+    uint32_t failures = stats->connectFailures;
+    uint32_t disconnects = stats->disconnects;
+    uint32_t closedByServer = stats->closedByServer;
+    uint32_t stalls = stats->stalls;
+    uint32_t unmatched = stats->unmatched;
+    uint64_t commandsSent = stats->commandsSent;
+    uint64_t previewResults = stats->previewResults;
+    uint64_t historyRequests = stats->historyRequests;
+    uint64_t historyReplies = stats->historyReplies;
+    uint32_t settingsSessions = stats->settingsSessions;
+    uint32_t settingsSaves = stats->settingsSaves;
+    unsigned long firstDhtMs = stats->firstDhtMs;
+    std::map<std::string, Percentiles> actionHandlerTime;
+    for (const auto& entry : stats->actionHandler) {
+        actionHandlerTime[entry.first] = percentiles(entry.second.us);
+    }
+    std::vector<uint32_t> dataHandler = stats->dataHandler.us;
+    std::vector<uint32_t> connectHandler = stats->connectHandler.us;
+    std::vector<uint32_t> dht[2] = { stats->dht[0].us, stats->dht[1].us };
+    std::vector<uint32_t> light[2] = { stats->light[0].us, stats->light[1].us };
+    stats->mutex.unlock();
+    uint32_t heapPeak = ESP.getHeapSize() - ESP.getMinFreeHeap();
+    NativeNvsWrites nvs = native_nvs_writes();
+
+    Percentiles dhtLatency[2] = { percentiles(dht[0]), percentiles(dht[1]) };
+    Percentiles lightLatency[2] = { percentiles(light[0]), percentiles(light[1]) };
+    Percentiles lightPeriod = percentiles(sensor_sim_light_journal().intervals());
+    Percentiles dataHandlerTime = percentiles(dataHandler);
+    Percentiles connectHandlerTime = percentiles(connectHandler);
+    // Every applied preview is confirmed to all clients
+    uint32_t fastBots = bots - slowBots;
+    double previewsApplied = fastBots && seconds > 0 ? previewResults / (double)fastBots / seconds : 0;
+    fprintf(stderr, "[load] %.0fs %u bots (%u slow): %llu messages, %.1f KB, %u connects (%u failed), %u disconnects "
+                    "(%u by the server), %u stalls, %u unmatched, heap peak %.1f KB",
+            seconds, bots, slowBots, (unsigned long long)messages, bytes / 1024.0, connects, failures, disconnects,
+            closedByServer, stalls, unmatched, heapPeak / 1024.0);
+    for (int group = 0; group < 2; group++) {
+        if (group == 1 && slowBots == 0) {
+            break;
+        }
+        std::string dhtName = std::string(LOAD_GROUPS[group]) + "dht";
+        std::string lightName = std::string(LOAD_GROUPS[group]) + "light";
+        print_latency(stderr, dhtName.c_str(), dhtLatency[group]);
+        print_latency(stderr, lightName.c_str(), lightLatency[group]);
+    }
+    if (commandsSent) {
+        fprintf(stderr, " | commands %.1f/s, previews applied %.1f/s", commandsSent / seconds, previewsApplied);
+    }
+    fprintf(stderr, " | light read period p50=%.1f p99=%.1f max=%.1f ms", lightPeriod.p50, lightPeriod.p99, lightPeriod.max);
+    if (firstDhtMs) {
+        fprintf(stderr, " | first sensor value after %lu ms", firstDhtMs);
+    }
+    fprintf(stderr, " | history answered %llu/%llu", (unsigned long long)historyReplies, (unsigned long long)historyRequests);
+    if (settingsSessions) {
+        fprintf(stderr, " | settings %u saves in %u sessions", settingsSaves, settingsSessions);
+    }
+    fprintf(stderr, " | NVS %u writes (%u entries, %.1f per settings session), %u unchanged", nvs.writes, nvs.entries,
+            settingsSessions ? nvs.entries / (double)settingsSessions : 0.0, nvs.unchanged);
+    fprintf(stderr, " | data handler n=%zu p50=%.1f p99=%.1f max=%.1f us | connect handler n=%zu p50=%.1f p99=%.1f max=%.1f us\n",
+            dataHandlerTime.count, dataHandlerTime.p50, dataHandlerTime.p99, dataHandlerTime.max,
+            connectHandlerTime.count, connectHandlerTime.p50, connectHandlerTime.p99, connectHandlerTime.max);
+    if (actionHandlerTime.size() > 1) {
+        fprintf(stderr, "[load] data handler per action, p50/p99 us:");
+        for (const auto& entry : actionHandlerTime) {
+            fprintf(stderr, " %s %.2f/%.2f", entry.first.c_str(), entry.second.p50, entry.second.p99);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    const char* path = native_env("NATIVE_BOT_REPORT_FILE", nullptr);
+    if (final && path) {
+        FILE* file = fopen(path, "w");
+        if (file) {
+            fprintf(file, "{\"seconds\":%.1f,\"bots\":%u,\"slow_bots\":%u,\"messages\":%llu,\"bytes\":%llu,\"connects\":%u,"
+                          "\"connect_failures\":%u,\"disconnects\":%u,\"closed_by_server\":%u,\"stalls\":%u,"
+                          "\"unmatched\":%u,\"heap_peak\":%u,\"commands_sent\":%llu,\"previews_applied_per_s\":%.2f,",
+                    seconds, bots, slowBots, (unsigned long long)messages, (unsigned long long)bytes, connects, failures,
+                    disconnects, closedByServer, stalls, unmatched, heapPeak, (unsigned long long)commandsSent, previewsApplied);
+            fprintf(file, "\"history_requests\":%llu,\"history_replies\":%llu,\"settings_sessions\":%u,\"settings_saves\":%u,"
+                          "\"nvs_writes\":%u,\"nvs_entries\":%u,\"nvs_unchanged\":%u,\"first_dht_ms\":%lu,\"handler_us\":{",
+                    (unsigned long long)historyRequests, (unsigned long long)historyReplies, settingsSessions, settingsSaves,
+                    nvs.writes, nvs.entries, nvs.unchanged, firstDhtMs);
+            json_latency(file, "data", dataHandlerTime);
+            fprintf(file, ",");
+            json_latency(file, "connect", connectHandlerTime);
+            for (const auto& entry : actionHandlerTime) {
+                fprintf(file, ",");
+                json_latency(file, entry.first.c_str(), entry.second);
+            }
+            fprintf(file, "},\"latency_ms\":{");
+            for (int group = 0; group < 2; group++) {
+                std::string dhtName = std::string(LOAD_GROUPS[group]) + "dht";
+                std::string lightName = std::string(LOAD_GROUPS[group]) + "light";
+                json_latency(file, dhtName.c_str(), dhtLatency[group]);
+                fprintf(file, ",");
+                json_latency(file, lightName.c_str(), lightLatency[group]);
+                fprintf(file, group ? "" : ",");
+            }
+            fprintf(file, "}}\n");
+            fclose(file);
+        }
+    }
+}
+
+static void load_report_final() {
+    load_report(true);
+}
+
+// Unlike millis() it goes on across the exec of ESP.restart()
+static uint64_t monotonic_us() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+// Waits until the station is connected to ssid, the time since the change is the downtime
+static void config_wait_applied(const std::string& ssid, uint64_t changedAt, const char* how) {
+    unsigned long start = millis();
+    while (millis() - start < LOAD_CONFIG_APPLY_TIMEOUT_MS) {
+        if (WiFi.status() == WL_CONNECTED && ssid == WiFi.SSID().c_str()) {
+            fprintf(stderr, "[config] login %s applied after %.1f ms%s\n", ssid.c_str(), (monotonic_us() - changedAt) / 1000.0, how);
+            return;
+        }
+        delay(1);
+    }
+    fprintf(stderr, "[config] login %s not applied after %u s, the station is on \"%s\"\n", ssid.c_str(),
+            LOAD_CONFIG_APPLY_TIMEOUT_MS / 1000, WiFi.SSID().c_str());
+}
+
+// Saves a new WiFi login every NATIVE_CONFIG_CHANGE_S seconds, like the config page would. What
+// the last change was is kept in the environment, so it can be reported after a restart.
+static void config_changes_begin(uint32_t seconds) {
+    const char* changedAt = getenv("NATIVE_CONFIG_CHANGE_AT");
+    std::string restartSsid = native_env("NATIVE_CONFIG_CHANGE_SSID", "");
+    uint32_t index = strtoul(native_env("NATIVE_CONFIG_CHANGE_INDEX", "0"), nullptr, 10);
+    uint64_t restartAt = changedAt ? strtoull(changedAt, nullptr, 10) : 0;
+    std::thread([seconds, restartSsid, index, restartAt]() mutable {
+        if (restartAt) {
+            // The restart is the downtime, even if the station comes back with another login
+            while (WiFi.status() != WL_CONNECTED) {
+                delay(1);
+            }
+            fprintf(stderr, "[config] restarted, station connected after %.1f ms\n", (monotonic_us() - restartAt) / 1000.0);
+            config_wait_applied(restartSsid, restartAt, " (restarted)");
+        }
+        while (true) {
+            delay(seconds * 1000);
+            char ssid[16];
+            snprintf(ssid, sizeof(ssid), "LoadTest%u", ++index);
+            char value[24];
+            uint64_t start = monotonic_us();
+            snprintf(value, sizeof(value), "%llu", (unsigned long long)start);
+            setenv("NATIVE_CONFIG_CHANGE_AT", value, 1);
+            setenv("NATIVE_CONFIG_CHANGE_SSID", ssid, 1);
+            snprintf(value, sizeof(value), "%u", index);
+            setenv("NATIVE_CONFIG_CHANGE_INDEX", value, 1);
+            Save_info_File(ssid, "loadtest1", "", "", "");
+            config_wait_applied(ssid, start, "");
+        }
+    }).detach();
+}
+
+void load_generator_begin() {
+    uint32_t configSeconds = strtoul(native_env("NATIVE_CONFIG_CHANGE_S", "0"), nullptr, 10);
+    if (configSeconds > 0) {
+        config_changes_begin(configSeconds);
+    }
+    uint32_t bots = strtoul(native_env("NATIVE_WS_BOTS", "0"), nullptr, 10);
+    if (bots == 0) {
+        return;
+    }
+    uint16_t port = native_port(strtoul(native_env("NATIVE_BOT_PORT", "8080"), nullptr, 10));
+    float churn = atof(native_env("NATIVE_BOT_CHURN", "0"));
+    float stall = atof(native_env("NATIVE_BOT_STALL", "0"));
+    float slow = atof(native_env("NATIVE_BOT_SLOW", "0"));
+    uint32_t slowBps = strtoul(native_env("NATIVE_BOT_SLOW_BPS", "1024"), nullptr, 10);
+    uint32_t previewHz = strtoul(native_env("NATIVE_BOT_PREVIEW_HZ", "0"), nullptr, 10);
+    uint32_t connectSeconds = strtoul(native_env("NATIVE_BOT_CONNECT_S", "0"), nullptr, 10);
+    uint32_t actionHz = strtoul(native_env("NATIVE_BOT_ACTION_HZ", "0"), nullptr, 10);
+    uint32_t settingsSeconds = strtoul(native_env("NATIVE_BOT_SETTINGS_S", "0"), nullptr, 10);
+    uint32_t fragment = strtoul(native_env("NATIVE_BOT_FRAGMENT", "0"), nullptr, 10);
+    uint32_t reportSeconds = strtoul(native_env("NATIVE_BOT_REPORT_S", "10"), nullptr, 10);
+
+    stats = new LoadStats();
+    stats->bots = bots;
+    stats->startMs = millis();
+    native_on_exit(load_report_final);
+    native_ws_observe_handler([](AwsEventType type, const AwsFrameInfo* info, const std::string& head, uint32_t duration) {
+        if (type == WS_EVT_DATA || type == WS_EVT_CONNECT) {
+            std::lock_guard<std::mutex> lock(stats->mutex);
+            (type == WS_EVT_DATA ? stats->dataHandler : stats->connectHandler).add(duration);
+            size_t name = head.find("\"action\":\"");
+            if (type == WS_EVT_DATA && info->num == 0 && info->final && name != std::string::npos) {
+                name += 10;
+                stats->actionHandler[head.substr(name, head.find('"', name) - name)].add(duration);
+            }
+        }
+    });
+    fprintf(stderr, "[load] starting %u WebSocket bots on port %u\n", bots, port);
+
+    // The slow bots are spread evenly over the indices
+    for (uint32_t i = 0; i < bots; i++) {
+        bool isSlow = (uint32_t)((i + 1) * slow) > (uint32_t)(i * slow);
+        if (isSlow) {
+            stats->slowBots++;
+        }
+        // Only fast bots drag the color picker, only the first one sets up WiFi and changes settings
+        Bot* bot = new Bot(i, port, churn, stall, isSlow ? max(slowBps, (uint32_t)1) : 0,
+                           isSlow ? 0 : previewHz, i == 0 ? connectSeconds : 0, isSlow ? 0 : actionHz,
+                           i == 0 ? settingsSeconds : 0, fragment);
+        std::thread([bot]() { bot->run(); }).detach();
+    }
+    // getFreeHeap() keeps track of the lowest value it saw
+    std::thread([]() {
+        while (true) {
+            ESP.getFreeHeap();
+            delay(LOAD_HEAP_SAMPLE_MS);
+        }
+    }).detach();
+    if (reportSeconds > 0) {
+        std::thread([reportSeconds]() {
+            while (true) {
+                delay(reportSeconds * 1000);
+                load_report(false);
+            }
+        }).detach();
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef __NATIVE_LOAD_GENERATOR_H__
+#define __NATIVE_LOAD_GENERATOR_H__
+
+// WebSocket clients that behave like open dashboards, to load the native build the way a
+// busy site does. Each bot connects to /ws, sends what the dashboard sends when it opens and
+// on its timers, and measures how old the sensor values are when they reach it: the time from
+// the sensor task reading them (see SampleJournal in sensor_sim.h) to their first arrival.
+// Bots are plain threads, not tasks, they stand for browsers and stay out of the task profile.
+// Slow bots read at a fixed byte rate through a small receive buffer, like a phone on a weak
+// link, so frames back up on the server. A summary with latency percentiles (fast and slow bots
+// apart), the heap peak and the run time of the server's WebSocket event handler is printed every
+// NATIVE_BOT_REPORT_S and at exit. The heap is that of the whole process, the bots' latency
+// samples are kept outside of it. The handler time is what the network task is held up for on
+// the device, with NATIVE_BOT_PREVIEW_HZ and NATIVE_BOT_CONNECT_S the bots also send the actions
+// that used to run in it. Every get_history request has to be answered, the report compares the
+// two counts, which checks the reassembly of fragmented messages with NATIVE_BOT_FRAGMENT. The
+// flash writes of Preferences are reported too, per settings session with NATIVE_BOT_SETTINGS_S.
+// The time from boot until a bot first gets a DHT value that was actually read shows how long the
+// startup keeps the dashboards waiting (with NATIVE_WIFI_ASSOC_MS, NATIVE_WIFI_SCAN_MS and
+// NATIVE_SIM_DHT_WARMUP_MS for the slow parts of a real boot). The period of the light sensor
+// reads (the last 512) shows how punctually the sensor loop is scheduled under the load.
+//
+// Settings, read from the environment:
+//   NATIVE_WS_BOTS          number of bots, default 0 (off)
+//   NATIVE_BOT_PORT         port of the WebSocket server, default 8080 (NATIVE_PORT_OFFSET is added)
+//   NATIVE_BOT_CHURN        probability per second that a bot drops its connection and reconnects, default 0
+//   NATIVE_BOT_STALL        probability per second that a bot stops reading for 1 to 5 s, default 0
+//   NATIVE_BOT_SLOW         share of the bots that read slowly, default 0
+//   NATIVE_BOT_SLOW_BPS     bytes per second a slow bot reads, default 1024
+//   NATIVE_BOT_PREVIEW_HZ   color previews per second each fast bot sends, like a dragged color picker, default 0
+//   NATIVE_BOT_CONNECT_S    seconds between WiFi connects sent by the first bot, default 0 (never)
+//   NATIVE_BOT_ACTION_HZ    messages per second each fast bot sends, going through every action in
+//                           turn, the handler time is then also reported per action, default 0
+//   NATIVE_BOT_SETTINGS_S   seconds between settings sessions of the first bot, 3 s of saving the colors and
+//                           the threshold with new values every 200 ms, default 0 (never)
+//   NATIVE_BOT_FRAGMENT     largest frame payload in bytes, longer messages are sent fragmented, default 0 (never)
+//   NATIVE_CONFIG_CHANGE_S  seconds between new WiFi logins saved through Save_info_File(), the time until
+//                           the station is connected with the new login is printed, default 0 (never)
+//   NATIVE_BOT_REPORT_S     seconds between summaries, default 10, 0 for a summary at exit only
+//   NATIVE_BOT_REPORT_FILE  file the final summary is written to as JSON
+
+void load_generator_begin();
+
+#endif
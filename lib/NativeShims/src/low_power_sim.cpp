@@ -0,0 +1,211 @@
+#include "low_power_sim.h"
+#include "low_power.h"
+#include "native_board.h"
+#include "report_replay.h"
+#include "sensor_sim.h"
+
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_EPOCH_MS 1700000000000LL    // Unix time at the cold boot
+#define SIM_HOUR_MS 3600000ULL
+
+struct SimSettings {
+    float days;
+    uint32_t awakeMs;
+    uint32_t connectMs;
+    uint32_t scanMs;
+    uint32_t sendMs;
+    uint32_t timeoutMs;
+    float fail;
+    float outageHours;
+    float threshold;
+};
+
+static float sim_env_float(const char* name, const char* fallback) {
+    return (float)atof(native_env(name, fallback));
+}
+
+static SimSettings sim_settings() {
+    SimSettings settings;
+    settings.days = sim_env_float("NATIVE_LOW_POWER_DAYS", "0");
+    settings.awakeMs = strtoul(native_env("NATIVE_LOW_POWER_AWAKE_MS", "250"), nullptr, 10);
+    settings.connectMs = strtoul(native_env("NATIVE_LOW_POWER_CONNECT_MS", "1500"), nullptr, 10);
+    settings.scanMs = strtoul(native_env("NATIVE_LOW_POWER_SCAN_MS", "2500"), nullptr, 10);
+    settings.sendMs = strtoul(native_env("NATIVE_LOW_POWER_SEND_MS", "100"), nullptr, 10);
+    settings.timeoutMs = strtoul(native_env("NATIVE_LOW_POWER_TIMEOUT_MS", "10000"), nullptr, 10);
+    settings.fail = sim_env_float("NATIVE_LOW_POWER_FAIL", "0");
+    settings.outageHours = sim_env_float("NATIVE_LOW_POWER_OUTAGE_H", "0");
+    settings.threshold = sim_env_float("NATIVE_LOW_POWER_THRESHOLD", "30");
+    return settings;
+}
+
+class SimRun {
+public:
+    explicit SimRun(const SimSettings& settings)
+        : settings(settings), dht(SensorSimConfig::fromEnvironment()),
+          random(0x9E3779B9u ^ strtoul(native_env("NATIVE_SIM_SEED", "1"), nullptr, 10)) {
+        memset(&state, 0, sizeof(state));
+    }
+
+    bool run() {
+        uint64_t end = (uint64_t)(settings.days * 24 * SIM_HOUR_MS);
+        low_power_begin(state, settings.threshold);
+        ReportRule rules[HISTORY_METRIC_COUNT];
+        report_replay_rules(rules);
+        low_power_set_rules(state, rules);
+        while (state.clockMs < end) {
+            wake();
+        }
+        return report();
+    }
+
+private:
+    SimSettings settings;
+    DhtSimulator dht;
+    uint32_t random;
+    LowPowerState state;            // The RTC memory
+    bool channelCached = false;
+    int64_t lastTs = 0;
+    uint32_t batchSamples = 0;      // Of the largest batch that was written
+    size_t batchBytes = 0;
+    uint64_t delaySumS = 0;
+    uint32_t delayMaxS = 0;
+    uint32_t alertStarts = 0;
+    uint32_t alertsLate = 0;        // Alert starts without an uplink at their wake and no retry pending
+    uint32_t outOfOrder = 0;
+    uint32_t batchTooLarge = 0;     // Not even one sample fit
+
+    uint32_t nextRandom() {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random;
+    }
+
+    bool chance(float probability) {
+        return (nextRandom() >> 8) / 16777216.0f < probability;
+    }
+
+    bool accessPointUp() const {
+        uint64_t outageStart = 12 * SIM_HOUR_MS;
+        uint64_t outageEnd = outageStart + (uint64_t)(settings.outageHours * SIM_HOUR_MS);
+        return state.clockMs < outageStart || state.clockMs >= outageEnd;
+    }
+
+    void wake() {
+        uint32_t ms = (uint32_t)state.clockMs;      // The traces repeat after 49 days
+        DhtSample sample = dht.read(ms);
+        bool wasActive = state.alertActive;
+        bool due = low_power_record(state, sample.temperature, sample.humidity, sensor_sim_light_at(ms));
+        bool started = state.alertActive && !wasActive;
+        if (started) {
+            alertStarts++;
+            if (!due && state.samples[(state.head + LOW_POWER_RING_SIZE - 1) % LOW_POWER_RING_SIZE].time >= state.retryAt) {
+                alertsLate++;
+            }
+        }
+        uint32_t awake = settings.awakeMs;
+        if (due) {
+            awake += uplink(awake);
+        }
+        low_power_sleep(state, awake);
+    }
+
+    // Returns the radio time
+    uint32_t uplink(uint32_t awakeMs) {
+        if (!accessPointUp() || chance(settings.fail)) {
+            // Scans at the next uplink, like the device after a failed connect
+            channelCached = false;
+            low_power_uplink_done(state, false, settings.timeoutMs);
+            return settings.timeoutMs;
+        }
+        uint32_t radio = settings.connectMs + (channelCached ? 0 : settings.scanMs);
+        channelCached = true;
+        low_power_set_time(state, SIM_EPOCH_MS + (int64_t)state.clockMs + awakeMs + radio, awakeMs + radio);
+
+        char json[LOW_POWER_BATCH_JSON];
+        while (state.count > 0) {
+            size_t count = low_power_batch_json(state, json, sizeof(json));
+            if (count == 0) {
+                batchTooLarge++;
+                break;
+            }
+            check(json, count);
+            radio += settings.sendMs;
+            low_power_sent(state, count);
+        }
+        low_power_uplink_done(state, state.count == 0, radio);
+        return radio;
+    }
+
+    // The timestamps have to come in order and be the times of the samples
+    void check(const char* json, size_t count) {
+        size_t bytes = strlen(json);
+        if (bytes > batchBytes) {
+            batchBytes = bytes;
+            batchSamples = count;
+        }
+        DynamicJsonDocument doc(8192);
+        if (deserializeJson(doc, json) || doc.as<JsonArray>().size() != count) {
+            outOfOrder++;
+            return;
+        }
+        uint32_t nowS = state.clockMs / 1000;
+        for (JsonObject entry : doc.as<JsonArray>()) {
+            int64_t ts = entry["ts"].as<int64_t>();
+            if (ts <= lastTs || (ts - SIM_EPOCH_MS) % 1000 != 0) {
+                outOfOrder++;
+            }
+            lastTs = ts;
+            uint32_t delay = nowS - (uint32_t)((ts - SIM_EPOCH_MS) / 1000);
+            delaySumS += delay;
+            delayMaxS = std::max(delayMaxS, delay);
+        }
+    }
+
+    bool report() {
+        float days = state.clockMs / (24.0f * SIM_HOUR_MS);
+        printf("[power] %.1f days, %u wakes, %u uplinks (%u for alerts), %u failed, %u samples sent, %u dropped, "
+               "%u waiting, %u suppressed | delay mean %.0f max %.0f min | largest batch %u samples, %zu bytes\n",
+               days, state.wakes, state.uplinks, state.alertUplinks, state.uplinkFailures, state.delivered,
+               state.dropped, state.count, state.suppressed, state.delivered ? delaySumS / 60.0 / state.delivered : 0.0,
+               delayMaxS / 60.0, batchSamples, batchBytes);
+
+        LowPowerEstimate simulated;
+        low_power_estimate(state, simulated);
+        LowPowerEstimate model;
+        float sampleShare = state.wakes ? 1 - (float)state.suppressed / state.wakes : 1;
+        low_power_model(model, settings.awakeMs, settings.connectMs + settings.sendMs, sampleShare, alertStarts / days);
+        const LowPowerEstimate* estimates[] = { &simulated, &model };
+        const char* names[] = { "simulated", "model" };
+        for (int i = 0; i < 2; i++) {
+            printf("[power] %-9s awake %.3f %%, radio %.3f %% (%.0f s/day), %.3f mA, %.0f days on %.0f mAh\n", names[i],
+                   estimates[i]->awakeShare * 100, estimates[i]->radioShare * 100, estimates[i]->radioSecondsPerDay,
+                   estimates[i]->averageMa, estimates[i]->batteryDays, LOW_POWER_BATTERY_MAH);
+        }
+        printf("[power] always on %.0f mA, %.1f days on %.0f mAh\n", LOW_POWER_RADIO_MA,
+               LOW_POWER_BATTERY_MAH / LOW_POWER_RADIO_MA / 24, LOW_POWER_BATTERY_MAH);
+
+        bool accounted = state.delivered + state.dropped + state.count + state.suppressed == state.wakes;
+        bool passed = accounted && outOfOrder == 0 && alertsLate == 0 && batchTooLarge == 0;
+        printf("[power] %s: %u alert starts (%u late), %u samples out of order, %u samples too large, samples %s\n",
+               passed ? "passed" : "FAILED", alertStarts, alertsLate, outOfOrder, batchTooLarge,
+               accounted ? "accounted for" : "lost");
+        return passed;
+    }
+};
+
+bool low_power_sim_run() {
+    SimSettings settings = sim_settings();
+    if (settings.days <= 0) {
+        return false;
+    }
+    SimRun run(settings);
+    if (!run.run()) {
+        native_exit(1);
+    }
+    return true;
+}
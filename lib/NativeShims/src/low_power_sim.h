@@ -0,0 +1,32 @@
+#ifndef __NATIVE_LOW_POWER_SIM_H__
+#define __NATIVE_LOW_POWER_SIM_H__
+
+// The low-power state machine (low_power.h) on a simulated sleep/wake clock. Runs instead of the
+// firmware when NATIVE_LOW_POWER_DAYS is set: every wake takes a sample of the simulated sensors
+// (sensor_sim.h) at the simulated time and runs it through the report filter with the rules of
+// report_replay.h, the uplinks take the radio times below and fail like an unreachable access
+// point would. Days of operation take well under a second. Prints the uplinks,
+// how late the samples arrived and the energy estimate of the run next to low_power_model(), and
+// exits with 1 if a check failed:
+//   - every wake was suppressed by the filter, or its sample was sent, is still waiting or was
+//     counted as dropped
+//   - the samples were sent in order, with their own timestamps
+//   - an alert started the uplink at the wake it started in, unless a retry was pending
+//   - every sample fits into a LOW_POWER_BATCH_JSON message
+//
+// Settings, read from the environment:
+//   NATIVE_LOW_POWER_DAYS        simulated days, default 0 (off)
+//   NATIVE_LOW_POWER_AWAKE_MS    time of a wake without the radio (boot, sensor reads), default 250
+//   NATIVE_LOW_POWER_CONNECT_MS  radio time of the WiFi and MQTT connect to the cached access point, default 1500
+//   NATIVE_LOW_POWER_SCAN_MS     added when the channel is not cached (the first uplink, after a failure), default 2500
+//   NATIVE_LOW_POWER_SEND_MS     radio time per batch message, default 100
+//   NATIVE_LOW_POWER_TIMEOUT_MS  radio time of a failed uplink, default 10000
+//   NATIVE_LOW_POWER_FAIL        probability that an uplink fails, default 0
+//   NATIVE_LOW_POWER_OUTAGE_H    hours from noon of the first day without the access point, default 0
+//   NATIVE_LOW_POWER_THRESHOLD   alert threshold in °C, default 30
+// The sensor traces follow NATIVE_SIM_SEED and the other settings of sensor_sim.h.
+
+// Returns false if the simulation is not enabled, exits with 1 if a check failed
+bool low_power_sim_run();
+
+#endif
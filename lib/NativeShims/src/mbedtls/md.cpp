@@ -0,0 +1,182 @@
+#include "md.h"
+#include "md5.h"
+#include "sha256.h"
+
+#include <string.h>
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+    unsigned char size;
+};
+
+static const mbedtls_md_info_t MD5_INFO = { MBEDTLS_MD_MD5, 16 };
+static const mbedtls_md_info_t SHA256_INFO = { MBEDTLS_MD_SHA256, 32 };
+
+// FIPS 180-4
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t SHA256_INITIAL[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static uint32_t rotr(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256_transform(mbedtls_sha256_context* ctx, const unsigned char* data) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+               ((uint32_t)data[i * 4 + 2] << 8) | (uint32_t)data[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t v[8];
+    memcpy(v, ctx->state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+        uint32_t choice = (v[4] & v[5]) ^ (~v[4] & v[6]);
+        uint32_t t1 = v[7] + s1 + choice + SHA256_K[i] + w[i];
+        uint32_t s0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+        uint32_t majority = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + s0 + majority;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] += v[i];
+    }
+}
+
+static void sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+    size_t used = ctx->total[0] % 64;
+    uint64_t total = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) + ilen;
+    ctx->total[0] = (uint32_t)total;
+    ctx->total[1] = (uint32_t)(total >> 32);
+    while (ilen > 0) {
+        size_t n = ilen < 64 - used ? ilen : 64 - used;
+        memcpy(ctx->buffer + used, input, n);
+        used += n;
+        input += n;
+        ilen -= n;
+        if (used == 64) {
+            sha256_transform(ctx, ctx->buffer);
+            used = 0;
+        }
+    }
+}
+
+static void sha256_finish(mbedtls_sha256_context* ctx, unsigned char* output) {
+    uint64_t bits = ((uint64_t)ctx->total[1] << 32 | ctx->total[0]) * 8;
+    unsigned char padding[72] = { 0x80 };
+    size_t used = ctx->total[0] % 64;
+    sha256_update(ctx, padding, used < 56 ? 56 - used : 120 - used);
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) {
+        length[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, length, sizeof(length));
+    for (int i = 0; i < 32; i++) {
+        output[i] = (unsigned char)(ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type) {
+    switch (md_type) {
+        case MBEDTLS_MD_MD5:
+            return &MD5_INFO;
+        case MBEDTLS_MD_SHA256:
+            return &SHA256_INFO;
+        default:
+            return nullptr;
+    }
+}
+
+void mbedtls_md_init(mbedtls_md_context_t* ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t* ctx) {
+    if (ctx == nullptr || ctx->md_info == nullptr) {
+        return;
+    }
+    if (ctx->md_info->type == MBEDTLS_MD_MD5) {
+        delete static_cast<mbedtls_md5_context*>(ctx->md_ctx);
+    } else {
+        delete static_cast<mbedtls_sha256_context*>(ctx->md_ctx);
+    }
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* md_info, int hmac) {
+    if (ctx == nullptr || md_info == nullptr || hmac != 0) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    ctx->md_info = md_info;
+    if (md_info->type == MBEDTLS_MD_MD5) {
+        ctx->md_ctx = new mbedtls_md5_context();
+    } else {
+        ctx->md_ctx = new mbedtls_sha256_context();
+    }
+    return 0;
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t* ctx) {
+    if (ctx == nullptr || ctx->md_info == nullptr) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    if (ctx->md_info->type == MBEDTLS_MD_MD5) {
+        static_cast<mbedtls_md5_context*>(ctx->md_ctx)->begin();
+    } else {
+        mbedtls_sha256_context* sha = static_cast<mbedtls_sha256_context*>(ctx->md_ctx);
+        memset(sha, 0, sizeof(*sha));
+        memcpy(sha->state, SHA256_INITIAL, sizeof(SHA256_INITIAL));
+    }
+    return 0;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t ilen) {
+    if (ctx == nullptr || ctx->md_info == nullptr) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    if (ctx->md_info->type == MBEDTLS_MD_MD5) {
+        static_cast<mbedtls_md5_context*>(ctx->md_ctx)->add(input, ilen);
+    } else {
+        sha256_update(static_cast<mbedtls_sha256_context*>(ctx->md_ctx), input, ilen);
+    }
+    return 0;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output) {
+    if (ctx == nullptr || ctx->md_info == nullptr) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    if (ctx->md_info->type == MBEDTLS_MD_MD5) {
+        mbedtls_md5_context* md5 = static_cast<mbedtls_md5_context*>(ctx->md_ctx);
+        md5->calculate();
+        md5->getBytes(output);
+    } else {
+        sha256_finish(static_cast<mbedtls_sha256_context*>(ctx->md_ctx), output);
+    }
+    return 0;
+}
+
+unsigned char mbedtls_md_get_size(const mbedtls_md_info_t* md_info) {
+    return md_info ? md_info->size : 0;
+}
+
+mbedtls_md_type_t mbedtls_md_get_type(const mbedtls_md_info_t* md_info) {
+    return md_info ? md_info->type : MBEDTLS_MD_NONE;
+}
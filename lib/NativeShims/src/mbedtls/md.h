@@ -0,0 +1,47 @@
+#ifndef __NATIVE_MBEDTLS_MD_H__
+#define __NATIVE_MBEDTLS_MD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The generic message digest API of mbedtls 2.x (the version of the Arduino-ESP32 2.x core), for
+// the ThingsBoard OTA hash on the host. Only MD5 and SHA-256 are implemented, in software,
+// mbedtls_md_info_from_type() returns NULL for every other type like a build without them.
+
+#define MBEDTLS_VERSION_MAJOR 2
+#define MBEDTLS_MD_MAX_SIZE 64
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+#define MBEDTLS_ERR_MD_ALLOC_FAILED -0x5180
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_MD2,
+    MBEDTLS_MD_MD4,
+    MBEDTLS_MD_MD5,
+    MBEDTLS_MD_SHA1,
+    MBEDTLS_MD_SHA224,
+    MBEDTLS_MD_SHA256,
+    MBEDTLS_MD_SHA384,
+    MBEDTLS_MD_SHA512,
+    MBEDTLS_MD_RIPEMD160,
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+typedef struct {
+    const mbedtls_md_info_t* md_info;
+    void* md_ctx;
+    void* hmac_ctx;
+} mbedtls_md_context_t;
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+void mbedtls_md_init(mbedtls_md_context_t* ctx);
+void mbedtls_md_free(mbedtls_md_context_t* ctx);
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* md_info, int hmac);
+int mbedtls_md_starts(mbedtls_md_context_t* ctx);
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output);
+unsigned char mbedtls_md_get_size(const mbedtls_md_info_t* md_info);
+mbedtls_md_type_t mbedtls_md_get_type(const mbedtls_md_info_t* md_info);
+
+#endif
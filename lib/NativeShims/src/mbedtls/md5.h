@@ -0,0 +1,9 @@
+#ifndef __NATIVE_MBEDTLS_MD5_H__
+#define __NATIVE_MBEDTLS_MD5_H__
+
+#include "../MD5Builder.h"
+
+// Through mbedtls_md_*() (md.h) only, the transform is the one of MD5Builder
+typedef MD5Builder mbedtls_md5_context;
+
+#endif
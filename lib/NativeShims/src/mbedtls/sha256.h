@@ -0,0 +1,14 @@
+#ifndef __NATIVE_MBEDTLS_SHA256_H__
+#define __NATIVE_MBEDTLS_SHA256_H__
+
+#include <stdint.h>
+
+// Through mbedtls_md_*() (md.h) only, SHA-224 is not implemented
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[8];
+    unsigned char buffer[64];
+    int is224;
+} mbedtls_sha256_context;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __NATIVE_MBEDTLS_SHA512_H__
+#define __NATIVE_MBEDTLS_SHA512_H__
+
+#include <stdint.h>
+
+// SHA-384 and SHA-512 are not implemented, the context only exists for code that sizes buffers
+typedef struct {
+    uint64_t total[2];
+    uint64_t state[8];
+    unsigned char buffer[128];
+    int is384;
+} mbedtls_sha512_context;
+
+#endif
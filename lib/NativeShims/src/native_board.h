@@ -0,0 +1,43 @@
+#ifndef __NATIVE_BOARD_H__
+#define __NATIVE_BOARD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Process level settings of the native environment, read from the environment at startup:
+//   NATIVE_RUN_SECONDS   exit with status 0 after this many seconds (for CI), default: run forever
+//   NATIVE_PORT_OFFSET   added to every port the web servers listen on, default 0
+//   NATIVE_FS_ROOT       directory that backs LittleFS, default: the data directory of the build
+//   NATIVE_NVS_DIR       directory that backs Preferences, default .native_nvs
+//   NATIVE_WIFI_FAIL     set to make every station connection fail
+//   NATIVE_WIFI_ASSOC_MS milliseconds a station connection takes, default 0
+//   NATIVE_WIFI_FLAKY    mean seconds between drops of the station connection, default 0 (never)
+// The sensor simulation, the load generator, the queue benchmark, the heap soak check, the
+// low-power simulation and the report replay have their own settings, see sensor_sim.h,
+// load_generator.h, queue_bench.h, heap_soak.h, low_power_sim.h and report_replay.h
+
+void native_init(int argc, char** argv);
+// Runs the exit hooks (in reverse order) and ends the process, also used on SIGINT/SIGTERM
+// and when NATIVE_RUN_SECONDS is over
+void native_exit(int status);
+void native_on_exit(void (*hook)());
+// Runs the handlers of esp_register_shutdown_handler() once, before a restart and in native_exit()
+void native_run_shutdown_handlers();
+char** native_argv();
+size_t native_heap_baseline();
+// Free chunks between allocated ones before main(), not counted as fragmentation
+size_t native_heap_holes_baseline();
+uint16_t native_port(uint16_t port);
+// Virtual clock of the host tests: once set, millis(), micros() and esp_timer_get_time() return
+// it and delay() advances it instead of sleeping. Only for tests that do not start the tasks.
+void native_clock_set_us(uint64_t us);
+void native_clock_advance_us(uint64_t us);
+// Microseconds since boot on the virtual clock if it is set, on the real one otherwise
+uint64_t native_clock_us();
+const char* native_env(const char* name, const char* fallback);
+
+// Simulated pins, the light sensor is read through analogRead()
+uint16_t native_sim_analog_read(uint8_t pin);
+int native_sim_digital_read(uint8_t pin, int written);
+
+#endif
@@ -0,0 +1,129 @@
+#include "Arduino.h"
+#include "load_generator.h"
+#include "native_board.h"
+#include "queue_bench.h"
+#include "heap_soak.h"
+#include "low_power_sim.h"
+#include "report_replay.h"
+
+#include <malloc.h>
+#include <signal.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static char** nativeArgv;
+static size_t heapBaseline;
+static size_t heapHolesBaseline;
+static std::vector<void (*)()> exitHooks;
+static std::mutex exitMutex;
+
+char** native_argv() {
+    return nativeArgv;
+}
+
+size_t native_heap_baseline() {
+    return heapBaseline;
+}
+
+size_t native_heap_holes_baseline() {
+    return heapHolesBaseline;
+}
+
+const char* native_env(const char* name, const char* fallback) {
+    const char* value = getenv(name);
+    return value && *value ? value : fallback;
+}
+
+uint16_t native_port(uint16_t port) {
+    return port + atoi(native_env("NATIVE_PORT_OFFSET", "0"));
+}
+
+void native_on_exit(void (*hook)()) {
+    std::lock_guard<std::mutex> lock(exitMutex);
+    exitHooks.push_back(hook);
+}
+
+void native_exit(int status) {
+    // Task threads keep running, so no static destructors (no exit()), only the hooks. The
+    // shutdown handlers come first, the exit hooks report what they did.
+    native_run_shutdown_handlers();
+    exitMutex.lock();
+    for (auto hook = exitHooks.rbegin(); hook != exitHooks.rend(); ++hook) {
+        (*hook)();
+    }
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+
+void native_init(int argc, char** argv) {
+    (void)argc;
+    nativeArgv = argv;
+    // Chunks parked in the per-thread caches of glibc count as used in mallinfo2(), the caches
+    // fill up over minutes and looked like a leak to the heap soak. They can only be turned off
+    // before the process starts, so it starts again once with the tunable set.
+    const char* tunables = getenv("GLIBC_TUNABLES");
+    if (tunables == nullptr || strstr(tunables, "tcache_count") == nullptr) {
+        std::string value = tunables && *tunables ? std::string(tunables) + ":" : std::string();
+        value += "glibc.malloc.tcache_count=0";
+        setenv("GLIBC_TUNABLES", value.c_str(), 1);
+        char path[512];
+        ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (len > 0) {
+            path[len] = '\0';
+            execv(path, argv);
+        }
+    }
+    // One heap for all threads like on the device, the per-thread arenas of glibc would hide
+    // the fragmentation from mallinfo2()
+    mallopt(M_ARENA_MAX, 1);
+    struct mallinfo2 info = mallinfo2();
+    heapBaseline = info.uordblks;
+    heapHolesBaseline = info.fordblks > info.keepcost ? info.fordblks - info.keepcost : 0;
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    // Blocked before any task thread exists, so only the watcher below receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread([signals]() {
+        int signal;
+        sigwait(&signals, &signal);
+        native_exit(128 + signal);
+    }).detach();
+
+    int runSeconds = atoi(native_env("NATIVE_RUN_SECONDS", "0"));
+    if (runSeconds > 0) {
+        std::thread([runSeconds]() {
+            std::this_thread::sleep_for(std::chrono::seconds(runSeconds));
+            native_exit(0);
+        }).detach();
+    }
+}
+
+// Same flow as the Arduino core: setup() once, then loop() forever in the loop task. The unit
+// tests (pio test -e native) bring their own main() and call setup() themselves if they need it.
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv) {
+    native_init(argc, argv);
+    if (queue_bench_run() || low_power_sim_run() || report_replay_run()) {
+        native_exit(0);
+    }
+    native_task_adopt_main("loopTask", 8192, 1);
+    setup();
+    load_generator_begin();
+    heap_soak_begin();
+    while (true) {
+        loop();
+        yield();
+    }
+    return 0;
+}
+#endif
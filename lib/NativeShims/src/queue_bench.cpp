@@ -0,0 +1,154 @@
+#include "queue_bench.h"
+#include "native_board.h"
+#include "spsc_ring.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#define BENCH_DEPTH 16      // Same depth as the sensor channel
+
+// As large as a SensorSample
+struct BenchItem {
+    uint64_t sentNs;
+    uint32_t sequence;
+    uint32_t pad;
+};
+
+static uint64_t bench_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Sleeps, a spinning producer would take the CPU from the consumer on a single core host
+static void bench_wait_until(uint64_t ns) {
+    uint64_t now = bench_now();
+    if (ns > now) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(ns - now));
+    }
+}
+
+class RingTransport {
+public:
+    void send(const BenchItem& item) {
+        while (!ring.push(item)) {
+            sched_yield();
+        }
+    }
+    void receive(BenchItem& item) {
+        while (!ring.pop(item)) {
+            sched_yield();
+        }
+    }
+
+private:
+    SpscRing<BenchItem, BENCH_DEPTH> ring;
+};
+
+class QueueTransport {
+public:
+    QueueTransport() : queue(xQueueCreate(BENCH_DEPTH, sizeof(BenchItem))) {}
+    ~QueueTransport() { vQueueDelete(queue); }
+    void send(const BenchItem& item) { xQueueSend(queue, &item, portMAX_DELAY); }
+    void receive(BenchItem& item) { xQueueReceive(queue, &item, portMAX_DELAY); }
+
+private:
+    QueueHandle_t queue;
+};
+
+// paceNs 0 sends flat out, the latencies are then only the queueing delay
+template <typename Transport>
+static bool bench_pass(uint32_t items, uint64_t paceNs, double& seconds, std::vector<uint32_t>& latencies) {
+    Transport transport;
+    latencies.assign(items, 0);
+    bool ordered = true;
+    uint64_t start = bench_now();
+    std::thread consumer([&]() {
+        for (uint32_t i = 0; i < items; i++) {
+            BenchItem item;
+            transport.receive(item);
+            uint64_t now = bench_now();
+            ordered = ordered && item.sequence == i;
+            latencies[i] = (uint32_t)std::min<uint64_t>(now - item.sentNs, UINT32_MAX);
+        }
+    });
+    uint64_t next = start;
+    for (uint32_t i = 0; i < items; i++) {
+        if (paceNs) {
+            next += paceNs;
+            bench_wait_until(next);
+        }
+        BenchItem item = { bench_now(), i, 0 };
+        transport.send(item);
+    }
+    consumer.join();
+    seconds = (bench_now() - start) / 1e9;
+    return ordered;
+}
+
+template <typename Transport>
+static QueueBenchResult bench(uint32_t items, uint64_t paceNs) {
+    QueueBenchResult result;
+    double seconds;
+    std::vector<uint32_t> latencies;
+    result.ordered = bench_pass<Transport>(items, 0, seconds, latencies);
+    result.itemsPerSecond = items / seconds;
+    // Far fewer paced items, each one takes paceNs
+    uint32_t paced = std::max<uint32_t>(1, std::min<uint32_t>(items, (uint32_t)(2e9 / paceNs)));
+    result.ordered = bench_pass<Transport>(paced, paceNs, seconds, latencies) && result.ordered;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = latencies[latencies.size() / 2] / 1000.0;
+    result.p99 = latencies[(size_t)(latencies.size() * 0.99)] / 1000.0;
+    result.max = latencies.back() / 1000.0;
+    return result;
+}
+
+QueueBenchResult queue_bench(QueueBenchTransport transport, uint32_t items, uint64_t paceNs) {
+    return transport == QUEUE_BENCH_SPSC_RING ? bench<RingTransport>(items, paceNs) : bench<QueueTransport>(items, paceNs);
+}
+
+static void bench_print(const char* name, const QueueBenchResult& result) {
+    fprintf(stderr, "[bench] %-10s %8.2f M items/s | latency p50=%.2f p99=%.2f max=%.1f us%s\n", name,
+            result.itemsPerSecond / 1e6, result.p50, result.p99, result.max, result.ordered ? "" : " | OUT OF ORDER");
+}
+
+bool queue_bench_run() {
+    uint32_t items = (uint32_t)atol(native_env("NATIVE_BENCH_QUEUES", "0"));
+    if (items == 0) {
+        return false;
+    }
+    uint64_t paceNs = (uint64_t)atol(native_env("NATIVE_BENCH_PACE_US", "20")) * 1000;
+    if (paceNs == 0) {
+        paceNs = 1000;
+    }
+    int load = atoi(native_env("NATIVE_BENCH_LOAD", "0"));
+
+    std::atomic<bool> running(true);
+    std::vector<std::thread> busy;
+    for (int i = 0; i < load; i++) {
+        busy.emplace_back([&running]() {
+            volatile uint64_t spins = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                spins = spins + 1;
+            }
+        });
+    }
+
+    fprintf(stderr, "[bench] %u items, depth %d, %d busy threads, %u CPUs\n", items, BENCH_DEPTH, load,
+            std::thread::hardware_concurrency());
+    bench_print("SpscRing", queue_bench(QUEUE_BENCH_SPSC_RING, items, paceNs));
+    bench_print("xQueue", queue_bench(QUEUE_BENCH_XQUEUE, items, paceNs));
+
+    running = false;
+    for (std::thread& thread : busy) {
+        thread.join();
+    }
+    return true;
+}
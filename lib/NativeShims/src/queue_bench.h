@@ -0,0 +1,38 @@
+#ifndef __NATIVE_QUEUE_BENCH_H__
+#define __NATIVE_QUEUE_BENCH_H__
+
+// Throughput and latency of the cross-core hand-over, SpscRing (spsc_ring.h) against the FreeRTOS
+// queue it replaces for the sensor readings, with one producer and one consumer thread. Runs
+// instead of the firmware when NATIVE_BENCH_QUEUES is set and prints one line per queue:
+//   throughput  items per second with the producer sending as fast as the queue takes them
+//   latency     time from the send to the receive, with one item every NATIVE_BENCH_PACE_US
+// The SpscRing consumer polls and yields when the ring is empty, the queue consumer blocks in
+// xQueueReceive like a task would. NATIVE_BENCH_LOAD busy threads compete for the CPUs, for the
+// contention of a loaded system.
+//
+// Settings, read from the environment:
+//   NATIVE_BENCH_QUEUES     items per run, default 0 (off)
+//   NATIVE_BENCH_PACE_US    microseconds between the items of the latency run, default 20
+//   NATIVE_BENCH_LOAD       busy threads running during both runs, default 0
+
+#include <stdint.h>
+
+enum QueueBenchTransport {
+    QUEUE_BENCH_SPSC_RING,
+    QUEUE_BENCH_XQUEUE
+};
+
+struct QueueBenchResult {
+    double itemsPerSecond;
+    double p50, p99, max;   // Microseconds
+    bool ordered;           // Every item arrived, in the order it was sent
+};
+
+// One throughput run of items and one latency run with an item every paceNs, also used by the
+// host test of the ring (test/test_spsc_ring)
+QueueBenchResult queue_bench(QueueBenchTransport transport, uint32_t items, uint64_t paceNs);
+
+// Returns false if the benchmark is not enabled
+bool queue_bench_run();
+
+#endif
@@ -0,0 +1,219 @@
+#include "report_replay.h"
+#include "native_board.h"
+#include "sensor_sim.h"
+#include "task_read_dht11.h"
+#include "task_light_sensor.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#define REPLAY_HOUR_MS 3600000.0
+
+struct ReplayMetric {
+    ReportRule rule;
+    ReportTrack track;
+    uint32_t readings = 0;
+    uint32_t reports = 0;
+    bool held = false;          // The receiver has a value
+    float heldValue = 0;
+    double squaredError = 0;
+    float maxError = 0;
+};
+
+static const char* const RULE_SETTINGS[HISTORY_METRIC_COUNT] = {
+    "NATIVE_REPORT_TEMPERATURE",
+    "NATIVE_REPORT_HUMIDITY",
+    "NATIVE_REPORT_LIGHT",
+};
+
+void report_replay_rules(ReportRule* rules) {
+    report_policy_defaults(rules);
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        const char* text = native_env(RULE_SETTINGS[i], nullptr);
+        if (text == nullptr) {
+            continue;
+        }
+        ReportRule rule = rules[i];
+        unsigned silence = rule.maxSilenceS;
+        unsigned window = rule.windowS;
+        int fields = sscanf(text, "%f,%u,%u", &rule.deadBand, &silence, &window);
+        rule.maxSilenceS = silence;
+        rule.windowS = window;
+        if (fields < 1 || !report_rule_valid(rule)) {
+            fprintf(stderr, "[report] %s=%s is no valid rule, kept the default\n", RULE_SETTINGS[i], text);
+            continue;
+        }
+        rules[i] = rule;
+    }
+}
+
+// Readings in the order the sensor jobs take them, failed DHT11 reads are left out like the jobs do
+std::vector<ReportReplayReading> report_replay_simulate(float hours) {
+    std::vector<ReportReplayReading> trace;
+    DhtSimulator dht(SensorSimConfig::fromEnvironment());
+    uint32_t end = (uint32_t)(hours * REPLAY_HOUR_MS);
+    uint32_t nextDht = 0;
+    uint32_t nextLight = 0;
+    while (nextDht < end || nextLight < end) {
+        if (nextDht <= nextLight) {
+            DhtSample sample = dht.read(nextDht);
+            if (!isnan(sample.temperature) && !isnan(sample.humidity)) {
+                trace.push_back({ nextDht, HISTORY_TEMPERATURE, sample.temperature });
+                trace.push_back({ nextDht, HISTORY_HUMIDITY, sample.humidity });
+            }
+            nextDht += DHT_READ_INTERVAL_MS;
+        } else {
+            trace.push_back({ nextLight, HISTORY_LIGHT, (float)sensor_sim_light_at(nextLight) });
+            nextLight += LIGHT_READ_INTERVAL_MS;
+        }
+    }
+    return trace;
+}
+
+static bool replay_load(const char* path, std::vector<ReportReplayReading>& trace) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "[report] cannot open %s\n", path);
+        return false;
+    }
+    char line[128];
+    unsigned lineNumber = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        unsigned ms;
+        char name[32];
+        float value;
+        HistoryMetric metric;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%u,%31[^,],%f", &ms, name, &value) != 3 || !history_parse_metric(name, metric) ||
+            (!trace.empty() && ms < trace.back().ms)) {
+            fprintf(stderr, "[report] %s:%u: expected \"ms,metric,value\" in time order\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+        trace.push_back({ ms, metric, value });
+    }
+    fclose(file);
+    return true;
+}
+
+static void replay_record(const char* path, const std::vector<ReportReplayReading>& trace) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "[report] cannot write %s\n", path);
+        return;
+    }
+    fprintf(file, "# ms,metric,value\n");
+    for (const ReportReplayReading& reading : trace) {
+        fprintf(file, "%u,%s,%g\n", reading.ms, history_metric_name(reading.metric), reading.value);
+    }
+    fclose(file);
+}
+
+ReportReplayResult report_replay(const std::vector<ReportReplayReading>& trace, const ReportRule* rules) {
+    ReplayMetric metrics[HISTORY_METRIC_COUNT];
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        metrics[i].rule = rules[i];
+        memset(&metrics[i].track, 0, sizeof(metrics[i].track));
+    }
+
+    uint32_t messages = 0;
+    uint32_t reportMessages = 0;
+    bool messageReported = false;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const ReportReplayReading& reading = trace[i];
+        ReplayMetric& metric = metrics[reading.metric];
+        // A message per reading time, it is sent if any reading of that time was reported
+        if (i == 0 || trace[i - 1].ms != reading.ms) {
+            messageReported = false;
+        }
+        metric.readings++;
+        Report report;
+        if (report_track(metric.track, metric.rule, reading.value, reading.ms, report)) {
+            metric.reports++;
+            metric.held = true;
+            metric.heldValue = report.mean;
+            messageReported = true;
+        }
+        if (metric.held) {
+            float error = fabsf(reading.value - metric.heldValue);
+            metric.squaredError += (double)error * error;
+            metric.maxError = std::max(metric.maxError, error);
+        }
+        if (i + 1 == trace.size() || trace[i + 1].ms != reading.ms) {
+            messages++;
+            reportMessages += messageReported;
+        }
+    }
+
+    ReportReplayResult result;
+    memset(&result, 0, sizeof(result));
+    result.messages = messages;
+    result.reportMessages = reportMessages;
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        const ReplayMetric& metric = metrics[i];
+        ReportReplayMetric& out = result.metrics[i];
+        out.readings = metric.readings;
+        out.reports = metric.reports;
+        out.rmsError = metric.readings ? (float)sqrt(metric.squaredError / metric.readings) : 0;
+        out.maxError = metric.maxError;
+        out.bounded = metric.rule.windowS > 0 || metric.maxError < metric.rule.deadBand || metric.rule.deadBand == 0;
+    }
+    return result;
+}
+
+bool report_replay_run() {
+    const char* source = native_env("NATIVE_REPORT_REPLAY", nullptr);
+    if (source == nullptr) {
+        return false;
+    }
+    std::vector<ReportReplayReading> trace;
+    std::string description;
+    if (strcmp(source, "sim") == 0) {
+        float hours = (float)atof(native_env("NATIVE_REPORT_HOURS", "24"));
+        trace = report_replay_simulate(hours);
+        description = "simulated trace";
+        const char* record = native_env("NATIVE_REPORT_RECORD", nullptr);
+        if (record) {
+            replay_record(record, trace);
+        }
+    } else if (replay_load(source, trace)) {
+        description = source;
+    } else {
+        native_exit(1);
+    }
+
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    report_replay_rules(rules);
+    ReportReplayResult result = report_replay(trace, rules);
+
+    float hours = trace.empty() ? 0 : trace.back().ms / REPLAY_HOUR_MS;
+    printf("[report] %s, %.1f h, %zu readings in %u messages\n", description.c_str(), hours, trace.size(), result.messages);
+    bool passed = true;
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        const ReportReplayMetric& metric = result.metrics[i];
+        if (metric.readings == 0) {
+            continue;
+        }
+        passed = passed && metric.bounded;
+        printf("[report] %-11s dead band %g, max silence %u s, window %u s: %u readings, %u reports (%.2f %%), "
+               "error rms %.3f max %.3f%s\n",
+               history_metric_name((HistoryMetric)i), rules[i].deadBand, rules[i].maxSilenceS, rules[i].windowS,
+               metric.readings, metric.reports, 100.0 * metric.reports / metric.readings, metric.rmsError,
+               metric.maxError, metric.bounded ? "" : " OVER THE DEAD BAND");
+    }
+    printf("[report] %s: %u messages -> %u, %.1f times fewer (%.1f %% saved)\n", passed ? "passed" : "FAILED",
+           result.messages, result.reportMessages,
+           result.reportMessages ? (double)result.messages / result.reportMessages : 0.0,
+           result.messages ? 100.0 * (result.messages - result.reportMessages) / result.messages : 0.0);
+    if (!passed) {
+        native_exit(1);
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef __NATIVE_REPORT_REPLAY_H__
+#define __NATIVE_REPORT_REPLAY_H__
+
+#include "report_policy.h"
+
+// Replay benchmark of the report filter (report_policy.h). Runs instead of the firmware when
+// NATIVE_REPORT_REPLAY is set: every reading of a trace goes through report_track() with the rules
+// below, and a receiver rebuilds the series by holding each reported mean until the next report.
+// Prints per metric how many readings became reports and how far the rebuilt series is from the
+// readings (RMS and largest error), and how many uplink messages are left, readings taken at the
+// same millisecond (both values of a DHT11 read) going in one message. Exits with 1 if a metric
+// without a window was rebuilt a dead band or more off, which the filter must never let happen.
+//
+// Settings, read from the environment:
+//   NATIVE_REPORT_REPLAY       "sim" for a trace of the simulated sensors (sensor_sim.h) read at the
+//                              intervals of the sensor jobs, or a file of "ms,metric,value" lines
+//                              as written by NATIVE_REPORT_RECORD, default off
+//   NATIVE_REPORT_HOURS        length of the simulated trace, default 24
+//   NATIVE_REPORT_RECORD       file the simulated trace is written to, to replay it with other rules
+//   NATIVE_REPORT_TEMPERATURE  rule of a metric as "dead_band,max_silence,window", e.g. "0.5,900,0",
+//   NATIVE_REPORT_HUMIDITY     default the rule of report_policy_defaults(). The low-power
+//   NATIVE_REPORT_LIGHT        simulation (low_power_sim.h) runs with these rules too.
+
+#include <vector>
+
+struct ReportReplayReading {
+    uint32_t ms;
+    HistoryMetric metric;
+    float value;
+};
+
+struct ReportReplayMetric {
+    uint32_t readings;
+    uint32_t reports;
+    float rmsError;             // Of the rebuilt series against the readings
+    float maxError;
+    bool bounded;               // No window, or every error below the dead band
+};
+
+struct ReportReplayResult {
+    ReportReplayMetric metrics[HISTORY_METRIC_COUNT];
+    uint32_t messages;          // Readings grouped by their millisecond
+    uint32_t reportMessages;    // Of these, messages with a report
+};
+
+// A trace of the simulated sensors at the intervals of the sensor jobs
+std::vector<ReportReplayReading> report_replay_simulate(float hours);
+// Replays trace with rules (HISTORY_METRIC_COUNT entries), also used by the host test of the
+// filter (test/test_report_policy)
+ReportReplayResult report_replay(const std::vector<ReportReplayReading>& trace, const ReportRule* rules);
+
+// Returns false if the replay is not enabled, exits with 1 if the check failed
+bool report_replay_run();
+// The rules of the settings above, HISTORY_METRIC_COUNT entries
+void report_replay_rules(ReportRule* rules);
+
+#endif
@@ -0,0 +1,234 @@
+#include "Arduino.h"
+#include "native_board.h"
+#include "sensor_sim.h"
+
+#include <math.h>
+
+#define SIM_LIGHT_PIN 1
+#define SIM_BOOT_PIN 0
+// Spikes are placed at most one per slot of simulated time
+#define SIM_SPIKE_SLOT_S 600.0f
+// Period of the slow drift, in simulated seconds
+#define SIM_DRIFT_PERIOD_S 900.0f
+// Channel numbers, they only decorrelate the random parts
+#define SIM_CHANNEL_TEMPERATURE 1
+#define SIM_CHANNEL_HUMIDITY 2
+#define SIM_CHANNEL_LIGHT 3
+#define SIM_CHANNEL_DROPOUT 4
+
+static const TraceShape TEMPERATURE_SHAPE = {
+    26.0f, 4.0f, 15.0f, false,   // Warmest in the afternoon
+    0.15f, 0.8f,
+    5.0f, 90.0f,                 // Sun on the enclosure, a hand on the sensor
+    -10.0f, 60.0f, 0.1f          // DHT11 resolution
+};
+
+static const TraceShape HUMIDITY_SHAPE = {
+    65.0f, 12.0f, 5.0f, false,   // Most humid at dawn, the opposite of the temperature
+    0.6f, 3.0f,
+    15.0f, 60.0f,                // Breath, showers
+    5.0f, 99.0f, 1.0f
+};
+
+static const TraceShape LIGHT_SHAPE = {
+    120.0f, 3000.0f, 12.0f, true,   // Indoor lighting at night, daylight between 6 and 18
+    25.0f, 300.0f,
+    -2500.0f, 20.0f,                // Shadows of people walking by
+    0.0f, 4095.0f, 1.0f             // 12 bit ADC
+};
+
+static uint32_t sim_hash(uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t x = a * 0x9E3779B9u ^ (b + 0x7F4A7C15u) * 0x85EBCA6Bu ^ (c + 0x165667B1u) * 0xC2B2AE35u;
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Uniform in [0, 1)
+static float sim_uniform(uint32_t hash) {
+    return (hash >> 8) / 16777216.0f;
+}
+
+// Approximately normal with standard deviation 1
+static float sim_gaussian(uint32_t seed, uint32_t channel, uint32_t index) {
+    float sum = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        sum += sim_uniform(sim_hash(seed, channel * 8 + i, index));
+    }
+    return (sum - 2.0f) * 1.7320508f;
+}
+
+static float sim_env_float(const char* name, float fallback) {
+    const char* value = native_env(name, nullptr);
+    return value ? (float)atof(value) : fallback;
+}
+
+SensorSimConfig SensorSimConfig::fromEnvironment() {
+    SensorSimConfig config;
+    config.seed = strtoul(native_env("NATIVE_SIM_SEED", "1"), nullptr, 10);
+    config.daySeconds = sim_env_float("NATIVE_SIM_DAY_SECONDS", 86400.0f);
+    config.startHour = sim_env_float("NATIVE_SIM_START_HOUR", 8.0f);
+    config.dropout = sim_env_float("NATIVE_SIM_DROPOUT", 0.02f);
+    config.spikesPerHour = sim_env_float("NATIVE_SIM_SPIKES", 0.5f);
+    if (config.daySeconds <= 0) {
+        config.daySeconds = 86400.0f;
+    }
+    return config;
+}
+
+SensorTrace::SensorTrace(const TraceShape& shape, const SensorSimConfig& config, uint32_t channel)
+    : shape(shape), config(config), channel(channel) {
+}
+
+float SensorTrace::hourOfDay(uint32_t ms) const {
+    float simSeconds = ms / 1000.0f * (86400.0f / config.daySeconds);
+    return fmodf(config.startHour + simSeconds / 3600.0f, 24.0f);
+}
+
+float SensorTrace::spikes(float simSeconds) const {
+    float probability = config.spikesPerHour * SIM_SPIKE_SLOT_S / 3600.0f;
+    int32_t slot = (int32_t)(simSeconds / SIM_SPIKE_SLOT_S);
+    float sum = 0;
+    // A spike may still be decaying from the previous slot
+    for (int32_t k = slot - 1; k <= slot; k++) {
+        if (k < 0 || sim_uniform(sim_hash(config.seed, channel * 16 + 1, k)) >= probability) {
+            continue;
+        }
+        float start = (k + sim_uniform(sim_hash(config.seed, channel * 16 + 2, k))) * SIM_SPIKE_SLOT_S;
+        if (simSeconds >= start) {
+            float height = shape.spikeHeight * (0.5f + sim_uniform(sim_hash(config.seed, channel * 16 + 3, k)));
+            sum += height * expf(-(simSeconds - start) / shape.spikeDecay);
+        }
+    }
+    return sum;
+}
+
+float SensorTrace::value(uint32_t ms) const {
+    float simSeconds = ms / 1000.0f * (86400.0f / config.daySeconds);
+    float hour = hourOfDay(ms);
+
+    float daily;
+    if (shape.daylight) {
+        daily = hour >= 6.0f && hour <= 18.0f ? sinf(PI * (hour - 6.0f) / 12.0f) : 0.0f;
+    } else {
+        daily = cosf(2 * PI * (hour - shape.peakHour) / 24.0f);
+    }
+
+    // Smoothly interpolated random values for the drift
+    float knot = simSeconds / SIM_DRIFT_PERIOD_S;
+    uint32_t k = (uint32_t)knot;
+    float f = (1.0f - cosf(PI * (knot - k))) / 2.0f;
+    float d0 = sim_uniform(sim_hash(config.seed, channel * 16 + 4, k)) * 2.0f - 1.0f;
+    float d1 = sim_uniform(sim_hash(config.seed, channel * 16 + 4, k + 1)) * 2.0f - 1.0f;
+    float drift = shape.drift * (d0 + (d1 - d0) * f);
+    // A new noise value every 100 ms of real time
+    float noise = shape.noise * sim_gaussian(config.seed, channel, ms / 100);
+
+    float value = shape.mean + shape.amplitude * daily + drift + noise + spikes(simSeconds);
+    if (value < shape.minimum) value = shape.minimum;
+    if (value > shape.maximum) value = shape.maximum;
+    if (shape.resolution > 0) {
+        value = roundf(value / shape.resolution) * shape.resolution;
+    }
+    return value;
+}
+
+DhtSimulator::DhtSimulator(const SensorSimConfig& config)
+    : config(config), temperature(TEMPERATURE_SHAPE, config, SIM_CHANNEL_TEMPERATURE),
+      humidity(HUMIDITY_SHAPE, config, SIM_CHANNEL_HUMIDITY), reads(0), failing(false) {
+}
+
+DhtSample DhtSimulator::read(uint32_t ms) {
+    // Half of the failures continue with the next read, like a sensor that lost contact
+    float probability = failing ? 0.5f : config.dropout;
+    failing = sim_uniform(sim_hash(config.seed, SIM_CHANNEL_DROPOUT, reads++)) < probability;
+    if (failing) {
+        return { NAN, NAN };
+    }
+    return { temperature.value(ms), humidity.value(ms) };
+}
+
+void SampleJournal::record(uint32_t us, float a, float b) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[total % CAPACITY] = { us, a, b };
+    total++;
+}
+
+bool SampleJournal::find(float a, float b, float tolerance, uint32_t& us, uint32_t& sequence) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t oldest = total > CAPACITY ? total - CAPACITY : 0;
+    for (uint32_t seq = total; seq > oldest; seq--) {
+        const Entry& entry = entries[(seq - 1) % CAPACITY];
+        if (fabsf(entry.a - a) <= tolerance && fabsf(entry.b - b) <= tolerance) {
+            us = entry.us;
+            sequence = seq - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> SampleJournal::intervals() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> result;
+    uint32_t oldest = total > CAPACITY ? total - CAPACITY : 0;
+    for (uint32_t seq = oldest + 1; seq < total; seq++) {
+        result.push_back(entries[seq % CAPACITY].us - entries[(seq - 1) % CAPACITY].us);
+    }
+    return result;
+}
+
+static const SensorSimConfig& sim_config() {
+    static const SensorSimConfig config = SensorSimConfig::fromEnvironment();
+    return config;
+}
+
+static SampleJournal dhtJournal;
+static SampleJournal lightJournal;
+
+DhtSample sensor_sim_read_dht() {
+    static std::mutex mutex;
+    static DhtSimulator dht(sim_config());
+    static const unsigned long warmup = strtoul(native_env("NATIVE_SIM_DHT_WARMUP_MS", "1000"), nullptr, 10);
+    std::lock_guard<std::mutex> lock(mutex);
+    // Before the sensor is ready, not counted as a read so the dropouts stay the same
+    if (millis() < warmup) {
+        return { NAN, NAN };
+    }
+    DhtSample sample = dht.read(millis());
+    if (!isnan(sample.temperature)) {
+        dhtJournal.record(micros(), sample.temperature, sample.humidity);
+    }
+    return sample;
+}
+
+uint16_t sensor_sim_read_light() {
+    uint16_t level = sensor_sim_light_at(millis());
+    lightJournal.record(micros(), level, 0);
+    return level;
+}
+
+uint16_t sensor_sim_light_at(uint32_t ms) {
+    static const SensorTrace light(LIGHT_SHAPE, sim_config(), SIM_CHANNEL_LIGHT);
+    return (uint16_t)light.value(ms);
+}
+
+const SampleJournal& sensor_sim_dht_journal() {
+    return dhtJournal;
+}
+
+const SampleJournal& sensor_sim_light_journal() {
+    return lightJournal;
+}
+
+uint16_t native_sim_analog_read(uint8_t pin) {
+    return pin == SIM_LIGHT_PIN ? sensor_sim_read_light() : 0;
+}
+
+int native_sim_digital_read(uint8_t pin, int written) {
+    // The BOOT button is never pressed
+    return pin == SIM_BOOT_PIN ? HIGH : written;
+}
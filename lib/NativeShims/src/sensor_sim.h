@@ -0,0 +1,112 @@
+#ifndef __NATIVE_SENSOR_SIM_H__
+#define __NATIVE_SENSOR_SIM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+// Deterministic sensor traces for the native environment. Every channel follows a daily
+// cycle with noise and occasional spikes, the DHT additionally fails like a loose wire does,
+// with NaN readings that often come in short bursts. For a given seed a trace only depends
+// on the time since boot (and the DHT dropouts on the number of reads), so runs are repeatable.
+//
+// Settings, read from the environment:
+//   NATIVE_SIM_SEED          seed of all random parts, default 1
+//   NATIVE_SIM_DAY_SECONDS   real seconds per simulated day, default 86400 (e.g. 600 for a day in 10 minutes)
+//   NATIVE_SIM_START_HOUR    time of day at boot, default 8
+//   NATIVE_SIM_DROPOUT       probability that a DHT read fails, default 0.02
+//   NATIVE_SIM_SPIKES        spikes per simulated hour and channel, default 0.5
+//   NATIVE_SIM_DHT_WARMUP_MS DHT reads fail until this long after boot, like a DHT11 that was just
+//                            powered on, default 1000
+
+struct SensorSimConfig {
+    uint32_t seed;
+    float daySeconds;
+    float startHour;
+    float dropout;
+    float spikesPerHour;
+
+    static SensorSimConfig fromEnvironment();
+};
+
+struct TraceShape {
+    float mean;           // Daily mean
+    float amplitude;      // Half of the daily swing
+    float peakHour;       // Time of day of the maximum
+    bool daylight;        // Follows the sun (zero at night) instead of a sine
+    float noise;          // Standard deviation of the per sample noise
+    float drift;          // Amplitude of slow random changes (clouds, doors, ...)
+    float spikeHeight;    // Height of a spike, negative for dips
+    float spikeDecay;     // Simulated seconds until a spike decays to 1/e
+    float minimum;
+    float maximum;
+    float resolution;     // Readings are rounded to this step, 0 for none
+};
+
+class SensorTrace {
+public:
+    SensorTrace(const TraceShape& shape, const SensorSimConfig& config, uint32_t channel);
+
+    // Value at the given time since boot
+    float value(uint32_t ms) const;
+
+private:
+    TraceShape shape;
+    SensorSimConfig config;
+    uint32_t channel;
+
+    float hourOfDay(uint32_t ms) const;
+    float spikes(float simSeconds) const;
+};
+
+struct DhtSample {
+    float temperature;
+    float humidity;
+};
+
+// Simulated DHT11: a read returns both values of one measurement, or NaN for both on a dropout
+class DhtSimulator {
+public:
+    explicit DhtSimulator(const SensorSimConfig& config);
+    DhtSample read(uint32_t ms);
+
+private:
+    SensorSimConfig config;
+    SensorTrace temperature;
+    SensorTrace humidity;
+    uint32_t reads;
+    bool failing;
+};
+
+// Every reading the firmware takes is journaled with its time, so a load generator can tell
+// how old the values are that reach a client
+class SampleJournal {
+public:
+    void record(uint32_t us, float a, float b);
+    // Time of the newest sample matching the values (within tolerance), false if none is known
+    bool find(float a, float b, float tolerance, uint32_t& us, uint32_t& sequence) const;
+    // Time between consecutive samples in the journal, how evenly the firmware reads a sensor
+    std::vector<uint32_t> intervals() const;
+
+private:
+    static const size_t CAPACITY = 512;
+    struct Entry {
+        uint32_t us;
+        float a;
+        float b;
+    };
+    mutable std::mutex mutex;
+    Entry entries[CAPACITY];
+    uint32_t total = 0;
+};
+
+// Readings as taken by the firmware, and their journals
+DhtSample sensor_sim_read_dht();
+uint16_t sensor_sim_read_light();
+// Light level at a time since boot, not journaled, for simulations that keep their own clock
+uint16_t sensor_sim_light_at(uint32_t ms);
+const SampleJournal& sensor_sim_dht_journal();
+const SampleJournal& sensor_sim_light_journal();
+
+#endif
@@ -0,0 +1,56 @@
+// Header include.
+#include "Arduino_ESP32_Checkpoint_Store.h"
+
+#if THINGSBOARD_ENABLE_OTA
+
+#if defined(ESP32) && defined(ARDUINO)
+
+// Library include.
+#include <Preferences.h>
+
+#if THINGSBOARD_ENABLE_PROGMEM
+constexpr char CHECKPOINT_KEY[] PROGMEM = "checkpoint";
+#else
+constexpr char CHECKPOINT_KEY[] = "checkpoint";
+#endif // THINGSBOARD_ENABLE_PROGMEM
+
+Arduino_ESP32_Checkpoint_Store::Arduino_ESP32_Checkpoint_Store(const char *name_space) :
+    m_namespace(name_space)
+{
+    // Nothing to do
+}
+
+bool Arduino_ESP32_Checkpoint_Store::save(const OTA_Checkpoint& checkpoint) {
+    Preferences preferences;
+    if (!preferences.begin(m_namespace, false)) {
+        return false;
+    }
+    const size_t written_bytes = preferences.putBytes(CHECKPOINT_KEY, &checkpoint, sizeof(checkpoint));
+    preferences.end();
+    return written_bytes == sizeof(checkpoint);
+}
+
+bool Arduino_ESP32_Checkpoint_Store::load(OTA_Checkpoint& checkpoint) {
+    Preferences preferences;
+    if (!preferences.begin(m_namespace, true)) {
+        return false;
+    }
+    // Checkpoints written by a build with another struct layout are ignored, because their content can not be interpreted
+    const bool valid = preferences.getBytesLength(CHECKPOINT_KEY) == sizeof(checkpoint) &&
+        preferences.getBytes(CHECKPOINT_KEY, &checkpoint, sizeof(checkpoint)) == sizeof(checkpoint);
+    preferences.end();
+    return valid && checkpoint.version == OTA_CHECKPOINT_VERSION;
+}
+
+void Arduino_ESP32_Checkpoint_Store::clear() {
+    Preferences preferences;
+    if (!preferences.begin(m_namespace, false)) {
+        return;
+    }
+    (void)preferences.remove(CHECKPOINT_KEY);
+    preferences.end();
+}
+
+#endif // defined(ESP32) && defined(ARDUINO)
+
+#endif // THINGSBOARD_ENABLE_OTA
@@ -0,0 +1,37 @@
+#ifndef Arduino_ESP32_Checkpoint_Store_h
+#define Arduino_ESP32_Checkpoint_Store_h
+
+// Local include.
+#include "Configuration.h"
+
+#if THINGSBOARD_ENABLE_OTA
+
+#if defined(ESP32) && defined(ARDUINO)
+
+// Local include.
+#include "IOTA_Checkpoint_Store.h"
+
+
+/// @brief IOTA_Checkpoint_Store implementation that uses the Arduino Preferences library (https://github.com/espressif/arduino-esp32/tree/master/libraries/Preferences),
+/// under the hood to persist the checkpoint as a single binary blob into the non-volatile storage partition
+class Arduino_ESP32_Checkpoint_Store : public IOTA_Checkpoint_Store {
+  public:
+    /// @brief Constructor
+    /// @param name_space Preferences namespace the checkpoint is saved in, has to be at most 15 characters long
+    Arduino_ESP32_Checkpoint_Store(const char *name_space = "tb-ota");
+
+    bool save(const OTA_Checkpoint& checkpoint) override;
+
+    bool load(OTA_Checkpoint& checkpoint) override;
+
+    void clear() override;
+
+  private:
+    const char *m_namespace; // Preferences namespace the checkpoint is saved in
+};
+
+#endif // defined(ESP32) && defined(ARDUINO)
+
+#endif // THINGSBOARD_ENABLE_OTA
+
+#endif // Arduino_ESP32_Checkpoint_Store_h
@@ -7,24 +7,24 @@
 
 // Library include.
 #include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <memory>
 
+// Smallest unit of flash memory that can be erased at once
+constexpr size_t FLASH_SECTOR_SIZE = 4096U;
 
 Espressif_Updater::Espressif_Updater() :
     m_ota_handle(0U),
-    m_update_partition(nullptr)
+    m_update_partition(nullptr),
+    m_resumed(false),
+    m_write_offset(0U),
+    m_erased_offset(0U)
 {
     // Nothing to do
 }
 
 bool Espressif_Updater::begin(const size_t& firmware_size) {
-    const esp_partition_t *running = esp_ota_get_running_partition();
-    const esp_partition_t *configured = esp_ota_get_boot_partition();
-
-    if (configured != running) {
-        return false;
-    }
-
-    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(nullptr);
+    const esp_partition_t *update_partition = static_cast<const esp_partition_t*>(get_update_partition());
 
     if (update_partition == nullptr) {
         return false;
@@ -42,21 +42,89 @@ bool Espressif_Updater::begin(const size_t& firmware_size) {
 
     m_ota_handle = ota_handle;
     m_update_partition = update_partition;
+    m_resumed = false;
+    return true;
+}
+
+bool Espressif_Updater::resume(const size_t& firmware_size, const size_t& offset) {
+    const esp_partition_t *update_partition = static_cast<const esp_partition_t*>(get_update_partition());
+
+    if (update_partition == nullptr || firmware_size > update_partition->size || offset == 0U || offset > firmware_size) {
+        return false;
+    }
+
+    // Everything after the offset might have already been written before the restart, but was not part of the checkpoint,
+    // therefore the sector containing the offset has to be erased again, while keeping the already committed bytes at its start
+    const size_t sector_start = offset - (offset % FLASH_SECTOR_SIZE);
+    const size_t kept_bytes = offset - sector_start;
+    std::unique_ptr<uint8_t[]> sector;
+    if (kept_bytes > 0U) {
+        sector.reset(new uint8_t[kept_bytes]);
+        if (esp_partition_read(update_partition, sector_start, sector.get(), kept_bytes) != ESP_OK) {
+            return false;
+        }
+    }
+    if (esp_partition_erase_range(update_partition, sector_start, FLASH_SECTOR_SIZE) != ESP_OK) {
+        return false;
+    }
+    if (kept_bytes > 0U && esp_partition_write(update_partition, sector_start, sector.get(), kept_bytes) != ESP_OK) {
+        return false;
+    }
+
+    m_ota_handle = 0U;
+    m_update_partition = update_partition;
+    m_resumed = true;
+    m_write_offset = offset;
+    m_erased_offset = sector_start + FLASH_SECTOR_SIZE;
     return true;
 }
 
+size_t Espressif_Updater::read(const size_t& offset, uint8_t* payload, const size_t& total_bytes) {
+    // Only the partition of a resumed update is known to contain the bytes before the write offset
+    if (!m_resumed || offset + total_bytes > m_write_offset) {
+        return 0U;
+    }
+    const esp_err_t error = esp_partition_read(static_cast<const esp_partition_t*>(m_update_partition), offset, payload, total_bytes);
+    return (error == ESP_OK) ? total_bytes : 0U;
+}
+
 size_t Espressif_Updater::write(uint8_t* payload, const size_t& total_bytes) {
+    if (m_resumed) {
+        const esp_partition_t *update_partition = static_cast<const esp_partition_t*>(m_update_partition);
+        // Erase each sector once, before the first byte is written into it
+        while (m_erased_offset < m_write_offset + total_bytes) {
+            if (esp_partition_erase_range(update_partition, m_erased_offset, FLASH_SECTOR_SIZE) != ESP_OK) {
+                return 0U;
+            }
+            m_erased_offset += FLASH_SECTOR_SIZE;
+        }
+        if (esp_partition_write(update_partition, m_write_offset, payload, total_bytes) != ESP_OK) {
+            return 0U;
+        }
+        m_write_offset += total_bytes;
+        return total_bytes;
+    }
+
     const esp_err_t error = esp_ota_write(m_ota_handle, payload, total_bytes);
     const size_t written_bytes = (error == ESP_OK) ? total_bytes : 0U;
     return written_bytes;
 }
 
 void Espressif_Updater::reset() {
+    if (m_resumed) {
+        // Nothing was opened with the OTA API, the next update will call begin() or resume() again anyway
+        m_resumed = false;
+        return;
+    }
     (void)esp_ota_abort(m_ota_handle);
 }
 
 bool Espressif_Updater::end() {
-    esp_err_t error = esp_ota_end(m_ota_handle);
+    esp_err_t error = ESP_OK;
+    // Resumed updates were written without an OTA handle, the image is still validated when setting the boot partition
+    if (!m_resumed) {
+        error = esp_ota_end(m_ota_handle);
+    }
     if (error != ESP_OK) {
         return false;
     }
@@ -65,6 +133,17 @@ bool Espressif_Updater::end() {
     return error == ESP_OK;
 }
 
+const void *Espressif_Updater::get_update_partition() const {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_partition_t *configured = esp_ota_get_boot_partition();
+
+    if (configured != running) {
+        return nullptr;
+    }
+
+    return esp_ota_get_next_update_partition(nullptr);
+}
+
 #endif // THINGSBOARD_USE_ESP_PARTITION
 
 #endif // THINGSBOARD_ENABLE_OTA
@@ -13,12 +13,18 @@
 
 
 /// @brief IUpdater implementation that uses the Over the Air Update API from Espressif (https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/ota.html)
-/// under the hood to write the given binary firmware data into flash memory so we can restart with newly received firmware
+/// under the hood to write the given binary firmware data into flash memory so we can restart with newly received firmware.
+/// Resumed updates are written with the partition API (https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/storage/partition.html) instead,
+/// because the OTA API always starts writing at the beginning of the partition, the image is still verified the same way when it is set as the boot partition
 class Espressif_Updater : public IUpdater {
   public:
     Espressif_Updater();
 
     bool begin(const size_t& firmware_size) override;
+
+    bool resume(const size_t& firmware_size, const size_t& offset) override;
+
+    size_t read(const size_t& offset, uint8_t* payload, const size_t& total_bytes) override;
   
     size_t write(uint8_t* payload, const size_t& total_bytes) override;
 
@@ -29,6 +35,13 @@ class Espressif_Updater : public IUpdater {
     private:
       uint32_t m_ota_handle;
       const void *m_update_partition;
+      bool m_resumed;          // Whether the update was resumed, in that case the partition is written directly, because the OTA API can only start at the beginning
+      size_t m_write_offset;   // Offset in the partition the next resumed write starts at
+      size_t m_erased_offset;  // Offset in the partition up to which the flash has been erased since resuming
+
+      /// @brief Gets the partition the update should be written into, as long as we are currently running from the configured boot partition
+      /// @return Partition the update should be written into or nullptr if there is none
+      const void *get_update_partition() const;
 };
 
 #endif // THINGSBOARD_USE_ESP_PARTITION
@@ -0,0 +1,33 @@
+#ifndef IOTA_Checkpoint_Store_h
+#define IOTA_Checkpoint_Store_h
+
+// Local include.
+#include "Configuration.h"
+
+#if THINGSBOARD_ENABLE_OTA
+
+// Local include.
+#include "OTA_Checkpoint.h"
+
+
+/// @brief Checkpoint store interface that contains the methods that a class that can be used to persist the progress of an OTA firmware update has to implement,
+/// the stored checkpoint has to survive a restart of the device, so it should be written into non-volatile memory (NVS, file system, EEPROM, ...)
+class IOTA_Checkpoint_Store {
+  public:
+    /// @brief Persists the given checkpoint, overwriting any previously saved checkpoint
+    /// @param checkpoint Progress of the ongoing update that should be saved
+    /// @return Whether saving the checkpoint was successful or not
+    virtual bool save(const OTA_Checkpoint& checkpoint) = 0;
+
+    /// @brief Reads the previously saved checkpoint
+    /// @param checkpoint Output the saved checkpoint will be copied into
+    /// @return Whether a checkpoint existed and was read successfully or not
+    virtual bool load(OTA_Checkpoint& checkpoint) = 0;
+
+    /// @brief Removes the previously saved checkpoint, called once the update has finished or has to be restarted from the beginning
+    virtual void clear() = 0;
+};
+
+#endif // THINGSBOARD_ENABLE_OTA
+
+#endif // IOTA_Checkpoint_Store_h
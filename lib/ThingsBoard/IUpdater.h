@@ -18,7 +18,31 @@ class IUpdater {
     /// @param firmware_size Total size of the data that should be written, is done in multiple packets
     /// @return Whether initalizing the update was successful or not
     virtual bool begin(const size_t& firmware_size) = 0;
+
+    /// @brief Initalizes the writing of the given data, continuing after the given amount of bytes that were already written before the device was restarted,
+    /// the default implementation does not support resuming, which causes the update to be started from the beginning instead
+    /// @param firmware_size Total size of the data that should be written, is done in multiple packets
+    /// @param offset Amount of bytes at the start of the data that have already been written and should be kept
+    /// @return Whether initalizing the update at the given offset was successful or not
+    virtual bool resume(const size_t& firmware_size, const size_t& offset) {
+        (void)firmware_size;
+        (void)offset;
+        return false;
+    }
   
+    /// @brief Reads back data that has already been written, used to hash the kept bytes again when an update is resumed,
+    /// the default implementation can not read, which causes the update to be started from the beginning instead
+    /// @param offset Offset from the start of the data the read should begin at
+    /// @param payload Output byte array the read data will be copied into
+    /// @param total_bytes Amount of bytes that should be read
+    /// @return Total amount of bytes that were successfully read
+    virtual size_t read(const size_t& offset, uint8_t* payload, const size_t& total_bytes) {
+        (void)offset;
+        (void)payload;
+        (void)total_bytes;
+        return 0U;
+    }
+
     /// @brief Writes the given amount of bytes of the packet data
     /// @param payload Firmware packet data that should be written
     /// @param total_bytes Amount of bytes in the current firmware packet data
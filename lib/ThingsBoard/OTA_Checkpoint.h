@@ -0,0 +1,35 @@
+#ifndef OTA_Checkpoint_h
+#define OTA_Checkpoint_h
+
+// Local include.
+#include "Configuration.h"
+
+#if THINGSBOARD_ENABLE_OTA
+
+// Library include.
+#include <stddef.h>
+#include <stdint.h>
+
+
+// OTA checkpoint values.
+constexpr uint8_t OTA_CHECKPOINT_VERSION = 2U;
+constexpr size_t OTA_CHECKPOINT_CHECKSUM_SIZE = 129U; // Hex string of the biggest supported hash (SHA512) + null terminator
+
+
+/// @brief Persistable snapshot of an ongoing OTA firmware update, written every few chunks so an interrupted download can be continued after a restart
+/// instead of downloading the complete firmware binary again. Contains everything needed to decide if the checkpoint still belongs to the firmware
+/// the server currently offers. The state of the hash is not part of it, because the hardware accelerated hash contexts can not be copied byte by byte,
+/// instead the committed bytes are read back from flash memory and hashed again when the update is resumed.
+/// Plain data only, so it can be written and read as a single binary blob by any IOTA_Checkpoint_Store implementation
+struct OTA_Checkpoint {
+    uint8_t version;                                  // Layout version of this struct, checkpoints with another version are discarded
+    char fw_checksum[OTA_CHECKPOINT_CHECKSUM_SIZE];   // Expected checksum of the complete firmware binary, used to ensure the checkpoint belongs to the same firmware
+    uint32_t fw_size;                                 // Total size of the firmware binary the checkpoint was created for
+    uint16_t chunk_size;                              // Size of the chunks the firmware binary was requested in, chunk indices are only valid for the same size
+    uint32_t committed_chunks;                        // Amount of chunks that were completely written into flash memory
+    uint8_t hash_algorithm;                           // Algorithm type used to hash the firmware binary, stored as mbedtls_md_type_t
+};
+
+#endif // THINGSBOARD_ENABLE_OTA
+
+#endif // OTA_Checkpoint_h
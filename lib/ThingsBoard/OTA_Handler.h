@@ -12,6 +12,10 @@
 #include "Helper.h"
 #include "OTA_Update_Callback.h"
 #include "OTA_Failure_Response.h"
+#include "OTA_Checkpoint.h"
+
+// Library includes.
+#include <vector>
 
 
 /// ---------------------------------
@@ -37,7 +41,8 @@ constexpr char FW_STATE_FAILED[] = "FAILED";
 // Log messages.
 #if THINGSBOARD_ENABLE_PROGMEM
 constexpr char UNABLE_TO_REQUEST_CHUNCKS[] PROGMEM = "Unable to request firmware chunk";
-constexpr char RECEIVED_UNEXPECTED_CHUNK[] PROGMEM = "Received chunk (%u), not the same as requested chunk (%u)";
+constexpr char RECEIVED_UNEXPECTED_CHUNK[] PROGMEM = "Received chunk (%u), outside of requested window starting at chunk (%u)";
+constexpr char FW_CHUNK_BUFFERED[] PROGMEM = "Buffered out of order chunk (%u), waiting for chunk (%u)";
 constexpr char ERROR_UPDATE_BEGIN[] PROGMEM = "Failed to initalize flash updater";
 constexpr char ERROR_UPDATE_WRITE[] PROGMEM = "Only wrote (%u) bytes of binary data to flash memory instead of expected (%u)";
 constexpr char UPDATING_HASH_FAILED[] PROGMEM = "Updating hash failed";
@@ -49,9 +54,12 @@ constexpr char HASH_EXPECTED[] PROGMEM = "(%s) expected checksum: (%s)";
 constexpr char CHKS_VER_SUCCESS[] PROGMEM = "Checksum is the same as expected";
 constexpr char FW_UPDATE_ABORTED[] PROGMEM = "Firmware update aborted";
 constexpr char FW_UPDATE_SUCCESS[] PROGMEM = "Update success";
+constexpr char FW_UPDATE_RESUMED[] PROGMEM = "Resuming firmware update at chunk (%u) of (%u)";
+constexpr char CHECKPOINT_SAVE_FAILED[] PROGMEM = "Unable to save firmware update checkpoint";
 #else
 constexpr char UNABLE_TO_REQUEST_CHUNCKS[] = "Unable to request firmware chunk";
-constexpr char RECEIVED_UNEXPECTED_CHUNK[] = "Received chunk (%u), not the same as requested chunk (%u)";
+constexpr char RECEIVED_UNEXPECTED_CHUNK[] = "Received chunk (%u), outside of requested window starting at chunk (%u)";
+constexpr char FW_CHUNK_BUFFERED[] = "Buffered out of order chunk (%u), waiting for chunk (%u)";
 constexpr char ERROR_UPDATE_BEGIN[] = "Failed to initalize flash updater";
 constexpr char ERROR_UPDATE_WRITE[] = "Only wrote (%u) bytes of binary data to flash memory instead of expected (%u)";
 constexpr char UPDATING_HASH_FAILED[] = "Updating hash failed";
@@ -63,11 +71,16 @@ constexpr char HASH_EXPECTED[] = "(%s) expected checksum: (%s)";
 constexpr char CHKS_VER_SUCCESS[] = "Checksum is the same as expected";
 constexpr char FW_UPDATE_ABORTED[] = "Firmware update aborted";
 constexpr char FW_UPDATE_SUCCESS[] = "Update success";
+constexpr char FW_UPDATE_RESUMED[] = "Resuming firmware update at chunk (%u) of (%u)";
+constexpr char CHECKPOINT_SAVE_FAILED[] = "Unable to save firmware update checkpoint";
 #endif // THINGSBOARD_ENABLE_PROGMEM
 
 
 /// @brief Handles the complete processing of received binary firmware data, including flashing it onto the device,
-/// creating a hash of the received data and in the end ensuring that the complete OTA firmware was flashes successfully and that the hash is the one we initally received
+/// creating a hash of the received data and in the end ensuring that the complete OTA firmware was flashes successfully and that the hash is the one we initally received.
+/// Keeps up to the configured chunk window of requests in flight at once, so the download speed is not bound by the round trip time of every single chunk request.
+/// Chunks that arrive out of order are buffered until all previous chunks have been written, because both the flash updater and the hash have to be fed sequentially.
+/// If a checkpoint store is configured the progress is persisted every few chunks, so an interrupted update continues from the last checkpoint
 /// @tparam Logger Logging class that should be used to print messages generated by internal processes
 template<typename Logger>
 class OTA_Handler {
@@ -88,13 +101,16 @@ class OTA_Handler {
         , m_hash()
         , m_total_chunks(0U)
         , m_requested_chunks(0U)
+        , m_next_request(0U)
+        , m_window()
         , m_retries(0U)
         , m_watchdog(std::bind(&OTA_Handler::Handle_Request_Timeout, this))
     {
       // Nothing to do
     }
 
-    /// @brief Starts the firmware update with requesting the first firmware packet and initalizes the underlying needed components
+    /// @brief Starts the firmware update with requesting the first firmware packet and initalizes the underlying needed components,
+    /// or continues the update from the last saved checkpoint if it belongs to the same firmware binary
     /// @param fw_callback Callback method that contains configuration information, about the over the air update
     /// @param fw_size Complete size of the firmware binary that will be downloaded and flashed onto this device
     /// @param fw_algorithm String of the algorithm type used to hash the firmware binary
@@ -114,6 +130,9 @@ class OTA_Handler {
           (void)m_send_fw_state_callback(FW_STATE_FAILED, OTA_CB_IS_NULL);
             return Handle_Failure(OTA_Failure_Response::RETRY_NOTHING);
         }
+        if (Resume_Firmware_Update()) {
+            return;
+        }
         Request_First_Firmware_Packet();
     }
 
@@ -137,47 +156,46 @@ class OTA_Handler {
     inline void Process_Firmware_Packet(const size_t& current_chunk, uint8_t *payload, const size_t& total_bytes) {
         (void)m_send_fw_state_callback(FW_STATE_DOWNLOADING, nullptr);
 
-        if (current_chunk != m_requested_chunks) {
+        if (current_chunk < m_requested_chunks || current_chunk >= m_next_request) {
           char message[Helper::detectSize(RECEIVED_UNEXPECTED_CHUNK, current_chunk, m_requested_chunks)];
           snprintf_P(message, sizeof(message), RECEIVED_UNEXPECTED_CHUNK, current_chunk, m_requested_chunks);
           Logger::log(message);
           return;
         }
 
-        m_watchdog.detach();
-
         char message[Helper::detectSize(FW_CHUNK, current_chunk, total_bytes)];
         snprintf_P(message, sizeof(message), FW_CHUNK, current_chunk, total_bytes);
         Logger::log(message);
 
-        if (current_chunk == 0U) {
-            // Initialize Flash
-            if (!m_fw_updater->begin(m_fw_size)) {
-              Logger::log(ERROR_UPDATE_BEGIN);
-              (void)m_send_fw_state_callback(FW_STATE_FAILED, ERROR_UPDATE_BEGIN);
-              return Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
-            }
-        }
-
-        // Write received binary data to flash partition
-        const size_t written_bytes = m_fw_updater->write(payload, total_bytes);
-        if (written_bytes != total_bytes) {
-            char message[Helper::detectSize(ERROR_UPDATE_WRITE, written_bytes, total_bytes)];
-            snprintf_P(message, sizeof(message), ERROR_UPDATE_WRITE, written_bytes, total_bytes);
+        // Chunk arrived before one of the previously requested chunks, keep it until the gap has been filled,
+        // the slot is unique for each chunk in the window, because the window is never bigger than the amount of slots
+        if (current_chunk != m_requested_chunks) {
+          Window_Slot& slot = m_window.at(current_chunk % m_window.size());
+          if (!slot.received) {
+            slot.data.assign(payload, payload + total_bytes);
+            slot.received = true;
+            char message[Helper::detectSize(FW_CHUNK_BUFFERED, current_chunk, m_requested_chunks)];
+            snprintf_P(message, sizeof(message), FW_CHUNK_BUFFERED, current_chunk, m_requested_chunks);
             Logger::log(message);
-            (void)m_send_fw_state_callback(FW_STATE_FAILED, message);
-            return Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
+          }
+          return;
         }
 
-        // Update value only if writing to flash was a success
-        if (!m_hash.update(payload, total_bytes)) {
-            Logger::log(UPDATING_HASH_FAILED);
-            (void)m_send_fw_state_callback(FW_STATE_FAILED, UPDATING_HASH_FAILED);
-            return Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
+        m_watchdog.detach();
+
+        if (!Write_Firmware_Packet(current_chunk, payload, total_bytes)) {
+          return;
         }
 
-        m_requested_chunks = current_chunk + 1;
-        m_fw_callback->Call_Progress_Callback<Logger>(m_requested_chunks, m_total_chunks);
+        // Write all directly following chunks, that already arrived out of order while we were waiting for the current chunk
+        Window_Slot* slot = &m_window.at(m_requested_chunks % m_window.size());
+        while (m_fw_callback != nullptr && m_requested_chunks < m_next_request && slot->received) {
+          slot->received = false;
+          if (!Write_Firmware_Packet(m_requested_chunks, slot->data.data(), slot->data.size())) {
+            return;
+          }
+          slot = &m_window.at(m_requested_chunks % m_window.size());
+        }
 
         // Ensure to check if the update was cancelled during the progress callback,
         // if it was the callback variable was reset and there is no need to request the next firmware packet
@@ -191,6 +209,12 @@ class OTA_Handler {
     }
 
   private:
+    /// @brief Buffer for a single requested chunk, that arrived before all previous chunks were written
+    struct Window_Slot {
+        bool received;             // Whether the chunk assigned to this slot has already arrived and is waiting to be written
+        std::vector<uint8_t> data; // Binary firmware data of the chunk, capacity is kept between chunks to avoid reallocating for every chunk
+    };
+
     const OTA_Update_Callback *m_fw_callback;                                 // Callback method that contains configuration information, about the over the air update
     std::function<bool(const size_t&)> m_publish_callback;                    // Callback that is used to request the firmware chunk of the firmware binary with the given chunk number
     std::function<bool(const char *, const char *)> m_send_fw_state_callback; // Callback that is used to send information about the current state of the over the air update
@@ -202,22 +226,164 @@ class OTA_Handler {
     IUpdater *m_fw_updater;                                                   // Interface implementation that writes received firmware binary data onto the given device
     HashGenerator m_hash;                                                     // Class instance that allows to generate a hash from received firmware binary data
     size_t m_total_chunks;                                                    // Total amount of chunks that need to be received to get the complete firmware binary
-    size_t m_requested_chunks;                                                // Amount of successfully requested and received firmware binary chunks
+    size_t m_requested_chunks;                                                // Amount of successfully requested and received firmware binary chunks, is also the index of the oldest chunk still in flight
+    size_t m_next_request;                                                    // Index of the next chunk that has not been requested yet, every chunk between m_requested_chunks and this index is in flight
+    std::vector<Window_Slot> m_window;                                        // Buffers for chunks that arrived out of order, one slot per chunk that can be in flight at the same time
     uint8_t m_retries;                                                        // Amount of request retries we attempt for each chunk, increasing makes the connection more stable
     Callback_Watchdog m_watchdog;                                             // Class instances that allows to timeout if we do not receive a response for a requested chunk in the given time
 
-    /// @brief Restarts or starts the firmware update and its needed components and then requests the first firmware chunk
+    /// @brief Restarts or starts the firmware update and its needed components and then requests the first firmware chunks
     inline void Request_First_Firmware_Packet() {
-        m_requested_chunks = 0U;
-        m_retries = m_fw_callback->Get_Chunk_Retries();
+        Reset_Window(0U);
         m_hash.start(m_fw_checksum_algorithm);
         m_watchdog.detach();
         m_fw_updater->reset();
+        Clear_Checkpoint();
+        Request_Next_Firmware_Packet();
+    }
+
+    /// @brief Continues the firmware update from the last saved checkpoint, if there is one for the same firmware binary,
+    /// the updater could be resumed at the committed offset and the bytes before it could be read back to restore the hash
+    /// @return Whether the update was resumed, if not it has to be started from the first chunk instead
+    inline bool Resume_Firmware_Update() {
+        IOTA_Checkpoint_Store *checkpoint_store = m_fw_callback->Get_Checkpoint_Store();
+        if (checkpoint_store == nullptr) {
+            return false;
+        }
+
+        OTA_Checkpoint checkpoint;
+        if (!checkpoint_store->load(checkpoint)) {
+            return false;
+        }
+
+        const uint16_t& chunk_size = m_fw_callback->Get_Chunk_Size();
+        checkpoint.fw_checksum[OTA_CHECKPOINT_CHECKSUM_SIZE - 1U] = '\0';
+        // Checkpoint has to belong to the exact same firmware binary requested in the same chunk size, otherwise the already written data is useless
+        if (m_fw_checksum.compare(checkpoint.fw_checksum) != 0 || checkpoint.fw_size != m_fw_size || checkpoint.chunk_size != chunk_size ||
+            checkpoint.hash_algorithm != static_cast<uint8_t>(m_fw_checksum_algorithm) || checkpoint.committed_chunks == 0U || checkpoint.committed_chunks >= m_total_chunks) {
+            return false;
+        }
+
+        m_watchdog.detach();
+        m_fw_updater->reset();
+        const size_t committed_bytes = checkpoint.committed_chunks * chunk_size;
+        if (!m_fw_updater->resume(m_fw_size, committed_bytes) || !Hash_Committed_Bytes(committed_bytes)) {
+            return false;
+        }
+
+        Reset_Window(checkpoint.committed_chunks);
+        char message[Helper::detectSize(FW_UPDATE_RESUMED, m_requested_chunks, m_total_chunks)];
+        snprintf_P(message, sizeof(message), FW_UPDATE_RESUMED, m_requested_chunks, m_total_chunks);
+        Logger::log(message);
         Request_Next_Firmware_Packet();
+        return true;
+    }
+
+    /// @brief Restarts the hash and adds the bytes a resumed update kept in flash memory, read back in chunk sized blocks.
+    /// Hashing them again costs one read of the kept bytes, but works with any hash implementation, including the hardware accelerated ones,
+    /// whose internal state can not be persisted
+    /// @param committed_bytes Amount of bytes at the start of the firmware binary that were written before the update was interrupted
+    /// @return Whether all bytes could be read back and added to the hash
+    inline bool Hash_Committed_Bytes(const size_t& committed_bytes) {
+        m_hash.start(m_fw_checksum_algorithm);
+        std::vector<uint8_t> buffer(m_fw_callback->Get_Chunk_Size());
+        for (size_t offset = 0U; offset < committed_bytes; offset += buffer.size()) {
+            const size_t size = (committed_bytes - offset < buffer.size()) ? committed_bytes - offset : buffer.size();
+            if (m_fw_updater->read(offset, buffer.data(), size) != size || !m_hash.update(buffer.data(), size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief Persists the current progress, as long as a checkpoint store is configured
+    /// and the configured amount of chunks has been written since the last checkpoint
+    inline void Save_Checkpoint() {
+        IOTA_Checkpoint_Store *checkpoint_store = m_fw_callback->Get_Checkpoint_Store();
+        const uint16_t& interval = m_fw_callback->Get_Checkpoint_Interval();
+        if (checkpoint_store == nullptr || m_requested_chunks >= m_total_chunks || (m_requested_chunks % (interval > 0U ? interval : 1U)) != 0U) {
+            return;
+        }
+
+        OTA_Checkpoint checkpoint;
+        memset(&checkpoint, 0, sizeof(checkpoint));
+        checkpoint.version = OTA_CHECKPOINT_VERSION;
+        strncpy(checkpoint.fw_checksum, m_fw_checksum.c_str(), OTA_CHECKPOINT_CHECKSUM_SIZE - 1U);
+        checkpoint.fw_size = m_fw_size;
+        checkpoint.chunk_size = m_fw_callback->Get_Chunk_Size();
+        checkpoint.committed_chunks = m_requested_chunks;
+        checkpoint.hash_algorithm = static_cast<uint8_t>(m_fw_checksum_algorithm);
+
+        // Failing to save a checkpoint does not affect the ongoing update, it only means an interruption costs more data
+        if (!checkpoint_store->save(checkpoint)) {
+            Logger::log(CHECKPOINT_SAVE_FAILED);
+        }
+    }
+
+    /// @brief Removes the saved checkpoint, because the update either finished or the already written data can not be used anymore
+    inline void Clear_Checkpoint() {
+        IOTA_Checkpoint_Store *checkpoint_store = m_fw_callback->Get_Checkpoint_Store();
+        if (checkpoint_store != nullptr) {
+            checkpoint_store->clear();
+        }
+    }
+
+    /// @brief Resets the chunk window so that the next request starts at the given chunk
+    /// @param first_chunk Index of the first chunk that has not been written yet
+    inline void Reset_Window(const size_t& first_chunk) {
+        m_requested_chunks = first_chunk;
+        m_next_request = first_chunk;
+        m_retries = m_fw_callback->Get_Chunk_Retries();
+        const uint8_t& window = m_fw_callback->Get_Chunk_Window();
+        m_window.resize(window > 0U ? window : 1U);
+        for (Window_Slot& slot : m_window) {
+            slot.received = false;
+        }
+    }
+
+    /// @brief Writes the given chunk into flash memory and the hash, expects the chunk to be the next one in sequence
+    /// @param current_chunk Index of the chunk we recieved the binary data for
+    /// @param payload Firmware packet data of the current chunk
+    /// @param total_bytes Amount of bytes in the current firmware packet data
+    /// @return Whether the chunk was handled successfully, if not the failure has already been handled
+    inline bool Write_Firmware_Packet(const size_t& current_chunk, uint8_t *payload, const size_t& total_bytes) {
+        if (current_chunk == 0U) {
+            // Initialize Flash
+            if (!m_fw_updater->begin(m_fw_size)) {
+              Logger::log(ERROR_UPDATE_BEGIN);
+              (void)m_send_fw_state_callback(FW_STATE_FAILED, ERROR_UPDATE_BEGIN);
+              Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
+              return false;
+            }
+        }
+
+        // Write received binary data to flash partition
+        const size_t written_bytes = m_fw_updater->write(payload, total_bytes);
+        if (written_bytes != total_bytes) {
+            char message[Helper::detectSize(ERROR_UPDATE_WRITE, written_bytes, total_bytes)];
+            snprintf_P(message, sizeof(message), ERROR_UPDATE_WRITE, written_bytes, total_bytes);
+            Logger::log(message);
+            (void)m_send_fw_state_callback(FW_STATE_FAILED, message);
+            Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
+            return false;
+        }
+
+        // Update value only if writing to flash was a success
+        if (!m_hash.update(payload, total_bytes)) {
+            Logger::log(UPDATING_HASH_FAILED);
+            (void)m_send_fw_state_callback(FW_STATE_FAILED, UPDATING_HASH_FAILED);
+            Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
+            return false;
+        }
+
+        m_requested_chunks = current_chunk + 1U;
+        Save_Checkpoint();
+        m_fw_callback->Call_Progress_Callback<Logger>(m_requested_chunks, m_total_chunks);
+        return true;
     }
 
-    /// @brief Requests the next firmware chunk of the OTA firmware if there are any left
-    /// and starts the timer that ensures we request the same chunk again if we have not received a response yet
+    /// @brief Requests further firmware chunks of the OTA firmware until the chunk window is full or there are none left
+    /// and starts the timer that ensures we request missing chunks again if we have not received a response yet
     inline void Request_Next_Firmware_Packet() {
         // Check if we have already requested and handled the last remaining chunk
         if (m_requested_chunks >= m_total_chunks) {
@@ -225,9 +391,13 @@ class OTA_Handler {
             return;
         }
 
-        if (!m_publish_callback(m_requested_chunks)) {
-          Logger::log(UNABLE_TO_REQUEST_CHUNCKS);
-          (void)m_send_fw_state_callback(FW_STATE_FAILED, UNABLE_TO_REQUEST_CHUNCKS);
+        while (m_next_request < m_total_chunks && m_next_request < m_requested_chunks + m_window.size()) {
+            if (!m_publish_callback(m_next_request)) {
+              Logger::log(UNABLE_TO_REQUEST_CHUNCKS);
+              (void)m_send_fw_state_callback(FW_STATE_FAILED, UNABLE_TO_REQUEST_CHUNCKS);
+              break;
+            }
+            m_next_request++;
         }
 
         // Watchdog gets started no matter if publishing request was successful or not in hopes,
@@ -235,6 +405,22 @@ class OTA_Handler {
         m_watchdog.once(m_fw_callback->Get_Timeout());
     }
 
+    /// @brief Requests every chunk in the current window again, that has been requested but not received yet,
+    /// chunks that already arrived out of order are kept, so only the individual missing chunks are downloaded again
+    inline void Request_Missing_Firmware_Packets() {
+        for (size_t chunk = m_requested_chunks; chunk < m_next_request; chunk++) {
+            if (m_window.at(chunk % m_window.size()).received) {
+                continue;
+            }
+            if (!m_publish_callback(chunk)) {
+              Logger::log(UNABLE_TO_REQUEST_CHUNCKS);
+              (void)m_send_fw_state_callback(FW_STATE_FAILED, UNABLE_TO_REQUEST_CHUNCKS);
+              break;
+            }
+        }
+        Request_Next_Firmware_Packet();
+    }
+
     /// @brief Completes the firmware update, which consists of checking the complete hash of the firmware binary if the initally received value,
     /// both should be the same and if that is not the case that means that we received invalid firmware binary data and have to restart the update.
     /// If checking the hash was successfull we attempt to finish flashing the ota partition and then inform the user that the update was successfull
@@ -253,6 +439,7 @@ class OTA_Handler {
         // Check if the initally received checksum is the same as the one we calculated from the received binary data,
         // if not we assume the binary data has been changed or not completly downloaded --> Firmware update failed
         if (m_fw_checksum.compare(calculated_hash) != 0) {
+            Clear_Checkpoint();
             Logger::log(CHKS_VER_FAILED);
             (void)m_send_fw_state_callback(FW_STATE_FAILED, CHKS_VER_FAILED);
             return Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
@@ -266,6 +453,7 @@ class OTA_Handler {
             return Handle_Failure(OTA_Failure_Response::RETRY_UPDATE);
         }
 
+        Clear_Checkpoint();
         Logger::log(FW_UPDATE_SUCCESS);
         (void)m_send_fw_state_callback(FW_STATE_UPDATING, nullptr);
 
@@ -289,7 +477,7 @@ class OTA_Handler {
 
       switch (failure_response) {
         case OTA_Failure_Response::RETRY_CHUNK:
-          Request_Next_Firmware_Packet();
+          Request_Missing_Firmware_Packets();
           break;
         case OTA_Failure_Response::RETRY_UPDATE:
           Request_First_Firmware_Packet();
@@ -9,13 +9,13 @@ OTA_Update_Callback::OTA_Update_Callback() :
     // Nothing to do
 }
 
-OTA_Update_Callback::OTA_Update_Callback(function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries, const uint16_t &chunkSize, const uint64_t &timeout) :
-    OTA_Update_Callback(nullptr, endCb, currFwTitle, currFwVersion, updater, chunkRetries, chunkSize, timeout)
+OTA_Update_Callback::OTA_Update_Callback(function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries, const uint16_t &chunkSize, const uint64_t &timeout, const uint8_t &chunkWindow) :
+    OTA_Update_Callback(nullptr, endCb, currFwTitle, currFwVersion, updater, chunkRetries, chunkSize, timeout, chunkWindow)
 {
     // Nothing to do
 }
 
-OTA_Update_Callback::OTA_Update_Callback(progressFn progressCb, function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries, const uint16_t &chunkSize, const uint64_t &timeout) :
+OTA_Update_Callback::OTA_Update_Callback(progressFn progressCb, function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries, const uint16_t &chunkSize, const uint64_t &timeout, const uint8_t &chunkWindow) :
     Callback(endCb, OTA_CB_IS_NULL),
     m_progressCb(progressCb),
     m_fwTitel(currFwTitle),
@@ -23,7 +23,10 @@ OTA_Update_Callback::OTA_Update_Callback(progressFn progressCb, function endCb,
     m_updater(updater),
     m_retries(chunkRetries),
     m_size(chunkSize),
-    m_timeout(timeout)
+    m_timeout(timeout),
+    m_window(chunkWindow),
+    m_checkpointStore(nullptr),
+    m_checkpointInterval(CHECKPOINT_INTERVAL)
 {
     // Nothing to do
 }
@@ -80,4 +83,28 @@ void OTA_Update_Callback::Set_Timeout(const uint64_t &timeout_microseconds) {
     m_timeout = timeout_microseconds;
 }
 
+const uint8_t& OTA_Update_Callback::Get_Chunk_Window() const {
+    return m_window;
+}
+
+void OTA_Update_Callback::Set_Chunk_Window(const uint8_t &chunkWindow) {
+    m_window = chunkWindow;
+}
+
+IOTA_Checkpoint_Store* OTA_Update_Callback::Get_Checkpoint_Store() const {
+    return m_checkpointStore;
+}
+
+void OTA_Update_Callback::Set_Checkpoint_Store(IOTA_Checkpoint_Store *checkpointStore) {
+    m_checkpointStore = checkpointStore;
+}
+
+const uint16_t& OTA_Update_Callback::Get_Checkpoint_Interval() const {
+    return m_checkpointInterval;
+}
+
+void OTA_Update_Callback::Set_Checkpoint_Interval(const uint16_t &checkpointInterval) {
+    m_checkpointInterval = checkpointInterval;
+}
+
 #endif // THINGSBOARD_ENABLE_OTA
@@ -8,6 +8,7 @@
 
 // Local includes.
 #include "IUpdater.h"
+#include "IOTA_Checkpoint_Store.h"
 
 // Library includes.
 #if THINGSBOARD_ENABLE_PROGMEM
@@ -29,10 +30,14 @@ constexpr char OTA_CB_IS_NULL[] = "OTA update callback is NULL";
 constexpr uint8_t CHUNK_RETRIES PROGMEM = 12U;
 constexpr uint16_t CHUNK_SIZE PROGMEM = (4U * 1024U);
 constexpr uint64_t REQUEST_TIMEOUT PROGMEM = (5U * 1000U * 1000U);
+constexpr uint8_t CHUNK_WINDOW PROGMEM = 4U;
+constexpr uint16_t CHECKPOINT_INTERVAL PROGMEM = 16U;
 #else
 constexpr uint8_t CHUNK_RETRIES = 12U;
 constexpr uint16_t CHUNK_SIZE = (4U * 1024U);
 constexpr uint64_t REQUEST_TIMEOUT = (5U * 1000U * 1000U);
+constexpr uint8_t CHUNK_WINDOW = 4U;
+constexpr uint16_t CHECKPOINT_INTERVAL = 16U;
 #endif // THINGSBOARD_ENABLE_PROGMEM
 
 
@@ -62,7 +67,10 @@ class OTA_Update_Callback : public Callback<void, const bool&> {
     // because the whole chunk is saved into the heap before it can be processed and is then erased again after it has been used
     /// @param timeout Maximum amount of time in microseconds for the OTA firmware update for each seperate chunk,
     /// until that chunk counts as a timeout, retries is then subtraced by one and the download is retried
-    OTA_Update_Callback(function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries = CHUNK_RETRIES, const uint16_t &chunkSize = CHUNK_SIZE, const uint64_t &timeout = REQUEST_TIMEOUT);
+    /// @param chunkWindow Maximum amount of chunks that are requested from the server at once, before we wait for the first of them to arrive,
+    /// increasing hides the round trip time of each request, but requires up to (chunkWindow - 1) * chunkSize additional bytes of heap memory,
+    /// because chunks that arrive out of order have to be buffered until all previous chunks have been written, 1 requests one chunk after the other
+    OTA_Update_Callback(function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries = CHUNK_RETRIES, const uint16_t &chunkSize = CHUNK_SIZE, const uint64_t &timeout = REQUEST_TIMEOUT, const uint8_t &chunkWindow = CHUNK_WINDOW);
 
     /// @brief Constructs callbacks that will be called when the OTA firmware data,
     /// has been completly sent by the cloud, received by the client and written to the flash partition as well as callback
@@ -80,7 +88,10 @@ class OTA_Update_Callback : public Callback<void, const bool&> {
     // because the whole chunk is saved into the heap before it can be processed and is then erased again after it has been used
     /// @param timeout Maximum amount of time in microseconds for the OTA firmware update for each seperate chunk,
     /// until that chunk counts as a timeout, retries is then subtraced by one and the download is retried
-    OTA_Update_Callback(progressFn progressCb, function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries = CHUNK_RETRIES, const uint16_t &chunkSize = CHUNK_SIZE, const uint64_t &timeout = REQUEST_TIMEOUT);
+    /// @param chunkWindow Maximum amount of chunks that are requested from the server at once, before we wait for the first of them to arrive,
+    /// increasing hides the round trip time of each request, but requires up to (chunkWindow - 1) * chunkSize additional bytes of heap memory,
+    /// because chunks that arrive out of order have to be buffered until all previous chunks have been written, 1 requests one chunk after the other
+    OTA_Update_Callback(progressFn progressCb, function endCb, const char *currFwTitle, const char *currFwVersion, IUpdater *updater, const uint8_t &chunkRetries = CHUNK_RETRIES, const uint16_t &chunkSize = CHUNK_SIZE, const uint64_t &timeout = REQUEST_TIMEOUT, const uint8_t &chunkWindow = CHUNK_WINDOW);
 
     /// @brief Calls the progress callback that was subscribed, when this class instance was initally created
     /// @tparam Logger Logging class that should be used to print messages generated by internal processes
@@ -164,6 +175,34 @@ class OTA_Update_Callback : public Callback<void, const bool&> {
     /// @param timeout_microseconds Timeout time until we expect a response from the server
     void Set_Timeout(const uint64_t &timeout_microseconds);
 
+    /// @brief Gets the maximum amount of chunks that are requested from the server at once, before we wait for the first of them to arrive
+    /// @return Amount of chunk requests that are kept in flight at the same time
+    const uint8_t& Get_Chunk_Window() const;
+
+    /// @brief Sets the maximum amount of chunks that are requested from the server at once, before we wait for the first of them to arrive,
+    /// increasing hides the round trip time of each request, but requires up to (chunkWindow - 1) * chunkSize additional bytes of heap memory
+    /// @param chunkWindow Amount of chunk requests that are kept in flight at the same time, 0 is treated as 1
+    void Set_Chunk_Window(const uint8_t &chunkWindow);
+
+    /// @brief Gets the checkpoint store implementation, used to persist the progress of the update every few chunks,
+    /// so that an interrupted download can be continued after a restart instead of being started from the beginning
+    /// @return Checkpoint store implementation or nullptr if the update should not be resumable
+    IOTA_Checkpoint_Store* Get_Checkpoint_Store() const;
+
+    /// @brief Sets the checkpoint store implementation, used to persist the progress of the update every few chunks,
+    /// resuming additionally requires an updater implementation that supports IUpdater::resume()
+    /// @param checkpointStore Checkpoint store implementation or nullptr if the update should not be resumable
+    void Set_Checkpoint_Store(IOTA_Checkpoint_Store *checkpointStore);
+
+    /// @brief Gets the amount of chunks that are written between two checkpoints
+    /// @return Amount of chunks between two checkpoints
+    const uint16_t& Get_Checkpoint_Interval() const;
+
+    /// @brief Sets the amount of chunks that are written between two checkpoints, decreasing reduces the amount of data that has to be downloaded again
+    /// after an interruption, but increases the amount of writes into non-volatile memory
+    /// @param checkpointInterval Amount of chunks between two checkpoints, 0 is treated as 1
+    void Set_Checkpoint_Interval(const uint16_t &checkpointInterval);
+
   private:
     progressFn      m_progressCb;    // Progress callback to call
     const char      *m_fwTitel;      // Current firmware title of device
@@ -172,6 +211,9 @@ class OTA_Update_Callback : public Callback<void, const bool&> {
     uint8_t         m_retries;       // Maximum amount of retries for a single chunk to be downloaded and flashes successfully
     uint16_t        m_size;          // Size of chunks the firmware data will be split into
     uint64_t        m_timeout;       // How long we wait for each chunck to arrive before declaring it as failed
+    uint8_t         m_window;        // How many chunks are requested at once before waiting for the first of them to arrive
+    IOTA_Checkpoint_Store *m_checkpointStore; // Checkpoint store implementation used to persist the progress of the update
+    uint16_t        m_checkpointInterval;     // How many chunks are written between two checkpoints
 };
 
 #endif // THINGSBOARD_ENABLE_OTA
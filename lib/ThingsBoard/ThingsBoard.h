@@ -777,7 +777,9 @@ class ThingsBoardSized {
       }
 
       // Push back complete vector into our local m_rpc_callbacks vector.
-      m_rpc_callbacks.insert(m_rpc_callbacks.end(), first_itr, last_itr);
+      for (InputIterator itr = first_itr; itr != last_itr; ++itr) {
+        m_rpc_callbacks.push_back(*itr);
+      }
       return true;
     }
 
@@ -1022,7 +1024,9 @@ class ThingsBoardSized {
       }
 
       // Push back complete vector into our local m_shared_attribute_update_callbacks vector.
-      m_shared_attribute_update_callbacks.insert(m_shared_attribute_update_callbacks.end(), first_itr, last_itr);
+      for (InputIterator itr = first_itr; itr != last_itr; ++itr) {
+        m_shared_attribute_update_callbacks.push_back(*itr);
+      }
       return true;
     }
 
@@ -1910,11 +1914,15 @@ class ThingsBoardSized {
       return telemetry ? sendTelemetryJson(object, Helper::Measure_Json(object)) : sendAttributeJSON(object, Helper::Measure_Json(object));
     }
 
-    /// @brief Vector signature
-#if THINGSBOARD_ENABLE_STL
+    /// @brief Callback vector signature, keeps up to MaxFieldsAmt callbacks inline so subscribing does not allocate on the heap,
+    /// if THINGSBOARD_ENABLE_DYNAMIC is set the default amount is stored inline instead and the vector grows geometrically onto the heap afterwards
+#if THINGSBOARD_ENABLE_DYNAMIC
     template<typename T>
-    using Vector = std::vector<T>;
-#endif // THINGSBOARD_ENABLE_STL
+    using Callback_Vector = Vector<T, Default_Fields_Amt>;
+#else
+    template<typename T>
+    using Callback_Vector = Vector<T, MaxFieldsAmt>;
+#endif // THINGSBOARD_ENABLE_DYNAMIC
 
     IMQTT_Client& m_client; // MQTT client instance.
     size_t m_max_stack; // Maximum stack size we allocate at once.
@@ -1928,10 +1936,10 @@ class ThingsBoardSized {
     // of its usage, which will lead to dangling references and undefined behaviour.
     // Therefore copy-by-value has been choosen as for this specific use case it is more advantageous,
     // especially because at most we copy a vector, that will only ever contain a few pointers
-    Vector<RPC_Callback> m_rpc_callbacks; // Server side RPC callbacks vector, replacement for non C++ STL boards
-    Vector<RPC_Request_Callback> m_rpc_request_callbacks; // Client side RPC callbacks vector, replacement for non C++ STL boards
-    Vector<Shared_Attribute_Callback> m_shared_attribute_update_callbacks; // Shared attribute update callbacks vector, replacement for non C++ STL boards
-    Vector<Attribute_Request_Callback> m_attribute_request_callbacks; // Client-side or shared attribute request callback vector, replacement for non C++ STL boards
+    Callback_Vector<RPC_Callback> m_rpc_callbacks; // Server side RPC callbacks vector
+    Callback_Vector<RPC_Request_Callback> m_rpc_request_callbacks; // Client side RPC callbacks vector
+    Callback_Vector<Shared_Attribute_Callback> m_shared_attribute_update_callbacks; // Shared attribute update callbacks vector
+    Callback_Vector<Attribute_Request_Callback> m_attribute_request_callbacks; // Client-side or shared attribute request callback vector
 
     Provision_Callback m_provision_callback; // Provision response callback
     size_t m_request_id; // Allows nearly 4.3 million requests before wrapping back to 0
@@ -2,32 +2,100 @@
 #define Vector_h
 
 // Local include.
-#include "Configuration.h"
-
-#if !THINGSBOARD_ENABLE_STL
+#include "Constants.h"
 
 // Library includes.
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __has_include
+#  if __has_include(<new>)
+#    include <new>
+#  else
+#    include <new.h>
+#  endif
+#else
+#  include <new.h>
+#endif
 
 
-/// @brief Replacement data container for boards that do not support the C++ STL.
-/// @tparam T Type of the underlying data the list should point too.
-template <typename T>
+/// @brief Data container that stores the first InlineCapacity elements directly inside of the object itself and only falls back to the heap,
+/// if more elements than that are inserted. Once on the heap the capacity grows geometrically (doubles), meaning inserting n elements causes at most log2(n) allocations,
+/// instead of allocating and copying the complete container on every insert. Used for the callback lists in ThingsBoard, because those are only ever filled
+/// when subscribing and therefore normally never leave the inline storage, which removes heap fragmentation completly for the common use case.
+/// Works on boards with and without C++ STL support, because only placement new is required to construct the elements into the raw storage.
+/// @tparam T Type of the underlying data the list should point too
+/// @tparam InlineCapacity Amount of elements that can be stored without allocating any memory on the heap, has to be at least 1
+template <typename T, size_t InlineCapacity = Default_Fields_Amt>
 class Vector {
+  static_assert(InlineCapacity > 0U, "Vector requires an inline capacity of at least one element");
+
   public:
     /// @brief Constructor
     inline Vector(void) :
-        m_elements(nullptr),
-        m_capacity(0U),
+        m_elements(inline_elements()),
+        m_capacity(InlineCapacity),
         m_size(0U)
     {
         // Nothing to do
     }
 
+    /// @brief Copy constructor, copies all elements of the other container into our own storage
+    /// @param other Container we want to copy the elements from
+    inline Vector(const Vector& other) :
+        m_elements(inline_elements()),
+        m_capacity(InlineCapacity),
+        m_size(0U)
+    {
+        reserve(other.m_size);
+        for (size_t i = 0U; i < other.m_size; i++) {
+            new (&m_elements[i]) T(other.m_elements[i]);
+        }
+        m_size = other.m_size;
+    }
+
+    /// @brief Move constructor, takes over the heap allocation of the other container if there is one,
+    /// or moves the elements one by one if they are still contained in the inline storage
+    /// @param other Container we want to move the elements from, will be empty afterwards
+    inline Vector(Vector&& other) :
+        m_elements(inline_elements()),
+        m_capacity(InlineCapacity),
+        m_size(0U)
+    {
+        take(other);
+    }
+
     /// @brief Destructor
     inline ~Vector() {
-        delete[] m_elements;
-        m_elements = nullptr;
+        clear();
+        release();
+    }
+
+    /// @brief Copy assignment operator
+    /// @param other Container we want to copy the elements from
+    /// @return Reference to this container
+    inline Vector& operator=(const Vector& other) {
+        if (this != &other) {
+            clear();
+            reserve(other.m_size);
+            for (size_t i = 0U; i < other.m_size; i++) {
+                new (&m_elements[i]) T(other.m_elements[i]);
+            }
+            m_size = other.m_size;
+        }
+        return *this;
+    }
+
+    /// @brief Move assignment operator
+    /// @param other Container we want to move the elements from, will be empty afterwards
+    /// @return Reference to this container
+    inline Vector& operator=(Vector&& other) {
+        if (this != &other) {
+            clear();
+            release();
+            take(other);
+        }
+        return *this;
     }
 
     /// @brief Returns whether there are still any element in the underlying data container
@@ -47,13 +115,25 @@ class Vector {
     inline const size_t& capacity() const {
         return m_capacity;
     }
-    
+
+    /// @brief Returns whether the elements are still stored in the inline storage or were moved onto the heap
+    /// @return Whether no heap memory is currently allocated by this container
+    inline bool is_inline() const {
+        return m_elements == inline_elements();
+    }
+
     /// @brief Returns a pointer to the first element of the vector
     /// @return Pointer to the first element of the vector
     inline T* begin() {
         return m_elements;
     }
 
+    /// @brief Returns a constant pointer to the first element of the vector
+    /// @return Constant pointer to the first element of the vector
+    inline const T* begin() const {
+        return m_elements;
+    }
+
     /// @brief Returns the last element of the vector
     /// @return Reference to the last element of the vector
     inline T& back() {
@@ -67,6 +147,12 @@ class Vector {
         return m_elements + m_size;
     }
 
+    /// @brief Returns a constant pointer to one-past-the-end element of the vector
+    /// @return Constant pointer to one-past-the-end element of the vector
+    inline const T* end() const {
+        return m_elements + m_size;
+    }
+
     /// @brief Returns a constant pointer to the first element of the vector
     /// @return Constant pointer to the first element of the vector
     inline const T* cbegin() const {
@@ -79,16 +165,12 @@ class Vector {
         return m_elements + m_size;
     }
 
-    /// @brief Reserves the given capacity for the underlying data container
+    /// @brief Reserves the given capacity for the underlying data container,
+    /// does nothing if the given capacity already fits into the current storage
     /// @param capacity Capacity that should be reserved in the underlying data container
     inline void reserve(const size_t& capacity) {
         if (capacity > m_capacity) {
-            T* newElements = new T[m_capacity];
-            if (m_elements != nullptr) {
-                memcpy(newElements, m_elements, m_size * sizeof(T));
-                delete[] m_elements;
-            }
-            m_elements = newElements;
+            reallocate(capacity);
         }
     }
 
@@ -96,15 +178,28 @@ class Vector {
     /// @param element Element that should be inserted at the end
     inline void push_back(const T& element) {
         if (m_size == m_capacity) {
-            m_capacity = (m_capacity == 0) ? 1 : 2 * m_capacity;
-            T* newElements = new T[m_capacity];
-            if (m_elements != nullptr) {
-                memcpy(newElements, m_elements, m_size * sizeof(T));
-                delete[] m_elements;
-            }
-            m_elements = newElements;
+            // Copy the element before growing, because it could be a reference to one of our own elements
+            T copy(element);
+            grow();
+            new (&m_elements[m_size]) T(move(copy));
+        }
+        else {
+            new (&m_elements[m_size]) T(element);
+        }
+        m_size++;
+    }
+
+    /// @brief Moves the given element to the end of the underlying data container
+    /// @param element Element that should be moved to the end
+    inline void push_back(T&& element) {
+        if (m_size == m_capacity) {
+            T moved(move(element));
+            grow();
+            new (&m_elements[m_size]) T(move(moved));
+        }
+        else {
+            new (&m_elements[m_size]) T(move(element));
         }
-        m_elements[m_size] = element;
         m_size++;
     }
 
@@ -114,14 +209,21 @@ class Vector {
         // Check if the given index is bigger or equal than the actual amount of elements if it is we can not erase that element because it does not exist
         if (index < m_size) {
             // Move all elements after the index one position to the left
-            for (size_t i = index; i < m_size - 1; i++) {
-                m_elements[i] = m_elements[i + 1];
+            for (size_t i = index; i < m_size - 1U; i++) {
+                m_elements[i] = move(m_elements[i + 1U]);
             }
-            // Decrease the size of the vector to remove the last element, because either it was moved one index to the left or was the element we wanted to delete
+            // Decrease the size of the vector and destroy the last element, because it was either moved one index to the left or was the element we wanted to delete
             m_size--;
+            m_elements[m_size].~T();
         }
     }
 
+    /// @brief Removes the element at the given position, allows to use the same interface as std::vector::erase
+    /// @param position Pointer to the element that should be removed from the underlying data container
+    inline void erase(const T* position) {
+        erase(static_cast<size_t>(position - m_elements));
+    }
+
     /// @brief Method to access an element at a given index,
     /// ensures the device crashes if we attempted to access in an invalid location
     /// @param index Index we want to get the corresponding element for
@@ -130,6 +232,14 @@ class Vector {
         return m_elements[index];
     }
 
+    /// @brief Method to access an element at a given index,
+    /// ensures the device crashes if we attempted to access in an invalid location
+    /// @param index Index we want to get the corresponding element for
+    inline const T& at(const size_t& index) const {
+        assert(index < m_size);
+        return m_elements[index];
+    }
+
     /// @brief Bracket operator to access an element at a given index
     /// @param index Index we want to get the corresponding element for
     inline T& operator[](const size_t& index) {
@@ -143,17 +253,84 @@ class Vector {
     }
 
     /// @brief Clears the given underlying data container.
-    /// Simply sets the underlying size to 0, data will only be cleared in the destructor
+    /// Destroys all contained elements, but keeps the already allocated capacity to allow reusing it
     inline void clear() {
-        m_size = 0;
+        for (size_t i = 0U; i < m_size; i++) {
+            m_elements[i].~T();
+        }
+        m_size = 0U;
     }
 
   private:
-    T* m_elements;      // Pointer to the start of our elements
-    size_t m_capacity;  // Allocated capacity that shows how many elements we could hold
-    size_t m_size;      // Used size that shows how many elements we entered
-};
+    alignas(T) uint8_t m_inline[InlineCapacity * sizeof(T)]; // Raw storage for the first InlineCapacity elements, constructed with placement new
+    T* m_elements;                                           // Pointer to the start of our elements, either the inline storage or a heap allocation
+    size_t m_capacity;                                       // Allocated capacity that shows how many elements we could hold
+    size_t m_size;                                           // Used size that shows how many elements we entered
+
+    /// @brief Replacement for std::move, because it is not available on boards without C++ STL support
+    /// @param element Element that should be casted to a rvalue reference
+    /// @return Rvalue reference to the given element
+    static inline T&& move(T& element) {
+        return static_cast<T&&>(element);
+    }
+
+    /// @brief Returns a pointer to the inline storage of this container
+    /// @return Pointer to the inline storage
+    inline T* inline_elements() {
+        return reinterpret_cast<T*>(m_inline);
+    }
+
+    /// @brief Returns a constant pointer to the inline storage of this container
+    /// @return Constant pointer to the inline storage
+    inline const T* inline_elements() const {
+        return reinterpret_cast<const T*>(m_inline);
+    }
 
-#endif // !THINGSBOARD_ENABLE_STL
+    /// @brief Doubles the current capacity, called once the container is full and another element should be inserted
+    inline void grow() {
+        reallocate(2U * m_capacity);
+    }
+
+    /// @brief Allocates raw heap storage for the given capacity and moves all current elements into it
+    /// @param capacity Amount of elements the new storage should be able to hold
+    inline void reallocate(const size_t& capacity) {
+        T* new_elements = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0U; i < m_size; i++) {
+            new (&new_elements[i]) T(move(m_elements[i]));
+            m_elements[i].~T();
+        }
+        release();
+        m_elements = new_elements;
+        m_capacity = capacity;
+    }
+
+    /// @brief Frees the heap storage if there is one and falls back to the inline storage, expects all elements to already be destroyed
+    inline void release() {
+        if (!is_inline()) {
+            ::operator delete(m_elements);
+        }
+        m_elements = inline_elements();
+        m_capacity = InlineCapacity;
+    }
+
+    /// @brief Takes over the elements of the given container, expects this container to be empty and using the inline storage
+    /// @param other Container we want to take the elements from, will be empty and using its inline storage afterwards
+    inline void take(Vector& other) {
+        if (other.is_inline()) {
+            for (size_t i = 0U; i < other.m_size; i++) {
+                new (&m_elements[i]) T(move(other.m_elements[i]));
+            }
+            m_size = other.m_size;
+            other.clear();
+            return;
+        }
+        m_elements = other.m_elements;
+        m_capacity = other.m_capacity;
+        m_size = other.m_size;
+        other.m_elements = other.inline_elements();
+        other.m_capacity = InlineCapacity;
+        other.m_size = 0U;
+    }
+};
 
 #endif // Vector_h
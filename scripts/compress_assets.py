@@ -0,0 +1,73 @@
+# Minifies and gzips the web assets before the LittleFS image is built
+#
+# The HTML sources stay readable in data/, the filesystem image is built from
+# .pio/build/<env>/data instead, which only contains the .gz variants.
+# WiFiConfigServer serves those with Content-Encoding: gzip and an ETag.
+# Assets are only regenerated when their source changed since the last build.
+#
+# Enabled in platformio.ini with:
+#   extra_scripts = pre:scripts/compress_assets.py
+
+import gzip
+import os
+import re
+import shutil
+
+Import("env")
+
+COMPRESSED_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg")
+
+
+def minify(text):
+    # Conservative on purpose: drop HTML comments, indentation and empty lines,
+    # but keep the line breaks so inline scripts relying on them still work
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    lines = (line.strip() for line in text.splitlines())
+    return "\n".join(line for line in lines if line)
+
+
+def build_asset(source, target):
+    if os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+        return False
+    with open(source, "r", encoding="utf-8") as f:
+        content = minify(f.read()).encode("utf-8")
+    # mtime=0 keeps the output identical for identical input, so the ETag only changes with the content
+    with open(target, "wb") as f:
+        f.write(gzip.compress(content, compresslevel=9, mtime=0))
+    print(f"Assets: {os.path.relpath(source)} {os.path.getsize(source)} -> {os.path.getsize(target)} bytes")
+    return True
+
+
+def build_assets():
+    source_dir = env.subst("$PROJECT_DATA_DIR")
+    target_dir = os.path.join(env.subst("$BUILD_DIR"), "data")
+    expected = set()
+
+    for root, _, files in os.walk(source_dir):
+        relative = os.path.relpath(root, source_dir)
+        os.makedirs(os.path.join(target_dir, relative), exist_ok=True)
+        for name in files:
+            source = os.path.join(root, name)
+            if name.endswith(COMPRESSED_EXTENSIONS):
+                target = os.path.join(target_dir, relative, name + ".gz")
+                build_asset(source, target)
+            else:
+                target = os.path.join(target_dir, relative, name)
+                if not os.path.exists(target) or os.path.getmtime(target) < os.path.getmtime(source):
+                    shutil.copy2(source, target)
+            expected.add(os.path.normpath(target))
+
+    # Remove outputs of sources that were deleted
+    for root, _, files in os.walk(target_dir):
+        for name in files:
+            path = os.path.normpath(os.path.join(root, name))
+            if path not in expected:
+                os.remove(path)
+
+    env.Replace(PROJECT_DATA_DIR=target_dir)
+    # The native environment has no filesystem image, its LittleFS reads this directory directly
+    if env.get("PIOPLATFORM") == "native":
+        env.Append(CPPDEFINES=[("NATIVE_FS_ROOT", env.StringifyMacro(target_dir))])
+
+
+build_assets()
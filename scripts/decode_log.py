@@ -0,0 +1,144 @@
+# Decodes the raw output of the deferred logger (see include/deferred_log.h)
+#
+# Enable raw output on the device with log_begin(true) or log_set_raw(true), then:
+#   python scripts/decode_log.py capture.bin
+#   python scripts/decode_log.py --port /dev/ttyACM0          (needs pyserial)
+#
+# Frames: A5 5A, ring index, record. Records: u8 length, u16 id, u32 millis, arguments
+# (4 byte little endian int or float, strings as u8 length + bytes). Message ids and
+# formats are read from include/log_messages.def, so the decoder has to be run against
+# the same revision as the firmware. Bytes outside of frames (boot messages of the ROM,
+# Serial.print calls that were not converted) are passed through unchanged.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = b"\xA5\x5A"
+HEADER = struct.Struct("<BHI")
+ID_TASK_NAME = 0xFFFF
+ID_DROPPED = 0xFFFE
+LEVEL_LETTERS = {"LOG_LEVEL_DEBUG": "D", "LOG_LEVEL_INFO": "I", "LOG_LEVEL_WARN": "W", "LOG_LEVEL_ERROR": "E"}
+
+MESSAGE = re.compile(r'^LOG_MESSAGE\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', re.M)
+CONVERSION = re.compile(r"%([-+ #0-9.]*)([diuxXocfeEgGs%])")
+
+
+def load_messages(path):
+    with open(path, "r", encoding="utf-8") as f:
+        text = f.read()
+    messages = []
+    for name, level, fmt in MESSAGE.findall(text):
+        fmt = fmt.replace('\\"', '"').replace("\\\\", "\\")
+        messages.append((name, LEVEL_LETTERS.get(level, "?"), fmt))
+    return messages
+
+
+def format_message(fmt, args):
+    pos = 0
+
+    def convert(match):
+        nonlocal pos
+        flags, conv = match.groups()
+        if conv == "%":
+            return "%"
+        try:
+            if conv == "s":
+                length = args[pos]
+                value = args[pos + 1:pos + 1 + length].decode("utf-8", "replace")
+                pos += 1 + length
+                return ("%" + flags + "s") % value
+            value, = struct.unpack_from("<f" if conv in "feEgG" else "<i", args, pos)
+            pos += 4
+            if conv in "uxXo" and value < 0:
+                value += 1 << 32
+            if conv == "c":
+                value = chr(value & 0xFF)
+            if conv in "iu":
+                conv = "d"
+            return ("%" + flags + conv) % value
+        except (IndexError, struct.error):
+            return "?"
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode(stream, messages, out, live=False):
+    tasks = {}
+    buffer = b""
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            if live:
+                continue
+            break
+        buffer += chunk
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                # Keep a trailing A5, it may be the start of the next sync
+                keep = 1 if buffer.endswith(SYNC[:1]) else 0
+                out.write(buffer[:len(buffer) - keep].decode("utf-8", "replace"))
+                buffer = buffer[len(buffer) - keep:]
+                break
+            if start:
+                out.write(buffer[:start].decode("utf-8", "replace"))
+                buffer = buffer[start:]
+            if len(buffer) < 3 + HEADER.size:
+                break
+            ring = buffer[2]
+            length, msg_id, millis = HEADER.unpack_from(buffer, 3)
+            if length < HEADER.size:
+                # Not a frame after all
+                out.write(buffer[:1].decode("utf-8", "replace"))
+                buffer = buffer[1:]
+                continue
+            if len(buffer) < 3 + length:
+                break
+            args = buffer[3 + HEADER.size:3 + length]
+            buffer = buffer[3 + length:]
+
+            if msg_id == ID_TASK_NAME:
+                tasks[ring] = args[1:1 + args[0]].decode("utf-8", "replace")
+                continue
+            task = tasks.get(ring, f"ring {ring}")
+            stamp = f"[{millis // 1000}.{millis % 1000:03d}]"
+            if msg_id == ID_DROPPED:
+                count, = struct.unpack_from("<I", args)
+                out.write(f"{stamp} [log] {count} messages of task {task} dropped\n")
+            elif msg_id < len(messages):
+                name, level, fmt = messages[msg_id]
+                out.write(f"{stamp} {level} {task}: {format_message(fmt, args)}\n")
+            else:
+                out.write(f"{stamp} ? {task}: unknown message id {msg_id}\n")
+        out.flush()
+
+
+def main():
+    default_def = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include", "log_messages.def")
+    parser = argparse.ArgumentParser(description="Decode the raw output of the deferred logger")
+    parser.add_argument("capture", nargs="?", help="captured serial output (default: stdin)")
+    parser.add_argument("--port", help="read from a serial port instead of a file")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--messages", default=default_def, help="log_messages.def of the firmware")
+    args = parser.parse_args()
+
+    messages = load_messages(args.messages)
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+    elif args.capture:
+        stream = open(args.capture, "rb")
+    else:
+        stream = sys.stdin.buffer
+    try:
+        decode(stream, messages, sys.stdout, live=bool(args.port))
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
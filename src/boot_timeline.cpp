@@ -0,0 +1,81 @@
+#include "boot_timeline.h"
+#include "deferred_log.h"
+#include "metrics.h"
+
+#define BOOT_BEGUN 1
+#define BOOT_ENDED 2
+
+static const char* const BOOT_STAGE_NAMES[BOOT_STAGE_COUNT] = {
+    "setup", "config", "lcd", "dht_warmup", "first_dht", "first_light", "web_server", "wifi", "first_publish"
+};
+
+// The times are written before the state bit that publishes them
+static int64_t stageBegin[BOOT_STAGE_COUNT];
+static int64_t stageEnd[BOOT_STAGE_COUNT];
+static uint8_t stageState[BOOT_STAGE_COUNT];
+
+static uint8_t stage_state(BootStage stage) {
+    return __atomic_load_n(&stageState[stage], __ATOMIC_ACQUIRE);
+}
+
+void boot_stage_begin(BootStage stage) {
+    if (stage_state(stage) != 0) {
+        return;
+    }
+    stageBegin[stage] = esp_timer_get_time();
+    __atomic_store_n(&stageState[stage], BOOT_BEGUN, __ATOMIC_RELEASE);
+}
+
+void boot_stage_end(BootStage stage) {
+    uint8_t state = stage_state(stage);
+    if (state & BOOT_ENDED) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (!(state & BOOT_BEGUN)) {
+        stageBegin[stage] = now;
+    }
+    stageEnd[stage] = now;
+    __atomic_store_n(&stageState[stage], BOOT_BEGUN | BOOT_ENDED, __ATOMIC_RELEASE);
+    if (stage == BOOT_FIRST_PUBLISH) {
+        metric_boot_first_publish.set(now / 1000000.0f);
+    }
+    LOG(BOOT_STAGE, BOOT_STAGE_NAMES[stage], stageBegin[stage] / 1000.0f, now / 1000.0f);
+}
+
+void boot_mark(BootStage stage) {
+    boot_stage_end(stage);
+}
+
+bool boot_stage_done(BootStage stage) {
+    return stage_state(stage) & BOOT_ENDED;
+}
+
+bool boot_timeline_write(Print& out, size_t item) {
+    if (item >= BOOT_STAGE_COUNT) {
+        out.print("]}");
+        return false;
+    }
+    if (item == 0) {
+        out.printf("{\"uptime_us\":%lld,\"stages\":[", (long long)esp_timer_get_time());
+    } else {
+        out.print(",");
+    }
+    // Stages that have not begun or ended yet are null
+    BootStage stage = (BootStage)item;
+    uint8_t state = stage_state(stage);
+    out.printf("{\"name\":\"%s\",\"start_us\":", BOOT_STAGE_NAMES[stage]);
+    if (state & BOOT_BEGUN) {
+        out.printf("%lld", (long long)stageBegin[stage]);
+    } else {
+        out.print("null");
+    }
+    out.print(",\"end_us\":");
+    if (state & BOOT_ENDED) {
+        out.printf("%lld", (long long)stageEnd[stage]);
+    } else {
+        out.print("null");
+    }
+    out.print("}");
+    return true;
+}
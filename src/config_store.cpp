@@ -0,0 +1,259 @@
+#include "config_store.h"
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "global.h"
+#include "metrics.h"
+#include "memory_budget.h"
+
+struct ConfigHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;      // sizeof(DeviceConfig) of the version
+};
+
+struct ConfigListenerEntry {
+    uint8_t parts;
+    ConfigListener listener;
+    void* arg;
+};
+
+static SemaphoreHandle_t configMutex = nullptr;    // Guards current
+static SemaphoreHandle_t writeMutex = nullptr;     // One change at a time, held while the listeners run
+static DeviceConfig current;
+static ConfigListenerEntry listeners[CONFIG_MAX_LISTENERS];
+static size_t listenerCount = 0;
+
+static uint32_t config_crc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void copy_field(char* to, const char* from, size_t size) {
+    // strncpy zeroes the rest, equal configs are equal byte for byte
+    strncpy(to, from ? from : "", size - 1);
+    to[size - 1] = '\0';
+}
+
+static bool read_config(DeviceConfig& config) {
+    if (!LittleFS.exists(CONFIG_PATH)) {
+        return false;
+    }
+    File file = LittleFS.open(CONFIG_PATH, "r");
+    if (!file) {
+        return false;
+    }
+    ConfigHeader header;
+    uint32_t crc = 0;
+    bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == CONFIG_MAGIC;
+    // A newer version is from a firmware that was rolled back
+    if (valid && header.version > CONFIG_VERSION) {
+        Serial.printf("Config version %u is not supported\n", header.version);
+        valid = false;
+    }
+    // Older versions are shorter, the fields they lack stay zero until the next write
+    valid = valid && header.size <= sizeof(DeviceConfig) &&
+            file.read((uint8_t*)&config, header.size) == header.size &&
+            file.read((uint8_t*)&crc, sizeof(crc)) == sizeof(crc) &&
+            crc == config_crc32((const uint8_t*)&config, header.size);
+    file.close();
+    if (!valid) {
+        Serial.println("Config file is damaged, ignored");
+    }
+    return valid;
+}
+
+static bool write_config(const DeviceConfig& config) {
+    ConfigHeader header = { CONFIG_MAGIC, CONFIG_VERSION, sizeof(DeviceConfig) };
+    uint32_t crc = config_crc32((const uint8_t*)&config, sizeof(config));
+    File file = LittleFS.open(CONFIG_TMP_PATH, "w");
+    if (!file) {
+        return false;
+    }
+    bool written = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                   file.write((const uint8_t*)&config, sizeof(config)) == sizeof(config) &&
+                   file.write((const uint8_t*)&crc, sizeof(crc)) == sizeof(crc);
+    file.close();
+    // LittleFS replaces the old file in one step
+    if (!written || !LittleFS.rename(CONFIG_TMP_PATH, CONFIG_PATH)) {
+        LittleFS.remove(CONFIG_TMP_PATH);
+        metric_config_write_failures.inc();
+        return false;
+    }
+    metric_config_writes.inc();
+    return true;
+}
+
+// The copies the rest of the firmware reads
+static void update_globals(const DeviceConfig& config) {
+    strlcpy(WIFI_SSID, config.wifiSsid, sizeof(WIFI_SSID));
+    strlcpy(WIFI_PASS, config.wifiPassword, sizeof(WIFI_PASS));
+    strlcpy(CORE_IOT_TOKEN, config.coreIotToken, sizeof(CORE_IOT_TOKEN));
+    strlcpy(CORE_IOT_SERVER, config.coreIotServer, sizeof(CORE_IOT_SERVER));
+    CORE_IOT_PORT = config.coreIotPort;
+}
+
+// Reads /info.dat and the WiFi login of the web server, false if there is neither
+static bool migrate(DeviceConfig& config) {
+    bool found = false;
+    if (LittleFS.exists(CONFIG_LEGACY_PATH)) {
+        File file = LittleFS.open(CONFIG_LEGACY_PATH, "r");
+        StaticJsonDocument<768> doc;
+        if (file && !deserializeJson(doc, file)) {
+            copy_field(config.wifiSsid, doc["WIFI_SSID"], sizeof(config.wifiSsid));
+            copy_field(config.wifiPassword, doc["WIFI_PASS"], sizeof(config.wifiPassword));
+            copy_field(config.coreIotToken, doc["CORE_IOT_TOKEN"], sizeof(config.coreIotToken));
+            copy_field(config.coreIotServer, doc["CORE_IOT_SERVER"], sizeof(config.coreIotServer));
+            config.coreIotPort = atoi(doc["CORE_IOT_PORT"] | "0");
+            found = true;
+        }
+        file.close();
+    }
+    // The web server connected with this login, it wins over /info.dat
+    Preferences preferences;
+    bool opened = preferences.begin("wifi-config", false);
+    if (opened && preferences.isKey("ssid")) {
+        copy_field(config.wifiSsid, preferences.getString("ssid", "").c_str(), sizeof(config.wifiSsid));
+        copy_field(config.wifiPassword, preferences.getString("password", "").c_str(), sizeof(config.wifiPassword));
+        found = true;
+    }
+    // The old copies go once the file is written, a failed write leaves them for the next boot
+    if (found && write_config(config)) {
+        LittleFS.remove(CONFIG_LEGACY_PATH);
+        if (opened) {
+            preferences.remove("ssid");
+            preferences.remove("password");
+        }
+        Serial.println("Config moved to " CONFIG_PATH);
+    }
+    if (opened) {
+        preferences.end();
+    }
+    return found;
+}
+
+bool config_begin() {
+    configMutex = memory_create_mutex();
+    writeMutex = memory_create_mutex();
+    memset(&current, 0, sizeof(current));
+    if (!LittleFS.begin(true)) {
+        Serial.println("❌ Lỗi khởi động LittleFS!");
+        return false;
+    }
+    uint32_t start = micros();
+    DeviceConfig config;
+    memset(&config, 0, sizeof(config));
+    if (!read_config(config) && !migrate(config)) {
+        memset(&config, 0, sizeof(config));
+    }
+    current = config;
+    update_globals(config);
+    Serial.printf("Config loaded in %u us\n", (unsigned)(micros() - start));
+    return true;
+}
+
+void config_get(DeviceConfig& config) {
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    config = current;
+    xSemaphoreGive(configMutex);
+}
+
+static uint8_t changed_parts(const DeviceConfig& a, const DeviceConfig& b) {
+    uint8_t changed = 0;
+    if (strcmp(a.wifiSsid, b.wifiSsid) != 0 || strcmp(a.wifiPassword, b.wifiPassword) != 0) {
+        changed |= CONFIG_WIFI;
+    }
+    if (strcmp(a.coreIotToken, b.coreIotToken) != 0 || strcmp(a.coreIotServer, b.coreIotServer) != 0 ||
+        a.coreIotPort != b.coreIotPort) {
+        changed |= CONFIG_CORE_IOT;
+    }
+    if (a.wifiChannel != b.wifiChannel || memcmp(a.wifiBssid, b.wifiBssid, sizeof(a.wifiBssid)) != 0) {
+        changed |= CONFIG_WIFI_CACHE;
+    }
+    return changed;
+}
+
+// With writeMutex held
+static bool commit(const DeviceConfig& next) {
+    DeviceConfig config;
+    memset(&config, 0, sizeof(config));
+    copy_field(config.wifiSsid, next.wifiSsid, sizeof(config.wifiSsid));
+    copy_field(config.wifiPassword, next.wifiPassword, sizeof(config.wifiPassword));
+    copy_field(config.coreIotToken, next.coreIotToken, sizeof(config.coreIotToken));
+    copy_field(config.coreIotServer, next.coreIotServer, sizeof(config.coreIotServer));
+    config.coreIotPort = next.coreIotPort;
+    // Where the old login was connected says nothing about a new one
+    if (strcmp(config.wifiSsid, current.wifiSsid) == 0 && strcmp(config.wifiPassword, current.wifiPassword) == 0) {
+        memcpy(config.wifiBssid, next.wifiBssid, sizeof(config.wifiBssid));
+        config.wifiChannel = next.wifiChannel;
+    }
+
+    uint8_t changed = changed_parts(current, config);
+    if (changed == 0) {
+        return true;
+    }
+    if (!write_config(config)) {
+        return false;
+    }
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    current = config;
+    xSemaphoreGive(configMutex);
+    update_globals(config);
+
+    for (size_t i = 0; i < listenerCount; i++) {
+        if (listeners[i].parts & changed) {
+            listeners[i].listener(changed, config, listeners[i].arg);
+        }
+    }
+    return true;
+}
+
+bool config_set(const DeviceConfig& next) {
+    xSemaphoreTake(writeMutex, portMAX_DELAY);
+    DeviceConfig config = next;
+    memcpy(config.wifiBssid, current.wifiBssid, sizeof(config.wifiBssid));
+    config.wifiChannel = current.wifiChannel;
+    bool saved = commit(config);
+    xSemaphoreGive(writeMutex);
+    return saved;
+}
+
+bool config_set_wifi(const char* ssid, const char* password) {
+    xSemaphoreTake(writeMutex, portMAX_DELAY);
+    DeviceConfig config = current;
+    copy_field(config.wifiSsid, ssid, sizeof(config.wifiSsid));
+    copy_field(config.wifiPassword, password, sizeof(config.wifiPassword));
+    bool saved = commit(config);
+    xSemaphoreGive(writeMutex);
+    return saved;
+}
+
+bool config_set_wifi_cache(uint8_t channel, const uint8_t* bssid) {
+    xSemaphoreTake(writeMutex, portMAX_DELAY);
+    DeviceConfig config = current;
+    memcpy(config.wifiBssid, bssid, sizeof(config.wifiBssid));
+    config.wifiChannel = channel;
+    bool saved = commit(config);
+    xSemaphoreGive(writeMutex);
+    return saved;
+}
+
+bool config_clear() {
+    DeviceConfig config;
+    memset(&config, 0, sizeof(config));
+    return config_set(config);
+}
+
+void config_listen(uint8_t parts, ConfigListener listener, void* arg) {
+    xSemaphoreTake(writeMutex, portMAX_DELAY);
+    if (listenerCount < CONFIG_MAX_LISTENERS) {
+        listeners[listenerCount++] = { parts, listener, arg };
+    }
+    xSemaphoreGive(writeMutex);
+}
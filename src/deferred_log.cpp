@@ -0,0 +1,288 @@
+#include "deferred_log.h"
+#include "metrics.h"
+#include "task_topology.h"
+#include "memory_budget.h"
+
+// Single producer (the owning task) / single consumer (the drain task) byte ring
+struct LogRing {
+    char name[configMAX_TASK_NAME_LEN];
+    TaskHandle_t owner;
+    uint32_t head;          // Written by the owner only
+    uint32_t tail;          // Written by the drain task only
+    uint32_t dropped;       // Records that did not fit, reported and reset by the drain task
+    bool announced;         // Name frame sent since raw output was enabled
+    uint8_t data[LOG_RING_SIZE];
+};
+
+const uint8_t LOG_MESSAGE_LEVELS[LOG_MESSAGE_COUNT] = {
+#define LOG_MESSAGE(id, level, format) level,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+};
+
+static const char* const LOG_MESSAGE_FORMATS[LOG_MESSAGE_COUNT] = {
+#define LOG_MESSAGE(id, level, format) format,
+#include "log_messages.def"
+#undef LOG_MESSAGE
+};
+
+static const char LOG_LEVEL_LETTERS[] = "DIWE";
+
+volatile uint8_t log_level = LOG_LEVEL_INFO;
+static volatile bool logRaw = false;
+
+static LogRing* logRings[LOG_MAX_RINGS];
+static uint32_t logRingCount;
+
+// Raw frames on the serial port: sync bytes, ring index, then the record as stored.
+// Two ids are reserved for the frames of the drain task itself.
+static const uint8_t LOG_FRAME_SYNC[2] = { 0xA5, 0x5A };
+static const uint16_t LOG_ID_TASK_NAME = 0xFFFF;    // %s: name of the task owning the ring
+static const uint16_t LOG_ID_DROPPED = 0xFFFE;      // %u: records lost since the last report
+static const size_t LOG_HEADER_SIZE = 7;
+
+static void log_encode_header(uint8_t* data, uint16_t id) {
+    uint32_t now = millis();
+    data[1] = id & 0xFF;
+    data[2] = id >> 8;
+    memcpy(&data[3], &now, sizeof(now));
+}
+
+static bool log_ring_push(LogRing* ring, const uint8_t* data, size_t len) {
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (LOG_RING_SIZE - (head - tail) < len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        ring->data[(head + i) & (LOG_RING_SIZE - 1)] = data[i];
+    }
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Rings are claimed from the LOG_RINGS region and never released
+MEMORY_FITS(LOG_RINGS, LOG_MAX_RINGS * ((sizeof(LogRing) + 7) & ~(size_t)7));
+
+// Ring of the calling task, created on its first message. Lookups are lock-free, only
+// the creation of a ring suspends the scheduler, once per task.
+static LogRing* log_current_ring() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    uint32_t count = __atomic_load_n(&logRingCount, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        if (logRings[i]->owner == self) {
+            return logRings[i];
+        }
+    }
+    if (count >= LOG_MAX_RINGS) {
+        return nullptr;
+    }
+
+    // Claimed with the scheduler suspended, so a task that loses the race for the last slot
+    // does not take a ring that can never be given back
+    LogRing* ring = nullptr;
+    vTaskSuspendAll();
+    uint32_t index = logRingCount;
+    if (index < LOG_MAX_RINGS) {
+        ring = (LogRing*)memory_claim(MEMORY_LOG_RINGS, sizeof(LogRing));
+    }
+    if (ring) {
+        memset(ring, 0, sizeof(LogRing));
+        ring->owner = self;
+        strlcpy(ring->name, pcTaskGetName(NULL), sizeof(ring->name));
+        logRings[index] = ring;
+        __atomic_store_n(&logRingCount, index + 1, __ATOMIC_RELEASE);
+    }
+    xTaskResumeAll();
+    return ring;
+}
+
+LogRecord::LogRecord(uint16_t id) : len(LOG_HEADER_SIZE), truncated(false) {
+    log_encode_header(data, id);
+}
+
+void LogRecord::append(const void* value, size_t size) {
+    if (len + size > sizeof(data)) {
+        truncated = true;
+        return;
+    }
+    memcpy(&data[len], value, size);
+    len += size;
+}
+
+void LogRecord::put(const char* value) {
+    size_t n = value ? strnlen(value, LOG_MAX_STRING) : 0;
+    if (len + 1 + n > sizeof(data)) {
+        truncated = true;
+        return;
+    }
+    data[len++] = (uint8_t)n;
+    memcpy(&data[len], value, n);
+    len += n;
+}
+
+void LogRecord::commit() {
+    data[0] = (uint8_t)len;
+    LogRing* ring = log_current_ring();
+    // Truncated records would decode into garbage, they are dropped like records that do not fit
+    if (truncated || ring == nullptr || !log_ring_push(ring, data, len)) {
+        if (ring != nullptr) {
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        }
+        metric_log_dropped.inc();
+    }
+}
+
+void log_set_level(LogLevel level) {
+    log_level = level;
+}
+
+void log_set_raw(bool raw) {
+    if (raw && !logRaw) {
+        uint32_t count = __atomic_load_n(&logRingCount, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < count; i++) {
+            logRings[i]->announced = false;
+        }
+    }
+    logRaw = raw;
+}
+
+static void log_write_frame(uint8_t ringIndex, const uint8_t* record, size_t len) {
+    Serial.write(LOG_FRAME_SYNC, sizeof(LOG_FRAME_SYNC));
+    Serial.write(ringIndex);
+    Serial.write(record, len);
+}
+
+// Formats one record like printf would have, taking the arguments from the record instead of varargs
+static void log_write_text(const uint8_t* record, size_t len) {
+    uint16_t id = record[1] | (record[2] << 8);
+    uint32_t time;
+    memcpy(&time, &record[3], sizeof(time));
+    if (id >= LOG_MESSAGE_COUNT) {
+        return;
+    }
+
+    char line[192];
+    size_t pos = snprintf(line, sizeof(line), "[%lu.%03lu] %c ",
+                          (unsigned long)(time / 1000), (unsigned long)(time % 1000),
+                          LOG_LEVEL_LETTERS[LOG_MESSAGE_LEVELS[id]]);
+    size_t arg = LOG_HEADER_SIZE;
+
+    for (const char* p = LOG_MESSAGE_FORMATS[id]; *p && pos < sizeof(line) - 1; p++) {
+        if (*p != '%') {
+            line[pos++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            line[pos++] = '%';
+            p++;
+            continue;
+        }
+
+        const char* start = p++;
+        while (*p && strchr("-+ #0123456789.", *p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        char spec[16];
+        size_t specLen = min((size_t)(p - start + 1), sizeof(spec) - 1);
+        memcpy(spec, start, specLen);
+        spec[specLen] = '\0';
+
+        size_t room = sizeof(line) - pos;
+        int written = 0;
+        if (strchr("diuxXoc", *p) && arg + 4 <= len) {
+            int32_t value;
+            memcpy(&value, &record[arg], sizeof(value));
+            arg += 4;
+            written = snprintf(&line[pos], room, spec, value);
+        } else if (strchr("feEgG", *p) && arg + 4 <= len) {
+            float value;
+            memcpy(&value, &record[arg], sizeof(value));
+            arg += 4;
+            written = snprintf(&line[pos], room, spec, (double)value);
+        } else if (*p == 's' && arg + 1 <= len && arg + 1 + record[arg] <= len) {
+            char value[LOG_MAX_STRING + 1];
+            size_t n = record[arg];
+            memcpy(value, &record[arg + 1], n);
+            value[n] = '\0';
+            arg += 1 + n;
+            written = snprintf(&line[pos], room, spec, value);
+        } else {
+            written = snprintf(&line[pos], room, "?");
+        }
+        if (written > 0) {
+            pos += min((size_t)written, room - 1);
+        }
+    }
+    Serial.write((const uint8_t*)line, pos);
+    Serial.println();
+}
+
+static void log_report_dropped(uint8_t ringIndex, LogRing* ring) {
+    uint32_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped == 0) {
+        return;
+    }
+    if (logRaw) {
+        uint8_t record[LOG_HEADER_SIZE + 4];
+        log_encode_header(record, LOG_ID_DROPPED);
+        record[0] = sizeof(record);
+        memcpy(&record[LOG_HEADER_SIZE], &dropped, sizeof(dropped));
+        log_write_frame(ringIndex, record, sizeof(record));
+    } else {
+        Serial.printf("[log] %lu messages of task %s dropped\n", (unsigned long)dropped, ring->name);
+    }
+}
+
+static void log_announce(uint8_t ringIndex, LogRing* ring) {
+    uint8_t record[LOG_HEADER_SIZE + 1 + configMAX_TASK_NAME_LEN];
+    size_t n = strnlen(ring->name, sizeof(ring->name));
+    log_encode_header(record, LOG_ID_TASK_NAME);
+    record[0] = LOG_HEADER_SIZE + 1 + n;
+    record[LOG_HEADER_SIZE] = n;
+    memcpy(&record[LOG_HEADER_SIZE + 1], ring->name, n);
+    log_write_frame(ringIndex, record, record[0]);
+    ring->announced = true;
+}
+
+static void log_drain_task(void* pvParameters) {
+    uint8_t record[LOG_MAX_RECORD];
+    while (1) {
+        uint32_t count = __atomic_load_n(&logRingCount, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < count; i++) {
+            LogRing* ring = logRings[i];
+            bool raw = logRaw;
+            if (raw && !ring->announced) {
+                log_announce(i, ring);
+            }
+            log_report_dropped(i, ring);
+
+            uint32_t tail = ring->tail;
+            uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            while (tail != head) {
+                size_t len = ring->data[tail & (LOG_RING_SIZE - 1)];
+                for (size_t j = 0; j < len; j++) {
+                    record[j] = ring->data[(tail + j) & (LOG_RING_SIZE - 1)];
+                }
+                tail += len;
+                // Hand the space back before the slow serial write
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+                if (raw) {
+                    log_write_frame(i, record, len);
+                } else {
+                    log_write_text(record, len);
+                }
+            }
+        }
+        vTaskDelay(LOG_DRAIN_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void log_begin(bool raw) {
+    log_set_raw(raw);
+    // Serial output is IO, it stays off the core of the sensor jobs
+    topology_create_task(log_drain_task, "Log Drain", MEMORY_STACK_LOG_DRAIN, NULL, 1, TASK_ROLE_NETWORK);
+}
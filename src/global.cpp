@@ -2,19 +2,16 @@
 float glob_temperature = 0;
 float glob_humidity = 0;
 int glob_light_level = 0;
+uint32_t glob_dht_read_ms = 0;
+uint32_t glob_light_read_ms = 0;
 bool glob_led_state = false;
 bool glob_temp_alert = false;
 float HIGH_TEMP_THRESHOLD = 30.0;
 
-String WIFI_SSID;
-String WIFI_PASS;
-String CORE_IOT_TOKEN;
-String CORE_IOT_SERVER;
-String CORE_IOT_PORT;
+char WIFI_SSID[CONFIG_MAX_SSID + 1];
+char WIFI_PASS[CONFIG_MAX_PASSWORD + 1];
+char CORE_IOT_TOKEN[CONFIG_MAX_TOKEN + 1];
+char CORE_IOT_SERVER[CONFIG_MAX_SERVER + 1];
+uint16_t CORE_IOT_PORT = 0;
 
-String ssid = "ESP32-YOUR NETWORK HERE!!!";
-String password = "12345678";
-String wifi_ssid = "abcde";
-String wifi_password = "123456789";
 boolean isWifiConnected = false;
-SemaphoreHandle_t xBinarySemaphoreInternet = xSemaphoreCreateBinary();
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "heap_monitor.h"
+#include "esp_heap_caps.h"
+#include "memory_budget.h"
+
+static const char* const HEAP_SITE_NAMES[HEAP_SITE_COUNT] = {
+#define HEAP_SITE(id, description) #id,
+#include "heap_sites.def"
+#undef HEAP_SITE
+};
+
+// Zero-initialized, heap_site_alloc() runs during static initialization too
+static uint32_t heapSiteAllocs[HEAP_SITE_COUNT];
+static uint32_t heapSiteBytes[HEAP_SITE_COUNT];
+static uint32_t heapAllocsTotal;
+
+static SemaphoreHandle_t heapMutex = memory_create_mutex();
+static HeapSample heapSamples[HEAP_MONITOR_SAMPLES];
+static uint32_t heapSampleCount;        // Samples taken, the newest one is still being filled
+static uint32_t heapLastPoll;
+static uint32_t heapIntervalStart;
+static uint32_t heapAllocsAtStart;
+
+void heap_site_alloc(HeapSite site, size_t bytes) {
+    __atomic_fetch_add(&heapSiteAllocs[site], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&heapSiteBytes[site], (uint32_t)bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&heapAllocsTotal, 1, __ATOMIC_RELAXED);
+}
+
+float heap_fragmentation(size_t freeBytes, size_t largestBlock) {
+    if (freeBytes == 0 || largestBlock >= freeBytes) {
+        return 0;
+    }
+    return 1.0f - (float)largestBlock / freeBytes;
+}
+
+void heap_monitor_poll() {
+    uint32_t now = millis();
+    if (heapSampleCount > 0 && now - heapLastPoll < HEAP_MONITOR_POLL_MS) {
+        return;
+    }
+    heapLastPoll = now;
+    uint32_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    uint16_t fragmentation = (uint16_t)(heap_fragmentation(freeBytes, largest) * 1000 + 0.5f);
+    uint32_t allocs = __atomic_load_n(&heapAllocsTotal, __ATOMIC_RELAXED);
+
+    xSemaphoreTake(heapMutex, portMAX_DELAY);
+    if (heapSampleCount == 0 || now - heapIntervalStart >= HEAP_MONITOR_INTERVAL_MS) {
+        // Allocations since the last poll still belong to the interval that ends
+        if (heapSampleCount > 0) {
+            heapSamples[(heapSampleCount - 1) % HEAP_MONITOR_SAMPLES].allocs = allocs - heapAllocsAtStart;
+        }
+        heapIntervalStart = now;
+        heapAllocsAtStart = allocs;
+        HeapSample& sample = heapSamples[heapSampleCount % HEAP_MONITOR_SAMPLES];
+        sample.time = now / 1000;
+        sample.minFree = freeBytes;
+        sample.minLargest = largest;
+        sample.fragmentation = fragmentation;
+        heapSampleCount++;
+    }
+    HeapSample& sample = heapSamples[(heapSampleCount - 1) % HEAP_MONITOR_SAMPLES];
+    sample.minFree = min(sample.minFree, freeBytes);
+    sample.minLargest = min(sample.minLargest, largest);
+    sample.fragmentation = max(sample.fragmentation, fragmentation);
+    sample.allocs = allocs - heapAllocsAtStart;
+    xSemaphoreGive(heapMutex);
+}
+
+bool heap_monitor_write(Print& out, size_t item) {
+    // Items: the current values, one per sample, one per site, the end
+    uint32_t count = min(__atomic_load_n(&heapSampleCount, __ATOMIC_RELAXED), (uint32_t)HEAP_MONITOR_SAMPLES);
+    if (item == 0) {
+        size_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        out.printf("{\"free\":%u,\"largest\":%u,\"min_free\":%u,\"fragmentation\":%.3f,\"interval_s\":%lu,"
+                   "\"samples\":[",
+                   (unsigned)freeBytes, (unsigned)largest, (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+                   heap_fragmentation(freeBytes, largest), (unsigned long)(HEAP_MONITOR_INTERVAL_MS / 1000));
+        return true;
+    }
+    size_t index = item - 1;
+    if (index < count) {
+        // Samples as [time, min_free, min_largest, fragmentation, allocs], oldest first. A sample
+        // that was overwritten meanwhile only moves the window, the values stay consistent.
+        xSemaphoreTake(heapMutex, portMAX_DELAY);
+        uint32_t first = heapSampleCount > HEAP_MONITOR_SAMPLES ? heapSampleCount - HEAP_MONITOR_SAMPLES : 0;
+        HeapSample sample = heapSamples[(first + index) % HEAP_MONITOR_SAMPLES];
+        xSemaphoreGive(heapMutex);
+        out.printf("%s[%lu,%lu,%lu,%.3f,%lu]", index ? "," : "", (unsigned long)sample.time,
+                   (unsigned long)sample.minFree, (unsigned long)sample.minLargest, sample.fragmentation / 1000.0f,
+                   (unsigned long)sample.allocs);
+        return true;
+    }
+    index -= count;
+    if (index < HEAP_SITE_COUNT) {
+        out.printf("%s{\"name\":\"%s\",\"allocs\":%lu,\"bytes\":%lu}", index ? "," : "],\"sites\":[",
+                   HEAP_SITE_NAMES[index], (unsigned long)__atomic_load_n(&heapSiteAllocs[index], __ATOMIC_RELAXED),
+                   (unsigned long)__atomic_load_n(&heapSiteBytes[index], __ATOMIC_RELAXED));
+        return true;
+    }
+    out.print("]}");
+    return false;
+}
@@ -0,0 +1,98 @@
+#include "job_executor.h"
+
+JobExecutor::JobExecutor() : count(0), handle(nullptr) {
+}
+
+bool JobExecutor::add(const char* name, JobStep step, void* arg, MetricHistogram* loop) {
+    if (count >= JOB_MAX_JOBS || handle != nullptr) {
+        return false;
+    }
+    Job& job = jobs[count++];
+    job.name = name;
+    job.step = step;
+    job.arg = arg;
+    job.loop = loop;
+    job.wait = JobWait::yield();
+    job.due = 0;
+    return true;
+}
+
+void JobExecutor::start(const char* name, MemoryRegionId stack, UBaseType_t priority, BaseType_t core) {
+    TaskHandle_t task = memory_create_task(worker, name, stack, this, priority, core);
+    __atomic_store_n(&handle, task, __ATOMIC_RELEASE);
+}
+
+void JobExecutor::wake() {
+    // Before start() the worker checks every wait on its first pass anyway
+    TaskHandle_t task = __atomic_load_n(&handle, __ATOMIC_ACQUIRE);
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void JobExecutor::worker(void* parameter) {
+    ((JobExecutor*)parameter)->run();
+}
+
+void JobExecutor::run() {
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = INT64_MAX;
+        // One step per due job and pass, a job that yields runs again after the others
+        for (size_t i = 0; i < count; i++) {
+            Job& job = jobs[i];
+            if (job.wait.kind == JobWait::JOB_WAIT_DONE) {
+                continue;
+            }
+            bool received = job.wait.kind == JobWait::JOB_WAIT_QUEUE && job.wait.queue->pending();
+            if (!received && now < job.due) {
+                next = min(next, job.due);
+                continue;
+            }
+            if (!received && job.wait.timeoutMs > 0) {
+                // How much later than asked for the worker got to it, other steps included
+                metric_job_lateness.observe((uint32_t)min(now - job.due, (int64_t)UINT32_MAX));
+            }
+            uint32_t start = micros();
+            job.wait = job.step(job.arg);
+            if (job.loop) {
+                job.loop->observe(micros() - start);
+            }
+            now = esp_timer_get_time();
+            job.due = job.wait.timeoutMs == JOB_FOREVER ? INT64_MAX : now + (int64_t)job.wait.timeoutMs * 1000;
+            next = min(next, job.due);
+        }
+        if (next > now) {
+            // Rounded up, waking a tick early would only mean another pass
+            int64_t tickUs = portTICK_PERIOD_MS * 1000;
+            TickType_t ticks = next == INT64_MAX || (next - now) / tickUs >= portMAX_DELAY
+                               ? portMAX_DELAY : (TickType_t)((next - now + tickUs - 1) / tickUs);
+            ulTaskNotifyTake(pdTRUE, ticks);
+        }
+    }
+}
+
+JobQueue::JobQueue(JobExecutor& executor, UBaseType_t length, UBaseType_t itemSize) : executor(executor) {
+    queue = memory_create_queue(length, itemSize);
+}
+
+bool JobQueue::send(const void* item) {
+    if (xQueueSend(queue, item, 0) != pdTRUE) {
+        return false;
+    }
+    executor.wake();
+    return true;
+}
+
+void JobQueue::overwrite(const void* item) {
+    xQueueOverwrite(queue, item);
+    executor.wake();
+}
+
+bool JobQueue::receive(void* item) {
+    return xQueueReceive(queue, item, 0) == pdTRUE;
+}
+
+bool JobQueue::pending() const {
+    return uxQueueMessagesWaiting(queue) > 0;
+}
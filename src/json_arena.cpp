@@ -0,0 +1,89 @@
+#include "json_arena.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "heap_monitor.h"
+
+#define JSON_ARENA_BLOCKS (JSON_ARENA_SMALL_BLOCKS + JSON_ARENA_LARGE_BLOCKS)
+#define JSON_ARENA_BYTES (JSON_ARENA_SMALL_BLOCKS * JSON_ARENA_SMALL + JSON_ARENA_LARGE_BLOCKS * JSON_ARENA_LARGE)
+
+MEMORY_FITS(JSON_ARENA, JSON_ARENA_BYTES);
+static_assert(JSON_ARENA_BLOCKS <= 32, "The free blocks are one bit each in a uint32_t");
+
+// Small blocks first, then the large ones
+static uint8_t* const jsonArena = (uint8_t*)memory_claim(MEMORY_JSON_ARENA, JSON_ARENA_BYTES);
+static uint32_t jsonArenaUsed;
+
+static uint8_t* json_arena_block(int block) {
+    if (block < JSON_ARENA_SMALL_BLOCKS) {
+        return jsonArena + block * JSON_ARENA_SMALL;
+    }
+    return jsonArena + JSON_ARENA_SMALL_BLOCKS * JSON_ARENA_SMALL + (block - JSON_ARENA_SMALL_BLOCKS) * JSON_ARENA_LARGE;
+}
+
+// Takes the first free block in [first, last), -1 if all of them are used
+static int json_arena_take(int first, int last) {
+    uint32_t used = __atomic_load_n(&jsonArenaUsed, __ATOMIC_RELAXED);
+    while (true) {
+        int block = first;
+        while (block < last && (used & (1u << block))) {
+            block++;
+        }
+        if (block == last) {
+            return -1;
+        }
+        if (__atomic_compare_exchange_n(&jsonArenaUsed, &used, used | (1u << block), true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return block;
+        }
+    }
+}
+
+// Index of the block the pointer belongs to, -1 if it came from the heap
+static int json_arena_index(const void* pointer) {
+    const uint8_t* p = (const uint8_t*)pointer;
+    if (jsonArena == nullptr || p < jsonArena || p >= jsonArena + JSON_ARENA_BYTES) {
+        return -1;
+    }
+    size_t offset = p - jsonArena;
+    if (offset < JSON_ARENA_SMALL_BLOCKS * JSON_ARENA_SMALL) {
+        return offset / JSON_ARENA_SMALL;
+    }
+    return JSON_ARENA_SMALL_BLOCKS + (offset - JSON_ARENA_SMALL_BLOCKS * JSON_ARENA_SMALL) / JSON_ARENA_LARGE;
+}
+
+void* JsonArenaAllocator::allocate(size_t size) {
+    int block = -1;
+    if (jsonArena != nullptr) {
+        if (size <= JSON_ARENA_SMALL) {
+            block = json_arena_take(0, JSON_ARENA_SMALL_BLOCKS);
+        }
+        if (block < 0 && size <= JSON_ARENA_LARGE) {
+            block = json_arena_take(JSON_ARENA_SMALL_BLOCKS, JSON_ARENA_BLOCKS);
+        }
+    }
+    if (block >= 0) {
+        return json_arena_block(block);
+    }
+    metric_json_arena_fallbacks.inc();
+    heap_site_alloc(HEAP_SITE_JSON_FALLBACK, size);
+    return malloc(size);
+}
+
+void JsonArenaAllocator::deallocate(void* pointer) {
+    int block = json_arena_index(pointer);
+    if (block < 0) {
+        free(pointer);
+        return;
+    }
+    __atomic_fetch_and(&jsonArenaUsed, ~(1u << block), __ATOMIC_RELEASE);
+}
+
+void* JsonArenaAllocator::reallocate(void* pointer, size_t size) {
+    // Only shrinkToFit() reallocates, a block keeps its size
+    int block = json_arena_index(pointer);
+    if (block < 0) {
+        return realloc(pointer, size);
+    }
+    size_t capacity = block < JSON_ARENA_SMALL_BLOCKS ? JSON_ARENA_SMALL : JSON_ARENA_LARGE;
+    return size <= capacity ? pointer : nullptr;
+}
@@ -0,0 +1,152 @@
+#include "latency_trace.h"
+#include "freertos/semphr.h"
+#include "memory_budget.h"
+
+TraceSpan trace_spans[TRACE_BUFFER_SPANS];
+uint32_t trace_claimed = 0;
+
+static uint32_t traceNextId = 1;
+
+// Handed from the sensor tasks to the next message: the id is published last and taken with an
+// exchange, so every reading is carried by one message at most
+static uint32_t tracePendingId[TRACE_SOURCE_COUNT];
+static uint64_t tracePendingReadStart[TRACE_SOURCE_COUNT];
+
+// Messages waiting for the send queues to drain. Messages are sent from the web server task
+// and from WebSocket events, so these are behind a lock.
+struct TraceAwaiting {
+    uint32_t id;
+    uint64_t readStart;
+    uint64_t enqueued;
+};
+static TraceAwaiting traceAwaiting[TRACE_SOURCE_COUNT];
+static SemaphoreHandle_t traceMutex = memory_create_mutex();
+
+static MetricHistogram* const TRACE_LATENCY[TRACE_SOURCE_COUNT] = {
+    &metric_sensor_latency_dht, &metric_sensor_latency_light
+};
+
+static const char* const TRACE_STAGE_NAMES[TRACE_STAGE_COUNT] = {
+    "sensor_read", "snapshot_publish", "json_encode", "ws_enqueue", "net_send"
+};
+static const char* const TRACE_SOURCE_NAMES[TRACE_SOURCE_COUNT] = { "dht", "light" };
+static const char* const TRACE_SOURCE_LABELS[TRACE_SOURCE_COUNT] = { "DHT11", "Light sensor" };
+
+uint32_t trace_begin() {
+    uint32_t id = __atomic_fetch_add(&traceNextId, 1, __ATOMIC_RELAXED);
+    // 0 marks "no trace", skip it when the counter wraps
+    return id ? id : __atomic_fetch_add(&traceNextId, 1, __ATOMIC_RELAXED);
+}
+
+void trace_publish(TraceSource source, uint32_t id, uint64_t readStart, uint64_t start) {
+    trace_span(id, source, TRACE_SNAPSHOT_PUBLISH, start, trace_now());
+    // A message taking the previous id in between may pick up this read start, that only
+    // shortens one end to end latency by a read interval
+    tracePendingReadStart[source] = readStart;
+    __atomic_store_n(&tracePendingId[source], id, __ATOMIC_RELEASE);
+}
+
+TraceMessage::TraceMessage(bool take) {
+    for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+        ids[source] = take ? __atomic_exchange_n(&tracePendingId[source], 0, __ATOMIC_ACQ_REL) : 0;
+        readStarts[source] = tracePendingReadStart[source];
+    }
+}
+
+bool TraceMessage::empty() const {
+    for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+        if (ids[source]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TraceMessage::span(TraceStage stage, uint64_t start, uint64_t end) const {
+    for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+        if (ids[source]) {
+            trace_span(ids[source], (TraceSource)source, stage, start, end);
+        }
+    }
+}
+
+void TraceMessage::enqueued(uint64_t end) const {
+    if (empty()) {
+        return;
+    }
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+    for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+        // A message still waiting is ahead of this one in every queue, it is treated as sent
+        // when this one is, so only the newer one is kept
+        if (ids[source]) {
+            traceAwaiting[source] = { ids[source], readStarts[source], end };
+        }
+    }
+    xSemaphoreGive(traceMutex);
+}
+
+void trace_poll_sent(bool drained) {
+    if (!drained) {
+        return;
+    }
+    uint64_t now = trace_now();
+    xSemaphoreTake(traceMutex, portMAX_DELAY);
+    for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+        TraceAwaiting& awaiting = traceAwaiting[source];
+        if (awaiting.id) {
+            trace_span(awaiting.id, (TraceSource)source, TRACE_NET_SEND, awaiting.enqueued, now);
+            TRACE_LATENCY[source]->observe((uint32_t)(now - awaiting.readStart));
+            awaiting.id = 0;
+        }
+    }
+    xSemaphoreGive(traceMutex);
+}
+
+TraceJsonWriter::TraceJsonWriter() : count(0) {
+    uint32_t claimed = __atomic_load_n(&trace_claimed, __ATOMIC_ACQUIRE);
+    uint32_t oldest = claimed > TRACE_BUFFER_SPANS ? claimed - TRACE_BUFFER_SPANS : 0;
+    for (uint32_t claim = oldest; claim != claimed; claim++) {
+        const TraceSpan& slot = trace_spans[claim & (TRACE_BUFFER_SPANS - 1)];
+        // Skip slots that are being written or were overwritten while copying
+        if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != claim + 1) {
+            continue;
+        }
+        TraceSpan& copy = spans[count];
+        copy.id = slot.id;
+        copy.start = slot.start;
+        copy.duration = slot.duration;
+        copy.stage = slot.stage;
+        copy.source = slot.source;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) == claim + 1) {
+            count++;
+        }
+    }
+}
+
+bool TraceJsonWriter::write(Print& out, size_t item) {
+    if (item == 0) {
+        // Names and order of the processes (sensors) and threads (stages)
+        out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (int source = 0; source < TRACE_SOURCE_COUNT; source++) {
+            out.printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+                       source ? "," : "", source + 1, TRACE_SOURCE_LABELS[source]);
+            for (int stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+                out.printf(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}"
+                           ",{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                           source + 1, stage, TRACE_STAGE_NAMES[stage], source + 1, stage, stage);
+            }
+        }
+        return true;
+    }
+    if (item > count) {
+        out.print("]}");
+        return false;
+    }
+
+    const TraceSpan& span = spans[item - 1];
+    out.printf(",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu,\"dur\":%lu,\"args\":{\"trace\":%lu}}",
+               TRACE_STAGE_NAMES[span.stage], TRACE_SOURCE_NAMES[span.source], span.source + 1, span.stage,
+               (unsigned long long)span.start, (unsigned long)span.duration, (unsigned long)span.id);
+    return true;
+}
@@ -0,0 +1,370 @@
+#include "low_power.h"
+#include <ArduinoJson.h>
+
+#define LOW_POWER_DAY_MS 86400000.0f
+
+static uint16_t ring_oldest(const LowPowerState& state) {
+    return (state.head + LOW_POWER_RING_SIZE - state.count) % LOW_POWER_RING_SIZE;
+}
+
+// Steps of LowPowerValue
+static const float VALUE_SCALE[HISTORY_METRIC_COUNT] = { 10, 10, 1 };
+static const char* const MIN_KEYS[HISTORY_METRIC_COUNT] = { "temperature_min", "humidity_min", "light_min" };
+static const char* const MAX_KEYS[HISTORY_METRIC_COUNT] = { "temperature_max", "humidity_max", "light_max" };
+
+static int16_t fixed(HistoryMetric metric, float value) {
+    return (int16_t)lroundf(value * VALUE_SCALE[metric]);
+}
+
+bool low_power_begin(LowPowerState& state, float threshold) {
+    if (state.magic == LOW_POWER_MAGIC) {
+        return false;
+    }
+    memset(&state, 0, sizeof(state));
+    state.magic = LOW_POWER_MAGIC;
+    state.threshold = threshold;
+    report_policy_defaults(state.rules);
+    return true;
+}
+
+void low_power_set_threshold(LowPowerState& state, float threshold) {
+    state.threshold = threshold;
+}
+
+void low_power_set_rules(LowPowerState& state, const ReportRule* rules) {
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        if (memcmp(&state.rules[i], &rules[i], sizeof(ReportRule)) != 0) {
+            state.rules[i] = rules[i];
+            memset(&state.tracks[i], 0, sizeof(ReportTrack));
+        }
+    }
+}
+
+bool low_power_record(LowPowerState& state, float temperature, float humidity, uint16_t light) {
+    state.wakes++;
+    bool valid = !isnan(temperature) && !isnan(humidity);
+    bool alert = valid && temperature > state.threshold;
+    bool alertChanged = alert != state.alertActive;
+    // Only the start of an alert wakes the radio, the samples of a long one go with the batches
+    if (alert && !state.alertActive) {
+        state.alertPending = true;
+    }
+    state.alertActive = alert;
+
+    LowPowerSample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.time = state.clockMs / 1000;
+    sample.flags = alert ? LOW_POWER_SAMPLE_ALERT : 0;
+    const float values[HISTORY_METRIC_COUNT] = { temperature, humidity, (float)light };
+    // The filter keeps time in ms, it only looks at differences so the wrap after 49 days is harmless
+    uint32_t nowMs = (uint32_t)state.clockMs;
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        HistoryMetric metric = (HistoryMetric)i;
+        Report report;
+        if ((metric == HISTORY_LIGHT || valid) && report_track(state.tracks[i], state.rules[i], values[i], nowMs, report)) {
+            sample.reported |= 1 << i;
+            sample.values[i] = { fixed(metric, report.mean), fixed(metric, report.min), fixed(metric, report.max) };
+        }
+    }
+    // The temperature that started or ended an alert goes with it, even inside the dead band
+    if (alertChanged && !(sample.reported & (1 << HISTORY_TEMPERATURE)) && valid) {
+        int16_t value = fixed(HISTORY_TEMPERATURE, temperature);
+        sample.reported |= 1 << HISTORY_TEMPERATURE;
+        sample.values[HISTORY_TEMPERATURE] = { value, value, value };
+    }
+
+    if (sample.reported == 0 && !alertChanged) {
+        state.suppressed++;
+    } else {
+        state.samples[state.head] = sample;
+        state.head = (state.head + 1) % LOW_POWER_RING_SIZE;
+        if (state.count == LOW_POWER_RING_SIZE) {
+            // Overwrote the oldest one
+            state.dropped++;
+        } else {
+            state.count++;
+        }
+    }
+
+    bool due = state.count >= LOW_POWER_BATCH_SIZE || state.alertPending;
+    return due && sample.time >= state.retryAt;
+}
+
+void low_power_set_time(LowPowerState& state, int64_t epochMs, uint32_t awakeMs) {
+    state.epochOffsetMs = epochMs - (int64_t)(state.clockMs + awakeMs);
+}
+
+size_t low_power_batch_json(const LowPowerState& state, char* json, size_t size) {
+    // Without the time the samples would all get the time they arrive at
+    if (state.count == 0 || state.epochOffsetMs == 0) {
+        return 0;
+    }
+    size_t waiting = min((size_t)state.count, (size_t)LOW_POWER_BATCH_SIZE);
+    StaticJsonDocument<JSON_ARRAY_SIZE(LOW_POWER_BATCH_SIZE) +
+                       LOW_POWER_BATCH_SIZE * (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(3 * HISTORY_METRIC_COUNT + 1))> doc;
+    JsonArray batch = doc.to<JsonArray>();
+    uint16_t index = ring_oldest(state);
+    size_t count = 0;
+    while (count < waiting) {
+        const LowPowerSample& sample = state.samples[(index + count) % LOW_POWER_RING_SIZE];
+        JsonObject entry = batch.createNestedObject();
+        entry["ts"] = state.epochOffsetMs + (int64_t)sample.time * 1000;
+        JsonObject values = entry.createNestedObject("values");
+        for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+            if (!(sample.reported & (1 << i))) {
+                continue;
+            }
+            const LowPowerValue& value = sample.values[i];
+            const char* name = history_metric_name((HistoryMetric)i);
+            values[name] = value.mean / VALUE_SCALE[i];
+            if (value.min != value.max) {
+                values[MIN_KEYS[i]] = value.min / VALUE_SCALE[i];
+                values[MAX_KEYS[i]] = value.max / VALUE_SCALE[i];
+            }
+        }
+        values["alert"] = (sample.flags & LOW_POWER_SAMPLE_ALERT) != 0;
+        // The sample that does not fit any more goes with the next message
+        if (doc.overflowed() || measureJson(doc) >= size) {
+            batch.remove(count);
+            break;
+        }
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    serializeJson(doc, json, size);
+    return count;
+}
+
+void low_power_sent(LowPowerState& state, size_t count) {
+    state.count -= min((size_t)state.count, count);
+    state.delivered += count;
+}
+
+void low_power_uplink_done(LowPowerState& state, bool ok, uint32_t radioMs) {
+    state.radioMs += radioMs;
+    if (ok) {
+        state.uplinks++;
+        if (state.alertPending) {
+            state.alertUplinks++;
+        }
+        state.alertPending = false;
+        state.failureStreak = 0;
+        state.retryAt = 0;
+        return;
+    }
+    // Each failure in a row doubles the wait, an access point that is gone would otherwise cost
+    // a connect timeout at every batch
+    state.uplinkFailures++;
+    state.failureStreak++;
+    uint32_t backoff = LOW_POWER_RETRY_S;
+    for (uint32_t i = 1; i < state.failureStreak && backoff < LOW_POWER_RETRY_MAX_S; i++) {
+        backoff *= 2;
+    }
+    state.retryAt = state.clockMs / 1000 + min(backoff, (uint32_t)LOW_POWER_RETRY_MAX_S);
+}
+
+uint32_t low_power_sleep(LowPowerState& state, uint32_t awakeMs) {
+    state.awakeMs += awakeMs;
+    // The samples stay on the interval however long the wake took
+    uint32_t interval = LOW_POWER_SAMPLE_INTERVAL_S * 1000UL;
+    uint32_t sleepMs = awakeMs + LOW_POWER_MIN_SLEEP_MS < interval ? interval - awakeMs : LOW_POWER_MIN_SLEEP_MS;
+    state.clockMs += awakeMs + sleepMs;
+    return sleepMs;
+}
+
+static void estimate_from(LowPowerEstimate& estimate, float totalMs, float awakeMs, float radioMs) {
+    memset(&estimate, 0, sizeof(estimate));
+    if (totalMs <= 0) {
+        return;
+    }
+    estimate.awakeShare = awakeMs / totalMs;
+    estimate.radioShare = radioMs / totalMs;
+    estimate.radioSecondsPerDay = estimate.radioShare * LOW_POWER_DAY_MS / 1000;
+    estimate.averageMa = (1 - estimate.awakeShare) * LOW_POWER_SLEEP_MA +
+                         (estimate.awakeShare - estimate.radioShare) * LOW_POWER_ACTIVE_MA +
+                         estimate.radioShare * LOW_POWER_RADIO_MA;
+    estimate.batteryDays = LOW_POWER_BATTERY_MAH / estimate.averageMa / 24;
+}
+
+void low_power_estimate(const LowPowerState& state, LowPowerEstimate& estimate) {
+    estimate_from(estimate, state.clockMs, state.awakeMs, state.radioMs);
+}
+
+void low_power_model(LowPowerEstimate& estimate, uint32_t awakeMs, uint32_t radioMs, float sampleShare,
+                     float alertsPerDay) {
+    float wakes = LOW_POWER_DAY_MS / 1000 / LOW_POWER_SAMPLE_INTERVAL_S;
+    float uplinks = wakes * sampleShare / LOW_POWER_BATCH_SIZE + alertsPerDay;
+    float radio = uplinks * radioMs;
+    estimate_from(estimate, LOW_POWER_DAY_MS, wakes * awakeMs + radio, radio);
+}
+
+#if LOW_POWER_MODE
+
+#include <esp_sleep.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <sys/time.h>
+#include <Arduino_MQTT_Client.h>
+#include <ThingsBoard.h>
+#include "global.h"
+#include "config_store.h"
+#include "settings_store.h"
+#include "task_read_dht11.h"
+#include "task_light_sensor.h"
+
+#define LOW_POWER_CONNECT_TIMEOUT_MS 10000
+#define LOW_POWER_TIME_TIMEOUT_MS 2000
+#define LOW_POWER_NTP_SERVER "pool.ntp.org"
+#define LOW_POWER_MQTT_PORT 1883
+#define LOW_POWER_MQTT_BUFFER (LOW_POWER_BATCH_JSON + 64)     // Topic and MQTT header too
+
+// RTC slow memory, 8 KB on the ESP32-S3
+RTC_DATA_ATTR static LowPowerState rtcState;
+static_assert(sizeof(LowPowerState) <= 4096, "LowPowerState does not fit into its share of RTC memory");
+
+static bool configLoaded = false;
+
+// The config file, the threshold and the report rules are read at the cold boot and before each
+// uplink only, they are kept in the RTC state in between
+static void low_power_load_config() {
+    if (configLoaded) {
+        return;
+    }
+    configLoaded = true;
+    config_begin();
+    Preferences preferences;
+    SettingsStore settings;
+    preferences.begin("wifi-config", false);
+    settings.begin(&preferences);
+    low_power_set_threshold(rtcState, settings.get().tempThreshold);
+    preferences.end();
+
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    report_policy_begin();
+    report_policy_get(rules);
+    low_power_set_rules(rtcState, rules);
+}
+
+static bool low_power_connect() {
+    DeviceConfig config;
+    config_get(config);
+    if (config.wifiSsid[0] == '\0') {
+        return false;
+    }
+    // Straight to the access point of the last connect, scanning every channel takes seconds of radio time
+    bool cached = config.wifiChannel != 0;
+    const char* password = config.wifiPassword[0] ? config.wifiPassword : nullptr;
+    WiFi.mode(WIFI_STA);
+    if (cached) {
+        WiFi.begin(config.wifiSsid, password, config.wifiChannel, config.wifiBssid);
+    } else {
+        WiFi.begin(config.wifiSsid, password);
+    }
+    uint32_t start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < LOW_POWER_CONNECT_TIMEOUT_MS) {
+        delay(20);
+    }
+    if (WiFi.status() != WL_CONNECTED) {
+        // The access point may have moved, the next uplink scans
+        if (cached) {
+            config_set_wifi_cache(0, config.wifiBssid);
+        }
+        return false;
+    }
+    if (!cached) {
+        config_set_wifi_cache(WiFi.channel(), WiFi.BSSID());
+    }
+    return true;
+}
+
+// A failed sync keeps the offset of the last one, the low-power clock has kept running
+static void low_power_sync_time() {
+    configTime(0, 0, LOW_POWER_NTP_SERVER);
+    struct tm now;
+    if (getLocalTime(&now, LOW_POWER_TIME_TIMEOUT_MS)) {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        low_power_set_time(rtcState, (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000, millis());
+    }
+}
+
+static void low_power_uplink() {
+    low_power_load_config();
+    uint32_t radioStart = millis();
+    bool ok = false;
+    if (low_power_connect() && CORE_IOT_SERVER[0] != '\0' && CORE_IOT_TOKEN[0] != '\0') {
+        low_power_sync_time();
+        WiFiClient client;
+        Arduino_MQTT_Client mqttClient(client);
+        ThingsBoard thingsBoard(mqttClient, LOW_POWER_MQTT_BUFFER);
+        if (thingsBoard.connect(CORE_IOT_SERVER, CORE_IOT_TOKEN, CORE_IOT_PORT ? CORE_IOT_PORT : LOW_POWER_MQTT_PORT)) {
+            char json[LOW_POWER_BATCH_JSON];
+            size_t count;
+            while ((count = low_power_batch_json(rtcState, json, sizeof(json))) > 0 && thingsBoard.sendTelemetryJson(json)) {
+                low_power_sent(rtcState, count);
+            }
+            ok = rtcState.count == 0;
+            if (ok) {
+                // How the battery is doing, with the time of the arrival
+                LowPowerEstimate estimate;
+                low_power_estimate(rtcState, estimate);
+                const Telemetry health[] = {
+                    Telemetry("radio_s_per_day", estimate.radioSecondsPerDay),
+                    Telemetry("battery_days", estimate.batteryDays),
+                    Telemetry("uplink_failures", rtcState.uplinkFailures),
+                    Telemetry("samples_dropped", rtcState.dropped),
+                    Telemetry("samples_suppressed", rtcState.suppressed),
+                };
+                thingsBoard.sendTelemetry(health, sizeof(health) / sizeof(health[0]));
+            }
+            thingsBoard.loop();
+            thingsBoard.disconnect();
+        }
+    }
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    low_power_uplink_done(rtcState, ok, millis() - radioStart);
+}
+
+void low_power_run() {
+    // Only a wake from the timer finds the RTC memory as it was left, a reset or a power loss
+    // starts over
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+        rtcState.magic = 0;
+    }
+    if (low_power_begin(rtcState, HIGH_TEMP_THRESHOLD)) {
+        Serial.printf("[power] cold boot, a sample every %d s, uplink every %d samples\n",
+                      LOW_POWER_SAMPLE_INTERVAL_S, LOW_POWER_BATCH_SIZE);
+        low_power_load_config();
+        // The DHT11 stays powered while the chip sleeps, it only needs the warmup after power-on
+        uint32_t uptime = millis();
+        if (uptime < DHT_WARMUP_MS) {
+            delay(DHT_WARMUP_MS - uptime);
+        }
+    }
+
+    dht.begin();
+    float temperature = dht.readTemperature();
+    float humidity = dht.readHumidity();
+    uint16_t light = readLightLevel();
+    if (low_power_record(rtcState, temperature, humidity, light)) {
+        low_power_uplink();
+    }
+
+    LowPowerEstimate estimate;
+    low_power_estimate(rtcState, estimate);
+    Serial.printf("[power] %.1f C %.1f %% light %u, %u waiting, %lu sent, %lu dropped, %lu suppressed, radio %.0f s/day, "
+                  "%.0f days on battery\n", temperature, humidity, light, rtcState.count, (unsigned long)rtcState.delivered,
+                  (unsigned long)rtcState.dropped, (unsigned long)rtcState.suppressed, estimate.radioSecondsPerDay,
+                  estimate.batteryDays);
+    Serial.flush();
+
+    uint32_t sleepMs = low_power_sleep(rtcState, millis());
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+    esp_deep_sleep_start();
+}
+
+#endif
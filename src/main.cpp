@@ -9,19 +9,49 @@
 #include "task_wifi.h"
 #include "task_light_sensor.h"
 #include "task_lcd.h"
+#include "neo_blynky.h"
+#include "task_topology.h"
+#include "low_power.h"
+
+// Sensor, LCD and NeoPixel jobs, on one worker task instead of a task each
+static JobExecutor jobs;
 
 
 void setup()
 {
   Serial.begin(115200);
+#if LOW_POWER_MODE
+  // One sample, the uplink if one is due, then deep sleep until the next sample (low_power.h)
+  low_power_run();
+#endif
+  // Regions of the memory budget (memory_budget.h), /memory shows what was claimed from them
+  memory_budget_print();
+  // Sensor and web server tasks log through the deferred logger, its drain task owns the serial output
+  log_begin();
+  boot_stage_begin(BOOT_SETUP);
+  // Rules of the report filter the sensor jobs run their readings through (report_policy.h)
+  report_policy_begin();
+
+  // The sensors and the LCD do not need the config, they warm up and initialize while LittleFS
+  // is mounted. Each task is pinned to the core of its role (task_topology.h). Stack sizes are
+  // registered with the profiler, it shows how much of them is actually used
+  jobs.add("temp_humi", temp_humi_job, NULL, &metric_loop_temp_humi);
+  jobs.add("light_sensor", light_sensor_job, NULL, &metric_loop_light_sensor);
+  jobs.add("lcd", lcd_job, NULL, &metric_loop_lcd);
+  neo_effect_begin(jobs);
+  jobs.start("Jobs", MEMORY_STACK_JOBS, 2, topology_core(TASK_ROLE_ACQUISITION));
+  profiler_track_task(jobs.task(), MEMORY_BYTES(STACK_JOBS));
+
+  // The only mount of LittleFS, the web server uses it as it is
+  boot_stage_begin(BOOT_CONFIG);
   check_info_File(0);
+  boot_stage_end(BOOT_CONFIG);
 
-  xTaskCreate(temp_humi_monitor, "Task TEMP HUMI Monitor", 2048, NULL, 2, NULL);
-  xTaskCreate(task_light_sensor, "Task Light Sensor", 2048, NULL, 2, NULL);
-  xTaskCreate(task_lcd, "Task LCD Display", 2048, NULL, 1, NULL);
   // Need turn of led_blynk and neo_blynk function
-  xTaskCreate(webserver_wifi_config_task, "WebServer WiFi Config Task", 8192, NULL, 3, NULL);
+  topology_create_task(webserver_wifi_config_task, "WebServer WiFi Config Task", MEMORY_STACK_WEB_SERVER, NULL, 3, TASK_ROLE_NETWORK,
+                       &metric_loop_webserver);
   // xTaskCreate(Task_Toogle_BOOT, "Task_Toogle_BOOT", 4096, NULL, 2, NULL);
+  boot_stage_end(BOOT_SETUP);
 }
 
 void loop()
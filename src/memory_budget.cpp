@@ -0,0 +1,164 @@
+#include "memory_budget.h"
+#include "heap_monitor.h"
+
+#define MEMORY_ALIGN 8
+
+static const size_t MEMORY_REGION_SIZES[MEMORY_REGION_COUNT] = {
+#define MEMORY_REGION(id, kind, bytes, description) bytes,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+};
+
+static const MemoryKind MEMORY_REGION_KINDS[MEMORY_REGION_COUNT] = {
+#define MEMORY_REGION(id, kind, bytes, description) kind,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+};
+
+static const char* const MEMORY_REGION_NAMES[MEMORY_REGION_COUNT] = {
+#define MEMORY_REGION(id, kind, bytes, description) #id,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+};
+
+static const char* const MEMORY_REGION_DESCRIPTIONS[MEMORY_REGION_COUNT] = {
+#define MEMORY_REGION(id, kind, bytes, description) description,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+};
+
+static const char* const MEMORY_KIND_NAMES[] = { "stack", "kernel", "object", "buffer" };
+
+static constexpr size_t MEMORY_BUDGET_TOTAL = 0
+#define MEMORY_REGION(id, kind, bytes, description) + (bytes)
+#include "memory_budget.def"
+#undef MEMORY_REGION
+    ;
+static_assert(MEMORY_BUDGET_TOTAL <= MEMORY_BUDGET_BYTES, "The regions of memory_budget.def exceed MEMORY_BUDGET_BYTES");
+
+#if MEMORY_STATIC
+// One array per region, claimed from the front
+#define MEMORY_REGION(id, kind, bytes, description) alignas(MEMORY_ALIGN) static uint8_t memory_storage_##id[bytes];
+#include "memory_budget.def"
+#undef MEMORY_REGION
+
+static uint8_t* const MEMORY_STORAGE[MEMORY_REGION_COUNT] = {
+#define MEMORY_REGION(id, kind, bytes, description) memory_storage_##id,
+#include "memory_budget.def"
+#undef MEMORY_REGION
+};
+#endif
+
+// Also used before the scheduler runs, by semaphores created during static initialization,
+// so only zero-initialized state and no metrics here
+static uint32_t memoryClaimed[MEMORY_REGION_COUNT];
+static uint32_t memoryRegionHeap[MEMORY_REGION_COUNT];
+
+// Takes bytes of the region's budget, false if it is used up
+static bool memory_reserve(MemoryRegionId region, size_t bytes, uint32_t& offset) {
+    offset = __atomic_load_n(&memoryClaimed[region], __ATOMIC_RELAXED);
+    do {
+        if (offset + bytes > MEMORY_REGION_SIZES[region]) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&memoryClaimed[region], &offset, offset + bytes, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+// Static storage from the region, nullptr in the normal build or if the region is used up. The
+// caller takes the memory from the heap then, it is counted here.
+static void* memory_static_buffer(MemoryRegionId region, size_t bytes) {
+    bytes = (bytes + MEMORY_ALIGN - 1) & ~(size_t)(MEMORY_ALIGN - 1);
+    uint32_t offset;
+    bool reserved = memory_reserve(region, bytes, offset);
+#if MEMORY_STATIC
+    if (reserved) {
+        return MEMORY_STORAGE[region] + offset;
+    }
+#else
+    (void)reserved;
+#endif
+    __atomic_fetch_add(&memoryRegionHeap[region], (uint32_t)bytes, __ATOMIC_RELAXED);
+    heap_site_alloc(HEAP_SITE_MEMORY_BUDGET, bytes);
+    return nullptr;
+}
+
+size_t memory_region_bytes(MemoryRegionId region) {
+    return MEMORY_REGION_SIZES[region];
+}
+
+void* memory_claim(MemoryRegionId region, size_t bytes) {
+    void* storage = memory_static_buffer(region, bytes);
+    return storage ? storage : malloc(bytes);
+}
+
+SemaphoreHandle_t memory_create_mutex() {
+    StaticSemaphore_t* buffer = (StaticSemaphore_t*)memory_static_buffer(MEMORY_SEMAPHORES, sizeof(StaticSemaphore_t));
+    return buffer ? xSemaphoreCreateMutexStatic(buffer) : xSemaphoreCreateMutex();
+}
+
+SemaphoreHandle_t memory_create_counting_semaphore(UBaseType_t max, UBaseType_t initial) {
+    StaticSemaphore_t* buffer = (StaticSemaphore_t*)memory_static_buffer(MEMORY_SEMAPHORES, sizeof(StaticSemaphore_t));
+    return buffer ? xSemaphoreCreateCountingStatic(max, initial, buffer) : xSemaphoreCreateCounting(max, initial);
+}
+
+QueueHandle_t memory_create_queue(UBaseType_t length, UBaseType_t itemSize) {
+    uint8_t* buffer = (uint8_t*)memory_static_buffer(MEMORY_QUEUES, sizeof(StaticQueue_t) + length * itemSize);
+    if (buffer) {
+        return xQueueCreateStatic(length, itemSize, buffer + sizeof(StaticQueue_t), (StaticQueue_t*)buffer);
+    }
+    return xQueueCreate(length, itemSize);
+}
+
+TaskHandle_t memory_create_task(TaskFunction_t function, const char* name, MemoryRegionId stack, void* arg,
+                                UBaseType_t priority, BaseType_t core) {
+    // Stack depths are in bytes on the ESP32
+    size_t stackBytes = MEMORY_REGION_SIZES[stack];
+    StackType_t* stackBuffer = (StackType_t*)memory_static_buffer(stack, stackBytes);
+    StaticTask_t* task = (StaticTask_t*)memory_static_buffer(MEMORY_TASKS, sizeof(StaticTask_t));
+    if (stackBuffer && task) {
+        return xTaskCreateStaticPinnedToCore(function, name, stackBytes, arg, priority, stackBuffer, task, core);
+    }
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(function, name, stackBytes, arg, priority, &handle, core) != pdPASS) {
+        return nullptr;
+    }
+    return handle;
+}
+
+size_t memory_heap_bytes() {
+    size_t total = 0;
+    for (int region = 0; region < MEMORY_REGION_COUNT; region++) {
+        total += __atomic_load_n(&memoryRegionHeap[region], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void memory_budget_print() {
+    Serial.printf("Memory budget (%s): %u of %u bytes declared\n", MEMORY_STATIC ? "static" : "heap",
+                  (unsigned)MEMORY_BUDGET_TOTAL, (unsigned)MEMORY_BUDGET_BYTES);
+    for (int region = 0; region < MEMORY_REGION_COUNT; region++) {
+        Serial.printf("  %-18s %-6s %6u  %s\n", MEMORY_REGION_NAMES[region], MEMORY_KIND_NAMES[MEMORY_REGION_KINDS[region]],
+                      (unsigned)MEMORY_REGION_SIZES[region], MEMORY_REGION_DESCRIPTIONS[region]);
+    }
+}
+
+bool memory_budget_write(Print& out, size_t item) {
+    if (item > MEMORY_REGION_COUNT) {
+        out.print("]}");
+        return false;
+    }
+    if (item == 0) {
+        out.printf("{\"static\":%s,\"budget_bytes\":%u,\"declared_bytes\":%u,\"heap_bytes\":%u,\"regions\":[",
+                   MEMORY_STATIC ? "true" : "false", (unsigned)MEMORY_BUDGET_BYTES, (unsigned)MEMORY_BUDGET_TOTAL,
+                   (unsigned)memory_heap_bytes());
+        return true;
+    }
+    int region = item - 1;
+    out.printf("%s{\"name\":\"%s\",\"kind\":\"%s\",\"bytes\":%u,\"claimed\":%u,\"heap\":%u}", region ? "," : "",
+               MEMORY_REGION_NAMES[region], MEMORY_KIND_NAMES[MEMORY_REGION_KINDS[region]],
+               (unsigned)MEMORY_REGION_SIZES[region], (unsigned)__atomic_load_n(&memoryClaimed[region], __ATOMIC_RELAXED),
+               (unsigned)__atomic_load_n(&memoryRegionHeap[region], __ATOMIC_RELAXED));
+    return true;
+}
@@ -0,0 +1,204 @@
+#include "metrics.h"
+#include "esp_heap_caps.h"
+#include "memory_budget.h"
+#include "heap_monitor.h"
+
+Metric* Metric::head = nullptr;
+Metric* Metric::tail = nullptr;
+
+const uint32_t MetricHistogram::BOUNDS_US[METRICS_HISTOGRAM_BUCKETS] = {
+    100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000
+};
+const char* const MetricHistogram::BOUNDS_LE[METRICS_HISTOGRAM_BUCKETS] = {
+    "0.0001", "0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "0.5", "1.0", "5.0"
+};
+
+MetricCounter metric_dht_reads("dht_reads", "DHT11 read attempts");
+MetricCounter metric_dht_read_failures("dht_read_failures", "DHT11 reads that returned no value");
+MetricGauge metric_temperature("temperature_celsius", "Last valid temperature reading");
+MetricGauge metric_humidity("humidity_percent", "Last valid humidity reading");
+MetricGauge metric_light_level("light_level", "Last light sensor reading (raw ADC)");
+MetricHistogram metric_loop_temp_humi("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"temp_humi\"");
+MetricHistogram metric_loop_light_sensor("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"light_sensor\"");
+MetricHistogram metric_loop_lcd("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"lcd\"");
+MetricHistogram metric_loop_webserver("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"webserver\"");
+MetricHistogram metric_loop_ws_commands("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"ws_commands\"");
+MetricHistogram metric_loop_neo_effect("task_loop_seconds", "Time spent per task loop iteration, without the delay", "task=\"neo_effect\"");
+MetricHistogram metric_job_lateness("job_lateness_seconds", "Time from a job being due until its step ran on the job worker");
+MetricCounter metric_sensor_channel_dropped("sensor_channel_dropped", "Sensor readings dropped because the web server task did not take them in time");
+
+MetricCounter metric_http_responses("http_responses", "Streamed REST responses");
+MetricCounter metric_ws_messages_received("ws_messages_received", "WebSocket messages received from clients");
+MetricHistogram metric_ws_broadcast("ws_broadcast_seconds", "Time spent fanning a message out to all WebSocket clients");
+MetricCounter metric_ws_frames_dropped("ws_frames_dropped", "Sensor frames dropped for WebSocket clients that fell behind");
+MetricCounter metric_ws_evictions("ws_evictions", "WebSocket clients closed because they stayed behind");
+MetricCounter metric_ws_commands_coalesced("ws_commands_coalesced", "Dashboard commands replaced by a newer one of the same kind before they ran");
+MetricCounter metric_ws_commands_dropped("ws_commands_dropped", "Dashboard commands dropped because the command queue was full");
+MetricHistogram metric_sensor_latency_dht("sensor_to_ws_seconds", "Time from a sensor read until the first message with the value left the WebSocket send queues", "sensor=\"dht\"");
+MetricHistogram metric_sensor_latency_light("sensor_to_ws_seconds", "Time from a sensor read until the first message with the value left the WebSocket send queues", "sensor=\"light\"");
+
+MetricCounter metric_settings_changes("settings_changes", "Settings saved from the dashboards");
+MetricCounter metric_settings_writes("settings_writes", "Settings blobs written to NVS");
+MetricCounter metric_settings_write_failures("settings_write_failures", "Settings blobs that could not be written to NVS");
+
+MetricCounter metric_config_writes("config_writes", "Device config files written");
+MetricCounter metric_config_write_failures("config_write_failures", "Device config files that could not be written");
+
+MetricCounter metric_report_readings_temperature("report_readings", "Valid sensor readings passed to the report filter", "metric=\"temperature\"");
+MetricCounter metric_report_readings_humidity("report_readings", "Valid sensor readings passed to the report filter", "metric=\"humidity\"");
+MetricCounter metric_report_readings_light("report_readings", "Valid sensor readings passed to the report filter", "metric=\"light\"");
+MetricCounter metric_report_reports_temperature("report_reports", "Readings or windows the report filter would send", "metric=\"temperature\"");
+MetricCounter metric_report_reports_humidity("report_reports", "Readings or windows the report filter would send", "metric=\"humidity\"");
+MetricCounter metric_report_reports_light("report_reports", "Readings or windows the report filter would send", "metric=\"light\"");
+
+MetricGauge metric_boot_first_publish("boot_first_publish_seconds", "Time from boot to the first valid sensor reading sent to the dashboards");
+
+MetricCounter metric_log_dropped("log_dropped", "Log messages lost because the ring of their task was full");
+
+MetricCounter metric_json_arena_fallbacks("json_arena_fallbacks", "JSON documents allocated from the heap because no arena block was free");
+
+MetricGauge metric_heap_free("heap_free_bytes", "Free heap");
+MetricGauge metric_heap_min_free("heap_min_free_bytes", "Lowest free heap since boot");
+MetricGauge metric_heap_largest_block("heap_largest_free_block_bytes", "Largest allocatable heap block");
+MetricGauge metric_heap_fragmentation("heap_fragmentation_ratio", "Share of the free heap outside of the largest free block");
+MetricGauge metric_uptime("uptime_seconds", "Time since boot");
+MetricGauge metric_memory_budget_heap("memory_budget_heap_bytes", "Bytes of the memory budget regions handed out from the heap");
+
+Metric::Metric(Type type, const char* name, const char* help, const char* labels)
+    : type(type), name(name), help(help), labels(labels), nextMetric(nullptr) {
+    // Global constructors run before any task, so the list needs no lock
+    if (tail) {
+        tail->nextMetric = this;
+    } else {
+        head = this;
+    }
+    tail = this;
+}
+
+void Metric::write(Print& out) const {
+    bool firstOfName = true;
+    for (const Metric* metric = head; metric != this; metric = metric->nextMetric) {
+        if (strcmp(metric->name, name) == 0) {
+            firstOfName = false;
+            break;
+        }
+    }
+    if (firstOfName) {
+        static const char* const TYPE_NAMES[] = { "counter", "gauge", "histogram" };
+        out.printf("# TYPE %s %s\n# HELP %s %s\n", name, TYPE_NAMES[type], name, help);
+    }
+    writeSamples(out);
+}
+
+MetricCounter::MetricCounter(const char* name, const char* help, const char* labels)
+    : Metric(COUNTER, name, help, labels), values{} {
+}
+
+uint64_t MetricCounter::value() const {
+    uint64_t total = 0;
+    for (int core = 0; core < METRICS_CORES; core++) {
+        total += __atomic_load_n(&values[core], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+void MetricCounter::writeSamples(Print& out) const {
+    out.printf("%s_total%s%s%s %llu\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+               (unsigned long long)value());
+}
+
+MetricGauge::MetricGauge(const char* name, const char* help, const char* labels)
+    : Metric(GAUGE, name, help, labels), bits(0) {
+}
+
+float MetricGauge::value() const {
+    uint32_t current = __atomic_load_n(&bits, __ATOMIC_RELAXED);
+    float value;
+    memcpy(&value, &current, sizeof(value));
+    return value;
+}
+
+void MetricGauge::writeSamples(Print& out) const {
+    out.printf("%s%s%s%s %.9g\n", name, labels ? "{" : "", labels ? labels : "", labels ? "}" : "", value());
+}
+
+MetricHistogram::MetricHistogram(const char* name, const char* help, const char* labels)
+    : Metric(HISTOGRAM, name, help, labels), buckets{}, sumLow{}, sumHigh{} {
+}
+
+void MetricHistogram::observe(uint32_t micros) {
+    int bucket = 0;
+    while (bucket < METRICS_HISTOGRAM_BUCKETS && micros > BOUNDS_US[bucket]) {
+        bucket++;
+    }
+    int core = xPortGetCoreID();
+    __atomic_fetch_add(&buckets[core][bucket], 1, __ATOMIC_RELAXED);
+    uint32_t previous = __atomic_fetch_add(&sumLow[core], micros, __ATOMIC_RELAXED);
+    if ((uint32_t)(previous + micros) < previous) {
+        __atomic_fetch_add(&sumHigh[core], 1, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t MetricHistogram::snapshot(uint32_t counts[METRICS_HISTOGRAM_BUCKETS + 1]) const {
+    uint64_t total = 0;
+    for (int bucket = 0; bucket <= METRICS_HISTOGRAM_BUCKETS; bucket++) {
+        counts[bucket] = 0;
+        for (int core = 0; core < METRICS_CORES; core++) {
+            counts[bucket] += __atomic_load_n(&buckets[core][bucket], __ATOMIC_RELAXED);
+        }
+        total += counts[bucket];
+    }
+    return total;
+}
+
+const char* MetricHistogram::bound(int bucket) {
+    return bucket < METRICS_HISTOGRAM_BUCKETS ? BOUNDS_LE[bucket] : "+Inf";
+}
+
+void MetricHistogram::writeSamples(Print& out) const {
+    const char* separator = labels ? "," : "";
+    const char* labelSet = labels ? labels : "";
+
+    uint64_t cumulative = 0;
+    for (int bucket = 0; bucket <= METRICS_HISTOGRAM_BUCKETS; bucket++) {
+        for (int core = 0; core < METRICS_CORES; core++) {
+            cumulative += __atomic_load_n(&buckets[core][bucket], __ATOMIC_RELAXED);
+        }
+        out.printf("%s_bucket{%s%sle=\"%s\"} %llu\n", name, labelSet, separator,
+                   bucket < METRICS_HISTOGRAM_BUCKETS ? BOUNDS_LE[bucket] : "+Inf", (unsigned long long)cumulative);
+    }
+
+    uint64_t sum = 0;
+    for (int core = 0; core < METRICS_CORES; core++) {
+        sum += ((uint64_t)__atomic_load_n(&sumHigh[core], __ATOMIC_RELAXED) << 32) |
+               __atomic_load_n(&sumLow[core], __ATOMIC_RELAXED);
+    }
+    const char* open = labels ? "{" : "";
+    const char* close = labels ? "}" : "";
+    out.printf("%s_count%s%s%s %llu\n", name, open, labelSet, close, (unsigned long long)cumulative);
+    out.printf("%s_sum%s%s%s %.6f\n", name, open, labelSet, close, sum / 1000000.0);
+}
+
+void metrics_collect() {
+    uint32_t freeBytes = ESP.getFreeHeap();
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    metric_heap_free.set(freeBytes);
+    metric_heap_min_free.set(ESP.getMinFreeHeap());
+    metric_heap_largest_block.set(largest);
+    metric_heap_fragmentation.set(heap_fragmentation(freeBytes, largest));
+    metric_uptime.set(millis() / 1000.0f);
+    metric_memory_budget_heap.set(memory_heap_bytes());
+}
+
+bool metrics_write(Print& out, size_t item) {
+    Metric* metric = Metric::first();
+    for (size_t i = 0; i < item && metric; i++) {
+        metric = metric->next();
+    }
+    if (!metric) {
+        out.print("# EOF\n");
+        return false;
+    }
+    metric->write(out);
+    return true;
+}
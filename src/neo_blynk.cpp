@@ -1,25 +1,67 @@
 #include "neo_blynky.h"
+#include <new>
 
-void neo_blinky(void *pvParameters){
+static Adafruit_NeoPixel strip(LED_COUNT, NEO_PIN, NEO_GRB + NEO_KHZ800);
+// Mailbox of length 1
+static JobQueue* neoEffects = nullptr;
 
-    Adafruit_NeoPixel strip(LED_COUNT, NEO_PIN, NEO_GRB + NEO_KHZ800);
-    strip.begin();
-    // Set all pixels to off to start
-    strip.clear();
-    strip.show();
+static void neo_effect_post(NeoEffectMode mode, uint8_t r, uint8_t g, uint8_t b) {
+    NeoEffect effect = { mode, r, g, b };
+    if (neoEffects) {
+        neoEffects->overwrite(&effect);
+    }
+}
+
+void neo_effect_show(uint8_t r, uint8_t g, uint8_t b) {
+    neo_effect_post(NEO_EFFECT_SOLID, r, g, b);
+}
 
-    while(1) {                          
-        strip.setPixelColor(0, strip.Color(255, 0, 0)); // Set pixel 0 to red
-        strip.show(); // Update the strip
+void neo_effect_blink(uint8_t r, uint8_t g, uint8_t b) {
+    neo_effect_post(NEO_EFFECT_BLINK, r, g, b);
+}
 
-        // Wait for 500 milliseconds
-        vTaskDelay(500);
+static JobWait neo_effect_job(void *arg) {
+    static bool started = false;
+    static NeoEffect current = { NEO_EFFECT_SOLID, 0, 0, 0 };
+    static bool lit = false;
+    static uint32_t nextToggle = 0;
 
-        // Set the pixel to off
-        strip.setPixelColor(0, strip.Color(0, 0, 0)); // Turn pixel 0 off
-        strip.show(); // Update the strip
+    if (!started) {
+        strip.begin();
+        // Set all pixels to off to start
+        strip.clear();
+        strip.show();
+        started = true;
+    }
 
-        // Wait for another 500 milliseconds
-        vTaskDelay(500);
+    uint32_t now = millis();
+    NeoEffect next;
+    bool changed = false;
+    if (neoEffects->receive(&next) && memcmp(&next, &current, sizeof(next)) != 0) {
+        current = next;
+        changed = true;
+    }
+    if (changed || (current.mode == NEO_EFFECT_BLINK && (int32_t)(now - nextToggle) >= 0)) {
+        // A new effect starts with the color on
+        lit = changed || !lit;
+        if (lit) {
+            strip.setPixelColor(0, strip.Color(current.r, current.g, current.b));
+        } else {
+            strip.setPixelColor(0, strip.Color(0, 0, 0));
+        }
+        strip.show();
+        nextToggle = now + NEO_BLINK_MS;
     }
-}
\ No newline at end of file
+
+    if (current.mode != NEO_EFFECT_BLINK) {
+        return JobWait::receive(*neoEffects);
+    }
+    int32_t remaining = (int32_t)(nextToggle - now);
+    return JobWait::receive(*neoEffects, remaining > 0 ? remaining : 0);
+}
+
+void neo_effect_begin(JobExecutor& executor) {
+    MEMORY_FITS(JOB_QUEUES, sizeof(JobQueue));
+    neoEffects = new (memory_claim(MEMORY_JOB_QUEUES, sizeof(JobQueue))) JobQueue(executor, 1, sizeof(NeoEffect));
+    executor.add("neo_effect", neo_effect_job, nullptr, &metric_loop_neo_effect);
+}
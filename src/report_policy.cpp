@@ -0,0 +1,183 @@
+#include "report_policy.h"
+#include <Preferences.h>
+#include "memory_budget.h"
+
+// Readings come in steps of the sensor resolution, a step of exactly the dead band is reported
+#define REPORT_EPSILON 1e-4f
+#define REPORT_DEFAULT_SILENCE_S 900
+
+struct ReportPolicyBlob {
+    uint16_t version;
+    uint16_t size;          // sizeof(ReportRule) when written, a changed layout needs a new version
+    ReportRule rules[HISTORY_METRIC_COUNT];
+};
+
+static SemaphoreHandle_t policyMutex = nullptr;
+static ReportRule policyRules[HISTORY_METRIC_COUNT];
+static bool policyRestart[HISTORY_METRIC_COUNT];    // Rule changed, the filter starts over
+// Only used by the sensor jobs, they all run on the job worker
+static ReportTrack policyTracks[HISTORY_METRIC_COUNT];
+
+static MetricCounter* const READINGS[HISTORY_METRIC_COUNT] = {
+    &metric_report_readings_temperature,
+    &metric_report_readings_humidity,
+    &metric_report_readings_light,
+};
+static MetricCounter* const REPORTS[HISTORY_METRIC_COUNT] = {
+    &metric_report_reports_temperature,
+    &metric_report_reports_humidity,
+    &metric_report_reports_light,
+};
+
+bool report_rule_valid(const ReportRule& rule) {
+    return rule.deadBand >= 0 && rule.deadBand <= REPORT_MAX_DEAD_BAND &&
+           rule.maxSilenceS <= REPORT_MAX_SILENCE_S && rule.windowS <= REPORT_MAX_WINDOW_S;
+}
+
+void report_policy_defaults(ReportRule* rules) {
+    // Twice the resolution of the DHT11 readings and about 2.5 % of the light range, each reading
+    // on its own and a heartbeat every 15 minutes
+    rules[HISTORY_TEMPERATURE] = { 0.5f, REPORT_DEFAULT_SILENCE_S, 0 };
+    rules[HISTORY_HUMIDITY] = { 2.0f, REPORT_DEFAULT_SILENCE_S, 0 };
+    rules[HISTORY_LIGHT] = { 100.0f, REPORT_DEFAULT_SILENCE_S, 0 };
+}
+
+static void track_add(ReportTrack& track, float value, uint32_t nowMs) {
+    if (track.count == 0) {
+        track.windowStart = nowMs;
+        track.min = value;
+        track.max = value;
+        track.sum = 0;
+    }
+    track.min = min(track.min, value);
+    track.max = max(track.max, value);
+    track.sum += value;
+    track.count++;
+}
+
+// Closes the window, true if it is reported
+static bool track_close(ReportTrack& track, const ReportRule& rule, uint32_t nowMs, Report& report) {
+    float band = rule.deadBand - REPORT_EPSILON;
+    bool moved = !track.reported || track.max - track.lastValue >= band || track.lastValue - track.min >= band;
+    bool silent = rule.maxSilenceS > 0 && nowMs - track.lastReport >= rule.maxSilenceS * 1000UL;
+    bool due = moved || silent;
+    if (due) {
+        report.mean = track.sum / track.count;
+        report.min = track.min;
+        report.max = track.max;
+        report.count = track.count;
+        track.lastValue = report.mean;
+        track.lastReport = nowMs;
+        track.reported = true;
+    }
+    track.count = 0;
+    return due;
+}
+
+bool report_track(ReportTrack& track, const ReportRule& rule, float value, uint32_t nowMs, Report& report) {
+    if (rule.windowS == 0) {
+        track_add(track, value, nowMs);
+        return track_close(track, rule, nowMs, report);
+    }
+    bool due = false;
+    if (track.count > 0 && nowMs - track.windowStart >= rule.windowS * 1000UL) {
+        due = track_close(track, rule, nowMs, report);
+    }
+    track_add(track, value, nowMs);
+    return due;
+}
+
+void report_policy_begin() {
+    if (policyMutex != nullptr) {
+        return;
+    }
+    policyMutex = memory_create_mutex();
+    report_policy_defaults(policyRules);
+
+    Preferences preferences;
+    if (preferences.begin(REPORT_POLICY_NAMESPACE, true)) {
+        ReportPolicyBlob blob;
+        if (preferences.getBytesLength(REPORT_POLICY_KEY) == sizeof(blob) &&
+            preferences.getBytes(REPORT_POLICY_KEY, &blob, sizeof(blob)) == sizeof(blob) &&
+            blob.version == REPORT_POLICY_VERSION && blob.size == sizeof(ReportRule)) {
+            // A rule that does not make sense keeps its default
+            for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+                if (report_rule_valid(blob.rules[i])) {
+                    policyRules[i] = blob.rules[i];
+                }
+            }
+        }
+        preferences.end();
+    }
+}
+
+void report_policy_get(ReportRule* rules) {
+    xSemaphoreTake(policyMutex, portMAX_DELAY);
+    memcpy(rules, policyRules, sizeof(policyRules));
+    xSemaphoreGive(policyMutex);
+}
+
+static bool report_policy_write(const ReportRule* rules) {
+    ReportPolicyBlob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.version = REPORT_POLICY_VERSION;
+    blob.size = sizeof(ReportRule);
+    memcpy(blob.rules, rules, sizeof(blob.rules));
+    Preferences preferences;
+    if (!preferences.begin(REPORT_POLICY_NAMESPACE, false)) {
+        return false;
+    }
+    bool written = preferences.putBytes(REPORT_POLICY_KEY, &blob, sizeof(blob)) == sizeof(blob);
+    preferences.end();
+    return written;
+}
+
+bool report_policy_set(HistoryMetric metric, const ReportRule& rule) {
+    if (metric >= HISTORY_METRIC_COUNT || !report_rule_valid(rule)) {
+        return false;
+    }
+    // Rules are changed by hand, they are written right away instead of batched like the settings
+    xSemaphoreTake(policyMutex, portMAX_DELAY);
+    ReportRule& current = policyRules[metric];
+    bool changed = current.deadBand != rule.deadBand || current.maxSilenceS != rule.maxSilenceS ||
+                   current.windowS != rule.windowS;
+    bool saved = true;
+    if (changed) {
+        ReportRule rules[HISTORY_METRIC_COUNT];
+        memcpy(rules, policyRules, sizeof(rules));
+        rules[metric] = rule;
+        saved = report_policy_write(rules);
+        if (saved) {
+            current = rule;
+            policyRestart[metric] = true;
+        }
+    }
+    xSemaphoreGive(policyMutex);
+    return saved;
+}
+
+void report_policy_reading(HistoryMetric metric, float value, uint32_t readMs) {
+    xSemaphoreTake(policyMutex, portMAX_DELAY);
+    ReportRule rule = policyRules[metric];
+    bool restart = policyRestart[metric];
+    policyRestart[metric] = false;
+    xSemaphoreGive(policyMutex);
+
+    ReportTrack& track = policyTracks[metric];
+    if (restart) {
+        memset(&track, 0, sizeof(track));
+    }
+    READINGS[metric]->inc();
+    Report report;
+    if (report_track(track, rule, value, readMs, report)) {
+        REPORTS[metric]->inc();
+    }
+}
+
+uint64_t report_policy_readings(HistoryMetric metric) {
+    return READINGS[metric]->value();
+}
+
+uint64_t report_policy_reports(HistoryMetric metric) {
+    return REPORTS[metric]->value();
+}
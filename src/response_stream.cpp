@@ -0,0 +1,62 @@
+#include "response_stream.h"
+#include "metrics.h"
+#include "heap_monitor.h"
+
+ResponseStream::ResponseStream(Producer producer)
+    : producer(producer), item(0), finished(false), out(nullptr), outLen(0), outMax(0), pendingPos(0) {
+}
+
+size_t ResponseStream::read(uint8_t* buffer, size_t maxLen) {
+    out = buffer;
+    outLen = 0;
+    outMax = maxLen;
+
+    // Leftovers of the last piece first
+    if (pendingPos < pending.size()) {
+        size_t n = min(pending.size() - pendingPos, maxLen);
+        memcpy(buffer, pending.data() + pendingPos, n);
+        pendingPos += n;
+        outLen = n;
+        if (pendingPos < pending.size()) {
+            out = nullptr;
+            return outLen;
+        }
+        pending.clear();
+        pendingPos = 0;
+    }
+
+    while (outLen < outMax && !finished) {
+        finished = !producer(*this, item++);
+    }
+
+    out = nullptr;
+    return outLen;
+}
+
+size_t ResponseStream::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t ResponseStream::write(const uint8_t* data, size_t len) {
+    size_t n = 0;
+    if (out != nullptr && outLen < outMax) {
+        n = min(len, outMax - outLen);
+        memcpy(out + outLen, data, n);
+        outLen += n;
+    }
+    if (n < len) {
+        pending.insert(pending.end(), data + n, data + len);
+    }
+    return len;
+}
+
+void sendStreamResponse(AsyncWebServerRequest* request, const char* contentType, ResponseStream::Producer producer) {
+    metric_http_responses.inc();
+    heap_site_alloc(HEAP_SITE_HTTP_RESPONSE, sizeof(ResponseStream));
+    std::shared_ptr<ResponseStream> stream = std::make_shared<ResponseStream>(producer);
+    AsyncWebServerResponse* response = request->beginChunkedResponse(contentType,
+        [stream](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return stream->read(buffer, maxLen);
+        });
+    request->send(response);
+}
@@ -0,0 +1,28 @@
+#include "sensor_channel.h"
+#include "metrics.h"
+
+static SpscRing<SensorSample, SENSOR_CHANNEL_DEPTH> sensorRing;
+
+void sensor_channel_publish(const SensorSample& sample) {
+    if (!sensorRing.push(sample)) {
+        metric_sensor_channel_dropped.inc();
+    }
+}
+
+size_t sensor_channel_drain(SensorSnapshot& snapshot) {
+    size_t count = 0;
+    SensorSample sample;
+    while (sensorRing.pop(sample)) {
+        if (sample.kind == SENSOR_SAMPLE_DHT) {
+            snapshot.temperature = sample.first;
+            snapshot.humidity = sample.second;
+            snapshot.dhtReadMs = sample.readMs;
+        } else {
+            snapshot.lightLevel = (int)sample.first;
+            snapshot.ledState = sample.ledState;
+            snapshot.lightReadMs = sample.readMs;
+        }
+        count++;
+    }
+    return count;
+}
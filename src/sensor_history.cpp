@@ -0,0 +1,208 @@
+#include "sensor_history.h"
+#include "memory_budget.h"
+
+struct HistoryBuffer {
+    HistorySample samples[HISTORY_CAPACITY];
+    uint32_t total;          // Samples ever pushed, sample n is stored at n % HISTORY_CAPACITY
+    // Readings of the interval that is still running
+    double sum;
+    uint32_t sumCount;
+    uint32_t intervalStart;
+};
+
+static HistoryBuffer historyBuffers[HISTORY_METRIC_COUNT];
+static SemaphoreHandle_t historyMutex = memory_create_mutex();
+
+static const char* const HISTORY_METRIC_NAMES[HISTORY_METRIC_COUNT] = {
+    "temperature",
+    "humidity",
+    "light"
+};
+
+static uint32_t history_oldest(const HistoryBuffer& buffer) {
+    return buffer.total > HISTORY_CAPACITY ? buffer.total - HISTORY_CAPACITY : 0;
+}
+
+// Expects the history lock to be held, fails if the sample was already overwritten
+static bool history_sample(const HistoryBuffer& buffer, uint32_t seq, HistorySample& sample) {
+    if (seq < history_oldest(buffer) || seq >= buffer.total) {
+        return false;
+    }
+    sample = buffer.samples[seq % HISTORY_CAPACITY];
+    return true;
+}
+
+// First sequence number whose sample is newer than time (or at least as new if inclusive)
+static uint32_t history_search(const HistoryBuffer& buffer, uint32_t time, bool inclusive) {
+    uint32_t low = history_oldest(buffer);
+    uint32_t high = buffer.total;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t sampleTime = buffer.samples[mid % HISTORY_CAPACITY].time;
+        if (inclusive ? sampleTime < time : sampleTime <= time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t history_now() {
+    return millis() / 1000;
+}
+
+void history_record(HistoryMetric metric, float value) {
+    if (metric >= HISTORY_METRIC_COUNT || isnan(value)) {
+        return;
+    }
+    uint32_t now = history_now();
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    HistoryBuffer& buffer = historyBuffers[metric];
+    if (buffer.sumCount > 0 && now - buffer.intervalStart >= HISTORY_INTERVAL_S) {
+        HistorySample& sample = buffer.samples[buffer.total % HISTORY_CAPACITY];
+        sample.time = buffer.intervalStart;
+        sample.value = buffer.sum / buffer.sumCount;
+        buffer.total++;
+        buffer.sumCount = 0;
+        buffer.sum = 0;
+    }
+    if (buffer.sumCount == 0) {
+        buffer.intervalStart = now;
+    }
+    buffer.sum += value;
+    buffer.sumCount++;
+    xSemaphoreGive(historyMutex);
+}
+
+bool history_parse_metric(const String& name, HistoryMetric& metric) {
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        if (name == HISTORY_METRIC_NAMES[i]) {
+            metric = (HistoryMetric)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* history_metric_name(HistoryMetric metric) {
+    return metric < HISTORY_METRIC_COUNT ? HISTORY_METRIC_NAMES[metric] : "";
+}
+
+HistoryQuery::HistoryQuery(HistoryMetric metric, uint32_t from, uint32_t to, size_t maxPoints)
+    : metric(metric), first(0), count(0), points(0), produced(0), selected({0, 0}) {
+    if (metric >= HISTORY_METRIC_COUNT || from > to) {
+        return;
+    }
+    // LTTB always keeps the first and last point and needs at least one bucket in between
+    if (maxPoints < 3) {
+        maxPoints = 3;
+    }
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    const HistoryBuffer& buffer = historyBuffers[metric];
+    first = history_search(buffer, from, true);
+    count = history_search(buffer, to, false) - first;
+    xSemaphoreGive(historyMutex);
+
+    points = count < maxPoints ? count : maxPoints;
+}
+
+bool HistoryQuery::next(HistorySample& sample) {
+    if (produced >= points) {
+        return false;
+    }
+
+    xSemaphoreTake(historyMutex, portMAX_DELAY);
+    const HistoryBuffer& buffer = historyBuffers[metric];
+    bool ok;
+    if (count <= points) {
+        ok = history_sample(buffer, first + produced, sample);
+    } else if (produced == 0) {
+        ok = history_sample(buffer, first, sample);
+    } else if (produced == points - 1) {
+        ok = history_sample(buffer, first + count - 1, sample);
+    } else {
+        // Buckets split the samples between the first and the last point evenly
+        double every = (double)(count - 2) / (points - 2);
+        size_t bucket = produced - 1;
+        size_t start = (size_t)(bucket * every) + 1;
+        size_t end = (size_t)((bucket + 1) * every) + 1;
+        size_t nextEnd = (size_t)((bucket + 2) * every) + 1;
+        if (end > count - 1) end = count - 1;
+        if (nextEnd > count) nextEnd = count;
+
+        // Average of the next bucket is the third corner of the triangle, relative to the
+        // selected point, so large uptimes do not eat the float precision
+        double avgTime = 0, avgValue = 0;
+        size_t nextStart = end < nextEnd ? end : count - 1;
+        size_t nextCount = 0;
+        HistorySample current;
+        ok = true;
+        for (size_t i = nextStart; i < nextEnd && ok; i++) {
+            ok = history_sample(buffer, first + i, current);
+            avgTime += (double)current.time - selected.time;
+            avgValue += current.value;
+            nextCount++;
+        }
+        if (nextCount == 0) {
+            ok = ok && history_sample(buffer, first + count - 1, current);
+            avgTime = (double)current.time - selected.time;
+            avgValue = current.value;
+            nextCount = 1;
+        }
+        avgTime /= nextCount;
+        avgValue = avgValue / nextCount - selected.value;
+
+        double maxArea = -1;
+        for (size_t i = start; i < end && ok; i++) {
+            ok = history_sample(buffer, first + i, current);
+            double area = fabs(((double)current.time - selected.time) * avgValue -
+                               avgTime * ((double)current.value - selected.value));
+            if (area > maxArea) {
+                maxArea = area;
+                sample = current;
+            }
+        }
+    }
+    xSemaphoreGive(historyMutex);
+
+    if (!ok) {
+        // Overwritten while the response was streaming, end the series early
+        points = produced;
+        return false;
+    }
+    selected = sample;
+    produced++;
+    return true;
+}
+
+HistoryJsonWriter::HistoryJsonWriter(HistoryMetric metric, uint32_t from, uint32_t to, size_t maxPoints)
+    : metric(metric), from(from), to(to), query(metric, from, to, maxPoints) {
+}
+
+bool HistoryJsonWriter::write(Print& out, size_t item) {
+    char piece[160];
+    int len;
+    bool more = true;
+    if (item == 0) {
+        len = snprintf(piece, sizeof(piece),
+                       "{\"type\":\"history\",\"metric\":\"%s\",\"now\":%lu,\"from\":%lu,\"to\":%lu,\"interval\":%d,\"points\":[",
+                       history_metric_name(metric), (unsigned long)history_now(),
+                       (unsigned long)from, (unsigned long)to, HISTORY_INTERVAL_S);
+    } else {
+        HistorySample sample;
+        if (query.next(sample)) {
+            len = snprintf(piece, sizeof(piece), "%s[%lu,%.2f]",
+                           item > 1 ? "," : "", (unsigned long)sample.time, sample.value);
+        } else {
+            len = snprintf(piece, sizeof(piece), "]}");
+            more = false;
+        }
+    }
+    if (len > 0) {
+        out.write((const uint8_t*)piece, min((size_t)len, sizeof(piece) - 1));
+    }
+    return more;
+}
@@ -0,0 +1,172 @@
+#include "settings_store.h"
+#include "esp_system.h"
+#include "memory_budget.h"
+
+static SettingsStore* shutdownStore = nullptr;
+
+// Runs in esp_restart(), before the chip resets
+static void settings_store_shutdown() {
+    if (shutdownStore) {
+        shutdownStore->flush();
+    }
+}
+
+static void copy_hex(char* to, const char* from) {
+    strncpy(to, from, SETTINGS_MAX_HEX);
+    to[SETTINGS_MAX_HEX] = '\0';
+}
+
+static Settings default_settings() {
+    Settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.tempThreshold = 30.0;
+    settings.neoR = 0;
+    settings.neoG = 255;
+    settings.neoB = 0;
+    copy_hex(settings.neoHex, "#00ff00");
+    settings.alertR = 255;
+    settings.alertG = 0;
+    settings.alertB = 0;
+    copy_hex(settings.alertHex, "#ff0000");
+    return settings;
+}
+
+SettingsStore::SettingsStore() : preferences(nullptr), dirty(false), firstChange(0), lastChange(0) {
+    mutex = memory_create_mutex();
+    current = default_settings();
+    stored = current;
+}
+
+void SettingsStore::begin(Preferences* preferences) {
+    this->preferences = preferences;
+    Blob blob;
+    size_t len = preferences->getBytesLength(SETTINGS_KEY);
+    if (len == sizeof(blob) && preferences->getBytes(SETTINGS_KEY, &blob, sizeof(blob)) == sizeof(blob) &&
+        blob.version == SETTINGS_VERSION && blob.size == sizeof(Settings)) {
+        current = blob.settings;
+        stored = current;
+    } else if (!migrate()) {
+        // Nothing stored yet, the defaults are only written once something changes
+        current = default_settings();
+        stored = current;
+    }
+
+    if (shutdownStore == nullptr) {
+        shutdownStore = this;
+        esp_register_shutdown_handler(settings_store_shutdown);
+    }
+}
+
+bool SettingsStore::migrate() {
+    // Keys of the versions that wrote every value on its own
+    if (!preferences->isKey("neo_r") && !preferences->isKey("alert_r") && !preferences->isKey("temp_threshold")) {
+        return false;
+    }
+    Settings defaults = default_settings();
+    current = defaults;
+    current.neoR = preferences->getUChar("neo_r", defaults.neoR);
+    current.neoG = preferences->getUChar("neo_g", defaults.neoG);
+    current.neoB = preferences->getUChar("neo_b", defaults.neoB);
+    copy_hex(current.neoHex, preferences->getString("neo_hex", defaults.neoHex).c_str());
+    current.alertR = preferences->getUChar("alert_r", defaults.alertR);
+    current.alertG = preferences->getUChar("alert_g", defaults.alertG);
+    current.alertB = preferences->getUChar("alert_b", defaults.alertB);
+    copy_hex(current.alertHex, preferences->getString("alert_hex", defaults.alertHex).c_str());
+    current.tempThreshold = preferences->getFloat("temp_threshold", defaults.tempThreshold);
+
+    // The old keys go once the blob is written, a failed write leaves them for the next boot
+    if (write()) {
+        static const char* const OLD_KEYS[] = {
+            "neo_r", "neo_g", "neo_b", "neo_hex", "alert_r", "alert_g", "alert_b", "alert_hex", "temp_threshold"
+        };
+        for (const char* key : OLD_KEYS) {
+            preferences->remove(key);
+        }
+        Serial.println("Settings moved to a single NVS blob");
+    }
+    return true;
+}
+
+Settings SettingsStore::get() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Settings settings = current;
+    xSemaphoreGive(mutex);
+    return settings;
+}
+
+void SettingsStore::changed() {
+    uint32_t now = millis();
+    if (!dirty) {
+        dirty = true;
+        firstChange = now;
+    }
+    lastChange = now;
+    metric_settings_changes.inc();
+}
+
+void SettingsStore::setNeoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    current.neoR = r;
+    current.neoG = g;
+    current.neoB = b;
+    copy_hex(current.neoHex, hex);
+    changed();
+    xSemaphoreGive(mutex);
+}
+
+void SettingsStore::setAlertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    current.alertR = r;
+    current.alertG = g;
+    current.alertB = b;
+    copy_hex(current.alertHex, hex);
+    changed();
+    xSemaphoreGive(mutex);
+}
+
+void SettingsStore::setTempThreshold(float threshold) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    current.tempThreshold = threshold;
+    changed();
+    xSemaphoreGive(mutex);
+}
+
+bool SettingsStore::write() {
+    Blob blob;
+    blob.version = SETTINGS_VERSION;
+    blob.size = sizeof(Settings);
+    blob.settings = current;
+    if (preferences == nullptr || preferences->putBytes(SETTINGS_KEY, &blob, sizeof(blob)) != sizeof(blob)) {
+        metric_settings_write_failures.inc();
+        return false;
+    }
+    stored = current;
+    metric_settings_writes.inc();
+    return true;
+}
+
+void SettingsStore::loop() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (dirty) {
+        uint32_t now = millis();
+        if (now - lastChange >= SETTINGS_FLUSH_QUIET_MS || now - firstChange >= SETTINGS_FLUSH_MAX_MS) {
+            if (memcmp(&current, &stored, sizeof(Settings)) == 0 || write()) {
+                dirty = false;
+            } else {
+                // Tried again after the next quiet period
+                firstChange = lastChange = now;
+            }
+        }
+    }
+    xSemaphoreGive(mutex);
+}
+
+bool SettingsStore::flush() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (dirty && (memcmp(&current, &stored, sizeof(Settings)) == 0 || write())) {
+        dirty = false;
+    }
+    bool saved = !dirty;
+    xSemaphoreGive(mutex);
+    return saved;
+}
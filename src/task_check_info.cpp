@@ -1,76 +1,41 @@
 #include "task_check_info.h"
 
-void Load_info_File()
-{
-  File file = LittleFS.open("/info.dat", "r");
-  if (!file)
-  {
-    return;
-  }
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, file);
-  if (error)
-  {
-    Serial.print(F("deserializeJson() failed: "));
-  }
-  else
-  {
-    WIFI_SSID = strdup(doc["WIFI_SSID"]);
-    WIFI_PASS = strdup(doc["WIFI_PASS"]);
-    CORE_IOT_TOKEN = strdup(doc["CORE_IOT_TOKEN"]);
-    CORE_IOT_SERVER = strdup(doc["CORE_IOT_SERVER"]);
-    CORE_IOT_PORT = strdup(doc["CORE_IOT_PORT"]);
-  }
-  file.close();
-}
-
 void Delete_info_File()
 {
-  if (LittleFS.exists("/info.dat"))
-  {
-    LittleFS.remove("/info.dat");
-  }
-  ESP.restart();
+  // The listeners of the config drop the WiFi connection, no restart needed
+  config_clear();
 }
 
 void Save_info_File(String wifi_ssid, String wifi_pass, String CORE_IOT_TOKEN, String CORE_IOT_SERVER, String CORE_IOT_PORT)
 {
   Serial.println(wifi_ssid);
-  Serial.println(wifi_pass);
 
-  DynamicJsonDocument doc(4096);
-  doc["WIFI_SSID"] = wifi_ssid;
-  doc["WIFI_PASS"] = wifi_pass;
-  doc["CORE_IOT_TOKEN"] = CORE_IOT_TOKEN;
-  doc["CORE_IOT_SERVER"] = CORE_IOT_SERVER;
-  doc["CORE_IOT_PORT"] = CORE_IOT_PORT;
+  DeviceConfig config;
+  memset(&config, 0, sizeof(config));
+  strncpy(config.wifiSsid, wifi_ssid.c_str(), sizeof(config.wifiSsid) - 1);
+  strncpy(config.wifiPassword, wifi_pass.c_str(), sizeof(config.wifiPassword) - 1);
+  strncpy(config.coreIotToken, CORE_IOT_TOKEN.c_str(), sizeof(config.coreIotToken) - 1);
+  strncpy(config.coreIotServer, CORE_IOT_SERVER.c_str(), sizeof(config.coreIotServer) - 1);
+  config.coreIotPort = CORE_IOT_PORT.toInt();
 
-  File configFile = LittleFS.open("/info.dat", "w");
-  if (configFile)
-  {
-    serializeJson(doc, configFile);
-    configFile.close();
-  }
-  else
+  // Applied right away by the listeners of the config, no restart needed
+  if (!config_set(config))
   {
     Serial.println("Unable to save the configuration.");
   }
-  ESP.restart();
 };
 
 bool check_info_File(bool check)
 {
   if (!check)
   {
-    if (!LittleFS.begin(true))
+    if (!config_begin())
     {
-      Serial.println("❌ Lỗi khởi động LittleFS!");
       return false;
     }
-    Load_info_File();
   }
   
-  if (WIFI_SSID.isEmpty() && WIFI_PASS.isEmpty())
+  if (WIFI_SSID[0] == '\0' && WIFI_PASS[0] == '\0')
   {
     if (!check)
     {
@@ -79,4 +44,4 @@ bool check_info_File(bool check)
     return false;
   }
   return true;
-}
\ No newline at end of file
+}
@@ -3,71 +3,82 @@
 LiquidCrystal_I2C lcd(LCD_ADDR, LCD_COLS, LCD_ROWS);
 
 void initLCD() {
+    boot_stage_begin(BOOT_LCD);
     Wire.begin(SDA_PIN, SCL_PIN);
     lcd.begin();
     lcd.backlight();
+    boot_stage_end(BOOT_LCD);
     Serial.println("LCD initialized");
 }
 
-void displaySensorData() {
-    static int displayMode = 0;
-    
-    lcd.clear();
-    
-    if (displayMode == 0) {
+void displaySensorLine(uint8_t mode, uint8_t row) {
+    lcd.setCursor(0, row);
+    if (mode == 0) {
         // Display Temperature and Humidity
-        lcd.setCursor(0, 0);
-        lcd.print("Temp: ");
-        lcd.print(glob_temperature, 1);
-        lcd.print("C");
-        lcd.setCursor(0, 1);
-        lcd.print("Humi: ");
-        lcd.print(glob_humidity, 1);
-        lcd.print("%");
-    } else if (displayMode == 1) {
+        if (row == 0) {
+            lcd.print("Temp: ");
+            lcd.print(glob_temperature, 1);
+            lcd.print("C");
+        } else {
+            lcd.print("Humi: ");
+            lcd.print(glob_humidity, 1);
+            lcd.print("%");
+        }
+    } else if (mode == 1) {
         // Display Light level and LED status
-        lcd.setCursor(0, 0);
-        lcd.print("Light: ");
-        lcd.print(glob_light_level);
-        lcd.setCursor(0, 1);
-        lcd.print("LED: ");
-        lcd.print(glob_led_state ? "ON " : "OFF");
+        if (row == 0) {
+            lcd.print("Light: ");
+            lcd.print(glob_light_level);
+        } else {
+            lcd.print("LED: ");
+            lcd.print(glob_led_state ? "ON " : "OFF");
+        }
     } else {
-        // Display ESP32 IP Address
-        lcd.setCursor(0, 0);
-        if (WiFi.status() == WL_CONNECTED) {
-            lcd.print("WiFi IP:");
-            lcd.setCursor(0, 1);
-            String ip = WiFi.localIP().toString();
-            if (ip.length() > 16) {
-                // If IP is too long, scroll it or show shortened version
-                lcd.print(ip.substring(0, 16));
-            } else {
-                lcd.print(ip);
-            }
+        // Display ESP32 IP Address, both lines from the state of the first
+        static bool connected = false;
+        if (row == 0) {
+            connected = WiFi.status() == WL_CONNECTED;
+            lcd.print(connected ? "WiFi IP:" : "No WiFi");
+        } else if (connected) {
+            // Printed straight from the address, a dotted quad always fits into the 16 columns
+            lcd.print(WiFi.localIP());
         } else {
-            lcd.print("No WiFi");
-            lcd.setCursor(0, 1);
             lcd.print("192.168.4.1"); // Access Point IP
         }
     }
-    
-    // Switch display mode every cycle (3 modes now)
-    displayMode = (displayMode + 1) % 3;
 }
 
-void task_lcd(void *pvParameters) {
-    initLCD();
-    
-    Serial.println("LCD display task started");
-    Serial.printf("LCD Address: 0x%02X, Size: %dx%d\n", LCD_ADDR, LCD_COLS, LCD_ROWS);
-    Serial.printf("I2C Pins - SDA: %d, SCL: %d\n", SDA_PIN, SCL_PIN);
+enum LcdJobState {
+    LCD_JOB_START,
+    LCD_JOB_LINE0,
+    LCD_JOB_LINE1
+};
+
+JobWait lcd_job(void *arg) {
+    static LcdJobState state = LCD_JOB_START;
+    static uint8_t displayMode = 0;
     
-    while (1) {
-        // Update LCD display with sensor data
-        displaySensorData();
-        
-        // Wait for 3 seconds before next update
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
+    switch (state) {
+        case LCD_JOB_START:
+            initLCD();
+            Serial.println("LCD display job started");
+            Serial.printf("LCD Address: 0x%02X, Size: %dx%d\n", LCD_ADDR, LCD_COLS, LCD_ROWS);
+            Serial.printf("I2C Pins - SDA: %d, SCL: %d\n", SDA_PIN, SCL_PIN);
+            state = LCD_JOB_LINE0;
+            return JobWait::yield();
+        case LCD_JOB_LINE0:
+            // Wire returns once a transfer is done, so a refresh is split by line instead
+            lcd.clear();
+            displaySensorLine(displayMode, 0);
+            state = LCD_JOB_LINE1;
+            return JobWait::yield();
+        case LCD_JOB_LINE1:
+        default:
+            displaySensorLine(displayMode, 1);
+            // Switch display mode every cycle (3 modes now)
+            displayMode = (displayMode + 1) % 3;
+            state = LCD_JOB_LINE0;
+            // Wait for 3 seconds before next update
+            return JobWait::delay(3000);
     }
 }
\ No newline at end of file
@@ -13,41 +13,57 @@ int readLightLevel() {
 void controlLED(bool state) {
     digitalWrite(LED_PIN, state ? HIGH : LOW);
     glob_led_state = state;
-    Serial.printf("LED %s\n", state ? "ON" : "OFF");
+    LOG(LED_STATE, state ? "ON" : "OFF");
 }
 
-void task_light_sensor(void *pvParameters) {
-    initLightSensor();
+JobWait light_sensor_job(void *arg) {
+    static bool started = false;
+    if (!started) {
+        initLightSensor();
+        
+        Serial.println("Light sensor job started");
+        Serial.printf("Light threshold: %d\n", LIGHT_THRESHOLD);
+        Serial.printf("LED GPIO: %d\n", LED_PIN);
+        Serial.printf("Light sensor GPIO: %d\n", LIGHT_SENSOR_PIN);
+        started = true;
+    }
     
-    Serial.println("Light sensor task started");
-    Serial.printf("Light threshold: %d\n", LIGHT_THRESHOLD);
-    Serial.printf("LED GPIO: %d\n", LED_PIN);
-    Serial.printf("Light sensor GPIO: %d\n", LIGHT_SENSOR_PIN);
+    // Read light level from sensor
+    uint32_t traceId = trace_begin();
+    uint64_t readStart = trace_now();
+    int lightLevel = readLightLevel();
+    trace_span(traceId, TRACE_SOURCE_LIGHT, TRACE_SENSOR_READ, readStart, trace_now());
     
-    while (1) {
-        // Read light level from sensor
-        int lightLevel = readLightLevel();
-        glob_light_level = lightLevel;
-        
-        // Check if it's dark (light level below threshold)
-        if (lightLevel < LIGHT_THRESHOLD) {
-            // Turn on LED when it's dark
-            if (!glob_led_state) {
-                controlLED(true);
-                Serial.printf("Dark detected (light: %d) - LED turned ON\n", lightLevel);
-            }
-        } else {
-            // Turn off LED when there's enough light
-            if (glob_led_state) {
-                controlLED(false);
-                Serial.printf("Light detected (light: %d) - LED turned OFF\n", lightLevel);
-            }
+    // Check if it's dark (light level below threshold)
+    if (lightLevel < LIGHT_THRESHOLD) {
+        // Turn on LED when it's dark
+        if (!glob_led_state) {
+            controlLED(true);
+            LOG(LIGHT_DARK, lightLevel);
+        }
+    } else {
+        // Turn off LED when there's enough light
+        if (glob_led_state) {
+            controlLED(false);
+            LOG(LIGHT_BRIGHT, lightLevel);
         }
-        
-        // Print current status periodically
-        Serial.printf("Light level: %d, LED: %s\n", lightLevel, glob_led_state ? "ON" : "OFF");
-        
-        // Wait for 2 seconds before next reading
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
     }
+    
+    // The LED state goes to the web server together with the level it was switched for
+    uint64_t publishStart = trace_now();
+    glob_light_level = lightLevel;
+    glob_light_read_ms = millis();
+    SensorSample sample = { SENSOR_SAMPLE_LIGHT, glob_led_state, (float)lightLevel, 0, glob_light_read_ms };
+    sensor_channel_publish(sample);
+    trace_publish(TRACE_SOURCE_LIGHT, traceId, readStart, publishStart);
+    boot_mark(BOOT_FIRST_LIGHT);
+    history_record(HISTORY_LIGHT, lightLevel);
+    report_policy_reading(HISTORY_LIGHT, lightLevel, glob_light_read_ms);
+    metric_light_level.set(lightLevel);
+    
+    // Print current status periodically
+    LOG(LIGHT_LEVEL, lightLevel, glob_led_state ? "ON" : "OFF");
+    
+    // Wait before next reading
+    return JobWait::delay(LIGHT_READ_INTERVAL_MS);
 }
\ No newline at end of file
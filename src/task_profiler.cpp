@@ -0,0 +1,177 @@
+#include "task_profiler.h"
+#include "memory_budget.h"
+
+static TaskProfiler taskProfiler;
+static FreeRTOSTaskStats taskStats;
+static SemaphoreHandle_t profilerMutex = memory_create_mutex();
+
+FreeRTOSTaskStats::FreeRTOSTaskStats() : status(nullptr) {
+}
+
+size_t FreeRTOSTaskStats::read(TaskStatsSample* samples, size_t max, uint32_t& totalRuntime) {
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    const UBaseType_t capacity = PROFILER_MAX_TASKS + PROFILER_STATUS_SLACK;
+    MEMORY_FITS(PROFILER, capacity * sizeof(TaskStatus_t));
+    if (status == nullptr) {
+        status = (TaskStatus_t*)memory_claim(MEMORY_PROFILER, capacity * sizeof(TaskStatus_t));
+        if (status == nullptr) {
+            return 0;
+        }
+    }
+    uint32_t total = 0;
+    UBaseType_t found = uxTaskGetSystemState(status, capacity, &total);
+    size_t count = found < max ? found : max;
+    for (size_t i = 0; i < count; i++) {
+        samples[i].handle = status[i].xHandle;
+        strlcpy(samples[i].name, status[i].pcTaskName, sizeof(samples[i].name));
+        samples[i].priority = status[i].uxCurrentPriority;
+#if configTASKLIST_INCLUDE_COREID
+        samples[i].core = status[i].xCoreID < portNUM_PROCESSORS ? status[i].xCoreID : -1;
+#else
+        samples[i].core = -1;
+#endif
+        samples[i].runtime = status[i].ulRunTimeCounter;
+        samples[i].stackFree = status[i].usStackHighWaterMark;
+    }
+    totalRuntime = total;
+    return count;
+#else
+    totalRuntime = 0;
+    return 0;
+#endif
+}
+
+TaskProfiler::TaskProfiler(uint8_t cores)
+    : cores(cores ? cores : 1), count(0), trackedCount(0), sampled(false), lastTotal(0), lastInterval(0) {
+}
+
+bool TaskProfiler::track(const void* handle, uint32_t stackSize, const MetricHistogram* loop) {
+    if (handle == nullptr || trackedCount >= PROFILER_MAX_TRACKED) {
+        return false;
+    }
+    tracked[trackedCount++] = { handle, stackSize, loop };
+    return true;
+}
+
+void TaskProfiler::sample(TaskStatsSource& source) {
+    TaskStatsSample samples[PROFILER_MAX_TASKS];
+    uint32_t total = 0;
+    size_t found = source.read(samples, PROFILER_MAX_TASKS, total);
+    if (found == 0) {
+        return;
+    }
+    // Counters are unsigned, so the differences stay right when they wrap
+    uint32_t elapsed = sampled ? total - lastTotal : 0;
+
+    // Merge in place: profiles of tasks that still exist are moved to the front in the order
+    // of the new sample, tasks that were deleted drop out
+    size_t previousCount = count;
+    memcpy(previous, profiles, previousCount * sizeof(TaskProfile));
+
+    count = 0;
+    for (size_t i = 0; i < found; i++) {
+        const TaskStatsSample& current = samples[i];
+        TaskProfile& profile = profiles[count++];
+
+        const TaskProfile* before = nullptr;
+        for (size_t j = 0; j < previousCount; j++) {
+            if (previous[j].handle == current.handle) {
+                before = &previous[j];
+                break;
+            }
+        }
+
+        profile.handle = current.handle;
+        memcpy(profile.name, current.name, sizeof(profile.name));
+        profile.name[sizeof(profile.name) - 1] = '\0';
+        profile.priority = current.priority;
+        profile.core = current.core;
+        profile.stackFree = current.stackFree;
+        profile.lastRuntime = current.runtime;
+        if (before) {
+            uint32_t delta = current.runtime - before->lastRuntime;
+            profile.runtime = before->runtime + delta;
+            profile.stackMinFree = min(before->stackMinFree, current.stackFree);
+            profile.cpu = elapsed ? 100.0f * delta / ((float)elapsed * cores) : 0;
+        } else {
+            // Started during the interval, its share is only known from the next sample on
+            profile.runtime = current.runtime;
+            profile.stackMinFree = current.stackFree;
+            profile.cpu = 0;
+        }
+
+        profile.stackSize = 0;
+        profile.loop = nullptr;
+        for (size_t j = 0; j < trackedCount; j++) {
+            if (tracked[j].handle == current.handle) {
+                profile.stackSize = tracked[j].stackSize;
+                profile.loop = tracked[j].loop;
+                break;
+            }
+        }
+    }
+
+    lastTotal = total;
+    lastInterval = elapsed;
+    sampled = true;
+}
+
+void profiler_track_task(TaskHandle_t handle, uint32_t stackSize, const MetricHistogram* loop) {
+    xSemaphoreTake(profilerMutex, portMAX_DELAY);
+    taskProfiler.track(handle, stackSize, loop);
+    xSemaphoreGive(profilerMutex);
+}
+
+void profiler_sample() {
+    xSemaphoreTake(profilerMutex, portMAX_DELAY);
+    taskProfiler.sample(taskStats);
+    xSemaphoreGive(profilerMutex);
+}
+
+TaskProfileJsonWriter::TaskProfileJsonWriter() {
+    snapshot();
+}
+
+void TaskProfileJsonWriter::snapshot() {
+    xSemaphoreTake(profilerMutex, portMAX_DELAY);
+    count = taskProfiler.size();
+    for (size_t i = 0; i < count; i++) {
+        profiles[i] = taskProfiler.task(i);
+    }
+    interval = taskProfiler.interval();
+    xSemaphoreGive(profilerMutex);
+}
+
+bool TaskProfileJsonWriter::write(Print& out, size_t item) {
+    if (item == 0) {
+        out.printf("{\"type\":\"tasks\",\"uptime\":%lu,\"interval_us\":%lu,\"cores\":%d,\"loop_buckets\":[",
+                   (unsigned long)(millis() / 1000), (unsigned long)interval, portNUM_PROCESSORS);
+        for (int bucket = 0; bucket <= METRICS_HISTOGRAM_BUCKETS; bucket++) {
+            out.printf("%s\"%s\"", bucket ? "," : "", MetricHistogram::bound(bucket));
+        }
+        out.print("],\"tasks\":[");
+        return true;
+    }
+    if (item > count) {
+        out.print("]}");
+        return false;
+    }
+
+    const TaskProfile& profile = profiles[item - 1];
+    out.printf("%s{\"name\":\"%s\",\"priority\":%u,\"core\":%d,\"cpu\":%.2f,\"runtime_ms\":%llu,"
+               "\"stack_size\":%lu,\"stack_free\":%lu,\"stack_min_free\":%lu",
+               item > 1 ? "," : "", profile.name, profile.priority, profile.core, profile.cpu,
+               (unsigned long long)(profile.runtime / 1000), (unsigned long)profile.stackSize,
+               (unsigned long)profile.stackFree, (unsigned long)profile.stackMinFree);
+    if (profile.loop) {
+        uint32_t counts[METRICS_HISTOGRAM_BUCKETS + 1];
+        uint64_t yields = profile.loop->snapshot(counts);
+        out.printf(",\"yields\":%llu,\"loop\":[", (unsigned long long)yields);
+        for (int bucket = 0; bucket <= METRICS_HISTOGRAM_BUCKETS; bucket++) {
+            out.printf("%s%lu", bucket ? "," : "", (unsigned long)counts[bucket]);
+        }
+        out.print("]");
+    }
+    out.print("}");
+    return true;
+}
@@ -3,41 +3,70 @@
 #define DHTTYPE DHT11
 DHT dht(DHTPIN, DHTTYPE);
 
-void temp_humi_monitor(void *pvParameters){
+enum DhtJobState {
+    DHT_JOB_START,
+    DHT_JOB_READ
+};
 
-    Serial.begin(115200);
-    dht.begin();
+static DhtJobState dhtJobState = DHT_JOB_START;
 
-    while (1){
-        /* code */
-        // Reading temperature in Celsius
-        float temperature = dht.readTemperature();
-        // Reading humidity
-        float humidity = dht.readHumidity();
+JobWait temp_humi_job(void *arg){
 
-        
-
-        // Check if any reads failed and exit early
-        if (isnan(temperature) || isnan(humidity)) {
-            Serial.println("Failed to read from DHT sensor!");
-            temperature = humidity = -1;
+    if (dhtJobState == DHT_JOB_START) {
+        boot_stage_begin(BOOT_DHT_WARMUP);
+        dht.begin();
+        dhtJobState = DHT_JOB_READ;
+        // Reads before the sensor is ready fail and the next try would be a whole interval later
+        uint32_t uptime = millis();
+        if (uptime < DHT_WARMUP_MS) {
+            return JobWait::delay(DHT_WARMUP_MS - uptime);
         }
+    }
+    boot_stage_end(BOOT_DHT_WARMUP);
+    boot_stage_begin(BOOT_FIRST_DHT);
+
+    uint32_t traceId = trace_begin();
+    uint64_t readStart = trace_now();
+    // Reading temperature in Celsius
+    float temperature = dht.readTemperature();
+    // Reading humidity
+    float humidity = dht.readHumidity();
+    trace_span(traceId, TRACE_SOURCE_DHT, TRACE_SENSOR_READ, readStart, trace_now());
+    uint32_t readMs = millis();
+
+
+    metric_dht_reads.inc();
 
-        //Update global variables for temperature and humidity
-        glob_temperature = temperature;
-        glob_humidity = humidity;
-
-        // Print the results
-        
-        Serial.print("Humidity: ");
-        Serial.print(humidity);
-        Serial.print("%  Temperature: ");
-        Serial.print(temperature);
-        Serial.print("°C  Light: ");
-        Serial.print(glob_light_level);
-        Serial.print("  LED: ");
-        Serial.println(glob_led_state ? "ON" : "OFF");
-        vTaskDelay(5000);
+    // Check if any reads failed and exit early
+    bool valid = !isnan(temperature) && !isnan(humidity);
+    if (!valid) {
+        metric_dht_read_failures.inc();
+        LOG(DHT_READ_FAILED);
+        temperature = humidity = -1;
+    } else {
+        // Keep failed readings out of the trend
+        history_record(HISTORY_TEMPERATURE, temperature);
+        history_record(HISTORY_HUMIDITY, humidity);
+        report_policy_reading(HISTORY_TEMPERATURE, temperature, readMs);
+        report_policy_reading(HISTORY_HUMIDITY, humidity, readMs);
+        metric_temperature.set(temperature);
+        metric_humidity.set(humidity);
     }
-    
-}
\ No newline at end of file
+
+    //Update global variables for temperature and humidity, the web server gets them through the channel
+    uint64_t publishStart = trace_now();
+    glob_temperature = temperature;
+    glob_humidity = humidity;
+    glob_dht_read_ms = readMs;
+    SensorSample sample = { SENSOR_SAMPLE_DHT, false, temperature, humidity, readMs };
+    sensor_channel_publish(sample);
+    trace_publish(TRACE_SOURCE_DHT, traceId, readStart, publishStart);
+    if (valid) {
+        boot_stage_end(BOOT_FIRST_DHT);
+    }
+
+    // Print the results
+
+    LOG(DHT_READING, humidity, temperature, glob_light_level, glob_led_state ? "ON" : "OFF");
+    return JobWait::delay(boot_stage_done(BOOT_FIRST_DHT) ? DHT_READ_INTERVAL_MS : min(DHT_BOOT_RETRY_MS, DHT_READ_INTERVAL_MS));
+}
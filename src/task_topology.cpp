@@ -0,0 +1,20 @@
+#include "task_topology.h"
+#include "task_profiler.h"
+
+BaseType_t topology_core(TaskRole role) {
+#if portNUM_PROCESSORS > 1
+    return role == TASK_ROLE_ACQUISITION ? TOPOLOGY_ACQUISITION_CORE : TOPOLOGY_NETWORK_CORE;
+#else
+    (void)role;
+    return 0;
+#endif
+}
+
+TaskHandle_t topology_create_task(TaskFunction_t function, const char* name, MemoryRegionId stack, void* arg,
+                                  UBaseType_t priority, TaskRole role, const MetricHistogram* loop) {
+    TaskHandle_t handle = memory_create_task(function, name, stack, arg, priority, topology_core(role));
+    if (handle) {
+        profiler_track_task(handle, memory_region_bytes(stack), loop);
+    }
+    return handle;
+}
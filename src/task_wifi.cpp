@@ -10,28 +10,27 @@ void startAP()
 
 void startSTA()
 {
-    if (WIFI_SSID.isEmpty())
+    if (WIFI_SSID[0] == '\0')
     {
         vTaskDelete(NULL);
     }
 
     WiFi.mode(WIFI_STA);
 
-    if (WIFI_PASS.isEmpty())
+    if (WIFI_PASS[0] == '\0')
     {
-        WiFi.begin(WIFI_SSID.c_str());
+        WiFi.begin(WIFI_SSID);
     }
     else
     {
-        WiFi.begin(WIFI_SSID.c_str(), WIFI_PASS.c_str());
+        WiFi.begin(WIFI_SSID, WIFI_PASS);
     }
 
     while (WiFi.status() != WL_CONNECTED)
     {
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
-    //Give a semaphore here
-    xSemaphoreGive(xBinarySemaphoreInternet);
+    isWifiConnected = true;
 }
 
 bool Wifi_reconnect()
@@ -1,4 +1,10 @@
 #include "webserver_wifi_config.h"
+#include <MD5Builder.h>
+#include "response_stream.h"
+#include "memory_budget.h"
+#include "json_arena.h"
+#include "heap_monitor.h"
+#include <new>
 
 WiFiConfigServer* wifiConfig = nullptr;
 
@@ -10,7 +16,8 @@ AsyncWebSocket wifiConfigWS("/ws");
 void webserver_wifi_config_task(void *parameter)
 {
   // Initialize WiFi config
-  wifiConfig = new WiFiConfigServer(&wifiConfigServer, &wifiConfigWS);
+  MEMORY_FITS(WEB_SERVER, sizeof(WiFiConfigServer));
+  wifiConfig = new (memory_claim(MEMORY_WEB_SERVER, sizeof(WiFiConfigServer))) WiFiConfigServer(&wifiConfigServer, &wifiConfigWS);
   wifiConfig->begin();
   
   Serial.println("WiFi Configuration Server started on port 8080");
@@ -19,38 +26,70 @@ void webserver_wifi_config_task(void *parameter)
   while (true)
   {
     wifiConfig->loop();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    vTaskDelay(WEB_SERVER_LOOP_MS / portTICK_PERIOD_MS);
   }
 }
 
+static void ws_command_task(void *parameter)
+{
+  ((WiFiConfigServer*)parameter)->runCommands();
+}
+
+static void wifi_config_changed(uint8_t changed, const DeviceConfig& config, void *arg)
+{
+  ((WiFiConfigServer*)arg)->applyWiFiConfig(config);
+}
+
 WiFiConfigServer::WiFiConfigServer(AsyncWebServer* webServer, AsyncWebSocket* webSocket) 
-    : server(webServer), ws(webSocket), isConfigMode(false), ledState(false), neoState(true),
-      savedNeoR(0), savedNeoG(255), savedNeoB(0), savedNeoHex("#00ff00"),
-      alertNeoR(255), alertNeoG(0), alertNeoB(0), alertNeoHex("#ff0000"), tempThreshold(30.0),
-      isBlinking(false), lastBlinkTime(0), blinkState(false) {
+    : server(webServer), ws(webSocket), fanout(new (memory_claim(MEMORY_WS_FANOUT, sizeof(WsFanout))) WsFanout(webSocket)), isConfigMode(false), ledState(false), neoState(true),
+      isBlinking(false), connectPending(false), connectStart(0),
+      connectCached(false), connectAtBoot(false) {
+    MEMORY_FITS(WS_FANOUT, sizeof(WsFanout));
+    largeMessageMutex = memory_create_mutex();
+    largeMessage = (char*)memory_claim(MEMORY_WS_MESSAGES, WS_MESSAGE_LARGE);
+    memset(&stationLogin, 0, sizeof(stationLogin));
+    memset(&sensors, 0, sizeof(sensors));
+    
     // Initialize LED pins
     pinMode(LED_GPIO, OUTPUT);
     digitalWrite(LED_GPIO, LOW);
     
-    // Initialize NeoPixel - start with normal color (green)
-    neoPixel = new Adafruit_NeoPixel(LED_COUNT, NEO_PIN, NEO_GRB + NEO_KHZ800);
-    neoPixel->begin();
-    neoPixel->setPixelColor(0, neoPixel->Color(savedNeoR, savedNeoG, savedNeoB)); // Start with saved color
-    neoPixel->show();
+    // NeoPixel - start with normal color (green, the default until begin() loads the settings)
+    Settings neo = settings.get();
+    neo_effect_show(neo.neoR, neo.neoG, neo.neoB);
 }
 
 void WiFiConfigServer::begin() {
+    boot_stage_begin(BOOT_WEB_SERVER);
     preferences.begin("wifi-config", false);
-    
-    if (!LittleFS.begin()) {
-        Serial.println("LittleFS Mount Failed");
-        return;
-    }
+    settings.begin(&preferences);
     
     // Load saved NeoPixel color and alert settings
     loadSavedNeoColor();
     loadAlertSettings();
     
+    // Look up the web pages once, the filesystem only changes with a new image (and a reboot).
+    // LittleFS was mounted with the config in setup().
+    loadStaticAsset(dashboardAsset, "/dashboard.html");
+    loadStaticAsset(wifiConfigAsset, "/wifi_config.html");
+    
+    // The saved login is joined by the command task like one from a dashboard. The loop sends
+    // sensor values in the meantime instead of waiting here for the association.
+    WiFiCredentials creds = loadWiFiCredentials();
+    if (creds.ssid.length() > 0) {
+        WsWiFiLogin login;
+        memset(&login, 0, sizeof(login));
+        strncpy(login.ssid, creds.ssid.c_str(), WS_COMMAND_MAX_SSID);
+        strncpy(login.password, creds.password.c_str(), WS_COMMAND_MAX_PASSWORD);
+        boot_stage_begin(BOOT_WIFI);
+        connectAtBoot = true;
+        startConnect(login);
+    }
+    
+    // Actions from the dashboards run here instead of on the network task
+    topology_create_task(ws_command_task, "WS Commands", MEMORY_STACK_WS_COMMANDS, this, 3, TASK_ROLE_NETWORK,
+                         &metric_loop_ws_commands);
+    
     ws->onEvent([this](AsyncWebSocket *server, AsyncWebSocketClient *client, 
                        AwsEventType type, void *arg, uint8_t *data, size_t len) {
         this->onWsEvent(server, client, type, arg, data, len);
@@ -59,22 +98,22 @@ void WiFiConfigServer::begin() {
     server->addHandler(ws);
     setupConfigRoutes();
     
+    // A new WiFi login is joined right away instead of after a restart
+    config_listen(CONFIG_WIFI, wifi_config_changed, this);
+    
     // Start the web server
     server->begin();
     Serial.println("WiFi Config Web Server started");
+    boot_stage_end(BOOT_WEB_SERVER);
     
-    WiFiCredentials creds = loadWiFiCredentials();
-    if (creds.ssid.length() > 0) {
-        if (!connectToWiFi(creds.ssid, creds.password)) {
-            Serial.println("Failed to connect with saved credentials, starting config mode");
-            startConfigMode();
-        }
-    } else {
+    if (creds.ssid.length() == 0) {
         startConfigMode();
     }
 }
 
 void WiFiConfigServer::loop() {
+    uint32_t loopStart = micros();
+    
     if (isConfigMode) {
         if (WiFi.softAPgetStationNum() == 0) {
             static unsigned long lastCheck = 0;
@@ -87,26 +126,50 @@ void WiFiConfigServer::loop() {
     
     static unsigned long lastStatusUpdate = 0;
     static unsigned long lastSensorUpdate = 0;
+    static unsigned long lastProfileUpdate = 0;
     
-    if (millis() - lastStatusUpdate > 5000) {
+    if (millis() - lastStatusUpdate > WIFI_STATUS_INTERVAL_MS) {
         sendWiFiStatus();
         lastStatusUpdate = millis();
     }
     
-    // Send sensor data including light sensor every 3 seconds
-    if (millis() - lastSensorUpdate > 3000) {
+    // Send sensor data including light sensor every SENSOR_BROADCAST_INTERVAL_MS, the first
+    // valid DHT reading right away. The readings are taken over after the check, the first
+    // valid one is in the channel before its boot stage ends.
+    bool dhtReady = boot_stage_done(BOOT_FIRST_DHT);
+    sensor_channel_drain(sensors);
+    if ((dhtReady && !boot_stage_done(BOOT_FIRST_PUBLISH)) || millis() - lastSensorUpdate > SENSOR_BROADCAST_INTERVAL_MS) {
         sendSensorData();
+        if (dhtReady) {
+            boot_mark(BOOT_FIRST_PUBLISH);
+        }
         
         // Update NeoPixel based on temperature
-        if (!isnan(glob_temperature)) {
-            setNeoColorForTemperature(glob_temperature);
+        if (!isnan(sensors.temperature)) {
+            setNeoColorForTemperature(sensors.temperature);
         }
         
         lastSensorUpdate = millis();
     }
     
-    // Handle NeoPixel blinking for alerts
-    handleNeoBlinking();
+    // Sample the task profiler even without clients, so the lowest stack high water marks are tracked
+    if (millis() - lastProfileUpdate > PROFILER_INTERVAL_MS) {
+        profiler_sample();
+        sendTaskProfile(nullptr);
+        lastProfileUpdate = millis();
+    }
+    
+    // Feed the clients that could not take all frames when they were sent
+    fanout->pump();
+    // Traced sensor values count as sent once no client has anything queued
+    trace_poll_sent(fanout->drained());
+    
+    // Saved settings go to flash once they stopped changing
+    settings.loop();
+    
+    heap_monitor_poll();
+    
+    metric_loop_webserver.observe(micros() - loopStart);
 }
 
 void WiFiConfigServer::startConfigMode(const char* apSSID, const char* apPassword) {
@@ -135,25 +198,47 @@ void WiFiConfigServer::stopConfigMode() {
 }
 
 bool WiFiConfigServer::saveWiFiCredentials(const String& ssid, const String& password) {
-    preferences.putString("ssid", ssid);
-    preferences.putString("password", password);
-    // Save_info_File(ssid, password, CORE_IOT_TOKEN.isEmpty() ? "" : CORE_IOT_TOKEN, 
-    //                CORE_IOT_SERVER.isEmpty() ? "" : CORE_IOT_SERVER, 
-    //                CORE_IOT_PORT.isEmpty() ? "" : CORE_IOT_PORT);
-
+    if (!config_set_wifi(ssid.c_str(), password.c_str())) {
+        Serial.println("Unable to save the WiFi credentials");
+        return false;
+    }
     Serial.printf("WiFi credentials saved: %s\n", ssid.c_str());
     return true;
 }
 
 WiFiCredentials WiFiConfigServer::loadWiFiCredentials() {
+    DeviceConfig config;
+    config_get(config);
     WiFiCredentials creds;
-    creds.ssid = preferences.getString("ssid", "");
-    creds.password = preferences.getString("password", "");
-    // creds.ssid = WIFI_SSID;
-    // creds.password = WIFI_PASS;
+    creds.ssid = config.wifiSsid;
+    creds.password = config.wifiPassword;
     return creds;
 }
 
+void WiFiConfigServer::applyWiFiConfig(const DeviceConfig& config) {
+    // Saved after a connect with this login succeeded, or a connect with it is running
+    if (strcmp(config.wifiSsid, stationLogin.ssid) == 0 && strcmp(config.wifiPassword, stationLogin.password) == 0) {
+        return;
+    }
+    if (config.wifiSsid[0] == '\0') {
+        disconnectWiFi();
+        if (!isConfigMode) {
+            startConfigMode();
+        }
+        sendWiFiStatus();
+        return;
+    }
+    // Joined by the command task like a login from a dashboard, which also gets the result
+    WsCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = WS_CMD_CONNECT;
+    WsWiFiLogin login;
+    memset(&login, 0, sizeof(login));
+    strncpy(login.ssid, config.wifiSsid, WS_COMMAND_MAX_SSID);
+    strncpy(login.password, config.wifiPassword, WS_COMMAND_MAX_PASSWORD);
+    queueCommand(command, &login);
+}
+
 
 std::vector<WiFiNetwork> WiFiConfigServer::scanWiFiNetworks() {
     std::vector<WiFiNetwork> networks;
@@ -190,11 +275,7 @@ std::vector<WiFiNetwork> WiFiConfigServer::scanWiFiNetworks() {
 }
 
 bool WiFiConfigServer::connectToWiFi(const String& ssid, const String& password, unsigned long timeout) {
-    Serial.printf("Connecting to WiFi: %s\n", ssid.c_str());
-    
-    // Keep AP+STA mode to allow configuration access
-    WiFi.mode(WIFI_AP_STA);
-    WiFi.begin(ssid.c_str(), password.c_str());
+    beginConnect(ssid, password, false);
     
     unsigned long startTime = millis();
     while (WiFi.status() != WL_CONNECTED && millis() - startTime < timeout) {
@@ -202,6 +283,38 @@ bool WiFiConfigServer::connectToWiFi(const String& ssid, const String& password,
         Serial.print(".");
     }
     
+    return finishConnect();
+}
+
+void WiFiConfigServer::beginConnect(const String& ssid, const String& password, bool useCache) {
+    Serial.printf("Connecting to WiFi: %s\n", ssid.c_str());
+    memset(&stationLogin, 0, sizeof(stationLogin));
+    strncpy(stationLogin.ssid, ssid.c_str(), WS_COMMAND_MAX_SSID);
+    strncpy(stationLogin.password, password.c_str(), WS_COMMAND_MAX_PASSWORD);
+    
+    DeviceConfig config;
+    config_get(config);
+    connectCached = useCache && config.wifiChannel != 0 && ssid == config.wifiSsid && password == config.wifiPassword;
+    
+    // Keep AP+STA mode to allow configuration access
+    WiFi.mode(WIFI_AP_STA);
+    if (connectCached) {
+        // Straight to the access point of the last connect, without scanning every channel
+        WiFi.begin(ssid.c_str(), password.c_str(), config.wifiChannel, config.wifiBssid);
+    } else {
+        WiFi.begin(ssid.c_str(), password.c_str());
+    }
+}
+
+void WiFiConfigServer::startConnect(const WsWiFiLogin& login) {
+    // Answered by pollConnect(), a newer connect takes over a pending one
+    beginConnect(login.ssid, login.password);
+    connectLogin = login;
+    connectStart = millis();
+    connectPending = true;
+}
+
+bool WiFiConfigServer::finishConnect() {
     if (WiFi.status() == WL_CONNECTED) {
         Serial.printf("\nConnected! IP: %s\n", WiFi.localIP().toString().c_str());
         Serial.printf("WiFi Config still accessible at: http://192.168.4.1:8080\n");
@@ -216,6 +329,7 @@ bool WiFiConfigServer::connectToWiFi(const String& ssid, const String& password,
 
 void WiFiConfigServer::disconnectWiFi() {
     WiFi.disconnect();
+    memset(&stationLogin, 0, sizeof(stationLogin));
     Serial.println("WiFi disconnected");
 }
 
@@ -223,12 +337,14 @@ bool WiFiConfigServer::isConnected() {
     return WiFi.status() == WL_CONNECTED;
 }
 
-String WiFiConfigServer::getConnectedSSID() {
-    return WiFi.SSID();
+const char* WiFiConfigServer::getConnectedSSID() {
+    // Every station connect goes through beginConnect(), no String from the WiFi library needed
+    return isConnected() ? stationLogin.ssid : "";
 }
 
-String WiFiConfigServer::getLocalIP() {
-    return WiFi.localIP().toString();
+void WiFiConfigServer::getLocalIP(char* ip, size_t size) {
+    IPAddress address = WiFi.localIP();
+    snprintf(ip, size, "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
 }
 
 int WiFiConfigServer::getRSSI() {
@@ -239,281 +355,533 @@ void WiFiConfigServer::onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *c
                                 AwsEventType type, void *arg, uint8_t *data, size_t len) {
     if (type == WS_EVT_CONNECT) {
         Serial.printf("WebSocket client #%u connected\n", client->id());
-        sendWiFiStatus();
-        sendWiFiList();
-        sendSensorData();
-        sendLEDStatus();
-        sendLightSensorData();
-        
-        // Send alert settings
-        DynamicJsonDocument doc(512);
-        doc["type"] = "alert_settings";
-        doc["alert_r"] = alertNeoR;
-        doc["alert_g"] = alertNeoG;
-        doc["alert_b"] = alertNeoB;
-        doc["alert_hex"] = alertNeoHex;
-        doc["temp_threshold"] = tempThreshold;
-        doc["current_temp"] = glob_temperature;
-        doc["temp_alert"] = glob_temp_alert;
-        
-        String message;
-        serializeJson(doc, message);
-        ws->textAll(message);
+        fanout->addClient(client->id());
+        // The current state goes to the new client only, the others already have it. The WiFi
+        // scan takes seconds, so it is built by the command task like any other request.
+        static const WsCommandType INITIAL_STATE[] = {
+            WS_CMD_GET_STATUS, WS_CMD_SCAN, WS_CMD_GET_SENSORS, WS_CMD_GET_LEDS, WS_CMD_GET_LIGHT, WS_CMD_GET_ALERT_SETTINGS
+        };
+        for (WsCommandType request : INITIAL_STATE) {
+            WsCommand command;
+            command.type = request;
+            command.client = client->id();
+            queueCommand(command);
+        }
     } else if (type == WS_EVT_DISCONNECT) {
         Serial.printf("WebSocket client #%u disconnected\n", client->id());
+        fanout->removeClient(client->id());
+        assembler.drop(client->id());
     } else if (type == WS_EVT_DATA) {
-        handleWebSocketMessage(arg, data, len);
+        handleWebSocketMessage(client, arg, data, len);
     }
 }
 
-void WiFiConfigServer::handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
+void WiFiConfigServer::handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *data, size_t len) {
     AwsFrameInfo *info = (AwsFrameInfo*)arg;
     
-    if (info->opcode == WS_TEXT) {
-        String message;
-        message += String((char*)data).substring(0, len);
-        
-        DynamicJsonDocument doc(1024);
-        DeserializationError error = deserializeJson(doc, message);
-        
-        if (error) {
-            Serial.println("JSON parsing failed");
+    if (info->message_opcode == WS_TEXT) {
+        size_t messageLen;
+        char* message = assembler.add(client->id(), info, data, len, messageLen);
+        if (message == nullptr) {
             return;
         }
-        
-        String action = doc["action"];
-        
-        if (action == "scan") {
-            sendWiFiList();
-        } else if (action == "connect") {
-            String ssid = doc["ssid"];
-            String password = doc["password"];
-            
-            if (connectToWiFi(ssid, password)) {
-                saveWiFiCredentials(ssid, password);
-                DynamicJsonDocument response(256);
-                response["type"] = "connect_result";
-                response["success"] = true;
-                response["message"] = "Connected successfully";
-                
-                String responseStr;
-                serializeJson(response, responseStr);
-                ws->textAll(responseStr);
-            } else {
-                DynamicJsonDocument response(256);
-                response["type"] = "connect_result";
-                response["success"] = false;
-                response["message"] = "Connection failed";
-                
-                String responseStr;
-                serializeJson(response, responseStr);
-                ws->textAll(responseStr);
-            }
-        } else if (action == "disconnect") {
+        metric_ws_messages_received.inc();
+        WsCommand command;
+        WsWiFiLogin login;
+        if (!ws_command_parse(message, messageLen, client->id(), command, login)) {
+            Serial.println("Invalid WebSocket command");
+            return;
+        }
+        queueCommand(command, &login);
+    }
+}
+
+void WiFiConfigServer::queueCommand(const WsCommand& command, const WsWiFiLogin* login) {
+    if (!commands.push(command, login)) {
+        metric_ws_commands_dropped.inc();
+    }
+}
+
+void WiFiConfigServer::runCommands() {
+    WsCommand command;
+    WsWiFiLogin login;
+    while (true) {
+        // A connect is polled in between, it would hold up the queue for the whole timeout
+        TickType_t wait = connectPending ? WIFI_CONNECT_POLL_MS / portTICK_PERIOD_MS : portMAX_DELAY;
+        if (commands.pop(command, login, wait)) {
+            uint32_t start = micros();
+            runCommand(command, login);
+            metric_loop_ws_commands.observe(micros() - start);
+        }
+        pollConnect();
+    }
+}
+
+void WiFiConfigServer::pollConnect() {
+    if (!connectPending) {
+        return;
+    }
+    wl_status_t status = WiFi.status();
+    if (status != WL_CONNECTED) {
+        // The saved access point may be on another channel by now or replaced, then it is
+        // looked for with a scan. Without the cache the whole timeout is waited for.
+        bool missing = status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED;
+        if (connectCached && (missing || millis() - connectStart >= WIFI_CACHED_CONNECT_TIMEOUT_MS)) {
+            Serial.println("Saved access point not found, scanning");
+            beginConnect(connectLogin.ssid, connectLogin.password, false);
+            connectStart = millis();
+            return;
+        }
+        if (millis() - connectStart < WIFI_CONNECT_TIMEOUT_MS) {
+            return;
+        }
+    }
+    connectPending = false;
+    bool connected = finishConnect();
+    if (connected) {
+        saveWiFiCredentials(connectLogin.ssid, connectLogin.password);
+        // Where to go directly next time
+        uint8_t* bssid = WiFi.BSSID();
+        if (bssid) {
+            config_set_wifi_cache(WiFi.channel(), bssid);
+        }
+        boot_stage_end(BOOT_WIFI);
+    } else if (connectAtBoot && !isConfigMode) {
+        Serial.println("Failed to connect with saved credentials, starting config mode");
+        startConfigMode();
+    }
+    connectAtBoot = false;
+    JsonArenaDocument response(256);
+    response["type"] = "connect_result";
+    response["success"] = connected;
+    response["message"] = connected ? "Connected successfully" : "Connection failed";
+    
+    sendJson(nullptr, response, WS_FRAME_CONTROL);
+}
+
+void WiFiConfigServer::runCommand(const WsCommand& command, const WsWiFiLogin& login) {
+    AsyncWebSocketClient *client = nullptr;
+    if (ws_command_is_request(command.type)) {
+        // Requested data only goes to the client that asked, nothing to do if it is gone
+        client = ws->client(command.client);
+        if (client == nullptr) {
+            return;
+        }
+    }
+    
+    switch (command.type) {
+        case WS_CMD_SCAN:
+            sendWiFiList(client);
+            break;
+        case WS_CMD_GET_STATUS:
+            sendWiFiStatus(client);
+            break;
+        case WS_CMD_GET_SENSORS:
+            sendSensorData(client);
+            break;
+        case WS_CMD_GET_LEDS:
+            sendLEDStatus(client);
+            break;
+        case WS_CMD_GET_LIGHT:
+            sendLightSensorData(client);
+            break;
+        case WS_CMD_GET_ALERT_SETTINGS:
+            sendAlertSettings(client);
+            break;
+        case WS_CMD_GET_HISTORY:
+            sendHistory(client, command.history.metric, command.history.from, command.history.to, command.history.points);
+            break;
+        case WS_CMD_GET_TASKS:
+            sendTaskProfile(client);
+            break;
+        case WS_CMD_GET_REPORT_POLICY:
+            sendReportPolicy(client);
+            break;
+        case WS_CMD_CONNECT:
+            // Takes over the connect at boot, its failure no longer starts config mode
+            connectAtBoot = false;
+            startConnect(login);
+            break;
+        case WS_CMD_DISCONNECT:
             disconnectWiFi();
             sendWiFiStatus();
-        } else if (action == "get_status") {
-            sendWiFiStatus();
-        } else if (action == "get_sensors") {
-            sendSensorData();
-        } else if (action == "get_leds") {
-            sendLEDStatus();
-        } else if (action == "control_led") {
-            bool state = doc["state"];
-            setLEDState(state);
+            break;
+        case WS_CMD_CONTROL_LED:
+            setLEDState(command.state);
             sendLEDStatus();
-        // Manual NeoPixel control functions restored for normal operation
-        } else if (action == "control_neo") {
-            bool state = doc["state"];
-            setNeoState(state);
+            break;
+        case WS_CMD_CONTROL_NEO:
+            setNeoState(command.state);
             sendLEDStatus();
-        } else if (action == "preview_neo_color") {
-            uint8_t r = doc["r"];
-            uint8_t g = doc["g"];
-            uint8_t b = doc["b"];
-            setNeoColor(r, g, b);
+            break;
+        case WS_CMD_PREVIEW_NEO_COLOR: {
+            setNeoColor(command.color.r, command.color.g, command.color.b);
             
             // Send confirmation response for preview
-            DynamicJsonDocument response(256);
+            JsonArenaDocument response(256);
             response["type"] = "neo_color_result";
             response["action"] = "preview";
             response["success"] = true;
-            String responseStr;
-            serializeJson(response, responseStr);
-            ws->textAll(responseStr);
-        } else if (action == "save_neo_color") {
-            uint8_t r = doc["r"];
-            uint8_t g = doc["g"];
-            uint8_t b = doc["b"];
-            String hex = doc["hex"];
-            
-            bool saved = saveNeoColor(r, g, b, hex);
+            sendJson(nullptr, response, WS_FRAME_CONTROL);
+            break;
+        }
+        case WS_CMD_SAVE_NEO_COLOR: {
+            const WsColor& color = command.color;
+            bool saved = saveNeoColor(color.r, color.g, color.b, color.hex);
             if (!isBlinking) { // Apply immediately if not in alert mode
-                setNeoColor(r, g, b);
+                setNeoColor(color.r, color.g, color.b);
             }
             
             // Send confirmation response for save
-            DynamicJsonDocument response(256);
+            JsonArenaDocument response(256);
             response["type"] = "neo_color_result";
             response["action"] = "save";
             response["success"] = saved;
-            String responseStr;
-            serializeJson(response, responseStr);
-            ws->textAll(responseStr);
-        } else if (action == "get_light") {
-            sendLightSensorData();
-        } else if (action == "save_alert_color") {
-            uint8_t r = doc["r"];
-            uint8_t g = doc["g"];
-            uint8_t b = doc["b"];
-            String hex = doc["hex"];
-            
-            bool saved = saveAlertColor(r, g, b, hex);
+            sendJson(nullptr, response, WS_FRAME_CONTROL);
+            break;
+        }
+        case WS_CMD_SAVE_ALERT_COLOR: {
+            const WsColor& color = command.color;
+            bool saved = saveAlertColor(color.r, color.g, color.b, color.hex);
             
-            DynamicJsonDocument response(256);
+            JsonArenaDocument response(256);
             response["type"] = "alert_color_result";
             response["success"] = saved;
-            String responseStr;
-            serializeJson(response, responseStr);
-            ws->textAll(responseStr);
-        } else if (action == "save_temp_threshold") {
-            float threshold = doc["threshold"];
-            
-            bool saved = saveTempThreshold(threshold);
+            sendJson(nullptr, response, WS_FRAME_CONTROL);
+            break;
+        }
+        case WS_CMD_SAVE_TEMP_THRESHOLD: {
+            bool saved = saveTempThreshold(command.threshold);
             
-            DynamicJsonDocument response(256);
+            JsonArenaDocument response(256);
             response["type"] = "temp_threshold_result";
             response["success"] = saved;
-            response["threshold"] = threshold;
-            String responseStr;
-            serializeJson(response, responseStr);
-            ws->textAll(responseStr);
-        } else if (action == "get_alert_settings") {
-            DynamicJsonDocument response(512);
-            response["type"] = "alert_settings";
-            response["alert_r"] = alertNeoR;
-            response["alert_g"] = alertNeoG;
-            response["alert_b"] = alertNeoB;
-            response["alert_hex"] = alertNeoHex;
-            response["temp_threshold"] = tempThreshold;
-            response["current_temp"] = glob_temperature;
-            response["temp_alert"] = glob_temp_alert;
+            response["threshold"] = command.threshold;
+            sendJson(nullptr, response, WS_FRAME_CONTROL);
+            break;
+        }
+        case WS_CMD_SET_REPORT_POLICY: {
+            bool saved = report_policy_set(command.report.metric, command.report.rule);
             
-            String responseStr;
-            serializeJson(response, responseStr);
-            ws->textAll(responseStr);
+            JsonArenaDocument response(256);
+            response["type"] = "report_policy_result";
+            response["success"] = saved;
+            response["metric"] = history_metric_name(command.report.metric);
+            sendJson(nullptr, response, WS_FRAME_CONTROL);
+            sendReportPolicy();
+            break;
+        }
+    }
+}
+
+void WiFiConfigServer::sendHistory(AsyncWebSocketClient *client, HistoryMetric metric, uint32_t from, uint32_t to, size_t points) {
+    // Only the requesting client gets the series, it is one message so the point count is capped
+    if (points > HISTORY_WS_MAX_POINTS) {
+        points = HISTORY_WS_MAX_POINTS;
+    }
+    HistoryJsonWriter writer(metric, from, to, points);
+    xSemaphoreTake(largeMessageMutex, portMAX_DELAY);
+    {
+        WsMessage message(largeMessage, WS_MESSAGE_LARGE);
+        size_t item = 0;
+        while (writer.write(message, item++)) {
         }
+        sendMessage(client, message, WS_FRAME_CONTROL);
+    }
+    xSemaphoreGive(largeMessageMutex);
+}
+
+void WiFiConfigServer::sendTaskProfile(AsyncWebSocketClient *client) {
+    if (client == nullptr && ws->count() == 0) {
+        return;
+    }
+    // The writer holds a copy of all profiles, it is kept with the large message buffer instead
+    // of on the stack of the calling task
+    xSemaphoreTake(largeMessageMutex, portMAX_DELAY);
+    {
+        profileWriter.snapshot();
+        WsMessage message(largeMessage, WS_MESSAGE_LARGE);
+        size_t item = 0;
+        while (profileWriter.write(message, item++)) {
+        }
+        sendMessage(client, message, client ? WS_FRAME_CONTROL : WS_FRAME_SENSOR);
+    }
+    xSemaphoreGive(largeMessageMutex);
+}
+
+void WiFiConfigServer::sendReportPolicy(AsyncWebSocketClient *client) {
+    if (client == nullptr && ws->count() == 0) {
+        return;
+    }
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    report_policy_get(rules);
+    JsonArenaDocument doc(JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(HISTORY_METRIC_COUNT) +
+                          HISTORY_METRIC_COUNT * JSON_OBJECT_SIZE(6));
+    doc["type"] = "report_policy";
+    JsonArray metrics = doc.createNestedArray("metrics");
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        HistoryMetric metric = (HistoryMetric)i;
+        JsonObject entry = metrics.createNestedObject();
+        entry["metric"] = history_metric_name(metric);
+        entry["dead_band"] = rules[i].deadBand;
+        entry["max_silence"] = rules[i].maxSilenceS;
+        entry["window"] = rules[i].windowS;
+        entry["readings"] = report_policy_readings(metric);
+        entry["reports"] = report_policy_reports(metric);
+    }
+    sendJson(client, doc, WS_FRAME_CONTROL);
+}
+
+void WiFiConfigServer::loadStaticAsset(StaticAsset& asset, const char* path) {
+    asset.path = path;
+    asset.gzip = false;
+    asset.available = false;
+    
+    // Prefer the variant precompressed by scripts/compress_assets.py
+    String gzPath = String(path) + ".gz";
+    File file = LittleFS.open(gzPath, "r");
+    if (file) {
+        asset.file = gzPath;
+        asset.gzip = true;
+    } else {
+        file = LittleFS.open(path, "r");
+        asset.file = path;
+    }
+    if (!file) {
+        Serial.printf("Web page %s not found on LittleFS\n", path);
+        return;
     }
+    
+    MD5Builder md5;
+    md5.begin();
+    md5.addStream(file, file.size());
+    md5.calculate();
+    asset.etag = "\"" + md5.toString() + "\"";
+    asset.available = true;
+    Serial.printf("Web page %s: %u bytes%s, ETag %s\n", asset.file.c_str(), (unsigned)file.size(),
+                  asset.gzip ? " (gzip)" : "", asset.etag.c_str());
+    file.close();
+}
+
+bool WiFiConfigServer::sendStaticAsset(AsyncWebServerRequest *request, const StaticAsset& asset) {
+    if (!asset.available) {
+        return false;
+    }
+    
+    // The browser still has this exact version, let it revalidate without sending the page again
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset.etag) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", asset.etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
+        return true;
+    }
+    
+    // Open the known file directly instead of letting the web server probe for variants with exists(),
+    // it is passed under its .gz path, so the web server does not add a second Content-Encoding header
+    File file = LittleFS.open(asset.file, "r");
+    if (!file) {
+        return false;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(file, asset.file, "text/html");
+    if (asset.gzip) {
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return true;
 }
 
 void WiFiConfigServer::setupConfigRoutes() {
     server->on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
         // Serve dashboard.html as root page
-        if (LittleFS.exists("/dashboard.html")) {
-            request->send(LittleFS, "/dashboard.html", "text/html");
-        } else {
+        if (!sendStaticAsset(request, dashboardAsset)) {
             request->send(404, "text/html", "<h1>Dashboard not found</h1><p>Please upload dashboard.html to LittleFS</p>");
         }
     });
     
     server->on("/wifi-config", HTTP_GET, [this](AsyncWebServerRequest *request) {
         // Try to serve from LittleFS first, fallback to function
-        if (LittleFS.exists("/wifi_config.html")) {
-            request->send(LittleFS, "/wifi_config.html", "text/html");
-        } else {
+        if (!sendStaticAsset(request, wifiConfigAsset)) {
             request->send(200, "text/html", getConfigPageHTML());
         }
     });
     
     server->on("/dashboard", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        if (LittleFS.exists("/dashboard.html")) {
-            request->send(LittleFS, "/dashboard.html", "text/html");
-        } else {
+        if (!sendStaticAsset(request, dashboardAsset)) {
             request->send(404, "text/html", "<h1>Dashboard not found</h1><p>Please upload dashboard.html to LittleFS</p>");
         }
     });
     
+    // JSON bodies are serialized straight into the send buffer of a chunked response,
+    // instead of being built as a String and copied again by the web server
     server->on("/scan", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getWiFiScanJSON());
+        std::shared_ptr<std::vector<WiFiNetwork>> networks = std::make_shared<std::vector<WiFiNetwork>>(scanWiFiNetworks());
+        sendStreamResponse(request, "application/json", [networks](Print& out, size_t item) {
+            // One network per call, the list itself is never serialized as a whole
+            if (item == 0) {
+                out.print("{\"networks\":[");
+            }
+            if (item < networks->size()) {
+                if (item > 0) {
+                    out.print(',');
+                }
+                const WiFiNetwork& network = (*networks)[item];
+                StaticJsonDocument<192> doc;
+                doc["ssid"] = network.ssid;
+                doc["rssi"] = network.rssi;
+                doc["secured"] = network.secured;
+                doc["strength"] = (network.rssi + 100) * 2;
+                serializeJson(doc, out);
+                return true;
+            }
+            out.print("]}");
+            return false;
+        });
     });
     
     server->on("/status", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getWiFiStatusJSON());
+        sendStreamResponse(request, "application/json", [this](Print& out, size_t item) {
+            writeWiFiStatusJSON(out);
+            return false;
+        });
     });
     
     server->on("/sensors", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getSensorDataJSON());
+        sendStreamResponse(request, "application/json", [this](Print& out, size_t item) {
+            writeSensorDataJSON(out);
+            return false;
+        });
     });
     
     server->on("/leds", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getLEDStatusJSON());
+        sendStreamResponse(request, "application/json", [this](Print& out, size_t item) {
+            writeLEDStatusJSON(out);
+            return false;
+        });
     });
     
     server->on("/light", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getLightSensorJSON());
+        sendStreamResponse(request, "application/json", [this](Print& out, size_t item) {
+            writeLightSensorJSON(out);
+            return false;
+        });
     });
     
     server->on("/alert", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        request->send(200, "application/json", getAlertSettingsJSON());
+        sendStreamResponse(request, "application/json", [this](Print& out, size_t item) {
+            writeAlertSettingsJSON(out);
+            return false;
+        });
     });
-}
-
-String WiFiConfigServer::getWiFiScanJSON() {
-    auto networks = scanWiFiNetworks();
     
-    DynamicJsonDocument doc(2048);
-    JsonArray array = doc.createNestedArray("networks");
+    // OpenMetrics exposition of the counters and histograms in metrics.h
+    server->on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+        sendStreamResponse(request, "application/openmetrics-text; version=1.0.0; charset=utf-8", [](Print& out, size_t item) {
+            if (item == 0) {
+                metrics_collect();
+            }
+            return metrics_write(out, item);
+        });
+    });
     
-    for (const auto& network : networks) {
-        JsonObject obj = array.createNestedObject();
-        obj["ssid"] = network.ssid;
-        obj["rssi"] = network.rssi;
-        obj["secured"] = network.secured;
-        obj["strength"] = (network.rssi + 100) * 2;
-    }
+    // Free heap, largest block and fragmentation over the last week and the allocation sites (heap_monitor.h)
+    server->on("/heap", HTTP_GET, [](AsyncWebServerRequest *request) {
+        sendStreamResponse(request, "application/json", heap_monitor_write);
+    });
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    // Regions of the memory budget and what was claimed from them (memory_budget.h)
+    server->on("/memory", HTTP_GET, [](AsyncWebServerRequest *request) {
+        sendStreamResponse(request, "application/json", memory_budget_write);
+    });
+    
+    // Start and end of the init stages (boot_timeline.h)
+    server->on("/boot", HTTP_GET, [](AsyncWebServerRequest *request) {
+        sendStreamResponse(request, "application/json", boot_timeline_write);
+    });
+    
+    // Per task CPU share, stack high water marks and loop latency histograms (task_profiler.h)
+    server->on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+        std::shared_ptr<TaskProfileJsonWriter> writer = std::make_shared<TaskProfileJsonWriter>();
+        sendStreamResponse(request, "application/json", [writer](Print& out, size_t item) {
+            return writer->write(out, item);
+        });
+    });
+    
+    // Latency spans of the last sensor readings as Chrome trace-event JSON (latency_trace.h),
+    // open it in chrome://tracing or ui.perfetto.dev
+    server->on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+        std::shared_ptr<TraceJsonWriter> writer = std::make_shared<TraceJsonWriter>();
+        sendStreamResponse(request, "application/json", [writer](Print& out, size_t item) {
+            return writer->write(out, item);
+        });
+    });
+    
+    // /history?metric=temperature|humidity|light&from=&to=&range=&points=
+    // from/to are seconds since boot (default: the last range seconds, 24 hours), the series is downsampled
+    // with LTTB and written chunk by chunk, so the response is never held in RAM as a whole
+    server->on("/history", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        HistoryMetric metric;
+        if (!request->hasParam("metric") || !history_parse_metric(request->getParam("metric")->value(), metric)) {
+            request->send(400, "application/json", "{\"error\":\"metric must be temperature, humidity or light\"}");
+            return;
+        }
+        uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : history_now();
+        uint32_t range = request->hasParam("range") ? strtoul(request->getParam("range")->value().c_str(), NULL, 10) : 86400;
+        uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : (to > range ? to - range : 0);
+        size_t points = request->hasParam("points") ? strtoul(request->getParam("points")->value().c_str(), NULL, 10) : HISTORY_DEFAULT_POINTS;
+        
+        std::shared_ptr<HistoryJsonWriter> writer = std::make_shared<HistoryJsonWriter>(metric, from, to, points);
+        sendStreamResponse(request, "application/json", [writer](Print& out, size_t item) {
+            return writer->write(out, item);
+        });
+    });
 }
 
-String WiFiConfigServer::getWiFiStatusJSON() {
-    DynamicJsonDocument doc(512);
+void WiFiConfigServer::writeWiFiStatusJSON(Print& out) {
+    StaticJsonDocument<512> doc;
+    
+    char ip[16];
+    getLocalIP(ip, sizeof(ip));
+    char configIp[16] = "";
+    if (isConfigMode) {
+        IPAddress address = WiFi.softAPIP();
+        snprintf(configIp, sizeof(configIp), "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+    }
     
     doc["connected"] = isConnected();
     doc["ssid"] = getConnectedSSID();
-    doc["ip"] = getLocalIP();
+    doc["ip"] = (const char*)ip;
     doc["rssi"] = getRSSI();
     doc["config_mode"] = isConfigMode;
     doc["config_ssid"] = configSSID;
-    doc["config_ip"] = isConfigMode ? WiFi.softAPIP().toString() : "";
+    doc["config_ip"] = (const char*)configIp;
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    serializeJson(doc, out);
 }
 
-void WiFiConfigServer::sendWiFiStatus() {
-    if (ws->count() > 0) {
-        DynamicJsonDocument doc(512);
+void WiFiConfigServer::sendWiFiStatus(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
+        char ip[16];
+        getLocalIP(ip, sizeof(ip));
+        JsonArenaDocument doc(512);
         doc["type"] = "status";
         doc["connected"] = isConnected();
         doc["ssid"] = getConnectedSSID();
-        doc["ip"] = getLocalIP();
+        doc["ip"] = (const char*)ip;
         doc["rssi"] = getRSSI();
         doc["config_mode"] = isConfigMode;
         
-        String message;
-        serializeJson(doc, message);
-        ws->textAll(message);
+        sendJson(client, doc, WS_FRAME_SENSOR);
     }
 }
 
-void WiFiConfigServer::sendWiFiList() {
-    if (ws->count() > 0) {
+void WiFiConfigServer::sendWiFiList(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
         auto networks = scanWiFiNetworks();
         
-        DynamicJsonDocument doc(2048);
+        JsonArenaDocument doc(2048);
         doc["type"] = "networks";
         JsonArray array = doc.createNestedArray("list");
         
@@ -525,88 +893,122 @@ void WiFiConfigServer::sendWiFiList() {
             obj["strength"] = (network.rssi + 100) * 2;
         }
         
-        String message;
-        serializeJson(doc, message);
-        ws->textAll(message);
+        sendJson(client, doc, WS_FRAME_CONTROL);
     }
 }
 
-void WiFiConfigServer::broadcastMessage(const String& message) {
+void WiFiConfigServer::broadcastMessage(const WsMessage& message, WsFrameClass frameClass) {
     if (ws->count() > 0) {
-        ws->textAll(message);
+        uint32_t start = micros();
+        fanout->broadcast(message.c_str(), message.length(), frameClass);
+        metric_ws_broadcast.observe(micros() - start);
+    }
+}
+
+void WiFiConfigServer::sendMessage(AsyncWebSocketClient *client, const WsMessage& message, WsFrameClass frameClass) {
+    if (client) {
+        fanout->send(client->id(), message.c_str(), message.length(), frameClass);
+    } else {
+        broadcastMessage(message, frameClass);
+    }
+}
+
+void WiFiConfigServer::sendJson(AsyncWebSocketClient *client, const JsonDocument& doc, WsFrameClass frameClass) {
+    if (measureJson(doc) < WS_MESSAGE_SMALL) {
+        char buffer[WS_MESSAGE_SMALL];
+        WsMessage message(buffer, sizeof(buffer));
+        serializeJson(doc, message);
+        sendMessage(client, message, frameClass);
+        return;
+    }
+    xSemaphoreTake(largeMessageMutex, portMAX_DELAY);
+    {
+        WsMessage message(largeMessage, WS_MESSAGE_LARGE);
+        serializeJson(doc, message);
+        sendMessage(client, message, frameClass);
     }
+    xSemaphoreGive(largeMessageMutex);
 }
 
-String WiFiConfigServer::getSensorDataJSON() {
-    DynamicJsonDocument doc(512);
+void WiFiConfigServer::writeSensorDataJSON(Print& out) {
+    StaticJsonDocument<512> doc;
     
-    doc["temperature"] = glob_temperature;
-    doc["humidity"] = glob_humidity;
-    doc["light_level"] = glob_light_level;
-    doc["led_state"] = glob_led_state;
+    doc["temperature"] = sensors.temperature;
+    doc["humidity"] = sensors.humidity;
+    doc["light_level"] = sensors.lightLevel;
+    doc["led_state"] = sensors.ledState;
     doc["temp_alert"] = glob_temp_alert;
-    doc["temp_threshold"] = tempThreshold;
+    doc["temp_threshold"] = settings.get().tempThreshold;
     doc["timestamp"] = millis();
-    doc["valid"] = !isnan(glob_temperature) && !isnan(glob_humidity);
+    doc["sampled_at"] = sensors.dhtReadMs;
+    doc["light_sampled_at"] = sensors.lightReadMs;
+    doc["valid"] = !isnan(sensors.temperature) && !isnan(sensors.humidity);
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    serializeJson(doc, out);
 }
 
-void WiFiConfigServer::sendSensorData() {
-    if (ws->count() > 0) {
-        DynamicJsonDocument doc(512);
+void WiFiConfigServer::sendSensorData(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
+        // Readings published since the last broadcast are traced from here to the network,
+        // the initial state sent to a new client leaves them to the next broadcast
+        TraceMessage trace(client == nullptr);
+        uint64_t encodeStart = trace_now();
+        JsonArenaDocument doc(512);
         doc["type"] = "sensors";
-        doc["temperature"] = glob_temperature;
-        doc["humidity"] = glob_humidity;
-        doc["light_level"] = glob_light_level;
-        doc["led_state"] = glob_led_state;
+        doc["temperature"] = sensors.temperature;
+        doc["humidity"] = sensors.humidity;
+        doc["light_level"] = sensors.lightLevel;
+        doc["led_state"] = sensors.ledState;
         doc["temp_alert"] = glob_temp_alert;
-        doc["temp_threshold"] = tempThreshold;
+        doc["temp_threshold"] = settings.get().tempThreshold;
         doc["timestamp"] = millis();
-        doc["valid"] = !isnan(glob_temperature) && !isnan(glob_humidity);
+        doc["sampled_at"] = sensors.dhtReadMs;
+        doc["light_sampled_at"] = sensors.lightReadMs;
+        doc["valid"] = !isnan(sensors.temperature) && !isnan(sensors.humidity);
         
-        String message;
+        char buffer[WS_MESSAGE_SMALL];
+        WsMessage message(buffer, sizeof(buffer));
         serializeJson(doc, message);
-        ws->textAll(message);
+        uint64_t enqueueStart = trace_now();
+        trace.span(TRACE_JSON_ENCODE, encodeStart, enqueueStart);
+        sendMessage(client, message, WS_FRAME_SENSOR);
+        uint64_t enqueueEnd = trace_now();
+        trace.span(TRACE_WS_ENQUEUE, enqueueStart, enqueueEnd);
+        trace.enqueued(enqueueEnd);
     }
 }
 
-String WiFiConfigServer::getLEDStatusJSON() {
-    DynamicJsonDocument doc(512);
+void WiFiConfigServer::writeLEDStatusJSON(Print& out) {
+    StaticJsonDocument<256> doc;
     
     doc["led_state"] = ledState;
     doc["neo_state"] = neoState;
-    doc["light_led_state"] = glob_led_state;
+    doc["light_led_state"] = sensors.ledState;
     doc["led_pin"] = LED_GPIO;
     doc["neo_pin"] = NEO_PIN;
     doc["light_led_pin"] = 2;
     doc["timestamp"] = millis();
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    serializeJson(doc, out);
 }
 
-String WiFiConfigServer::getLightSensorJSON() {
-    DynamicJsonDocument doc(256);
+void WiFiConfigServer::writeLightSensorJSON(Print& out) {
+    StaticJsonDocument<256> doc;
     
-    doc["light_level"] = glob_light_level;
-    doc["led_state"] = glob_led_state;
+    doc["light_level"] = sensors.lightLevel;
+    doc["led_state"] = sensors.ledState;
     doc["threshold"] = 500;
     doc["sensor_pin"] = 1;
     doc["led_pin"] = 2;
     doc["timestamp"] = millis();
+    doc["sampled_at"] = sensors.lightReadMs;
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    serializeJson(doc, out);
 }
 
-void WiFiConfigServer::sendLEDStatus() {
-    if (ws->count() > 0) {
-        DynamicJsonDocument doc(256);
+void WiFiConfigServer::sendLEDStatus(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
+        JsonArenaDocument doc(256);
         doc["type"] = "leds";
         doc["led_state"] = ledState;
         doc["neo_state"] = neoState;
@@ -614,26 +1016,40 @@ void WiFiConfigServer::sendLEDStatus() {
         doc["neo_pin"] = NEO_PIN;
         doc["timestamp"] = millis();
         
-        String message;
-        serializeJson(doc, message);
-        ws->textAll(message);
+        sendJson(client, doc, WS_FRAME_CONTROL);
     }
 }
 
-void WiFiConfigServer::sendLightSensorData() {
-    if (ws->count() > 0) {
-        DynamicJsonDocument doc(256);
+void WiFiConfigServer::sendLightSensorData(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
+        JsonArenaDocument doc(256);
         doc["type"] = "light";
-        doc["light_level"] = glob_light_level;
-        doc["led_state"] = glob_led_state;
+        doc["light_level"] = sensors.lightLevel;
+        doc["led_state"] = sensors.ledState;
         doc["threshold"] = 500;
         doc["sensor_pin"] = 1;
         doc["led_pin"] = 2;
         doc["timestamp"] = millis();
+        doc["sampled_at"] = sensors.lightReadMs;
         
-        String message;
-        serializeJson(doc, message);
-        ws->textAll(message);
+        sendJson(client, doc, WS_FRAME_SENSOR);
+    }
+}
+
+void WiFiConfigServer::sendAlertSettings(AsyncWebSocketClient *client) {
+    if (client || ws->count() > 0) {
+        Settings alert = settings.get();
+        JsonArenaDocument doc(512);
+        doc["type"] = "alert_settings";
+        doc["alert_r"] = alert.alertR;
+        doc["alert_g"] = alert.alertG;
+        doc["alert_b"] = alert.alertB;
+        doc["alert_hex"] = alert.alertHex;
+        doc["temp_threshold"] = alert.tempThreshold;
+        doc["current_temp"] = sensors.temperature;
+        doc["temp_alert"] = glob_temp_alert;
+        
+        sendJson(client, doc, WS_FRAME_CONTROL);
     }
 }
 
@@ -661,54 +1077,28 @@ void WiFiConfigServer::setNeoState(bool state) {
 
 // Temperature-based NeoPixel control function
 void WiFiConfigServer::setNeoColorForTemperature(float temperature) {
-    if (temperature > tempThreshold) {
+    Settings neo = settings.get();
+    if (temperature > neo.tempThreshold) {
         // Start blinking with alert color when temperature is above threshold
-        if (!isBlinking) {
-            isBlinking = true;
-            lastBlinkTime = millis();
-            blinkState = true;
-        }
+        isBlinking = true;
+        neo_effect_blink(neo.alertR, neo.alertG, neo.alertB);
         neoState = true;
         glob_temp_alert = true;
-        Serial.printf("NeoPixel GPIO %d blinking alert color RGB(%d,%d,%d) due to high temperature: %.2f°C (threshold: %.1f°C)\n", 
-                      NEO_PIN, alertNeoR, alertNeoG, alertNeoB, temperature, tempThreshold);
+        LOG(NEO_ALERT, NEO_PIN, neo.alertR, neo.alertG, neo.alertB, temperature, neo.tempThreshold);
     } else {
         // Return to normal color when temperature is at or below threshold
         isBlinking = false;
-        neoPixel->setPixelColor(0, neoPixel->Color(savedNeoR, savedNeoG, savedNeoB));
-        neoPixel->show();
+        neo_effect_show(neo.neoR, neo.neoG, neo.neoB);
         neoState = true;
         glob_temp_alert = false;
-        Serial.printf("NeoPixel GPIO %d set to normal color RGB(%d,%d,%d), temperature: %.2f°C (threshold: %.1f°C)\n", 
-                      NEO_PIN, savedNeoR, savedNeoG, savedNeoB, temperature, tempThreshold);
-    }
-}
-
-// Handle NeoPixel blinking during temperature alerts
-void WiFiConfigServer::handleNeoBlinking() {
-    if (isBlinking) {
-        unsigned long currentTime = millis();
-        if (currentTime - lastBlinkTime > 500) { // Blink every 500ms
-            blinkState = !blinkState;
-            lastBlinkTime = currentTime;
-            
-            if (blinkState) {
-                // Show alert color
-                neoPixel->setPixelColor(0, neoPixel->Color(alertNeoR, alertNeoG, alertNeoB));
-            } else {
-                // Turn off
-                neoPixel->setPixelColor(0, neoPixel->Color(0, 0, 0));
-            }
-            neoPixel->show();
-        }
+        LOG(NEO_NORMAL, NEO_PIN, neo.neoR, neo.neoG, neo.neoB, temperature, neo.tempThreshold);
     }
 }
 
 // Manual color setting for normal operation
 void WiFiConfigServer::setNeoColor(uint8_t r, uint8_t g, uint8_t b) {
     if (!isBlinking) { // Only allow manual control when not in alert mode
-        neoPixel->setPixelColor(0, neoPixel->Color(r, g, b));
-        neoPixel->show();
+        neo_effect_show(r, g, b);
         neoState = true;
         Serial.printf("NeoPixel GPIO %d color set to RGB(%d, %d, %d)\n", NEO_PIN, r, g, b);
     }
@@ -719,52 +1109,39 @@ void WiFiConfigServer::setNeoState(bool state) {
     if (!isBlinking) { // Only allow manual control when not in alert mode
         neoState = state;
         if (state) {
-            neoPixel->setPixelColor(0, neoPixel->Color(savedNeoR, savedNeoG, savedNeoB));
+            Settings neo = settings.get();
+            neo_effect_show(neo.neoR, neo.neoG, neo.neoB);
         } else {
-            neoPixel->setPixelColor(0, neoPixel->Color(0, 0, 0));
+            neo_effect_show(0, 0, 0);
         }
-        neoPixel->show();
         Serial.printf("NeoPixel GPIO %d set to %s\n", NEO_PIN, state ? "ON" : "OFF");
     }
 }
 
-bool WiFiConfigServer::saveNeoColor(uint8_t r, uint8_t g, uint8_t b, const String& hex) {
-    savedNeoR = r;
-    savedNeoG = g;
-    savedNeoB = b;
-    savedNeoHex = hex;
+bool WiFiConfigServer::saveNeoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) {
+    // Written to NVS once the user stopped changing settings
+    settings.setNeoColor(r, g, b, hex);
     
-    // Save to preferences
-    preferences.putUChar("neo_r", r);
-    preferences.putUChar("neo_g", g);
-    preferences.putUChar("neo_b", b);
-    preferences.putString("neo_hex", hex);
-    
-    Serial.printf("NeoPixel color saved: RGB(%d, %d, %d) = %s\n", r, g, b, hex.c_str());
+    Serial.printf("NeoPixel color saved: RGB(%d, %d, %d) = %s\n", r, g, b, hex);
     return true;
 }
 
 void WiFiConfigServer::loadSavedNeoColor() {
-    // Load saved color from preferences, use default if not found
-    savedNeoR = preferences.getUChar("neo_r", 0);
-    savedNeoG = preferences.getUChar("neo_g", 255);
-    savedNeoB = preferences.getUChar("neo_b", 0);
-    savedNeoHex = preferences.getString("neo_hex", "#00ff00");
+    // Saved color from the settings store, the default if none was saved
+    Settings saved = settings.get();
     
     Serial.printf("Loaded saved NeoPixel color: RGB(%d, %d, %d) = %s\n", 
-                  savedNeoR, savedNeoG, savedNeoB, savedNeoHex.c_str());
+                  saved.neoR, saved.neoG, saved.neoB, saved.neoHex);
     
     // Send saved color to connected clients
-    DynamicJsonDocument doc(256);
+    JsonArenaDocument doc(256);
     doc["type"] = "saved_color";
-    doc["r"] = savedNeoR;
-    doc["g"] = savedNeoG;
-    doc["b"] = savedNeoB;
-    doc["hex"] = savedNeoHex;
+    doc["r"] = saved.neoR;
+    doc["g"] = saved.neoG;
+    doc["b"] = saved.neoB;
+    doc["hex"] = saved.neoHex;
     
-    String message;
-    serializeJson(doc, message);
-    ws->textAll(message);
+    sendJson(nullptr, doc, WS_FRAME_CONTROL);
 }
 
 bool WiFiConfigServer::getLEDState() {
@@ -775,63 +1152,48 @@ bool WiFiConfigServer::getNeoState() {
     return neoState;
 }
 
-bool WiFiConfigServer::saveAlertColor(uint8_t r, uint8_t g, uint8_t b, const String& hex) {
-    alertNeoR = r;
-    alertNeoG = g;
-    alertNeoB = b;
-    alertNeoHex = hex;
-    
-    // Save to preferences
-    preferences.putUChar("alert_r", r);
-    preferences.putUChar("alert_g", g);
-    preferences.putUChar("alert_b", b);
-    preferences.putString("alert_hex", hex);
+bool WiFiConfigServer::saveAlertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) {
+    settings.setAlertColor(r, g, b, hex);
+    // A running alert blinks in the new color right away
+    if (isBlinking) {
+        neo_effect_blink(r, g, b);
+    }
     
-    Serial.printf("Alert color saved: RGB(%d, %d, %d) = %s\n", r, g, b, hex.c_str());
+    Serial.printf("Alert color saved: RGB(%d, %d, %d) = %s\n", r, g, b, hex);
     return true;
 }
 
 bool WiFiConfigServer::saveTempThreshold(float threshold) {
-    tempThreshold = threshold;
+    settings.setTempThreshold(threshold);
     HIGH_TEMP_THRESHOLD = threshold; // Update global threshold
     
-    // Save to preferences
-    preferences.putFloat("temp_threshold", threshold);
-    
     Serial.printf("Temperature threshold saved: %.1f°C\n", threshold);
     return true;
 }
 
 void WiFiConfigServer::loadAlertSettings() {
-    // Load saved alert color from preferences, use default if not found
-    alertNeoR = preferences.getUChar("alert_r", 255);
-    alertNeoG = preferences.getUChar("alert_g", 0);
-    alertNeoB = preferences.getUChar("alert_b", 0);
-    alertNeoHex = preferences.getString("alert_hex", "#ff0000");
-    
-    // Load temperature threshold
-    tempThreshold = preferences.getFloat("temp_threshold", 30.0);
-    HIGH_TEMP_THRESHOLD = tempThreshold; // Update global threshold
+    // Saved alert color and temperature threshold, the defaults if none were saved
+    Settings saved = settings.get();
+    HIGH_TEMP_THRESHOLD = saved.tempThreshold; // Update global threshold
     
     Serial.printf("Loaded alert settings: Color RGB(%d, %d, %d) = %s, Threshold: %.1f°C\n", 
-                  alertNeoR, alertNeoG, alertNeoB, alertNeoHex.c_str(), tempThreshold);
+                  saved.alertR, saved.alertG, saved.alertB, saved.alertHex, saved.tempThreshold);
 }
 
-String WiFiConfigServer::getAlertSettingsJSON() {
-    DynamicJsonDocument doc(256);
+void WiFiConfigServer::writeAlertSettingsJSON(Print& out) {
+    Settings alert = settings.get();
+    StaticJsonDocument<256> doc;
     
-    doc["alert_r"] = alertNeoR;
-    doc["alert_g"] = alertNeoG;
-    doc["alert_b"] = alertNeoB;
-    doc["alert_hex"] = alertNeoHex;
-    doc["temp_threshold"] = tempThreshold;
-    doc["current_temp"] = glob_temperature;
+    doc["alert_r"] = alert.alertR;
+    doc["alert_g"] = alert.alertG;
+    doc["alert_b"] = alert.alertB;
+    doc["alert_hex"] = alert.alertHex;
+    doc["temp_threshold"] = alert.tempThreshold;
+    doc["current_temp"] = sensors.temperature;
     doc["temp_alert"] = glob_temp_alert;
     doc["timestamp"] = millis();
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    serializeJson(doc, out);
 }
 
 String WiFiConfigServer::getConfigPageHTML() {
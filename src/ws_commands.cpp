@@ -0,0 +1,359 @@
+#include "ws_commands.h"
+#include <ArduinoJson.h>
+#include "memory_budget.h"
+
+// Parameter types, numbers are checked for their range and strings for their length
+enum WsParamType : uint8_t {
+    WS_PARAM_BOOL,
+    WS_PARAM_BYTE,
+    WS_PARAM_UINT,
+    WS_PARAM_FLOAT,
+    WS_PARAM_STRING,
+    WS_PARAM_HISTORY_METRIC
+};
+
+struct WsParam {
+    const char* name;
+    WsParamType type;
+    bool required;          // Otherwise it is 0 if missing
+    bool login;             // Stored in the WiFi login instead of the command
+    uint16_t offset;
+    uint8_t size;           // Of string buffers, including the terminator
+};
+
+#define WS_PARAM(name, type, required, member) \
+    { name, type, required, false, offsetof(WsCommand, member), sizeof(((WsCommand*)0)->member) }
+#define WS_LOGIN_PARAM(name, required, member) \
+    { name, WS_PARAM_STRING, required, true, offsetof(WsWiFiLogin, member), sizeof(((WsWiFiLogin*)0)->member) }
+
+struct WsAction {
+    const char* name;
+    WsCommandType type;
+    const WsParam* params;
+    uint8_t paramCount;
+    // Checks and completes the command once the parameters are read, present has a bit per parameter
+    bool (*finish)(WsCommand& command, WsWiFiLogin& login, uint32_t present);
+};
+
+#define WS_ACTION(name, type, params, finish) { name, type, params, sizeof(params) / sizeof(params[0]), finish }
+#define WS_ACTION_WITHOUT_PARAMS(name, type) { name, type, nullptr, 0, nullptr }
+
+static constexpr WsParam WS_PARAMS_STATE[] = {
+    WS_PARAM("state", WS_PARAM_BOOL, true, state),
+};
+static constexpr WsParam WS_PARAMS_COLOR[] = {
+    WS_PARAM("r", WS_PARAM_BYTE, true, color.r),
+    WS_PARAM("g", WS_PARAM_BYTE, true, color.g),
+    WS_PARAM("b", WS_PARAM_BYTE, true, color.b),
+    WS_PARAM("hex", WS_PARAM_STRING, true, color.hex),
+};
+static constexpr WsParam WS_PARAMS_THRESHOLD[] = {
+    WS_PARAM("threshold", WS_PARAM_FLOAT, true, threshold),
+};
+static constexpr WsParam WS_PARAMS_CONNECT[] = {
+    WS_LOGIN_PARAM("ssid", true, ssid),
+    WS_LOGIN_PARAM("password", false, password),    // Open networks
+};
+static constexpr WsParam WS_PARAMS_HISTORY[] = {
+    WS_PARAM("metric", WS_PARAM_HISTORY_METRIC, true, history.metric),
+    WS_PARAM("from", WS_PARAM_UINT, false, history.from),
+    WS_PARAM("to", WS_PARAM_UINT, false, history.to),
+    WS_PARAM("range", WS_PARAM_UINT, false, history.range),
+    WS_PARAM("points", WS_PARAM_UINT, false, history.points),
+};
+static constexpr WsParam WS_PARAMS_REPORT_POLICY[] = {
+    WS_PARAM("metric", WS_PARAM_HISTORY_METRIC, true, report.metric),
+    WS_PARAM("dead_band", WS_PARAM_FLOAT, true, report.rule.deadBand),
+    WS_PARAM("max_silence", WS_PARAM_UINT, true, report.rule.maxSilenceS),
+    WS_PARAM("window", WS_PARAM_UINT, false, report.rule.windowS),
+};
+#define WS_ACTION_MAX_PARAMS 5
+
+static bool ws_finish_connect(WsCommand& command, WsWiFiLogin& login, uint32_t present) {
+    return login.ssid[0] != '\0';
+}
+
+static bool ws_finish_history(WsCommand& command, WsWiFiLogin& login, uint32_t present) {
+    // Bits in the order of WS_PARAMS_HISTORY, the series of the last day ending now by default
+    WsHistoryRequest& history = command.history;
+    if (!(present & (1 << 2))) {
+        history.to = history_now();
+    }
+    if (!(present & (1 << 3))) {
+        history.range = 86400;
+    }
+    if (!(present & (1 << 1))) {
+        history.from = history.to > history.range ? history.to - history.range : 0;
+    }
+    if (!(present & (1 << 4))) {
+        history.points = HISTORY_DEFAULT_POINTS;
+    }
+    return true;
+}
+
+static bool ws_finish_report_policy(WsCommand& command, WsWiFiLogin& login, uint32_t present) {
+    return report_rule_valid(command.report.rule);
+}
+
+static constexpr WsAction WS_ACTIONS[] = {
+    WS_ACTION_WITHOUT_PARAMS("scan", WS_CMD_SCAN),
+    WS_ACTION_WITHOUT_PARAMS("get_status", WS_CMD_GET_STATUS),
+    WS_ACTION_WITHOUT_PARAMS("get_sensors", WS_CMD_GET_SENSORS),
+    WS_ACTION_WITHOUT_PARAMS("get_leds", WS_CMD_GET_LEDS),
+    WS_ACTION_WITHOUT_PARAMS("get_light", WS_CMD_GET_LIGHT),
+    WS_ACTION_WITHOUT_PARAMS("get_alert_settings", WS_CMD_GET_ALERT_SETTINGS),
+    WS_ACTION("get_history", WS_CMD_GET_HISTORY, WS_PARAMS_HISTORY, ws_finish_history),
+    WS_ACTION_WITHOUT_PARAMS("get_tasks", WS_CMD_GET_TASKS),
+    WS_ACTION_WITHOUT_PARAMS("get_report_policy", WS_CMD_GET_REPORT_POLICY),
+    WS_ACTION("connect", WS_CMD_CONNECT, WS_PARAMS_CONNECT, ws_finish_connect),
+    WS_ACTION_WITHOUT_PARAMS("disconnect", WS_CMD_DISCONNECT),
+    WS_ACTION("control_led", WS_CMD_CONTROL_LED, WS_PARAMS_STATE, nullptr),
+    WS_ACTION("control_neo", WS_CMD_CONTROL_NEO, WS_PARAMS_STATE, nullptr),
+    WS_ACTION("preview_neo_color", WS_CMD_PREVIEW_NEO_COLOR, WS_PARAMS_COLOR, nullptr),
+    WS_ACTION("save_neo_color", WS_CMD_SAVE_NEO_COLOR, WS_PARAMS_COLOR, nullptr),
+    WS_ACTION("save_alert_color", WS_CMD_SAVE_ALERT_COLOR, WS_PARAMS_COLOR, nullptr),
+    WS_ACTION("save_temp_threshold", WS_CMD_SAVE_TEMP_THRESHOLD, WS_PARAMS_THRESHOLD, nullptr),
+    WS_ACTION("set_report_policy", WS_CMD_SET_REPORT_POLICY, WS_PARAMS_REPORT_POLICY, ws_finish_report_policy),
+};
+#define WS_ACTION_COUNT (sizeof(WS_ACTIONS) / sizeof(WS_ACTIONS[0]))
+
+// Perfect hash of the action names: FNV-1a, multiplied by a seed that spreads the names over
+// distinct slots. If a new action collides, the static_assert below fails, try other odd seeds.
+#define WS_ACTION_SEED 2809u
+#define WS_ACTION_SLOT_BITS 5
+#define WS_ACTION_MAX_NAME 24
+#define WS_NO_ACTION 0xFF
+
+// Recursive to stay a C++11 constexpr, names are at most WS_ACTION_MAX_NAME long
+static constexpr uint32_t ws_action_hash(const char* name, uint32_t hash = 2166136261u) {
+    return *name ? ws_action_hash(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+static constexpr uint8_t ws_action_slot(const char* name) {
+    return (uint8_t)((uint32_t)(ws_action_hash(name) * WS_ACTION_SEED) >> (32 - WS_ACTION_SLOT_BITS));
+}
+
+static constexpr bool ws_actions_distinct(size_t i = 0, size_t j = 1) {
+    return i >= WS_ACTION_COUNT ? true
+         : j >= WS_ACTION_COUNT ? ws_actions_distinct(i + 1, i + 2)
+         : ws_action_slot(WS_ACTIONS[i].name) != ws_action_slot(WS_ACTIONS[j].name) && ws_actions_distinct(i, j + 1);
+}
+static_assert(ws_actions_distinct(), "Two actions hash to the same slot, change WS_ACTION_SEED");
+
+static constexpr uint8_t ws_action_at(uint8_t slot, size_t i = 0) {
+    return i >= WS_ACTION_COUNT ? WS_NO_ACTION
+         : ws_action_slot(WS_ACTIONS[i].name) == slot ? (uint8_t)i
+         : ws_action_at(slot, i + 1);
+}
+
+#define WS_ACTION_AT_4(slot) ws_action_at(slot), ws_action_at(slot + 1), ws_action_at(slot + 2), ws_action_at(slot + 3)
+static constexpr uint8_t WS_ACTION_SLOTS[] = {
+    WS_ACTION_AT_4(0), WS_ACTION_AT_4(4), WS_ACTION_AT_4(8), WS_ACTION_AT_4(12),
+    WS_ACTION_AT_4(16), WS_ACTION_AT_4(20), WS_ACTION_AT_4(24), WS_ACTION_AT_4(28),
+};
+static_assert(sizeof(WS_ACTION_SLOTS) == 1 << WS_ACTION_SLOT_BITS, "One entry per slot");
+
+static bool ws_read_param(JsonVariantConst value, const WsParam& param, WsCommand& command, WsWiFiLogin& login) {
+    uint8_t* target = (param.login ? (uint8_t*)&login : (uint8_t*)&command) + param.offset;
+    switch (param.type) {
+        case WS_PARAM_BOOL:
+            if (!value.is<bool>()) {
+                return false;
+            }
+            *(bool*)target = value.as<bool>();
+            return true;
+        case WS_PARAM_BYTE:
+            if (!value.is<uint8_t>()) {
+                return false;
+            }
+            *target = value.as<uint8_t>();
+            return true;
+        case WS_PARAM_UINT: {
+            if (!value.is<uint32_t>()) {
+                return false;
+            }
+            uint32_t number = value.as<uint32_t>();
+            memcpy(target, &number, sizeof(number));
+            return true;
+        }
+        case WS_PARAM_FLOAT: {
+            float number = value.as<float>();
+            if (!value.is<float>() || isnan(number) || isinf(number)) {
+                return false;
+            }
+            memcpy(target, &number, sizeof(number));
+            return true;
+        }
+        case WS_PARAM_STRING: {
+            const char* text = value.as<const char*>();
+            size_t len = text ? strlen(text) : param.size;
+            if (len >= param.size) {
+                return false;
+            }
+            memcpy(target, text, len + 1);
+            return true;
+        }
+        case WS_PARAM_HISTORY_METRIC: {
+            HistoryMetric metric;
+            const char* text = value.as<const char*>();
+            if (text == nullptr || !history_parse_metric(text, metric)) {
+                return false;
+            }
+            memcpy(target, &metric, sizeof(metric));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ws_command_parse(char* message, size_t len, uint32_t client, WsCommand& command, WsWiFiLogin& login) {
+    // The input is writable, so strings stay in it (zero-copy) and the document only holds the members
+    StaticJsonDocument<JSON_OBJECT_SIZE(WS_ACTION_MAX_PARAMS + 1)> doc;
+    DeserializationError error = deserializeJson(doc, message, len);
+    if (error) {
+        return false;
+    }
+
+    const char* name = doc["action"];
+    if (name == nullptr || strlen(name) > WS_ACTION_MAX_NAME) {
+        return false;
+    }
+    uint8_t index = WS_ACTION_SLOTS[ws_action_slot(name)];
+    if (index == WS_NO_ACTION || strcmp(WS_ACTIONS[index].name, name) != 0) {
+        return false;
+    }
+    const WsAction& action = WS_ACTIONS[index];
+
+    memset(&command, 0, sizeof(command));
+    command.type = action.type;
+    command.client = client;
+    uint32_t present = 0;
+    for (uint8_t i = 0; i < action.paramCount; i++) {
+        const WsParam& param = action.params[i];
+        JsonVariantConst value = doc[param.name];
+        if (value.isNull()) {
+            if (param.required) {
+                return false;
+            }
+            continue;
+        }
+        if (!ws_read_param(value, param, command, login)) {
+            return false;
+        }
+        present |= 1 << i;
+    }
+    return action.finish == nullptr || action.finish(command, login, present);
+}
+
+WsMessageAssembler::WsMessageAssembler() {
+    memset(slots, 0, sizeof(slots));
+}
+
+WsMessageAssembler::Slot* WsMessageAssembler::find(uint32_t client) {
+    for (Slot& slot : slots) {
+        if (slot.client == client) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+char* WsMessageAssembler::add(uint32_t client, const AwsFrameInfo* info, uint8_t* data, size_t len, size_t& messageLen) {
+    bool first = info->num == 0 && info->index == 0;
+    bool last = info->final && info->index + len == info->len;
+    if (first && last) {
+        messageLen = len;
+        return (char*)data;
+    }
+
+    Slot* slot = find(client);
+    if (first) {
+        if (slot == nullptr) {
+            slot = find(0);
+        }
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        slot->client = client;
+        slot->len = 0;
+        slot->overflow = false;
+    } else if (slot == nullptr) {
+        // Rest of a message that was dropped
+        return nullptr;
+    }
+
+    if (slot->len + len > WS_COMMAND_MAX_MESSAGE) {
+        slot->overflow = true;
+    } else {
+        memcpy(slot->buffer + slot->len, data, len);
+        slot->len += len;
+    }
+    if (!last) {
+        return nullptr;
+    }
+    slot->client = 0;
+    if (slot->overflow) {
+        return nullptr;
+    }
+    slot->buffer[slot->len] = '\0';
+    messageLen = slot->len;
+    return slot->buffer;
+}
+
+void WsMessageAssembler::drop(uint32_t client) {
+    Slot* slot = find(client);
+    if (slot) {
+        slot->client = 0;
+    }
+}
+
+// True if b is made obsolete by a
+static bool ws_command_supersedes(const WsCommand& a, const WsCommand& b) {
+    return a.type == b.type && (!ws_command_is_request(a.type) || a.client == b.client) &&
+           (a.type != WS_CMD_SET_REPORT_POLICY || a.report.metric == b.report.metric);
+}
+
+WsCommandQueue::WsCommandQueue() : count(0) {
+    mutex = memory_create_mutex();
+    available = memory_create_counting_semaphore(WS_COMMAND_QUEUE_DEPTH, 0);
+}
+
+bool WsCommandQueue::push(const WsCommand& command, const WsWiFiLogin* login) {
+    bool queued = true;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t index = 0;
+    while (index < count && !ws_command_supersedes(command, commands[index])) {
+        index++;
+    }
+    if (index < count) {
+        // Same number of commands, the semaphore stays as it is
+        memmove(&commands[index], &commands[index + 1], (count - index - 1) * sizeof(WsCommand));
+        commands[count - 1] = command;
+        metric_ws_commands_coalesced.inc();
+    } else if (count < WS_COMMAND_QUEUE_DEPTH) {
+        commands[count++] = command;
+        xSemaphoreGive(available);
+    } else {
+        queued = false;
+    }
+    if (queued && command.type == WS_CMD_CONNECT) {
+        this->login = *login;
+    }
+    xSemaphoreGive(mutex);
+    return queued;
+}
+
+bool WsCommandQueue::pop(WsCommand& command, WsWiFiLogin& login, TickType_t ticks) {
+    if (xSemaphoreTake(available, ticks) != pdTRUE) {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    command = commands[0];
+    count--;
+    memmove(&commands[0], &commands[1], count * sizeof(WsCommand));
+    if (command.type == WS_CMD_CONNECT) {
+        login = this->login;
+    }
+    xSemaphoreGive(mutex);
+    return true;
+}
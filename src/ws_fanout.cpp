@@ -0,0 +1,199 @@
+#include "ws_fanout.h"
+#include "memory_budget.h"
+#include "heap_monitor.h"
+
+WsFanout::WsFanout(AsyncWebSocket* ws) : ws(ws), clientCount(0) {
+    mutex = memory_create_mutex();
+    memset(frames, 0, sizeof(frames));
+}
+
+WsFanout::Client* WsFanout::find(uint32_t id) {
+    for (size_t i = 0; i < clientCount; i++) {
+        if (clients[i].id == id) {
+            return &clients[i];
+        }
+    }
+    return nullptr;
+}
+
+void WsFanout::addClient(uint32_t id) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (find(id) == nullptr) {
+        if (clientCount < WS_FANOUT_MAX_CLIENTS) {
+            Client& client = clients[clientCount++];
+            client.id = id;
+            client.count = 0;
+            client.sensors = 0;
+            client.lastDrained = millis();
+            client.evicted = false;
+        } else {
+            AsyncWebSocketClient* socket = ws->client(id);
+            if (socket) {
+                socket->close();
+            }
+        }
+    }
+    xSemaphoreGive(mutex);
+}
+
+void WsFanout::removeClient(uint32_t id) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Client* client = find(id);
+    if (client) {
+        while (client->count > 0) {
+            remove(*client, 0);
+        }
+        *client = clients[--clientCount];
+    }
+    xSemaphoreGive(mutex);
+}
+
+WsFanout::Frame* WsFanout::makeFrame(const char* message, size_t len, WsFrameClass frameClass) {
+    for (Frame& frame : frames) {
+        if (frame.buffer == nullptr) {
+            frame.buffer = ws->makeBuffer((const uint8_t*)message, len);
+            if (frame.buffer == nullptr) {
+                return nullptr;
+            }
+            heap_site_alloc(HEAP_SITE_WS_FRAME, len);
+            // The library frees unlocked buffers that are in no client queue
+            frame.buffer->lock();
+            frame.refs = 0;
+            frame.frameClass = frameClass;
+            return &frame;
+        }
+    }
+    return nullptr;
+}
+
+void WsFanout::release(Frame* frame) {
+    if (--frame->refs == 0) {
+        frame->buffer->unlock();
+        frame->buffer = nullptr;
+    }
+}
+
+void WsFanout::remove(Client& client, size_t index) {
+    Frame* frame = client.queue[index];
+    if (frame->frameClass == WS_FRAME_SENSOR) {
+        client.sensors--;
+    }
+    memmove(&client.queue[index], &client.queue[index + 1], (client.count - index - 1) * sizeof(Frame*));
+    client.count--;
+    release(frame);
+}
+
+void WsFanout::push(Client& client, Frame* frame) {
+    if (client.evicted) {
+        return;
+    }
+    bool full = client.count == WS_FANOUT_QUEUE_DEPTH ||
+                (frame->frameClass == WS_FRAME_SENSOR && client.sensors == WS_FANOUT_SENSOR_DEPTH);
+    if (full) {
+        if (client.sensors == 0) {
+            // Full of control frames, a new sensor frame can go, a control frame cannot
+            if (frame->frameClass == WS_FRAME_CONTROL) {
+                evict(client);
+                return;
+            }
+            metric_ws_frames_dropped.inc();
+            return;
+        }
+        for (size_t i = 0; i < client.count; i++) {
+            if (client.queue[i]->frameClass == WS_FRAME_SENSOR) {
+                remove(client, i);
+                break;
+            }
+        }
+        metric_ws_frames_dropped.inc();
+    }
+    client.queue[client.count++] = frame;
+    if (frame->frameClass == WS_FRAME_SENSOR) {
+        client.sensors++;
+    }
+    frame->refs++;
+}
+
+void WsFanout::pumpClient(Client& client, uint32_t now) {
+    if (client.evicted) {
+        return;
+    }
+    AsyncWebSocketClient* socket = ws->client(client.id);
+    if (socket == nullptr) {
+        return;
+    }
+    while (client.count > 0 && socket->queueLen() < WS_FANOUT_IN_FLIGHT) {
+        socket->text(client.queue[0]->buffer);
+        remove(client, 0);
+    }
+    if (client.count == 0 && socket->queueLen() == 0) {
+        client.lastDrained = now;
+    } else if (now - client.lastDrained > WS_FANOUT_EVICT_MS) {
+        evict(client);
+    }
+}
+
+void WsFanout::evict(Client& client) {
+    client.evicted = true;
+    while (client.count > 0) {
+        remove(client, 0);
+    }
+    metric_ws_evictions.inc();
+    // The entry goes with the disconnect event
+    AsyncWebSocketClient* socket = ws->client(client.id);
+    if (socket) {
+        socket->close();
+    }
+}
+
+void WsFanout::broadcast(const char* message, size_t len, WsFrameClass frameClass) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Frame* frame = clientCount ? makeFrame(message, len, frameClass) : nullptr;
+    if (frame) {
+        frame->refs = 1;    // Kept until every client had its turn
+        uint32_t now = millis();
+        for (size_t i = 0; i < clientCount; i++) {
+            push(clients[i], frame);
+            pumpClient(clients[i], now);
+        }
+        release(frame);
+    }
+    xSemaphoreGive(mutex);
+}
+
+void WsFanout::send(uint32_t id, const char* message, size_t len, WsFrameClass frameClass) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Client* client = find(id);
+    Frame* frame = client && !client->evicted ? makeFrame(message, len, frameClass) : nullptr;
+    if (frame) {
+        frame->refs = 1;
+        push(*client, frame);
+        pumpClient(*client, millis());
+        release(frame);
+    }
+    xSemaphoreGive(mutex);
+}
+
+void WsFanout::pump() {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t now = millis();
+    for (size_t i = 0; i < clientCount; i++) {
+        pumpClient(clients[i], now);
+    }
+    xSemaphoreGive(mutex);
+}
+
+bool WsFanout::drained() {
+    bool empty = true;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (size_t i = 0; i < clientCount && empty; i++) {
+        if (clients[i].count > 0) {
+            empty = false;
+        } else {
+            AsyncWebSocketClient* socket = ws->client(clients[i].id);
+            empty = socket == nullptr || socket->queueLen() == 0;
+        }
+    }
+    xSemaphoreGive(mutex);
+    return empty;
+}
@@ -0,0 +1,49 @@
+#include "ws_message.h"
+#include "heap_monitor.h"
+
+WsMessage::WsMessage(char* buffer, size_t capacity) : text(buffer), capacity(capacity), len(0), onHeap(false) {
+    text[0] = '\0';
+}
+
+WsMessage::~WsMessage() {
+    if (onHeap) {
+        free(text);
+    }
+}
+
+// Room for size more bytes and the terminator, false if the heap has none either
+bool WsMessage::reserve(size_t size) {
+    if (len + size < capacity) {
+        return true;
+    }
+    size_t grown = capacity * 2;
+    while (len + size >= grown) {
+        grown *= 2;
+    }
+    char* moved = (char*)(onHeap ? realloc(text, grown) : malloc(grown));
+    if (moved == nullptr) {
+        return false;
+    }
+    if (!onHeap) {
+        memcpy(moved, text, len + 1);
+    }
+    heap_site_alloc(HEAP_SITE_WS_MESSAGE_OVERFLOW, grown);
+    text = moved;
+    capacity = grown;
+    onHeap = true;
+    return true;
+}
+
+size_t WsMessage::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t WsMessage::write(const uint8_t* data, size_t size) {
+    if (!reserve(size)) {
+        return 0;
+    }
+    memcpy(text + len, data, size);
+    len += size;
+    text[len] = '\0';
+    return size;
+}
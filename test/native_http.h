@@ -0,0 +1,134 @@
+#ifndef __TEST_NATIVE_HTTP_H__
+#define __TEST_NATIVE_HTTP_H__
+
+// HTTP client of the host tests that run the firmware's web server (env:native). One request per
+// connection, the native server answers everything with Connection: close. Records the bytes on
+// the wire and the time to the first and the last byte.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <ctype.h>
+#include <map>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HttpResponse {
+    int status = 0;
+    std::map<std::string, std::string> headers;   // Names in lower case
+    std::string body;                             // Without the chunk framing
+    size_t wireBytes = 0;                         // Head and body as received
+    double firstByteUs = 0;
+    double totalUs = 0;
+
+    bool has(const char* name) const { return headers.count(name) > 0; }
+    std::string header(const char* name) const {
+        auto it = headers.find(name);
+        return it == headers.end() ? std::string() : it->second;
+    }
+};
+
+static int http_connect(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The server task starts after setup() returned
+static bool http_wait_for_server(uint16_t port, int timeoutMs = 5000) {
+    for (int waited = 0; waited < timeoutMs; waited += 10) {
+        int fd = http_connect(port);
+        if (fd >= 0) {
+            close(fd);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static std::string http_unchunk(const std::string& data) {
+    std::string body;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t lineEnd = data.find("\r\n", pos);
+        if (lineEnd == std::string::npos) {
+            break;
+        }
+        size_t size = strtoul(data.substr(pos, lineEnd - pos).c_str(), nullptr, 16);
+        if (size == 0) {
+            break;
+        }
+        body += data.substr(lineEnd + 2, size);
+        pos = lineEnd + 2 + size + 2;
+    }
+    return body;
+}
+
+// extraHeaders are complete lines without the line break, e.g. "If-None-Match: \"...\""
+static HttpResponse http_get(uint16_t port, const std::string& path, const std::vector<std::string>& extraHeaders = {}) {
+    HttpResponse response;
+    int fd = http_connect(port);
+    if (fd < 0) {
+        return response;
+    }
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept-Encoding: gzip\r\n";
+    for (const std::string& header : extraHeaders) {
+        request += header + "\r\n";
+    }
+    request += "\r\n";
+
+    const auto start = std::chrono::steady_clock::now();
+    send(fd, request.data(), request.size(), 0);
+    std::string data;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        if (data.empty()) {
+            response.firstByteUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+        data.append(buffer, n);
+    }
+    response.totalUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    close(fd);
+
+    response.wireBytes = data.size();
+    size_t headEnd = data.find("\r\n\r\n");
+    if (headEnd == std::string::npos || data.compare(0, 9, "HTTP/1.1 ") != 0) {
+        return response;
+    }
+    response.status = atoi(data.c_str() + 9);
+    size_t line = data.find("\r\n") + 2;
+    while (line < headEnd) {
+        size_t lineEnd = data.find("\r\n", line);
+        size_t colon = data.find(':', line);
+        if (colon < lineEnd) {
+            std::string name = data.substr(line, colon - line);
+            for (char& c : name) {
+                c = (char)tolower(c);
+            }
+            size_t value = data.find_first_not_of(' ', colon + 1);
+            response.headers[name] = data.substr(value, lineEnd - value);
+        }
+        line = lineEnd + 2;
+    }
+    response.body = data.substr(headEnd + 4);
+    if (response.header("transfer-encoding") == "chunked") {
+        response.body = http_unchunk(response.body);
+    }
+    return response;
+}
+
+#endif
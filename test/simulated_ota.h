@@ -0,0 +1,275 @@
+#ifndef __TEST_SIMULATED_OTA_H__
+#define __TEST_SIMULATED_OTA_H__
+
+// Drives the ThingsBoard OTA_Handler on a virtual clock, for the tests of the chunk window and of
+// resuming. The MQTT side is a simulated broker that answers each chunk request after a round trip
+// time and can lose requests, the flash side an updater that writes into RAM and the checkpoints
+// go into a store in RAM. The handler's
+// Callback_Watchdog is defined here instead of in lib/ThingsBoard, it fires when the virtual clock
+// reaches its timeout.
+
+// Constants.h first, like ThingsBoard.h does, it provides snprintf_P without PROGMEM
+#include <Constants.h>
+#include <OTA_Handler.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static uint64_t sim_now_us = 0;
+static const uint64_t SIM_NO_DEADLINE = UINT64_MAX;
+static uint64_t sim_watchdog_deadline = SIM_NO_DEADLINE;
+static std::function<void(void)> sim_watchdog_callback;
+
+Callback_Watchdog::Callback_Watchdog(std::function<void(void)> callback) :
+    m_callback(callback),
+    m_oneshot_timer(nullptr)
+{
+    sim_watchdog_callback = callback;
+}
+
+Callback_Watchdog::~Callback_Watchdog() {
+    sim_watchdog_deadline = SIM_NO_DEADLINE;
+    sim_watchdog_callback = nullptr;
+}
+
+void Callback_Watchdog::once(const int& timeout_microseconds) {
+    sim_watchdog_deadline = sim_now_us + timeout_microseconds;
+}
+
+void Callback_Watchdog::detach() {
+    sim_watchdog_deadline = SIM_NO_DEADLINE;
+}
+
+struct Sim_Logger {
+    static void log(const char* message) {
+        if (getenv("OTA_TEST_LOG")) {
+            printf("[%8.3f s] %s\n", sim_now_us / 1e6, message);
+        }
+    }
+};
+
+// Deterministic, so a failing run can be repeated
+static uint32_t sim_random(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static std::vector<uint8_t> sim_firmware(size_t size, uint32_t seed) {
+    std::vector<uint8_t> firmware(size);
+    for (uint8_t& value : firmware) {
+        value = (uint8_t)sim_random(seed);
+    }
+    return firmware;
+}
+
+static std::string sim_sha256(const std::vector<uint8_t>& data) {
+    HashGenerator hash;
+    hash.start(MBEDTLS_MD_SHA256);
+    hash.update(data.data(), data.size());
+    return hash.get_hash_string();
+}
+
+// Keeps the written bytes like a flash partition, which survives an interrupted update
+class Memory_Updater : public IUpdater {
+  public:
+    std::vector<uint8_t> flash;
+    size_t fail_write_at = SIZE_MAX;    // Offset of a write that fails once
+    bool fail_read = false;
+    size_t begins = 0;
+    size_t resumes = 0;
+    size_t read_bytes = 0;
+
+    bool begin(const size_t& firmware_size) override {
+        m_size = firmware_size;
+        flash.clear();
+        begins++;
+        return true;
+    }
+
+    bool resume(const size_t& firmware_size, const size_t& offset) override {
+        if (offset > flash.size()) {
+            return false;
+        }
+        m_size = firmware_size;
+        flash.resize(offset);
+        resumes++;
+        return true;
+    }
+
+    size_t read(const size_t& offset, uint8_t* payload, const size_t& total_bytes) override {
+        if (fail_read || offset + total_bytes > flash.size()) {
+            return 0U;
+        }
+        memcpy(payload, flash.data() + offset, total_bytes);
+        read_bytes += total_bytes;
+        return total_bytes;
+    }
+
+    size_t write(uint8_t* payload, const size_t& total_bytes) override {
+        if (flash.size() >= fail_write_at) {
+            fail_write_at = SIZE_MAX;
+            return 0U;
+        }
+        flash.insert(flash.end(), payload, payload + total_bytes);
+        return total_bytes;
+    }
+
+    void reset() override {
+        // Like esp_ota_abort() the written bytes stay in the partition, begin() overwrites them
+    }
+
+    bool end() override {
+        return flash.size() == m_size;
+    }
+
+  protected:
+    size_t m_size = 0;
+};
+
+// Keeps the checkpoint in RAM, which survives an interrupted update as long as the store does
+class Memory_Checkpoint_Store : public IOTA_Checkpoint_Store {
+  public:
+    bool saved = false;
+    OTA_Checkpoint checkpoint;
+    size_t saves = 0;
+
+    bool save(const OTA_Checkpoint& value) override {
+        checkpoint = value;
+        saved = true;
+        saves++;
+        return true;
+    }
+
+    bool load(OTA_Checkpoint& value) override {
+        if (!saved) {
+            return false;
+        }
+        value = checkpoint;
+        return true;
+    }
+
+    void clear() override {
+        saved = false;
+    }
+};
+
+// Answers chunk requests with the firmware after rtt_us plus up to jitter_us, every request is
+// lost with the probability loss, and the chunks in lose_once lose their first request
+class Simulated_Broker {
+  public:
+    uint64_t rtt_us = 100000;
+    uint64_t jitter_us = 0;
+    double loss = 0;
+    uint32_t seed = 1;
+    std::set<size_t> lose_once;
+
+    std::vector<size_t> requests;       // Every requested chunk, in order
+    size_t lost = 0;
+    size_t delivered_bytes = 0;
+
+    Simulated_Broker(const std::vector<uint8_t>& firmware, size_t chunk_size) :
+        m_firmware(firmware),
+        m_chunk_size(chunk_size)
+    {
+    }
+
+    bool request(const size_t& chunk) {
+        requests.push_back(chunk);
+        if (lose_once.erase(chunk) > 0 || (loss > 0 && (sim_random(seed) % 10000) < loss * 10000)) {
+            lost++;
+            return true;
+        }
+        uint64_t delay = rtt_us + (jitter_us > 0 ? sim_random(seed) % jitter_us : 0);
+        m_in_flight.insert(std::make_pair(sim_now_us + delay, chunk));
+        return true;
+    }
+
+    size_t requests_of(size_t chunk) const {
+        size_t count = 0;
+        for (size_t requested : requests) {
+            count += requested == chunk;
+        }
+        return count;
+    }
+
+    // Delivers responses and fires the watchdog in time order until done() or nothing is pending,
+    // returns false if it stopped because nothing was pending
+    template<typename Handler, typename Done>
+    bool run(Handler& handler, Done done, uint64_t limit_us = 3600ULL * 1000000ULL) {
+        while (!done()) {
+            uint64_t next_response = m_in_flight.empty() ? SIM_NO_DEADLINE : m_in_flight.begin()->first;
+            if (next_response == SIM_NO_DEADLINE && sim_watchdog_deadline == SIM_NO_DEADLINE) {
+                return false;
+            }
+            if (next_response <= sim_watchdog_deadline) {
+                sim_now_us = next_response;
+                size_t chunk = m_in_flight.begin()->second;
+                m_in_flight.erase(m_in_flight.begin());
+                size_t offset = chunk * m_chunk_size;
+                size_t size = offset < m_firmware.size() ? std::min(m_chunk_size, m_firmware.size() - offset) : 0;
+                std::vector<uint8_t> payload(m_firmware.begin() + offset, m_firmware.begin() + offset + size);
+                delivered_bytes += size;
+                handler.Process_Firmware_Packet(chunk, payload.data(), payload.size());
+            } else {
+                sim_now_us = sim_watchdog_deadline;
+                sim_watchdog_deadline = SIM_NO_DEADLINE;
+                sim_watchdog_callback();
+            }
+            if (sim_now_us > limit_us) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Responses still on the way, e.g. to throw away when the device restarts
+    void drop_in_flight() {
+        m_in_flight.clear();
+    }
+
+  private:
+    const std::vector<uint8_t>& m_firmware;
+    size_t m_chunk_size;
+    std::multimap<uint64_t, size_t> m_in_flight;
+};
+
+// One download through OTA_Handler, from Start_Firmware_Update() to the end callback
+struct Simulated_Update {
+    Memory_Updater& updater;
+    Simulated_Broker broker;
+    OTA_Update_Callback callback;
+    OTA_Handler<Sim_Logger> handler;
+    bool finished = false;
+    bool success = false;
+    std::vector<std::string> states;
+
+    Simulated_Update(const std::vector<uint8_t>& firmware, Memory_Updater& memory_updater, uint16_t chunk_size, uint8_t window) :
+        updater(memory_updater),
+        broker(firmware, chunk_size),
+        callback([this](const bool& result) { success = result; }, "firmware", "1.0.0", &memory_updater, 12U, chunk_size, 1000000U, window),
+        handler([this](const size_t& chunk) { return broker.request(chunk); },
+                [this](const char* state, const char*) { states.push_back(state); return true; },
+                [this]() { finished = true; return true; })
+    {
+    }
+
+    // Only sends the first requests, run() the broker to continue
+    void begin(const std::vector<uint8_t>& firmware) {
+        sim_now_us = 0;
+        handler.Start_Firmware_Update(&callback, firmware.size(), "SHA256", sim_sha256(firmware), MBEDTLS_MD_SHA256);
+    }
+
+    bool start(const std::vector<uint8_t>& firmware) {
+        begin(firmware);
+        return broker.run(handler, [this]() { return finished; });
+    }
+};
+
+#endif
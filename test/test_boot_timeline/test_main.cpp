@@ -0,0 +1,273 @@
+// Boot timeline (src/boot_timeline.cpp) and the startup order of setup() on the virtual clock. The
+// jobs of the sensors and the LCD are stepped by a scheduler with the rules of JobExecutor::run,
+// next to the config load of setup() and the first-publish check of WiFiConfigServer::loop, so
+// every stage lands at a time that follows from the sequencing alone. The old order, a DHT read
+// right at boot and then one per interval, is run on the same simulated sensor for comparison.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <DHT.h>
+#include <LittleFS.h>
+#include <StreamString.h>
+#include <WiFi.h>
+#include "boot_timeline.h"
+#include "config_store.h"
+#include "native_board.h"
+#include "sensor_channel.h"
+#include "task_check_info.h"
+#include "task_lcd.h"
+#include "task_light_sensor.h"
+#include "task_read_dht11.h"
+#include "webserver_wifi_config.h"
+
+#include <map>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// How long the simulated DHT11 stays silent after power-on, longer than DHT_WARMUP_MS so the
+// first read fails and is retried
+static const uint32_t SENSOR_WARMUP_MS = 2500;
+// Time the LittleFS mount takes on the device
+static const uint32_t MOUNT_MS = 40;
+
+struct StageTimes {
+    int64_t start;      // -1 for null
+    int64_t end;
+};
+
+// The timeline of /boot, by stage name
+static std::map<std::string, StageTimes> timeline() {
+    StreamString text;
+    for (size_t item = 0; boot_timeline_write(text, item); item++) {
+    }
+    DynamicJsonDocument doc(4096);
+    TEST_ASSERT_TRUE(deserializeJson(doc, text.c_str()) == DeserializationError::Ok);
+    std::map<std::string, StageTimes> stages;
+    for (JsonObject stage : doc["stages"].as<JsonArray>()) {
+        stages[stage["name"].as<const char*>()] = { stage["start_us"].isNull() ? -1 : stage["start_us"].as<int64_t>(),
+                                                    stage["end_us"].isNull() ? -1 : stage["end_us"].as<int64_t>() };
+    }
+    return stages;
+}
+
+// Steps due jobs in the order they were added, like JobExecutor::run, and moves the virtual clock
+// to the next due time in between
+class VirtualJobs {
+public:
+    void add(JobStep step) {
+        jobs.push_back({ step, 0, false });
+    }
+
+    void runUntil(uint64_t endUs) {
+        while (true) {
+            uint64_t next = UINT64_MAX;
+            for (Job& job : jobs) {
+                if (!job.done && job.due <= native_clock_us()) {
+                    const JobWait wait = job.step(nullptr);
+                    job.done = wait.kind == JobWait::JOB_WAIT_DONE;
+                    job.due = native_clock_us() + (uint64_t)wait.timeoutMs * 1000;
+                }
+                if (!job.done) {
+                    next = std::min(next, job.due);
+                }
+            }
+            if (next > endUs) {
+                return;
+            }
+            if (next > native_clock_us()) {
+                native_clock_set_us(next);
+            }
+        }
+    }
+
+private:
+    struct Job {
+        JobStep step;
+        uint64_t due;
+        bool done;
+    };
+    std::vector<Job> jobs;
+};
+
+enum SetupState { SETUP_MOUNT, SETUP_CONFIG };
+
+// The part of setup() after the jobs are started: the config load, of which the mount takes time
+static JobWait setup_step(void* arg) {
+    static SetupState state = SETUP_MOUNT;
+    if (state == SETUP_MOUNT) {
+        boot_stage_begin(BOOT_CONFIG);
+        state = SETUP_CONFIG;
+        return JobWait::delay(MOUNT_MS);
+    }
+    check_info_File(0);
+    boot_stage_end(BOOT_CONFIG);
+    boot_stage_end(BOOT_SETUP);
+    return JobWait::done();
+}
+
+static SensorSnapshot sensors;
+
+// The first-publish check of WiFiConfigServer::loop
+static JobWait web_server_step(void* arg) {
+    const bool dhtReady = boot_stage_done(BOOT_FIRST_DHT);
+    sensor_channel_drain(sensors);
+    if (dhtReady && !boot_stage_done(BOOT_FIRST_PUBLISH)) {
+        TEST_ASSERT_FALSE(isnan(sensors.temperature));
+        TEST_ASSERT_TRUE(sensors.temperature > 0);
+        boot_mark(BOOT_FIRST_PUBLISH);
+    }
+    return JobWait::delay(WEB_SERVER_LOOP_MS);
+}
+
+static uint64_t us_of(int64_t ms) {
+    return (uint64_t)ms * 1000;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// First, the stages only record their first start and end
+void test_startup_sequence(void) {
+    native_clock_set_us(0);
+    boot_stage_begin(BOOT_SETUP);
+    VirtualJobs jobs;
+    // In the order of setup()
+    jobs.add(temp_humi_job);
+    jobs.add(light_sensor_job);
+    jobs.add(lcd_job);
+    jobs.add(setup_step);
+    jobs.add(web_server_step);
+    jobs.runUntil(us_of(20000));
+
+    std::map<std::string, StageTimes> stages = timeline();
+    // The sensors and the LCD start at once, while LittleFS is mounted
+    TEST_ASSERT_EQUAL_INT64(0, stages["lcd"].end);
+    TEST_ASSERT_EQUAL_INT64(0, stages["first_light"].end);
+    TEST_ASSERT_EQUAL_INT64(0, stages["dht_warmup"].start);
+    TEST_ASSERT_EQUAL_INT64(0, stages["config"].start);
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(MOUNT_MS), stages["config"].end);
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(MOUNT_MS), stages["setup"].end);
+    // The first read waits for the warm-up of the DHT11, then failed reads are retried sooner
+    // than the read interval
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(DHT_WARMUP_MS), stages["dht_warmup"].end);
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(DHT_WARMUP_MS), stages["first_dht"].start);
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(DHT_WARMUP_MS + DHT_BOOT_RETRY_MS), stages["first_dht"].end);
+    // Published on the next pass of the web server loop, not after SENSOR_BROADCAST_INTERVAL_MS
+    const int64_t firstPublish = stages["first_publish"].end;
+    TEST_ASSERT_TRUE(firstPublish >= stages["first_dht"].end);
+    TEST_ASSERT_TRUE(firstPublish < stages["first_dht"].end + (int64_t)us_of(WEB_SERVER_LOOP_MS));
+    TEST_ASSERT_EQUAL_INT64(firstPublish, stages["first_publish"].start);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, firstPublish / 1e6f, metric_boot_first_publish.value());
+    // The web server and WiFi stages are not part of this run
+    TEST_ASSERT_EQUAL_INT64(-1, stages["web_server"].start);
+    TEST_ASSERT_EQUAL_INT64(-1, stages["wifi"].end);
+    TEST_ASSERT_EQUAL_INT64(-1, stages["wifi"].start);
+
+    // The old order on the same sensor: a read right at boot, then one per interval
+    DHT legacy(3, DHT11);
+    legacy.begin();
+    uint64_t legacyFirst = 0;
+    for (uint64_t us = 0; us < us_of(60000); us += us_of(DHT_READ_INTERVAL_MS)) {
+        native_clock_set_us(us);
+        if (!isnan(legacy.readTemperature())) {
+            legacyFirst = us;
+            break;
+        }
+    }
+    printf("stage           start ms    end ms\n");
+    for (const auto& stage : stages) {
+        if (stage.second.end >= 0) {
+            printf("%-14s %9.1f %9.1f\n", stage.first.c_str(), stage.second.start / 1000.0, stage.second.end / 1000.0);
+        }
+    }
+    printf("first valid DHT reading: %.1f ms, %.1f ms with a read per interval from boot\n",
+           stages["first_dht"].end / 1000.0, legacyFirst / 1000.0);
+    TEST_ASSERT_TRUE(legacyFirst > (uint64_t)stages["first_dht"].end);
+}
+
+void test_stages_are_recorded_once(void) {
+    std::map<std::string, StageTimes> before = timeline();
+    native_clock_set_us(us_of(30000));
+    // Started or ended again, by another task or a later pass: the first times stay
+    boot_stage_begin(BOOT_LCD);
+    boot_stage_end(BOOT_LCD);
+    boot_mark(BOOT_FIRST_PUBLISH);
+    std::map<std::string, StageTimes> after = timeline();
+    TEST_ASSERT_EQUAL_INT64(before["lcd"].start, after["lcd"].start);
+    TEST_ASSERT_EQUAL_INT64(before["lcd"].end, after["lcd"].end);
+    TEST_ASSERT_EQUAL_INT64(before["first_publish"].end, after["first_publish"].end);
+
+    // Begun: a start and a null end until it ends
+    TEST_ASSERT_FALSE(boot_stage_done(BOOT_WIFI));
+    boot_stage_begin(BOOT_WIFI);
+    after = timeline();
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(30000), after["wifi"].start);
+    TEST_ASSERT_EQUAL_INT64(-1, after["wifi"].end);
+    native_clock_advance_us(us_of(850));
+    boot_stage_end(BOOT_WIFI);
+    TEST_ASSERT_TRUE(boot_stage_done(BOOT_WIFI));
+    after = timeline();
+    TEST_ASSERT_EQUAL_INT64((int64_t)us_of(30850), after["wifi"].end);
+
+    // Ended without a start: both at the end
+    boot_stage_end(BOOT_WEB_SERVER);
+    after = timeline();
+    TEST_ASSERT_EQUAL_INT64(after["web_server"].end, after["web_server"].start);
+}
+
+void test_cached_access_point_skips_the_scan(void) {
+    // The login the config load of the startup found
+    TEST_ASSERT_TRUE(config_set_wifi("native-lab", "secret"));
+    native_clock_set_us(us_of(40000));
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
+    uint32_t start = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        native_clock_advance_us(us_of(10));
+    }
+    const uint32_t scanned = millis() - start;
+    TEST_ASSERT_TRUE(config_set_wifi_cache(WiFi.channel(), WiFi.BSSID()));
+
+    // The next boot goes to the channel and BSSID of the last connect
+    DeviceConfig config;
+    config_get(config);
+    TEST_ASSERT_EQUAL_UINT8(WiFi.channel(), config.wifiChannel);
+    WiFi.disconnect();
+    WiFi.begin(config.wifiSsid, config.wifiPassword, config.wifiChannel, config.wifiBssid);
+    start = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        native_clock_advance_us(us_of(10));
+    }
+    const uint32_t cached = millis() - start;
+    printf("association: %u ms with a scan, %u ms to the cached access point\n", scanned, cached);
+    TEST_ASSERT_EQUAL_UINT32(2500U + 800U, scanned);
+    TEST_ASSERT_EQUAL_UINT32(800U, cached);
+
+    // Another login drops the cache, it belongs to the old access point
+    TEST_ASSERT_TRUE(config_set_wifi("native-guest", "guest"));
+    config_get(config);
+    TEST_ASSERT_EQUAL_UINT8(0, config.wifiChannel);
+}
+
+int main(int argc, char** argv) {
+    char directory[] = "/tmp/boot_timeline_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", (root + "/nvs").c_str(), 1);
+    setenv("NATIVE_FS_ROOT", (root + "/fs").c_str(), 1);
+    setenv("NATIVE_SIM_DROPOUT", "0", 1);
+    setenv("NATIVE_SIM_DHT_WARMUP_MS", std::to_string(SENSOR_WARMUP_MS).c_str(), 1);
+    setenv("NATIVE_WIFI_ASSOC_MS", "800", 1);
+    setenv("NATIVE_WIFI_SCAN_MS", "2500", 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_startup_sequence);
+    RUN_TEST(test_stages_are_recorded_once);
+    RUN_TEST(test_cached_access_point_skips_the_scan);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    return failures;
+}
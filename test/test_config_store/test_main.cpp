@@ -0,0 +1,255 @@
+// Config store (src/config_store.cpp) on the LittleFS and Preferences shims: the old /info.dat and
+// the web server's login are moved into /config.bin, damaged or newer files are ignored, and a
+// change reaches the listeners of its part only. The benchmarks compare the load with the 4 KB
+// JSON document of Load_info_File, and measure on the virtual clock how long the station is
+// offline after a config change, where the device used to restart.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include "config_store.h"
+#include "global.h"
+#include "metrics.h"
+#include "native_board.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static const char* const LEGACY_JSON =
+    "{\"WIFI_SSID\":\"native-guest\",\"WIFI_PASS\":\"old secret\",\"CORE_IOT_TOKEN\":\"token-1234\","
+    "\"CORE_IOT_SERVER\":\"app.coreiot.io\",\"CORE_IOT_PORT\":\"1883\"}";
+
+static void write_file(const char* path, const void* data, size_t len) {
+    File file = LittleFS.open(path, "w");
+    TEST_ASSERT_TRUE((bool)file);
+    TEST_ASSERT_EQUAL_size_t(len, file.write((const uint8_t*)data, len));
+    file.close();
+}
+
+static std::vector<uint8_t> read_file(const char* path) {
+    File file = LittleFS.open(path, "r");
+    std::vector<uint8_t> data(file ? file.size() : 0);
+    if (file) {
+        file.read(data.data(), data.size());
+        file.close();
+    }
+    return data;
+}
+
+// Load_info_File before the config store: a 4 KB document and strdup'ed copies
+static void legacy_load(char** copies) {
+    File file = LittleFS.open(CONFIG_LEGACY_PATH, "r");
+    TEST_ASSERT_TRUE((bool)file);
+    DynamicJsonDocument doc(4096);
+    TEST_ASSERT_TRUE(deserializeJson(doc, file) == DeserializationError::Ok);
+    copies[0] = strdup(doc["WIFI_SSID"]);
+    copies[1] = strdup(doc["WIFI_PASS"]);
+    copies[2] = strdup(doc["CORE_IOT_TOKEN"]);
+    copies[3] = strdup(doc["CORE_IOT_SERVER"]);
+    copies[4] = strdup(doc["CORE_IOT_PORT"]);
+    file.close();
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static int wifiChanges = 0;
+static int coreIotChanges = 0;
+
+// Joins a new login like the web server's listener, through the cached access point if known
+static void wifi_listener(uint8_t changed, const DeviceConfig& config, void* arg) {
+    (void)arg;
+    if (!(changed & CONFIG_WIFI)) {
+        return;
+    }
+    wifiChanges++;
+    WiFi.disconnect();
+    if (config.wifiSsid[0]) {
+        WiFi.begin(config.wifiSsid, config.wifiPassword);
+    }
+}
+
+static void core_iot_listener(uint8_t changed, const DeviceConfig& config, void* arg) {
+    (void)config;
+    (void)arg;
+    coreIotChanges += (changed & CONFIG_CORE_IOT) != 0;
+}
+
+// Virtual milliseconds until the station is connected to ssid
+static uint32_t ms_until_connected(const char* ssid) {
+    const uint32_t start = millis();
+    while (!(WiFi.status() == WL_CONNECTED && WiFi.SSID() == ssid)) {
+        TEST_ASSERT_LESS_THAN_UINT32(60000U, millis() - start);
+        native_clock_advance_us(10000ULL);
+    }
+    return millis() - start;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_migrates_the_old_files(void) {
+    TEST_ASSERT_TRUE(LittleFS.begin(true));
+    write_file(CONFIG_LEGACY_PATH, LEGACY_JSON, strlen(LEGACY_JSON));
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("wifi-config"));
+    preferences.putString("ssid", "native-lab");
+    preferences.putString("password", "new secret");
+    preferences.end();
+
+    TEST_ASSERT_TRUE(config_begin());
+    DeviceConfig config;
+    config_get(config);
+    // The login the web server connected with wins over /info.dat
+    TEST_ASSERT_EQUAL_STRING("native-lab", config.wifiSsid);
+    TEST_ASSERT_EQUAL_STRING("new secret", config.wifiPassword);
+    TEST_ASSERT_EQUAL_STRING("token-1234", config.coreIotToken);
+    TEST_ASSERT_EQUAL_UINT16(1883, config.coreIotPort);
+    TEST_ASSERT_EQUAL_STRING("native-lab", WIFI_SSID);
+    TEST_ASSERT_EQUAL_UINT16(1883, CORE_IOT_PORT);
+    TEST_ASSERT_TRUE(LittleFS.exists(CONFIG_PATH));
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_LEGACY_PATH));
+    TEST_ASSERT_TRUE(preferences.begin("wifi-config", true));
+    TEST_ASSERT_FALSE(preferences.isKey("ssid"));
+    preferences.end();
+
+    // The next boot reads the file
+    TEST_ASSERT_TRUE(config_begin());
+    config_get(config);
+    TEST_ASSERT_EQUAL_STRING("native-lab", config.wifiSsid);
+}
+
+void test_damaged_and_newer_files_are_ignored(void) {
+    const std::vector<uint8_t> good = read_file(CONFIG_PATH);
+    TEST_ASSERT_GREATER_THAN_size_t(sizeof(DeviceConfig), good.size());
+    DeviceConfig config;
+
+    // A flipped bit fails the CRC
+    std::vector<uint8_t> damaged = good;
+    damaged[20] ^= 0x01;
+    write_file(CONFIG_PATH, damaged.data(), damaged.size());
+    TEST_ASSERT_TRUE(config_begin());
+    config_get(config);
+    TEST_ASSERT_EQUAL_STRING("", config.wifiSsid);
+
+    // Cut short, as by a reset while writing without the rename
+    write_file(CONFIG_PATH, good.data(), good.size() / 2);
+    TEST_ASSERT_TRUE(config_begin());
+    config_get(config);
+    TEST_ASSERT_EQUAL_STRING("", config.wifiSsid);
+
+    // Written by a newer firmware that was rolled back
+    std::vector<uint8_t> newer = good;
+    newer[4] = CONFIG_VERSION + 1;
+    write_file(CONFIG_PATH, newer.data(), newer.size());
+    TEST_ASSERT_TRUE(config_begin());
+    config_get(config);
+    TEST_ASSERT_EQUAL_STRING("", config.wifiSsid);
+
+    write_file(CONFIG_PATH, good.data(), good.size());
+    TEST_ASSERT_TRUE(config_begin());
+    config_get(config);
+    TEST_ASSERT_EQUAL_STRING("native-lab", config.wifiSsid);
+}
+
+void test_load_time(void) {
+    write_file(CONFIG_LEGACY_PATH, LEGACY_JSON, strlen(LEGACY_JSON));
+    const int rounds = 100;
+    std::vector<double> legacy;
+    std::vector<double> store;
+    for (int i = 0; i < rounds; i++) {
+        char* copies[5];
+        auto start = std::chrono::steady_clock::now();
+        legacy_load(copies);
+        legacy.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        for (char* copy : copies) {
+            free(copy);
+        }
+        start = std::chrono::steady_clock::now();
+        config_begin();
+        store.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    LittleFS.remove(CONFIG_LEGACY_PATH);
+    printf("load, median of %d     us\n", rounds);
+    printf("/info.dat, 4 KB JSON %6.1f\n", median(legacy));
+    printf("/config.bin          %6.1f\n", median(store));
+    // Both are dominated by opening the file, the binary load must not be the slower one
+    TEST_ASSERT_LESS_THAN_DOUBLE(median(legacy) * 1.5, median(store));
+}
+
+void test_downtime_per_change(void) {
+    config_listen(CONFIG_WIFI, wifi_listener, nullptr);
+    config_listen(CONFIG_CORE_IOT, core_iot_listener, nullptr);
+    native_clock_set_us(10000000ULL);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
+    const uint32_t boot = ms_until_connected("native-lab");
+
+    // A new login: only the association, nothing else restarts
+    const uint64_t writes = metric_config_writes.value();
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(config_set_wifi("native-guest", "guest secret"));
+    const double applyUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    const uint32_t wifiDowntime = ms_until_connected("native-guest");
+    TEST_ASSERT_EQUAL_INT(1, wifiChanges);
+    TEST_ASSERT_EQUAL_INT(0, coreIotChanges);
+    TEST_ASSERT_EQUAL_STRING("native-guest", WIFI_SSID);
+
+    // A CoreIOT change leaves the station connected
+    DeviceConfig config;
+    config_get(config);
+    strlcpy(config.coreIotToken, "token-5678", sizeof(config.coreIotToken));
+    TEST_ASSERT_TRUE(config_set(config));
+    TEST_ASSERT_EQUAL_INT(1, wifiChanges);
+    TEST_ASSERT_EQUAL_INT(1, coreIotChanges);
+    TEST_ASSERT_EQUAL_INT(WL_CONNECTED, WiFi.status());
+
+    // The same config again is neither written nor announced
+    TEST_ASSERT_TRUE(config_set(config));
+    TEST_ASSERT_TRUE(config_set_wifi("native-guest", "guest secret"));
+    TEST_ASSERT_EQUAL_UINT64(2U, metric_config_writes.value() - writes);
+    TEST_ASSERT_EQUAL_INT(1, wifiChanges);
+    TEST_ASSERT_EQUAL_INT(1, coreIotChanges);
+
+    // Forgetting the login disconnects
+    TEST_ASSERT_TRUE(config_clear());
+    TEST_ASSERT_EQUAL_INT(2, wifiChanges);
+    TEST_ASSERT_FALSE(WiFi.status() == WL_CONNECTED);
+    TEST_ASSERT_FALSE(LittleFS.exists(CONFIG_TMP_PATH));
+
+    printf("offline after a change          ms\n");
+    printf("boot connect (scan + assoc) %6u\n", boot);
+    printf("WiFi login                  %6u\n", wifiDowntime);
+    printf("CoreIOT connection          %6u\n", 0U);
+    printf("write and listeners: %.1f us\n", applyUs);
+    // The association and the scan of the simulated access point, nothing of a boot
+    TEST_ASSERT_UINT32_WITHIN(20U, 3500U, wifiDowntime);
+}
+
+int main(int argc, char** argv) {
+    char directory[] = "/tmp/config_store_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", (root + "/nvs").c_str(), 1);
+    setenv("NATIVE_FS_ROOT", (root + "/fs").c_str(), 1);
+    setenv("NATIVE_WIFI_ASSOC_MS", "1500", 1);
+    setenv("NATIVE_WIFI_SCAN_MS", "2000", 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_migrates_the_old_files);
+    RUN_TEST(test_damaged_and_newer_files_are_ignored);
+    RUN_TEST(test_load_time);
+    RUN_TEST(test_downtime_per_change);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    return failures;
+}
@@ -0,0 +1,253 @@
+// Deferred logger (src/deferred_log.cpp): records stored by the calling task and formatted by the
+// drain task must read like the printf they replace, also after the raw frames went through
+// scripts/decode_log.py (needs python3 or python, that part is ignored without it). The benchmark
+// compares the cost of a call with printf into /dev/null.
+#include <unity.h>
+#include <Arduino.h>
+#include "deferred_log.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string python;
+
+static std::string temp_path(const char* name) {
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/deferred_log_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static std::string read_file(const std::string& path) {
+    std::string data;
+    FILE* file = fopen(path.c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, read);
+    }
+    fclose(file);
+    return data;
+}
+
+// Serial writes to stdout, everything the drain task writes while body runs is returned
+static std::string capture_serial(const std::function<void()>& body) {
+    const std::string path = temp_path("serial.bin");
+    fflush(stdout);
+    const int saved = dup(STDOUT_FILENO);
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    body();
+    // Long enough for the drain task to come around twice
+    delay(LOG_DRAIN_INTERVAL_MS * 3);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    const std::string data = read_file(path);
+    remove(path.c_str());
+    return data;
+}
+
+static std::vector<std::string> lines_of(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    size_t end;
+    while ((end = text.find('\n', start)) != std::string::npos) {
+        lines.push_back(text.substr(start, end - start - (end > start && text[end - 1] == '\r')));
+        start = end + 1;
+    }
+    return lines;
+}
+
+// The message without the "[time] L " (and for decode_log.py "task: ") prefix
+static std::string message_of(const std::string& line, bool withTask = false) {
+    size_t start = line.find("] ");
+    TEST_ASSERT_TRUE_MESSAGE(start != std::string::npos, line.c_str());
+    start += 4;
+    if (withTask) {
+        start = line.find(": ", start) + 2;
+    }
+    return line.substr(start);
+}
+
+static std::string printf_string(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return text;
+}
+
+// The messages of the round trip and what printf makes of them
+static void log_samples() {
+    LOG(DHT_READ_FAILED);
+    LOG(DHT_READING, 45.5f, 23.25f, 1234, "ON");
+    LOG(LED_STATE, String("OFF"));
+    LOG(LIGHT_DARK, -7);
+    LOG(BOOT_STAGE, "a stage name longer than LOG_MAX_STRING bytes", 1.25f, 1234.5f);
+}
+
+static std::vector<std::string> expected_samples() {
+    return {
+        printf_string("Failed to read from DHT sensor!"),
+        printf_string("Humidity: %.2f%%  Temperature: %.2f°C  Light: %d  LED: %s", 45.5, 23.25, 1234, "ON"),
+        printf_string("LED %s", "OFF"),
+        printf_string("Dark detected (light: %d) - LED turned ON", -7),
+        printf_string("Boot stage %s: %.1f ms to %.1f ms", std::string("a stage name longer than LOG_MAX_STRING bytes", LOG_MAX_STRING).c_str(), 1.25, 1234.5),
+    };
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_full_ring_drops_and_reports(void) {
+    // Before the drain task runs: the ring of this task fills up and the rest is dropped
+    const uint64_t droppedBefore = metric_log_dropped.value();
+    for (int i = 0; i < 100; i++) {
+        LOG(LIGHT_BRIGHT, i);
+    }
+    const uint64_t dropped = metric_log_dropped.value() - droppedBefore;
+    const size_t recordSize = 7U + 4U;
+    TEST_ASSERT_EQUAL_UINT64(100U - LOG_RING_SIZE / recordSize, dropped);
+
+    const std::vector<std::string> lines = lines_of(capture_serial([]() { log_begin(); }));
+    TEST_ASSERT_EQUAL_size_t(LOG_RING_SIZE / recordSize + 1U, lines.size());
+    const std::string report = lines[0];
+    const std::string expected = "[log] " + std::to_string(dropped) + " messages of task loopTask dropped";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), report.c_str());
+    // The oldest ones were kept, in order
+    for (size_t i = 1; i < lines.size(); i++) {
+        const std::string message = message_of(lines[i]);
+        const std::string printed = printf_string("Light detected (light: %d) - LED turned OFF", (int)i - 1);
+        TEST_ASSERT_EQUAL_STRING(printed.c_str(), message.c_str());
+    }
+}
+
+void test_text_reads_like_printf(void) {
+    const std::vector<std::string> lines = lines_of(capture_serial(log_samples));
+    const std::vector<std::string> expected = expected_samples();
+    TEST_ASSERT_EQUAL_size_t(expected.size(), lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        const std::string message = message_of(lines[i]);
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), message.c_str());
+    }
+    const std::string warning = lines[0].substr(lines[0].find("] ") + 2, 1);
+    TEST_ASSERT_EQUAL_STRING("W", warning.c_str());
+}
+
+void test_disabled_levels_are_not_stored(void) {
+    const std::string output = capture_serial([]() {
+        LOG(LIGHT_LEVEL, 100, "ON");
+        log_set_level(LOG_LEVEL_DEBUG);
+        LOG(LIGHT_LEVEL, 200, "OFF");
+        log_set_level(LOG_LEVEL_ERROR);
+        LOG(LED_STATE, "ON");
+        log_set_level(LOG_LEVEL_INFO);
+    });
+    const std::vector<std::string> lines = lines_of(output);
+    TEST_ASSERT_EQUAL_size_t(1U, lines.size());
+    const std::string message = message_of(lines[0]);
+    TEST_ASSERT_EQUAL_STRING("Light level: 200, LED: OFF", message.c_str());
+}
+
+void test_raw_frames_decode_like_printf(void) {
+    if (python.empty()) {
+        TEST_IGNORE_MESSAGE("python is needed to run decode_log.py");
+    }
+    const std::string raw = capture_serial([]() {
+        log_set_raw(true);
+        log_samples();
+    });
+    log_set_raw(false);
+    const std::string capture = temp_path("capture.bin");
+    const std::string decoded = temp_path("decoded.txt");
+    FILE* file = fopen(capture.c_str(), "wb");
+    fwrite(raw.data(), 1, raw.size(), file);
+    fclose(file);
+    std::string file_name = __FILE__;
+    const std::string script = file_name.substr(0, file_name.find_last_of('/') + 1) + "../../scripts/decode_log.py";
+    const std::string command = python + " \"" + script + "\" \"" + capture + "\" > \"" + decoded + "\"";
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, system(command.c_str()), command.c_str());
+
+    const std::vector<std::string> lines = lines_of(read_file(decoded));
+    remove(capture.c_str());
+    remove(decoded.c_str());
+    const std::vector<std::string> expected = expected_samples();
+    TEST_ASSERT_EQUAL_size_t(expected.size(), lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        TEST_ASSERT_TRUE_MESSAGE(lines[i].find(" loopTask: ") != std::string::npos, lines[i].c_str());
+        const std::string message = message_of(lines[i], true);
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), message.c_str());
+    }
+}
+
+void test_call_cost_benchmark(void) {
+    FILE* null = fopen("/dev/null", "w");
+    TEST_ASSERT_NOT_NULL(null);
+    const int batches = 100;
+    // A batch fits into the ring (22 byte records), the drain task empties it in between
+    const int perBatch = LOG_RING_SIZE / 32;
+    double disabledNs = 0;
+    double enabledNs = 0;
+    double printfNs = 0;
+    const uint64_t droppedBefore = metric_log_dropped.value();
+
+    capture_serial([&]() {
+        for (int batch = 0; batch < batches; batch++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < perBatch; i++) {
+                LOG(LIGHT_LEVEL, i, "ON");
+            }
+            disabledNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < perBatch; i++) {
+                LOG(DHT_READING, 45.5f, 23.25f, i, "ON");
+            }
+            enabledNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < perBatch; i++) {
+                fprintf(null, "Humidity: %.2f%%  Temperature: %.2f°C  Light: %d  LED: %s\n", 45.5, 23.25, i, "ON");
+            }
+            fflush(null);
+            printfNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+            delay(LOG_DRAIN_INTERVAL_MS + 10);
+        }
+    });
+    fclose(null);
+
+    const double calls = (double)batches * perBatch;
+    printf("per call: disabled %.1f ns, enabled %.1f ns, printf into /dev/null %.1f ns\n",
+           disabledNs / calls, enabledNs / calls, printfNs / calls);
+    TEST_ASSERT_EQUAL_UINT64(0U, metric_log_dropped.value() - droppedBefore);
+    TEST_ASSERT_LESS_THAN_DOUBLE(printfNs, enabledNs);
+    TEST_ASSERT_LESS_THAN_DOUBLE(enabledNs, disabledNs);
+}
+
+int main(int argc, char** argv) {
+    if (system("python3 --version > /dev/null 2>&1") == 0) {
+        python = "python3";
+    } else if (system("python --version > /dev/null 2>&1") == 0) {
+        python = "python";
+    }
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_ring_drops_and_reports);
+    RUN_TEST(test_text_reads_like_printf);
+    RUN_TEST(test_disabled_levels_are_not_stored);
+    RUN_TEST(test_raw_frames_decode_like_printf);
+    RUN_TEST(test_call_cost_benchmark);
+    return UNITY_END();
+}
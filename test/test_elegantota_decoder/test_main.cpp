@@ -0,0 +1,290 @@
+// Streaming decoder of compressed and delta encoded ElegantOTA images (lib/ElegantOTA-master/src/
+// ElegantOTADecoder.cpp) against the images elegantota_pack.py generates. Needs python3 or python
+// on the host, the tests are ignored without it.
+#include <unity.h>
+#include <ElegantOTADecoder.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static const size_t FIRMWARE_SIZE = 256U * 1024U;
+
+static std::string python;
+
+static uint32_t next_random(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Looks like a firmware image to the encoder: repeated instruction sequences, random constants
+// and zero padding
+static Bytes make_firmware(size_t size, uint32_t seed) {
+    Bytes firmware;
+    while (firmware.size() < size) {
+        const uint32_t kind = next_random(seed) % 10U;
+        if (kind < 5U) {
+            uint8_t pattern[16];
+            for (uint8_t& value : pattern) {
+                value = (uint8_t)next_random(seed);
+            }
+            for (uint32_t repeat = next_random(seed) % 8U + 1U; repeat > 0; repeat--) {
+                firmware.insert(firmware.end(), pattern, pattern + sizeof(pattern));
+            }
+        } else if (kind < 8U) {
+            for (uint32_t count = next_random(seed) % 285U + 16U; count > 0; count--) {
+                firmware.push_back((uint8_t)next_random(seed));
+            }
+        } else {
+            firmware.insert(firmware.end(), next_random(seed) % 497U + 16U, 0U);
+        }
+    }
+    firmware.resize(size);
+    return firmware;
+}
+
+// The next build of the same firmware: a few functions changed, some code moved
+static Bytes change_firmware(const Bytes& base, uint32_t seed) {
+    Bytes firmware = base;
+    for (int edit = 0; edit < 8; edit++) {
+        const size_t offset = next_random(seed) % (firmware.size() - 200U);
+        if (edit % 2 == 0) {
+            for (size_t i = 0; i < 50U; i++) {
+                firmware[offset + i] = (uint8_t)next_random(seed);
+            }
+        } else {
+            Bytes inserted(100U);
+            for (uint8_t& value : inserted) {
+                value = (uint8_t)next_random(seed);
+            }
+            firmware.insert(firmware.begin() + offset, inserted.begin(), inserted.end());
+        }
+    }
+    return firmware;
+}
+
+static std::string temp_path(const char* name) {
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory ? directory : "/tmp") + "/elegantota_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static void save(const std::string& path, const Bytes& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_size_t(data.size(), fwrite(data.data(), 1, data.size(), file));
+    fclose(file);
+}
+
+static Bytes load(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return data;
+}
+
+static std::string encoder_script() {
+    std::string file = __FILE__;
+    return file.substr(0, file.find_last_of('/') + 1) + "../../lib/ElegantOTA-master/elegantota_pack.py";
+}
+
+static Bytes encode(const Bytes& firmware, const Bytes* base = nullptr, int window_bits = 12) {
+    if (python.empty()) {
+        TEST_IGNORE_MESSAGE("python is needed to run elegantota_pack.py");
+    }
+    const std::string firmware_path = temp_path("firmware.bin");
+    const std::string base_path = temp_path("base.bin");
+    const std::string image_path = temp_path("image.bin");
+    save(firmware_path, firmware);
+    std::string command = python + " \"" + encoder_script() + "\" \"" + firmware_path + "\" -o \"" + image_path +
+        "\" --window-bits " + std::to_string(window_bits);
+    if (base) {
+        save(base_path, *base);
+        command += " --base \"" + base_path + "\"";
+    }
+    command += " > /dev/null";
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, system(command.c_str()), command.c_str());
+    Bytes image = load(image_path);
+    remove(firmware_path.c_str());
+    remove(base_path.c_str());
+    remove(image_path.c_str());
+    return image;
+}
+
+// Feeds the image in upload chunks of random size, so ops are split at every possible byte
+static bool decode(ElegantOTADecoder& decoder, const Bytes& image, size_t length, uint32_t seed) {
+    size_t offset = 0;
+    while (offset < length) {
+        const size_t chunk = std::min<size_t>(next_random(seed) % 1500U + 1U, length - offset);
+        if (!decoder.write(image.data() + offset, chunk)) {
+            return false;
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+static Bytes decode_image(const Bytes& image, const Bytes* base, uint32_t seed) {
+    Bytes output;
+    ElegantOTADecoder decoder;
+    const bool begun = decoder.begin([&](uint8_t* data, size_t len) {
+        output.insert(output.end(), data, data + len);
+        return len;
+    }, base == nullptr ? ElegantOTADecoder::BaseReadCallback() : [base](size_t offset, uint8_t* data, size_t len) {
+        memcpy(data, base->data() + offset, len);
+        return true;
+    });
+    TEST_ASSERT_TRUE(begun);
+    TEST_ASSERT_TRUE_MESSAGE(decode(decoder, image, image.size(), seed), decoder.errorString());
+    TEST_ASSERT_TRUE_MESSAGE(decoder.end(), decoder.errorString());
+    TEST_ASSERT_EQUAL_size_t(output.size(), decoder.decodedSize());
+    return output;
+}
+
+static double decode_mb_per_s(const Bytes& image, const Bytes* base) {
+    const int rounds = 5;
+    size_t produced = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        ElegantOTADecoder decoder;
+        decoder.begin([&](uint8_t*, size_t len) {
+            produced += len;
+            return len;
+        }, [base](size_t offset, uint8_t* data, size_t len) {
+            memcpy(data, base->data() + offset, len);
+            return true;
+        });
+        decoder.write(image.data(), image.size());
+        TEST_ASSERT_TRUE(decoder.end());
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return produced / seconds / 1e6;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_compressed_image_is_byte_exact(void) {
+    const Bytes firmware = make_firmware(FIRMWARE_SIZE, 1U);
+    for (int window_bits : { 8, 12, 15 }) {
+        const Bytes image = encode(firmware, nullptr, window_bits);
+        TEST_ASSERT_TRUE(ElegantOTADecoder::isEncoded(image.data(), image.size()));
+        TEST_ASSERT_TRUE(decode_image(image, nullptr, 3U) == firmware);
+        printf("compressed, window bits %2d: %zu -> %zu bytes (%.1f %%), decodes at %.1f MB/s\n", window_bits,
+               firmware.size(), image.size(), 100.0 * image.size() / firmware.size(), decode_mb_per_s(image, &firmware));
+    }
+}
+
+void test_delta_image_is_byte_exact(void) {
+    const Bytes base = make_firmware(FIRMWARE_SIZE, 1U);
+    const Bytes firmware = change_firmware(base, 5U);
+    const Bytes image = encode(firmware, &base);
+    TEST_ASSERT_TRUE(decode_image(image, &base, 7U) == firmware);
+    printf("delta: %zu -> %zu bytes (%.1f %%), decodes at %.1f MB/s\n", firmware.size(), image.size(),
+           100.0 * image.size() / firmware.size(), decode_mb_per_s(image, &base));
+    // Only the edits and the op headers are sent
+    TEST_ASSERT_LESS_THAN_size_t(firmware.size() / 20U, image.size());
+}
+
+void test_delta_needs_base(void) {
+    const Bytes base = make_firmware(16U * 1024U, 1U);
+    const Bytes image = encode(change_firmware(base, 5U), &base);
+    ElegantOTADecoder decoder;
+    TEST_ASSERT_TRUE(decoder.begin([](uint8_t*, size_t len) { return len; }));
+    TEST_ASSERT_FALSE(decoder.write(image.data(), image.size()));
+    TEST_ASSERT_FALSE(decoder.end());
+    TEST_ASSERT_EQUAL_STRING("Delta images are not supported for this update", decoder.errorString());
+}
+
+void test_failing_write_stops_decoding(void) {
+    const Bytes firmware = make_firmware(FIRMWARE_SIZE, 1U);
+    const Bytes image = encode(firmware);
+    for (size_t fail_at : { (size_t)0U, (size_t)ELEGANTOTA_DECODER_OUT_BUFFER, (size_t)100U * 1024U }) {
+        size_t written = 0;
+        size_t calls_after_failure = 0;
+        bool failed = false;
+        ElegantOTADecoder decoder;
+        decoder.begin([&](uint8_t*, size_t len) {
+            if (failed) {
+                calls_after_failure++;
+            }
+            if (written + len > fail_at) {
+                failed = true;
+                return (size_t)0U;
+            }
+            written += len;
+            return len;
+        });
+
+        // The remaining upload keeps arriving after the failure, none of it is written
+        TEST_ASSERT_FALSE(decode(decoder, image, image.size(), 9U));
+        TEST_ASSERT_TRUE(decoder.hasError());
+        TEST_ASSERT_FALSE(decoder.write(image.data(), image.size()));
+        TEST_ASSERT_FALSE(decoder.end());
+        TEST_ASSERT_EQUAL_STRING("Failed to write decoded data to free space", decoder.errorString());
+        TEST_ASSERT_EQUAL_size_t(0U, calls_after_failure);
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(fail_at, written);
+        TEST_ASSERT_LESS_THAN_size_t(firmware.size(), decoder.decodedSize());
+    }
+}
+
+void test_truncated_image_fails(void) {
+    const Bytes firmware = make_firmware(FIRMWARE_SIZE, 1U);
+    const Bytes image = encode(firmware);
+    for (size_t length : { (size_t)10U, ElegantOTADecoder::HEADER_SIZE, image.size() / 2U, image.size() - 1U }) {
+        Bytes output;
+        ElegantOTADecoder decoder;
+        decoder.begin([&](uint8_t* data, size_t len) {
+            output.insert(output.end(), data, data + len);
+            return len;
+        });
+        TEST_ASSERT_TRUE(decode(decoder, image, length, 11U));
+        TEST_ASSERT_FALSE(decoder.end());
+        TEST_ASSERT_EQUAL_STRING("Encoded image is truncated", decoder.errorString());
+        TEST_ASSERT_TRUE(memcmp(output.data(), firmware.data(), output.size()) == 0);
+    }
+}
+
+void test_corrupted_image_fails(void) {
+    const Bytes firmware = make_firmware(FIRMWARE_SIZE, 1U);
+    Bytes image = encode(firmware);
+    // A literal byte, the structure stays valid and only the CRC notices
+    image.at(ElegantOTADecoder::HEADER_SIZE + 1U) ^= 0x01U;
+    ElegantOTADecoder decoder;
+    decoder.begin([](uint8_t*, size_t len) { return len; });
+    TEST_ASSERT_TRUE(decode(decoder, image, image.size(), 13U));
+    TEST_ASSERT_FALSE(decoder.end());
+    TEST_ASSERT_EQUAL_STRING("Decoded image CRC mismatch (wrong base firmware?)", decoder.errorString());
+}
+
+int main(int argc, char** argv) {
+    if (system("python3 --version > /dev/null 2>&1") == 0) {
+        python = "python3";
+    } else if (system("python --version > /dev/null 2>&1") == 0) {
+        python = "python";
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_compressed_image_is_byte_exact);
+    RUN_TEST(test_delta_image_is_byte_exact);
+    RUN_TEST(test_delta_needs_base);
+    RUN_TEST(test_failing_write_stops_decoding);
+    RUN_TEST(test_truncated_image_fails);
+    RUN_TEST(test_corrupted_image_fails);
+    return UNITY_END();
+}
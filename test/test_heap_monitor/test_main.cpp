@@ -0,0 +1,271 @@
+// Heap monitor (src/heap_monitor.cpp) over a simulated week: the periodic messages of the web
+// server and the LCD text are built every second of virtual time, once the way the firmware does
+// it now (JsonArenaDocument, WsMessage in a fixed buffer, the IP printed without a String) and
+// once the way it did before (DynamicJsonDocument, serializeJson into a String, toString()). In
+// both the library holds each frame for a few seconds. The heap model of the native build
+// (native_init) gives the free heap and the largest free block.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <StreamString.h>
+#include <WiFi.h>
+#include "esp_heap_caps.h"
+#include "heap_monitor.h"
+#include "json_arena.h"
+#include "native_board.h"
+#include "webserver_wifi_config.h"
+#include "ws_message.h"
+
+#include <chrono>
+#include <deque>
+
+static const uint32_t WEEK_S = 7 * 24 * 3600;
+static const uint32_t HISTORY_POINTS = 60;
+
+// A frame the WebSocket library holds until every client has it
+struct HeldFrame {
+    void* data;
+    uint32_t releaseAt;
+};
+
+static std::deque<HeldFrame> heldFrames;
+static uint32_t randomState = 12345;
+
+static uint32_t next_random() {
+    randomState = randomState * 1103515245U + 12345U;
+    return randomState >> 16;
+}
+
+static void hold_frame(const char* text, size_t len, uint32_t now) {
+    void* frame = malloc(len);
+    memcpy(frame, text, len);
+    heap_site_alloc(HEAP_SITE_WS_FRAME, len);
+    // Slow clients take longer
+    heldFrames.push_back({ frame, now + 1 + next_random() % 4 });
+}
+
+static void release_frames(uint32_t now, bool all) {
+    while (!heldFrames.empty() && (all || heldFrames.front().releaseAt <= now)) {
+        free(heldFrames.front().data);
+        heldFrames.pop_front();
+    }
+}
+
+template <typename Document>
+static void fill_sensors(Document& doc, uint32_t second) {
+    doc["type"] = "sensors";
+    doc["temperature"] = 20.0f + (second % 100) / 10.0f;
+    doc["humidity"] = 40.0f + (second % 300) / 10.0f;
+    doc["light_level"] = (int)(second % 4096);
+    doc["led_state"] = second % 2 == 0;
+    doc["temp_alert"] = false;
+    doc["temp_threshold"] = 30.0f;
+    doc["timestamp"] = millis();
+    doc["sampled_at"] = millis() - 100;
+    doc["light_sampled_at"] = millis() - 40;
+    doc["valid"] = true;
+}
+
+template <typename Document>
+static void fill_history(Document& doc, uint32_t second) {
+    doc["type"] = "history";
+    JsonArray points = doc.createNestedArray("points");
+    for (uint32_t i = 0; i < HISTORY_POINTS; i++) {
+        JsonArray point = points.createNestedArray();
+        point.add(second - (HISTORY_POINTS - i) * 60);
+        point.add(20.0f + i / 10.0f);
+        point.add(40.0f + i / 7.0f);
+    }
+}
+
+// One second of the firmware: the sensor broadcast, the status every 5 s, the history every 60 s
+static char largeMessage[WS_MESSAGE_LARGE];
+
+static void firmware_second(uint32_t second, char* lcdLine) {
+    {
+        JsonArenaDocument doc(512);
+        fill_sensors(doc, second);
+        char buffer[WS_MESSAGE_SMALL];
+        WsMessage message(buffer, sizeof(buffer));
+        serializeJson(doc, message);
+        hold_frame(message.c_str(), message.length(), second);
+    }
+    if (second % 5 == 0) {
+        char buffer[WS_MESSAGE_SMALL];
+        WsMessage message(buffer, sizeof(buffer));
+        IPAddress address = WiFi.localIP();
+        message.printf("{\"type\":\"status\",\"ip\":\"%u.%u.%u.%u\",\"rssi\":%d,\"uptime\":%lu}", address[0], address[1],
+                       address[2], address[3], -40 - (int)(second % 30), (unsigned long)second);
+        hold_frame(message.c_str(), message.length(), second);
+        // The LCD prints the IP into its line
+        IPAddress ip = WiFi.localIP();
+        snprintf(lcdLine, 17, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    }
+    if (second % 60 == 0) {
+        JsonArenaDocument doc(JSON_ARENA_LARGE);
+        fill_history(doc, second);
+        WsMessage message(largeMessage, sizeof(largeMessage));
+        serializeJson(doc, message);
+        hold_frame(message.c_str(), message.length(), second);
+    }
+}
+
+// The same second as before the change
+static void legacy_second(uint32_t second, char* lcdLine) {
+    {
+        DynamicJsonDocument doc(1024);
+        fill_sensors(doc, second);
+        String json;
+        serializeJson(doc, json);
+        hold_frame(json.c_str(), json.length(), second);
+    }
+    if (second % 5 == 0) {
+        String json = "{\"type\":\"status\",\"ip\":\"";
+        json += WiFi.localIP().toString();
+        json += "\",\"rssi\":";
+        json += String(-40 - (int)(second % 30));
+        json += ",\"uptime\":";
+        json += String((unsigned long)second);
+        json += "}";
+        hold_frame(json.c_str(), json.length(), second);
+        String ip = WiFi.localIP().toString();
+        strlcpy(lcdLine, ip.c_str(), 17);
+    }
+    if (second % 60 == 0) {
+        DynamicJsonDocument doc(8192);
+        fill_history(doc, second);
+        String json;
+        serializeJson(doc, json);
+        hold_frame(json.c_str(), json.length(), second);
+    }
+}
+
+struct WeekResult {
+    float worstFragmentation;
+    uint32_t freeAfterDay;
+    uint32_t freeAtEnd;
+    double seconds;
+};
+
+// A week, one step per virtual second, the monitor polls like the web server loop does
+static WeekResult run_week(void (*second_of)(uint32_t, char*), uint32_t startSecond) {
+    WeekResult result = {};
+    char lcdLine[17];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < WEEK_S; i++) {
+        const uint32_t second = startSecond + i;
+        native_clock_set_us((uint64_t)second * 1000000ULL);
+        release_frames(second, false);
+        second_of(second, lcdLine);
+        heap_monitor_poll();
+        const size_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        const float fragmentation = heap_fragmentation(freeBytes, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+        // The first day is the warmup
+        if (i >= 24 * 3600) {
+            result.worstFragmentation = max(result.worstFragmentation, fragmentation);
+        }
+        if (i == 24 * 3600) {
+            result.freeAfterDay = freeBytes;
+        }
+    }
+    release_frames(0, true);
+    result.freeAtEnd = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    char expected[17];
+    IPAddress ip = WiFi.localIP();
+    snprintf(expected, sizeof(expected), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    TEST_ASSERT_EQUAL_STRING(expected, lcdLine);
+    return result;
+}
+
+static DynamicJsonDocument heap_document() {
+    StreamString text;
+    for (size_t item = 0; heap_monitor_write(text, item); item++) {
+    }
+    DynamicJsonDocument doc(65536);
+    TEST_ASSERT_TRUE(deserializeJson(doc, text.c_str()) == DeserializationError::Ok);
+    return doc;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_fragmentation_ratio(void) {
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, heap_fragmentation(0, 0));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, heap_fragmentation(100000, 100000));
+    TEST_ASSERT_EQUAL_FLOAT(0.75f, heap_fragmentation(100000, 25000));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, heap_fragmentation(100000, 0));
+}
+
+static WeekResult firmwareWeek;
+static WeekResult legacyWeek;
+
+void test_week_of_firmware_messages(void) {
+    firmwareWeek = run_week(firmware_second, 0);
+    printf("firmware week: %.1f s, worst fragmentation %.3f, free %u after a day, %u at the end\n", firmwareWeek.seconds,
+           firmwareWeek.worstFragmentation, firmwareWeek.freeAfterDay, firmwareWeek.freeAtEnd);
+    // Bounded: the limits of the soak check (heap_soak.h)
+    TEST_ASSERT_LESS_THAN_FLOAT(0.25f, firmwareWeek.worstFragmentation);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(firmwareWeek.freeAfterDay - 16 * 1024, firmwareWeek.freeAtEnd);
+
+    // The monitor has a sample per hour of the week, oldest first
+    DynamicJsonDocument doc = heap_document();
+    JsonArray samples = doc["samples"];
+    TEST_ASSERT_EQUAL_size_t(HEAP_MONITOR_SAMPLES, samples.size());
+    TEST_ASSERT_EQUAL_UINT32(HEAP_MONITOR_INTERVAL_MS / 1000, doc["interval_s"].as<uint32_t>());
+    uint32_t frameAllocs = 0;
+    for (JsonObject site : doc["sites"].as<JsonArray>()) {
+        if (strcmp(site["name"].as<const char*>(), "WS_FRAME") == 0) {
+            frameAllocs = site["allocs"];
+        }
+        // Nothing outgrew its fixed buffer or arena block
+        if (strcmp(site["name"].as<const char*>(), "WS_MESSAGE_OVERFLOW") == 0 ||
+            strcmp(site["name"].as<const char*>(), "JSON_FALLBACK") == 0) {
+            TEST_ASSERT_EQUAL_UINT32(0U, site["allocs"].as<uint32_t>());
+        }
+    }
+    // The sensors every second, the status every 5 s, the history every minute
+    TEST_ASSERT_EQUAL_UINT32(WEEK_S + WEEK_S / 5 + WEEK_S / 60, frameAllocs);
+    uint32_t previous = 0;
+    float worstSampled = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        JsonArray sample = samples[i];
+        if (i > 0) {
+            TEST_ASSERT_EQUAL_UINT32(previous + 3600, sample[0].as<uint32_t>());
+        }
+        previous = sample[0];
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(sample[1].as<uint32_t>(), sample[2].as<uint32_t>());
+        // An hour of frames and nothing else on the heap, the last hour is still being counted
+        if (i + 1 < samples.size()) {
+            TEST_ASSERT_EQUAL_UINT32(3600 + 720 + 60, sample[4].as<uint32_t>());
+        }
+        worstSampled = max(worstSampled, sample[3].as<float>());
+    }
+    TEST_ASSERT_EQUAL_UINT32(WEEK_S - 3600, samples[samples.size() - 1][0].as<uint32_t>());
+    TEST_ASSERT_LESS_THAN_FLOAT(0.25f, worstSampled);
+}
+
+void test_week_of_legacy_messages(void) {
+    legacyWeek = run_week(legacy_second, WEEK_S);
+    printf("legacy week:   %.1f s, worst fragmentation %.3f, free %u after a day, %u at the end\n", legacyWeek.seconds,
+           legacyWeek.worstFragmentation, legacyWeek.freeAfterDay, legacyWeek.freeAtEnd);
+    // A sample of the second week, the window moved on by a week
+    DynamicJsonDocument doc = heap_document();
+    TEST_ASSERT_EQUAL_UINT32(WEEK_S, doc["samples"][0][0].as<uint32_t>());
+    // The Strings and documents come and go between the frames the library still holds
+    TEST_ASSERT_GREATER_THAN_FLOAT(firmwareWeek.worstFragmentation, legacyWeek.worstFragmentation);
+}
+
+int main(int argc, char** argv) {
+    // One malloc arena without thread caches, the heap model of the native build
+    native_init(argc, argv);
+    WiFi.mode(WIFI_AP);
+    WiFi.softAP("ESP32-Config", "12345678");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fragmentation_ratio);
+    RUN_TEST(test_week_of_firmware_messages);
+    RUN_TEST(test_week_of_legacy_messages);
+    return UNITY_END();
+}
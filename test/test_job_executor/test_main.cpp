@@ -0,0 +1,275 @@
+// Job executor (src/job_executor.cpp): steps run when their delay is over, a yield lets the other
+// due jobs go first, and a queue wakes the job waiting for it. The benchmark runs the same three
+// periodic features once as a task each, the design the sensor and LCD loops had, and once as
+// jobs on one worker, and compares the reserved stacks and task control blocks, the stack
+// actually used and how late each step starts.
+#include <unity.h>
+#include <Arduino.h>
+#include "job_executor.h"
+#include "memory_budget.h"
+#include "native_board.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+static int64_t now_us() {
+    return esp_timer_get_time();
+}
+
+static void busy_us(int us) {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+static void wait_ms(int ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+static double percentile(std::vector<int64_t> values, double p) {
+    std::sort(values.begin(), values.end());
+    return values.empty() ? 0 : values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+// The steps of the executor test write here, the test reads once the worker is done with them
+static std::atomic<int> periodicSteps(0);
+static int64_t periodicTimes[10];
+static std::atomic<int> yieldSteps(0);
+static std::vector<int> order;
+static std::atomic<int> received(0);
+static std::atomic<int> timeouts(0);
+static int64_t receivedAt[3];
+static int receivedItems[3];
+
+static JobWait periodic_job(void* arg) {
+    const int step = periodicSteps;
+    periodicTimes[step] = now_us();
+    periodicSteps++;
+    return step + 1 < 10 ? JobWait::delay(5) : JobWait::done();
+}
+
+// Yields three times, the other due jobs of the pass run before each next step
+static JobWait yield_job(void* arg) {
+    order.push_back((int)(intptr_t)arg);
+    return ++yieldSteps < 3 ? JobWait::yield() : JobWait::done();
+}
+
+static JobWait marker_job(void* arg) {
+    order.push_back((int)(intptr_t)arg);
+    return yieldSteps < 3 ? JobWait::yield() : JobWait::done();
+}
+
+static JobQueue* itemQueue;
+
+static JobWait queue_job(void* arg) {
+    int item;
+    if (itemQueue->receive(&item)) {
+        const int index = received;
+        receivedItems[index] = item;
+        receivedAt[index] = now_us();
+        received++;
+    } else if (received > 0) {
+        timeouts++;
+    }
+    return timeouts > 0 ? JobWait::done() : JobWait::receive(*itemQueue, 50);
+}
+
+static JobWait noop_job(void* arg) {
+    return JobWait::done();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_steps_and_waits(void) {
+    static JobExecutor executor;
+    static JobQueue queue(executor, 4, sizeof(int));
+    itemQueue = &queue;
+    TEST_ASSERT_TRUE(executor.add("periodic", periodic_job));
+    TEST_ASSERT_TRUE(executor.add("yield", yield_job, (void*)1));
+    TEST_ASSERT_TRUE(executor.add("marker", marker_job, (void*)2));
+    TEST_ASSERT_TRUE(executor.add("queue", queue_job));
+    executor.start("Jobs", MEMORY_STACK_JOBS, 2);
+    // Jobs are only added before the worker runs
+    TEST_ASSERT_FALSE(executor.add("late", noop_job));
+
+    // An item is received right away, the queue wakes the worker out of its wait
+    wait_ms(20);
+    int64_t sentAt[3];
+    for (int i = 0; i < 3; i++) {
+        const int item = 10 + i;
+        sentAt[i] = now_us();
+        TEST_ASSERT_TRUE(queue.send(&item));
+        wait_ms(15);
+    }
+    // Then the receive times out after 50 ms without an item
+    wait_ms(100);
+    TEST_ASSERT_EQUAL_INT(3, received.load());
+    TEST_ASSERT_EQUAL_INT(1, timeouts.load());
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(10 + i, receivedItems[i]);
+        TEST_ASSERT_LESS_THAN(5000, (int)(receivedAt[i] - sentAt[i]));
+    }
+
+    // A delay is never cut short
+    TEST_ASSERT_EQUAL_INT(10, periodicSteps.load());
+    for (int i = 1; i < 10; i++) {
+        TEST_ASSERT_GREATER_OR_EQUAL(5000, (int)(periodicTimes[i] - periodicTimes[i - 1]));
+    }
+    // The yielding job and the marker take turns
+    const std::vector<int> expected = { 1, 2, 1, 2, 1, 2 };
+    TEST_ASSERT_EQUAL_size_t(expected.size(), order.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL_INT(expected[i], order[i]);
+    }
+
+    JobExecutor full;
+    for (int i = 0; i < JOB_MAX_JOBS; i++) {
+        TEST_ASSERT_TRUE(full.add("job", noop_job));
+    }
+    TEST_ASSERT_FALSE(full.add("one too many", noop_job));
+}
+
+// A sensor read or LCD refresh: some stack for its locals and some time on the bus
+struct Feature {
+    const char* name;
+    uint32_t periodMs;
+    size_t stackBytes;
+    int workUs;
+    int64_t expected;
+    std::vector<int64_t> lateness;
+};
+
+static Feature FEATURES[] = {
+    { "dht", 10, 480, 300, 0, {} },
+    { "light", 7, 160, 60, 0, {} },
+    { "lcd", 13, 320, 500, 0, {} },
+};
+static const size_t FEATURE_COUNT = sizeof(FEATURES) / sizeof(FEATURES[0]);
+
+// Read back from the stack of each step, so the compiler keeps it
+static volatile uint8_t stackSink;
+
+static void feature_step(Feature& feature) {
+    const int64_t start = now_us();
+    if (feature.expected != 0) {
+        feature.lateness.push_back(start - feature.expected);
+    }
+    volatile uint8_t locals[512];
+    const size_t stackBytes = min(feature.stackBytes, sizeof(locals));
+    for (size_t i = 0; i < stackBytes; i++) {
+        locals[i] = (uint8_t)i;
+    }
+    stackSink = locals[stackBytes - 1];
+    busy_us(feature.workUs);
+    // The next step is due a period after this one ended, in both designs
+    feature.expected = now_us() + feature.periodMs * 1000;
+}
+
+static std::atomic<bool> tasksRunning(true);
+static std::atomic<int> tasksStopped(0);
+
+// The loop each feature had as its own task
+static void feature_task(void* arg) {
+    Feature& feature = *(Feature*)arg;
+    while (tasksRunning) {
+        feature_step(feature);
+        vTaskDelay(pdMS_TO_TICKS(feature.periodMs));
+    }
+    tasksStopped++;
+    vTaskDelete(NULL);
+}
+
+static std::atomic<bool> jobsRunning(true);
+
+static JobWait feature_job(void* arg) {
+    Feature& feature = *(Feature*)arg;
+    if (!jobsRunning) {
+        return JobWait::done();
+    }
+    feature_step(feature);
+    return JobWait::delay(feature.periodMs);
+}
+
+static void reset_features() {
+    for (Feature& feature : FEATURES) {
+        feature.expected = 0;
+        feature.lateness.clear();
+    }
+}
+
+static void print_lateness(const char* design) {
+    for (Feature& feature : FEATURES) {
+        printf("%-6s %-6s %5zu %9.0f %9.0f %9.0f\n", design, feature.name, feature.lateness.size(),
+               percentile(feature.lateness, 0.5), percentile(feature.lateness, 0.99), percentile(feature.lateness, 1.0));
+    }
+}
+
+void test_footprint_and_latency_against_tasks(void) {
+    const int runMs = 3000;
+    // A task per feature, with the 2048 byte stacks the sensor and LCD tasks had
+    const size_t taskStack = 2048;
+    reset_features();
+    TaskHandle_t tasks[FEATURE_COUNT];
+    for (size_t i = 0; i < FEATURE_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(pdPASS, xTaskCreatePinnedToCore(feature_task, FEATURES[i].name, taskStack, &FEATURES[i], 2, &tasks[i], 1));
+    }
+    wait_ms(runMs);
+    size_t tasksUsed = 0;
+    for (TaskHandle_t task : tasks) {
+        tasksUsed += taskStack - uxTaskGetStackHighWaterMark(task);
+    }
+    printf("design feature steps   late p50 us   p99 us    max us\n");
+    print_lateness("tasks");
+    std::vector<int64_t> taskLateness;
+    for (Feature& feature : FEATURES) {
+        taskLateness.insert(taskLateness.end(), feature.lateness.begin(), feature.lateness.end());
+    }
+    tasksRunning = false;
+    while (tasksStopped < (int)FEATURE_COUNT) {
+        wait_ms(10);
+    }
+
+    // The same features as jobs on one worker
+    reset_features();
+    static JobExecutor executor;
+    for (Feature& feature : FEATURES) {
+        TEST_ASSERT_TRUE(executor.add(feature.name, feature_job, &feature));
+    }
+    executor.start("Jobs", MEMORY_STACK_JOBS, 2, 1);
+    wait_ms(runMs);
+    const size_t jobsUsed = MEMORY_BYTES(STACK_JOBS) - uxTaskGetStackHighWaterMark(executor.task());
+    print_lateness("jobs");
+    std::vector<int64_t> jobLateness;
+    for (Feature& feature : FEATURES) {
+        jobLateness.insert(jobLateness.end(), feature.lateness.begin(), feature.lateness.end());
+    }
+    jobsRunning = false;
+    wait_ms(50);
+
+    const size_t tasksReserved = FEATURE_COUNT * (taskStack + sizeof(StaticTask_t));
+    const size_t jobsReserved = MEMORY_BYTES(STACK_JOBS) + sizeof(StaticTask_t);
+    // Host frames are larger, the shim scales the host stack down by the factor it enlarged it by
+    printf("        stacks + TCBs reserved   stack used (scaled host)\n");
+    printf("tasks   %22zu %12zu\n", tasksReserved, tasksUsed);
+    printf("jobs    %22zu %12zu\n", jobsReserved, jobsUsed);
+    TEST_ASSERT_LESS_THAN_size_t(tasksReserved, jobsReserved);
+    // One stack as deep as the deepest step, not one per feature
+    TEST_ASSERT_LESS_THAN_size_t(tasksUsed, jobsUsed);
+    // Steps wait for each other and for the wait rounded up to a tick, a shared host adds its
+    // own scheduling on top
+    TEST_ASSERT_LESS_THAN_DOUBLE(percentile(taskLateness, 0.5) + 2000.0, percentile(jobLateness, 0.5));
+    TEST_ASSERT_LESS_THAN_DOUBLE(percentile(taskLateness, 0.99) + 5000.0, percentile(jobLateness, 0.99));
+}
+
+int main(int argc, char** argv) {
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_steps_and_waits);
+    RUN_TEST(test_footprint_and_latency_against_tasks);
+    return UNITY_END();
+}
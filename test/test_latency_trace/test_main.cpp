@@ -0,0 +1,223 @@
+// Latency tracing (src/latency_trace.cpp): readings taken by the sensor jobs and broadcast the way
+// WiFiConfigServer::sendSensorData does must show up in /trace with all five stages in order, the
+// ring must hand out only whole spans while tasks keep recording, and a stage must cost less than
+// a microsecond to record.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <StreamString.h>
+#include "latency_trace.h"
+#include "native_board.h"
+#include "sensor_channel.h"
+#include "task_light_sensor.h"
+#include "task_read_dht11.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+
+struct ExportedSpan {
+    uint32_t id;
+    int source;
+    int stage;
+    uint64_t start;
+    uint32_t duration;
+};
+
+// The spans of /trace, in ring order
+static std::vector<ExportedSpan> exported() {
+    StreamString text;
+    TraceJsonWriter writer;
+    for (size_t item = 0; writer.write(text, item); item++) {
+    }
+    DynamicJsonDocument doc(256 * 1024);
+    TEST_ASSERT_TRUE(deserializeJson(doc, text.c_str()) == DeserializationError::Ok);
+    std::vector<ExportedSpan> spans;
+    for (JsonObject event : doc["traceEvents"].as<JsonArray>()) {
+        const std::string phase = event["ph"].as<const char*>();
+        if (phase == "X") {
+            spans.push_back({ event["args"]["trace"].as<uint32_t>(), event["pid"].as<int>() - 1, event["tid"].as<int>(),
+                              event["ts"].as<uint64_t>(), event["dur"].as<uint32_t>() });
+        }
+    }
+    return spans;
+}
+
+static uint64_t latency_count(MetricHistogram& histogram) {
+    uint32_t counts[METRICS_HISTOGRAM_BUCKETS + 1];
+    return histogram.snapshot(counts);
+}
+
+// The web server side of one broadcast, each stage taking some time of the virtual clock
+static void broadcast(SensorSnapshot& snapshot) {
+    sensor_channel_drain(snapshot);
+    TraceMessage trace;
+    const uint64_t encodeStart = trace_now();
+    native_clock_advance_us(150);
+    const uint64_t enqueueStart = trace_now();
+    trace.span(TRACE_JSON_ENCODE, encodeStart, enqueueStart);
+    native_clock_advance_us(40);
+    const uint64_t enqueueEnd = trace_now();
+    trace.span(TRACE_WS_ENQUEUE, enqueueStart, enqueueEnd);
+    trace.enqueued(enqueueEnd);
+    // Clients still have frames queued on the first pass of the loop
+    native_clock_advance_us(100000);
+    trace_poll_sent(false);
+    native_clock_advance_us(100000);
+    trace_poll_sent(true);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_broadcast_readings_have_every_stage(void) {
+    native_clock_set_us(5000000ULL);
+    const uint64_t dhtBefore = latency_count(metric_sensor_latency_dht);
+    const uint64_t lightBefore = latency_count(metric_sensor_latency_light);
+    SensorSnapshot snapshot = {};
+    std::set<uint32_t> replaced;
+    const int rounds = 20;
+    for (int round = 0; round < rounds; round++) {
+        // Every fourth round a second reading replaces the first before the broadcast
+        const int reads = round % 4 == 3 ? 2 : 1;
+        for (int read = 0; read < reads; read++) {
+            temp_humi_job(nullptr);
+            native_clock_advance_us(300);
+            light_sensor_job(nullptr);
+            native_clock_advance_us(300);
+        }
+        broadcast(snapshot);
+    }
+    // A message without a reading carries no trace
+    const size_t before = exported().size();
+    broadcast(snapshot);
+    TEST_ASSERT_EQUAL_size_t(before, exported().size());
+
+    std::map<uint32_t, std::vector<ExportedSpan>> traces;
+    for (const ExportedSpan& span : exported()) {
+        traces[span.id].push_back(span);
+    }
+    TEST_ASSERT_EQUAL_size_t(2U * (rounds + rounds / 4), traces.size());
+    int complete = 0;
+    int ended = 0;
+    for (const auto& trace : traces) {
+        const std::vector<ExportedSpan>& spans = trace.second;
+        // Recorded in the order of the stages, each starting where the previous one ended
+        for (size_t i = 0; i < spans.size(); i++) {
+            TEST_ASSERT_EQUAL_INT((int)i, spans[i].stage);
+            TEST_ASSERT_EQUAL_INT(spans[0].source, spans[i].source);
+            if (i > 0) {
+                TEST_ASSERT_TRUE(spans[i].start >= spans[i - 1].start + spans[i - 1].duration);
+            }
+        }
+        if (spans.size() == TRACE_STAGE_COUNT) {
+            complete++;
+            TEST_ASSERT_EQUAL_UINT32(150U, spans[TRACE_JSON_ENCODE].duration);
+            TEST_ASSERT_EQUAL_UINT32(40U, spans[TRACE_WS_ENQUEUE].duration);
+            TEST_ASSERT_EQUAL_UINT32(200000U, spans[TRACE_NET_SEND].duration);
+        } else {
+            // Replaced before a message went out
+            TEST_ASSERT_EQUAL_size_t(2U, spans.size());
+            ended++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(2 * rounds, complete);
+    TEST_ASSERT_EQUAL_INT(2 * (rounds / 4), ended);
+    // Every carried reading also went into the end to end histogram
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)rounds, latency_count(metric_sensor_latency_dht) - dhtBefore);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)rounds, latency_count(metric_sensor_latency_light) - lightBefore);
+}
+
+void test_ring_keeps_the_newest_spans(void) {
+    for (uint32_t id = 1; id <= TRACE_BUFFER_SPANS + 44; id++) {
+        trace_span(1000000U + id, TRACE_SOURCE_LIGHT, TRACE_SENSOR_READ, id, id + 1);
+    }
+    const std::vector<ExportedSpan> spans = exported();
+    TEST_ASSERT_EQUAL_size_t(TRACE_BUFFER_SPANS, spans.size());
+    for (size_t i = 0; i < spans.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(1000000U + 45U + i, spans[i].id);
+    }
+}
+
+// Every field of a span follows from its id, so a torn copy shows
+static ExportedSpan span_for(uint32_t id) {
+    return { id, (int)(id % TRACE_SOURCE_COUNT), (int)(id % TRACE_STAGE_COUNT), (uint64_t)id * 3U, id % 1000U };
+}
+
+static std::atomic<int> writersDone(0);
+
+static void writer_task(void* parameter) {
+    const uint32_t first = (uint32_t)(uintptr_t)parameter;
+    for (uint32_t id = first; id < first + 200000U; id++) {
+        const ExportedSpan span = span_for(id);
+        trace_span(id, (TraceSource)span.source, (TraceStage)span.stage, span.start, span.start + span.duration);
+    }
+    writersDone++;
+    vTaskDelete(NULL);
+}
+
+void test_export_while_tasks_record(void) {
+    xTaskCreatePinnedToCore(writer_task, "writer0", 4096, (void*)(uintptr_t)10000000U, 1, NULL, 0);
+    xTaskCreatePinnedToCore(writer_task, "writer1", 4096, (void*)(uintptr_t)20000000U, 1, NULL, 1);
+    int exports = 0;
+    size_t spans = 0;
+    do {
+        for (const ExportedSpan& span : exported()) {
+            if (span.id < 10000000U) {
+                continue;
+            }
+            const ExportedSpan expected = span_for(span.id);
+            TEST_ASSERT_EQUAL_INT(expected.source, span.source);
+            TEST_ASSERT_EQUAL_INT(expected.stage, span.stage);
+            TEST_ASSERT_EQUAL_UINT64(expected.start, span.start);
+            TEST_ASSERT_EQUAL_UINT32(expected.duration, span.duration);
+            spans++;
+        }
+        exports++;
+    } while (writersDone < 2);
+    printf("%d exports with %zu spans while recording\n", exports, spans);
+}
+
+void test_overhead_per_stage(void) {
+    const int rounds = 1000000;
+    uint32_t id = trace_begin();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        // Both timestamps and the span, as at every stage of the firmware
+        const uint64_t stageStart = trace_now();
+        trace_span(id, TRACE_SOURCE_DHT, TRACE_JSON_ENCODE, stageStart, trace_now());
+    }
+    const double spanNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+    // A message carrying both sensors records each stage twice
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        trace_publish(TRACE_SOURCE_DHT, id, 0, trace_now());
+        trace_publish(TRACE_SOURCE_LIGHT, id, 0, trace_now());
+        TraceMessage trace;
+        const uint64_t encodeStart = trace_now();
+        trace.span(TRACE_JSON_ENCODE, encodeStart, trace_now());
+        trace.enqueued(trace_now());
+        trace_poll_sent(true);
+    }
+    const double messageNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    printf("per stage: %.1f ns, publish + encode + enqueue + sent of two readings: %.1f ns (%.1f ns per stage)\n",
+           spanNs, messageNs, messageNs / 6);
+    TEST_ASSERT_LESS_THAN_DOUBLE(1000.0, spanNs);
+    TEST_ASSERT_LESS_THAN_DOUBLE(1000.0, messageNs / 6);
+}
+
+int main(int argc, char** argv) {
+    setenv("NATIVE_SIM_DROPOUT", "0", 1);
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_broadcast_readings_have_every_stage);
+    RUN_TEST(test_ring_keeps_the_newest_spans);
+    RUN_TEST(test_export_while_tasks_record);
+    RUN_TEST(test_overhead_per_stage);
+    return UNITY_END();
+}
@@ -0,0 +1,257 @@
+// Low-power mode (src/low_power.cpp): the state machine with its RTC state, driven on a simulated
+// sleep/wake clock. Every wake records a reading and, when an uplink is due, sends the batches
+// the way low_power_run() does. The last test runs a week with the radio times of the native
+// simulation (lib/NativeShims/src/low_power_sim.h) and compares the radio time it measured with
+// low_power_model().
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "low_power.h"
+
+#include <math.h>
+
+static const int64_t EPOCH_MS = 1767225600000LL;       // 2026-01-01
+static const uint32_t AWAKE_MS = 250;
+static const uint32_t CONNECT_MS = 1500;
+static const uint32_t SEND_MS = 100;
+static const uint32_t TIMEOUT_MS = 10000;
+
+// Zero like the RTC memory after the first power-on
+static LowPowerState state;
+
+// Every reading is reported
+static void report_every_reading(LowPowerState& target) {
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    for (ReportRule& rule : rules) {
+        rule = { 0, 0, 0 };
+    }
+    low_power_set_rules(target, rules);
+}
+
+// Sends every waiting sample, the batches are parsed into batches when given. Returns the radio time.
+static uint32_t uplink(LowPowerState& target, bool reachable, JsonArray* batches = nullptr) {
+    if (!reachable) {
+        low_power_uplink_done(target, false, TIMEOUT_MS);
+        return TIMEOUT_MS;
+    }
+    uint32_t radio = CONNECT_MS;
+    low_power_set_time(target, EPOCH_MS + (int64_t)target.clockMs + AWAKE_MS + radio, AWAKE_MS + radio);
+    char json[LOW_POWER_BATCH_JSON];
+    size_t count;
+    while ((count = low_power_batch_json(target, json, sizeof(json))) > 0) {
+        if (batches) {
+            DynamicJsonDocument doc(8192);
+            // Copied, json is reused for the next batch
+            TEST_ASSERT_TRUE(deserializeJson(doc, (const char*)json) == DeserializationError::Ok);
+            TEST_ASSERT_EQUAL_size_t(count, doc.as<JsonArray>().size());
+            batches->add(doc.as<JsonArray>());
+        }
+        low_power_sent(target, count);
+        radio += SEND_MS;
+    }
+    low_power_uplink_done(target, target.count == 0, radio);
+    return radio;
+}
+
+// One wake: the reading, the uplink if due, then to sleep. True if the radio was turned on.
+static bool wake(LowPowerState& target, float temperature, bool reachable = true, JsonArray* batches = nullptr) {
+    const bool due = low_power_record(target, temperature, 50.0f, 800);
+    uint32_t awake = AWAKE_MS;
+    if (due) {
+        awake += uplink(target, reachable, batches);
+    }
+    const uint32_t sleepMs = low_power_sleep(target, awake);
+    TEST_ASSERT_EQUAL_UINT32(LOW_POWER_SAMPLE_INTERVAL_S * 1000UL - awake, sleepMs);
+    return due;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_cold_and_warm_boot(void) {
+    TEST_ASSERT_TRUE(low_power_begin(state, 30.0f));
+    TEST_ASSERT_EQUAL_FLOAT(30.0f, state.threshold);
+    ReportRule defaults[HISTORY_METRIC_COUNT];
+    report_policy_defaults(defaults);
+    TEST_ASSERT_EQUAL_MEMORY(defaults, state.rules, sizeof(defaults));
+
+    // A wake from the timer keeps the state, the threshold is only read at the cold boot
+    low_power_record(state, 21.0f, 50.0f, 800);
+    TEST_ASSERT_FALSE(low_power_begin(state, 35.0f));
+    TEST_ASSERT_EQUAL_FLOAT(30.0f, state.threshold);
+    TEST_ASSERT_EQUAL_UINT32(1U, state.wakes);
+
+    // Garbage after a power loss starts over
+    state.magic ^= 0x5A5A5A5A;
+    TEST_ASSERT_TRUE(low_power_begin(state, 30.0f));
+    TEST_ASSERT_EQUAL_UINT32(0U, state.wakes);
+    TEST_ASSERT_EQUAL_UINT16(0U, state.count);
+}
+
+void test_batch_uplink_with_sample_times(void) {
+    report_every_reading(state);
+    for (int i = 0; i < LOW_POWER_BATCH_SIZE - 1; i++) {
+        TEST_ASSERT_FALSE(wake(state, 20.0f + i / 10.0f));
+    }
+    // Not synced yet: the samples would get the time they arrive at
+    char json[LOW_POWER_BATCH_JSON];
+    TEST_ASSERT_EQUAL_size_t(0U, low_power_batch_json(state, json, sizeof(json)));
+
+    DynamicJsonDocument doc(16384);
+    JsonArray batches = doc.to<JsonArray>();
+    TEST_ASSERT_TRUE(wake(state, 21.1f, true, &batches));
+    TEST_ASSERT_EQUAL_size_t(1U, batches.size());
+    JsonArray batch = batches[0];
+    TEST_ASSERT_EQUAL_size_t(LOW_POWER_BATCH_SIZE, batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        // Each sample keeps the time of its wake
+        TEST_ASSERT_EQUAL_INT64(EPOCH_MS + (int64_t)i * LOW_POWER_SAMPLE_INTERVAL_S * 1000, batch[i]["ts"].as<int64_t>());
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, 20.0f + i / 10.0f, batch[i]["values"]["temperature"].as<float>());
+        TEST_ASSERT_FALSE(batch[i]["values"]["alert"].as<bool>());
+    }
+    TEST_ASSERT_EQUAL_UINT16(0U, state.count);
+    TEST_ASSERT_EQUAL_UINT32(1U, state.uplinks);
+    TEST_ASSERT_EQUAL_UINT32(LOW_POWER_BATCH_SIZE, state.delivered);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)LOW_POWER_BATCH_SIZE * AWAKE_MS + CONNECT_MS + SEND_MS, state.awakeMs);
+    TEST_ASSERT_EQUAL_UINT64(CONNECT_MS + SEND_MS, state.radioMs);
+}
+
+void test_alert_starts_an_uplink(void) {
+    TEST_ASSERT_FALSE(wake(state, 25.0f));
+    // Only the start of an alert turns the radio on
+    TEST_ASSERT_TRUE(wake(state, 31.0f));
+    TEST_ASSERT_EQUAL_UINT32(1U, state.alertUplinks);
+    TEST_ASSERT_FALSE(wake(state, 32.0f));
+    TEST_ASSERT_FALSE(wake(state, 25.0f));
+    TEST_ASSERT_EQUAL_UINT32(2U, state.uplinks);
+
+    // Inside the dead band the temperatures are not stored, the ones that start and end an alert are
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    report_policy_defaults(rules);
+    rules[HISTORY_TEMPERATURE].deadBand = 20.0f;
+    low_power_set_rules(state, rules);
+    const uint32_t suppressed = state.suppressed;
+    TEST_ASSERT_FALSE(wake(state, 25.0f));
+    TEST_ASSERT_FALSE(wake(state, 25.0f));
+    TEST_ASSERT_EQUAL_UINT32(suppressed + 1, state.suppressed);
+    DynamicJsonDocument doc(16384);
+    JsonArray batches = doc.to<JsonArray>();
+    TEST_ASSERT_TRUE(wake(state, 30.5f, true, &batches));
+    JsonArray batch = batches[0];
+    JsonObject last = batch[batch.size() - 1]["values"];
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 30.5f, last["temperature"].as<float>());
+    TEST_ASSERT_TRUE(last["alert"].as<bool>());
+    const uint16_t waiting = state.count;
+    TEST_ASSERT_FALSE(wake(state, 29.5f));
+    TEST_ASSERT_EQUAL_UINT16(waiting + 1, state.count);
+    report_every_reading(state);
+}
+
+void test_failed_uplinks_back_off(void) {
+    // A power loss, the ring starts empty
+    state.magic = 0;
+    TEST_ASSERT_TRUE(low_power_begin(state, 30.0f));
+    report_every_reading(state);
+
+    // The access point is gone: each failure doubles the wait up to LOW_POWER_RETRY_MAX_S
+    const uint32_t expected[] = { 600, 1200, 2400, 4800, 7200, 7200 };
+    uint32_t failures = 0;
+    uint32_t wakes = 0;
+    while (failures < sizeof(expected) / sizeof(expected[0])) {
+        const uint32_t now = state.clockMs / 1000;
+        const bool due = wake(state, 22.0f, false);
+        wakes++;
+        if (due) {
+            TEST_ASSERT_EQUAL_UINT32(now + expected[failures], state.retryAt);
+            failures++;
+        } else if (state.count >= LOW_POWER_BATCH_SIZE) {
+            TEST_ASSERT_LESS_THAN_UINT32(state.retryAt, now);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(failures, state.uplinkFailures);
+
+    // Hours without an uplink fill the ring, the oldest samples are overwritten and counted
+    while (state.dropped == 0) {
+        wake(state, 22.0f, false);
+        wakes++;
+    }
+    TEST_ASSERT_EQUAL_UINT16(LOW_POWER_RING_SIZE, state.count);
+    TEST_ASSERT_EQUAL_UINT32(wakes, state.wakes);
+    TEST_ASSERT_EQUAL_UINT32(wakes, state.dropped + state.count);
+
+    // Back: the retry sends what the ring holds in order, the last LOW_POWER_RING_SIZE wakes
+    DynamicJsonDocument doc(65536);
+    JsonArray batches = doc.to<JsonArray>();
+    uint32_t now;
+    do {
+        now = state.clockMs / 1000;
+        wakes++;
+    } while (!wake(state, 22.0f, true, &batches));
+    TEST_ASSERT_FALSE(doc.overflowed());
+    TEST_ASSERT_EQUAL_UINT16(0U, state.count);
+    TEST_ASSERT_EQUAL_UINT32(0U, state.retryAt);
+    const int64_t oldest = now - (LOW_POWER_RING_SIZE - 1) * LOW_POWER_SAMPLE_INTERVAL_S;
+    TEST_ASSERT_EQUAL_INT64(EPOCH_MS + oldest * 1000, batches[0][0]["ts"].as<int64_t>());
+    int64_t previous = 0;
+    for (JsonArray batch : batches) {
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(LOW_POWER_BATCH_SIZE, batch.size());
+        for (JsonObject entry : batch) {
+            TEST_ASSERT_TRUE(entry["ts"].as<int64_t>() > previous);
+            previous = entry["ts"].as<int64_t>();
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(wakes, state.delivered + state.dropped);
+}
+
+void test_long_wake_sleeps_the_minimum(void) {
+    const uint64_t clock = state.clockMs;
+    TEST_ASSERT_EQUAL_UINT32(LOW_POWER_MIN_SLEEP_MS, low_power_sleep(state, LOW_POWER_SAMPLE_INTERVAL_S * 1000UL));
+    TEST_ASSERT_EQUAL_UINT64(clock + LOW_POWER_SAMPLE_INTERVAL_S * 1000ULL + LOW_POWER_MIN_SLEEP_MS, state.clockMs);
+}
+
+void test_week_radio_time_against_the_model(void) {
+    static LowPowerState week;
+    TEST_ASSERT_TRUE(low_power_begin(week, 30.0f));
+    // The default rules, a temperature that goes over the threshold each afternoon
+    const uint32_t wakes = 7 * 86400 / LOW_POWER_SAMPLE_INTERVAL_S;
+    uint32_t alertStarts = 0;
+    uint32_t radioOn = 0;
+    for (uint32_t i = 0; i < wakes; i++) {
+        const float hour = (week.clockMs / 3600000ULL) % 24 + (week.clockMs % 3600000ULL) / 3600000.0f;
+        const float temperature = 25.0f + 6.0f * sinf((hour - 9.0f) / 24.0f * 2 * (float)M_PI);
+        const bool wasActive = week.alertActive;
+        radioOn += wake(week, roundf(temperature));
+        alertStarts += week.alertActive && !wasActive;
+    }
+    TEST_ASSERT_EQUAL_UINT32(wakes, week.delivered + week.count + week.suppressed);
+    TEST_ASSERT_EQUAL_UINT32(radioOn, week.uplinks);
+
+    LowPowerEstimate measured;
+    low_power_estimate(week, measured);
+    LowPowerEstimate model;
+    const float sampleShare = 1 - (float)week.suppressed / week.wakes;
+    low_power_model(model, AWAKE_MS, CONNECT_MS + SEND_MS, sampleShare, alertStarts / 7.0f);
+    printf("%u wakes, %u uplinks (%u for alerts), %u suppressed\n", week.wakes, week.uplinks, week.alertUplinks,
+           week.suppressed);
+    printf("          radio s/day    mA   battery days\n");
+    printf("measured  %11.1f %6.3f %14.0f\n", measured.radioSecondsPerDay, measured.averageMa, measured.batteryDays);
+    printf("model     %11.1f %6.3f %14.0f\n", model.radioSecondsPerDay, model.averageMa, model.batteryDays);
+    TEST_ASSERT_EQUAL_UINT32(7U, alertStarts);
+    // The model rounds the batches of a day to fractions, otherwise it is the same arithmetic
+    TEST_ASSERT_FLOAT_WITHIN(model.radioSecondsPerDay * 0.15f, model.radioSecondsPerDay, measured.radioSecondsPerDay);
+    TEST_ASSERT_FLOAT_WITHIN(model.averageMa * 0.15f, model.averageMa, measured.averageMa);
+    // Always on, the radio alone would empty the battery in under a day
+    TEST_ASSERT_GREATER_THAN_FLOAT(LOW_POWER_BATTERY_MAH / LOW_POWER_RADIO_MA / 24 * 100, measured.batteryDays);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_cold_and_warm_boot);
+    RUN_TEST(test_batch_uplink_with_sample_times);
+    RUN_TEST(test_alert_starts_an_uplink);
+    RUN_TEST(test_failed_uplinks_back_off);
+    RUN_TEST(test_long_wake_sleeps_the_minimum);
+    RUN_TEST(test_week_radio_time_against_the_model);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+// Memory budget (src/memory_budget.cpp) after a boot of the firmware: setup() runs as on the
+// device, then everything claimed must lie within the regions of memory_budget.def. Built with
+// MEMORY_STATIC=1 (pio test -e native_static) /memory must report no heap bytes and the JSON
+// documents must not fall back to the heap. A budget that is exceeded fails the build through the
+// static_asserts of memory_budget.cpp and MEMORY_FITS, this test checks what the firmware claims
+// at runtime.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <StreamString.h>
+#include "json_arena.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "native_board.h"
+
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+void setup();
+
+static DynamicJsonDocument budget() {
+    StreamString text;
+    for (size_t item = 0; memory_budget_write(text, item); item++) {
+    }
+    DynamicJsonDocument doc(8192);
+    TEST_ASSERT_TRUE(deserializeJson(doc, text.c_str()) == DeserializationError::Ok);
+    return doc;
+}
+
+static JsonObject region(DynamicJsonDocument& doc, const char* name) {
+    for (JsonObject entry : doc["regions"].as<JsonArray>()) {
+        if (strcmp(entry["name"].as<const char*>(), name) == 0) {
+            return entry;
+        }
+    }
+    TEST_FAIL_MESSAGE(name);
+    return JsonObject();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// First, the claims of the boot
+void test_boot_stays_within_the_regions(void) {
+    setup();
+    // The web server task creates its objects and the first documents once it runs
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    DynamicJsonDocument doc = budget();
+    TEST_ASSERT_EQUAL(MEMORY_STATIC != 0, doc["static"].as<bool>());
+    TEST_ASSERT_TRUE(doc["declared_bytes"].as<uint32_t>() <= doc["budget_bytes"].as<uint32_t>());
+    printf("region              bytes  claimed   heap\n");
+    uint32_t claimed = 0;
+    for (JsonObject entry : doc["regions"].as<JsonArray>()) {
+        printf("%-18s %6u %8u %6u\n", entry["name"].as<const char*>(), entry["bytes"].as<unsigned>(),
+               entry["claimed"].as<unsigned>(), entry["heap"].as<unsigned>());
+        TEST_ASSERT_TRUE(entry["claimed"].as<uint32_t>() <= entry["bytes"].as<uint32_t>());
+        claimed += entry["claimed"].as<uint32_t>();
+    }
+    // Every task the firmware creates has its stack and control block in the budget
+    TEST_ASSERT_EQUAL_UINT32(memory_region_bytes(MEMORY_TASKS), region(doc, "TASKS")["claimed"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(memory_region_bytes(MEMORY_STACK_WEB_SERVER), region(doc, "STACK_WEB_SERVER")["claimed"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(memory_region_bytes(MEMORY_STACK_JOBS), region(doc, "STACK_JOBS")["claimed"].as<uint32_t>());
+    printf("%u of %u declared bytes claimed, %u from the heap, %u JSON arena fallbacks\n", claimed,
+           doc["declared_bytes"].as<unsigned>(), doc["heap_bytes"].as<unsigned>(), (unsigned)metric_json_arena_fallbacks.value());
+#if MEMORY_STATIC
+    TEST_ASSERT_EQUAL_UINT32(0U, doc["heap_bytes"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT64(0U, metric_json_arena_fallbacks.value());
+#else
+    // The same claims, each one from the heap
+    TEST_ASSERT_EQUAL_UINT32(claimed, doc["heap_bytes"].as<uint32_t>());
+#endif
+}
+
+void test_used_up_region_hands_out_heap(void) {
+    DynamicJsonDocument before = budget();
+    const uint32_t claimed = region(before, "JOB_QUEUES")["claimed"].as<uint32_t>();
+    const size_t heapBytes = memory_heap_bytes();
+    // More than the rest of the region: nothing fails, the bytes are counted as heap
+    void* storage = memory_claim(MEMORY_JOB_QUEUES, memory_region_bytes(MEMORY_JOB_QUEUES));
+    TEST_ASSERT_NOT_NULL(storage);
+    memset(storage, 0xA5, memory_region_bytes(MEMORY_JOB_QUEUES));
+    DynamicJsonDocument after = budget();
+    TEST_ASSERT_EQUAL_UINT32(claimed, region(after, "JOB_QUEUES")["claimed"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_size_t(heapBytes + memory_region_bytes(MEMORY_JOB_QUEUES), memory_heap_bytes());
+}
+
+int main(int argc, char** argv) {
+    char directory[] = "/tmp/memory_budget_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", (root + "/nvs").c_str(), 1);
+    setenv("NATIVE_FS_ROOT", (root + "/fs").c_str(), 1);
+    setenv("NATIVE_PORT_OFFSET", std::to_string(20000 + getpid() % 20000).c_str(), 1);
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_stays_within_the_regions);
+    RUN_TEST(test_used_up_region_hands_out_heap);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    // The firmware's tasks keep running, do not wait for them
+    fflush(stdout);
+    _exit(failures);
+}
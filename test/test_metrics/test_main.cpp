@@ -0,0 +1,223 @@
+// Counters, gauges and histograms of /metrics (src/metrics.cpp): the OpenMetrics text of all the
+// firmware's metrics checked line by line, and a microbenchmark of the per-core counters against a
+// shared atomic and a spinlocked counter, with tasks pinned to both cores.
+#include <unity.h>
+#include <Arduino.h>
+#include <StreamString.h>
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Registered after the firmware's metrics, so they are the last ones in the exposition
+static MetricCounter test_counter("test_events", "Events counted by the test", "kind=\"a\"");
+static MetricCounter test_counter_b("test_events", "Events counted by the test", "kind=\"b\"");
+static MetricGauge test_gauge("test_level", "Level set by the test");
+static MetricHistogram test_histogram("test_latency_seconds", "Latencies observed by the test");
+
+static std::vector<std::string> exposition() {
+    StreamString text;
+    for (size_t item = 0; metrics_write(text, item); item++) {
+    }
+    std::vector<std::string> lines;
+    std::string all = text.c_str();
+    TEST_ASSERT_TRUE(all.size() > 0 && all.back() == '\n');
+    size_t start = 0;
+    size_t end;
+    while ((end = all.find('\n', start)) != std::string::npos) {
+        lines.push_back(all.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+static std::string sample_value(const std::vector<std::string>& lines, const std::string& name) {
+    for (const std::string& line : lines) {
+        if (line.compare(0, name.size() + 1, name + " ") == 0) {
+            return line.substr(name.size() + 1);
+        }
+    }
+    return "";
+}
+
+// Runs body(core) on one task per core and waits for all of them
+static void run_on_cores(int cores, void (*body)(int core)) {
+    struct Run {
+        void (*body)(int);
+        int core;
+        std::atomic<int>* done;
+    };
+    std::atomic<int> done(0);
+    std::vector<Run> runs(cores);
+    for (int core = 0; core < cores; core++) {
+        runs[core] = { body, core, &done };
+        xTaskCreatePinnedToCore([](void* arg) {
+            Run* run = (Run*)arg;
+            run->body(run->core);
+            (*run->done)++;
+            vTaskDelete(NULL);
+        }, "bench", 4096, &runs[core], 1, NULL, core);
+    }
+    while (done < cores) {
+        vTaskDelay(1);
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_exposition_is_openmetrics(void) {
+    metrics_collect();
+    const std::vector<std::string> lines = exposition();
+    TEST_ASSERT_EQUAL_STRING("# EOF", lines.back().c_str());
+
+    std::map<std::string, std::string> types;
+    std::string family;
+    for (size_t i = 0; i + 1 < lines.size(); i++) {
+        const std::string& line = lines[i];
+        TEST_ASSERT_TRUE_MESSAGE(line.find("# EOF") == std::string::npos, line.c_str());
+        if (line.compare(0, 7, "# TYPE ") == 0) {
+            const size_t space = line.find(' ', 7);
+            const std::string name = line.substr(7, space - 7);
+            const std::string type = line.substr(space + 1);
+            // One family per name, the samples below must all be of it
+            TEST_ASSERT_TRUE_MESSAGE(types.count(name) == 0, line.c_str());
+            TEST_ASSERT_TRUE(type == "counter" || type == "gauge" || type == "histogram");
+            types[name] = type;
+            family = name;
+            TEST_ASSERT_TRUE_MESSAGE(lines[i + 1].compare(0, 8 + name.size(), "# HELP " + name + " ") == 0, line.c_str());
+            i++;
+            continue;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(line[0] != '#', line.c_str());
+        const size_t nameEnd = line.find_first_of("{ ");
+        const std::string sample = line.substr(0, nameEnd);
+        const std::string& type = types[family];
+        if (type == "counter") {
+            TEST_ASSERT_TRUE_MESSAGE(sample == family + "_total", line.c_str());
+        } else if (type == "gauge") {
+            TEST_ASSERT_TRUE_MESSAGE(sample == family, line.c_str());
+        } else {
+            TEST_ASSERT_TRUE_MESSAGE(sample == family + "_bucket" || sample == family + "_count" || sample == family + "_sum", line.c_str());
+        }
+        // Label set, then one space and the value
+        if (line[nameEnd] == '{') {
+            const size_t close = line.find("} ", nameEnd);
+            TEST_ASSERT_TRUE_MESSAGE(close != std::string::npos, line.c_str());
+            TEST_ASSERT_TRUE_MESSAGE(line.find('"', nameEnd) < close, line.c_str());
+        }
+        const std::string value = line.substr(line.rfind(' ') + 1);
+        char* parsed;
+        strtod(value.c_str(), &parsed);
+        TEST_ASSERT_TRUE_MESSAGE(!value.empty() && *parsed == '\0', line.c_str());
+    }
+    TEST_ASSERT_EQUAL_STRING("counter", types["dht_reads"].c_str());
+    TEST_ASSERT_EQUAL_STRING("histogram", types["task_loop_seconds"].c_str());
+    TEST_ASSERT_EQUAL_STRING("gauge", types["heap_free_bytes"].c_str());
+}
+
+void test_counter_gauge_and_histogram_values(void) {
+    test_counter.inc();
+    test_counter.inc(41);
+    test_gauge.set(-2.5f);
+    // On the bound counts into the bucket, just above into the next one
+    for (uint32_t micros : { 100U, 101U, 1000U, 4999999U, 5000001U, 4000000000U, 4000000000U }) {
+        test_histogram.observe(micros);
+    }
+    const std::vector<std::string> lines = exposition();
+    const std::string counter = sample_value(lines, "test_events_total{kind=\"a\"}");
+    const std::string other = sample_value(lines, "test_events_total{kind=\"b\"}");
+    const std::string gauge = sample_value(lines, "test_level");
+    TEST_ASSERT_EQUAL_STRING("42", counter.c_str());
+    TEST_ASSERT_EQUAL_STRING("0", other.c_str());
+    TEST_ASSERT_EQUAL_STRING("-2.5", gauge.c_str());
+
+    static const char* const CUMULATIVE[] = { "1", "2", "3", "3", "3", "3", "3", "3", "3", "4", "7" };
+    for (int bucket = 0; bucket <= METRICS_HISTOGRAM_BUCKETS; bucket++) {
+        const std::string name = std::string("test_latency_seconds_bucket{le=\"") + MetricHistogram::bound(bucket) + "\"}";
+        const std::string value = sample_value(lines, name);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(CUMULATIVE[bucket], value.c_str(), name.c_str());
+    }
+    const std::string count = sample_value(lines, "test_latency_seconds_count");
+    const std::string sum = sample_value(lines, "test_latency_seconds_sum");
+    TEST_ASSERT_EQUAL_STRING("7", count.c_str());
+    // The low word wrapped, the sum still is 8010001201 us
+    TEST_ASSERT_EQUAL_STRING("8010.001201", sum.c_str());
+}
+
+static const uint32_t INCREMENTS = 2000000U;
+static std::atomic<uint32_t> sharedCounter(0);
+static portMUX_TYPE counterMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t lockedCounter = 0;
+static MetricCounter bench_counter("test_bench_events", "Events of the counter benchmark");
+
+void test_counter_benchmark(void) {
+    struct Variant {
+        const char* name;
+        void (*body)(int core);
+        uint64_t (*value)();
+    };
+    static const Variant VARIANTS[] = {
+        { "MetricCounter (per core)",
+          [](int) { for (uint32_t i = 0; i < INCREMENTS; i++) bench_counter.inc(); },
+          []() { return bench_counter.value(); } },
+        { "shared atomic",
+          [](int) { for (uint32_t i = 0; i < INCREMENTS; i++) sharedCounter.fetch_add(1, std::memory_order_relaxed); },
+          []() { return (uint64_t)sharedCounter.load(); } },
+        { "spinlock",
+          [](int) {
+              for (uint32_t i = 0; i < INCREMENTS; i++) {
+                  portENTER_CRITICAL(&counterMux);
+                  lockedCounter++;
+                  portEXIT_CRITICAL(&counterMux);
+              }
+          },
+          []() { return (uint64_t)lockedCounter; } },
+    };
+
+    // The contention only shows when the host has a CPU for each of the tasks
+    printf("host CPUs: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("counter                     1 core ns/inc   2 cores ns/inc\n");
+    for (const Variant& variant : VARIANTS) {
+        double ns[2];
+        for (int cores = 1; cores <= 2; cores++) {
+            const uint64_t before = variant.value();
+            const auto start = std::chrono::steady_clock::now();
+            run_on_cores(cores, variant.body);
+            ns[cores - 1] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / INCREMENTS;
+            // No increment is lost, whatever the core
+            TEST_ASSERT_EQUAL_UINT64((uint64_t)cores * INCREMENTS, variant.value() - before);
+        }
+        printf("%-26s  %13.2f   %14.2f\n", variant.name, ns[0], ns[1]);
+    }
+
+    const int rounds = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        test_histogram.observe((uint32_t)i * 7919U % 6000000U);
+    }
+    const double observeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    start = std::chrono::steady_clock::now();
+    StreamString text;
+    size_t metrics = 0;
+    while (metrics_write(text, metrics)) {
+        metrics++;
+    }
+    const double scrapeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    printf("histogram observe: %.1f ns, scrape of %zu metrics (%zu bytes): %.0f us\n", observeNs, metrics, (size_t)text.length(), scrapeUs);
+}
+
+int main(int argc, char** argv) {
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_exposition_is_openmetrics);
+    RUN_TEST(test_counter_gauge_and_histogram_values);
+    RUN_TEST(test_counter_benchmark);
+    return UNITY_END();
+}
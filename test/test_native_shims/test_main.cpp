@@ -0,0 +1,246 @@
+// The shims the native environment runs the firmware on (lib/NativeShims): FreeRTOS tasks, queues
+// and semaphores on pthreads, task notifications, Preferences and LittleFS backed by directories,
+// and the virtual clock of the host tests. The firmware's own tests rely on them behaving like
+// on the device.
+#include <unity.h>
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "native_board.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_queue_order_and_timeouts(void) {
+    QueueHandle_t queue = xQueueCreate(3, sizeof(int));
+    for (int value : { 1, 2 }) {
+        TEST_ASSERT_EQUAL_INT(pdTRUE, xQueueSend(queue, &value, 0));
+    }
+    int front = 0;
+    TEST_ASSERT_EQUAL_INT(pdTRUE, xQueueSendToFront(queue, &front, 0));
+    TEST_ASSERT_EQUAL_UINT32(0U, uxQueueSpacesAvailable(queue));
+
+    // Full: waits for the timeout, then fails
+    int value = 9;
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_INT(pdFALSE, xQueueSend(queue, &value, pdMS_TO_TICKS(30)));
+    TEST_ASSERT_GREATER_OR_EQUAL(25, (int)elapsed_ms(start));
+
+    for (int expected : { 0, 1, 2 }) {
+        TEST_ASSERT_EQUAL_INT(pdTRUE, xQueueReceive(queue, &value, 0));
+        TEST_ASSERT_EQUAL_INT(expected, value);
+    }
+    start = std::chrono::steady_clock::now();
+    TEST_ASSERT_EQUAL_INT(pdFALSE, xQueueReceive(queue, &value, pdMS_TO_TICKS(30)));
+    TEST_ASSERT_GREATER_OR_EQUAL(25, (int)elapsed_ms(start));
+
+    QueueHandle_t mailbox = xQueueCreate(1, sizeof(int));
+    for (int latest : { 4, 5 }) {
+        xQueueOverwrite(mailbox, &latest);
+    }
+    TEST_ASSERT_EQUAL_INT(pdTRUE, xQueuePeek(mailbox, &value, 0));
+    TEST_ASSERT_EQUAL_INT(5, value);
+    TEST_ASSERT_EQUAL_UINT32(1U, uxQueueMessagesWaiting(mailbox));
+    vQueueDelete(mailbox);
+    vQueueDelete(queue);
+}
+
+static QueueHandle_t pingQueue;
+static QueueHandle_t pongQueue;
+
+static void pong_task(void* parameter) {
+    int value;
+    while (xQueueReceive(pingQueue, &value, portMAX_DELAY) == pdTRUE && value >= 0) {
+        value = value * 10 + xPortGetCoreID();
+        xQueueSend(pongQueue, &value, portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+void test_tasks_block_on_queues(void) {
+    pingQueue = xQueueCreate(1, sizeof(int));
+    pongQueue = xQueueCreate(1, sizeof(int));
+    TaskHandle_t task = nullptr;
+    TEST_ASSERT_EQUAL_INT(pdPASS, xTaskCreatePinnedToCore(pong_task, "pong", 4096, NULL, 2, &task, 1));
+    TEST_ASSERT_NOT_NULL(task);
+    const std::string name = pcTaskGetName(task);
+    TEST_ASSERT_EQUAL_STRING("pong", name.c_str());
+    TEST_ASSERT_EQUAL_UINT32(2U, uxTaskPriorityGet(task));
+
+    for (int i = 0; i < 100; i++) {
+        int value;
+        xQueueSend(pingQueue, &i, portMAX_DELAY);
+        TEST_ASSERT_EQUAL_INT(pdTRUE, xQueueReceive(pongQueue, &value, pdMS_TO_TICKS(1000)));
+        // Runs on the core it was pinned to
+        TEST_ASSERT_EQUAL_INT(i * 10 + 1, value);
+    }
+    const int stop = -1;
+    xQueueSend(pingQueue, &stop, portMAX_DELAY);
+}
+
+static SemaphoreHandle_t mutex;
+static std::atomic<int> inside(0);
+static std::atomic<int> overlaps(0);
+static std::atomic<int> finished(0);
+
+static void mutex_task(void* parameter) {
+    for (int i = 0; i < 1000; i++) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (inside++ != 0) {
+            overlaps++;
+        }
+        inside--;
+        xSemaphoreGive(mutex);
+    }
+    finished++;
+    vTaskDelete(NULL);
+}
+
+void test_semaphores(void) {
+    mutex = xSemaphoreCreateMutex();
+    for (int core = 0; core < 2; core++) {
+        xTaskCreatePinnedToCore(mutex_task, "mutex", 4096, NULL, 1, NULL, core);
+    }
+    while (finished < 2) {
+        vTaskDelay(1);
+    }
+    TEST_ASSERT_EQUAL_INT(0, overlaps.load());
+
+    SemaphoreHandle_t recursive = xSemaphoreCreateRecursiveMutex();
+    TEST_ASSERT_EQUAL_INT(pdTRUE, xSemaphoreTakeRecursive(recursive, 0));
+    TEST_ASSERT_EQUAL_INT(pdTRUE, xSemaphoreTakeRecursive(recursive, 0));
+    xSemaphoreGiveRecursive(recursive);
+    xSemaphoreGiveRecursive(recursive);
+
+    SemaphoreHandle_t counting = xSemaphoreCreateCounting(2, 1);
+    TEST_ASSERT_EQUAL_INT(pdTRUE, xSemaphoreGive(counting));
+    TEST_ASSERT_EQUAL_INT(pdFALSE, xSemaphoreGive(counting));
+    TEST_ASSERT_EQUAL_UINT32(2U, uxSemaphoreGetCount(counting));
+
+    // A binary semaphore starts empty
+    SemaphoreHandle_t binary = xSemaphoreCreateBinary();
+    TEST_ASSERT_EQUAL_INT(pdFALSE, xSemaphoreTake(binary, 0));
+    vSemaphoreDelete(binary);
+    vSemaphoreDelete(counting);
+    vSemaphoreDelete(recursive);
+}
+
+static TaskHandle_t waiter;
+
+static void notify_task(void* parameter) {
+    for (int i = 0; i < 3; i++) {
+        xTaskNotifyGive(waiter);
+    }
+    vTaskDelete(NULL);
+}
+
+void test_task_notifications(void) {
+    waiter = xTaskGetCurrentTaskHandle();
+    xTaskCreate(notify_task, "notify", 4096, NULL, 1, NULL);
+    uint32_t received = 0;
+    while (received < 3) {
+        const uint32_t count = ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(1000));
+        TEST_ASSERT_GREATER_THAN_UINT32(0U, count);
+        received++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(0U, ulTaskNotifyTake(pdTRUE, 0));
+}
+
+void test_preferences_persist(void) {
+    const NativeNvsWrites before = native_nvs_writes();
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("shims"));
+    preferences.clear();
+    preferences.putInt("count", -42);
+    preferences.putString("name", "dashboard");
+    preferences.putInt("count", -42);
+    preferences.end();
+    TEST_ASSERT_FALSE(preferences.begin("a_namespace_too_long"));
+
+    Preferences again;
+    TEST_ASSERT_TRUE(again.begin("shims", true));
+    TEST_ASSERT_EQUAL_INT(-42, again.getInt("count"));
+    TEST_ASSERT_EQUAL_INT(7, again.getInt("missing", 7));
+    const String name = again.getString("name");
+    TEST_ASSERT_EQUAL_STRING("dashboard", name.c_str());
+    // Read only
+    TEST_ASSERT_EQUAL_size_t(0U, again.putInt("count", 1));
+    again.end();
+
+    // The same value again is not written, like NVS
+    const NativeNvsWrites after = native_nvs_writes();
+    TEST_ASSERT_EQUAL_UINT32(2U, after.writes - before.writes);
+    TEST_ASSERT_EQUAL_UINT32(1U, after.unchanged - before.unchanged);
+}
+
+void test_littlefs_is_a_directory(void) {
+    TEST_ASSERT_TRUE(LittleFS.begin(true));
+    File file = LittleFS.open("/shims.txt", "w");
+    TEST_ASSERT_TRUE((bool)file);
+    file.print("hello flash");
+    file.close();
+    TEST_ASSERT_TRUE(LittleFS.exists("/shims.txt"));
+    file = LittleFS.open("/shims.txt", "r");
+    TEST_ASSERT_EQUAL_size_t(11U, file.size());
+    const String content = file.readString();
+    file.close();
+    TEST_ASSERT_EQUAL_STRING("hello flash", content.c_str());
+    TEST_ASSERT_TRUE(LittleFS.remove("/shims.txt"));
+    TEST_ASSERT_FALSE(LittleFS.exists("/shims.txt"));
+}
+
+// Last, the clock stays virtual
+void test_virtual_clock(void) {
+    native_clock_set_us(5000000ULL);
+    TEST_ASSERT_EQUAL_UINT32(5000U, millis());
+    TEST_ASSERT_EQUAL_UINT32(5000000U, micros());
+    const auto start = std::chrono::steady_clock::now();
+    delay(60000);
+    delayMicroseconds(250);
+    TEST_ASSERT_LESS_THAN(50, (int)elapsed_ms(start));
+    TEST_ASSERT_EQUAL_UINT32(65000U, millis());
+    TEST_ASSERT_EQUAL_INT64(65000250LL, esp_timer_get_time());
+    native_clock_advance_us(1000ULL);
+    TEST_ASSERT_EQUAL_UINT32(65001250U, micros());
+    // millis() wraps like on the device, after 49.7 days
+    native_clock_set_us(4294967296000ULL + 1000ULL);
+    TEST_ASSERT_EQUAL_UINT32(1U, millis());
+}
+
+int main(int argc, char** argv) {
+    // Preferences and LittleFS in a directory of their own
+    char directory[] = "/tmp/native_shims_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", (root + "/nvs").c_str(), 1);
+    setenv("NATIVE_FS_ROOT", (root + "/fs").c_str(), 1);
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_order_and_timeouts);
+    RUN_TEST(test_tasks_block_on_queues);
+    RUN_TEST(test_semaphores);
+    RUN_TEST(test_task_notifications);
+    RUN_TEST(test_preferences_persist);
+    RUN_TEST(test_littlefs_is_a_directory);
+    RUN_TEST(test_virtual_clock);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    return failures;
+}
@@ -0,0 +1,217 @@
+// Report filter (src/report_policy.cpp): the dead band, the max-silence heartbeat and the window
+// aggregates of report_track(), the rules in NVS and the counters of the firmware path. The
+// benchmark replays a simulated day of the sensor jobs with the replay of the native build
+// (lib/NativeShims/src/report_replay.h) and reports the message reduction and the error of the
+// series a receiver rebuilds from the reports.
+#include <unity.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include "report_policy.h"
+#include "report_replay.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+static const uint32_t SECOND_MS = 1000;
+
+// Feeds value at nowMs, true if it was reported
+static bool feed(ReportTrack& track, const ReportRule& rule, float value, uint32_t nowMs, Report* out = nullptr) {
+    Report report;
+    const bool reported = report_track(track, rule, value, nowMs, report);
+    if (reported && out) {
+        *out = report;
+    }
+    return reported;
+}
+
+static void print_replay(const char* name, const ReportReplayResult& result) {
+    printf("%-16s %6u -> %5u messages, %5.1fx", name, result.messages, result.reportMessages,
+           (double)result.messages / result.reportMessages);
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        printf(" | %s rms %.3f max %.3f", history_metric_name((HistoryMetric)i), result.metrics[i].rmsError,
+               result.metrics[i].maxError);
+    }
+    printf("\n");
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_dead_band(void) {
+    const ReportRule rule = { 1.0f, 0, 0 };
+    ReportTrack track = {};
+    Report report;
+    // The first reading is always reported
+    TEST_ASSERT_TRUE(feed(track, rule, 22.0f, 0, &report));
+    TEST_ASSERT_EQUAL_FLOAT(22.0f, report.mean);
+    TEST_ASSERT_EQUAL_UINT16(1, report.count);
+    TEST_ASSERT_FALSE(feed(track, rule, 22.9f, 5 * SECOND_MS));
+    TEST_ASSERT_FALSE(feed(track, rule, 21.1f, 10 * SECOND_MS));
+    // A step of exactly the dead band, from the last reported value
+    TEST_ASSERT_TRUE(feed(track, rule, 23.0f, 15 * SECOND_MS, &report));
+    TEST_ASSERT_EQUAL_FLOAT(23.0f, report.mean);
+    TEST_ASSERT_FALSE(feed(track, rule, 22.5f, 20 * SECOND_MS));
+    TEST_ASSERT_TRUE(feed(track, rule, 22.0f, 25 * SECOND_MS));
+
+    // No dead band: every reading
+    const ReportRule every = { 0, 0, 0 };
+    ReportTrack all = {};
+    for (uint32_t i = 0; i < 10; i++) {
+        TEST_ASSERT_TRUE(feed(all, every, 22.0f, i * 5 * SECOND_MS));
+    }
+}
+
+void test_max_silence_heartbeat(void) {
+    const ReportRule rule = { 1.0f, 60, 0 };
+    ReportTrack track = {};
+    TEST_ASSERT_TRUE(feed(track, rule, 22.0f, 0));
+    uint32_t reports = 0;
+    uint32_t lastReport = 0;
+    // A reading every 5 s that never leaves the dead band, for ten minutes
+    for (uint32_t ms = 5 * SECOND_MS; ms <= 600 * SECOND_MS; ms += 5 * SECOND_MS) {
+        if (feed(track, rule, 22.0f, ms)) {
+            TEST_ASSERT_EQUAL_UINT32(60 * SECOND_MS, ms - lastReport);
+            lastReport = ms;
+            reports++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(10U, reports);
+}
+
+void test_window_aggregates(void) {
+    const ReportRule rule = { 1.0f, 0, 60 };
+    ReportTrack track = {};
+    Report report;
+    // Twelve readings of a minute, a short spike among them
+    for (uint32_t i = 0; i < 12; i++) {
+        TEST_ASSERT_FALSE(feed(track, rule, i == 6 ? 25.0f : 22.0f, i * 5 * SECOND_MS));
+    }
+    // The first reading after the end closes the window and starts the next one
+    TEST_ASSERT_TRUE(feed(track, rule, 22.0f, 60 * SECOND_MS, &report));
+    TEST_ASSERT_EQUAL_UINT16(12, report.count);
+    TEST_ASSERT_EQUAL_FLOAT(22.0f, report.min);
+    TEST_ASSERT_EQUAL_FLOAT(25.0f, report.max);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 22.25f, report.mean);
+
+    // The next window stays within the dead band of the mean
+    for (uint32_t i = 1; i < 12; i++) {
+        TEST_ASSERT_FALSE(feed(track, rule, 22.5f, (60 + i * 5) * SECOND_MS));
+    }
+    TEST_ASSERT_FALSE(feed(track, rule, 22.0f, 120 * SECOND_MS));
+    // A spike in it goes through the min and max even though the mean barely moves
+    for (uint32_t i = 1; i < 12; i++) {
+        TEST_ASSERT_FALSE(feed(track, rule, i == 3 ? 20.0f : 22.25f, (120 + i * 5) * SECOND_MS));
+    }
+    TEST_ASSERT_TRUE(feed(track, rule, 22.0f, 180 * SECOND_MS, &report));
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, report.min);
+    TEST_ASSERT_FLOAT_WITHIN(0.25f, 22.25f, report.mean);
+}
+
+void test_rules_in_nvs(void) {
+    ReportRule invalid = { NAN, 0, 0 };
+    TEST_ASSERT_FALSE(report_rule_valid(invalid));
+    invalid = { -1.0f, 0, 0 };
+    TEST_ASSERT_FALSE(report_rule_valid(invalid));
+    invalid = { 1.0f, REPORT_MAX_SILENCE_S + 1, 0 };
+    TEST_ASSERT_FALSE(report_rule_valid(invalid));
+    invalid = { 1.0f, 0, REPORT_MAX_WINDOW_S + 1 };
+    TEST_ASSERT_FALSE(report_rule_valid(invalid));
+
+    report_policy_begin();
+    ReportRule defaults[HISTORY_METRIC_COUNT];
+    report_policy_defaults(defaults);
+    ReportRule rules[HISTORY_METRIC_COUNT];
+    report_policy_get(rules);
+    TEST_ASSERT_EQUAL_MEMORY(defaults, rules, sizeof(rules));
+
+    const ReportRule light = { 250.0f, 1800, 300 };
+    TEST_ASSERT_TRUE(report_policy_set(HISTORY_LIGHT, light));
+    TEST_ASSERT_FALSE(report_policy_set(HISTORY_LIGHT, invalid));
+    TEST_ASSERT_FALSE(report_policy_set(HISTORY_METRIC_COUNT, light));
+    report_policy_get(rules);
+    TEST_ASSERT_EQUAL_MEMORY(&light, &rules[HISTORY_LIGHT], sizeof(light));
+    TEST_ASSERT_EQUAL_MEMORY(&defaults[HISTORY_TEMPERATURE], &rules[HISTORY_TEMPERATURE], sizeof(ReportRule));
+    // Written right away, the next boot loads it
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin(REPORT_POLICY_NAMESPACE, true));
+    TEST_ASSERT_TRUE(preferences.isKey(REPORT_POLICY_KEY));
+    preferences.end();
+}
+
+void test_readings_and_reports_counted(void) {
+    const uint64_t readings = report_policy_readings(HISTORY_TEMPERATURE);
+    const uint64_t reports = report_policy_reports(HISTORY_TEMPERATURE);
+    // The default temperature rule: a dead band of 0.5
+    const float values[] = { 22.0f, 22.0f, 22.0f, 23.0f, 23.0f, 22.0f };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        report_policy_reading(HISTORY_TEMPERATURE, values[i], i * 5 * SECOND_MS);
+    }
+    TEST_ASSERT_EQUAL_UINT64(6U, report_policy_readings(HISTORY_TEMPERATURE) - readings);
+    TEST_ASSERT_EQUAL_UINT64(3U, report_policy_reports(HISTORY_TEMPERATURE) - reports);
+
+    // A new rule starts the filter over: its first reading is reported
+    ReportRule rule = { 5.0f, 0, 0 };
+    TEST_ASSERT_TRUE(report_policy_set(HISTORY_TEMPERATURE, rule));
+    report_policy_reading(HISTORY_TEMPERATURE, 22.0f, 30 * SECOND_MS);
+    report_policy_reading(HISTORY_TEMPERATURE, 23.0f, 35 * SECOND_MS);
+    TEST_ASSERT_EQUAL_UINT64(4U, report_policy_reports(HISTORY_TEMPERATURE) - reports);
+}
+
+void test_replay_reduction_and_error(void) {
+    const std::vector<ReportReplayReading> trace = report_replay_simulate(24);
+    ReportRule every[HISTORY_METRIC_COUNT];
+    for (ReportRule& rule : every) {
+        rule = { 0, 0, 0 };
+    }
+    ReportRule defaults[HISTORY_METRIC_COUNT];
+    report_policy_defaults(defaults);
+    // Windows of five minutes, reported when they move
+    ReportRule windows[HISTORY_METRIC_COUNT];
+    report_policy_defaults(windows);
+    for (ReportRule& rule : windows) {
+        rule.windowS = 300;
+    }
+
+    const ReportReplayResult all = report_replay(trace, every);
+    const ReportReplayResult filtered = report_replay(trace, defaults);
+    const ReportReplayResult windowed = report_replay(trace, windows);
+    printf("a simulated day, %zu readings\n", trace.size());
+    print_replay("every reading", all);
+    print_replay("defaults", filtered);
+    print_replay("5 min windows", windowed);
+
+    // Every reading sent, nothing to rebuild
+    TEST_ASSERT_EQUAL_UINT32(all.messages, all.reportMessages);
+    for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+        TEST_ASSERT_EQUAL_FLOAT(0.0f, all.metrics[i].maxError);
+        // The rebuilt series never leaves the dead band
+        TEST_ASSERT_TRUE(filtered.metrics[i].bounded);
+        TEST_ASSERT_LESS_THAN_FLOAT(defaults[i].deadBand, filtered.metrics[i].maxError);
+        TEST_ASSERT_EQUAL_UINT32(all.metrics[i].readings, filtered.metrics[i].readings);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(filtered.metrics[i].reports, windowed.metrics[i].reports);
+    }
+    TEST_ASSERT_EQUAL_UINT32(all.messages, filtered.messages);
+    // The DHT11 reads whole degrees and percent, almost every reading says nothing new
+    TEST_ASSERT_GREATER_THAN_UINT32(filtered.reportMessages * 10, all.messages);
+}
+
+int main(int argc, char** argv) {
+    char directory[] = "/tmp/report_policy_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", (root + "/nvs").c_str(), 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_dead_band);
+    RUN_TEST(test_max_silence_heartbeat);
+    RUN_TEST(test_window_aggregates);
+    RUN_TEST(test_rules_in_nvs);
+    RUN_TEST(test_readings_and_reports_counted);
+    RUN_TEST(test_replay_reduction_and_error);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    return failures;
+}
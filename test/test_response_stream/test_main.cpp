@@ -0,0 +1,219 @@
+// Chunked response bodies produced piece by piece (src/response_stream.cpp), read back in the slices
+// the web server asks for. The benchmark sends the largest /history body both ways: through
+// ResponseStream, and serialized into one String first like the handlers did before.
+#include <unity.h>
+#include <Arduino.h>
+#include <StreamString.h>
+#include "native_board.h"
+#include "response_stream.h"
+#include "sensor_history.h"
+
+#include <chrono>
+#include <malloc.h>
+#include <new>
+#include <string>
+#include <vector>
+
+// Send buffer of the web server when the TCP window is open, one MSS
+static const size_t SEND_BUFFER = 1436U;
+
+// Bytes held through operator new, String and the send path allocate nothing else
+static size_t heapUsed = 0;
+
+void* operator new(size_t size) {
+    void* block = malloc(size);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    heapUsed += malloc_usable_size(block);
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    if (block) {
+        heapUsed -= malloc_usable_size(block);
+        free(block);
+    }
+}
+
+void operator delete(void* block, size_t) noexcept {
+    operator delete(block);
+}
+
+static size_t heap_used() {
+    return heapUsed;
+}
+
+// Reads the whole body in slices of the given size
+static std::string read_all(ResponseStream& stream, size_t slice) {
+    std::string body;
+    std::vector<uint8_t> buffer(slice);
+    size_t len;
+    while ((len = stream.read(buffer.data(), slice)) > 0) {
+        body.append((const char*)buffer.data(), len);
+    }
+    return body;
+}
+
+// Pieces of 1 to 5000 bytes, so some are split over several slices and some slices hold many
+static bool pieces(Print& out, size_t item) {
+    static const size_t SIZES[] = { 1, 17, 5000, 3, 1436, 1437, 0, 200, 4096, 2 };
+    if (item >= sizeof(SIZES) / sizeof(SIZES[0])) {
+        return false;
+    }
+    for (size_t i = 0; i < SIZES[item]; i++) {
+        out.write((uint8_t)('a' + (item + i) % 26));
+    }
+    return true;
+}
+
+static std::string expected_pieces() {
+    StreamString all;
+    for (size_t item = 0; pieces(all, item); item++) {
+    }
+    return all.c_str();
+}
+
+static void record_day() {
+    for (size_t i = 0; i <= HISTORY_CAPACITY; i++) {
+        history_record(HISTORY_TEMPERATURE, 20.0f + (float)(i % 97U) / 10.0f);
+        native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL);
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_body_is_intact_at_every_slice_size(void) {
+    const std::string expected = expected_pieces();
+    for (size_t slice : { (size_t)1U, (size_t)7U, (size_t)37U, (size_t)1436U, (size_t)4096U, (size_t)20000U }) {
+        ResponseStream stream(pieces);
+        const std::string body = read_all(stream, slice);
+        TEST_ASSERT_EQUAL_size_t(expected.size(), body.size());
+        TEST_ASSERT_TRUE(body == expected);
+        // Stays finished
+        uint8_t buffer[16];
+        TEST_ASSERT_EQUAL_size_t(0U, stream.read(buffer, sizeof(buffer)));
+    }
+}
+
+void test_empty_body(void) {
+    size_t calls = 0;
+    ResponseStream stream([&](Print&, size_t) {
+        calls++;
+        return false;
+    });
+    uint8_t buffer[64];
+    TEST_ASSERT_EQUAL_size_t(0U, stream.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_size_t(0U, stream.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_size_t(1U, calls);
+}
+
+void test_producer_is_called_only_when_the_buffer_has_room(void) {
+    std::vector<size_t> items;
+    ResponseStream stream([&](Print& out, size_t item) {
+        items.push_back(item);
+        out.print("0123456789");
+        return item < 9U;
+    });
+    uint8_t buffer[25];
+    TEST_ASSERT_EQUAL_size_t(25U, stream.read(buffer, sizeof(buffer)));
+    // The third piece did not fit, its rest comes first in the next slice
+    TEST_ASSERT_EQUAL_size_t(3U, items.size());
+    TEST_ASSERT_EQUAL_size_t(25U, stream.read(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_UINT8('5', buffer[0]);
+    TEST_ASSERT_EQUAL_size_t(5U, items.size());
+}
+
+void test_history_body_streams_like_a_string(void) {
+    record_day();
+    const uint32_t to = history_now();
+    const uint32_t from = to - HISTORY_CAPACITY * HISTORY_INTERVAL_S;
+
+    StreamString whole;
+    HistoryJsonWriter writer(HISTORY_TEMPERATURE, from, to, HISTORY_CAPACITY);
+    for (size_t item = 0; writer.write(whole, item); item++) {
+    }
+    HistoryJsonWriter streamed(HISTORY_TEMPERATURE, from, to, HISTORY_CAPACITY);
+    ResponseStream stream([&streamed](Print& out, size_t item) { return streamed.write(out, item); });
+    const std::string body = read_all(stream, 37U);
+    TEST_ASSERT_EQUAL_size_t(whole.length(), body.size());
+    TEST_ASSERT_TRUE(body == whole.c_str());
+}
+
+void test_streaming_benchmark(void) {
+    const uint32_t to = history_now();
+    const uint32_t from = to - HISTORY_CAPACITY * HISTORY_INTERVAL_S;
+    const int rounds = 20;
+    size_t bodySize = 0;
+    size_t stringPeak = 0;
+    size_t streamPeak = 0;
+    double stringFirstUs = 0;
+    double streamFirstUs = 0;
+    double stringTotalUs = 0;
+    double streamTotalUs = 0;
+    std::vector<uint8_t> buffer(SEND_BUFFER);
+
+    for (int round = 0; round < rounds; round++) {
+        // Before: the body is serialized into one String, then copied out a send buffer at a time
+        size_t baseline = heap_used();
+        auto start = std::chrono::steady_clock::now();
+        {
+            StreamString whole;
+            HistoryJsonWriter writer(HISTORY_TEMPERATURE, from, to, HISTORY_CAPACITY);
+            for (size_t item = 0; writer.write(whole, item); item++) {
+            }
+            stringPeak = std::max(stringPeak, heap_used() - baseline);
+            for (size_t sent = 0; sent < whole.length(); sent += SEND_BUFFER) {
+                const size_t len = std::min(SEND_BUFFER, (size_t)whole.length() - sent);
+                memcpy(buffer.data(), whole.c_str() + sent, len);
+                if (sent == 0) {
+                    stringFirstUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                }
+            }
+            bodySize = whole.length();
+        }
+        stringTotalUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        // After: each send buffer is filled by the producer
+        baseline = heap_used();
+        start = std::chrono::steady_clock::now();
+        {
+            HistoryJsonWriter writer(HISTORY_TEMPERATURE, from, to, HISTORY_CAPACITY);
+            ResponseStream stream([&writer](Print& out, size_t item) { return writer.write(out, item); });
+            size_t len;
+            bool first = true;
+            while ((len = stream.read(buffer.data(), SEND_BUFFER)) > 0) {
+                if (first) {
+                    streamFirstUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                    first = false;
+                }
+                streamPeak = std::max(streamPeak, heap_used() - baseline);
+            }
+        }
+        streamTotalUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    printf("/history, %zu points, %zu byte body, %zu byte send buffer\n", (size_t)HISTORY_CAPACITY, bodySize, SEND_BUFFER);
+    printf("            peak heap B   first chunk us   whole body us\n");
+    printf("String      %11zu   %14.1f   %13.1f\n", stringPeak, stringFirstUs / rounds, stringTotalUs / rounds);
+    printf("stream      %11zu   %14.1f   %13.1f\n", streamPeak, streamFirstUs / rounds, streamTotalUs / rounds);
+
+    // The String holds the whole body, the stream at most one point that did not fit
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(bodySize, stringPeak);
+    TEST_ASSERT_LESS_THAN_size_t(256U, streamPeak);
+    TEST_ASSERT_LESS_THAN_DOUBLE(stringFirstUs, streamFirstUs);
+}
+
+int main(int argc, char** argv) {
+    native_clock_set_us(0);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_body_is_intact_at_every_slice_size);
+    RUN_TEST(test_empty_body);
+    RUN_TEST(test_producer_is_called_only_when_the_buffer_has_room);
+    RUN_TEST(test_history_body_streams_like_a_string);
+    RUN_TEST(test_streaming_benchmark);
+    return UNITY_END();
+}
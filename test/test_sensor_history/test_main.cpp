@@ -0,0 +1,265 @@
+// Sensor history and its Largest-Triangle-Three-Buckets downsampling (src/sensor_history.cpp) on
+// the virtual clock of the shims. The samples are recorded like the sensor tasks do, the ring keeps
+// HISTORY_CAPACITY of them: one day in env:native, 1M points in env:native_history for the benchmark.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <StreamString.h>
+#include "native_board.h"
+#include "sensor_history.h"
+
+#include <chrono>
+#include <math.h>
+#include <vector>
+
+static const size_t BENCHMARK_POINTS = HISTORY_CAPACITY < 1000000 ? HISTORY_CAPACITY : 1000000;
+
+static uint32_t seed = 1;
+
+static uint32_t next_random() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// Records one reading per interval, each one closes the sample of the previous interval. Returns
+// the time of the first sample.
+static uint32_t record(HistoryMetric metric, const std::vector<float>& values) {
+    const uint32_t first = history_now();
+    for (float value : values) {
+        history_record(metric, value);
+        native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL);
+    }
+    // Closes the last sample, the reading starts the next interval
+    history_record(metric, 0.0f);
+    native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL);
+    return first;
+}
+
+static std::vector<HistorySample> query(HistoryMetric metric, uint32_t from, uint32_t to, size_t maxPoints) {
+    std::vector<HistorySample> points;
+    HistoryQuery query(metric, from, to, maxPoints);
+    HistorySample sample;
+    while (query.next(sample)) {
+        points.push_back(sample);
+    }
+    TEST_ASSERT_EQUAL_size_t(query.size(), points.size());
+    return points;
+}
+
+static std::vector<float> noise(size_t count) {
+    std::vector<float> values(count);
+    for (float& value : values) {
+        value = 20.0f + (float)(next_random() % 1000U) / 100.0f;
+    }
+    return values;
+}
+
+// LTTB over the whole series in memory, with the buckets of HistoryQuery
+static std::vector<size_t> reference_lttb(const std::vector<HistorySample>& series, size_t points) {
+    const size_t count = series.size();
+    std::vector<size_t> selected = { 0 };
+    const double every = (double)(count - 2) / (points - 2);
+    for (size_t bucket = 0; bucket < points - 2; bucket++) {
+        const size_t start = (size_t)(bucket * every) + 1;
+        const size_t end = std::min((size_t)((bucket + 1) * every) + 1, count - 1);
+        const size_t nextEnd = std::min((size_t)((bucket + 2) * every) + 1, count);
+        const HistorySample& a = series[selected.back()];
+        double avgTime = 0, avgValue = 0;
+        size_t nextCount = 0;
+        for (size_t i = end < nextEnd ? end : count - 1; i < nextEnd; i++, nextCount++) {
+            avgTime += (double)series[i].time - a.time;
+            avgValue += series[i].value;
+        }
+        if (nextCount == 0) {
+            avgTime = (double)series[count - 1].time - a.time;
+            avgValue = series[count - 1].value;
+            nextCount = 1;
+        }
+        avgTime /= nextCount;
+        avgValue = avgValue / nextCount - a.value;
+        double maxArea = -1;
+        size_t best = start;
+        for (size_t i = start; i < end; i++) {
+            const double area = fabs(((double)series[i].time - a.time) * avgValue - avgTime * ((double)series[i].value - a.value));
+            if (area > maxArea) {
+                maxArea = area;
+                best = i;
+            }
+        }
+        selected.push_back(best);
+    }
+    selected.push_back(count - 1);
+    return selected;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_readings_are_averaged_per_interval(void) {
+    const uint32_t start = history_now();
+    for (float value : { 20.0f, 21.0f, 22.0f, 25.0f }) {
+        history_record(HISTORY_TEMPERATURE, value);
+        native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL / 4U);
+    }
+    history_record(HISTORY_TEMPERATURE, NAN);
+    history_record(HISTORY_TEMPERATURE, 30.0f);
+    native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL);
+    history_record(HISTORY_TEMPERATURE, 0.0f);
+
+    const std::vector<HistorySample> points = query(HISTORY_TEMPERATURE, start, history_now(), 10U);
+    TEST_ASSERT_EQUAL_size_t(2U, points.size());
+    TEST_ASSERT_EQUAL_UINT32(start, points[0].time);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 22.0f, points[0].value);
+    TEST_ASSERT_EQUAL_UINT32(start + HISTORY_INTERVAL_S, points[1].time);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 30.0f, points[1].value);
+    native_clock_advance_us(HISTORY_INTERVAL_S * 1000000ULL);
+}
+
+void test_short_range_is_returned_whole(void) {
+    const std::vector<float> values = noise(50U);
+    const uint32_t first = record(HISTORY_HUMIDITY, values);
+    const uint32_t last = first + (values.size() - 1U) * HISTORY_INTERVAL_S;
+
+    std::vector<HistorySample> points = query(HISTORY_HUMIDITY, first, last, 200U);
+    TEST_ASSERT_EQUAL_size_t(values.size(), points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(first + i * HISTORY_INTERVAL_S, points[i].time);
+        TEST_ASSERT_EQUAL_FLOAT(values[i], points[i].value);
+    }
+    // from and to are inclusive
+    points = query(HISTORY_HUMIDITY, first + 10U * HISTORY_INTERVAL_S, first + 19U * HISTORY_INTERVAL_S, 200U);
+    TEST_ASSERT_EQUAL_size_t(10U, points.size());
+    TEST_ASSERT_EQUAL_FLOAT(values[10], points.front().value);
+    TEST_ASSERT_EQUAL_FLOAT(values[19], points.back().value);
+    TEST_ASSERT_EQUAL_size_t(0U, query(HISTORY_HUMIDITY, last + 1U, last + 100U, 200U).size());
+    TEST_ASSERT_EQUAL_size_t(0U, query(HISTORY_HUMIDITY, last, first, 200U).size());
+}
+
+void test_downsampling_matches_reference(void) {
+    const size_t count = std::min<size_t>(HISTORY_CAPACITY, 1000U);
+    const std::vector<float> values = noise(count);
+    const uint32_t first = record(HISTORY_LIGHT, values);
+    const uint32_t last = first + (count - 1U) * HISTORY_INTERVAL_S;
+    const std::vector<HistorySample> series = query(HISTORY_LIGHT, first, last, count);
+    TEST_ASSERT_EQUAL_size_t(count, series.size());
+
+    for (size_t maxPoints : { (size_t)3U, (size_t)7U, (size_t)200U, count - 1U }) {
+        const std::vector<HistorySample> points = query(HISTORY_LIGHT, first, last, maxPoints);
+        const std::vector<size_t> expected = reference_lttb(series, maxPoints);
+        TEST_ASSERT_EQUAL_size_t(maxPoints, points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            TEST_ASSERT_EQUAL_UINT32(series[expected[i]].time, points[i].time);
+            TEST_ASSERT_EQUAL_FLOAT(series[expected[i]].value, points[i].value);
+        }
+    }
+    // LTTB needs the first, the last and one bucket in between
+    TEST_ASSERT_EQUAL_size_t(3U, query(HISTORY_LIGHT, first, last, 1U).size());
+}
+
+void test_downsampling_keeps_spikes(void) {
+    std::vector<float> values(std::min<size_t>(HISTORY_CAPACITY, 1000U), 25.0f);
+    values[333] = 60.0f;
+    values[777] = -10.0f;
+    const uint32_t first = record(HISTORY_TEMPERATURE, values);
+    const uint32_t last = first + (values.size() - 1U) * HISTORY_INTERVAL_S;
+
+    const std::vector<HistorySample> points = query(HISTORY_TEMPERATURE, first, last, 20U);
+    TEST_ASSERT_EQUAL_size_t(20U, points.size());
+    TEST_ASSERT_EQUAL_UINT32(first, points.front().time);
+    TEST_ASSERT_EQUAL_UINT32(last, points.back().time);
+    bool high = false;
+    bool low = false;
+    for (size_t i = 0; i < points.size(); i++) {
+        high = high || (points[i].value == 60.0f && points[i].time == first + 333U * HISTORY_INTERVAL_S);
+        low = low || (points[i].value == -10.0f && points[i].time == first + 777U * HISTORY_INTERVAL_S);
+        if (i > 0) {
+            TEST_ASSERT_GREATER_THAN_UINT32(points[i - 1].time, points[i].time);
+        }
+    }
+    TEST_ASSERT_TRUE(high);
+    TEST_ASSERT_TRUE(low);
+}
+
+void test_json_writer_streams_the_query(void) {
+    const std::vector<float> values = noise(300U);
+    const uint32_t first = record(HISTORY_HUMIDITY, values);
+    const uint32_t last = first + (values.size() - 1U) * HISTORY_INTERVAL_S;
+
+    StreamString out;
+    HistoryJsonWriter writer(HISTORY_HUMIDITY, first, last, 50U);
+    size_t items = 0;
+    while (writer.write(out, items)) {
+        items++;
+    }
+    TEST_ASSERT_EQUAL_size_t(51U, items);
+
+    DynamicJsonDocument doc(16384);
+    TEST_ASSERT_TRUE(deserializeJson(doc, out.c_str()) == DeserializationError::Ok);
+    const std::string metric = doc["metric"].as<const char*>();
+    TEST_ASSERT_EQUAL_STRING("humidity", metric.c_str());
+    TEST_ASSERT_EQUAL_UINT32(first, doc["from"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_INT(HISTORY_INTERVAL_S, doc["interval"].as<int>());
+    const std::vector<HistorySample> points = query(HISTORY_HUMIDITY, first, last, 50U);
+    JsonArray array = doc["points"].as<JsonArray>();
+    TEST_ASSERT_EQUAL_size_t(points.size(), array.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(points[i].time, array[i][0].as<uint32_t>());
+        TEST_ASSERT_FLOAT_WITHIN(0.005f, points[i].value, array[i][1].as<float>());
+    }
+}
+
+void test_oldest_samples_are_overwritten(void) {
+    const std::vector<float> values = noise(HISTORY_CAPACITY + 100U);
+    const uint32_t first = record(HISTORY_HUMIDITY, values);
+    const uint32_t last = first + (values.size() - 1U) * HISTORY_INTERVAL_S;
+
+    HistoryQuery all(HISTORY_HUMIDITY, first, last, HISTORY_CAPACITY + 100U);
+    TEST_ASSERT_EQUAL_size_t(HISTORY_CAPACITY, all.size());
+    HistorySample sample;
+    TEST_ASSERT_TRUE(all.next(sample));
+    TEST_ASSERT_EQUAL_UINT32(first + 100U * HISTORY_INTERVAL_S, sample.time);
+    TEST_ASSERT_EQUAL_FLOAT(values[100], sample.value);
+}
+
+void test_downsampling_benchmark(void) {
+    std::vector<float> values = noise(BENCHMARK_POINTS);
+    auto start = std::chrono::steady_clock::now();
+    const uint32_t first = record(HISTORY_LIGHT, values);
+    const double recordNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+        (BENCHMARK_POINTS + 1U);
+    const uint32_t last = first + (BENCHMARK_POINTS - 1U) * HISTORY_INTERVAL_S;
+
+    printf("samples     points   query ms   ns/sample   Msamples/s   (recording %.0f ns/reading)\n", recordNs);
+    for (size_t maxPoints : { (size_t)HISTORY_DEFAULT_POINTS, (size_t)HISTORY_WS_MAX_POINTS, (size_t)2000U }) {
+        const int rounds = 5;
+        size_t produced = 0;
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            produced = query(HISTORY_LIGHT, first, last, maxPoints).size();
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / rounds;
+        printf("%7zu   %8zu   %8.2f   %9.2f   %10.1f\n", BENCHMARK_POINTS, produced, ms,
+               ms * 1e6 / BENCHMARK_POINTS, BENCHMARK_POINTS / ms / 1e3);
+
+        TEST_ASSERT_EQUAL_size_t(std::min(maxPoints, BENCHMARK_POINTS), produced);
+        // Every sample is read once or twice (as a candidate and in the next bucket's average)
+        TEST_ASSERT_LESS_THAN_DOUBLE(100.0, ms * 1e6 / BENCHMARK_POINTS);
+    }
+}
+
+int main(int argc, char** argv) {
+    native_clock_set_us(0);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_readings_are_averaged_per_interval);
+    RUN_TEST(test_short_range_is_returned_whole);
+    RUN_TEST(test_downsampling_matches_reference);
+    RUN_TEST(test_downsampling_keeps_spikes);
+    RUN_TEST(test_json_writer_streams_the_query);
+    RUN_TEST(test_oldest_samples_are_overwritten);
+    RUN_TEST(test_downsampling_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,243 @@
+// Sensor simulation of the native environment (lib/NativeShims/src/sensor_sim.cpp): traces must be
+// repeatable for a seed, follow the daily cycle within the sensor's range and resolution, spike and
+// drop out at the configured rates, and reach the firmware through the DHT and analogRead shims
+// with every reading journaled at the time it was taken.
+#include <unity.h>
+#include <Arduino.h>
+#include <DHT.h>
+#include "native_board.h"
+#include "sensor_sim.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Same as the simulation's, the shapes themselves are private to it
+static const TraceShape TEMPERATURE = { 26.0f, 4.0f, 15.0f, false, 0.15f, 0.8f, 5.0f, 90.0f, -10.0f, 60.0f, 0.1f };
+static const TraceShape LIGHT = { 120.0f, 3000.0f, 12.0f, true, 25.0f, 300.0f, -2500.0f, 20.0f, 0.0f, 4095.0f, 1.0f };
+
+static const uint32_t HOUR_MS = 3600000U;
+
+static SensorSimConfig config_with(uint32_t seed, float dropout = 0.02f, float spikesPerHour = 0.5f) {
+    SensorSimConfig config;
+    config.seed = seed;
+    config.daySeconds = 86400.0f;
+    config.startHour = 0.0f;
+    config.dropout = dropout;
+    config.spikesPerHour = spikesPerHour;
+    return config;
+}
+
+// Mean over an hour around the given time of day
+static float hour_mean(const SensorTrace& trace, float hour) {
+    const uint32_t center = (uint32_t)(hour * HOUR_MS);
+    float sum = 0;
+    int count = 0;
+    for (uint32_t ms = center - HOUR_MS / 2; ms < center + HOUR_MS / 2; ms += 10000U) {
+        sum += trace.value(ms);
+        count++;
+    }
+    return sum / count;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_traces_repeat_for_a_seed(void) {
+    const SensorTrace a(TEMPERATURE, config_with(7), 1);
+    const SensorTrace b(TEMPERATURE, config_with(7), 1);
+    const SensorTrace otherSeed(TEMPERATURE, config_with(8), 1);
+    const SensorTrace otherChannel(TEMPERATURE, config_with(7), 2);
+    int differentSeed = 0;
+    int differentChannel = 0;
+    // Also backwards: a value only depends on the time
+    for (uint32_t ms = 48U * HOUR_MS; ms > 0; ms -= 60000U) {
+        TEST_ASSERT_EQUAL_FLOAT(a.value(ms), b.value(ms));
+        differentSeed += a.value(ms) != otherSeed.value(ms);
+        differentChannel += a.value(ms) != otherChannel.value(ms);
+    }
+    TEST_ASSERT_GREATER_THAN(2000, differentSeed);
+    TEST_ASSERT_GREATER_THAN(2000, differentChannel);
+
+    DhtSimulator first(config_with(7, 0.2f));
+    DhtSimulator second(config_with(7, 0.2f));
+    for (uint32_t ms = 0; ms < 1000U * 2000U; ms += 2000U) {
+        const DhtSample x = first.read(ms);
+        const DhtSample y = second.read(ms);
+        TEST_ASSERT_EQUAL(isnan(x.temperature), isnan(y.temperature));
+        if (!isnan(x.temperature)) {
+            TEST_ASSERT_EQUAL_FLOAT(x.temperature, y.temperature);
+            TEST_ASSERT_EQUAL_FLOAT(x.humidity, y.humidity);
+        }
+    }
+}
+
+void test_values_stay_in_range_and_resolution(void) {
+    // Many large spikes push the values against the limits
+    const SensorSimConfig config = config_with(3, 0.0f, 6.0f);
+    const SensorTrace temperature(TEMPERATURE, config, 1);
+    const SensorTrace light(LIGHT, config, 3);
+    for (uint32_t ms = 0; ms < 72U * HOUR_MS; ms += 7000U) {
+        const float t = temperature.value(ms);
+        TEST_ASSERT_TRUE(t >= -10.0f && t <= 60.0f);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, roundf(t * 10.0f), t * 10.0f);
+        const float l = light.value(ms);
+        TEST_ASSERT_TRUE(l >= 0.0f && l <= 4095.0f);
+        TEST_ASSERT_EQUAL_FLOAT(roundf(l), l);
+    }
+}
+
+void test_daily_cycle(void) {
+    const SensorSimConfig config = config_with(11, 0.0f, 0.0f);
+    const SensorTrace temperature(TEMPERATURE, config, 1);
+    const SensorTrace light(LIGHT, config, 3);
+    // Warmest in the afternoon, 2 * amplitude between peak and trough, less the drift
+    const float afternoon = hour_mean(temperature, 15.0f);
+    const float night = hour_mean(temperature, 3.0f);
+    TEST_ASSERT_GREATER_THAN(5, (int)(afternoon - night));
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 26.0f, hour_mean(temperature, 9.0f));
+    // Lamps at night, daylight at noon
+    TEST_ASSERT_LESS_THAN(500, (int)hour_mean(light, 1.0f));
+    TEST_ASSERT_GREATER_THAN(2500, (int)hour_mean(light, 12.0f));
+
+    // A shorter simulated day only speeds the cycle up
+    SensorSimConfig fast = config;
+    fast.daySeconds = 600.0f;
+    const SensorTrace fastLight(LIGHT, fast, 3);
+    TEST_ASSERT_LESS_THAN(500, (int)fastLight.value(50000U));
+    TEST_ASSERT_GREATER_THAN(2500, (int)fastLight.value(300000U));
+}
+
+void test_spikes_at_the_configured_rate(void) {
+    const float rate = 0.5f;
+    const SensorTrace spiky(TEMPERATURE, config_with(5, 0.0f, rate), 1);
+    const SensorTrace calm(TEMPERATURE, config_with(5, 0.0f, 0.0f), 1);
+    // The noise and drift are the same, the difference is the spikes
+    const uint32_t hours = 400U;
+    int spikes = 0;
+    bool inSpike = false;
+    float largest = 0;
+    for (uint32_t ms = 0; ms < hours * HOUR_MS; ms += 5000U) {
+        const float difference = spiky.value(ms) - calm.value(ms);
+        TEST_ASSERT_TRUE(difference > -0.05f);
+        largest = fmaxf(largest, difference);
+        if (!inSpike && difference >= 1.0f) {
+            spikes++;
+        }
+        inSpike = difference >= 0.2f;
+    }
+    printf("%d spikes in %u hours (expected %.0f), largest %.1f\n", spikes, hours, rate * hours, largest);
+    TEST_ASSERT_INT_WITHIN((int)(rate * hours * 0.3f), (int)(rate * hours), spikes);
+    TEST_ASSERT_TRUE(largest >= 2.4f && largest <= 7.6f);
+}
+
+void test_dropouts_come_in_bursts(void) {
+    const float dropout = 0.05f;
+    DhtSimulator dht(config_with(9, dropout));
+    const int reads = 200000;
+    int failed = 0;
+    int bursts = 0;
+    bool failing = false;
+    for (int i = 0; i < reads; i++) {
+        const DhtSample sample = dht.read((uint32_t)i * 2000U);
+        // Both values of a measurement fail together
+        TEST_ASSERT_EQUAL(isnan(sample.temperature), isnan(sample.humidity));
+        if (isnan(sample.temperature)) {
+            failed++;
+            bursts += !failing;
+        }
+        failing = isnan(sample.temperature);
+    }
+    // A failure continues with probability 0.5: bursts of 2 reads on average
+    const float expected = dropout / (dropout + 0.5f);
+    const float share = (float)failed / reads;
+    const float burst = (float)failed / bursts;
+    printf("failed reads %.2f %% (expected %.2f %%), %.2f reads per burst\n", share * 100, expected * 100, burst);
+    TEST_ASSERT_FLOAT_WITHIN(expected * 0.1f, expected, share);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 2.0f, burst);
+}
+
+void test_journal(void) {
+    SampleJournal journal;
+    uint32_t us;
+    uint32_t sequence;
+    TEST_ASSERT_FALSE(journal.find(1.0f, 2.0f, 0.01f, us, sequence));
+    TEST_ASSERT_EQUAL_size_t(0U, journal.intervals().size());
+
+    // More than fit, the oldest are forgotten
+    for (uint32_t i = 0; i < 600U; i++) {
+        journal.record(1000U + i * 250U, (float)(i % 50U), 0.5f);
+    }
+    // The newest match wins
+    TEST_ASSERT_TRUE(journal.find(7.0f, 0.5f, 0.01f, us, sequence));
+    TEST_ASSERT_EQUAL_UINT32(557U, sequence);
+    TEST_ASSERT_EQUAL_UINT32(1000U + 557U * 250U, us);
+    TEST_ASSERT_TRUE(journal.find(7.004f, 0.5f, 0.01f, us, sequence));
+    TEST_ASSERT_FALSE(journal.find(7.0f, 0.6f, 0.01f, us, sequence));
+    TEST_ASSERT_FALSE(journal.find(50.0f, 0.5f, 0.01f, us, sequence));
+
+    const std::vector<uint32_t> intervals = journal.intervals();
+    TEST_ASSERT_EQUAL_size_t(511U, intervals.size());
+    for (uint32_t interval : intervals) {
+        TEST_ASSERT_EQUAL_UINT32(250U, interval);
+    }
+}
+
+// Last, the shims use the configuration of the environment from the first read on
+void test_readings_through_the_firmware_path(void) {
+    const SensorSimConfig config = SensorSimConfig::fromEnvironment();
+    TEST_ASSERT_EQUAL_UINT32(42U, config.seed);
+    TEST_ASSERT_EQUAL_FLOAT(0.25f, config.dropout);
+    DhtSimulator reference(config);
+    DHT dht(4, DHT11);
+    dht.begin();
+
+    // Warming up: fails, without using up the dropouts of the reference
+    native_clock_set_us(200000U);
+    TEST_ASSERT_TRUE(isnan(dht.readTemperature()));
+    native_clock_set_us(1000000U);
+    int failed = 0;
+    for (int i = 0; i < 200; i++) {
+        const DhtSample expected = reference.read(millis());
+        const float temperature = dht.readTemperature();
+        const float humidity = dht.readHumidity();
+        if (isnan(expected.temperature)) {
+            TEST_ASSERT_TRUE(isnan(temperature) && isnan(humidity));
+            failed++;
+        } else {
+            TEST_ASSERT_EQUAL_FLOAT(expected.temperature, temperature);
+            TEST_ASSERT_EQUAL_FLOAT(expected.humidity, humidity);
+            uint32_t us;
+            uint32_t sequence;
+            TEST_ASSERT_TRUE(sensor_sim_dht_journal().find(temperature, humidity, 0.001f, us, sequence));
+            TEST_ASSERT_EQUAL_UINT32(micros(), us);
+        }
+        delay(2000);
+    }
+    TEST_ASSERT_GREATER_THAN(20, failed);
+
+    const SensorTrace light(LIGHT, config, 3);
+    for (int i = 0; i < 50; i++) {
+        TEST_ASSERT_EQUAL_UINT16((uint16_t)light.value(millis()), analogRead(1));
+        delay(100);
+    }
+    const std::vector<uint32_t> intervals = sensor_sim_light_journal().intervals();
+    TEST_ASSERT_EQUAL_size_t(49U, intervals.size());
+    TEST_ASSERT_EQUAL_UINT32(100000U, intervals.back());
+}
+
+int main(int argc, char** argv) {
+    setenv("NATIVE_SIM_SEED", "42", 1);
+    setenv("NATIVE_SIM_DROPOUT", "0.25", 1);
+    native_clock_set_us(0);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_traces_repeat_for_a_seed);
+    RUN_TEST(test_values_stay_in_range_and_resolution);
+    RUN_TEST(test_daily_cycle);
+    RUN_TEST(test_spikes_at_the_configured_rate);
+    RUN_TEST(test_dropouts_come_in_bursts);
+    RUN_TEST(test_journal);
+    RUN_TEST(test_readings_through_the_firmware_path);
+    return UNITY_END();
+}
@@ -0,0 +1,306 @@
+// Settings store (src/settings_store.cpp) on the Preferences shim, which counts flash writes the
+// way NVS does. SettingsStore::loop runs every 100 ms of the virtual clock like in the web server
+// loop, while a dashboard drags the color pickers and types a threshold. The writes of such a
+// session are compared with the per value keys that every save used to write.
+#include <unity.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include "native_board.h"
+#include "settings_store.h"
+
+#include <stdlib.h>
+#include <string>
+
+static const uint32_t LOOP_MS = 100;
+
+// Registered for the shutdown handlers by its begin(), which the first test calls
+static SettingsStore shutdownStore;
+
+static void run_for(SettingsStore& store, uint32_t ms) {
+    for (uint32_t elapsed = 0; elapsed < ms; elapsed += LOOP_MS) {
+        native_clock_advance_us(LOOP_MS * 1000ULL);
+        store.loop();
+    }
+}
+
+static NativeNvsWrites writes_since(const NativeNvsWrites& before) {
+    const NativeNvsWrites now = native_nvs_writes();
+    return { now.writes - before.writes, now.unchanged - before.unchanged, now.entries - before.entries };
+}
+
+static void hex_of(uint8_t r, uint8_t g, uint8_t b, char* hex) {
+    snprintf(hex, SETTINGS_MAX_HEX + 1, "#%02x%02x%02x", r, g, b);
+}
+
+// What the dashboard sends in one session: 6 s of dragging the color picker at 20 messages a
+// second, the alert color picked in 5 tries, and "2", "28", "28.", "28.5" typed as threshold
+class Session {
+public:
+    virtual void neoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) = 0;
+    virtual void alertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) = 0;
+    virtual void threshold(float value) = 0;
+    virtual void idle(uint32_t ms) = 0;
+
+    int run(int round) {
+        int saves = 0;
+        char hex[SETTINGS_MAX_HEX + 1];
+        for (int i = 0; i < 120; i++, saves++) {
+            const uint8_t g = (uint8_t)(round * 40 + i);
+            hex_of(10, g, 200, hex);
+            neoColor(10, g, 200, hex);
+            idle(50);
+        }
+        for (int i = 0; i < 5; i++, saves++) {
+            const uint8_t r = (uint8_t)(200 + round + i * 10);
+            hex_of(r, 0, 0, hex);
+            alertColor(r, 0, 0, hex);
+            idle(400);
+        }
+        for (float value : { 2.0f, 28.0f, 28.0f, 28.5f }) {
+            threshold(value + round);
+            saves++;
+            idle(300);
+        }
+        return saves;
+    }
+};
+
+// Every save written right away, as saveNeoColor, saveAlertColor and saveTempThreshold did
+class PerValueSession : public Session {
+public:
+    explicit PerValueSession(Preferences& preferences) : preferences(preferences) {}
+
+    void neoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) override {
+        preferences.putUChar("neo_r", r);
+        preferences.putUChar("neo_g", g);
+        preferences.putUChar("neo_b", b);
+        preferences.putString("neo_hex", hex);
+    }
+    void alertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) override {
+        preferences.putUChar("alert_r", r);
+        preferences.putUChar("alert_g", g);
+        preferences.putUChar("alert_b", b);
+        preferences.putString("alert_hex", hex);
+    }
+    void threshold(float value) override {
+        preferences.putFloat("temp_threshold", value);
+    }
+    void idle(uint32_t ms) override {
+        native_clock_advance_us(ms * 1000ULL);
+    }
+
+private:
+    Preferences& preferences;
+};
+
+class StoreSession : public Session {
+public:
+    explicit StoreSession(SettingsStore& store) : store(store), sinceLoop(0) {}
+
+    void neoColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) override {
+        store.setNeoColor(r, g, b, hex);
+    }
+    void alertColor(uint8_t r, uint8_t g, uint8_t b, const char* hex) override {
+        store.setAlertColor(r, g, b, hex);
+    }
+    void threshold(float value) override {
+        store.setTempThreshold(value);
+    }
+    void idle(uint32_t ms) override {
+        for (uint32_t elapsed = 0; elapsed < ms; elapsed += 10) {
+            native_clock_advance_us(10000ULL);
+            sinceLoop += 10;
+            if (sinceLoop >= LOOP_MS) {
+                store.loop();
+                sinceLoop = 0;
+            }
+        }
+    }
+
+private:
+    SettingsStore& store;
+    uint32_t sinceLoop;
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_flushed_on_shutdown(void) {
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("shutdown"));
+    shutdownStore.begin(&preferences);
+    shutdownStore.setTempThreshold(33.5f);
+    run_for(shutdownStore, SETTINGS_FLUSH_QUIET_MS / 2);
+    TEST_ASSERT_FALSE(preferences.isKey(SETTINGS_KEY));
+
+    // A restart in the middle of a session keeps what was saved so far
+    native_run_shutdown_handlers();
+    TEST_ASSERT_TRUE(preferences.isKey(SETTINGS_KEY));
+    SettingsStore reloaded;
+    reloaded.begin(&preferences);
+    TEST_ASSERT_EQUAL_FLOAT(33.5f, reloaded.get().tempThreshold);
+}
+
+void test_writes_per_session(void) {
+    const int sessions = 5;
+    Preferences perValue;
+    TEST_ASSERT_TRUE(perValue.begin("per_value"));
+    PerValueSession before(perValue);
+    NativeNvsWrites start = native_nvs_writes();
+    int saves = 0;
+    for (int round = 0; round < sessions; round++) {
+        saves += before.run(round);
+    }
+    const NativeNvsWrites perValueWrites = writes_since(start);
+
+    Preferences blob;
+    TEST_ASSERT_TRUE(blob.begin("blob"));
+    SettingsStore store;
+    store.begin(&blob);
+    StoreSession after(store);
+    start = native_nvs_writes();
+    const uint64_t blobWrites = metric_settings_writes.value();
+    for (int round = 0; round < sessions; round++) {
+        after.run(round);
+        after.idle(10000);
+    }
+    const NativeNvsWrites storeWrites = writes_since(start);
+
+    printf("%d sessions, %d saves\n", sessions, saves);
+    printf("             writes   entries   per session\n");
+    printf("per value  %8u %9u %13.1f\n", perValueWrites.writes, perValueWrites.entries, (double)perValueWrites.entries / sessions);
+    printf("blob       %8u %9u %13.1f\n", storeWrites.writes, storeWrites.entries, (double)storeWrites.entries / sessions);
+    // The color is dragged for longer than the quiet period is, then each session ends in one write
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)sessions, storeWrites.writes);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)sessions, metric_settings_writes.value() - blobWrites);
+    TEST_ASSERT_LESS_THAN_UINT32(perValueWrites.entries / 10, storeWrites.entries);
+
+    // What the last session left is what a reboot loads
+    SettingsStore reloaded;
+    reloaded.begin(&blob);
+    const Settings settings = reloaded.get();
+    TEST_ASSERT_EQUAL_FLOAT(28.5f + sessions - 1, settings.tempThreshold);
+    TEST_ASSERT_EQUAL_UINT8(244, settings.alertR);
+    const std::string hex = settings.neoHex;
+    TEST_ASSERT_EQUAL_STRING("#0a17c8", hex.c_str());
+}
+
+void test_quiet_period_and_deadline(void) {
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("deadline"));
+    SettingsStore store;
+    store.begin(&preferences);
+
+    // Not before the quiet period ends
+    const NativeNvsWrites start = native_nvs_writes();
+    store.setTempThreshold(25.0f);
+    run_for(store, SETTINGS_FLUSH_QUIET_MS - LOOP_MS);
+    TEST_ASSERT_EQUAL_UINT32(0U, writes_since(start).writes);
+    run_for(store, LOOP_MS);
+    TEST_ASSERT_EQUAL_UINT32(1U, writes_since(start).writes);
+
+    // Changes that never pause are written every SETTINGS_FLUSH_MAX_MS
+    const uint32_t ms = 3 * SETTINGS_FLUSH_MAX_MS + SETTINGS_FLUSH_QUIET_MS / 2;
+    for (uint32_t elapsed = 0; elapsed < ms; elapsed += 500) {
+        store.setTempThreshold(20.0f + elapsed / 5000.0f);
+        run_for(store, 500);
+    }
+    TEST_ASSERT_EQUAL_UINT32(4U, writes_since(start).writes);
+    run_for(store, SETTINGS_FLUSH_QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT32(5U, writes_since(start).writes);
+    // Nothing left to write
+    run_for(store, SETTINGS_FLUSH_MAX_MS);
+    TEST_ASSERT_TRUE(store.flush());
+    TEST_ASSERT_EQUAL_UINT32(5U, writes_since(start).writes);
+}
+
+void test_changes_back_to_the_stored_values(void) {
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("undo"));
+    SettingsStore store;
+    store.begin(&preferences);
+    const Settings stored = store.get();
+    const uint64_t changes = metric_settings_changes.value();
+
+    // A color tried and put back, a threshold typed and deleted: no write
+    const NativeNvsWrites start = native_nvs_writes();
+    store.setNeoColor(1, 2, 3, "#010203");
+    store.setTempThreshold(99.0f);
+    run_for(store, LOOP_MS);
+    store.setNeoColor(stored.neoR, stored.neoG, stored.neoB, stored.neoHex);
+    store.setTempThreshold(stored.tempThreshold);
+    run_for(store, SETTINGS_FLUSH_MAX_MS);
+    TEST_ASSERT_TRUE(store.flush());
+    TEST_ASSERT_EQUAL_UINT32(0U, writes_since(start).writes);
+    TEST_ASSERT_EQUAL_UINT64(4U, metric_settings_changes.value() - changes);
+}
+
+void test_failed_writes_are_retried(void) {
+    Preferences readOnly;
+    TEST_ASSERT_TRUE(readOnly.begin("read_only", true));
+    SettingsStore store;
+    store.begin(&readOnly);
+    const uint64_t failures = metric_settings_write_failures.value();
+    store.setTempThreshold(31.0f);
+    run_for(store, SETTINGS_FLUSH_QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT64(1U, metric_settings_write_failures.value() - failures);
+    // Once per quiet period, not on every loop
+    run_for(store, SETTINGS_FLUSH_QUIET_MS - LOOP_MS);
+    TEST_ASSERT_EQUAL_UINT64(1U, metric_settings_write_failures.value() - failures);
+    run_for(store, LOOP_MS);
+    TEST_ASSERT_EQUAL_UINT64(2U, metric_settings_write_failures.value() - failures);
+    TEST_ASSERT_FALSE(store.flush());
+    // The RAM copy still has the change
+    TEST_ASSERT_EQUAL_FLOAT(31.0f, store.get().tempThreshold);
+}
+
+void test_migrates_the_old_keys(void) {
+    Preferences preferences;
+    TEST_ASSERT_TRUE(preferences.begin("migrate"));
+    preferences.putUChar("neo_r", 1);
+    preferences.putUChar("neo_g", 2);
+    preferences.putUChar("neo_b", 3);
+    preferences.putString("neo_hex", "#010203");
+    preferences.putFloat("temp_threshold", 27.5f);
+
+    SettingsStore store;
+    store.begin(&preferences);
+    Settings settings = store.get();
+    TEST_ASSERT_EQUAL_UINT8(3, settings.neoB);
+    TEST_ASSERT_EQUAL_FLOAT(27.5f, settings.tempThreshold);
+    // The alert color was never saved, its default goes into the blob
+    TEST_ASSERT_EQUAL_UINT8(255, settings.alertR);
+    TEST_ASSERT_TRUE(preferences.isKey(SETTINGS_KEY));
+    for (const char* key : { "neo_r", "neo_g", "neo_b", "neo_hex", "temp_threshold" }) {
+        TEST_ASSERT_FALSE(preferences.isKey(key));
+    }
+
+    // The next boot reads the blob
+    const NativeNvsWrites start = native_nvs_writes();
+    SettingsStore rebooted;
+    rebooted.begin(&preferences);
+    settings = rebooted.get();
+    TEST_ASSERT_EQUAL_UINT8(2, settings.neoG);
+    TEST_ASSERT_EQUAL_UINT32(0U, writes_since(start).writes);
+}
+
+int main(int argc, char** argv) {
+    char directory[] = "/tmp/settings_store_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    const std::string root = directory;
+    setenv("NATIVE_NVS_DIR", root.c_str(), 1);
+    native_clock_set_us(1000000ULL);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_flushed_on_shutdown);
+    RUN_TEST(test_writes_per_session);
+    RUN_TEST(test_quiet_period_and_deadline);
+    RUN_TEST(test_changes_back_to_the_stored_values);
+    RUN_TEST(test_failed_writes_are_retried);
+    RUN_TEST(test_migrates_the_old_keys);
+    const int failures = UNITY_END();
+    const std::string cleanup = "rm -rf " + root;
+    system(cleanup.c_str());
+    return failures;
+}
@@ -0,0 +1,190 @@
+// SpscRing (include/spsc_ring.h) and the sensor channel built on it (src/sensor_channel.cpp): the
+// ring keeps order across its wrap-around, hands over only whole items while a producer and a
+// consumer task run side by side, and the channel counts the readings it has no room for. The
+// benchmark runs the queue benchmark of the native build (lib/NativeShims/src/queue_bench.h) on
+// the ring and on a FreeRTOS queue, idle and with busy threads competing for the CPUs.
+#include <unity.h>
+#include <Arduino.h>
+#include "metrics.h"
+#include "native_board.h"
+#include "queue_bench.h"
+#include "sensor_channel.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Every field follows from the sequence, so a torn copy shows
+struct Item {
+    uint32_t sequence;
+    uint32_t doubled;
+    uint64_t squared;
+    uint32_t inverted;
+};
+
+static Item item_for(uint32_t sequence) {
+    return { sequence, sequence * 2U, (uint64_t)sequence * sequence, ~sequence };
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_ring_fills_and_empties(void) {
+    static SpscRing<Item, 4> ring;
+    TEST_ASSERT_EQUAL_size_t(4U, ring.capacity());
+    Item item;
+    TEST_ASSERT_FALSE(ring.pop(item));
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.push(item_for(i)));
+    }
+    TEST_ASSERT_FALSE(ring.push(item_for(4)));
+    TEST_ASSERT_EQUAL_size_t(4U, ring.size());
+
+    // Around the ring many times, one to three items in it
+    uint32_t next = 0;
+    uint32_t sent = 4;
+    for (int round = 0; round < 1000; round++) {
+        const int take = 1 + round % 3;
+        for (int i = 0; i < take; i++) {
+            TEST_ASSERT_TRUE(ring.pop(item));
+            TEST_ASSERT_EQUAL_UINT32(next++, item.sequence);
+        }
+        while (ring.push(item_for(sent))) {
+            sent++;
+        }
+        TEST_ASSERT_EQUAL_size_t(4U, ring.size());
+    }
+    while (ring.pop(item)) {
+        TEST_ASSERT_EQUAL_UINT32(next++, item.sequence);
+    }
+    TEST_ASSERT_EQUAL_UINT32(sent, next);
+    TEST_ASSERT_EQUAL_size_t(0U, ring.size());
+}
+
+static SpscRing<Item, 16> crossRing;
+static const uint32_t CROSS_ITEMS = 2000000;
+static std::atomic<int> crossDone(0);
+static std::atomic<uint32_t> fullRetries(0);
+
+static void producer_task(void* arg) {
+    for (uint32_t i = 0; i < CROSS_ITEMS; i++) {
+        while (!crossRing.push(item_for(i))) {
+            fullRetries++;
+            taskYIELD();
+        }
+    }
+    crossDone++;
+    vTaskDelete(NULL);
+}
+
+static uint32_t consumed = 0;
+static uint32_t torn = 0;
+
+static void consumer_task(void* arg) {
+    Item item;
+    while (consumed < CROSS_ITEMS) {
+        if (!crossRing.pop(item)) {
+            taskYIELD();
+            continue;
+        }
+        const Item expected = item_for(consumed);
+        if (item.sequence != expected.sequence || item.doubled != expected.doubled ||
+            item.squared != expected.squared || item.inverted != expected.inverted) {
+            torn++;
+        }
+        consumed++;
+    }
+    crossDone++;
+    vTaskDelete(NULL);
+}
+
+void test_items_cross_tasks_whole(void) {
+    // A task on each core, like the Jobs task and the web server
+    xTaskCreatePinnedToCore(consumer_task, "consumer", 4096, NULL, 1, NULL, 0);
+    xTaskCreatePinnedToCore(producer_task, "producer", 4096, NULL, 1, NULL, 1);
+    while (crossDone < 2) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    printf("%u items, %u pushes retried on a full ring\n", consumed, fullRetries.load());
+    TEST_ASSERT_EQUAL_UINT32(CROSS_ITEMS, consumed);
+    TEST_ASSERT_EQUAL_UINT32(0U, torn);
+    TEST_ASSERT_EQUAL_size_t(0U, crossRing.size());
+}
+
+void test_sensor_channel(void) {
+    SensorSnapshot snapshot = {};
+    const uint64_t dropped = metric_sensor_channel_dropped.value();
+    // More readings than fit: the newest ones are dropped and counted
+    for (uint32_t i = 0; i < SENSOR_CHANNEL_DEPTH + 3; i++) {
+        SensorSample sample = i % 2 == 0 ? SensorSample{ SENSOR_SAMPLE_DHT, false, 20.0f + i, 50.0f + i, 1000U + i }
+                                         : SensorSample{ SENSOR_SAMPLE_LIGHT, i % 4 == 1, 100.0f + i, 0, 1000U + i };
+        sensor_channel_publish(sample);
+    }
+    TEST_ASSERT_EQUAL_UINT64(3U, metric_sensor_channel_dropped.value() - dropped);
+    TEST_ASSERT_EQUAL_size_t(SENSOR_CHANNEL_DEPTH, sensor_channel_drain(snapshot));
+    // The last of each kind that made it in
+    TEST_ASSERT_EQUAL_FLOAT(34.0f, snapshot.temperature);
+    TEST_ASSERT_EQUAL_FLOAT(64.0f, snapshot.humidity);
+    TEST_ASSERT_EQUAL_UINT32(1014U, snapshot.dhtReadMs);
+    TEST_ASSERT_EQUAL_INT(115, snapshot.lightLevel);
+    TEST_ASSERT_FALSE(snapshot.ledState);
+    TEST_ASSERT_EQUAL_UINT32(1015U, snapshot.lightReadMs);
+    // Nothing new: the snapshot stays
+    TEST_ASSERT_EQUAL_size_t(0U, sensor_channel_drain(snapshot));
+    TEST_ASSERT_EQUAL_FLOAT(34.0f, snapshot.temperature);
+}
+
+static void print_result(const char* name, int load, const QueueBenchResult& result) {
+    printf("%-9s %4d %12.2f %9.2f %9.2f %10.1f\n", name, load, result.itemsPerSecond / 1e6, result.p50, result.p99, result.max);
+}
+
+void test_throughput_and_latency_under_contention(void) {
+    printf("%u CPUs\n", std::thread::hardware_concurrency());
+    printf("queue     load  M items/s   p50 us    p99 us     max us\n");
+    const uint64_t paceNs = 20000;
+    QueueBenchResult idleRing = {};
+    QueueBenchResult idleQueue = {};
+    for (int load : { 0, 2 }) {
+        std::atomic<bool> running(true);
+        std::vector<std::thread> busy;
+        for (int i = 0; i < load; i++) {
+            busy.emplace_back([&running]() {
+                volatile uint64_t spins = 0;
+                while (running.load(std::memory_order_relaxed)) {
+                    spins = spins + 1;
+                }
+            });
+        }
+        // A ring consumer that polls loses its time slices to busy threads, fewer items then
+        const uint32_t items = load == 0 ? 500000 : 20000;
+        const QueueBenchResult ring = queue_bench(QUEUE_BENCH_SPSC_RING, items, paceNs);
+        const QueueBenchResult queue = queue_bench(QUEUE_BENCH_XQUEUE, items, paceNs);
+        running = false;
+        for (std::thread& thread : busy) {
+            thread.join();
+        }
+        print_result("SpscRing", load, ring);
+        print_result("xQueue", load, queue);
+        TEST_ASSERT_TRUE(ring.ordered);
+        TEST_ASSERT_TRUE(queue.ordered);
+        if (load == 0) {
+            idleRing = ring;
+            idleQueue = queue;
+        }
+    }
+    // Without contention the ring takes no lock and wakes no one
+    TEST_ASSERT_GREATER_THAN_DOUBLE(idleQueue.itemsPerSecond, idleRing.itemsPerSecond);
+}
+
+int main(int argc, char** argv) {
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_fills_and_empties);
+    RUN_TEST(test_items_cross_tasks_whole);
+    RUN_TEST(test_sensor_channel);
+    RUN_TEST(test_throughput_and_latency_under_contention);
+    return UNITY_END();
+}
@@ -0,0 +1,227 @@
+// TaskProfiler::sample (src/task_profiler.cpp) on synthetic scheduler snapshots from a fake
+// TaskStatsSource: CPU shares between two snapshots, tasks that appear and vanish, and run time
+// counters that wrap around.
+#include <unity.h>
+#include <Arduino.h>
+#include "task_profiler.h"
+
+#include <chrono>
+#include <vector>
+
+// Hands out one prepared snapshot per read()
+class FakeTaskStats : public TaskStatsSource {
+public:
+    struct Snapshot {
+        uint32_t totalRuntime;
+        std::vector<TaskStatsSample> tasks;
+    };
+
+    std::vector<Snapshot> snapshots;
+    size_t reads = 0;
+
+    size_t read(TaskStatsSample* samples, size_t max, uint32_t& totalRuntime) override {
+        if (reads >= snapshots.size()) {
+            return 0;
+        }
+        const Snapshot& snapshot = snapshots[reads++];
+        size_t count = snapshot.tasks.size() < max ? snapshot.tasks.size() : max;
+        for (size_t i = 0; i < count; i++) {
+            samples[i] = snapshot.tasks[i];
+        }
+        totalRuntime = snapshot.totalRuntime;
+        return count;
+    }
+};
+
+// Handles only need to be distinct
+static const void* handle_of(int id) {
+    return (const void*)(uintptr_t)(0x1000 + id);
+}
+
+static TaskStatsSample task(int id, const char* name, uint32_t runtime, uint32_t stackFree = 1000U, int8_t core = 0) {
+    TaskStatsSample sample = {};
+    sample.handle = handle_of(id);
+    strlcpy(sample.name, name, sizeof(sample.name));
+    sample.priority = (uint8_t)id;
+    sample.core = core;
+    sample.runtime = runtime;
+    sample.stackFree = stackFree;
+    return sample;
+}
+
+static const TaskProfile* find(const TaskProfiler& profiler, const char* name) {
+    for (size_t i = 0; i < profiler.size(); i++) {
+        if (strcmp(profiler.task(i).name, name) == 0) {
+            return &profiler.task(i);
+        }
+    }
+    return nullptr;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_first_sample_has_no_share(void) {
+    FakeTaskStats stats;
+    stats.snapshots = { { 5000000U, { task(1, "IDLE0", 4000000U), task(2, "loopTask", 700000U, 3000U, 1) } } };
+    TaskProfiler profiler(2);
+    profiler.sample(stats);
+
+    TEST_ASSERT_EQUAL_size_t(2U, profiler.size());
+    TEST_ASSERT_EQUAL_UINT32(0U, profiler.interval());
+    const TaskProfile& loop = profiler.task(1);
+    TEST_ASSERT_EQUAL_STRING("loopTask", loop.name);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, loop.cpu);
+    TEST_ASSERT_EQUAL_UINT64(700000U, loop.runtime);
+    TEST_ASSERT_EQUAL_UINT32(3000U, loop.stackFree);
+    TEST_ASSERT_EQUAL_UINT32(3000U, loop.stackMinFree);
+    TEST_ASSERT_EQUAL_INT(1, loop.core);
+    TEST_ASSERT_EQUAL_UINT32(0U, loop.stackSize);
+    TEST_ASSERT_NULL(loop.loop);
+}
+
+void test_cpu_share_per_task(void) {
+    // One second on two cores: 2 s of run time between all tasks
+    FakeTaskStats stats;
+    stats.snapshots = {
+        { 1000000U, { task(1, "IDLE0", 500000U), task(2, "IDLE1", 800000U, 1000U, 1), task(3, "webserver", 100000U, 2000U),
+                      task(4, "sensors", 0U, 1500U, 1) } },
+        { 2000000U, { task(1, "IDLE0", 1000000U), task(2, "IDLE1", 1600000U, 1000U, 1), task(3, "webserver", 500000U, 1800U),
+                      task(4, "sensors", 200000U, 1600U, 1) } },
+    };
+    TaskProfiler profiler(2);
+    profiler.sample(stats);
+    profiler.sample(stats);
+
+    TEST_ASSERT_EQUAL_UINT32(1000000U, profiler.interval());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 25.0f, find(profiler, "IDLE0")->cpu);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 40.0f, find(profiler, "IDLE1")->cpu);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, find(profiler, "webserver")->cpu);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 10.0f, find(profiler, "sensors")->cpu);
+    float total = 0;
+    for (size_t i = 0; i < profiler.size(); i++) {
+        total += profiler.task(i).cpu;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 95.0f, total);
+
+    // The high water mark only goes down
+    TEST_ASSERT_EQUAL_UINT32(1800U, find(profiler, "webserver")->stackMinFree);
+    TEST_ASSERT_EQUAL_UINT32(1600U, find(profiler, "sensors")->stackFree);
+    TEST_ASSERT_EQUAL_UINT32(1500U, find(profiler, "sensors")->stackMinFree);
+
+    // A single core gets the whole interval
+    FakeTaskStats single;
+    single.snapshots = stats.snapshots;
+    TaskProfiler oneCore(1);
+    oneCore.sample(single);
+    oneCore.sample(single);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 40.0f, find(oneCore, "webserver")->cpu);
+}
+
+void test_vanished_and_new_tasks(void) {
+    FakeTaskStats stats;
+    stats.snapshots = {
+        { 1000000U, { task(1, "IDLE0", 500000U), task(2, "upload", 300000U), task(3, "webserver", 100000U) } },
+        { 2000000U, { task(3, "webserver", 300000U), task(5, "ota", 250000U), task(1, "IDLE0", 900000U) } },
+        { 3000000U, { task(3, "webserver", 400000U), task(5, "ota", 650000U), task(1, "IDLE0", 1000000U) } },
+    };
+    TaskProfiler profiler(2);
+    profiler.track(handle_of(2), 8192U, nullptr);
+    profiler.track(handle_of(3), 4096U, &metric_loop_webserver);
+    profiler.sample(stats);
+    TEST_ASSERT_EQUAL_UINT32(8192U, find(profiler, "upload")->stackSize);
+    profiler.sample(stats);
+
+    // The deleted task dropped out, the others follow the order of the scheduler
+    TEST_ASSERT_EQUAL_size_t(3U, profiler.size());
+    TEST_ASSERT_NULL(find(profiler, "upload"));
+    TEST_ASSERT_EQUAL_STRING("webserver", profiler.task(0).name);
+    TEST_ASSERT_EQUAL_STRING("ota", profiler.task(1).name);
+    TEST_ASSERT_EQUAL_STRING("IDLE0", profiler.task(2).name);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 10.0f, find(profiler, "webserver")->cpu);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, find(profiler, "IDLE0")->cpu);
+    TEST_ASSERT_EQUAL_UINT32(4096U, find(profiler, "webserver")->stackSize);
+    TEST_ASSERT_TRUE(find(profiler, "webserver")->loop == &metric_loop_webserver);
+    // Started during the interval, its share is unknown until the next sample
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, find(profiler, "ota")->cpu);
+    TEST_ASSERT_EQUAL_UINT64(250000U, find(profiler, "ota")->runtime);
+
+    profiler.sample(stats);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, find(profiler, "ota")->cpu);
+    TEST_ASSERT_EQUAL_UINT64(650000U, find(profiler, "ota")->runtime);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 5.0f, find(profiler, "webserver")->cpu);
+}
+
+void test_counters_wrap_around(void) {
+    // The microsecond counters wrap after 71.6 minutes
+    const uint32_t nearWrap = UINT32_MAX - 99999U;
+    FakeTaskStats stats;
+    stats.snapshots = {
+        { nearWrap, { task(1, "IDLE0", nearWrap - 50000U), task(2, "webserver", UINT32_MAX - 9999U) } },
+        { nearWrap + 1000000U, { task(1, "IDLE0", nearWrap + 950000U), task(2, "webserver", 390000U) } },
+        { nearWrap + 2000000U, { task(1, "IDLE0", nearWrap + 1950000U), task(2, "webserver", 790000U) } },
+    };
+    TaskProfiler profiler(2);
+    profiler.sample(stats);
+    profiler.sample(stats);
+
+    TEST_ASSERT_EQUAL_UINT32(1000000U, profiler.interval());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 50.0f, find(profiler, "IDLE0")->cpu);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, find(profiler, "webserver")->cpu);
+    // The accumulated run time keeps counting past 2^32
+    const uint64_t expected = (uint64_t)UINT32_MAX - 9999U + 400000U;
+    TEST_ASSERT_EQUAL_UINT64(expected, find(profiler, "webserver")->runtime);
+    profiler.sample(stats);
+    TEST_ASSERT_EQUAL_UINT64(expected + 400000U, find(profiler, "webserver")->runtime);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 20.0f, find(profiler, "webserver")->cpu);
+}
+
+void test_failed_read_keeps_the_profiles(void) {
+    FakeTaskStats stats;
+    stats.snapshots = {
+        { 1000000U, { task(1, "IDLE0", 500000U) } },
+        { 2000000U, { task(1, "IDLE0", 1500000U) } },
+    };
+    TaskProfiler profiler(2);
+    profiler.sample(stats);
+    profiler.sample(stats);
+    profiler.sample(stats);
+    TEST_ASSERT_EQUAL_size_t(1U, profiler.size());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 50.0f, profiler.task(0).cpu);
+    TEST_ASSERT_EQUAL_UINT32(1000000U, profiler.interval());
+}
+
+void test_more_tasks_than_slots(void) {
+    FakeTaskStats stats;
+    FakeTaskStats::Snapshot snapshot = { 1000000U, {} };
+    char name[configMAX_TASK_NAME_LEN];
+    for (int id = 0; id < PROFILER_MAX_TASKS + 6; id++) {
+        snprintf(name, sizeof(name), "task%d", id);
+        snapshot.tasks.push_back(task(id, name, 1000U * id));
+    }
+    stats.snapshots = { snapshot, snapshot };
+    TaskProfiler profiler(2);
+    profiler.sample(stats);
+    TEST_ASSERT_EQUAL_size_t(PROFILER_MAX_TASKS, profiler.size());
+
+    const int rounds = 100000;
+    const auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        stats.reads = 1;
+        profiler.sample(stats);
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    printf("sample() of %d tasks: %.0f ns\n", PROFILER_MAX_TASKS, ns);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sample_has_no_share);
+    RUN_TEST(test_cpu_share_per_task);
+    RUN_TEST(test_vanished_and_new_tasks);
+    RUN_TEST(test_counters_wrap_around);
+    RUN_TEST(test_failed_read_keeps_the_profiles);
+    RUN_TEST(test_more_tasks_than_slots);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+// Resuming an interrupted ThingsBoard OTA download from a checkpoint (lib/ThingsBoard/OTA_Handler.h),
+// the device is interrupted by destroying the handler and dropping the answers still on the way,
+// while the flash and the checkpoint store are kept (../simulated_ota.h)
+#include <unity.h>
+#include "../simulated_ota.h"
+
+#include <memory>
+
+static const uint16_t CHUNK_SIZE_BYTES = 1024U;
+static const size_t FIRMWARE_SIZE = 200U * CHUNK_SIZE_BYTES - 300U;
+static const uint16_t INTERVAL_CHUNKS = 16U;
+static const uint8_t WINDOW = 4U;
+
+static std::vector<uint8_t> firmware;
+
+static std::unique_ptr<Simulated_Update> make_update(Memory_Updater& updater, Memory_Checkpoint_Store* store) {
+    std::unique_ptr<Simulated_Update> update(new Simulated_Update(firmware, updater, CHUNK_SIZE_BYTES, WINDOW));
+    update->callback.Set_Checkpoint_Store(store);
+    update->callback.Set_Checkpoint_Interval(INTERVAL_CHUNKS);
+    return update;
+}
+
+// Downloads until the given amount of bytes has been written, then powers the device off
+static size_t interrupt_at(Memory_Updater& updater, Memory_Checkpoint_Store* store, size_t written_bytes) {
+    std::unique_ptr<Simulated_Update> update = make_update(updater, store);
+    update->begin(firmware);
+    TEST_ASSERT_TRUE(update->broker.run(update->handler, [&]() { return updater.flash.size() >= written_bytes; }));
+    TEST_ASSERT_FALSE(update->finished);
+    return update->broker.delivered_bytes;
+}
+
+// Downloads with interruptions at the given chunks and returns the bytes downloaded more than once
+static size_t download(Memory_Updater& updater, Memory_Checkpoint_Store* store, const std::vector<size_t>& interruptions) {
+    size_t delivered_bytes = 0;
+    for (size_t chunk : interruptions) {
+        delivered_bytes += interrupt_at(updater, store, chunk * CHUNK_SIZE_BYTES);
+    }
+    std::unique_ptr<Simulated_Update> update = make_update(updater, store);
+    TEST_ASSERT_TRUE(update->start(firmware));
+    TEST_ASSERT_TRUE(update->success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+    delivered_bytes += update->broker.delivered_bytes;
+    return delivered_bytes - FIRMWARE_SIZE;
+}
+
+void setUp(void) {
+    firmware = sim_firmware(FIRMWARE_SIZE, 11U);
+}
+
+void tearDown(void) {}
+
+void test_resume_after_interruptions(void) {
+    static const std::vector<size_t> INTERRUPTIONS[] = { { 50 }, { 50, 100, 150 }, { 17, 40, 95, 130, 190 } };
+    printf("interruptions  re-downloaded KB   without checkpoints KB   read back KB\n");
+    for (const std::vector<size_t>& interruptions : INTERRUPTIONS) {
+        Memory_Updater updater;
+        Memory_Checkpoint_Store store;
+        const size_t redownloaded = download(updater, &store, interruptions);
+
+        Memory_Updater plain_updater;
+        const size_t plain_redownloaded = download(plain_updater, nullptr, interruptions);
+        printf("%13zu  %16.1f   %22.1f   %12.1f\n", interruptions.size(), redownloaded / 1024.0,
+               plain_redownloaded / 1024.0, updater.read_bytes / 1024.0);
+
+        // Only begun once, every interruption resumed at the last checkpoint and hashed the kept bytes again
+        TEST_ASSERT_EQUAL_size_t(1U, updater.begins);
+        TEST_ASSERT_EQUAL_size_t(interruptions.size(), updater.resumes);
+        size_t kept_bytes = 0;
+        for (size_t chunk : interruptions) {
+            kept_bytes += (chunk - chunk % INTERVAL_CHUNKS) * CHUNK_SIZE_BYTES;
+        }
+        TEST_ASSERT_EQUAL_size_t(kept_bytes, updater.read_bytes);
+        // At most the chunks since the last checkpoint and the window in flight are downloaded again
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(interruptions.size() * (INTERVAL_CHUNKS + WINDOW) * CHUNK_SIZE_BYTES, redownloaded);
+        TEST_ASSERT_LESS_THAN_size_t(plain_redownloaded, redownloaded);
+        TEST_ASSERT_EQUAL_size_t(interruptions.size(), plain_updater.begins - 1U);
+        TEST_ASSERT_FALSE(store.saved);
+    }
+}
+
+void test_checkpoint_cleared_on_success(void) {
+    Memory_Updater updater;
+    Memory_Checkpoint_Store store;
+    download(updater, &store, {});
+    TEST_ASSERT_EQUAL_size_t(FIRMWARE_SIZE / CHUNK_SIZE_BYTES / INTERVAL_CHUNKS, store.saves);
+    TEST_ASSERT_FALSE(store.saved);
+}
+
+void test_checkpoint_cleared_on_checksum_failure(void) {
+    Memory_Updater updater;
+    Memory_Checkpoint_Store store;
+    interrupt_at(updater, &store, 40U * CHUNK_SIZE_BYTES);
+    TEST_ASSERT_TRUE(store.saved);
+    // A bit flipped in the kept bytes, it is read back into the hash and only the final check notices
+    updater.flash.at(1000U) ^= 0x01U;
+
+    std::unique_ptr<Simulated_Update> update = make_update(updater, &store);
+    update->begin(firmware);
+    TEST_ASSERT_EQUAL_size_t(1U, updater.resumes);
+    TEST_ASSERT_TRUE(update->broker.run(update->handler, [&]() { return updater.begins == 2U; }));
+    TEST_ASSERT_FALSE(store.saved);
+    TEST_ASSERT_TRUE(update->broker.run(update->handler, [&]() { return update->finished; }));
+    TEST_ASSERT_TRUE(update->success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+}
+
+void test_checkpoint_cleared_on_restart(void) {
+    Memory_Updater updater;
+    Memory_Checkpoint_Store store;
+    interrupt_at(updater, &store, 40U * CHUNK_SIZE_BYTES);
+    updater.fail_write_at = 50U * CHUNK_SIZE_BYTES;
+
+    // The failed write starts over at chunk 0, the checkpoint no longer matches the flash
+    std::unique_ptr<Simulated_Update> update = make_update(updater, &store);
+    update->begin(firmware);
+    TEST_ASSERT_TRUE(update->broker.run(update->handler, [&]() { return updater.begins == 2U; }));
+    TEST_ASSERT_FALSE(store.saved);
+    TEST_ASSERT_TRUE(update->broker.run(update->handler, [&]() { return update->finished; }));
+    TEST_ASSERT_TRUE(update->success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+}
+
+void test_unreadable_flash_starts_over(void) {
+    Memory_Updater updater;
+    Memory_Checkpoint_Store store;
+    interrupt_at(updater, &store, 40U * CHUNK_SIZE_BYTES);
+    updater.fail_read = true;
+
+    std::unique_ptr<Simulated_Update> update = make_update(updater, &store);
+    TEST_ASSERT_TRUE(update->start(firmware));
+    TEST_ASSERT_TRUE(update->success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+    TEST_ASSERT_EQUAL_size_t(0U, updater.read_bytes);
+    TEST_ASSERT_EQUAL_size_t(FIRMWARE_SIZE, update->broker.delivered_bytes);
+}
+
+void test_other_firmware_starts_over(void) {
+    Memory_Updater updater;
+    Memory_Checkpoint_Store store;
+    interrupt_at(updater, &store, 40U * CHUNK_SIZE_BYTES);
+    firmware = sim_firmware(FIRMWARE_SIZE, 12U);
+
+    std::unique_ptr<Simulated_Update> update = make_update(updater, &store);
+    TEST_ASSERT_TRUE(update->start(firmware));
+    TEST_ASSERT_TRUE(update->success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+    TEST_ASSERT_EQUAL_size_t(0U, updater.resumes);
+    TEST_ASSERT_EQUAL_size_t(FIRMWARE_SIZE, update->broker.delivered_bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resume_after_interruptions);
+    RUN_TEST(test_checkpoint_cleared_on_success);
+    RUN_TEST(test_checkpoint_cleared_on_checksum_failure);
+    RUN_TEST(test_checkpoint_cleared_on_restart);
+    RUN_TEST(test_unreadable_flash_starts_over);
+    RUN_TEST(test_other_firmware_starts_over);
+    return UNITY_END();
+}
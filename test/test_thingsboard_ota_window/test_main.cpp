@@ -0,0 +1,121 @@
+// Chunk window of the ThingsBoard OTA download (lib/ThingsBoard/OTA_Handler.h) against a simulated
+// broker with a configurable round trip time and loss, on a virtual clock (../simulated_ota.h)
+#include <unity.h>
+#include "../simulated_ota.h"
+
+static const uint16_t CHUNK_SIZE_BYTES = 1024U;
+static const size_t FIRMWARE_SIZE = 64U * CHUNK_SIZE_BYTES - 100U;
+
+static std::vector<uint8_t> firmware;
+static size_t total_chunks;
+
+void setUp(void) {
+    firmware = sim_firmware(FIRMWARE_SIZE, 7U);
+    total_chunks = FIRMWARE_SIZE / CHUNK_SIZE_BYTES + 1U;
+}
+
+void tearDown(void) {}
+
+void test_hash_matches_known_digest(void) {
+    const std::vector<uint8_t> abc = { 'a', 'b', 'c' };
+    const std::string digest = sim_sha256(abc);
+    TEST_ASSERT_EQUAL_STRING("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", digest.c_str());
+}
+
+void test_window_hides_round_trip(void) {
+    static const uint64_t RTTS_MS[] = { 20, 100, 300 };
+    static const uint8_t WINDOWS[] = { 1, 4, 8 };
+    printf("rtt ms  window  chunks  requests  time s   KB/s\n");
+    for (uint64_t rtt_ms : RTTS_MS) {
+        for (uint8_t window : WINDOWS) {
+            Memory_Updater updater;
+            Simulated_Update update(firmware, updater, CHUNK_SIZE_BYTES, window);
+            update.broker.rtt_us = rtt_ms * 1000U;
+            TEST_ASSERT_TRUE(update.start(firmware));
+            printf("%6u  %6u  %6zu  %8zu  %6.2f  %6.1f\n", (unsigned)rtt_ms, window, total_chunks,
+                   update.broker.requests.size(), sim_now_us / 1e6, FIRMWARE_SIZE / 1024.0 / (sim_now_us / 1e6));
+
+            TEST_ASSERT_TRUE(update.success);
+            TEST_ASSERT_TRUE(updater.flash == firmware);
+            // Every chunk once, the window is refilled as soon as its first chunk is written
+            TEST_ASSERT_EQUAL_size_t(total_chunks, update.broker.requests.size());
+            const size_t round_trips = (total_chunks + window - 1U) / window;
+            TEST_ASSERT_EQUAL_UINT64(round_trips * rtt_ms * 1000U, sim_now_us);
+        }
+    }
+}
+
+void test_lost_chunk_is_requested_alone(void) {
+    Memory_Updater updater;
+    Simulated_Update update(firmware, updater, CHUNK_SIZE_BYTES, 4U);
+    update.broker.lose_once.insert(5U);
+
+    TEST_ASSERT_TRUE(update.start(firmware));
+    TEST_ASSERT_TRUE(update.success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+
+    // 6 to 8 arrived while 5 was missing and were kept, the timeout only asked for 5 again
+    TEST_ASSERT_EQUAL_size_t(total_chunks + 1U, update.broker.requests.size());
+    TEST_ASSERT_EQUAL_size_t(2U, update.broker.requests_of(5U));
+    for (size_t chunk = 6U; chunk <= 8U; chunk++) {
+        TEST_ASSERT_EQUAL_size_t(1U, update.broker.requests_of(chunk));
+    }
+    const std::vector<size_t>& requests = update.broker.requests;
+    const size_t retry = std::find(requests.begin() + 6, requests.end(), 5U) - requests.begin();
+    TEST_ASSERT_EQUAL_size_t(9U, retry);
+    // Writing 5 to 8 refilled the window with 9 to 12
+    TEST_ASSERT_GREATER_THAN_size_t(retry + 4U, requests.size());
+    for (size_t i = 0; i < 4U; i++) {
+        TEST_ASSERT_EQUAL_size_t(9U + i, requests.at(retry + 1U + i));
+    }
+}
+
+void test_failed_write_refills_window_from_start(void) {
+    Memory_Updater updater;
+    updater.fail_write_at = 10U * CHUNK_SIZE_BYTES;
+    Simulated_Update update(firmware, updater, CHUNK_SIZE_BYTES, 4U);
+
+    TEST_ASSERT_TRUE(update.start(firmware));
+    TEST_ASSERT_TRUE(update.success);
+    TEST_ASSERT_TRUE(updater.flash == firmware);
+    TEST_ASSERT_EQUAL_size_t(2U, updater.begins);
+
+    // The failed write restarted the update, the window starts over at chunk 0 and is full again
+    const std::vector<size_t>& requests = update.broker.requests;
+    const size_t restart = std::find(requests.begin() + 1, requests.end(), 0U) - requests.begin();
+    TEST_ASSERT_LESS_THAN_size_t(requests.size(), restart);
+    for (size_t i = 0; i < 4U; i++) {
+        TEST_ASSERT_EQUAL_size_t(i, requests.at(restart + i));
+    }
+    TEST_ASSERT_EQUAL_size_t(restart + total_chunks, requests.size());
+}
+
+void test_lossy_link_completes(void) {
+    static const double LOSSES[] = { 0.02, 0.1, 0.2 };
+    printf("loss  window  requests  lost  time s\n");
+    for (double loss : LOSSES) {
+        Memory_Updater updater;
+        Simulated_Update update(firmware, updater, CHUNK_SIZE_BYTES, 4U);
+        update.broker.rtt_us = 100000U;
+        update.broker.jitter_us = 100000U;
+        update.broker.loss = loss;
+        update.broker.seed = 12345U;
+
+        TEST_ASSERT_TRUE(update.start(firmware));
+        printf("%4.2f  %6u  %8zu  %4zu  %6.2f\n", loss, 4U, update.broker.requests.size(), update.broker.lost, sim_now_us / 1e6);
+        TEST_ASSERT_TRUE(update.success);
+        TEST_ASSERT_TRUE(updater.flash == firmware);
+        // The timeout is longer than the slowest answer, so only lost requests are repeated
+        TEST_ASSERT_EQUAL_size_t(total_chunks + update.broker.lost, update.broker.requests.size());
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hash_matches_known_digest);
+    RUN_TEST(test_window_hides_round_trip);
+    RUN_TEST(test_lost_chunk_is_requested_alone);
+    RUN_TEST(test_failed_write_refills_window_from_start);
+    RUN_TEST(test_lossy_link_completes);
+    return UNITY_END();
+}
@@ -0,0 +1,191 @@
+// Allocation benchmark of the ThingsBoard callback Vector (lib/ThingsBoard/Vector.h): registers
+// 1 to 1000 server-side RPC callbacks and counts heap allocations through a replaced operator new,
+// next to std::vector and a container that grows by one element like the old Vector did.
+#include <unity.h>
+#include <Vector.h>
+#include <RPC_Callback.h>
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// The replacement is built on malloc, which GCC does not know when matching new and delete
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    void* memory = malloc(size ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+static RPC_Response on_rpc(const RPC_Data&) {
+    return RPC_Response();
+}
+
+// The old Vector without STL: the capacity grew by exactly one element on every push_back
+struct GrowByOne {
+    RPC_Callback* elements = nullptr;
+    size_t size = 0;
+
+    ~GrowByOne() {
+        for (size_t i = 0; i < size; i++) {
+            elements[i].~RPC_Callback();
+        }
+        ::operator delete(elements);
+    }
+
+    void push_back(const RPC_Callback& callback) {
+        RPC_Callback* grown = static_cast<RPC_Callback*>(::operator new((size + 1) * sizeof(RPC_Callback)));
+        for (size_t i = 0; i < size; i++) {
+            new (&grown[i]) RPC_Callback(elements[i]);
+            elements[i].~RPC_Callback();
+        }
+        new (&grown[size]) RPC_Callback(callback);
+        ::operator delete(elements);
+        elements = grown;
+        size++;
+    }
+};
+
+struct Registration {
+    size_t allocations;
+    size_t bytes;
+    double ns_per_callback;
+};
+
+static const size_t COUNTS[] = { 1, 8, 9, 16, 100, 1000 };
+
+template<typename Container>
+static Registration measure(size_t count) {
+    const RPC_Callback callback("method", on_rpc);
+    Registration result;
+    {
+        const size_t before = allocations;
+        const size_t before_bytes = allocated_bytes;
+        Container container;
+        for (size_t i = 0; i < count; i++) {
+            container.push_back(callback);
+        }
+        result.allocations = allocations - before;
+        result.bytes = allocated_bytes - before_bytes;
+    }
+
+    // Repeat until the time is well above the clock resolution
+    const size_t rounds = 20000 / count + 10;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        Container container;
+        for (size_t i = 0; i < count; i++) {
+            container.push_back(callback);
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    result.ns_per_callback = std::chrono::duration<double, std::nano>(elapsed).count() / (rounds * count);
+    return result;
+}
+
+static size_t expected_allocations(size_t count, size_t inline_capacity) {
+    size_t result = 0;
+    for (size_t capacity = inline_capacity; capacity < count; capacity *= 2) {
+        result++;
+    }
+    return result;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_registration_allocations(void) {
+    using Callbacks = Vector<RPC_Callback, Default_Fields_Amt>;
+    printf("callbacks  Vector: allocs   bytes  ns/cb   std::vector: allocs  ns/cb   grow by one: allocs  ns/cb\n");
+    for (size_t count : COUNTS) {
+        const Registration vector = measure<Callbacks>(count);
+        const Registration std_vector = measure<std::vector<RPC_Callback>>(count);
+        const Registration grow_by_one = measure<GrowByOne>(count);
+        printf("%9zu  %14zu %7zu %6.1f  %19zu %6.1f  %19zu %6.1f\n", count, vector.allocations, vector.bytes,
+               vector.ns_per_callback, std_vector.allocations, std_vector.ns_per_callback, grow_by_one.allocations,
+               grow_by_one.ns_per_callback);
+
+        // Inline storage first, then one allocation per doubling
+        TEST_ASSERT_EQUAL_size_t(expected_allocations(count, Default_Fields_Amt), vector.allocations);
+        TEST_ASSERT_EQUAL_size_t(count, grow_by_one.allocations);
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(std_vector.allocations, vector.allocations);
+    }
+}
+
+void test_registration_keeps_order(void) {
+    Vector<RPC_Callback, Default_Fields_Amt> callbacks;
+    static const char* const NAMES[] = { "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l" };
+    for (const char* name : NAMES) {
+        callbacks.push_back(RPC_Callback(name, on_rpc));
+    }
+    TEST_ASSERT_EQUAL_size_t(sizeof(NAMES) / sizeof(NAMES[0]), callbacks.size());
+    TEST_ASSERT_FALSE(callbacks.is_inline());
+    for (size_t i = 0; i < callbacks.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(NAMES[i], callbacks.at(i).Get_Name());
+    }
+
+    callbacks.erase(static_cast<size_t>(0U));
+    TEST_ASSERT_EQUAL_STRING("b", callbacks.at(0).Get_Name());
+    TEST_ASSERT_EQUAL_STRING("l", callbacks.back().Get_Name());
+}
+
+void test_move_takes_heap_storage(void) {
+    Vector<RPC_Callback, 2> callbacks;
+    for (size_t i = 0; i < 5; i++) {
+        callbacks.push_back(RPC_Callback("method", on_rpc));
+    }
+    const RPC_Callback* storage = callbacks.begin();
+
+    const size_t before = allocations;
+    Vector<RPC_Callback, 2> moved(static_cast<Vector<RPC_Callback, 2>&&>(callbacks));
+    TEST_ASSERT_EQUAL_size_t(before, allocations);
+    TEST_ASSERT_EQUAL_PTR(storage, moved.begin());
+    TEST_ASSERT_EQUAL_size_t(5, moved.size());
+    TEST_ASSERT_TRUE(callbacks.empty());
+    TEST_ASSERT_TRUE(callbacks.is_inline());
+}
+
+void test_clear_keeps_capacity(void) {
+    Vector<RPC_Callback, 2> callbacks;
+    for (size_t i = 0; i < 20; i++) {
+        callbacks.push_back(RPC_Callback("method", on_rpc));
+    }
+    const size_t capacity = callbacks.capacity();
+    callbacks.clear();
+
+    // Subscribing again after an unsubscribe reuses the storage
+    const size_t before = allocations;
+    for (size_t i = 0; i < 20; i++) {
+        callbacks.push_back(RPC_Callback("method", on_rpc));
+    }
+    TEST_ASSERT_EQUAL_size_t(before, allocations);
+    TEST_ASSERT_EQUAL_size_t(capacity, callbacks.capacity());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_registration_allocations);
+    RUN_TEST(test_registration_keeps_order);
+    RUN_TEST(test_move_takes_heap_storage);
+    RUN_TEST(test_clear_keeps_capacity);
+    return UNITY_END();
+}
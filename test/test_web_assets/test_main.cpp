@@ -0,0 +1,132 @@
+// Precompressed web pages with ETag revalidation (WiFiConfigServer::sendStaticAsset), against the
+// firmware running on the host. LittleFS is the data directory scripts/compress_assets.py writes
+// the .gz pages into, the uncompressed sizes come from the sources in data/.
+#include <unity.h>
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "native_board.h"
+#include "../native_http.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <sys/stat.h>
+
+static uint16_t port;
+
+struct Page {
+    const char* url;
+    const char* source;     // In data/
+    const char* served;     // On LittleFS
+};
+
+static const Page PAGES[] = {
+    { "/", "dashboard.html", "/dashboard.html.gz" },
+    { "/wifi-config", "wifi_config.html", "/wifi_config.html.gz" },
+};
+
+static size_t source_size(const char* name) {
+    std::string file = __FILE__;
+    std::string path = file.substr(0, file.find_last_of('/') + 1) + "../../data/" + name;
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static size_t served_size(const char* path) {
+    File file = LittleFS.open(path, "r");
+    size_t size = file ? file.size() : 0;
+    file.close();
+    return size;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_server_starts(void) {
+    TEST_ASSERT_TRUE_MESSAGE(http_wait_for_server(port), "web server did not start");
+}
+
+void test_page_is_served_gzip_with_etag(void) {
+    for (const Page& page : PAGES) {
+        HttpResponse response = http_get(port, page.url);
+        TEST_ASSERT_EQUAL_INT(200, response.status);
+        const std::string encoding = response.header("content-encoding");
+        const std::string cacheControl = response.header("cache-control");
+        TEST_ASSERT_EQUAL_STRING("gzip", encoding.c_str());
+        TEST_ASSERT_EQUAL_STRING("no-cache", cacheControl.c_str());
+        // Strong ETag, the MD5 of the served file in quotes
+        const std::string etag = response.header("etag");
+        TEST_ASSERT_EQUAL_size_t(34U, etag.size());
+        TEST_ASSERT_TRUE(etag.front() == '"' && etag.back() == '"');
+        TEST_ASSERT_EQUAL_size_t(served_size(page.served), response.body.size());
+        TEST_ASSERT_EQUAL_UINT8(0x1F, (uint8_t)response.body[0]);
+        TEST_ASSERT_EQUAL_UINT8(0x8B, (uint8_t)response.body[1]);
+        // The same file keeps its ETag
+        const std::string again = http_get(port, page.url).header("etag");
+        TEST_ASSERT_EQUAL_STRING(etag.c_str(), again.c_str());
+    }
+}
+
+void test_matching_etag_is_not_modified(void) {
+    for (const Page& page : PAGES) {
+        const std::string etag = http_get(port, page.url).header("etag");
+        HttpResponse response = http_get(port, page.url, { "If-None-Match: " + etag });
+        TEST_ASSERT_EQUAL_INT(304, response.status);
+        const std::string returned = response.header("etag");
+        TEST_ASSERT_EQUAL_STRING(etag.c_str(), returned.c_str());
+        TEST_ASSERT_EQUAL_size_t(0U, response.body.size());
+
+        HttpResponse stale = http_get(port, page.url, { "If-None-Match: \"0123456789abcdef0123456789abcdef\"" });
+        TEST_ASSERT_EQUAL_INT(200, stale.status);
+        TEST_ASSERT_EQUAL_size_t(served_size(page.served), stale.body.size());
+    }
+}
+
+void test_transfer_benchmark(void) {
+    const int rounds = 50;
+    printf("page              source B   200 wire B   304 wire B   saved   ttfb 200 us   ttfb 304 us\n");
+    for (const Page& page : PAGES) {
+        const std::string etag = http_get(port, page.url).header("etag");
+        std::vector<double> full;
+        std::vector<double> revalidated;
+        size_t fullBytes = 0;
+        size_t revalidatedBytes = 0;
+        for (int round = 0; round < rounds; round++) {
+            HttpResponse response = http_get(port, page.url);
+            full.push_back(response.firstByteUs);
+            fullBytes = response.wireBytes;
+            response = http_get(port, page.url, { "If-None-Match: " + etag });
+            revalidated.push_back(response.firstByteUs);
+            revalidatedBytes = response.wireBytes;
+        }
+        const size_t source = source_size(page.source);
+        printf("%-16s  %8zu   %10zu   %10zu   %4.1f %%  %11.0f   %11.0f\n", page.url, source, fullBytes, revalidatedBytes,
+               100.0 - 100.0 * fullBytes / source, median(full), median(revalidated));
+
+        // Minified and gzipped to well under half, the revalidation is only the head
+        TEST_ASSERT_LESS_THAN_size_t(source / 2U, fullBytes);
+        TEST_ASSERT_LESS_THAN_size_t(300U, revalidatedBytes);
+    }
+}
+
+int main(int argc, char** argv) {
+    // The whole firmware, like native_main.cpp runs it
+    native_task_adopt_main("loopTask", 8192, 1);
+    setup();
+    port = native_port(8080);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_server_starts);
+    RUN_TEST(test_page_is_served_gzip_with_etag);
+    RUN_TEST(test_matching_etag_is_not_modified);
+    RUN_TEST(test_transfer_benchmark);
+    int failures = UNITY_END();
+    // The firmware's tasks keep running, leave without the static destructors
+    fflush(stdout);
+    _exit(failures);
+}
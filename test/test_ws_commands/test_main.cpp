@@ -0,0 +1,543 @@
+// WebSocket commands (src/ws_commands.cpp): what the event handler accepts, how fragmented
+// messages are joined and how the queue coalesces commands. The benchmarks measure the dispatch
+// per action against a String compare chain, the time the handler holds up the network task and
+// the commands a worker gets through while dashboards send previews as fast as they can.
+#include <unity.h>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "native_board.h"
+#include "ws_commands.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The handler parses in place, so every message is parsed from a copy
+static bool parse(const char* message, WsCommand& command, WsWiFiLogin& login, uint32_t client = 1) {
+    std::string copy = message;
+    return ws_command_parse(&copy[0], copy.size(), client, command, login);
+}
+
+static bool parse(const char* message) {
+    WsCommand command;
+    WsWiFiLogin login;
+    return parse(message, command, login);
+}
+
+static WsCommand preview(uint8_t r, uint32_t client = 1) {
+    WsCommand command = {};
+    command.type = WS_CMD_PREVIEW_NEO_COLOR;
+    command.client = client;
+    command.color.r = r;
+    return command;
+}
+
+static WsCommand request(WsCommandType type, uint32_t client) {
+    WsCommand command = {};
+    command.type = type;
+    command.client = client;
+    return command;
+}
+
+// Frame info of one part of a frame, as the library hands it to the event handler
+static AwsFrameInfo frame_part(uint32_t num, bool final, uint64_t frameLen, uint64_t index) {
+    AwsFrameInfo info = {};
+    info.message_opcode = WS_TEXT;
+    info.opcode = num == 0 ? WS_TEXT : WS_CONTINUATION;
+    info.num = num;
+    info.final = final;
+    info.len = frameLen;
+    info.index = index;
+    return info;
+}
+
+// Sends text as frames of at most frameSize bytes, each handed over in parts of at most partSize
+// bytes. Returns the message once it is complete.
+static std::string assemble(WsMessageAssembler& assembler, uint32_t client, const std::string& text,
+                            size_t frameSize, size_t partSize, bool* complete = nullptr) {
+    std::string result;
+    bool done = false;
+    uint32_t num = 0;
+    for (size_t frame = 0; frame < text.size(); frame += frameSize, num++) {
+        const size_t frameLen = std::min(frameSize, text.size() - frame);
+        for (size_t part = 0; part < frameLen; part += partSize) {
+            const size_t len = std::min(partSize, frameLen - part);
+            std::string data = text.substr(frame + part, len);
+            AwsFrameInfo info = frame_part(num, frame + frameLen == text.size(), frameLen, part);
+            size_t messageLen = 0;
+            const char* message = assembler.add(client, &info, (uint8_t*)&data[0], len, messageLen);
+            if (message) {
+                TEST_ASSERT_FALSE(done);
+                result.assign(message, messageLen);
+                done = true;
+            }
+        }
+    }
+    if (complete) {
+        *complete = done;
+    }
+    return result;
+}
+
+// The handler before the action table: the frame copied into a String, a 1 KB document and a
+// chain of String compares
+static bool string_chain_parse(const uint8_t* data, size_t len, WsCommand& command, WsWiFiLogin& login) {
+    String message;
+    message.concat((const char*)data, len);
+    DynamicJsonDocument doc(1024);
+    if (deserializeJson(doc, message)) {
+        return false;
+    }
+    String action = doc["action"] | "";
+    if (action == "scan") {
+        command.type = WS_CMD_SCAN;
+    } else if (action == "get_status") {
+        command.type = WS_CMD_GET_STATUS;
+    } else if (action == "get_sensors") {
+        command.type = WS_CMD_GET_SENSORS;
+    } else if (action == "get_leds") {
+        command.type = WS_CMD_GET_LEDS;
+    } else if (action == "get_light") {
+        command.type = WS_CMD_GET_LIGHT;
+    } else if (action == "get_alert_settings") {
+        command.type = WS_CMD_GET_ALERT_SETTINGS;
+    } else if (action == "get_history") {
+        command.type = WS_CMD_GET_HISTORY;
+        history_parse_metric(doc["metric"] | "", command.history.metric);
+        command.history.points = doc["points"] | HISTORY_DEFAULT_POINTS;
+    } else if (action == "get_tasks") {
+        command.type = WS_CMD_GET_TASKS;
+    } else if (action == "connect") {
+        command.type = WS_CMD_CONNECT;
+        strlcpy(login.ssid, doc["ssid"] | "", sizeof(login.ssid));
+        strlcpy(login.password, doc["password"] | "", sizeof(login.password));
+    } else if (action == "disconnect") {
+        command.type = WS_CMD_DISCONNECT;
+    } else if (action == "control_led") {
+        command.type = WS_CMD_CONTROL_LED;
+        command.state = doc["state"];
+    } else if (action == "control_neo") {
+        command.type = WS_CMD_CONTROL_NEO;
+        command.state = doc["state"];
+    } else if (action == "preview_neo_color" || action == "save_neo_color" || action == "save_alert_color") {
+        command.type = action == "preview_neo_color" ? WS_CMD_PREVIEW_NEO_COLOR
+                     : action == "save_neo_color" ? WS_CMD_SAVE_NEO_COLOR : WS_CMD_SAVE_ALERT_COLOR;
+        command.color.r = doc["r"];
+        command.color.g = doc["g"];
+        command.color.b = doc["b"];
+        strlcpy(command.color.hex, doc["hex"] | "", sizeof(command.color.hex));
+    } else if (action == "save_temp_threshold") {
+        command.type = WS_CMD_SAVE_TEMP_THRESHOLD;
+        command.threshold = doc["threshold"];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_parse_actions(void) {
+    WsCommand command;
+    WsWiFiLogin login;
+    TEST_ASSERT_TRUE(parse("{\"action\":\"preview_neo_color\",\"r\":255,\"g\":0,\"b\":17,\"hex\":\"#ff0011\"}", command, login, 7));
+    TEST_ASSERT_EQUAL_INT(WS_CMD_PREVIEW_NEO_COLOR, command.type);
+    TEST_ASSERT_EQUAL_UINT32(7U, command.client);
+    TEST_ASSERT_EQUAL_UINT8(255, command.color.r);
+    TEST_ASSERT_EQUAL_UINT8(17, command.color.b);
+    TEST_ASSERT_EQUAL_STRING("#ff0011", command.color.hex);
+
+    TEST_ASSERT_TRUE(parse("{\"action\":\"connect\",\"ssid\":\"home\"}", command, login));
+    TEST_ASSERT_EQUAL_INT(WS_CMD_CONNECT, command.type);
+    TEST_ASSERT_EQUAL_STRING("home", login.ssid);
+    TEST_ASSERT_EQUAL_STRING("", login.password);
+
+    TEST_ASSERT_TRUE(parse("{\"action\":\"save_temp_threshold\",\"threshold\":31.5}", command, login));
+    TEST_ASSERT_EQUAL_FLOAT(31.5f, command.threshold);
+    TEST_ASSERT_TRUE(parse("{\"action\":\"control_led\",\"state\":true}", command, login));
+    TEST_ASSERT_TRUE(command.state);
+
+    // Defaults of a history request: the last day, ending now
+    native_clock_set_us(200000ULL * 1000000ULL);
+    TEST_ASSERT_TRUE(parse("{\"action\":\"get_history\",\"metric\":\"humidity\",\"points\":50}", command, login));
+    TEST_ASSERT_EQUAL_INT(HISTORY_HUMIDITY, command.history.metric);
+    TEST_ASSERT_EQUAL_UINT32(history_now(), command.history.to);
+    TEST_ASSERT_EQUAL_UINT32(history_now() - 86400U, command.history.from);
+    TEST_ASSERT_EQUAL_UINT32(50U, command.history.points);
+
+    TEST_ASSERT_TRUE(parse("{\"action\":\"set_report_policy\",\"metric\":\"light\",\"dead_band\":50,\"max_silence\":600}", command, login));
+    TEST_ASSERT_EQUAL_INT(HISTORY_LIGHT, command.report.metric);
+    TEST_ASSERT_EQUAL_FLOAT(50.0f, command.report.rule.deadBand);
+    TEST_ASSERT_EQUAL_UINT32(600U, command.report.rule.maxSilenceS);
+    TEST_ASSERT_EQUAL_UINT32(0U, command.report.rule.windowS);
+}
+
+void test_parse_rejects(void) {
+    static const char* const INVALID[] = {
+        "",
+        "not json",
+        "{\"action\":\"scan\"",
+        "{\"state\":true}",
+        "{\"action\":\"reboot\"}",
+        "{\"action\":\"control_led\"}",
+        "{\"action\":\"control_led\",\"state\":\"yes\"}",
+        "{\"action\":\"preview_neo_color\",\"r\":256,\"g\":0,\"b\":0,\"hex\":\"#000000\"}",
+        "{\"action\":\"preview_neo_color\",\"r\":-1,\"g\":0,\"b\":0,\"hex\":\"#000000\"}",
+        "{\"action\":\"preview_neo_color\",\"r\":0,\"g\":0,\"b\":0,\"hex\":\"#0000000\"}",
+        "{\"action\":\"connect\",\"ssid\":\"\"}",
+        "{\"action\":\"connect\",\"ssid\":\"123456789012345678901234567890123\"}",
+        "{\"action\":\"save_temp_threshold\",\"threshold\":\"hot\"}",
+        "{\"action\":\"get_history\",\"metric\":\"pressure\"}",
+        "{\"action\":\"get_history\",\"metric\":\"light\",\"points\":-5}",
+        "{\"action\":\"set_report_policy\",\"metric\":\"light\",\"dead_band\":-1,\"max_silence\":600}",
+        "{\"action\":\"set_report_policy\",\"metric\":\"light\",\"dead_band\":1,\"max_silence\":9999999}",
+        "{\"action\":\"a_name_longer_than_any_action\"}",
+    };
+    for (const char* message : INVALID) {
+        TEST_ASSERT_FALSE_MESSAGE(parse(message), message);
+    }
+    // Every action of the table is found
+    static const char* const WITHOUT_PARAMS[] = { "scan", "get_status", "get_sensors", "get_leds", "get_light",
+                                                  "get_alert_settings", "get_tasks", "get_report_policy", "disconnect" };
+    for (const char* action : WITHOUT_PARAMS) {
+        const std::string message = std::string("{\"action\":\"") + action + "\"}";
+        TEST_ASSERT_TRUE_MESSAGE(parse(message.c_str()), action);
+    }
+}
+
+void test_assembler_joins_fragments(void) {
+    WsMessageAssembler assembler;
+    const std::string text = "{\"action\":\"get_history\",\"metric\":\"temperature\",\"points\":120}";
+
+    // A message in one piece stays in the buffer of the library
+    std::string data = text;
+    AwsFrameInfo whole = frame_part(0, true, text.size(), 0);
+    size_t messageLen = 0;
+    TEST_ASSERT_TRUE(assembler.add(1, &whole, (uint8_t*)&data[0], data.size(), messageLen) == &data[0]);
+    TEST_ASSERT_EQUAL_size_t(text.size(), messageLen);
+
+    // Continuation frames, frames in parts, and both
+    const size_t splits[][2] = { { 16, 16 }, { 1, 1 }, { 1000, 7 }, { 20, 3 }, { 17, 5 } };
+    for (const auto& split : splits) {
+        bool complete;
+        const std::string joined = assemble(assembler, 1, text, split[0], split[1], &complete);
+        TEST_ASSERT_TRUE(complete);
+        TEST_ASSERT_EQUAL_STRING(text.c_str(), joined.c_str());
+        // NUL terminated for the parser, which then takes it in place
+        WsCommand command;
+        WsWiFiLogin login;
+        std::string parsed = joined;
+        TEST_ASSERT_TRUE(ws_command_parse(&parsed[0], parsed.size(), 1, command, login));
+        TEST_ASSERT_EQUAL_UINT32(120U, command.history.points);
+    }
+}
+
+void test_assembler_interleaved_clients(void) {
+    WsMessageAssembler assembler;
+    // WS_COMMAND_FRAGMENTED_SLOTS clients in the middle of a message, their frames take turns
+    std::vector<std::string> texts;
+    for (uint32_t client = 1; client <= WS_COMMAND_FRAGMENTED_SLOTS; client++) {
+        texts.push_back("{\"action\":\"connect\",\"ssid\":\"network " + std::to_string(client) + "\",\"password\":\"secret\"}");
+    }
+    const size_t frameSize = 6;
+    std::vector<std::string> joined(texts.size());
+    for (size_t frame = 0; frame * frameSize < texts[0].size(); frame++) {
+        for (size_t i = 0; i < texts.size(); i++) {
+            const size_t start = frame * frameSize;
+            const size_t len = std::min(frameSize, texts[i].size() - start);
+            std::string data = texts[i].substr(start, len);
+            AwsFrameInfo info = frame_part(frame, start + len == texts[i].size(), len, 0);
+            size_t messageLen;
+            const char* message = assembler.add(i + 1, &info, (uint8_t*)&data[0], len, messageLen);
+            if (message) {
+                joined[i].assign(message, messageLen);
+            }
+        }
+    }
+    for (size_t i = 0; i < texts.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(texts[i].c_str(), joined[i].c_str());
+    }
+
+    // One more client than there are slots: its message is dropped, the others get through
+    std::string first = "{\"act";
+    for (uint32_t client = 1; client <= WS_COMMAND_FRAGMENTED_SLOTS + 1; client++) {
+        AwsFrameInfo info = frame_part(0, false, first.size(), 0);
+        size_t messageLen;
+        std::string data = first;
+        TEST_ASSERT_NULL(assembler.add(client, &info, (uint8_t*)&data[0], data.size(), messageLen));
+    }
+    std::string rest = "ion\":\"scan\"}";
+    for (uint32_t client = 1; client <= WS_COMMAND_FRAGMENTED_SLOTS + 1; client++) {
+        AwsFrameInfo info = frame_part(1, true, rest.size(), 0);
+        size_t messageLen = 0;
+        std::string data = rest;
+        const char* message = assembler.add(client, &info, (uint8_t*)&data[0], data.size(), messageLen);
+        if (client <= WS_COMMAND_FRAGMENTED_SLOTS) {
+            TEST_ASSERT_NOT_NULL(message);
+            const std::string scan(message, messageLen);
+            TEST_ASSERT_EQUAL_STRING("{\"action\":\"scan\"}", scan.c_str());
+        } else {
+            TEST_ASSERT_NULL(message);
+        }
+    }
+
+    // A client that disconnects in the middle of a message frees its slot
+    for (uint32_t client = 1; client <= WS_COMMAND_FRAGMENTED_SLOTS; client++) {
+        AwsFrameInfo info = frame_part(0, false, first.size(), 0);
+        size_t messageLen;
+        std::string data = first;
+        assembler.add(client, &info, (uint8_t*)&data[0], data.size(), messageLen);
+    }
+    assembler.drop(2);
+    bool complete;
+    const std::string scan = assemble(assembler, 9, "{\"action\":\"scan\"}", 4, 4, &complete);
+    TEST_ASSERT_EQUAL_STRING("{\"action\":\"scan\"}", scan.c_str());
+    // The continuation of the dropped message is ignored
+    AwsFrameInfo info = frame_part(1, true, rest.size(), 0);
+    size_t messageLen;
+    std::string data = rest;
+    TEST_ASSERT_NULL(assembler.add(2, &info, (uint8_t*)&data[0], data.size(), messageLen));
+}
+
+void test_assembler_overflow(void) {
+    WsMessageAssembler assembler;
+    // Exactly WS_COMMAND_MAX_MESSAGE bytes still fit
+    std::string text = "{\"action\":\"scan\",\"padding\":\"";
+    text += std::string(WS_COMMAND_MAX_MESSAGE - text.size() - 2, 'x') + "\"}";
+    TEST_ASSERT_EQUAL_size_t(WS_COMMAND_MAX_MESSAGE, text.size());
+    bool complete;
+    TEST_ASSERT_EQUAL_size_t(text.size(), assemble(assembler, 1, text, 50, 13, &complete).size());
+    TEST_ASSERT_TRUE(complete);
+
+    // One byte more is dropped, whole, also in a single frame handed over in parts
+    const std::string longer = text.substr(0, 1) + " " + text.substr(1);
+    assemble(assembler, 1, longer, 50, 13, &complete);
+    TEST_ASSERT_FALSE(complete);
+    assemble(assembler, 1, longer, 1000, 100, &complete);
+    TEST_ASSERT_FALSE(complete);
+    assemble(assembler, 1, std::string(4096, ' '), 1000, 1000, &complete);
+    TEST_ASSERT_FALSE(complete);
+    // The slot is free again for the next message
+    const std::string scan = assemble(assembler, 1, "{\"action\":\"scan\"}", 3, 3, &complete);
+    TEST_ASSERT_EQUAL_STRING("{\"action\":\"scan\"}", scan.c_str());
+}
+
+void test_dispatch_cost_per_action(void) {
+    static const char* const MESSAGES[] = {
+        "{\"action\":\"get_status\"}",
+        "{\"action\":\"save_temp_threshold\",\"threshold\":28.5}",
+        "{\"action\":\"control_neo\",\"state\":false}",
+        "{\"action\":\"preview_neo_color\",\"r\":12,\"g\":200,\"b\":7,\"hex\":\"#0cc807\"}",
+        "{\"action\":\"get_history\",\"metric\":\"light\",\"points\":100}",
+        "{\"action\":\"connect\",\"ssid\":\"home network\",\"password\":\"correct horse\"}",
+    };
+    const int rounds = 200000;
+    printf("action                  table ns   String chain ns\n");
+    for (const char* text : MESSAGES) {
+        const size_t len = strlen(text);
+        char buffer[WS_COMMAND_MAX_MESSAGE + 1];
+        WsCommand command;
+        WsWiFiLogin login;
+        // Each round parses a fresh copy, as a new frame would be
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            memcpy(buffer, text, len + 1);
+            TEST_ASSERT_TRUE(ws_command_parse(buffer, len, 1, command, login));
+        }
+        const double tableNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+        const WsCommandType type = command.type;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            memcpy(buffer, text, len + 1);
+            TEST_ASSERT_TRUE(string_chain_parse((const uint8_t*)buffer, len, command, login));
+        }
+        const double chainNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+        TEST_ASSERT_EQUAL_INT(type, command.type);
+        char name[24] = {};
+        sscanf(text, "{\"action\":\"%23[a-z_]", name);
+        printf("%-22s %9.1f %17.1f\n", name, tableNs, chainNs);
+        TEST_ASSERT_LESS_THAN_DOUBLE(chainNs, tableNs);
+    }
+}
+
+void test_queue_coalesces(void) {
+    WsCommandQueue queue;
+    WsCommand command;
+    WsWiFiLogin login;
+    const uint64_t coalescedBefore = metric_ws_commands_coalesced.value();
+
+    // A burst of previews leaves the latest, at the end of the queue
+    queue.push(preview(1));
+    queue.push(request(WS_CMD_GET_STATUS, 1));
+    queue.push(request(WS_CMD_GET_STATUS, 2));
+    for (int r = 2; r <= 100; r++) {
+        TEST_ASSERT_TRUE(queue.push(preview((uint8_t)r, (uint32_t)r)));
+    }
+    // Requests only for the same client
+    queue.push(request(WS_CMD_GET_STATUS, 1));
+    TEST_ASSERT_EQUAL_UINT64(99U + 1U, metric_ws_commands_coalesced.value() - coalescedBefore);
+
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_INT(WS_CMD_GET_STATUS, command.type);
+    TEST_ASSERT_EQUAL_UINT32(2U, command.client);
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_INT(WS_CMD_PREVIEW_NEO_COLOR, command.type);
+    TEST_ASSERT_EQUAL_UINT8(100, command.color.r);
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_UINT32(1U, command.client);
+    TEST_ASSERT_FALSE(queue.pop(command, login, 0));
+
+    // Report rules per metric
+    WsCommand rule = {};
+    rule.type = WS_CMD_SET_REPORT_POLICY;
+    rule.report.metric = HISTORY_LIGHT;
+    queue.push(rule);
+    rule.report.metric = HISTORY_HUMIDITY;
+    queue.push(rule);
+    rule.report.metric = HISTORY_LIGHT;
+    rule.report.rule.deadBand = 9.0f;
+    queue.push(rule);
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_INT(HISTORY_HUMIDITY, command.report.metric);
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_FLOAT(9.0f, command.report.rule.deadBand);
+
+    // The login of the waiting connect is the one of the latest
+    WsCommand connect = {};
+    connect.type = WS_CMD_CONNECT;
+    WsWiFiLogin first = { "first", "one" };
+    WsWiFiLogin second = { "second", "two" };
+    queue.push(connect, &first);
+    queue.push(connect, &second);
+    TEST_ASSERT_TRUE(queue.pop(command, login, 0));
+    TEST_ASSERT_EQUAL_STRING("second", login.ssid);
+
+    // Distinct requests fill the queue, then are refused
+    for (uint32_t client = 1; client <= WS_COMMAND_QUEUE_DEPTH; client++) {
+        TEST_ASSERT_TRUE(queue.push(request(WS_CMD_GET_SENSORS, client)));
+    }
+    TEST_ASSERT_FALSE(queue.push(request(WS_CMD_GET_SENSORS, WS_COMMAND_QUEUE_DEPTH + 1)));
+    // A command of a waiting kind still gets in
+    TEST_ASSERT_TRUE(queue.push(request(WS_CMD_GET_SENSORS, 1)));
+}
+
+// Stands in for the NeoPixel update and broadcast a preview causes
+#define APPLY_US 500
+
+// The clock of the firmware is virtual after the history request above, this one is real
+static void busy_us(int us) {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Time the calling thread spent, the host may have fewer CPUs than the two cores of the tasks
+static double thread_us() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static WsCommandQueue* benchQueue;
+static std::atomic<bool> benchSending(false);
+static std::atomic<bool> workerDone(false);
+static std::atomic<uint32_t> applied(0);
+static std::atomic<int> lastApplied(-1);
+
+static void worker_task(void* parameter) {
+    WsCommand command;
+    WsWiFiLogin login;
+    // Until the queue is empty after the last message
+    while (true) {
+        const bool sending = benchSending;
+        if (benchQueue->pop(command, login, pdMS_TO_TICKS(10))) {
+            busy_us(APPLY_US);
+            lastApplied = command.color.r | command.color.g << 8;
+            applied++;
+        } else if (!sending) {
+            break;
+        }
+    }
+    workerDone = true;
+    vTaskDelete(NULL);
+}
+
+static double percentile_us(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+void test_handler_time_and_throughput(void) {
+    const int messages = 20000;
+    std::vector<std::string> texts;
+    for (int i = 0; i < messages; i++) {
+        char text[128];
+        snprintf(text, sizeof(text), "{\"action\":\"preview_neo_color\",\"r\":%d,\"g\":%d,\"b\":0,\"hex\":\"#%02x%02x00\"}",
+                 i & 0xFF, i >> 8, i & 0xFF, (i >> 8) & 0xFF);
+        texts.push_back(text);
+    }
+    std::vector<double> inlineUs;
+    std::vector<double> queuedUs;
+    WsCommand command;
+    WsWiFiLogin login;
+
+    // Before: the handler applied every preview itself
+    for (int i = 0; i < 1000; i++) {
+        std::string copy = texts[i];
+        const double start = thread_us();
+        ws_command_parse(&copy[0], copy.size(), 1, command, login);
+        busy_us(APPLY_US);
+        inlineUs.push_back(thread_us() - start);
+    }
+
+    // After: it parses and queues, the worker applies what is left after coalescing
+    WsCommandQueue queue;
+    benchQueue = &queue;
+    benchSending = true;
+    xTaskCreatePinnedToCore(worker_task, "WS Commands", 4096, NULL, 1, NULL, 0);
+    const auto runStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        std::string& copy = texts[i];
+        const double start = thread_us();
+        TEST_ASSERT_TRUE(ws_command_parse(&copy[0], copy.size(), 1 + i % 16, command, login));
+        TEST_ASSERT_TRUE(queue.push(command));
+        queuedUs.push_back(thread_us() - start);
+        // 16 dashboards dragging the color picker, 20000 previews a second between them
+        busy_us(50);
+    }
+    const double runS = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    benchSending = false;
+    while (!workerDone) {
+        vTaskDelay(1);
+    }
+
+    printf("handler CPU  p50 us   p99 us   max us\n");
+    printf("inline     %8.2f %8.2f %8.2f\n", percentile_us(inlineUs, 0.5), percentile_us(inlineUs, 0.99), percentile_us(inlineUs, 1.0));
+    printf("queued     %8.2f %8.2f %8.2f\n", percentile_us(queuedUs, 0.5), percentile_us(queuedUs, 0.99), percentile_us(queuedUs, 1.0));
+    printf("%d previews in %.2f s (%.0f/s) applied as %u (%.0f/s)\n", messages, runS, messages / runS,
+           applied.load(), applied.load() / runS);
+
+    // The last preview always reaches the NeoPixel
+    TEST_ASSERT_EQUAL_INT((messages - 1) & 0xFFFF, lastApplied.load());
+    TEST_ASSERT_LESS_THAN_UINT32((uint32_t)messages, applied.load());
+    TEST_ASSERT_LESS_THAN_DOUBLE(APPLY_US / 10.0, percentile_us(queuedUs, 0.5));
+}
+
+int main(int argc, char** argv) {
+    native_task_adopt_main("loopTask", 8192, 1);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_actions);
+    RUN_TEST(test_parse_rejects);
+    RUN_TEST(test_assembler_joins_fragments);
+    RUN_TEST(test_assembler_interleaved_clients);
+    RUN_TEST(test_assembler_overflow);
+    RUN_TEST(test_dispatch_cost_per_action);
+    RUN_TEST(test_queue_coalesces);
+    RUN_TEST(test_handler_time_and_throughput);
+    return UNITY_END();
+}
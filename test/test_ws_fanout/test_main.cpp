@@ -0,0 +1,439 @@
+// WebSocket fan-out (src/ws_fanout.cpp): the queue policy on its own, then a load run with 16
+// real WebSocket clients on the native server, 4 of them reading slowly, once through textAll like
+// the firmware did before and once through WsFanout. Each run reports the heap peak of the server
+// side, the drops of the library and the delivery latency of fast and slow clients; at the end
+// the clients that stopped reading are evicted.
+#include <unity.h>
+#include <Arduino.h>
+#include <AsyncWebSocket.h>
+#include "metrics.h"
+#include "native_board.h"
+#include "ws_fanout.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <malloc.h>
+#include <memory>
+#include <netinet/in.h>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define BOTS 16
+#define SLOW_BOT_BPS 4096
+#define SENSOR_PERIOD_MS 20
+#define SENSOR_FRAME_SIZE 400
+#define CONTROL_EVERY 25
+
+// Heap held by the server side: the bots stand for browsers, their allocations are not counted
+static std::atomic<size_t> heapUsed(0);
+static std::atomic<size_t> heapPeak(0);
+static thread_local bool botThread = false;
+
+void* operator new(size_t size) {
+    void* block = malloc(size);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    if (!botThread) {
+        const size_t used = heapUsed += malloc_usable_size(block);
+        size_t peak = heapPeak.load();
+        while (used > peak && !heapPeak.compare_exchange_weak(peak, used)) {
+        }
+    }
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    if (block) {
+        if (!botThread) {
+            heapUsed -= malloc_usable_size(block);
+        }
+        free(block);
+    }
+}
+
+void operator delete(void* block, size_t) noexcept {
+    operator delete(block);
+}
+
+static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint16_t port;
+static AsyncWebServer* server;
+static AsyncWebSocket* ws;
+static WsFanout* fanout;
+static bool useFanout = false;
+static std::atomic<int> connected(0);
+
+// A dashboard: sensor frames "S <seq> <sent us> ..." and control frames "C <seq> <sent us>"
+struct Bot {
+    bool slow = false;
+    std::atomic<bool> reading{true};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> closed{false};
+    std::vector<uint32_t> latencies;
+    uint32_t sensors = 0;
+    uint32_t controls = 0;
+    uint32_t controlGaps = 0;
+    int lastControl = -1;
+    std::thread thread;
+};
+
+static void bot_run(Bot* bot) {
+    botThread = true;
+    bot->latencies.reserve(100000);
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bot->slow) {
+        // A phone on a weak link: small receive window, read at a fixed rate
+        int buffer = 2048;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        bot->closed = true;
+        close(fd);
+        return;
+    }
+    const char* handshake = "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    send(fd, handshake, strlen(handshake), MSG_NOSIGNAL);
+    std::string response;
+    char c;
+    while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0) {
+        if (recv(fd, &c, 1, 0) != 1) {
+            bot->closed = true;
+            close(fd);
+            return;
+        }
+        response += c;
+    }
+    timeval timeout = { 0, 20000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<uint8_t> input(1 << 16);
+    size_t have = 0;
+    while (!bot->stop && !bot->closed) {
+        if (!bot->reading) {
+            usleep(10000);
+            continue;
+        }
+        size_t want = input.size() - have;
+        if (bot->slow) {
+            want = std::min(want, (size_t)SLOW_BOT_BPS / 50);
+            usleep(20000);
+        }
+        const ssize_t n = recv(fd, input.data() + have, want, 0);
+        if (n == 0) {
+            bot->closed = true;
+        }
+        if (n <= 0) {
+            continue;
+        }
+        have += n;
+        while (have >= 2) {
+            size_t len = input[1] & 0x7F;
+            size_t header = 2;
+            if (len == 126) {
+                if (have < 4) {
+                    break;
+                }
+                len = ((size_t)input[2] << 8) | input[3];
+                header = 4;
+            }
+            if (have < header + len) {
+                break;
+            }
+            const uint8_t opcode = input[0] & 0x0F;
+            if (opcode == WS_DISCONNECT) {
+                bot->closed = true;
+            } else if (opcode == WS_TEXT) {
+                char text[64] = {};
+                memcpy(text, input.data() + header, std::min(len, sizeof(text) - 1));
+                char kind;
+                int seq;
+                unsigned long long sent;
+                if (sscanf(text, "%c %d %llu", &kind, &seq, &sent) == 3) {
+                    bot->latencies.push_back((uint32_t)(now_us() - sent));
+                    if (kind == 'S') {
+                        bot->sensors++;
+                    } else {
+                        bot->controls++;
+                        bot->controlGaps += seq != bot->lastControl + 1;
+                        bot->lastControl = seq;
+                    }
+                }
+            }
+            memmove(input.data(), input.data() + header + len, have - header - len);
+            have -= header + len;
+        }
+    }
+    close(fd);
+}
+
+static void start_bots(std::vector<std::unique_ptr<Bot>>& bots) {
+    for (int i = 0; i < BOTS; i++) {
+        bots.emplace_back(new Bot());
+        bots.back()->slow = i % 4 == 3;
+        bots.back()->thread = std::thread(bot_run, bots.back().get());
+    }
+    for (int wait = 0; wait < 200 && connected < BOTS; wait++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_INT(BOTS, connected.load());
+}
+
+static void stop_bots(std::vector<std::unique_ptr<Bot>>& bots) {
+    for (auto& bot : bots) {
+        bot->stop = true;
+        bot->reading = true;
+        bot->thread.join();
+    }
+    for (int wait = 0; wait < 200 && connected > 0; wait++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_INT(0, connected.load());
+}
+
+struct RunResult {
+    size_t heapPeak;
+    int libraryDrops;
+    uint32_t sent;
+    uint32_t fastP50, fastP99, slowP50, slowP99;
+};
+
+static uint32_t percentile(std::vector<uint32_t> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+// Sensor frames every SENSOR_PERIOD_MS and a control frame every CONTROL_EVERY of them
+static RunResult load_run(std::vector<std::unique_ptr<Bot>>& bots, bool throughFanout, int seconds) {
+    useFanout = throughFanout;
+    start_bots(bots);
+
+    // The library reports every message it drops on stderr
+    char errors[] = "/tmp/ws_fanout_stderr_XXXXXX";
+    const int errorsFd = mkstemp(errors);
+    fflush(stderr);
+    const int savedStderr = dup(STDERR_FILENO);
+    dup2(errorsFd, STDERR_FILENO);
+
+    heapPeak = heapUsed.load();
+    const size_t heapBefore = heapUsed.load();
+    char message[SENSOR_FRAME_SIZE + 1];
+    uint32_t seq = 0;
+    const uint64_t end = now_us() + seconds * 1000000ULL;
+    uint64_t next = now_us();
+    while (now_us() < end) {
+        if (now_us() >= next) {
+            int len = snprintf(message, sizeof(message), "S %u %llu ", seq, (unsigned long long)now_us());
+            memset(message + len, 'x', SENSOR_FRAME_SIZE - len);
+            message[SENSOR_FRAME_SIZE] = '\0';
+            if (throughFanout) {
+                fanout->broadcast(message, SENSOR_FRAME_SIZE, WS_FRAME_SENSOR);
+            } else {
+                ws->textAll(message, SENSOR_FRAME_SIZE);
+            }
+            if (seq % CONTROL_EVERY == 0) {
+                len = snprintf(message, sizeof(message), "C %u %llu", seq / CONTROL_EVERY, (unsigned long long)now_us());
+                if (throughFanout) {
+                    fanout->broadcast(message, len, WS_FRAME_CONTROL);
+                } else {
+                    ws->textAll(message, len);
+                }
+            }
+            seq++;
+            next += SENSOR_PERIOD_MS * 1000U;
+        }
+        if (throughFanout) {
+            fanout->pump();
+        }
+        delay(2);
+    }
+
+    fflush(stderr);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+    int drops = 0;
+    FILE* file = fdopen(errorsFd, "r");
+    rewind(file);
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        drops += strstr(line, "Too many messages queued") != nullptr;
+    }
+    fclose(file);
+    remove(errors);
+
+    std::vector<uint32_t> fast;
+    std::vector<uint32_t> slow;
+    for (auto& bot : bots) {
+        // Reads of the bot thread, it is past every frame of the run
+        (bot->slow ? slow : fast).insert((bot->slow ? slow : fast).end(), bot->latencies.begin(), bot->latencies.end());
+    }
+    RunResult result = { heapPeak - heapBefore, drops, seq, percentile(fast, 0.5), percentile(fast, 0.99),
+                         percentile(slow, 0.5), percentile(slow, 0.99) };
+    printf("%-8s heap peak %7zu B, library drops %5d, fast p50 %6.1f ms p99 %6.1f ms, slow p50 %6.1f ms p99 %6.1f ms\n",
+           throughFanout ? "fanout" : "textAll", result.heapPeak, drops, result.fastP50 / 1000.0, result.fastP99 / 1000.0,
+           result.slowP50 / 1000.0, result.slowP99 / 1000.0);
+    return result;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// Without a socket behind the client nothing is handed to the library, the queue only fills
+void test_queue_policy(void) {
+    AsyncWebSocket socketless("/policy");
+    WsFanout policy(&socketless);
+    policy.addClient(1);
+    const uint64_t droppedBefore = metric_ws_frames_dropped.value();
+    const uint64_t evictionsBefore = metric_ws_evictions.value();
+
+    // Sensor frames beyond the depth replace the oldest ones
+    for (int i = 0; i < 10; i++) {
+        policy.broadcast("s", 1, WS_FRAME_SENSOR);
+    }
+    TEST_ASSERT_EQUAL_UINT64(10U - WS_FANOUT_SENSOR_DEPTH, metric_ws_frames_dropped.value() - droppedBefore);
+    TEST_ASSERT_FALSE(policy.drained());
+
+    // Control frames fill the rest, then push out the sensor frames, one each
+    for (int i = 0; i < WS_FANOUT_QUEUE_DEPTH; i++) {
+        policy.broadcast("c", 1, WS_FRAME_CONTROL);
+    }
+    TEST_ASSERT_EQUAL_UINT64(10U, metric_ws_frames_dropped.value() - droppedBefore);
+    // Full of control frames: a sensor frame is dropped, a control frame closes the client
+    policy.broadcast("s", 1, WS_FRAME_SENSOR);
+    TEST_ASSERT_EQUAL_UINT64(11U, metric_ws_frames_dropped.value() - droppedBefore);
+    TEST_ASSERT_EQUAL_UINT64(0U, metric_ws_evictions.value() - evictionsBefore);
+    policy.send(1, "c", 1, WS_FRAME_CONTROL);
+    TEST_ASSERT_EQUAL_UINT64(1U, metric_ws_evictions.value() - evictionsBefore);
+    // An evicted client gets nothing until it is gone
+    policy.broadcast("s", 1, WS_FRAME_SENSOR);
+    TEST_ASSERT_EQUAL_UINT64(11U, metric_ws_frames_dropped.value() - droppedBefore);
+    TEST_ASSERT_TRUE(policy.drained());
+    policy.removeClient(1);
+
+    // Only WS_FANOUT_MAX_CLIENTS are taken, each of them gets every frame
+    for (uint32_t id = 1; id <= WS_FANOUT_MAX_CLIENTS + 2; id++) {
+        policy.addClient(id);
+    }
+    const uint64_t sharedBefore = metric_ws_frames_dropped.value();
+    for (int i = 0; i < WS_FANOUT_QUEUE_DEPTH - WS_FANOUT_SENSOR_DEPTH; i++) {
+        policy.broadcast("c", 1, WS_FRAME_CONTROL);
+    }
+    for (int i = 0; i < 10; i++) {
+        policy.broadcast("s", 1, WS_FRAME_SENSOR);
+    }
+    TEST_ASSERT_EQUAL_UINT64((10U - WS_FANOUT_SENSOR_DEPTH) * WS_FANOUT_MAX_CLIENTS, metric_ws_frames_dropped.value() - sharedBefore);
+    TEST_ASSERT_EQUAL_UINT64(1U, metric_ws_evictions.value() - evictionsBefore);
+    for (uint32_t id = 1; id <= WS_FANOUT_MAX_CLIENTS; id++) {
+        policy.removeClient(id);
+    }
+    TEST_ASSERT_TRUE(policy.drained());
+}
+
+void test_load_with_mixed_speed_clients(void) {
+    std::vector<std::unique_ptr<Bot>> before;
+    const RunResult textAll = load_run(before, false, 6);
+    stop_bots(before);
+
+    std::vector<std::unique_ptr<Bot>> bots;
+    const uint64_t droppedBefore = metric_ws_frames_dropped.value();
+    const RunResult fanned = load_run(bots, true, 6);
+    printf("fanout dropped %llu sensor frames for the slow clients\n",
+           (unsigned long long)(metric_ws_frames_dropped.value() - droppedBefore));
+
+    // textAll overran the library's queues of the slow clients, the fan-out never does
+    TEST_ASSERT_GREATER_THAN(0, textAll.libraryDrops);
+    TEST_ASSERT_EQUAL_INT(0, fanned.libraryDrops);
+    TEST_ASSERT_LESS_THAN_size_t(textAll.heapPeak, fanned.heapPeak);
+    TEST_ASSERT_LESS_THAN_UINT32(textAll.slowP50, fanned.slowP50);
+    TEST_ASSERT_LESS_THAN_UINT32(100000U, fanned.fastP99);
+
+    for (auto& bot : bots) {
+        TEST_ASSERT_FALSE(bot->closed.load());
+    }
+
+    // The slow clients stop reading: once their queues stayed full for WS_FANOUT_EVICT_MS they are closed
+    for (auto& bot : bots) {
+        if (bot->slow) {
+            bot->reading = false;
+        }
+    }
+    delay(300);
+    fanout->pump();
+    TEST_ASSERT_TRUE(fanout->drained() == false);
+    const uint64_t evictionsBefore = metric_ws_evictions.value();
+    native_clock_set_us((millis() + WS_FANOUT_EVICT_MS + 1000ULL) * 1000ULL);
+    fanout->pump();
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)BOTS / 4, metric_ws_evictions.value() - evictionsBefore);
+    TEST_ASSERT_EQUAL_size_t(BOTS - BOTS / 4, ws->count());
+    TEST_ASSERT_TRUE(fanout->drained());
+    for (auto& bot : bots) {
+        bot->reading = true;
+    }
+    // The clock is virtual now, delay() would not wait. The close frames are behind the backlog
+    // in the socket buffers.
+    auto slowOpen = [&bots]() {
+        int open = 0;
+        for (auto& bot : bots) {
+            open += bot->slow && !bot->closed;
+        }
+        return open;
+    };
+    for (int wait = 0; wait < 1000 && (slowOpen() > 0 || connected > BOTS - BOTS / 4); wait++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_INT(BOTS - BOTS / 4, connected.load());
+    // Control frames are never dropped: in order everywhere, and all of them where the client kept up
+    for (auto& bot : bots) {
+        TEST_ASSERT_EQUAL(bot->slow, bot->closed.load());
+        TEST_ASSERT_EQUAL_UINT32(0U, bot->controlGaps);
+        if (!bot->slow) {
+            TEST_ASSERT_EQUAL_UINT32((fanned.sent + CONTROL_EVERY - 1) / CONTROL_EVERY, bot->controls);
+        }
+    }
+    stop_bots(bots);
+}
+
+int main(int argc, char** argv) {
+    native_task_adopt_main("loopTask", 8192, 1);
+    port = 20000 + getpid() % 20000;
+    server = new AsyncWebServer(port);
+    ws = new AsyncWebSocket("/ws");
+    fanout = new WsFanout(ws);
+    ws->onEvent([](AsyncWebSocket*, AsyncWebSocketClient* client, AwsEventType type, void*, uint8_t*, size_t) {
+        if (type == WS_EVT_CONNECT) {
+            if (useFanout) {
+                fanout->addClient(client->id());
+            }
+            connected++;
+        } else if (type == WS_EVT_DISCONNECT) {
+            fanout->removeClient(client->id());
+            connected--;
+        }
+    });
+    server->addHandler(ws);
+    server->begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_policy);
+    RUN_TEST(test_load_with_mixed_speed_clients);
+    return UNITY_END();
+}